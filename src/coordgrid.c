@@ -0,0 +1,150 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, Viking Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <math.h>
+#include "coordgrid.h"
+
+#define CELL_SIZE (2*VIK_COORD_EQUALISH_TOLERANCE)
+
+typedef struct {
+  gint64 ns;
+  gint64 ew;
+  gint zone; // -1 for Lat/Lon
+} CoordGridCell;
+
+// The first entry in a cell is also its key in the hash table
+typedef struct _CoordGridEntry {
+  CoordGridCell cell;
+  VikCoord coord;
+  gpointer data;
+  struct _CoordGridEntry *next;
+} CoordGridEntry;
+
+struct _CoordGrid {
+  GHashTable *cells;
+  guint size;
+};
+
+static guint cell_hash ( gconstpointer key )
+{
+  const CoordGridCell *cell = key;
+  guint64 hh = (guint64)cell->ns * G_GUINT64_CONSTANT(0x9E3779B97F4A7C15);
+  hh ^= (guint64)cell->ew + G_GUINT64_CONSTANT(0x632BE59BD9B4E019) + (hh << 6) + (hh >> 2);
+  hh ^= (guint64)(cell->zone + 1) * 83492791;
+  return (guint)(hh ^ (hh >> 32));
+}
+
+static gboolean cell_equal ( gconstpointer aa, gconstpointer bb )
+{
+  const CoordGridCell *ca = aa;
+  const CoordGridCell *cb = bb;
+  return ca->ns == cb->ns && ca->ew == cb->ew && ca->zone == cb->zone;
+}
+
+static void cell_free ( gpointer data )
+{
+  CoordGridEntry *entry = data;
+  while ( entry ) {
+    CoordGridEntry *next = entry->next;
+    g_free ( entry );
+    entry = next;
+  }
+}
+
+static void cell_of ( const VikCoord *coord, CoordGridCell *cell )
+{
+  cell->ns = (gint64)floor ( coord->north_south / CELL_SIZE );
+  cell->ew = (gint64)floor ( coord->east_west / CELL_SIZE );
+  cell->zone = coord->mode == VIK_COORD_LATLON ? -1 : coord->utm_zone;
+}
+
+CoordGrid *coord_grid_new ( void )
+{
+  CoordGrid *cg = g_new0 ( CoordGrid, 1 );
+  cg->cells = g_hash_table_new_full ( cell_hash, cell_equal, NULL, cell_free );
+  return cg;
+}
+
+void coord_grid_free ( CoordGrid *cg )
+{
+  if ( !cg )
+    return;
+  g_hash_table_destroy ( cg->cells );
+  g_free ( cg );
+}
+
+guint coord_grid_size ( const CoordGrid *cg )
+{
+  return cg->size;
+}
+
+/**
+ * coord_grid_add:
+ *
+ * Add an item at the specified position.
+ * The data should not be NULL, as that is indistinguishable from not found.
+ */
+void coord_grid_add ( CoordGrid *cg, const VikCoord *coord, gpointer data )
+{
+  CoordGridEntry *entry = g_new ( CoordGridEntry, 1 );
+  cell_of ( coord, &entry->cell );
+  entry->coord = *coord;
+  entry->data = data;
+  entry->next = NULL;
+
+  // Insert after the head, so the key remains valid
+  CoordGridEntry *head = g_hash_table_lookup ( cg->cells, &entry->cell );
+  if ( head ) {
+    entry->next = head->next;
+    head->next = entry;
+  }
+  else
+    g_hash_table_insert ( cg->cells, &entry->cell, entry );
+  cg->size++;
+}
+
+/**
+ * coord_grid_find_equalish:
+ * @func: Optional additional test of each item at an equalish position
+ *
+ * Returns: The data of an item at a position that is #vik_coord_equalish() to the coord
+ *  (and satisfies the match function), or NULL if there is none.
+ */
+gpointer coord_grid_find_equalish ( const CoordGrid *cg, const VikCoord *coord, CoordGridMatchFunc func, gpointer user_data )
+{
+  CoordGridCell centre, cell;
+  cell_of ( coord, &centre );
+  cell.zone = centre.zone;
+  for ( gint dy = -1; dy <= 1; dy++ ) {
+    cell.ns = centre.ns + dy;
+    for ( gint dx = -1; dx <= 1; dx++ ) {
+      cell.ew = centre.ew + dx;
+      for ( CoordGridEntry *entry = g_hash_table_lookup ( cg->cells, &cell ); entry; entry = entry->next ) {
+        if ( vik_coord_equalish ( &entry->coord, coord ) &&
+             ( !func || func ( entry->data, user_data ) ) )
+          return entry->data;
+      }
+    }
+  }
+  return NULL;
+}
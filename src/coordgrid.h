@@ -0,0 +1,53 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, Viking Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef _VIKING_COORDGRID_H
+#define _VIKING_COORDGRID_H
+
+#include <glib.h>
+
+#include "vikcoord.h"
+
+G_BEGIN_DECLS
+
+/*
+ * A spatial hash of items by position, for finding items at (nearly) the same place.
+ *
+ * Positions are quantised into cells twice the size of the #vik_coord_equalish() tolerance,
+ *  so any equalish position must be within the same or one of the eight neighbouring cells.
+ * Thus finding a match takes constant time, rather than comparing against every item.
+ */
+typedef struct _CoordGrid CoordGrid;
+
+/*
+ * Further test of a potential match (e.g. same symbol)
+ */
+typedef gboolean (*CoordGridMatchFunc) ( gpointer data, gpointer user_data );
+
+CoordGrid *coord_grid_new ( void );
+void coord_grid_free ( CoordGrid *cg );
+
+guint coord_grid_size ( const CoordGrid *cg );
+void coord_grid_add ( CoordGrid *cg, const VikCoord *coord, gpointer data );
+gpointer coord_grid_find_equalish ( const CoordGrid *cg, const VikCoord *coord, CoordGridMatchFunc func, gpointer user_data );
+
+G_END_DECLS
+
+#endif
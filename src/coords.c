@@ -92,6 +92,12 @@ char *a_coords_dtostr ( double d )
 #define EquatorialRadius 6378137
 #define EccentricitySquared 0.00669438
 
+/*
+ * The bulk functions work through the arrays in blocks of this many points,
+ *  so the temporary arrays stay on the stack and in cache
+ */
+#define COORDS_BLOCK_SIZE 256
+
 static char coords_utm_letter( double latitude );
 
 int a_coords_utm_equal( const struct UTM *utm1, const struct UTM *utm2 )
@@ -101,7 +107,7 @@ int a_coords_utm_equal( const struct UTM *utm1, const struct UTM *utm2 )
 
 double a_coords_utm_diff( const struct UTM *utm1, const struct UTM *utm2 )
 {
-  static struct LatLon tmp1, tmp2;
+  struct LatLon tmp1, tmp2;
   if ( utm1->zone == utm2->zone ) {
     return sqrt ( pow ( utm1->easting - utm2->easting, 2 ) + pow ( utm1->northing - utm2->northing, 2 ) );
   } else {
@@ -111,6 +117,13 @@ double a_coords_utm_diff( const struct UTM *utm1, const struct UTM *utm2 )
   }
 }
 
+/*
+ * Spherical Law of Cosines, given the sin & cos of both latitudes (in radians)
+ *  - shared so the single and bulk versions give the same answers
+ */
+#define COORDS_LATLON_DIFF(sin_lat1,cos_lat1,lon1,sin_lat2,cos_lat2,lon2) \
+  (EquatorialRadius * acos((sin_lat1)*(sin_lat2)+(cos_lat1)*(cos_lat2)*cos((lon1)-(lon2))))
+
 /**
  * a_coords_latlon_diff:
  *
@@ -119,75 +132,225 @@ double a_coords_utm_diff( const struct UTM *utm1, const struct UTM *utm2 )
  */
 double a_coords_latlon_diff ( const struct LatLon *ll1, const struct LatLon *ll2 )
 {
-  static struct LatLon tmp1, tmp2;
-  gdouble tmp3;
-  tmp1.lat = ll1->lat * PIOVER180;
-  tmp1.lon = ll1->lon * PIOVER180;
-  tmp2.lat = ll2->lat * PIOVER180;
-  tmp2.lon = ll2->lon * PIOVER180;
-  tmp3 = EquatorialRadius * acos(sin(tmp1.lat)*sin(tmp2.lat)+cos(tmp1.lat)*cos(tmp2.lat)*cos(tmp1.lon-tmp2.lon));
+  double lat1 = ll1->lat * PIOVER180;
+  double lat2 = ll2->lat * PIOVER180;
+  double tmp = COORDS_LATLON_DIFF ( sin(lat1), cos(lat1), ll1->lon * PIOVER180,
+                                    sin(lat2), cos(lat2), ll2->lon * PIOVER180 );
   // For very small differences we can sometimes get NaN returned
-  return isnan(tmp3)?0:tmp3;
+  return isnan(tmp)?0:tmp;
 }
 
-void a_coords_latlon_to_utm( const struct LatLon *latlon, struct UTM *utm )
-    {
-    double latitude;
-    double longitude;
-    double lat_rad, long_rad;
-    double long_origin, long_origin_rad;
-    double eccPrimeSquared;
-    double N, T, C, A, M;
-    int zone;
-    double northing, easting;
+/*
+ * Differences for a block of points following on from the previous point,
+ *  whose sin, cos of latitude and longitude (in radians) are given in prev[] and updated on return
+ */
+static void coords_latlon_diff_block ( const double *lat, const double *lon, size_t len, double prev[3], double *out )
+{
+  double sin_lat[COORDS_BLOCK_SIZE+1];
+  double cos_lat[COORDS_BLOCK_SIZE+1];
+  double lon_rad[COORDS_BLOCK_SIZE+1];
+  size_t ii;
+
+  sin_lat[0] = prev[0];
+  cos_lat[0] = prev[1];
+  lon_rad[0] = prev[2];
+  // Each latitude is only needed once, rather than for both of the pairs it is in
+  for ( ii = 0; ii < len; ii++ ) {
+    double lat_rad = lat[ii] * PIOVER180;
+    sin_lat[ii+1] = sin ( lat_rad );
+    cos_lat[ii+1] = cos ( lat_rad );
+    lon_rad[ii+1] = lon[ii] * PIOVER180;
+  }
+  for ( ii = 0; ii < len; ii++ ) {
+    double tmp = COORDS_LATLON_DIFF ( sin_lat[ii+1], cos_lat[ii+1], lon_rad[ii+1],
+                                      sin_lat[ii], cos_lat[ii], lon_rad[ii] );
+    out[ii] = isnan(tmp)?0:tmp;
+  }
+  prev[0] = sin_lat[len];
+  prev[1] = cos_lat[len];
+  prev[2] = lon_rad[len];
+}
 
-    longitude = latlon->lon;
-    latitude = latlon->lat;
+/**
+ * a_coords_latlon_diff_n:
+ * @lat: Latitudes of @n points
+ * @lon: Longitudes of @n points
+ * @n:   Number of points
+ * @out: Receives for each point the distance from the previous one (0 for the first point)
+ *
+ * Gives the same values as a_coords_latlon_diff() on each consecutive pair of points,
+ *  but much faster for many points.
+ *
+ * Returns: The total distance
+ */
+double a_coords_latlon_diff_n ( const double *lat, const double *lon, size_t n, double *out )
+{
+  double total = 0.0;
+  double prev[3];
+
+  if ( n == 0 )
+    return total;
+
+  double lat_rad = lat[0] * PIOVER180;
+  prev[0] = sin ( lat_rad );
+  prev[1] = cos ( lat_rad );
+  prev[2] = lon[0] * PIOVER180;
+  out[0] = 0.0;
+
+  for ( size_t first = 1; first < n; first += COORDS_BLOCK_SIZE ) {
+    size_t len = MIN ( COORDS_BLOCK_SIZE, n - first );
+    coords_latlon_diff_block ( lat+first, lon+first, len, prev, out+first );
+    for ( size_t ii = 0; ii < len; ii++ )
+      total += out[first+ii];
+  }
+  return total;
+}
+
+/*
+ * Terms of the UTM series that only depend on the ellipsoid
+ */
+#define EccPrimeSquared ( EccentricitySquared / ( 1.0 - EccentricitySquared ) )
+#define UTM_M1 ( 1.0 - EccentricitySquared / 4 - 3 * EccentricitySquared * EccentricitySquared / 64 - 5 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 256 )
+#define UTM_M2 ( 3 * EccentricitySquared / 8 + 3 * EccentricitySquared * EccentricitySquared / 32 + 45 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 1024 )
+#define UTM_M3 ( 15 * EccentricitySquared * EccentricitySquared / 256 + 45 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 1024 )
+#define UTM_M4 ( 35 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 3072 )
+
+/* +3 puts origin in middle of zone */
+#define UTM_LONG_ORIGIN(zone) ( ( (zone) - 1 ) * 6 - 180 + 3 )
+
+/*
+ * The UTM zone of a point, also bringing the longitude within -180..180
+ */
+static int coords_utm_zone ( double latitude, double *longitude )
+{
+    int zone;
 
     /* We want the longitude within -180..180. */
-    if ( longitude < -180.0 )
-	longitude += 360.0;
-    if ( longitude > 180.0 )
-	longitude -= 360.0;
-
-    /* Now convert. */
-    lat_rad = DEG2RAD(latitude);
-    long_rad = DEG2RAD(longitude);
-    zone = (int) ( ( longitude + 180 ) / 6 ) + 1;
+    if ( *longitude < -180.0 )
+	*longitude += 360.0;
+    if ( *longitude > 180.0 )
+	*longitude -= 360.0;
+
+    zone = (int) ( ( *longitude + 180 ) / 6 ) + 1;
     if ( latitude >= 56.0 && latitude < 64.0 &&
-	 longitude >= 3.0 && longitude < 12.0 )
+	 *longitude >= 3.0 && *longitude < 12.0 )
 	zone = 32;
     /* Special zones for Svalbard. */
     if ( latitude >= 72.0 && latitude < 84.0 )
 	{
-	if      ( longitude >= 0.0  && longitude <  9.0 ) zone = 31;
-	else if ( longitude >= 9.0  && longitude < 21.0 ) zone = 33;
-	else if ( longitude >= 21.0 && longitude < 33.0 ) zone = 35;
-	else if ( longitude >= 33.0 && longitude < 42.0 ) zone = 37;
+	if      ( *longitude >= 0.0  && *longitude <  9.0 ) zone = 31;
+	else if ( *longitude >= 9.0  && *longitude < 21.0 ) zone = 33;
+	else if ( *longitude >= 21.0 && *longitude < 33.0 ) zone = 35;
+	else if ( *longitude >= 33.0 && *longitude < 42.0 ) zone = 37;
 	}
-    long_origin = ( zone - 1 ) * 6 - 180 + 3;	/* +3 puts origin in middle of zone */
-    long_origin_rad = DEG2RAD(long_origin);
-    eccPrimeSquared = EccentricitySquared / ( 1.0 - EccentricitySquared );
-    N = EquatorialRadius / sqrt( 1.0 - EccentricitySquared * sin( lat_rad ) * sin( lat_rad ) );
-    T = tan( lat_rad ) * tan( lat_rad );
-    C = eccPrimeSquared * cos( lat_rad ) * cos( lat_rad );
-    A = cos( lat_rad ) * ( long_rad - long_origin_rad );
-    M = EquatorialRadius * ( ( 1.0 - EccentricitySquared / 4 - 3 * EccentricitySquared * EccentricitySquared / 64 - 5 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 256 ) * lat_rad - ( 3 * EccentricitySquared / 8 + 3 * EccentricitySquared * EccentricitySquared / 32 + 45 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 1024 ) * sin( 2 * lat_rad ) + ( 15 * EccentricitySquared * EccentricitySquared / 256 + 45 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 1024 ) * sin( 4 * lat_rad ) - ( 35 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 3072 ) * sin( 6 * lat_rad ) );
-    easting =
-	K0 * N * ( A + ( 1 - T + C ) * A * A * A / 6 + ( 5 - 18 * T + T * T + 72 * C - 58 * eccPrimeSquared ) * A * A * A * A * A / 120 ) + 500000.0;
-    northing =
-	K0 * ( M + N * tan( lat_rad ) * ( A * A / 2 + ( 5 - T + 9 * C + 4 * C * C ) * A * A * A * A / 24 + ( 61 - 58 * T + T * T + 600 * C - 330 * eccPrimeSquared ) * A * A * A * A * A * A / 720 ) );
-    if ( latitude < 0.0 )
-	northing += 10000000.0;  /* 1e7 meter offset for southern hemisphere */
-
-    utm->northing = northing;
-    utm->easting = easting;
-    utm->zone = zone;
-    utm->letter = coords_utm_letter( latitude );
-
-    /* All done. */
+    return zone;
+}
+
+/*
+ * The rest of the conversion to UTM, once the maths library functions are worked out.
+ * This is only arithmetic, so the loop over a block of points can be vectorised.
+ * @dlon_rad: Longitude relative to the origin of the zone
+ * @root:     sqrt ( 1 - e^2 * sin^2(lat) )
+ */
+static inline void coords_latlon_to_utm_series ( double lat_rad, double dlon_rad,
+                                                 double cos_lat, double tan_lat,
+                                                 double sin_2lat, double sin_4lat, double sin_6lat,
+                                                 double root, double false_northing,
+                                                 double *northing, double *easting )
+{
+    double N = EquatorialRadius / root;
+    double T = tan_lat * tan_lat;
+    double C = EccPrimeSquared * cos_lat * cos_lat;
+    double A = cos_lat * dlon_rad;
+    double M = EquatorialRadius * ( UTM_M1 * lat_rad - UTM_M2 * sin_2lat + UTM_M3 * sin_4lat - UTM_M4 * sin_6lat );
+    *easting =
+	K0 * N * ( A + ( 1 - T + C ) * A * A * A / 6 + ( 5 - 18 * T + T * T + 72 * C - 58 * EccPrimeSquared ) * A * A * A * A * A / 120 ) + 500000.0;
+    *northing =
+	K0 * ( M + N * tan_lat * ( A * A / 2 + ( 5 - T + 9 * C + 4 * C * C ) * A * A * A * A / 24 + ( 61 - 58 * T + T * T + 600 * C - 330 * EccPrimeSquared ) * A * A * A * A * A * A / 720 ) ) + false_northing;
+}
+
+static void coords_latlon_to_utm( double latitude, double longitude, double *northing_out, double *easting_out, char *zone_out, char *letter_out )
+    {
+    int zone = coords_utm_zone ( latitude, &longitude );
+    double lat_rad = DEG2RAD(latitude);
+    double sin_lat = sin( lat_rad );
+
+    coords_latlon_to_utm_series ( lat_rad, DEG2RAD(longitude) - DEG2RAD(UTM_LONG_ORIGIN(zone)),
+                                  cos( lat_rad ), tan( lat_rad ),
+                                  sin( 2 * lat_rad ), sin( 4 * lat_rad ), sin( 6 * lat_rad ),
+                                  sqrt( 1.0 - EccentricitySquared * sin_lat * sin_lat ),
+                                  latitude < 0.0 ? 10000000.0 : 0.0, /* 1e7 meter offset for southern hemisphere */
+                                  northing_out, easting_out );
+    *zone_out = zone;
+    *letter_out = coords_utm_letter( latitude );
     }
 
+void a_coords_latlon_to_utm( const struct LatLon *latlon, struct UTM *utm )
+{
+  coords_latlon_to_utm ( latlon->lat, latlon->lon, &utm->northing, &utm->easting, &utm->zone, &utm->letter );
+}
+
+/*
+ * Convert a block of points, first working out the zones and the maths library functions for all of them,
+ *  then the remaining arithmetic in one simple loop
+ */
+static void coords_latlon_to_utm_block ( const double *lat, const double *lon, size_t len,
+                                         double *northing, double *easting, char *zone, char *letter )
+{
+  double lat_rad[COORDS_BLOCK_SIZE];
+  double dlon_rad[COORDS_BLOCK_SIZE];
+  double cos_lat[COORDS_BLOCK_SIZE];
+  double tan_lat[COORDS_BLOCK_SIZE];
+  double sin_2lat[COORDS_BLOCK_SIZE];
+  double sin_4lat[COORDS_BLOCK_SIZE];
+  double sin_6lat[COORDS_BLOCK_SIZE];
+  double root[COORDS_BLOCK_SIZE];
+  double false_northing[COORDS_BLOCK_SIZE];
+  // Points are normally in runs within the same zone
+  int last_zone = 0;
+  double long_origin_rad = 0.0;
+  size_t ii;
+
+  for ( ii = 0; ii < len; ii++ ) {
+    double longitude = lon[ii];
+    int zz = coords_utm_zone ( lat[ii], &longitude );
+    if ( zz != last_zone ) {
+      last_zone = zz;
+      long_origin_rad = DEG2RAD(UTM_LONG_ORIGIN(zz));
+    }
+    zone[ii] = zz;
+    letter[ii] = coords_utm_letter ( lat[ii] );
+    lat_rad[ii] = DEG2RAD(lat[ii]);
+    dlon_rad[ii] = DEG2RAD(longitude) - long_origin_rad;
+    false_northing[ii] = lat[ii] < 0.0 ? 10000000.0 : 0.0;
+
+    double sin_lat = sin ( lat_rad[ii] );
+    cos_lat[ii] = cos ( lat_rad[ii] );
+    tan_lat[ii] = tan ( lat_rad[ii] );
+    sin_2lat[ii] = sin ( 2 * lat_rad[ii] );
+    sin_4lat[ii] = sin ( 4 * lat_rad[ii] );
+    sin_6lat[ii] = sin ( 6 * lat_rad[ii] );
+    root[ii] = sqrt ( 1.0 - EccentricitySquared * sin_lat * sin_lat );
+  }
+
+  for ( ii = 0; ii < len; ii++ )
+    coords_latlon_to_utm_series ( lat_rad[ii], dlon_rad[ii], cos_lat[ii], tan_lat[ii],
+                                  sin_2lat[ii], sin_4lat[ii], sin_6lat[ii], root[ii], false_northing[ii],
+                                  &northing[ii], &easting[ii] );
+}
+
+/**
+ * a_coords_latlon_to_utm_n:
+ *
+ * Convert @n points, giving the same values as a_coords_latlon_to_utm() on each one
+ */
+void a_coords_latlon_to_utm_n ( const double *lat, const double *lon, size_t n,
+                                double *northing, double *easting, char *zone, char *letter )
+{
+  for ( size_t first = 0; first < n; first += COORDS_BLOCK_SIZE )
+    coords_latlon_to_utm_block ( lat+first, lon+first, MIN(COORDS_BLOCK_SIZE, n - first),
+                                 northing+first, easting+first, zone+first, letter+first );
+}
 
 static char coords_utm_letter( double latitude )
     {
@@ -220,55 +383,128 @@ static char coords_utm_letter( double latitude )
 
 
 
-void a_coords_utm_to_latlon( const struct UTM *utm, struct LatLon *latlon )
+
+/*
+ * Coefficients of the series for the footpoint latitude
+ */
+static void coords_utm_phi1_coefficients ( double coeff[3] )
+{
+    double e1 = ( 1.0 - sqrt( 1.0 - EccentricitySquared ) ) / ( 1.0 + sqrt( 1.0 - EccentricitySquared ) );
+    coeff[0] = 3 * e1 / 2 - 27 * e1 * e1 * e1 / 32;
+    coeff[1] = 21 * e1 * e1 / 16 - 55 * e1 * e1 * e1 * e1 / 32;
+    coeff[2] = 151 * e1 * e1 * e1 / 96;
+}
+
+/*
+ * The footpoint latitude (in radians) for the northing,
+ *  with the offset for the southern hemisphere already removed
+ */
+static inline double coords_utm_phi1 ( double y, const double coeff[3] )
+{
+    double M = y / K0;
+    double mu = M / ( EquatorialRadius * UTM_M1 );
+    return mu + coeff[0] * sin( 2 * mu ) + coeff[1] * sin( 4 * mu ) + coeff[2] * sin( 6 * mu );
+}
+
+/*
+ * The rest of the conversion from UTM, once the maths library functions are worked out.
+ * This is only arithmetic, so the loop over a block of points can be vectorised.
+ * @w:   1 - e^2 * sin^2(phi1)
+ * @root:       sqrt ( @w )
+ * @root_cubed: pow ( @w, 1.5 )
+ */
+static inline void coords_utm_to_latlon_series ( double x, double long_origin, double phi1_rad,
+                                                 double cos_phi1, double tan_phi1, double root, double root_cubed,
+                                                 double *lat_out, double *lon_out )
+{
+    double N1 = EquatorialRadius / root;
+    double T1 = tan_phi1 * tan_phi1;
+    double C1 = EccPrimeSquared * cos_phi1 * cos_phi1;
+    double R1 = EquatorialRadius * ( 1.0 - EccentricitySquared ) / root_cubed;
+    double D = x / ( N1 * K0 );
+    double latitude = phi1_rad - ( N1 * tan_phi1 / R1 ) * ( D * D / 2 -( 5 + 3 * T1 + 10 * C1 - 4 * C1 * C1 - 9 * EccPrimeSquared ) * D * D * D * D / 24 + ( 61 + 90 * T1 + 298 * C1 + 45 * T1 * T1 - 252 * EccPrimeSquared - 3 * C1 * C1 ) * D * D * D * D * D * D / 720 );
+    double longitude = ( D - ( 1 + 2 * T1 + C1 ) * D * D * D / 6 + ( 5 - 2 * C1 + 28 * T1 - 3 * C1 * C1 + 8 * EccPrimeSquared + 24 * T1 * T1 ) * D * D * D * D * D / 120 ) / cos_phi1;
+    *lat_out = RAD2DEG(latitude);
+    *lon_out = long_origin + RAD2DEG(longitude);
+}
+
+static void coords_utm_to_latlon( double northing, double easting, int zone, char letter, double *lat_out, double *lon_out )
     {
-    double northing, easting;
-    int zone;
-    char letter[100];
-    double x, y;
-    double eccPrimeSquared;
-    double e1;
-    double N1, T1, C1, R1, D, M;
-    double long_origin;
-    double mu, phi1_rad;
-    double latitude, longitude;
-
-    northing = utm->northing;
-    easting = utm->easting;
-    zone = utm->zone;
-    letter[0] = utm->letter;
-
-    /* Now convert. */
-    x = easting - 500000.0;	/* remove 500000 meter offset */
-    y = northing;
-    if ( ( *letter - 'N' ) < 0 ) {
+    double coeff[3];
+    double y = northing;
+    double phi1_rad, sin_phi1, w;
+
+    if ( ( letter - 'N' ) < 0 ) {
       /* southern hemisphere */
       y -= 10000000.0;	/* remove 1e7 meter offset */
     }
 
-    long_origin = ( zone - 1 ) * 6 - 180 + 3;	/* +3 puts origin in middle of zone */
-    eccPrimeSquared = EccentricitySquared / ( 1.0 - EccentricitySquared );
-    e1 = ( 1.0 - sqrt( 1.0 - EccentricitySquared ) ) / ( 1.0 + sqrt( 1.0 - EccentricitySquared ) );
-    M = y / K0;
-    mu = M / ( EquatorialRadius * ( 1.0 - EccentricitySquared / 4 - 3 * EccentricitySquared * EccentricitySquared / 64 - 5 * EccentricitySquared * EccentricitySquared * EccentricitySquared / 256 ) );
-    phi1_rad = mu + ( 3 * e1 / 2 - 27 * e1 * e1 * e1 / 32 )* sin( 2 * mu ) + ( 21 * e1 * e1 / 16 - 55 * e1 * e1 * e1 * e1 / 32 ) * sin( 4 * mu ) + ( 151 * e1 * e1 * e1 / 96 ) * sin( 6 *mu );
-    N1 = EquatorialRadius / sqrt( 1.0 - EccentricitySquared * sin( phi1_rad ) * sin( phi1_rad ) );
-    T1 = tan( phi1_rad ) * tan( phi1_rad );
-    C1 = eccPrimeSquared * cos( phi1_rad ) * cos( phi1_rad );
-    R1 = EquatorialRadius * ( 1.0 - EccentricitySquared ) / pow( 1.0 - EccentricitySquared * sin( phi1_rad ) * sin( phi1_rad ), 1.5 );
-    D = x / ( N1 * K0 );
-    latitude = phi1_rad - ( N1 * tan( phi1_rad ) / R1 ) * ( D * D / 2 -( 5 + 3 * T1 + 10 * C1 - 4 * C1 * C1 - 9 * eccPrimeSquared ) * D * D * D * D / 24 + ( 61 + 90 * T1 + 298 * C1 + 45 * T1 * T1 - 252 * eccPrimeSquared - 3 * C1 * C1 ) * D * D * D * D * D * D / 720 );
-    latitude = RAD2DEG(latitude);
-    longitude = ( D - ( 1 + 2 * T1 + C1 ) * D * D * D / 6 + ( 5 - 2 * C1 + 28 * T1 - 3 * C1 * C1 + 8 * eccPrimeSquared + 24 * T1 * T1 ) * D * D * D * D * D / 120 ) / cos( phi1_rad );
-    longitude = long_origin + RAD2DEG(longitude);
-
-    /* Show results. */
-
-    latlon->lat = latitude;
-    latlon->lon = longitude;
+    coords_utm_phi1_coefficients ( coeff );
+    phi1_rad = coords_utm_phi1 ( y, coeff );
+    sin_phi1 = sin( phi1_rad );
+    w = 1.0 - EccentricitySquared * sin_phi1 * sin_phi1;
 
+    coords_utm_to_latlon_series ( easting - 500000.0,	/* remove 500000 meter offset */
+                                  UTM_LONG_ORIGIN(zone), phi1_rad,
+                                  cos( phi1_rad ), tan( phi1_rad ), sqrt( w ), pow( w, 1.5 ),
+                                  lat_out, lon_out );
     }
 
+void a_coords_utm_to_latlon( const struct UTM *utm, struct LatLon *latlon )
+{
+  coords_utm_to_latlon ( utm->northing, utm->easting, utm->zone, utm->letter, &latlon->lat, &latlon->lon );
+}
+
+/*
+ * Convert a block of points, first working out the maths library functions for all of them,
+ *  then the remaining arithmetic in one simple loop
+ */
+static void coords_utm_to_latlon_block ( const double *northing, const double *easting, const char *zone, const char *letter, size_t len,
+                                         const double coeff[3], double *lat, double *lon )
+{
+  double long_origin[COORDS_BLOCK_SIZE];
+  double phi1_rad[COORDS_BLOCK_SIZE];
+  double cos_phi1[COORDS_BLOCK_SIZE];
+  double tan_phi1[COORDS_BLOCK_SIZE];
+  double root[COORDS_BLOCK_SIZE];
+  double root_cubed[COORDS_BLOCK_SIZE];
+  size_t ii;
+
+  for ( ii = 0; ii < len; ii++ ) {
+    double y = northing[ii];
+    if ( ( letter[ii] - 'N' ) < 0 )
+      y -= 10000000.0;
+    long_origin[ii] = UTM_LONG_ORIGIN(zone[ii]);
+    phi1_rad[ii] = coords_utm_phi1 ( y, coeff );
+    double sin_phi1 = sin ( phi1_rad[ii] );
+    double w = 1.0 - EccentricitySquared * sin_phi1 * sin_phi1;
+    cos_phi1[ii] = cos ( phi1_rad[ii] );
+    tan_phi1[ii] = tan ( phi1_rad[ii] );
+    root[ii] = sqrt ( w );
+    root_cubed[ii] = pow ( w, 1.5 );
+  }
+
+  for ( ii = 0; ii < len; ii++ )
+    coords_utm_to_latlon_series ( easting[ii] - 500000.0, long_origin[ii], phi1_rad[ii],
+                                  cos_phi1[ii], tan_phi1[ii], root[ii], root_cubed[ii],
+                                  &lat[ii], &lon[ii] );
+}
+
+/**
+ * a_coords_utm_to_latlon_n:
+ *
+ * Convert @n points, giving the same values as a_coords_utm_to_latlon() on each one
+ */
+void a_coords_utm_to_latlon_n ( const double *northing, const double *easting, const char *zone, const char *letter, size_t n,
+                                double *lat, double *lon )
+{
+  double coeff[3];
+  coords_utm_phi1_coefficients ( coeff );
+  for ( size_t first = 0; first < n; first += COORDS_BLOCK_SIZE )
+    coords_utm_to_latlon_block ( northing+first, easting+first, zone+first, letter+first, MIN(COORDS_BLOCK_SIZE, n - first),
+                                 coeff, lat+first, lon+first );
+}
+
 void a_coords_latlon_to_string ( const struct LatLon *latlon,
 				 gchar **lat,
 				 gchar **lon )
@@ -59,6 +59,13 @@ void a_coords_utm_to_latlon ( const struct UTM *utm, struct LatLon *latlon );
 double a_coords_utm_diff( const struct UTM *utm1, const struct UTM *utm2 );
 double a_coords_latlon_diff ( const struct LatLon *ll1, const struct LatLon *ll2 );
 
+/* Bulk versions, for many points at once */
+double a_coords_latlon_diff_n ( const double *lat, const double *lon, size_t n, double *out );
+void a_coords_latlon_to_utm_n ( const double *lat, const double *lon, size_t n,
+                                double *northing, double *easting, char *zone, char *letter );
+void a_coords_utm_to_latlon_n ( const double *northing, const double *easting, const char *zone, const char *letter, size_t n,
+                                double *lat, double *lon );
+
 /**
  * Convert a double to a string WITHOUT LOCALE.
  *
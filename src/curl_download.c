@@ -63,6 +63,12 @@ static size_t curl_write_func(void *ptr, size_t size, size_t nmemb, FILE *stream
   return fwrite(ptr, size, nmemb, stream);
 }
 
+static size_t curl_write_mem_func(void *ptr, size_t size, size_t nmemb, GByteArray *content)
+{
+  g_byte_array_append ( content, ptr, size * nmemb );
+  return size * nmemb;
+}
+
 static size_t curl_get_etag_func(void *ptr, size_t size, size_t nmemb, void *stream)
 {
 #define ETAG_KEYWORD "ETag: "
@@ -102,6 +108,13 @@ static char *get_cookie_file ( gboolean init )
 static gint curl_ssl_verifypeer = 1; // https://curl.haxx.se/libcurl/c/CURLOPT_SSL_VERIFYPEER.html
 static gchar* curl_cainfo = NULL;    // https://curl.haxx.se/libcurl/c/CURLOPT_CAINFO.html
 
+#define VIK_SETTINGS_CURL_MULTI_TRANSFERS "curl_multi_transfers"
+#define VIK_SETTINGS_CURL_MULTI_HOST_TRANSFERS "curl_multi_host_transfers"
+static gint curl_multi_transfers = 32;
+static gint curl_multi_host_transfers = 8;
+
+static void curl_multi_stop ( void );
+
 /* This should to be called from main() to make sure thread safe */
 void curl_download_init()
 {
@@ -127,11 +140,17 @@ void curl_download_init()
     curl_cainfo = g_strdup ( str );
     g_free ( str );
   }
+  gint num;
+  if ( a_settings_get_integer ( VIK_SETTINGS_CURL_MULTI_TRANSFERS, &num ) && num > 0 )
+    curl_multi_transfers = num;
+  if ( a_settings_get_integer ( VIK_SETTINGS_CURL_MULTI_HOST_TRANSFERS, &num ) && num > 0 )
+    curl_multi_host_transfers = num;
 }
 
 /* This should to be called from main() to make sure thread safe */
 void curl_download_uninit()
 {
+  curl_multi_stop ();
   curl_global_cleanup();
   g_free ( curl_cainfo );
   // Cookie file does not persist between sessions
@@ -174,21 +193,22 @@ static void common_opts ( CURL *curl, const char *uri, DownloadFileOptions *opti
 }
 
 /**
+ * Set up all the options for downloading the uri into the file
  *
+ * Returns: Any headers to be freed once the download is complete
  */
-CURL_download_t curl_download_uri ( const char *uri, FILE *f, DownloadFileOptions *options, CurlDownloadOptions *cdo, void *handle )
+static struct curl_slist *download_setup ( CURL *curl, const char *uri, FILE *f, DownloadFileOptions *options, CurlDownloadOptions *cdo )
 {
-  CURL *curl;
   struct curl_slist *curl_send_headers = NULL;
-  CURLcode res = CURLE_FAILED_INIT;
 
-  curl = handle ? handle : curl_easy_init ();
-  if ( !curl ) {
-    return CURL_DOWNLOAD_ERROR;
-  }
   common_opts ( curl, uri, options );
-  curl_easy_setopt ( curl, CURLOPT_WRITEDATA, f );
-  curl_easy_setopt ( curl, CURLOPT_WRITEFUNCTION, curl_write_func);
+  if ( cdo != NULL && cdo->content != NULL ) {
+    curl_easy_setopt ( curl, CURLOPT_WRITEDATA, cdo->content );
+    curl_easy_setopt ( curl, CURLOPT_WRITEFUNCTION, curl_write_mem_func );
+  } else {
+    curl_easy_setopt ( curl, CURLOPT_WRITEDATA, f );
+    curl_easy_setopt ( curl, CURLOPT_WRITEFUNCTION, curl_write_func);
+  }
   if (options != NULL) {
     if (cdo != NULL) {
       if(options->check_file_server_time && cdo->time_condition != 0) {
@@ -230,13 +250,20 @@ CURL_download_t curl_download_uri ( const char *uri, FILE *f, DownloadFileOption
   if ( curl_send_headers )
     curl_easy_setopt ( curl, CURLOPT_HTTPHEADER , curl_send_headers );
 
-  res = curl_easy_perform ( curl );
+  return curl_send_headers;
+}
 
+/**
+ * Interpret the outcome of a download
+ */
+static CURL_download_t download_result ( CURL *curl, CURLcode res, const char *uri )
+{
+  CURL_download_t result;
   if (res == CURLE_OK) {
     glong response;
     curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response);
     if (response == 304) {         // 304 = Not Modified
-      res = CURL_DOWNLOAD_NO_NEWER_FILE;
+      result = CURL_DOWNLOAD_NO_NEWER_FILE;
     } else if (response == 200 ||  // http: 200 = Ok
                response == 226) {  // ftp:  226 = sucess
       gdouble size;
@@ -244,64 +271,468 @@ CURL_download_t curl_download_uri ( const char *uri, FILE *f, DownloadFileOption
          when the server has a (incorrect) time earlier than the time on the file we already have */
       curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD, &size);
       if (size == 0)
-        res = CURL_DOWNLOAD_ERROR;
+        result = CURL_DOWNLOAD_ERROR;
       else
-        res = CURL_DOWNLOAD_NO_ERROR;
+        result = CURL_DOWNLOAD_NO_ERROR;
     } else {
       g_warning("%s: http response: %ld for uri %s", __FUNCTION__, response, uri);
-      res = CURL_DOWNLOAD_ERROR;
+      result = CURL_DOWNLOAD_ERROR;
     }
   } else if (res == CURLE_ABORTED_BY_CALLBACK) {
-    res = CURL_DOWNLOAD_ABORTED;
+    result = CURL_DOWNLOAD_ABORTED;
   } else {
     g_warning ( "%s: curl error: %d for uri %s", __FUNCTION__, res, uri );
-    res = CURL_DOWNLOAD_ERROR;
+    result = CURL_DOWNLOAD_ERROR;
   }
+  return result;
+}
+
+static void download_cleanup ( CURL *curl, struct curl_slist *curl_send_headers )
+{
   if (curl_send_headers) {
     curl_slist_free_all(curl_send_headers);
-    curl_send_headers = NULL;
     curl_easy_setopt ( curl, CURLOPT_HTTPHEADER , NULL);
   }
+}
+
+/**
+ *
+ */
+CURL_download_t curl_download_uri ( const char *uri, FILE *f, DownloadFileOptions *options, CurlDownloadOptions *cdo, void *handle )
+{
+  CURL *curl;
+
+  curl = handle ? handle : curl_easy_init ();
+  if ( !curl ) {
+    return CURL_DOWNLOAD_ERROR;
+  }
+  struct curl_slist *curl_send_headers = download_setup ( curl, uri, f, options, cdo );
+
+  CURL_download_t res = download_result ( curl, curl_easy_perform(curl), uri );
+
+  download_cleanup ( curl, curl_send_headers );
   if (!handle)
      curl_easy_cleanup ( curl );
   return res;
 }
 
 /**
- * curl_download_get_url:
- *  Either hostname and/or uri should be defined
+ * Either hostname and/or uri should be defined
  *
+ * Returns: The full url (to be freed after use) or NULL if it can't be determined
  */
-CURL_download_t curl_download_get_url ( const char *hostname, const char *uri, FILE *f, DownloadFileOptions *options, gboolean ftp, CurlDownloadOptions *cdo, void *handle )
+static gchar *get_full_url ( const char *hostname, const char *uri, gboolean ftp )
 {
-  gchar *full = NULL;
-
   if ( hostname && strstr ( hostname, "://" ) != NULL ) {
     if ( uri && strlen ( uri ) > 1 )
       // Simply append them together
-      full = g_strdup_printf ( "%s%s", hostname, uri );
+      return g_strdup_printf ( "%s%s", hostname, uri );
     else
       /* Already full url */
-      full = (gchar *) hostname;
+      return g_strdup ( hostname );
   }
   else if ( uri && strstr ( uri, "://" ) != NULL )
     /* Already full url */
-    full = (gchar *) uri;
+    return g_strdup ( uri );
   else if ( hostname && uri )
     /* Compose the full url */
-    full = g_strdup_printf ( "%s://%s%s", (ftp?"ftp":"http"), hostname, uri );
-  else {
+    return g_strdup_printf ( "%s://%s%s", (ftp?"ftp":"http"), hostname, uri );
+  return NULL;
+}
+
+/**
+ * curl_download_get_url:
+ *  Either hostname and/or uri should be defined
+ *
+ */
+CURL_download_t curl_download_get_url ( const char *hostname, const char *uri, FILE *f, DownloadFileOptions *options, gboolean ftp, CurlDownloadOptions *cdo, void *handle )
+{
+  gchar *full = get_full_url ( hostname, uri, ftp );
+  if ( !full )
     return CURL_DOWNLOAD_ERROR;
-  }
 
   CURL_download_t ret = curl_download_uri ( full, f, options, cdo, handle );
-  // Only free newly allocated memory
-  if ( hostname != full && uri != full )
-    g_free ( full );
+  g_free ( full );
 
   return ret;
 }
 
+/*
+ * Downloading many files at once
+ *
+ * A single thread drives all these downloads via the curl multi interface,
+ *  thus connections are kept open and shared between downloads from the same server
+ *  (and with HTTP/2 the downloads are multiplexed over the one connection),
+ *  rather than each download waiting on its own request/response round trip in turn.
+ * Downloads are started in order of priority (lowest value first),
+ *  subject to limits on the number of simultaneous transfers in total and per server.
+ */
+typedef struct {
+  gchar *url;
+  gchar *host;     // Scheme, server and port - for the per server limit
+  FILE *f;
+  DownloadFileOptions *options;
+  CurlDownloadOptions *cdo;
+  gdouble priority;
+  guint64 sequence; // Keeps requests of the same priority in the order they were made
+  guint group;
+  CurlDownloadDoneFunc done_func;
+  gpointer user_data;
+  GSequenceIter *queued; // When waiting to be started
+  CURL *curl;
+  struct curl_slist *headers;
+} CurlMultiJob;
+
+static struct {
+  GMutex mutex;
+  GThread *thread;
+  gboolean quit;
+  CURLM *handle;     // Only used by the download thread
+  GSList *spare;     // Easy handles for reuse - only used by the download thread
+  GList *active;     // Of CurlMultiJob in progress - only used by the download thread
+  GSequence *queue;  // Of CurlMultiJob, in order of priority
+  GHashTable *host_transfers; // Number of transfers in progress by host
+  guint transfers;   // In progress in total
+  GSList *cancelled; // Groups whose transfers in progress are to be abandoned
+  guint64 sequence;
+  guint group;
+} multi;
+
+/*
+ * The scheme, server and port part of the url
+ */
+static gchar *get_host ( const gchar *url )
+{
+  const gchar *start = strstr ( url, "://" );
+  start = start ? start + 3 : url;
+  const gchar *end = strchr ( start, '/' );
+  return end ? g_strndup ( url, end - url ) : g_strdup ( url );
+}
+
+static gint job_compare ( gconstpointer aa, gconstpointer bb, gpointer user_data )
+{
+  const CurlMultiJob *ja = aa;
+  const CurlMultiJob *jb = bb;
+  if ( ja->priority < jb->priority )
+    return -1;
+  if ( ja->priority > jb->priority )
+    return 1;
+  return (ja->sequence < jb->sequence) ? -1 : (ja->sequence > jb->sequence);
+}
+
+static void job_free ( CurlMultiJob *job )
+{
+  g_free ( job->url );
+  g_free ( job->host );
+  g_free ( job );
+}
+
+// Should be called with the mutex held
+static void wakeup ( void )
+{
+#if LIBCURL_VERSION_NUM >= 0x074400
+  if ( multi.handle )
+    curl_multi_wakeup ( multi.handle );
+#endif
+  // Otherwise the download thread notices within its polling interval
+}
+
+/*
+ * Start as many of the queued jobs as the limits allow
+ * Should be called from the download thread
+ */
+static void multi_start_jobs ( void )
+{
+  GSList *starting = NULL;
+
+  g_mutex_lock ( &multi.mutex );
+  GSequenceIter *iter = g_sequence_get_begin_iter ( multi.queue );
+  while ( multi.transfers < curl_multi_transfers && !g_sequence_iter_is_end(iter) ) {
+    CurlMultiJob *job = g_sequence_get ( iter );
+    GSequenceIter *next = g_sequence_iter_next ( iter );
+    guint host_transfers = GPOINTER_TO_UINT ( g_hash_table_lookup(multi.host_transfers, job->host) );
+    if ( host_transfers < curl_multi_host_transfers ) {
+      g_sequence_remove ( iter );
+      job->queued = NULL;
+      g_hash_table_insert ( multi.host_transfers, g_strdup(job->host), GUINT_TO_POINTER(host_transfers+1) );
+      multi.transfers++;
+      starting = g_slist_prepend ( starting, job );
+    }
+    iter = next;
+  }
+  g_mutex_unlock ( &multi.mutex );
+
+  // NB Order of adding doesn't matter as they all get started straight away
+  for ( GSList *sl = starting; sl; sl = sl->next ) {
+    CurlMultiJob *job = sl->data;
+    if ( multi.spare ) {
+      job->curl = multi.spare->data;
+      multi.spare = g_slist_delete_link ( multi.spare, multi.spare );
+    }
+    else
+      job->curl = curl_easy_init ();
+    job->headers = download_setup ( job->curl, job->url, job->f, job->options, job->cdo );
+    curl_easy_setopt ( job->curl, CURLOPT_PRIVATE, job );
+#if LIBCURL_VERSION_NUM >= 0x072B00
+    // Prefer waiting to share an existing connection (via HTTP/2 multiplexing), rather than opening a new one
+    curl_easy_setopt ( job->curl, CURLOPT_PIPEWAIT, 1L );
+#endif
+#if LIBCURL_VERSION_NUM >= 0x072F00
+    curl_easy_setopt ( job->curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS );
+#endif
+    curl_multi_add_handle ( multi.handle, job->curl );
+    multi.active = g_list_prepend ( multi.active, job );
+  }
+  g_slist_free ( starting );
+}
+
+/*
+ * Should be called from the download thread
+ */
+static void multi_finish_job ( CurlMultiJob *job, CURL_download_t result )
+{
+  curl_multi_remove_handle ( multi.handle, job->curl );
+  multi.active = g_list_remove ( multi.active, job );
+  download_cleanup ( job->curl, job->headers );
+  curl_easy_reset ( job->curl );
+  multi.spare = g_slist_prepend ( multi.spare, job->curl );
+
+  g_mutex_lock ( &multi.mutex );
+  guint host_transfers = GPOINTER_TO_UINT ( g_hash_table_lookup(multi.host_transfers, job->host) );
+  if ( host_transfers > 1 )
+    g_hash_table_insert ( multi.host_transfers, g_strdup(job->host), GUINT_TO_POINTER(host_transfers-1) );
+  else
+    g_hash_table_remove ( multi.host_transfers, job->host );
+  multi.transfers--;
+  g_mutex_unlock ( &multi.mutex );
+
+  job->done_func ( result, job->user_data );
+  job_free ( job );
+}
+
+/*
+ * Abandon the transfers in progress of any groups cancelled since last time
+ * Should be called from the download thread
+ */
+static void multi_abort_cancelled ( void )
+{
+  g_mutex_lock ( &multi.mutex );
+  GSList *groups = multi.cancelled;
+  multi.cancelled = NULL;
+  g_mutex_unlock ( &multi.mutex );
+
+  GList *iter = multi.active;
+  while ( groups && iter ) {
+    CurlMultiJob *job = iter->data;
+    // Finishing the job removes it from the list
+    iter = iter->next;
+    if ( g_slist_find(groups, GUINT_TO_POINTER(job->group)) )
+      multi_finish_job ( job, CURL_DOWNLOAD_ABORTED );
+  }
+  g_slist_free ( groups );
+}
+
+static gpointer multi_thread ( gpointer data )
+{
+  gboolean quit = FALSE;
+  while ( !quit ) {
+    multi_start_jobs ();
+    // After starting jobs, so those of a cancelled group that have only just been started are stopped too
+    multi_abort_cancelled ();
+
+    int running;
+    curl_multi_perform ( multi.handle, &running );
+
+    CURLMsg *msg;
+    int msgs_left;
+    while ( (msg = curl_multi_info_read(multi.handle, &msgs_left)) ) {
+      if ( msg->msg == CURLMSG_DONE ) {
+        CurlMultiJob *job;
+        curl_easy_getinfo ( msg->easy_handle, CURLINFO_PRIVATE, (char**)&job );
+        multi_finish_job ( job, download_result(job->curl, msg->data.result, job->url) );
+      }
+    }
+
+    g_mutex_lock ( &multi.mutex );
+    quit = multi.quit;
+    g_mutex_unlock ( &multi.mutex );
+
+    // Wait for activity on any transfer or (when supported) for a new download to be added
+    if ( !quit )
+#if LIBCURL_VERSION_NUM >= 0x074400
+      curl_multi_poll ( multi.handle, NULL, 0, 1000, NULL );
+#else
+      curl_multi_wait ( multi.handle, NULL, 0, 100, NULL );
+#endif
+  }
+
+  // Abandon anything still in progress
+  while ( multi.active )
+    multi_finish_job ( multi.active->data, CURL_DOWNLOAD_ABORTED );
+
+  return NULL;
+}
+
+/**
+ * curl_download_multi_new_group:
+ *
+ * Returns: A new identifier for a collection of downloads, that can then be cancelled together
+ */
+guint curl_download_multi_new_group ( void )
+{
+  g_mutex_lock ( &multi.mutex );
+  guint group = ++multi.group;
+  g_mutex_unlock ( &multi.mutex );
+  return group;
+}
+
+/**
+ * curl_download_multi_add:
+ * @hostname:  As per curl_download_get_url()
+ * @uri:       As per curl_download_get_url()
+ * @f:         Where to write the downloaded data
+ * @options:   Download options (maybe NULL)
+ * @ftp:       As per curl_download_get_url()
+ * @cdo:       Curl specific options (maybe NULL). When cdo->content is set, @f is not used
+ * @priority:  Downloads with lower values are started first
+ * @group:     From curl_download_multi_new_group() or 0 if not to be cancelled by group
+ * @done_func: Called on completion, either from the download thread
+ *             or from the thread cancelling the download
+ * @user_data: Passed to @done_func
+ *
+ * Queue a download. All the parameters must remain valid until @done_func is called.
+ *
+ * Returns: FALSE if the download could not be queued, in which case @done_func will not be called
+ */
+gboolean curl_download_multi_add ( const char *hostname, const char *uri, FILE *f, DownloadFileOptions *options, gboolean ftp,
+                                   CurlDownloadOptions *cdo, gdouble priority, guint group,
+                                   CurlDownloadDoneFunc done_func, gpointer user_data )
+{
+  gchar *url = get_full_url ( hostname, uri, ftp );
+  if ( !url )
+    return FALSE;
+
+  CurlMultiJob *job = g_malloc0 ( sizeof(CurlMultiJob) );
+  job->url = url;
+  job->host = get_host ( url );
+  job->f = f;
+  job->options = options;
+  job->cdo = cdo;
+  job->priority = priority;
+  job->group = group;
+  job->done_func = done_func;
+  job->user_data = user_data;
+
+  g_mutex_lock ( &multi.mutex );
+  if ( multi.quit ) {
+    g_mutex_unlock ( &multi.mutex );
+    job_free ( job );
+    return FALSE;
+  }
+  // Start the download thread on first use
+  if ( !multi.thread ) {
+    multi.handle = curl_multi_init ();
+#if LIBCURL_VERSION_NUM >= 0x072B00
+    curl_multi_setopt ( multi.handle, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX );
+#endif
+    curl_multi_setopt ( multi.handle, CURLMOPT_MAX_HOST_CONNECTIONS, (long)curl_multi_host_transfers );
+    curl_multi_setopt ( multi.handle, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)curl_multi_transfers );
+    multi.queue = g_sequence_new ( NULL );
+    multi.host_transfers = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+    multi.thread = g_thread_try_new ( "curl_multi_thread", multi_thread, NULL, NULL );
+    if ( !multi.thread ) {
+      g_warning ( "%s: Failed to start download thread", __FUNCTION__ );
+      curl_multi_cleanup ( multi.handle );
+      multi.handle = NULL;
+      g_mutex_unlock ( &multi.mutex );
+      job_free ( job );
+      return FALSE;
+    }
+  }
+  job->sequence = multi.sequence++;
+  job->queued = g_sequence_insert_sorted ( multi.queue, job, job_compare, NULL );
+  wakeup ();
+  g_mutex_unlock ( &multi.mutex );
+  return TRUE;
+}
+
+/**
+ * curl_download_multi_cancel_group:
+ * @in_progress: Whether to abandon the downloads already started too,
+ *               otherwise they are left to complete, since most of their cost may have been paid
+ *
+ * Cancel all the downloads of the group that have not yet been started.
+ * The completion function of each cancelled download is called with %CURL_DOWNLOAD_ABORTED,
+ *  from this thread for those not yet started or shortly after from the download thread
+ *  for those in progress.
+ */
+void curl_download_multi_cancel_group ( guint group, gboolean in_progress )
+{
+  GSList *cancelled = NULL;
+  g_mutex_lock ( &multi.mutex );
+  if ( in_progress && multi.thread && !g_slist_find(multi.cancelled, GUINT_TO_POINTER(group)) ) {
+    multi.cancelled = g_slist_prepend ( multi.cancelled, GUINT_TO_POINTER(group) );
+    wakeup ();
+  }
+  if ( multi.queue ) {
+    GSequenceIter *iter = g_sequence_get_begin_iter ( multi.queue );
+    while ( !g_sequence_iter_is_end(iter) ) {
+      CurlMultiJob *job = g_sequence_get ( iter );
+      GSequenceIter *next = g_sequence_iter_next ( iter );
+      if ( job->group == group ) {
+        g_sequence_remove ( iter );
+        job->queued = NULL;
+        cancelled = g_slist_prepend ( cancelled, job );
+      }
+      iter = next;
+    }
+  }
+  g_mutex_unlock ( &multi.mutex );
+
+  cancelled = g_slist_reverse ( cancelled );
+  for ( GSList *sl = cancelled; sl; sl = sl->next ) {
+    CurlMultiJob *job = sl->data;
+    job->done_func ( CURL_DOWNLOAD_ABORTED, job->user_data );
+    job_free ( job );
+  }
+  g_slist_free ( cancelled );
+}
+
+/*
+ * Stop the download thread, abandoning all queued and in progress downloads
+ */
+static void curl_multi_stop ( void )
+{
+  g_mutex_lock ( &multi.mutex );
+  multi.quit = TRUE;
+  wakeup ();
+  GThread *thread = multi.thread;
+  g_mutex_unlock ( &multi.mutex );
+  if ( !thread )
+    return;
+
+  g_thread_join ( thread );
+
+  // Anything not yet started
+  GSequenceIter *iter = g_sequence_get_begin_iter ( multi.queue );
+  while ( !g_sequence_iter_is_end(iter) ) {
+    CurlMultiJob *job = g_sequence_get ( iter );
+    job->done_func ( CURL_DOWNLOAD_ABORTED, job->user_data );
+    job_free ( job );
+    iter = g_sequence_iter_next ( iter );
+  }
+  g_sequence_free ( multi.queue );
+  multi.queue = NULL;
+  g_slist_free_full ( multi.spare, (GDestroyNotify)curl_easy_cleanup );
+  multi.spare = NULL;
+  curl_multi_cleanup ( multi.handle );
+  multi.handle = NULL;
+  g_hash_table_destroy ( multi.host_transfers );
+  g_slist_free ( multi.cancelled );
+  multi.cancelled = NULL;
+  multi.thread = NULL;
+}
+
 
 struct MemoryStruct {
   char *data;
@@ -49,6 +49,10 @@ typedef struct {
    * Etag sent by server on this download
    */
   char *new_etag;
+  /**
+   * When set the downloaded data is collected here, rather than written to the file
+   */
+  GByteArray *content;
 
 } CurlDownloadOptions;
 
@@ -61,6 +65,13 @@ void curl_download_handle_cleanup ( void * handle );
 
 char* curl_download_get_ptr ( const char *uri, DownloadFileOptions *options );
 
+typedef void (*CurlDownloadDoneFunc) ( CURL_download_t result, gpointer user_data );
+guint curl_download_multi_new_group ( void );
+gboolean curl_download_multi_add ( const char *hostname, const char *uri, FILE *f, DownloadFileOptions *options, gboolean ftp,
+                                   CurlDownloadOptions *cdo, gdouble priority, guint group,
+                                   CurlDownloadDoneFunc done_func, gpointer user_data );
+void curl_download_multi_cancel_group ( guint group, gboolean in_progress );
+
 G_END_DECLS
 
 #endif
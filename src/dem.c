@@ -244,7 +244,6 @@ static void dem_parse_block ( gchar *buffer, VikDEM *dem, gint *cur_column, gint
 
 static VikDEM *vik_dem_read_srtm_hgt(const gchar *file_name, const gchar *basename, gboolean zip)
 {
-  gint i, j;
   VikDEM *dem;
   off_t file_size;
   gint16 *dem_mem = NULL;
@@ -256,29 +255,9 @@ static VikDEM *vik_dem_read_srtm_hgt(const gchar *file_name, const gchar *basena
   gint arcsec;
   GError *error = NULL;
 
-  dem = g_malloc(sizeof(VikDEM));
-
-  dem->horiz_units = VIK_DEM_HORIZ_LL_ARCSECONDS;
-  dem->orig_vert_units = VIK_DEM_VERT_DECIMETERS;
-
-  /* TODO */
-  dem->min_north = atoi(basename+1) * 3600;
-  dem->min_east = atoi(basename+4) * 3600;
-  if ( basename[0] == 'S' )
-    dem->min_north = - dem->min_north;
-  if ( basename[3] == 'W' )
-    dem->min_east = - dem->min_east;
-
-  dem->max_north = 3600 + dem->min_north;
-  dem->max_east = 3600 + dem->min_east;
-
-  dem->columns = g_ptr_array_new();
-  dem->n_columns = 0;
-
   if ((mf = g_mapped_file_new(file_name, FALSE, &error)) == NULL) {
     g_critical(_("Couldn't map file %s: %s"), file_name, error->message);
     g_error_free(error);
-    g_free(dem);
     return NULL;
   }
   file_size = g_mapped_file_get_length(mf);
@@ -288,13 +267,12 @@ static VikDEM *vik_dem_read_srtm_hgt(const gchar *file_name, const gchar *basena
     void *unzip_mem = NULL;
     gulong ucsize;
 
-    if ((unzip_mem = unzip_file(dem_file, &ucsize)) == NULL) {
-      g_mapped_file_unref(mf);
-      g_ptr_array_foreach ( dem->columns, (GFunc)g_free, NULL );
-      g_ptr_array_free(dem->columns, TRUE);
-      g_free(dem);
+    unzip_mem = unzip_file(dem_file, &ucsize);
+    // Uncompressed data is held in memory, so the compressed file is no longer needed
+    g_mapped_file_unref(mf);
+    mf = NULL;
+    if ( unzip_mem == NULL )
       return NULL;
-    }
 
     dem_mem = unzip_mem;
     file_size = ucsize;
@@ -308,35 +286,42 @@ static VikDEM *vik_dem_read_srtm_hgt(const gchar *file_name, const gchar *basena
     arcsec = 1;
   else {
     g_warning("%s(): file %s does not have right size", __PRETTY_FUNCTION__, basename);
-    g_mapped_file_unref(mf);
-    g_free(dem);
+    if (zip)
+      g_free(dem_mem);
+    else
+      g_mapped_file_unref(mf);
     return NULL;
   }
 
-  num_rows = (arcsec == 3) ? num_rows_3sec : num_rows_1sec;
-  dem->east_scale = dem->north_scale = arcsec;
+  dem = g_malloc0(sizeof(VikDEM));
 
-  for ( i = 0; i < num_rows; i++ ) {
-    dem->n_columns++;
-    g_ptr_array_add ( dem->columns, g_malloc(sizeof(VikDEMColumn)) );
-    GET_COLUMN(dem,i)->east_west = dem->min_east + arcsec*i;
-    GET_COLUMN(dem,i)->south = dem->min_north;
-    GET_COLUMN(dem,i)->n_points = num_rows;
-    GET_COLUMN(dem,i)->points = g_malloc(sizeof(gint16)*num_rows);
-  }
+  dem->horiz_units = VIK_DEM_HORIZ_LL_ARCSECONDS;
+  dem->orig_vert_units = VIK_DEM_VERT_DECIMETERS;
 
-  int ent = 0;
-  for ( i = (num_rows - 1); i >= 0; i-- ) {
-    for ( j = 0; j < num_rows; j++ ) {
-      GET_COLUMN(dem,j)->points[i] = GINT16_FROM_BE(dem_mem[ent]);
-      ent++;
-    }
+  /* TODO */
+  dem->min_north = atoi(basename+1) * 3600;
+  dem->min_east = atoi(basename+4) * 3600;
+  if ( basename[0] == 'S' )
+    dem->min_north = - dem->min_north;
+  if ( basename[3] == 'W' )
+    dem->min_east = - dem->min_east;
 
-  }
+  dem->max_north = 3600 + dem->min_north;
+  dem->max_east = 3600 + dem->min_east;
 
+  num_rows = (arcsec == 3) ? num_rows_3sec : num_rows_1sec;
+  dem->east_scale = dem->north_scale = arcsec;
+
+  // Values are left as they are in the file, and only converted when read
+  //  thus for an uncompressed file only the parts actually used are paged in
+  dem->columns = g_ptr_array_new();
+  dem->n_columns = num_rows;
+  dem->grid = dem_mem;
+  dem->mapped = mf;
   if (zip)
-    g_free(dem_mem);
-  g_mapped_file_unref(mf);
+    dem->grid_mem = dem_mem;
+  dem->file = g_strdup ( file_name );
+
   return dem;
 }
 
@@ -364,7 +349,7 @@ VikDEM *vik_dem_new_from_file(const gchar *file)
   }
 
       /* Create Structure */
-  rv = g_malloc(sizeof(VikDEM));
+  rv = g_malloc0(sizeof(VikDEM));
 
       /* Header */
   f = g_fopen(file, "r");
@@ -423,21 +408,297 @@ VikDEM *vik_dem_new_from_file(const gchar *file)
 void vik_dem_free ( VikDEM *dem )
 {
   guint i;
-  for ( i = 0; i < dem->n_columns; i++)
+  for ( i = 0; i < dem->columns->len; i++)
     g_free ( GET_COLUMN(dem, i)->points );
   g_ptr_array_foreach ( dem->columns, (GFunc)g_free, NULL );
   g_ptr_array_free ( dem->columns, TRUE );
+  if ( dem->overviews )
+    g_ptr_array_free ( dem->overviews, TRUE );
+  if ( dem->overviews_mapped )
+    g_mapped_file_unref ( dem->overviews_mapped );
+  if ( dem->mapped )
+    g_mapped_file_unref ( dem->mapped );
+  g_free ( dem->grid_mem );
+  g_free ( dem->file );
   g_free ( dem );
 }
 
 gint16 vik_dem_get_xy ( VikDEM *dem, guint col, guint row )
 {
+  if ( dem->grid ) {
+    if ( col < dem->n_columns && row < dem->n_columns )
+      return GINT16_FROM_BE ( dem->grid[(dem->n_columns - 1 - row) * dem->n_columns + col] );
+    return VIK_DEM_INVALID_ELEVATION;
+  }
   if ( col < dem->n_columns )
     if ( row < GET_COLUMN(dem, col)->n_points )
       return GET_COLUMN(dem, col)->points[row];
   return VIK_DEM_INVALID_ELEVATION;
 }
 
+/*
+ * Overviews
+ *
+ * Each overview halves the resolution of the previous one (starting from the grid),
+ *  with each value being the average of the valid values it covers.
+ * Since generating them requires reading all of the data,
+ *  they are saved in the cache directory for reuse (and are then memory mapped).
+ */
+typedef struct {
+  guint factor;      // Relative to the grid
+  guint n_columns;   // Also the number of rows
+  const gint16 *points; // Native byte order, with the southern row first
+  gint16 *mem;       // When not from the mapped file
+} DEMOverview;
+
+typedef struct {
+  gchar magic[8];
+  guint32 version;
+  guint32 byte_order;
+  gint64 source_size;
+  gint64 source_mtime;
+  guint32 n_columns;
+  guint32 n_overviews;
+} DEMOverviewHeader;
+
+#define DEM_OVERVIEW_MAGIC "VIKDEMOV"
+#define DEM_OVERVIEW_VERSION 1
+#define DEM_OVERVIEW_BYTE_ORDER 0x01020304
+// Stop once the overview is this small
+#define DEM_OVERVIEW_MIN_COLUMNS 32
+
+static void dem_overview_free ( DEMOverview *ov )
+{
+  g_free ( ov->mem );
+  g_free ( ov );
+}
+
+static guint dem_overview_count ( guint n_columns )
+{
+  guint count = 0;
+  while ( n_columns > DEM_OVERVIEW_MIN_COLUMNS ) {
+    n_columns = (n_columns + 1) / 2;
+    count++;
+  }
+  return count;
+}
+
+/*
+ * The saved overviews are named by a hash of the full path,
+ *  as DEM files in different directories often have the same name (e.g. from different sources)
+ */
+static gchar *dem_overview_filename ( VikDEM *dem )
+{
+  gchar *path;
+  if ( g_path_is_absolute(dem->file) )
+    path = g_strdup ( dem->file );
+  else {
+    gchar *cwd = g_get_current_dir ();
+    path = g_build_filename ( cwd, dem->file, NULL );
+    g_free ( cwd );
+  }
+  gchar *hash = g_compute_checksum_for_string ( G_CHECKSUM_SHA1, path, -1 );
+  g_free ( path );
+  gchar *name = g_strdup_printf ( "%s-%s.ovr", a_file_basename(dem->file), hash );
+  gchar *filename = g_build_filename ( g_get_user_cache_dir(), PACKAGE, "dem", name, NULL );
+  g_free ( name );
+  g_free ( hash );
+  return filename;
+}
+
+static gint16 dem_overview_source_value ( VikDEM *dem, DEMOverview *src, guint col, guint row )
+{
+  if ( src )
+    return src->points[row * src->n_columns + col];
+  return vik_dem_get_xy ( dem, col, row );
+}
+
+static DEMOverview *dem_overview_generate ( VikDEM *dem, DEMOverview *src )
+{
+  guint src_columns = src ? src->n_columns : dem->n_columns;
+  DEMOverview *ov = g_malloc0 ( sizeof(DEMOverview) );
+  ov->factor = src ? src->factor * 2 : 2;
+  ov->n_columns = (src_columns + 1) / 2;
+  ov->mem = g_malloc ( ov->n_columns * ov->n_columns * sizeof(gint16) );
+  ov->points = ov->mem;
+
+  for ( guint row = 0; row < ov->n_columns; row++ ) {
+    for ( guint col = 0; col < ov->n_columns; col++ ) {
+      gint sum = 0;
+      guint count = 0;
+      for ( guint rr = row*2; rr < MIN(row*2+2, src_columns); rr++ ) {
+        for ( guint cc = col*2; cc < MIN(col*2+2, src_columns); cc++ ) {
+          gint16 elev = dem_overview_source_value ( dem, src, cc, rr );
+          if ( elev != VIK_DEM_INVALID_ELEVATION ) {
+            sum += elev;
+            count++;
+          }
+        }
+      }
+      ov->mem[row * ov->n_columns + col] = count ? (gint16)(sum / (gint)count) : VIK_DEM_INVALID_ELEVATION;
+    }
+  }
+  return ov;
+}
+
+static gboolean dem_overviews_load ( VikDEM *dem, const gchar *filename, GStatBuf *stat_buf )
+{
+  GMappedFile *mf = g_mapped_file_new ( filename, FALSE, NULL );
+  if ( !mf )
+    return FALSE;
+
+  const gchar *contents = g_mapped_file_get_contents ( mf );
+  gsize length = g_mapped_file_get_length ( mf );
+  guint n_overviews = dem_overview_count ( dem->n_columns );
+  gsize expected = sizeof(DEMOverviewHeader);
+  guint n_columns = dem->n_columns;
+  for ( guint ii = 0; ii < n_overviews; ii++ ) {
+    n_columns = (n_columns + 1) / 2;
+    expected += n_columns * n_columns * sizeof(gint16);
+  }
+
+  DEMOverviewHeader header;
+  if ( length != expected ) {
+    g_mapped_file_unref ( mf );
+    return FALSE;
+  }
+  memcpy ( &header, contents, sizeof(header) );
+  // Anything different (e.g. the source file has been updated) means it needs regenerating
+  if ( memcmp ( header.magic, DEM_OVERVIEW_MAGIC, sizeof(header.magic) ) != 0 ||
+       header.version != DEM_OVERVIEW_VERSION ||
+       header.byte_order != DEM_OVERVIEW_BYTE_ORDER ||
+       header.source_size != stat_buf->st_size ||
+       header.source_mtime != stat_buf->st_mtime ||
+       header.n_columns != dem->n_columns ||
+       header.n_overviews != n_overviews ) {
+    g_mapped_file_unref ( mf );
+    return FALSE;
+  }
+
+  const gchar *ptr = contents + sizeof(DEMOverviewHeader);
+  n_columns = dem->n_columns;
+  guint factor = 1;
+  for ( guint ii = 0; ii < n_overviews; ii++ ) {
+    DEMOverview *ov = g_malloc0 ( sizeof(DEMOverview) );
+    n_columns = (n_columns + 1) / 2;
+    factor *= 2;
+    ov->factor = factor;
+    ov->n_columns = n_columns;
+    ov->points = (const gint16*)ptr;
+    ptr += n_columns * n_columns * sizeof(gint16);
+    g_ptr_array_add ( dem->overviews, ov );
+  }
+  dem->overviews_mapped = mf;
+  return TRUE;
+}
+
+static void dem_overviews_save ( VikDEM *dem, const gchar *filename, GStatBuf *stat_buf )
+{
+  gchar *dir = g_path_get_dirname ( filename );
+  if ( g_mkdir_with_parents ( dir, 0700 ) != 0 )
+    g_warning ( "%s: Failed to mkdir %s", __FUNCTION__, dir );
+  g_free ( dir );
+
+  // Write to a temporary file first, so a partially written file is never used
+  gchar *tmp_filename = g_strdup_printf ( "%s.tmp", filename );
+  FILE *ff = g_fopen ( tmp_filename, "wb" );
+  if ( !ff ) {
+    g_warning ( "%s: Failed to open %s", __FUNCTION__, tmp_filename );
+    g_free ( tmp_filename );
+    return;
+  }
+
+  DEMOverviewHeader header;
+  memset ( &header, 0, sizeof(header) );
+  memcpy ( header.magic, DEM_OVERVIEW_MAGIC, sizeof(header.magic) );
+  header.version = DEM_OVERVIEW_VERSION;
+  header.byte_order = DEM_OVERVIEW_BYTE_ORDER;
+  header.source_size = stat_buf->st_size;
+  header.source_mtime = stat_buf->st_mtime;
+  header.n_columns = dem->n_columns;
+  header.n_overviews = dem->overviews->len;
+
+  gboolean ok = ( fwrite ( &header, sizeof(header), 1, ff ) == 1 );
+  for ( guint ii = 0; ok && ii < dem->overviews->len; ii++ ) {
+    DEMOverview *ov = g_ptr_array_index ( dem->overviews, ii );
+    gsize size = ov->n_columns * ov->n_columns;
+    ok = ( fwrite ( ov->points, sizeof(gint16), size, ff ) == size );
+  }
+  if ( fclose ( ff ) != 0 )
+    ok = FALSE;
+
+  if ( !ok || g_rename ( tmp_filename, filename ) != 0 ) {
+    g_warning ( "%s: Failed to write %s", __FUNCTION__, filename );
+    (void)g_remove ( tmp_filename );
+  }
+  g_free ( tmp_filename );
+}
+
+static void dem_overviews_create ( VikDEM *dem )
+{
+  dem->overviews = g_ptr_array_new_with_free_func ( (GDestroyNotify)dem_overview_free );
+
+  GStatBuf stat_buf;
+  if ( g_stat ( dem->file, &stat_buf ) != 0 )
+    memset ( &stat_buf, 0, sizeof(stat_buf) );
+
+  gchar *filename = dem_overview_filename ( dem );
+  if ( !dem_overviews_load ( dem, filename, &stat_buf ) ) {
+    DEMOverview *src = NULL;
+    guint n_overviews = dem_overview_count ( dem->n_columns );
+    for ( guint ii = 0; ii < n_overviews; ii++ ) {
+      src = dem_overview_generate ( dem, src );
+      g_ptr_array_add ( dem->overviews, src );
+    }
+    dem_overviews_save ( dem, filename, &stat_buf );
+    // Prefer the saved version, as mapped memory can be released by the system when not in use
+    g_ptr_array_set_size ( dem->overviews, 0 );
+    if ( !dem_overviews_load ( dem, filename, &stat_buf ) ) {
+      src = NULL;
+      for ( guint ii = 0; ii < n_overviews; ii++ ) {
+        src = dem_overview_generate ( dem, src );
+        g_ptr_array_add ( dem->overviews, src );
+      }
+    }
+  }
+  g_free ( filename );
+}
+
+/**
+ * vik_dem_get_xy_scaled:
+ * @scale: The spacing (in grid positions) between the values of interest
+ *
+ * Get the elevation at a position, using a reduced resolution overview
+ *  of the DEM when it is only going to be sampled every @scale positions.
+ * This avoids touching all the data when drawing zoomed out.
+ *
+ * NB Overviews are only available for SRTM data and are created on first use,
+ *  which is expected to be from the main thread (i.e. drawing).
+ */
+gint16 vik_dem_get_xy_scaled ( VikDEM *dem, guint col, guint row, guint scale )
+{
+  if ( !dem->grid || scale < 2 )
+    return vik_dem_get_xy ( dem, col, row );
+
+  if ( !dem->overviews )
+    dem_overviews_create ( dem );
+
+  // Use the lowest resolution no coarser than the requested scale
+  DEMOverview *ov = NULL;
+  for ( guint ii = 0; ii < dem->overviews->len; ii++ ) {
+    DEMOverview *tmp = g_ptr_array_index ( dem->overviews, ii );
+    if ( tmp->factor > scale )
+      break;
+    ov = tmp;
+  }
+  if ( !ov )
+    return vik_dem_get_xy ( dem, col, row );
+
+  if ( col >= dem->n_columns || row >= dem->n_columns )
+    return VIK_DEM_INVALID_ELEVATION;
+  return ov->points[(row / ov->factor) * ov->n_columns + (col / ov->factor)];
+}
+
 gint16 vik_dem_get_east_north ( VikDEM *dem, gdouble east, gdouble north )
 {
   gint col, row;
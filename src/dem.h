@@ -40,7 +40,15 @@ G_BEGIN_DECLS
 
 typedef struct {
   guint n_columns;
-  GPtrArray *columns;
+  GPtrArray *columns; // Of VikDEMColumn, except for SRTM data which uses the grid instead
+
+  // SRTM data is read in place from the file, rather than converted into columns
+  const gint16 *grid;   // Big endian values, n_columns * n_columns, with the northern row first
+  GMappedFile *mapped;  // The mapping of the grid (when not compressed)
+  gpointer grid_mem;    // The grid uncompressed into memory (when compressed)
+  gchar *file;
+  GPtrArray *overviews; // Reduced resolution versions of the grid, created on demand (see vik_dem_get_xy_scaled())
+  GMappedFile *overviews_mapped;
 
   guint8 horiz_units;
   guint8 orig_vert_units; /* original, always converted to meters when loading. */
@@ -69,6 +77,7 @@ typedef struct {
 VikDEM *vik_dem_new_from_file(const gchar *file);
 void vik_dem_free ( VikDEM *dem );
 gint16 vik_dem_get_xy ( VikDEM *dem, guint x, guint y );
+gint16 vik_dem_get_xy_scaled ( VikDEM *dem, guint x, guint y, guint scale );
 
 gint16 vik_dem_get_east_north ( VikDEM *dem, gdouble east, gdouble north );
 gint16 vik_dem_get_simple_interpol ( VikDEM *dem, gdouble east, gdouble north );
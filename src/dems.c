@@ -21,28 +21,105 @@
  */
 #include <glib.h>
 #include <glib/gi18n.h>
+#include <math.h>
+#include <stdlib.h>
 
 #include "dems.h"
 #include "background.h"
+#include "util.h"
 
 typedef struct {
   VikDEM *dem;
   guint ref_count;
+  LatLonBBox bbox;
+  gdouble resolution; // Approximate spacing of the samples in metres
 } LoadedDEM;
 
 GHashTable *loaded_dems = NULL;
 /* filename -> DEM */
 
+/*
+ * Index of the loaded DEMs, so a position only needs to be checked against the DEMs
+ *  that could cover it, rather than all of them.
+ * Each DEM is listed in every 1 degree cell its bounds overlap (including touching),
+ *  which is only a few cells for SRTM files and 1:24k USGS DEMs.
+ * The DEMs of each cell are sorted by resolution, best first.
+ */
+static GHashTable *dem_cells = NULL;
+/* cell key -> GPtrArray of LoadedDEM */
+
+/*
+ * Elevations may be looked up from background threads,
+ *  whilst DEMs are loaded and unloaded from others.
+ * NB DEMs are loaded from file outside of the lock, as that can take a while.
+ */
+static GRWLock dems_lock;
+
+#define DEM_CELL_KEY(lat,lon) ((gint64)((((guint64)(gint64)floor(lat)) << 32) | (guint32)((gint32)floor(lon))))
+
+static gint loaded_dem_compare_resolution ( gconstpointer aa, gconstpointer bb )
+{
+  const LoadedDEM *ldem1 = *(const LoadedDEM**)aa;
+  const LoadedDEM *ldem2 = *(const LoadedDEM**)bb;
+  if ( ldem1->resolution < ldem2->resolution )
+    return -1;
+  if ( ldem1->resolution > ldem2->resolution )
+    return 1;
+  return 0;
+}
+
+static void dem_cells_add ( LoadedDEM *ldem )
+{
+  if ( !dem_cells )
+    dem_cells = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, (GDestroyNotify)g_ptr_array_unref );
+
+  for ( gint lat = floor(ldem->bbox.south); lat <= floor(ldem->bbox.north); lat++ ) {
+    for ( gint lon = floor(ldem->bbox.west); lon <= floor(ldem->bbox.east); lon++ ) {
+      gint64 key = DEM_CELL_KEY(lat, lon);
+      GPtrArray *cell = g_hash_table_lookup ( dem_cells, &key );
+      if ( !cell ) {
+        cell = g_ptr_array_new ();
+        g_hash_table_insert ( dem_cells, g_memdup(&key, sizeof(key)), cell );
+      }
+      g_ptr_array_add ( cell, ldem );
+      g_ptr_array_sort ( cell, loaded_dem_compare_resolution );
+    }
+  }
+}
+
+static void dem_cells_remove ( LoadedDEM *ldem )
+{
+  if ( !dem_cells )
+    return;
+
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, dem_cells );
+  while ( g_hash_table_iter_next (&iter, &key, &value) ) {
+    GPtrArray *cell = (GPtrArray*)value;
+    // Maintain the order
+    if ( g_ptr_array_remove ( cell, ldem ) && cell->len == 0 )
+      g_hash_table_iter_remove ( &iter );
+  }
+}
+
 static void loaded_dem_free ( LoadedDEM *ldem )
 {
+  dem_cells_remove ( ldem );
   vik_dem_free ( ldem->dem );
   g_free ( ldem );
 }
 
 void a_dems_uninit ()
 {
+  g_rw_lock_writer_lock ( &dems_lock );
   if ( loaded_dems )
     g_hash_table_destroy ( loaded_dems );
+  if ( dem_cells )
+    g_hash_table_destroy ( dem_cells );
+  loaded_dems = NULL;
+  dem_cells = NULL;
+  g_rw_lock_writer_unlock ( &dems_lock );
 }
 
 /* To load a dem. if it was already loaded, will simply
@@ -52,6 +129,7 @@ VikDEM *a_dems_load(const gchar *filename)
 {
   LoadedDEM *ldem;
 
+  g_rw_lock_writer_lock ( &dems_lock );
   /* dems init hash table */
   if ( ! loaded_dems )
     loaded_dems = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify) loaded_dem_free );
@@ -59,29 +137,61 @@ VikDEM *a_dems_load(const gchar *filename)
   ldem = (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename );
   if ( ldem ) {
     ldem->ref_count++;
-    return ldem->dem;
+    VikDEM *dem = ldem->dem;
+    g_rw_lock_writer_unlock ( &dems_lock );
+    return dem;
   } else {
+    g_rw_lock_writer_unlock ( &dems_lock );
     VikDEM *dem = vik_dem_new_from_file ( filename );
     if ( ! dem )
       return NULL;
+
+    g_rw_lock_writer_lock ( &dems_lock );
+    // Another thread may have loaded the same file in the meantime
+    if ( ! loaded_dems )
+      loaded_dems = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify) loaded_dem_free );
+    ldem = (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename );
+    if ( ldem ) {
+      ldem->ref_count++;
+      g_rw_lock_writer_unlock ( &dems_lock );
+      vik_dem_free ( dem );
+      return ldem->dem; // NB Remains loaded at least until this reference is released
+    }
     ldem = g_malloc ( sizeof(LoadedDEM) );
     ldem->ref_count = 1;
     ldem->dem = dem;
+    ldem->bbox = vik_dem_get_bbox ( dem );
+    if ( dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS )
+      ldem->resolution = dem->north_scale * 30.87; // Metres per arcsecond of latitude
+    else {
+      ldem->resolution = dem->north_scale;
+      // The bounds of a UTM based DEM are only approximate in lat/lon terms (from the corners),
+      //  so allow a little extra
+      ldem->bbox.north += 0.01;
+      ldem->bbox.south -= 0.01;
+      ldem->bbox.east += 0.01;
+      ldem->bbox.west -= 0.01;
+    }
     g_hash_table_insert ( loaded_dems, g_strdup(filename), ldem );
+    dem_cells_add ( ldem );
+    g_rw_lock_writer_unlock ( &dems_lock );
     return dem;
   }
 }
 
 void a_dems_unref(const gchar *filename)
 {
-  LoadedDEM *ldem = (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename );
+  g_rw_lock_writer_lock ( &dems_lock );
+  LoadedDEM *ldem = loaded_dems ? (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename ) : NULL;
   if ( !ldem ) {
     /* This is fine - probably means the loaded list was aborted / not completed for some reason */
+    g_rw_lock_writer_unlock ( &dems_lock );
     return;
   }
   ldem->ref_count--;
   if ( ldem->ref_count == 0 )
     g_hash_table_remove ( loaded_dems, filename );
+  g_rw_lock_writer_unlock ( &dems_lock );
 }
 
 /* to get a DEM that was already loaded.
@@ -90,10 +200,13 @@ void a_dems_unref(const gchar *filename)
  */
 VikDEM *a_dems_get(const gchar *filename)
 {
-  LoadedDEM *ldem = g_hash_table_lookup ( loaded_dems, filename );
+  VikDEM *dem = NULL;
+  g_rw_lock_reader_lock ( &dems_lock );
+  LoadedDEM *ldem = loaded_dems ? g_hash_table_lookup ( loaded_dems, filename ) : NULL;
   if ( ldem )
-    return ldem->dem;
-  return NULL;
+    dem = ldem->dem;
+  g_rw_lock_reader_unlock ( &dems_lock );
+  return dem;
 }
 
 
@@ -169,24 +282,23 @@ GList *a_dems_list_copy ( GList *dems )
 
 gint16 a_dems_list_get_elev_by_coord ( GList *dems, const VikCoord *coord )
 {
-  static struct UTM utm_tmp;
-  static struct LatLon ll_tmp;
+  struct UTM utm_tmp;
+  struct LatLon ll_tmp;
   GList *iter = dems;
   VikDEM *dem;
   gint elev;
 
+  vik_coord_to_latlon ( coord, &ll_tmp );
+  vik_coord_to_utm ( coord, &utm_tmp );
+
   while ( iter ) {
     dem = a_dems_get ( (gchar *) iter->data );
     if ( dem ) {
       if ( dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS ) {
-        vik_coord_to_latlon ( coord, &ll_tmp );
-        ll_tmp.lat *= 3600;
-        ll_tmp.lon *= 3600;
-        elev = vik_dem_get_east_north(dem, ll_tmp.lon, ll_tmp.lat);
+        elev = vik_dem_get_east_north(dem, ll_tmp.lon * 3600, ll_tmp.lat * 3600);
         if ( elev != VIK_DEM_INVALID_ELEVATION )
           return elev;
       } else if ( dem->horiz_units == VIK_DEM_HORIZ_UTM_METERS ) {
-        vik_coord_to_utm ( coord, &utm_tmp );
         if ( utm_tmp.zone == dem->utm_zone &&
              (elev = vik_dem_get_east_north(dem, utm_tmp.easting, utm_tmp.northing)) != VIK_DEM_INVALID_ELEVATION )
             return elev;
@@ -197,62 +309,283 @@ gint16 a_dems_list_get_elev_by_coord ( GList *dems, const VikCoord *coord )
   return VIK_DEM_INVALID_ELEVATION;
 }
 
+/**
+ * Position of a coordinate in the forms needed for the different DEM types
+ */
 typedef struct {
-  const VikCoord *coord;
-  VikDemInterpol method;
-  gint elev;
-} CoordElev;
+  struct LatLon ll;
+  struct UTM utm;
+  gboolean have_utm; // Only converted when there is a UTM based DEM to check
+} DEMPosition;
 
-static gboolean get_elev_by_coord(gpointer key, LoadedDEM *ldem, CoordElev *ce)
+static gint16 dem_get_elev ( VikDEM *dem, DEMPosition *pos, VikDemInterpol method )
 {
-  VikDEM *dem = ldem->dem;
-  gdouble lat, lon;
+  gdouble north, east;
 
   if ( dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS ) {
-    struct LatLon ll_tmp;
-    vik_coord_to_latlon (ce->coord, &ll_tmp );
-    lat = ll_tmp.lat * 3600;
-    lon = ll_tmp.lon * 3600;
-  } else if (dem->horiz_units == VIK_DEM_HORIZ_UTM_METERS) {
-    static struct UTM utm_tmp;
-    if (utm_tmp.zone != dem->utm_zone)
-      return FALSE;
-    vik_coord_to_utm (ce->coord, &utm_tmp);
-    lat = utm_tmp.northing;
-    lon = utm_tmp.easting;
+    north = pos->ll.lat * 3600;
+    east = pos->ll.lon * 3600;
+  } else if ( dem->horiz_units == VIK_DEM_HORIZ_UTM_METERS ) {
+    if ( !pos->have_utm ) {
+      a_coords_latlon_to_utm ( &pos->ll, &pos->utm );
+      pos->have_utm = TRUE;
+    }
+    if ( pos->utm.zone != dem->utm_zone )
+      return VIK_DEM_INVALID_ELEVATION;
+    north = pos->utm.northing;
+    east = pos->utm.easting;
   } else
-    return FALSE;
+    return VIK_DEM_INVALID_ELEVATION;
 
-  switch (ce->method) {
+  switch (method) {
     case VIK_DEM_INTERPOL_NONE:
-      ce->elev = vik_dem_get_east_north(dem, lon, lat);
-      break;
+      return vik_dem_get_east_north(dem, east, north);
     case VIK_DEM_INTERPOL_SIMPLE:
-      ce->elev = vik_dem_get_simple_interpol(dem, lon, lat);
-      break;
+      return vik_dem_get_simple_interpol(dem, east, north);
     case VIK_DEM_INTERPOL_BEST:
-      ce->elev = vik_dem_get_shepard_interpol(dem, lon, lat);
-      break;
+      return vik_dem_get_shepard_interpol(dem, east, north);
     default: break;
   }
-  return (ce->elev != VIK_DEM_INVALID_ELEVATION);
+  return VIK_DEM_INVALID_ELEVATION;
+}
+
+/**
+ * Try each of the DEMs (that are in resolution order) until a value is found
+ */
+static gint16 dem_cell_get_elev ( GPtrArray *cell, DEMPosition *pos, VikDemInterpol method )
+{
+  if ( cell ) {
+    for ( guint ii = 0; ii < cell->len; ii++ ) {
+      LoadedDEM *ldem = g_ptr_array_index ( cell, ii );
+      if ( pos->ll.lat < ldem->bbox.south || pos->ll.lat > ldem->bbox.north ||
+           pos->ll.lon < ldem->bbox.west || pos->ll.lon > ldem->bbox.east )
+        continue;
+      gint16 elev = dem_get_elev ( ldem->dem, pos, method );
+      if ( elev != VIK_DEM_INVALID_ELEVATION )
+        return elev;
+    }
+  }
+  return VIK_DEM_INVALID_ELEVATION;
 }
 
-/* TODO: keep a (sorted) linked list of DEMs and select the best resolution one */
+/**
+ * a_dems_get_elev_by_coord:
+ *
+ * Get the elevation at the position from the loaded DEMs,
+ *  preferring the DEM with the best resolution when several cover it
+ */
 gint16 a_dems_get_elev_by_coord ( const VikCoord *coord, VikDemInterpol method )
 {
-  CoordElev ce;
+  DEMPosition pos;
+  vik_coord_to_latlon ( coord, &pos.ll );
+  pos.have_utm = FALSE;
 
-  if (!loaded_dems)
-    return VIK_DEM_INVALID_ELEVATION;
+  gint16 elev = VIK_DEM_INVALID_ELEVATION;
+  g_rw_lock_reader_lock ( &dems_lock );
+  if ( dem_cells ) {
+    gint64 key = DEM_CELL_KEY(pos.ll.lat, pos.ll.lon);
+    elev = dem_cell_get_elev ( g_hash_table_lookup(dem_cells, &key), &pos, method );
+  }
+  g_rw_lock_reader_unlock ( &dems_lock );
+  return elev;
+}
 
-  ce.coord = coord;
-  ce.method = method;
-  ce.elev = VIK_DEM_INVALID_ELEVATION;
+typedef struct {
+  gint64 key;
+  guint index;
+} DEMCoordKey;
 
-  if(!g_hash_table_find(loaded_dems, (GHRFunc)get_elev_by_coord, &ce))
-    return VIK_DEM_INVALID_ELEVATION;
-  return ce.elev;
+static gint dem_coord_key_compare ( gconstpointer aa, gconstpointer bb )
+{
+  const DEMCoordKey *key1 = aa;
+  const DEMCoordKey *key2 = bb;
+  if ( key1->key != key2->key )
+    return (key1->key < key2->key) ? -1 : 1;
+  // Keep the original order within a cell, for locality of access within the DEM
+  return (key1->index < key2->index) ? -1 : (key1->index > key2->index);
+}
+
+typedef struct {
+  DEMPosition *positions;
+  DEMCoordKey *keys; // Sorted by cell
+  guint n;
+  VikDemInterpol method;
+  gint16 *elevs;
+} DEMElevsT;
+
+static void dem_elevs_init ( DEMElevsT *de, const VikCoord *coords, guint n, VikDemInterpol method, gint16 *elevs )
+{
+  de->n = n;
+  de->method = method;
+  de->elevs = elevs;
+  de->positions = g_new ( DEMPosition, n );
+  de->keys = g_new ( DEMCoordKey, n );
+  for ( guint ii = 0; ii < n; ii++ ) {
+    vik_coord_to_latlon ( &coords[ii], &de->positions[ii].ll );
+    de->positions[ii].have_utm = FALSE;
+    de->keys[ii].key = DEM_CELL_KEY(de->positions[ii].ll.lat, de->positions[ii].ll.lon);
+    de->keys[ii].index = ii;
+  }
+  qsort ( de->keys, n, sizeof(DEMCoordKey), dem_coord_key_compare );
+}
+
+static void dem_elevs_clear ( DEMElevsT *de )
+{
+  g_free ( de->keys );
+  g_free ( de->positions );
+}
+
+/**
+ * Get the elevations of the sorted positions from @start up to @end,
+ *  only looking up the cell when it changes
+ * Must be called with the lock held (for reading)
+ */
+static gulong dem_elevs_range ( DEMElevsT *de, guint start, guint end )
+{
+  gulong found = 0;
+  GPtrArray *cell = NULL;
+  for ( guint ii = start; ii < end; ii++ ) {
+    if ( ii == start || de->keys[ii].key != de->keys[ii-1].key )
+      cell = g_hash_table_lookup ( dem_cells, &de->keys[ii].key );
+    if ( !cell )
+      continue;
+    guint index = de->keys[ii].index;
+    de->elevs[index] = dem_cell_get_elev ( cell, &de->positions[index], de->method );
+    if ( de->elevs[index] != VIK_DEM_INVALID_ELEVATION )
+      found++;
+  }
+  return found;
+}
+
+/**
+ * a_dems_get_elevs_by_coords:
+ * @coords: The positions
+ * @n:      The number of positions
+ * @elevs:  Array of at least @n values to be filled in,
+ *          VIK_DEM_INVALID_ELEVATION where there is no DEM value
+ *
+ * Get the elevations of many positions in one go,
+ *  which is more efficient than individual calls to a_dems_get_elev_by_coord()
+ *  as the positions are processed grouped by the DEM area they are in.
+ *
+ * Returns: The number of positions for which an elevation was found
+ */
+gulong a_dems_get_elevs_by_coords ( const VikCoord *coords, guint n, VikDemInterpol method, gint16 *elevs )
+{
+  gulong found = 0;
+  for ( guint ii = 0; ii < n; ii++ )
+    elevs[ii] = VIK_DEM_INVALID_ELEVATION;
+
+  if ( n == 0 )
+    return found;
+
+  g_rw_lock_reader_lock ( &dems_lock );
+  if ( dem_cells ) {
+    DEMElevsT de;
+    dem_elevs_init ( &de, coords, n, method, elevs );
+    found = dem_elevs_range ( &de, 0, n );
+    dem_elevs_clear ( &de );
+  }
+  g_rw_lock_reader_unlock ( &dems_lock );
+  return found;
+}
+
+// Number of positions given to a worker at a time,
+//  large enough to amortize the cell lookups and small enough for timely progress
+#define DEM_CHUNK_SIZE 4096
+
+typedef struct {
+  DEMElevsT de;
+  GMutex mutex;
+  GCond cond;
+  guint done;
+  gulong found;
+  gint cancelled;
+} DEMElevsParallelT;
+
+static void dem_elevs_worker ( gpointer data, DEMElevsParallelT *dp )
+{
+  guint start = (GPOINTER_TO_UINT(data) - 1) * DEM_CHUNK_SIZE;
+  gulong found = 0;
+  if ( !g_atomic_int_get(&dp->cancelled) ) {
+    // Only hold the lock for each chunk, so loading or freeing DEMs (in the main thread) isn't held up for long
+    g_rw_lock_reader_lock ( &dems_lock );
+    if ( dem_cells )
+      found = dem_elevs_range ( &dp->de, start, MIN(start + DEM_CHUNK_SIZE, dp->de.n) );
+    g_rw_lock_reader_unlock ( &dems_lock );
+  }
+  g_mutex_lock ( &dp->mutex );
+  dp->found += found;
+  dp->done++;
+  g_cond_signal ( &dp->cond );
+  g_mutex_unlock ( &dp->mutex );
+}
+
+/**
+ * a_dems_get_elevs_by_coords_progress:
+ * @coords:     The positions
+ * @n:          The number of positions
+ * @elevs:      Array of at least @n values to be filled in,
+ *              VIK_DEM_INVALID_ELEVATION where there is no DEM value
+ * @threaddata: The background thread this is being run from
+ * @found:      Returns the number of positions for which an elevation was found
+ *
+ * As a_dems_get_elevs_by_coords(), but for very many positions:
+ *  the positions (in DEM area order) are split into chunks which are evaluated
+ *  in parallel using all the CPUs, whilst reporting progress.
+ * The DEMs available may change between chunks, if DEMs are loaded or freed meanwhile.
+ *
+ * Without @threaddata this simply blocks until all the values are found,
+ *  which is intended for the automatic DEM application when a file is loaded.
+ *
+ * Returns: 0 or -1 if cancelled
+ */
+gint a_dems_get_elevs_by_coords_progress ( const VikCoord *coords, guint n, VikDemInterpol method, gint16 *elevs, gpointer threaddata, gulong *found )
+{
+  *found = 0;
+  for ( guint ii = 0; ii < n; ii++ )
+    elevs[ii] = VIK_DEM_INVALID_ELEVATION;
+
+  if ( n == 0 )
+    return 0;
+
+  g_rw_lock_reader_lock ( &dems_lock );
+  gboolean have_dems = ( dem_cells != NULL );
+  g_rw_lock_reader_unlock ( &dems_lock );
+  if ( !have_dems )
+    return 0;
+
+  DEMElevsParallelT *dp = g_new0 ( DEMElevsParallelT, 1 );
+  g_mutex_init ( &dp->mutex );
+  g_cond_init ( &dp->cond );
+  dem_elevs_init ( &dp->de, coords, n, method, elevs );
+
+  const guint count = (n + DEM_CHUNK_SIZE - 1) / DEM_CHUNK_SIZE;
+  GThreadPool *pool = g_thread_pool_new ( (GFunc)dem_elevs_worker, dp, MIN(count, util_get_number_of_cpus()), FALSE, NULL );
+  for ( guint nn = 0; nn < count; nn++ )
+    g_thread_pool_push ( pool, GUINT_TO_POINTER(nn+1), NULL );
+
+  g_mutex_lock ( &dp->mutex );
+  while ( dp->done < count ) {
+    gint64 end_time = g_get_monotonic_time () + G_TIME_SPAN_SECOND / 4;
+    (void)g_cond_wait_until ( &dp->cond, &dp->mutex, end_time );
+    gdouble fraction = (gdouble)dp->done / count;
+    g_mutex_unlock ( &dp->mutex );
+    if ( threaddata && a_background_thread_progress ( threaddata, fraction ) )
+      g_atomic_int_set ( &dp->cancelled, 1 );
+    g_mutex_lock ( &dp->mutex );
+  }
+  g_mutex_unlock ( &dp->mutex );
+
+  g_thread_pool_free ( pool, FALSE, TRUE );
+
+  gint ans = g_atomic_int_get(&dp->cancelled) ? -1 : 0;
+  *found = dp->found;
+  dem_elevs_clear ( &dp->de );
+  g_mutex_clear ( &dp->mutex );
+  g_cond_clear ( &dp->cond );
+  g_free ( dp );
+  return ans;
 }
 
 /**
@@ -263,12 +596,15 @@ gint16 a_dems_get_elev_by_coord ( const VikCoord *coord, VikDemInterpol method )
  */
 gboolean a_dems_overlaps_bbox ( LatLonBBox bbox )
 {
-  if (!loaded_dems)
-    return FALSE;
-
   gboolean ans = FALSE;
   LatLonBBox dem_bbox;
 
+  g_rw_lock_reader_lock ( &dems_lock );
+  if ( !loaded_dems ) {
+    g_rw_lock_reader_unlock ( &dems_lock );
+    return FALSE;
+  }
+
   gpointer key, value;
   GHashTableIter ght_iter;
   g_hash_table_iter_init ( &ght_iter, loaded_dems );
@@ -279,5 +615,6 @@ gboolean a_dems_overlaps_bbox ( LatLonBBox bbox )
       break;
     }
   }
+  g_rw_lock_reader_unlock ( &dems_lock );
   return ans;
 }
@@ -42,6 +42,8 @@ void a_dems_list_free ( GList *dems );
 GList *a_dems_list_copy ( GList *dems );
 gint16 a_dems_list_get_elev_by_coord ( GList *dems, const VikCoord *coord );
 gint16 a_dems_get_elev_by_coord ( const VikCoord *coord, VikDemInterpol method);
+gulong a_dems_get_elevs_by_coords ( const VikCoord *coords, guint n, VikDemInterpol method, gint16 *elevs );
+gint a_dems_get_elevs_by_coords_progress ( const VikCoord *coords, guint n, VikDemInterpol method, gint16 *elevs, gpointer threaddata, gulong *found );
 
 gboolean a_dems_overlaps_bbox ( LatLonBBox bbox );
 
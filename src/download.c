@@ -45,6 +45,7 @@
 #include "download.h"
 
 #include "curl_download.h"
+#include "tilestore.h"
 #include "preferences.h"
 #include "globals.h"
 #include "vik_compat.h"
@@ -93,16 +94,21 @@ static gboolean check_file_first_line(FILE* f, gchar *patterns[])
   return FALSE;
 }
 
+static gchar *html_str[] = {
+  "<html",
+  "<!DOCTYPE html",
+  "<head",
+  "<title",
+  NULL
+};
+
+static gchar *kml_str[] = {
+  "<?xml",
+  NULL
+};
+
 gboolean a_check_html_file(FILE* f)
 {
-  gchar * html_str[] = {
-    "<html",
-    "<!DOCTYPE html",
-    "<head",
-    "<title",
-    NULL
-  };
-
   return check_file_first_line(f, html_str);
 }
 
@@ -114,17 +120,75 @@ gboolean a_check_map_file(FILE* f)
 
 gboolean a_check_kml_file(FILE* f)
 {
-  gchar * kml_str[] = {
-    "<?xml",
-    NULL
-  };
-
   return check_file_first_line(f, kml_str);
 }
 
+/*
+ * In memory equivalents of the file content checkers,
+ *  for data that has been downloaded without going via a file
+ */
+typedef gboolean (*ContentCheckerFunc) (const gchar*, gsize);
+
+static gboolean check_content_first_line(const gchar *data, gsize len, gchar *patterns[])
+{
+  const gchar *bp = data;
+  const gchar *end = data + MIN(len, 32);
+  gchar **s;
+
+  while (bp < end && isspace(*bp))
+    bp++;
+  if (bp >= end)
+    return FALSE;
+  for (s = patterns; *s; s++) {
+    gsize slen = strlen(*s);
+    if (slen <= (gsize)(data + len - bp) && strncasecmp(*s, bp, slen) == 0)
+      return TRUE;
+  }
+  return FALSE;
+}
+
+static gboolean check_html_content(const gchar *data, gsize len)
+{
+  return check_content_first_line(data, len, html_str);
+}
+
+static gboolean check_map_content(const gchar *data, gsize len)
+{
+  return !check_html_content(data, len);
+}
+
+static gboolean check_kml_content(const gchar *data, gsize len)
+{
+  return check_content_first_line(data, len, kml_str);
+}
+
+/**
+ * Get the in memory equivalent of a file content checker
+ *
+ * Returns: FALSE if there isn't one
+ */
+static gboolean get_content_checker ( VikFileContentCheckerFunc check_file, ContentCheckerFunc *checker )
+{
+  if ( check_file == NULL )
+    *checker = NULL;
+  else if ( check_file == a_check_map_file )
+    *checker = check_map_content;
+  else if ( check_file == a_check_html_file )
+    *checker = check_html_content;
+  else if ( check_file == a_check_kml_file )
+    *checker = check_kml_content;
+  else
+    return FALSE;
+  return TRUE;
+}
+
 static GList *file_list = NULL;
 static GMutex *file_list_mutex = NULL;
 
+// Writes files for downloads held in memory
+static GThreadPool *write_pool = NULL;
+static void download_write ( gpointer data, gpointer user_data );
+
 /* spin button scales */
 static VikLayerParamScale params_scales[] = {
   {1, 365, 1, 0},		/* download_tile_age */
@@ -152,10 +216,13 @@ void a_download_init (void)
 {
 	a_preferences_register ( prefs, (VikLayerParamData){0}, VIKING_PREFERENCES_GROUP_KEY );
 	file_list_mutex = vik_mutex_new();
+	write_pool = g_thread_pool_new ( download_write, NULL, 1, FALSE, NULL );
 }
 
 void a_download_uninit (void)
 {
+	// Complete any outstanding file writes
+	g_thread_pool_free ( write_pool, FALSE, TRUE );
 	vik_mutex_free(file_list_mutex);
 }
 
@@ -335,16 +402,51 @@ static void set_etag(const char *fn, const char *fntmp, CurlDownloadOptions *cdo
   }
 }
 
-static DownloadResult_t download( const char *hostname, const char *uri, const char *fn, DownloadFileOptions *options, gboolean ftp, void *handle)
-{
-  FILE *f;
+typedef struct {
+  gchar *fn;
   gchar *tmpfilename;
-  gboolean failure = FALSE;
-  CurlDownloadOptions cdo = {0, NULL, NULL};
+  FILE *f;
+  gboolean file_exists;
+  DownloadFileOptions *options;
+  CurlDownloadOptions cdo;
+  // Only for asynchronous downloads
+  DownloadDoneFunc done_func;
+  gpointer user_data;
+  GBytes *content; // Downloaded data still to be written to the file
+  // When fn is a tile store (see tilestore.h), rather than the file itself
+  gboolean in_store;
+  gint x, y;
+} DownloadJob;
+
+static void download_job_clear ( DownloadJob *dj )
+{
+  g_free ( dj->fn );
+  g_free ( dj->tmpfilename );
+  g_free ( dj->cdo.etag );
+  g_free ( dj->cdo.new_etag );
+  if ( dj->cdo.content )
+    g_byte_array_unref ( dj->cdo.content );
+  if ( dj->content )
+    g_bytes_unref ( dj->content );
+}
+
+/**
+ * Check whether the download is needed and if so open the temporary file to download into
+ *  (unless downloading into memory, in which case the file is only locked)
+ *
+ * Returns: DOWNLOAD_SUCCESS when the download should go ahead
+ */
+static DownloadResult_t download_prepare ( DownloadJob *dj, const char *hostname, const char *uri )
+{
+  DownloadFileOptions *options = dj->options;
 
   /* Check file */
-  gboolean file_exists = g_file_test ( fn, G_FILE_TEST_EXISTS );
-  if ( file_exists )
+  time_t file_time = 0;
+  if ( dj->in_store )
+    dj->file_exists = a_tilestore_get_info ( dj->fn, dj->x, dj->y, &file_time, NULL );
+  else
+    dj->file_exists = g_file_test ( dj->fn, G_FILE_TEST_EXISTS );
+  if ( dj->file_exists )
   {
     // Options should always be specified when request downloading
     //  a file that already exists (i.e. map tiles)
@@ -352,25 +454,36 @@ static DownloadResult_t download( const char *hostname, const char *uri, const c
       return DOWNLOAD_NOT_REQUIRED;
 
     time_t file_age = options->expiry_age;
-    /* Get the modified time of this file */
-    GStatBuf buf;
-    (void)g_stat ( fn, &buf );
-    time_t file_time = buf.st_mtime;
+    if ( !dj->in_store ) {
+      /* Get the modified time of this file */
+      GStatBuf buf;
+      (void)g_stat ( dj->fn, &buf );
+      file_time = buf.st_mtime;
+    }
     if ( (time(NULL) - file_time) < file_age ) {
       /* File cache is too recent, so return */
       return DOWNLOAD_NOT_REQUIRED;
     }
 
     if ( options->check_file_server_time ) {
-      cdo.time_condition = file_time;
+      dj->cdo.time_condition = file_time;
     }
 
     if ( options->use_etag ) {
-      get_etag(fn, &cdo);
+      if ( dj->in_store ) {
+        (void)a_tilestore_get_info ( dj->fn, dj->x, dj->y, NULL, &dj->cdo.etag );
+        // As per get_etag()
+        if ( dj->cdo.etag && strlen(dj->cdo.etag) > 100 ) {
+          g_free ( dj->cdo.etag );
+          dj->cdo.etag = NULL;
+        }
+      }
+      else
+        get_etag(dj->fn, &dj->cdo);
     }
 
-  } else {
-    gchar *dir = g_path_get_dirname ( fn );
+  } else if ( !dj->in_store ) {
+    gchar *dir = g_path_get_dirname ( dj->fn );
     if ( g_mkdir_with_parents ( dir , 0777 ) != 0)
       g_warning ("%s: Failed to mkdir %s", __FUNCTION__, dir );
     g_free ( dir );
@@ -382,27 +495,62 @@ static DownloadResult_t download( const char *hostname, const char *uri, const c
     return DOWNLOAD_PARAMETERS_ERROR;
   }
 
-  tmpfilename = g_strdup_printf("%s.tmp", fn);
+  // For a tile store this is only used for the lock
+  gchar *tmpfilename = dj->in_store ? g_strdup_printf("%s.%d.%d.tmp", dj->fn, dj->x, dj->y) : g_strdup_printf("%s.tmp", dj->fn);
   if (!lock_file ( tmpfilename ) )
   {
     g_debug("%s: Couldn't take lock on temporary file \"%s\"", __FUNCTION__, tmpfilename);
     g_free ( tmpfilename );
-    if (options->use_etag)
-      g_free ( cdo.etag );
     return DOWNLOAD_FILE_WRITE_ERROR;
   }
-  f = g_fopen ( tmpfilename, "w+b" );  /* truncate file and open it */
-  if ( ! f ) {
-    g_warning("Couldn't open temporary file \"%s\": %s", tmpfilename, g_strerror(errno));
-    g_free ( tmpfilename );
-    if (options->use_etag)
-      g_free ( cdo.etag );
-    return DOWNLOAD_FILE_WRITE_ERROR;
+  if ( !dj->cdo.content ) {
+    dj->f = g_fopen ( tmpfilename, "w+b" );  /* truncate file and open it */
+    if ( ! dj->f ) {
+      g_warning("Couldn't open temporary file \"%s\": %s", tmpfilename, g_strerror(errno));
+      unlock_file ( tmpfilename );
+      g_free ( tmpfilename );
+      return DOWNLOAD_FILE_WRITE_ERROR;
+    }
   }
+  dj->tmpfilename = tmpfilename;
+  return DOWNLOAD_SUCCESS;
+}
+
+/**
+ * Move the completely downloaded temporary file into place
+ */
+static void download_commit ( DownloadJob *dj )
+{
+  DownloadFileOptions *options = dj->options;
 
-  /* Call the backend function */
-  CURL_download_t ret = curl_download_get_url ( hostname, uri, f, options, ftp, &cdo, handle );
+  if ( options != NULL && options->convert_file )
+    options->convert_file ( dj->tmpfilename );
 
+  if ( options != NULL && options->use_etag ) {
+    if ( dj->cdo.new_etag ) {
+      /* server returned an etag value */
+      set_etag(dj->fn, dj->tmpfilename, &dj->cdo);
+    }
+  }
+
+  // Remove existing file if it exists and then replace with the newly downloaded file
+  // Potential TOCTOU, but we shouldn't be requesting downloads of the same file multiple times anyway.
+  if ( dj->file_exists )
+    if ( g_remove ( dj->fn ) )
+      g_warning ( "%s: failed to remove: %s", __FUNCTION__, dj->fn );
+
+  /* move completely-downloaded file to permanent location */
+  if ( g_rename ( dj->tmpfilename, dj->fn ) )
+    g_warning ("%s: file rename failed [%s] to [%s]", __FUNCTION__, dj->tmpfilename, dj->fn );
+}
+
+/**
+ * Check what was downloaded and if all is well move it into place
+ */
+static DownloadResult_t download_finish ( DownloadJob *dj, CURL_download_t ret )
+{
+  DownloadFileOptions *options = dj->options;
+  gboolean failure = FALSE;
   DownloadResult_t result = DOWNLOAD_SUCCESS;
 
   if (ret == CURL_DOWNLOAD_ABORTED) {
@@ -415,65 +563,273 @@ static DownloadResult_t download( const char *hostname, const char *uri, const c
     result = DOWNLOAD_HTTP_ERROR;
   }
 
-  if (!failure && options != NULL && options->check_file != NULL && ! options->check_file(f)) {
+  if (!failure && options != NULL && options->check_file != NULL && ! options->check_file(dj->f)) {
     g_debug("%s: file content checking failed", __FUNCTION__);
     failure = TRUE;
     result = DOWNLOAD_CONTENT_ERROR;
   }
 
-  fclose ( f );
-  f = NULL;
+  fclose ( dj->f );
+  dj->f = NULL;
 
   if (failure)
   {
-    g_warning(_("Download error: %s"), fn);
-    if ( g_remove ( tmpfilename ) != 0 )
-      g_warning( ("Failed to remove: %s"), tmpfilename);
-    unlock_file ( tmpfilename );
-    g_free ( tmpfilename );
-    if ( options != NULL && options->use_etag ) {
-      g_free ( cdo.etag );
-      g_free ( cdo.new_etag );
-    }
+    if ( result != DOWNLOAD_USER_ABORTED )
+      g_warning(_("Download error: %s"), dj->fn);
+    if ( g_remove ( dj->tmpfilename ) != 0 )
+      g_warning( ("Failed to remove: %s"), dj->tmpfilename);
+    unlock_file ( dj->tmpfilename );
     return result;
   }
 
   if (ret == CURL_DOWNLOAD_NO_NEWER_FILE)  {
-    (void)g_remove ( tmpfilename );
+    (void)g_remove ( dj->tmpfilename );
      // update mtime of local copy
      // Not security critical, thus potential Time of Check Time of Use race condition is not bad
      // coverity[toctou]
-     if ( g_utime ( fn, NULL ) != 0 )
-       g_warning ( "%s couldn't set time on: %s", __FUNCTION__, fn );
+     if ( g_utime ( dj->fn, NULL ) != 0 )
+       g_warning ( "%s couldn't set time on: %s", __FUNCTION__, dj->fn );
   } else {
-    if ( options != NULL && options->convert_file )
-      options->convert_file ( tmpfilename );
+    download_commit ( dj );
+  }
+  unlock_file ( dj->tmpfilename );
 
-    if ( options != NULL && options->use_etag ) {
-      if ( cdo.new_etag ) {
-        /* server returned an etag value */
-        set_etag(fn, tmpfilename, &cdo);
-      }
+  return DOWNLOAD_SUCCESS;
+}
+
+/**
+ * As download_finish() but for data downloaded into memory.
+ * Once accepted the data is moved to dj->content,
+ *  with the temporary file remaining locked until the data is written to it.
+ */
+static DownloadResult_t download_finish_content ( DownloadJob *dj, CURL_download_t ret )
+{
+  DownloadResult_t result = DOWNLOAD_SUCCESS;
+
+  if (ret == CURL_DOWNLOAD_ABORTED) {
+    g_debug("%s: download aborted: curl_download_get_url=%d", __FUNCTION__, ret);
+    result = DOWNLOAD_USER_ABORTED;
+  } else if (ret == CURL_DOWNLOAD_ERROR) {
+    g_debug("%s: download failed: curl_download_get_url=%d", __FUNCTION__, ret);
+    result = DOWNLOAD_HTTP_ERROR;
+  } else if (ret == CURL_DOWNLOAD_NO_ERROR && dj->options != NULL) {
+    ContentCheckerFunc checker = NULL;
+    (void)get_content_checker ( dj->options->check_file, &checker );
+    if ( checker && !checker((const gchar*)dj->cdo.content->data, dj->cdo.content->len) ) {
+      g_debug("%s: content checking failed", __FUNCTION__);
+      result = DOWNLOAD_CONTENT_ERROR;
     }
+  }
+
+  if ( result != DOWNLOAD_SUCCESS ) {
+    if ( result != DOWNLOAD_USER_ABORTED )
+      g_warning(_("Download error: %s"), dj->fn);
+  } else if ( ret == CURL_DOWNLOAD_NO_NEWER_FILE ) {
+    // update mtime of local copy
+    if ( dj->in_store )
+      (void)a_tilestore_touch ( dj->fn, dj->x, dj->y );
+    else if ( g_utime ( dj->fn, NULL ) != 0 )
+      g_warning ( "%s couldn't set time on: %s", __FUNCTION__, dj->fn );
+  } else {
+    dj->content = g_byte_array_free_to_bytes ( dj->cdo.content );
+    dj->cdo.content = NULL;
+    return result;
+  }
+  unlock_file ( dj->tmpfilename );
+  return result;
+}
+
+static DownloadResult_t download( const char *hostname, const char *uri, const char *fn, DownloadFileOptions *options, gboolean ftp, void *handle)
+{
+  DownloadJob dj = { 0 };
+  dj.fn = g_strdup ( fn );
+  dj.options = options;
+
+  DownloadResult_t result = download_prepare ( &dj, hostname, uri );
+  if ( result == DOWNLOAD_SUCCESS ) {
+    /* Call the backend function */
+    CURL_download_t ret = curl_download_get_url ( hostname, uri, dj.f, options, ftp, &dj.cdo, handle );
+    result = download_finish ( &dj, ret );
+  }
+  download_job_clear ( &dj );
+  return result;
+}
+
+static void download_job_free ( DownloadJob *dj )
+{
+  download_job_clear ( dj );
+  if ( dj->options )
+    a_download_file_options_free ( dj->options );
+  g_free ( dj );
+}
+
+/**
+ * Write the downloaded data to the temporary file and then move it into place
+ *
+ * Runs in the write_pool
+ */
+static void download_write ( gpointer data, gpointer user_data )
+{
+  DownloadJob *dj = (DownloadJob*)data;
+
+  if ( dj->in_store ) {
+    const gchar *etag = ( dj->options && dj->options->use_etag ) ? dj->cdo.new_etag : NULL;
+    if ( !a_tilestore_write ( dj->fn, dj->x, dj->y, dj->content, etag ) )
+      g_warning ( "%s: Failed to store tile %d,%d in %s", __FUNCTION__, dj->x, dj->y, dj->fn );
+    unlock_file ( dj->tmpfilename );
+    download_job_free ( dj );
+    return;
+  }
 
-    // Remove existing file if it exists and then replace with the newly downloaded file
-    // Potential TOCTOU, but we shouldn't be requesting downloads of the same file multiple times anyway.
-    if ( file_exists )
-      if ( g_remove ( fn ) )
-        g_warning ( "%s: failed to remove: %s", __FUNCTION__, fn );
+  gsize len;
+  gconstpointer bytes = g_bytes_get_data ( dj->content, &len );
+  gboolean written = FALSE;
 
-     /* move completely-downloaded file to permanent location */
-     if ( g_rename ( tmpfilename, fn ) )
-        g_warning ("%s: file rename failed [%s] to [%s]", __FUNCTION__, tmpfilename, fn );
+  FILE *f = g_fopen ( dj->tmpfilename, "wb" );
+  if ( f ) {
+    written = ( fwrite ( bytes, 1, len, f ) == len );
+    if ( fclose ( f ) != 0 )
+      written = FALSE;
   }
-  unlock_file ( tmpfilename );
-  g_free ( tmpfilename );
 
-  if ( options != NULL && options->use_etag ) {
-    g_free ( cdo.etag );
-    g_free ( cdo.new_etag );
+  if ( written )
+    download_commit ( dj );
+  else {
+    g_warning ( "Couldn't write temporary file \"%s\": %s", dj->tmpfilename, g_strerror(errno) );
+    (void)g_remove ( dj->tmpfilename );
   }
-  return DOWNLOAD_SUCCESS;
+  unlock_file ( dj->tmpfilename );
+  download_job_free ( dj );
+}
+
+static void download_async_done ( CURL_download_t ret, gpointer user_data )
+{
+  DownloadJob *dj = (DownloadJob*)user_data;
+  if ( dj->cdo.content ) {
+    dj->done_func ( download_finish_content(dj, ret), dj->content, dj->user_data );
+    if ( dj->content ) {
+      // Not waiting on the disk
+      g_thread_pool_push ( write_pool, dj, NULL );
+      return;
+    }
+  }
+  else
+    dj->done_func ( download_finish(dj, ret), NULL, dj->user_data );
+  download_job_free ( dj );
+}
+
+static gboolean download_in_memory_possible ( DownloadFileOptions *options )
+{
+  ContentCheckerFunc checker;
+  return !(options && options->convert_file) && get_content_checker ( options ? options->check_file : NULL, &checker );
+}
+
+/**
+ * Start the download in the background, or if that's not needed or possible
+ *  report the outcome straight away
+ */
+static void download_async_start ( DownloadJob *dj, const char *hostname, const char *uri, gdouble priority, guint group )
+{
+  DownloadFileOptions *options = dj->options;
+  DownloadDoneFunc done_func = dj->done_func;
+  gpointer user_data = dj->user_data;
+
+  DownloadResult_t result = download_prepare ( dj, hostname, uri );
+  if ( result == DOWNLOAD_SUCCESS ) {
+    if ( curl_download_multi_add ( hostname, uri, dj->f, options, FALSE, &dj->cdo, priority, group, download_async_done, dj ) )
+      return;
+    if ( dj->cdo.content )
+      result = download_finish_content ( dj, CURL_DOWNLOAD_ERROR );
+    else
+      result = download_finish ( dj, CURL_DOWNLOAD_ERROR );
+  }
+  done_func ( result, NULL, user_data );
+  download_job_free ( dj );
+}
+
+/**
+ * a_http_download_get_url_async:
+ * @options:   Taken over by this function (maybe NULL)
+ * @priority:  Downloads with lower values are started first
+ * @group:     From a_download_new_group() or 0 if not to be cancelled by group
+ * @done_func: Always called exactly once with the outcome.
+ *             This may be before this function returns, from another thread once downloaded,
+ *             or from the thread that cancels the download
+ *
+ * As a_http_download_get_url(), but the download itself happens in the background
+ *  alongside any others, sharing connections to the same server.
+ *
+ * Where possible the data is downloaded into memory and given to @done_func,
+ *  so it need not be read back in from the file - which is written afterwards.
+ */
+void a_http_download_get_url_async ( const char *hostname, const char *uri, const char *fn, DownloadFileOptions *options,
+                                     gdouble priority, guint group, DownloadDoneFunc done_func, gpointer user_data )
+{
+  DownloadJob *dj = g_malloc0 ( sizeof(DownloadJob) );
+  dj->fn = g_strdup ( fn );
+  dj->options = options;
+  dj->done_func = done_func;
+  dj->user_data = user_data;
+
+  // Any conversion or content check has to be performed on the file
+  if ( download_in_memory_possible ( options ) )
+    dj->cdo.content = g_byte_array_new ();
+
+  download_async_start ( dj, hostname, uri, priority, group );
+}
+
+/**
+ * a_http_download_get_url_to_store_async:
+ * @store: The tile store filename
+ * @x:     The tile's position in the store
+ * @y:
+ *
+ * As a_http_download_get_url_async(), but for a tile kept in a tile store (see tilestore.h)
+ */
+void a_http_download_get_url_to_store_async ( const char *hostname, const char *uri, const char *store, gint x, gint y,
+                                              DownloadFileOptions *options, gdouble priority, guint group,
+                                              DownloadDoneFunc done_func, gpointer user_data )
+{
+  if ( !download_in_memory_possible ( options ) ) {
+    g_warning ( "%s: Tiles that need converting can not be stored in %s", __FUNCTION__, store );
+    if ( options )
+      a_download_file_options_free ( options );
+    done_func ( DOWNLOAD_PARAMETERS_ERROR, NULL, user_data );
+    return;
+  }
+
+  DownloadJob *dj = g_malloc0 ( sizeof(DownloadJob) );
+  dj->fn = g_strdup ( store );
+  dj->in_store = TRUE;
+  dj->x = x;
+  dj->y = y;
+  dj->options = options;
+  dj->done_func = done_func;
+  dj->user_data = user_data;
+  dj->cdo.content = g_byte_array_new ();
+
+  download_async_start ( dj, hostname, uri, priority, group );
+}
+
+/**
+ * a_download_new_group:
+ *
+ * Returns: An identifier for a set of asynchronous downloads, so they can be cancelled together
+ */
+guint a_download_new_group ( void )
+{
+  return curl_download_multi_new_group ();
+}
+
+/**
+ * a_download_cancel_group:
+ * @in_progress: Whether to stop those already being downloaded too
+ *
+ * Cancel those downloads in the group that haven't started yet
+ */
+void a_download_cancel_group ( guint group, gboolean in_progress )
+{
+  curl_download_multi_cancel_group ( group, in_progress );
 }
 
 /**
@@ -132,6 +132,16 @@ typedef enum {
 /* TODO: convert to Glib */
 DownloadResult_t a_http_download_get_url ( const char *hostname, const char *uri, const char *fn, DownloadFileOptions *opt, void *handle );
 DownloadResult_t a_ftp_download_get_url ( const char *hostname, const char *uri, const char *fn, DownloadFileOptions *opt, void *handle );
+// @content: The downloaded data if it was kept in memory, otherwise NULL
+//  (take a reference to keep it beyond the call)
+typedef void (*DownloadDoneFunc) ( DownloadResult_t result, GBytes *content, gpointer user_data );
+void a_http_download_get_url_async ( const char *hostname, const char *uri, const char *fn, DownloadFileOptions *opt,
+                                     gdouble priority, guint group, DownloadDoneFunc done_func, gpointer user_data );
+void a_http_download_get_url_to_store_async ( const char *hostname, const char *uri, const char *store, gint x, gint y,
+                                              DownloadFileOptions *opt, gdouble priority, guint group,
+                                              DownloadDoneFunc done_func, gpointer user_data );
+guint a_download_new_group ( void );
+void a_download_cancel_group ( guint group, gboolean in_progress );
 void *a_download_handle_init ();
 void a_download_handle_cleanup ( void *handle );
 
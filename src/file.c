@@ -34,10 +34,12 @@
 #include "file_magic.h"
 #include "vikgpslayer.h"
 #include "vikgeocluelayer.h"
+#include "background.h"
 
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#include <glib/gstdio.h>
 
 #include "file.h"
 #include "misc/strtod.h"
@@ -815,6 +817,7 @@ VikLoadType_t a_file_load_stream ( FILE *f,
       switch (read_status) {
       case GPX_READ_FAILURE: load_answer = LOAD_TYPE_GPX_FAILURE; break;
       case GPX_READ_WARNING: load_answer = LOAD_TYPE_GPX_WARNING; break;
+      case GPX_READ_CANCELLED: // Only when reading with progress
       case GPX_READ_SUCCESS: load_answer = LOAD_TYPE_OTHER_SUCCESS; break;
       }
       if ( load_answer != LOAD_TYPE_GPX_FAILURE ) {
@@ -857,6 +860,287 @@ VikLoadType_t a_file_load_stream ( FILE *f,
   return load_answer;
 }
 
+/*
+ * Background loading of a large GPX or KML file
+ *
+ * The file is read into an unattached staging TrackWaypoint layer in a background job,
+ *  whilst the (initially empty) layer for the file is shown straight away.
+ * Between chunks of the file, items that have been completely read are periodically
+ *  taken out of the staging layer and handed over to be added into the visible layer
+ *  on the main thread, so it fills in as the file is read.
+ */
+#define VIK_SETTINGS_FILE_BACKGROUND_LOAD_SIZE "file_background_load_size"
+#define BACKGROUND_LOAD_CHUNK_SIZE (1024*1024) // Matching the GPX/KML readers
+#define BACKGROUND_LOAD_PUBLISH_INTERVAL G_USEC_PER_SEC
+
+typedef struct {
+  gint ref_count;       // Main thread + the job + each scheduled publish
+  VikAggregateLayer *top;
+  VikViewport *vp;
+  VikTrwLayer *vtl;     // The visible layer; NULL if it gets deleted whilst loading
+  VikTrwLayer *staging; // Only accessed by the job until it has finished
+  gchar *filename;
+  gchar *dirpath;
+  FILE *f;
+  gint64 size;
+  gboolean is_kml;
+  gpointer threaddata;
+  gint64 last_publish;
+  gboolean failed;
+  gint layer_gone;
+  gint publish_pending;
+  GMutex *mutex;        // Protects the lists below
+  GList *waypoints;     // Read but not yet added into the visible layer
+  GList *tracks;
+  GList *routes;
+  gboolean view_set;
+  guint added;
+} BackgroundLoad;
+
+// Main thread
+static void background_load_layer_gone ( BackgroundLoad *load, GObject *dead_vtl )
+{
+  load->vtl = NULL;
+  g_atomic_int_set ( &load->layer_gone, 1 );
+}
+
+// Main thread
+static void background_load_add_pending ( BackgroundLoad *load )
+{
+  g_mutex_lock ( load->mutex );
+  GList *waypoints = load->waypoints;
+  GList *tracks = load->tracks;
+  GList *routes = load->routes;
+  load->waypoints = load->tracks = load->routes = NULL;
+  g_mutex_unlock ( load->mutex );
+
+  if ( !load->vtl ) {
+    g_list_free_full ( waypoints, (GDestroyNotify)vik_waypoint_free );
+    g_list_free_full ( tracks, (GDestroyNotify)vik_track_free );
+    g_list_free_full ( routes, (GDestroyNotify)vik_track_free );
+    return;
+  }
+  if ( !waypoints && !tracks && !routes )
+    return;
+
+  // In one batch, as sorting the treeview after each item would take quadratic time
+  vik_trw_layer_add_items ( load->vtl, waypoints, tracks, routes );
+  load->added += g_list_length(waypoints) + g_list_length(tracks) + g_list_length(routes);
+
+  if ( waypoints )
+    trw_layer_calculate_bounds_waypoints ( load->vtl );
+  g_list_free ( waypoints );
+  g_list_free ( tracks );
+  g_list_free ( routes );
+
+  // Go to the data as soon as there is some, rather than waiting for the whole file
+  if ( !load->view_set ) {
+    load->view_set = vik_trw_layer_auto_set_view ( load->vtl, load->vp );
+    vik_layer_emit_update ( VIK_LAYER(load->top), FALSE );
+  }
+  else
+    vik_layer_emit_update ( VIK_LAYER(load->vtl), FALSE );
+}
+
+// Main thread
+static void background_load_finish ( BackgroundLoad *load )
+{
+  background_load_add_pending ( load );
+
+  if ( load->vtl ) {
+    g_object_weak_unref ( G_OBJECT(load->vtl), (GWeakNotify)background_load_layer_gone, load );
+    if ( load->failed && !load->added ) {
+      g_warning ( "%s: unable to read %s", __FUNCTION__, load->filename );
+      if ( g_list_find ((GList*)vik_aggregate_layer_get_children(load->top), load->vtl) ) {
+        vik_aggregate_layer_delete_layer ( load->top, VIK_LAYER(load->vtl) );
+        vik_layer_emit_update ( VIK_LAYER(load->top), FALSE );
+      }
+    }
+    else {
+      if ( load->failed )
+        g_warning ( "%s: malformed file %s, read as much as possible", __FUNCTION__, load->filename );
+      vik_trw_layer_take_file_info ( load->vtl, load->staging );
+      vik_layer_post_read ( VIK_LAYER(load->vtl), load->vp, TRUE );
+      if ( !load->view_set )
+        (void)vik_trw_layer_auto_set_view ( load->vtl, load->vp );
+      vik_layer_emit_update ( VIK_LAYER(load->top), FALSE );
+    }
+  }
+
+  g_object_unref ( load->staging );
+  g_object_unref ( load->top );
+  g_object_unref ( load->vp );
+  vik_mutex_free ( load->mutex );
+  g_free ( load->filename );
+  g_free ( load->dirpath );
+  g_free ( load );
+}
+
+// Main thread
+static void background_load_unref ( BackgroundLoad *load )
+{
+  if ( g_atomic_int_dec_and_test(&load->ref_count) )
+    background_load_finish ( load );
+}
+
+// Main thread
+static gboolean background_load_publish_idle ( BackgroundLoad *load )
+{
+  g_atomic_int_set ( &load->publish_pending, 0 );
+  background_load_add_pending ( load );
+  background_load_unref ( load );
+  return FALSE;
+}
+
+// Background thread
+static void background_load_publish ( BackgroundLoad *load, gboolean force )
+{
+  GList *waypoints = NULL;
+  GList *tracks = NULL;
+  GList *routes = NULL;
+  vik_trw_layer_steal_items ( load->staging, &waypoints, &tracks, &routes );
+  // Do the per track calculations here rather than on the main thread
+  for ( GList *iter = tracks; iter; iter = iter->next )
+    vik_track_calculate_bounds ( VIK_TRACK(iter->data) );
+  for ( GList *iter = routes; iter; iter = iter->next )
+    vik_track_calculate_bounds ( VIK_TRACK(iter->data) );
+
+  g_mutex_lock ( load->mutex );
+  load->waypoints = g_list_concat ( load->waypoints, waypoints );
+  load->tracks = g_list_concat ( load->tracks, tracks );
+  load->routes = g_list_concat ( load->routes, routes );
+  g_mutex_unlock ( load->mutex );
+
+  if ( g_atomic_int_compare_and_exchange(&load->publish_pending, 0, 1) || force ) {
+    g_atomic_int_inc ( &load->ref_count );
+    gdk_threads_add_idle ( (GSourceFunc)background_load_publish_idle, load );
+  }
+}
+
+// Background thread - called by the reader between chunks
+static gboolean background_load_progress ( BackgroundLoad *load, gint64 bytes_read )
+{
+  if ( a_background_thread_progress(load->threaddata, (gdouble)bytes_read / load->size) != 0 )
+    return FALSE; // Keep what has been read so far
+  if ( g_atomic_int_get(&load->layer_gone) )
+    return FALSE;
+
+  gint64 now = g_get_monotonic_time ();
+  if ( now - load->last_publish >= BACKGROUND_LOAD_PUBLISH_INTERVAL ) {
+    load->last_publish = now;
+    background_load_publish ( load, FALSE );
+  }
+  return TRUE;
+}
+
+static int background_load_thread ( BackgroundLoad *load, gpointer threaddata )
+{
+  load->threaddata = threaddata;
+  load->last_publish = g_get_monotonic_time ();
+  if ( load->is_kml ) {
+    gboolean cancelled = FALSE;
+    load->failed = !a_kml_read_file_progress ( load->staging, load->f, FALSE,
+                                               (VikFileReadProgressFunc)background_load_progress, load, &cancelled );
+    if ( cancelled )
+      return -1;
+  }
+  else {
+    GpxReadStatus_t status = a_gpx_read_file_progress ( load->staging, load->f, load->dirpath, FALSE,
+                                                         (VikFileReadProgressFunc)background_load_progress, load );
+    load->failed = ( status == GPX_READ_FAILURE || status == GPX_READ_WARNING );
+    if ( status == GPX_READ_CANCELLED )
+      return -1;
+  }
+  return 0;
+}
+
+static void background_load_free ( BackgroundLoad *load )
+{
+  xfclose ( load->f );
+  load->f = NULL;
+  // Hand over the remainder; the job's reference is only released on the main thread
+  background_load_publish ( load, TRUE );
+  g_atomic_int_add ( &load->ref_count, -1 ); // Never the last, as the publish holds one
+}
+
+/*
+ * Start reading @filename in the background if it's a large enough GPX or KML file
+ *  to be loaded into a new layer.
+ * The layer for it is added to @top straight away.
+ *
+ * Returns: Whether the file is being loaded in the background
+ *  (in which case @f is now owned by the background job)
+ */
+static gboolean file_load_in_background ( FILE *f,
+                                          const gchar *filename,
+                                          VikAggregateLayer *top,
+                                          VikViewport *vp,
+                                          gboolean new_layer,
+                                          gboolean external,
+                                          const gchar *dirpath,
+                                          const gchar *name )
+{
+  if ( !new_layer || external || a_vik_get_open_files_in_selected_layer() || g_strcmp0(filename, "-") == 0 )
+    return FALSE;
+
+  gboolean is_kml = a_file_check_ext ( filename, ".kml" );
+  if ( !is_kml && !a_file_check_ext(filename, ".gpx") )
+    return FALSE;
+
+  gint size_mb = 32;
+  gint tmp;
+  if ( a_settings_get_integer ( VIK_SETTINGS_FILE_BACKGROUND_LOAD_SIZE, &tmp ) )
+    size_mb = tmp;
+  if ( size_mb <= 0 )
+    return FALSE;
+
+  GStatBuf stat_buf;
+  if ( g_stat(filename, &stat_buf) != 0 || !S_ISREG(stat_buf.st_mode) )
+    return FALSE;
+  if ( (gint64)stat_buf.st_size < (gint64)size_mb * 1024 * 1024 )
+    return FALSE;
+
+  // Same checks as for reading in the foreground
+  if ( is_kml && !file_check_magic(f, FILE_XML_MAGIC) )
+    return FALSE;
+
+  BackgroundLoad *load = g_malloc0 ( sizeof(BackgroundLoad) );
+  load->ref_count = 1;
+  load->top = g_object_ref ( top );
+  load->vp = g_object_ref ( vp );
+  load->filename = g_strdup ( filename );
+  load->dirpath = g_strdup ( dirpath );
+  load->f = f;
+  load->size = stat_buf.st_size;
+  load->is_kml = is_kml;
+  load->mutex = vik_mutex_new ();
+
+  // Layer creation is GUI related, so both layers are created here
+  load->staging = VIK_TRW_LAYER ( vik_layer_create(VIK_LAYER_TRW, vp, FALSE) );
+  vik_layer_rename ( VIK_LAYER(load->staging), name ? name : a_file_basename(filename) );
+
+  load->vtl = VIK_TRW_LAYER ( vik_layer_create(VIK_LAYER_TRW, vp, FALSE) );
+  vik_layer_rename ( VIK_LAYER(load->vtl), name ? name : a_file_basename(filename) );
+  vik_trw_layer_set_filename ( load->vtl, filename );
+  vik_aggregate_layer_add_layer ( top, VIK_LAYER(load->vtl), FALSE );
+  g_object_weak_ref ( G_OBJECT(load->vtl), (GWeakNotify)background_load_layer_gone, load );
+
+  g_atomic_int_inc ( &load->ref_count );
+  gchar *msg = g_strdup_printf ( _("Loading %s..."), a_file_basename(filename) );
+  a_background_thread ( BACKGROUND_POOL_LOCAL,
+                        NULL,
+                        msg,
+                        (vik_thr_func) background_load_thread,
+                        load,
+                        (vik_thr_free_func) background_load_free,
+                        NULL,
+                        (gint)(load->size / BACKGROUND_LOAD_CHUNK_SIZE) );
+  g_free ( msg );
+
+  background_load_unref ( load );
+  return TRUE;
+}
+
 /**
  * a_file_load:
  *
@@ -891,6 +1175,11 @@ VikLoadType_t a_file_load ( VikAggregateLayer *top,
     dirpath = g_path_get_dirname ( absolute );
   g_free ( absolute );
 
+  if ( file_load_in_background ( f, filename, top, vp, new_layer, external, dirpath, name ) ) {
+    g_free ( dirpath );
+    return LOAD_TYPE_OTHER_SUCCESS;
+  }
+
   VikLoadType_t load_answer = a_file_load_stream ( f, filename, top, vp, vtl, new_layer, external, dirpath, name );
 
   g_free ( dirpath );
@@ -898,6 +1187,240 @@ VikLoadType_t a_file_load ( VikAggregateLayer *top,
   return load_answer;
 }
 
+/*
+ * Concurrent loading of many GPX files
+ *
+ * Each file is read into its own (unattached) TrackWaypoint layer in one of several
+ *  background jobs, as the GPX reader keeps all of its state per read.
+ * Finished layers are passed back via a queue and only added into the aggregate layer
+ *  on the main thread, in batches whenever the main loop gets round to it.
+ */
+typedef struct {
+  gchar *filename;
+  gchar *dirpath;
+  VikTrwLayer *vtl;
+  gboolean parsed;
+  GpxReadStatus_t status;
+} GpxLoadItem;
+
+typedef struct {
+  gint ref_count;     // Main thread + each job + each scheduled merge
+  VikAggregateLayer *top;
+  VikViewport *vp;
+  gboolean external;
+  GAsyncQueue *finished; // GpxLoadItems read (or skipped due to cancellation)
+  gint merge_pending;
+  guint loaded;
+  VikFileLoadFunc func;
+  gpointer user_data;
+} GpxLoadBatch;
+
+typedef struct {
+  GpxLoadBatch *batch;
+  GPtrArray *items;
+  guint done;
+} GpxLoadJob;
+
+static void gpx_load_item_free ( GpxLoadItem *item )
+{
+  if ( item->vtl )
+    g_object_unref ( item->vtl );
+  g_free ( item->filename );
+  g_free ( item->dirpath );
+  g_free ( item );
+}
+
+// Main thread
+static void gpx_load_batch_merge ( GpxLoadBatch *batch, gboolean complete )
+{
+  GSList *failures = NULL;
+  guint added = 0;
+  GpxLoadItem *item;
+  while ( (item = g_async_queue_try_pop(batch->finished)) ) {
+    if ( item->parsed && item->status != GPX_READ_FAILURE ) {
+      if ( item->status == GPX_READ_WARNING )
+        g_warning ( "%s: malformed GPX file %s, read as much as possible", __FUNCTION__, item->filename );
+      if ( batch->external )
+        trw_layer_replace_external ( item->vtl, item->filename );
+      vik_layer_post_read ( VIK_LAYER(item->vtl), batch->vp, TRUE );
+      vik_aggregate_layer_add_layer ( batch->top, VIK_LAYER(item->vtl), FALSE );
+      vik_trw_layer_auto_set_view ( item->vtl, batch->vp );
+      item->vtl = NULL; // Now owned by the aggregate layer
+      added++;
+    }
+    else if ( item->parsed )
+      failures = g_slist_prepend ( failures, g_strdup(item->filename) );
+    gpx_load_item_free ( item );
+  }
+  batch->loaded += added;
+
+  if ( batch->func && (added || failures || complete) )
+    batch->func ( batch->user_data, added, failures, complete );
+  g_slist_free_full ( failures, g_free );
+}
+
+// Main thread
+static void gpx_load_batch_unref ( GpxLoadBatch *batch )
+{
+  if ( !g_atomic_int_dec_and_test(&batch->ref_count) )
+    return;
+  // All jobs have finished, so everything is now in the queue
+  gpx_load_batch_merge ( batch, TRUE );
+  g_async_queue_unref ( batch->finished );
+  g_object_unref ( batch->top );
+  g_object_unref ( batch->vp );
+  g_free ( batch );
+}
+
+// Main thread
+static gboolean gpx_load_batch_merge_idle ( GpxLoadBatch *batch )
+{
+  g_atomic_int_set ( &batch->merge_pending, 0 );
+  gpx_load_batch_merge ( batch, FALSE );
+  gpx_load_batch_unref ( batch );
+  return FALSE;
+}
+
+// Any thread, whilst holding a reference
+static void gpx_load_batch_schedule_merge ( GpxLoadBatch *batch, gboolean force )
+{
+  if ( g_atomic_int_compare_and_exchange(&batch->merge_pending, 0, 1) || force ) {
+    g_atomic_int_inc ( &batch->ref_count );
+    gdk_threads_add_idle ( (GSourceFunc)gpx_load_batch_merge_idle, batch );
+  }
+}
+
+static int gpx_load_thread ( GpxLoadJob *job, gpointer threaddata )
+{
+  for ( ; job->done < job->items->len; job->done++ ) {
+    int res = a_background_thread_progress ( threaddata, ((gdouble)job->done+1) / job->items->len );
+    if ( res != 0 )
+      return -1; // Remaining files are handed back unread when the job is freed
+
+    GpxLoadItem *item = g_ptr_array_index ( job->items, job->done );
+    FILE *f = xfopen ( item->filename );
+    if ( f ) {
+      item->status = a_gpx_read_file ( item->vtl, f, item->dirpath, FALSE );
+      xfclose ( f );
+    }
+    else
+      item->status = GPX_READ_FAILURE;
+    item->parsed = TRUE;
+
+    g_async_queue_push ( job->batch->finished, item );
+    gpx_load_batch_schedule_merge ( job->batch, FALSE );
+  }
+  return 0;
+}
+
+static void gpx_load_job_free ( GpxLoadJob *job )
+{
+  for ( guint ii = job->done; ii < job->items->len; ii++ )
+    g_async_queue_push ( job->batch->finished, g_ptr_array_index(job->items, ii) );
+  // Ensure the job's reference is only released on the main thread
+  gpx_load_batch_schedule_merge ( job->batch, TRUE );
+  g_atomic_int_add ( &job->batch->ref_count, -1 ); // Never the last, as the merge holds one
+  g_ptr_array_free ( job->items, TRUE );
+  g_free ( job );
+}
+
+/**
+ * a_file_load_gpx_files:
+ * @top:      The aggregate layer to add the new layers into
+ * @vp:       The viewport
+ * @files:    A list of filenames
+ * @external: Whether the new layers refer to the files externally
+ * @func:     Called (on the main thread) each time some layers have been added and once all files are done
+ * @user_data: Passed to @func
+ *
+ * Load the GPX files from @files, each into a new TrackWaypoint layer,
+ *  reading several of the files at once in the background.
+ * Only plain GPX files (by extension) are taken - any other files are left to be loaded as normal.
+ *
+ * Returns: The list of the files not handled here.
+ *  The contents of @files are either moved into the returned list or freed
+ */
+GSList *a_file_load_gpx_files ( VikAggregateLayer *top,
+                                VikViewport *vp,
+                                GSList *files,
+                                gboolean external,
+                                VikFileLoadFunc func,
+                                gpointer user_data )
+{
+  GSList *others = NULL;
+  GPtrArray *items = g_ptr_array_new ();
+  for ( GSList *iter = files; iter; iter = g_slist_next(iter) ) {
+    gchar *filename = iter->data;
+    if ( !a_file_check_ext(filename, ".gpx") || g_strcmp0(filename, "-") == 0 ) {
+      others = g_slist_prepend ( others, filename );
+      continue;
+    }
+    GpxLoadItem *item = g_malloc0 ( sizeof(GpxLoadItem) );
+    item->filename = filename;
+    gchar *absolute = file_realpath_dup ( filename );
+    if ( absolute )
+      item->dirpath = g_path_get_dirname ( absolute );
+    g_free ( absolute );
+    // Layer creation is GUI related, so it is done here
+    item->vtl = VIK_TRW_LAYER ( vik_layer_create(VIK_LAYER_TRW, vp, FALSE) );
+    vik_layer_rename ( VIK_LAYER(item->vtl), a_file_basename(filename) );
+    if ( !external )
+      vik_trw_layer_set_filename ( item->vtl, filename );
+    g_ptr_array_add ( items, item );
+  }
+  g_slist_free ( files );
+  others = g_slist_reverse ( others );
+
+  if ( items->len == 0 ) {
+    g_ptr_array_free ( items, TRUE );
+    return others;
+  }
+
+  GpxLoadBatch *batch = g_malloc0 ( sizeof(GpxLoadBatch) );
+  batch->ref_count = 1;
+  batch->top = g_object_ref ( top );
+  batch->vp = g_object_ref ( vp );
+  batch->external = external;
+  batch->finished = g_async_queue_new ();
+  batch->func = func;
+  batch->user_data = user_data;
+
+  guint cpus = util_get_number_of_cpus ();
+  guint njobs = cpus > 1 ? cpus-1 : 1;
+  if ( njobs > items->len )
+    njobs = items->len;
+
+  GpxLoadJob **jobs = g_malloc ( njobs * sizeof(GpxLoadJob*) );
+  for ( guint jj = 0; jj < njobs; jj++ ) {
+    jobs[jj] = g_malloc0 ( sizeof(GpxLoadJob) );
+    jobs[jj]->batch = batch;
+    jobs[jj]->items = g_ptr_array_new ();
+  }
+  // Interleave so the files of a directory listing get spread across the jobs
+  for ( guint ii = 0; ii < items->len; ii++ )
+    g_ptr_array_add ( jobs[ii % njobs]->items, g_ptr_array_index(items, ii) );
+  g_ptr_array_free ( items, TRUE );
+
+  for ( guint jj = 0; jj < njobs; jj++ ) {
+    g_atomic_int_inc ( &batch->ref_count );
+    gchar *msg = g_strdup_printf ( ngettext("Loading %d GPX file...", "Loading %d GPX files...", jobs[jj]->items->len),
+                                   jobs[jj]->items->len );
+    a_background_thread ( BACKGROUND_POOL_LOCAL,
+                          NULL,
+                          msg,
+                          (vik_thr_func) gpx_load_thread,
+                          jobs[jj],
+                          (vik_thr_free_func) gpx_load_job_free,
+                          NULL,
+                          jobs[jj]->items->len );
+    g_free ( msg );
+  }
+  g_free ( jobs );
+
+  gpx_load_batch_unref ( batch );
+  return others;
+}
+
 gboolean a_file_save ( VikAggregateLayer *top, gpointer vp, const gchar *filename )
 {
   FILE *f;
@@ -87,6 +87,22 @@ VikLoadType_t a_file_load ( VikAggregateLayer *top,
                             gboolean external,
                             const gchar *name );
 
+/**
+ * VikFileLoadFunc:
+ * @user_data: As given to a_file_load_gpx_files()
+ * @added:     Number of layers added since the previous call
+ * @failures:  Filenames that could not be loaded since the previous call
+ * @complete:  Whether all the files have now been handled
+ */
+typedef void (*VikFileLoadFunc) ( gpointer user_data, guint added, GSList *failures, gboolean complete );
+
+GSList *a_file_load_gpx_files ( VikAggregateLayer *top,
+                                VikViewport *vp,
+                                GSList *files,
+                                gboolean external,
+                                VikFileLoadFunc func,
+                                gpointer user_data );
+
 gboolean a_file_save ( VikAggregateLayer *top, gpointer vp, const gchar *filename );
 /* Only need to define VikTrack if the file type is FILE_TYPE_GPX_TRACK */
 gboolean a_file_export ( VikTrwLayer *vtl, const gchar *filename, VikFileType_t file_type, VikTrack *trk, gboolean write_hidden );
@@ -338,6 +338,10 @@ static struct {
 static GHashTable *icons = NULL;
 static GHashTable *old_icons = NULL;
 
+// Symbols may be looked up from file import threads,
+//  so the lazy creation of the tables and icons is guarded
+G_LOCK_DEFINE_STATIC(icons_lock);
+
 static gboolean str_equal_casefold ( gconstpointer v1, gconstpointer v2 ) {
   gboolean equal;
   gchar *v1_lower;
@@ -376,16 +380,24 @@ static guint str_hash_casefold ( gconstpointer key ) {
 }
 
 static void init_icons() {
-  icons = g_hash_table_new_full ( str_hash_casefold, str_equal_casefold, NULL, NULL);
+  G_LOCK(icons_lock);
+  if ( icons ) {
+    G_UNLOCK(icons_lock);
+    return;
+  }
+  GHashTable *new_icons = g_hash_table_new_full ( str_hash_casefold, str_equal_casefold, NULL, NULL);
   old_icons = g_hash_table_new_full ( str_hash_casefold, str_equal_casefold, NULL, NULL);
   gint i;
   for (i=0; i<G_N_ELEMENTS(garmin_syms); i++) {
-    g_hash_table_insert(icons, garmin_syms[i].sym, GINT_TO_POINTER (i));
+    g_hash_table_insert(new_icons, garmin_syms[i].sym, GINT_TO_POINTER (i));
     g_hash_table_insert(old_icons, garmin_syms[i].old_sym, GINT_TO_POINTER (i));
   }
+  g_atomic_pointer_set ( &icons, new_icons );
+  G_UNLOCK(icons_lock);
 }
 
 static GdkPixbuf *get_wp_sym_from_index ( gint i ) {
+  G_LOCK(icons_lock);
   // Ensure data exists to either directly load icon or scale from the other set
   if ( !garmin_syms[i].icon && ( garmin_syms[i].data || garmin_syms[i].data_large) ) {
     if ( a_vik_get_use_large_waypoint_icons() ) {
@@ -401,7 +413,9 @@ static GdkPixbuf *get_wp_sym_from_index ( gint i ) {
         garmin_syms[i].icon = ui_get_icon ( garmin_syms[i].data_large, 18 );
     }
   }
-  return garmin_syms[i].icon;
+  GdkPixbuf *icon = garmin_syms[i].icon;
+  G_UNLOCK(icons_lock);
+  return icon;
 }
 
 GdkPixbuf *a_get_wp_sym ( const gchar *sym ) {
@@ -411,7 +425,7 @@ GdkPixbuf *a_get_wp_sym ( const gchar *sym ) {
   if (!sym) {
     return NULL;
   }
-  if (!icons) {
+  if ( !g_atomic_pointer_get(&icons) ) {
     init_icons();
   }
   if (g_hash_table_lookup_extended(icons, sym, &x, &gp))
@@ -429,7 +443,7 @@ const gchar *a_get_hashed_sym ( const gchar *sym ) {
   if (!sym) {
     return NULL;
   }
-  if (!icons) {
+  if ( !g_atomic_pointer_get(&icons) ) {
     init_icons();
   }
   if (g_hash_table_lookup_extended(icons, sym, &x, &gp))
@@ -476,12 +490,14 @@ GtkListStore* a_garmin_get_sym_liststore ( void )
 void clear_garmin_icon_syms () {
   g_debug("garminsymbols: clear_garmin_icon_syms");
   gint i;
+  G_LOCK(icons_lock);
   for (i=0; i<G_N_ELEMENTS(garmin_syms); i++) {
     if (garmin_syms[i].icon) {
       g_object_unref (garmin_syms[i].icon);
       garmin_syms[i].icon = NULL;
     }
   }
+  G_UNLOCK(icons_lock);
   if ( list ) {
     gtk_list_store_clear ( list );
     g_object_unref ( list );
@@ -33,6 +33,8 @@
 #include "config.h"
 #include "globals.h"
 #include "file.h"
+#include "util.h"
+#include "background.h"
 
 #include <sys/stat.h>
 #ifdef HAVE_UTIME_H
@@ -531,6 +533,88 @@ gchar* a_geotag_get_exif_date_from_file ( const gchar *filename, gboolean *has_G
 }
 
 
+typedef struct {
+	const gchar **filenames;
+	gchar **datetimes;
+	gboolean *has_GPS_info;
+	GMutex mutex;
+	GCond cond;
+	guint done;
+	gint cancelled;
+} ExifDatesT;
+
+static void exif_dates_worker ( gpointer data, ExifDatesT *ed )
+{
+	guint ii = GPOINTER_TO_UINT(data) - 1;
+	if ( !g_atomic_int_get(&ed->cancelled) )
+		ed->datetimes[ii] = a_geotag_get_exif_date_from_file ( ed->filenames[ii], &ed->has_GPS_info[ii] );
+	g_mutex_lock ( &ed->mutex );
+	ed->done++;
+	g_cond_signal ( &ed->cond );
+	g_mutex_unlock ( &ed->mutex );
+}
+
+/**
+ * a_geotag_get_exif_dates_from_files:
+ * @filenames:    The files
+ * @count:        The number of files
+ * @datetimes:    Array of at least @count values to be filled in (free each with g_free())
+ * @has_GPS_info: Array of at least @count values to be filled in
+ * @threaddata:   Optional background thread this is being run from
+ *
+ * As a_geotag_get_exif_date_from_file() for each file,
+ *  but reading the files in parallel using all the CPUs
+ *  (since it is dominated by waiting for the files to be read).
+ * Progress is reported once per file (so each counts as a background item),
+ *  going from 0 to 0.5, as normally the files are then processed.
+ *
+ * Returns: 0 or -1 if cancelled
+ */
+gint a_geotag_get_exif_dates_from_files ( const gchar **filenames, guint count, gchar **datetimes, gboolean *has_GPS_info, gpointer threaddata )
+{
+	for ( guint ii = 0; ii < count; ii++ ) {
+		datetimes[ii] = NULL;
+		has_GPS_info[ii] = FALSE;
+	}
+	if ( count == 0 )
+		return 0;
+
+	ExifDatesT *ed = g_new0 ( ExifDatesT, 1 );
+	ed->filenames = filenames;
+	ed->datetimes = datetimes;
+	ed->has_GPS_info = has_GPS_info;
+	g_mutex_init ( &ed->mutex );
+	g_cond_init ( &ed->cond );
+
+	GThreadPool *pool = g_thread_pool_new ( (GFunc)exif_dates_worker, ed, MIN(count, util_get_number_of_cpus()), FALSE, NULL );
+	for ( guint nn = 0; nn < count; nn++ )
+		g_thread_pool_push ( pool, GUINT_TO_POINTER(nn+1), NULL );
+
+	guint reported = 0;
+	g_mutex_lock ( &ed->mutex );
+	while ( ed->done < count ) {
+		gint64 end_time = g_get_monotonic_time () + G_TIME_SPAN_SECOND / 4;
+		(void)g_cond_wait_until ( &ed->cond, &ed->mutex, end_time );
+		guint done = ed->done;
+		g_mutex_unlock ( &ed->mutex );
+		// Remaining files are skipped once cancelled
+		while ( threaddata && reported < done && !g_atomic_int_get(&ed->cancelled) ) {
+			if ( a_background_thread_progress ( threaddata, 0.5 * ++reported / count ) )
+				g_atomic_int_set ( &ed->cancelled, 1 );
+		}
+		g_mutex_lock ( &ed->mutex );
+	}
+	g_mutex_unlock ( &ed->mutex );
+
+	g_thread_pool_free ( pool, FALSE, TRUE );
+
+	gint ans = g_atomic_int_get(&ed->cancelled) ? -1 : 0;
+	g_mutex_clear ( &ed->mutex );
+	g_cond_clear ( &ed->cond );
+	g_free ( ed );
+	return ans;
+}
+
 #ifdef HAVE_LIBEXIF
 /**! If the entry doesn't exist, create it.
  * Based on exif command line action_create_value function in exif 0.6.20
@@ -39,6 +39,7 @@ VikWaypoint* a_geotag_create_waypoint_from_file ( const gchar *filename, VikCoor
 VikWaypoint* a_geotag_waypoint_positioned ( const gchar *filename, VikCoord coord, gdouble alt, gchar **name, VikWaypoint *wp );
 
 gchar* a_geotag_get_exif_date_from_file ( const gchar *filename, gboolean *has_GPS_info );
+gint a_geotag_get_exif_dates_from_files ( const gchar **filenames, guint count, gchar **datetimes, gboolean *has_GPS_info, gpointer threaddata );
 
 struct LatLon a_geotag_get_position ( const gchar *filename );
 
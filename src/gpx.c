@@ -273,40 +273,54 @@ static const gchar* get_tag_name ( tag_type tt )
 
 /******************************************/
 
-static tag_type current_tag = tt_unknown;
-static GString *xpath = NULL;
-
-/* current ("c_") objects */
-static VikTrackpoint *c_tp = NULL;
-static VikWaypoint *c_wp = NULL;
-static VikTrack *c_tr = NULL;
-static VikTRWMetadata *c_md = NULL;
-static GString *c_cdata = NULL;
-static GString *c_ext = NULL;
-static GString *c_trkpt_ext = NULL;
-
-static gchar *c_wp_name = NULL;
-static gchar *c_tr_name = NULL;
-
-// Global colour for all tracks (ATM not for waypoints)
-static GdkColor c_color;
-static gboolean c_have_color = FALSE;
-
-/* temporary things so we don't have to create them lots of times */
-static const gchar *c_slat, *c_slon;
-static struct LatLon c_ll;
-
-/* specialty flags / etc */
-static gboolean f_tr_newseg;
-static const gchar *c_link = NULL;
-static guint unnamed_waypoints = 0;
-static guint unnamed_tracks = 0;
-static guint unnamed_routes = 0;
-
+/*
+ * All state of a single GPX read lives here,
+ *  so that several files may be parsed at the same time in different threads
+ */
 typedef struct {
 	VikTrwLayer *vtl;
 	const gchar *dirpath;
 	gboolean append;
+
+	tag_type current_tag;
+	GString *xpath;
+
+	/* current ("c_") objects */
+	VikTrackpoint *c_tp;
+	VikWaypoint *c_wp;
+	VikTrack *c_tr;
+	VikTRWMetadata *c_md;
+	GString *c_cdata;
+	GString *c_ext;
+	GString *c_trkpt_ext;
+
+	gchar *c_wp_name;
+	gchar *c_tr_name;
+
+	// Global colour for all tracks (ATM not for waypoints)
+	GdkColor c_color;
+	gboolean c_have_color;
+
+	/* temporary things so we don't have to create them lots of times */
+	struct LatLon c_ll;
+
+	/* specialty flags / etc */
+	gboolean f_tr_newseg;
+	const gchar *c_link;
+	guint unnamed_waypoints;
+	guint unnamed_tracks;
+	guint unnamed_routes;
+
+	// Extension (re)processing
+	GString *gs_ext;
+	GMarkupParseContext *gcontext;
+	GQueue *laps;
+
+	// When reading with progress, items may be taken from the layer during the read
+	//  so tracks get tidied individually
+	VikFileReadProgressFunc progress_func;
+	gboolean tidy;
+	guint tidy_speed;
 } UserDataT;
 
 static const char *get_attr ( const char **attr, const char *key )
@@ -322,7 +336,7 @@ static const char *get_attr ( const char **attr, const char *key )
 /**
  * Attempt to set the colour given a string value
  */
-static gboolean global_set_color ( gchar *color )
+static gboolean global_set_color ( UserDataT *ud, gchar *color )
 {
 	// If "#AARRGGBB" style
 	if ( strlen(color) == 9 && color[0] == '#' ) {
@@ -336,11 +350,11 @@ static gboolean global_set_color ( gchar *color )
 		gcol[5] = color[7];
 		gcol[6] = color[8];
 		gcol[7] = '\0';
-		return gdk_color_parse ( gcol, &c_color );
+		return gdk_color_parse ( gcol, &ud->c_color );
 	}
 	// Otherwise try whole string
 	//  hopefully "#RRGGBB" or named colour
-	return gdk_color_parse ( color, &c_color );
+	return gdk_color_parse ( color, &ud->c_color );
 }
 
 /**
@@ -375,11 +389,12 @@ static GString *get_header ( const char **attr )
   return gs;
 }
 
-static gboolean set_c_ll ( const char **attr )
+static gboolean set_c_ll ( UserDataT *ud, const char **attr )
 {
+  const gchar *c_slat, *c_slon;
   if ( (c_slat = get_attr ( attr, "lat" )) && (c_slon = get_attr ( attr, "lon" )) ) {
-    c_ll.lat = g_ascii_strtod(c_slat, NULL);
-    c_ll.lon = g_ascii_strtod(c_slon, NULL);
+    ud->c_ll.lat = g_ascii_strtod(c_slat, NULL);
+    ud->c_ll.lon = g_ascii_strtod(c_slon, NULL);
     return TRUE;
   }
   return FALSE;
@@ -471,8 +486,6 @@ static tag_type_ext get_tag_ext_specific (const char *tt)
  return ext_unknown;
 }
 
-static GString *gs_ext;
-
 // Reprocess the extension text to extract tags we handle
 static void ext_start_element ( GMarkupParseContext *context,
                                 const gchar         *element_name,
@@ -481,7 +494,8 @@ static void ext_start_element ( GMarkupParseContext *context,
                                 gpointer             user_data,
                                 GError             **error )
 {
-  g_string_erase ( gs_ext, 0, -1 ); // Reset the tmp string buffer
+  UserDataT *ud = (UserDataT*)user_data;
+  g_string_erase ( ud->gs_ext, 0, -1 ); // Reset the tmp string buffer
 }
 
 // NB Text is not null terminated
@@ -491,8 +505,9 @@ static void ext_text ( GMarkupParseContext *context,
                        gpointer             user_data,
                        GError             **error )
 {
+  UserDataT *ud = (UserDataT*)user_data;
   // Store tag contents
-  g_string_append_len ( gs_ext, text, text_len );
+  g_string_append_len ( ud->gs_ext, text, text_len );
 }
 
 // Main trackpoint extension processing here
@@ -501,41 +516,42 @@ static void ext_end_element ( GMarkupParseContext *context,
                               gpointer             user_data,
                               GError             **error )
 {
+  UserDataT *ud = (UserDataT*)user_data;
   // If it is any of the extended tags we are interested in,
   //  then use the text stored in the string buffer to set the appropriate track or trackpoint value
   tag_type_ext tag = get_tag_ext_specific ( element_name );
   switch ( tag ) {
   case ext_tp_heart_rate:
-    if ( c_tp ) c_tp->heart_rate = atoi ( gs_ext->str ); // bpm
+    if ( ud->c_tp ) ud->c_tp->heart_rate = atoi ( ud->gs_ext->str ); // bpm
     break;
   case ext_tp_cadence:
-    if ( c_tp ) c_tp->cadence = atoi ( gs_ext->str ); // RPM
+    if ( ud->c_tp ) ud->c_tp->cadence = atoi ( ud->gs_ext->str ); // RPM
     break;
   case ext_tp_speed:
-    if ( c_tp ) c_tp->speed = g_ascii_strtod ( gs_ext->str, NULL ); // m/s
+    if ( ud->c_tp ) ud->c_tp->speed = g_ascii_strtod ( ud->gs_ext->str, NULL ); // m/s
     break;
   case ext_tp_course:
-    if ( c_tp ) c_tp->course = g_ascii_strtod ( gs_ext->str, NULL ); // Degrees
+    if ( ud->c_tp ) ud->c_tp->course = g_ascii_strtod ( ud->gs_ext->str, NULL ); // Degrees
     break;
   case ext_tp_temp:
-    if ( c_tp ) c_tp->temp = g_ascii_strtod ( gs_ext->str, NULL ); // Degrees Celsius
+    if ( ud->c_tp ) ud->c_tp->temp = g_ascii_strtod ( ud->gs_ext->str, NULL ); // Degrees Celsius
     break;
   case ext_tp_power:
-    if ( c_tp ) c_tp->power = atoi ( gs_ext->str ); // Watts
+    if ( ud->c_tp ) ud->c_tp->power = atoi ( ud->gs_ext->str ); // Watts
     break;
   case ext_trk_color:
-    if ( c_tr ) {
+    if ( ud->c_tr ) {
       GdkColor gclr;
-      if ( gdk_color_parse ( gs_ext->str, &gclr ) ) {
-        c_tr->has_color = TRUE;
-        c_tr->color = gclr;
+      if ( gdk_color_parse ( ud->gs_ext->str, &gclr ) ) {
+        ud->c_tr->has_color = TRUE;
+        ud->c_tr->color = gclr;
       }
     }
     break;
   default:
     break;
   }
-  g_string_erase ( gs_ext, 0, -1 );
+  g_string_erase ( ud->gs_ext, 0, -1 );
 }
 
 // Laps
@@ -546,20 +562,20 @@ static void lap_start_element ( GMarkupParseContext *context,
                                 gpointer             user_data,
                                 GError             **error )
 {
-  g_string_erase ( gs_ext, 0, -1 ); // Reset the tmp string buffer
+  UserDataT *ud = (UserDataT*)user_data;
+  g_string_erase ( ud->gs_ext, 0, -1 ); // Reset the tmp string buffer
   tag_type_ext tag = get_tag_ext_specific ( element_name );
   switch ( tag ) {
   case ext_gpx_lap:
     {
       // Not expected that many laps - so no need to prepend and then reverse at the end...
       // So simply append to the end (tail)
-      GQueue* laps = (GQueue*)user_data;
       GpxLapType* lap = g_malloc(sizeof(GpxLapType));
       lap->duration = NAN;
       lap->distance = NAN;
       lap->startTime = NAN;
       if ( lap )
-        g_queue_push_tail ( laps, lap );
+        g_queue_push_tail ( ud->laps, lap );
     }
     break;
   default:
@@ -572,24 +588,24 @@ static void lap_end_element ( GMarkupParseContext *context,
                               gpointer             user_data,
                               GError             **error )
 {
+  UserDataT *ud = (UserDataT*)user_data;
   // If it is any of the (lap) extended tags we are interested in
   tag_type_ext tag = get_tag_ext_specific ( element_name );
   switch ( tag ) {
   case ext_gpx_lap_index:
     {
       // What if negative?
-      //index = atoi ( gs_ext->str, NULL );
+      //index = atoi ( ud->gs_ext->str, NULL );
       // Ignore index from file (have seen files with 0 - which just complicates matters)
       // - So use the structure index instead
     }
     break;
   case ext_gpx_lap_length:
     // Add to current list
-    if (user_data) {
-      gdouble distance = g_ascii_strtod ( gs_ext->str, NULL ); // metres
+    if (ud->laps) {
+      gdouble distance = g_ascii_strtod ( ud->gs_ext->str, NULL ); // metres
       if ( !isnan(distance) ) {
-        GQueue* gq = (GQueue*)user_data;
-        GList* laps = g_queue_peek_tail_link(gq);
+        GList* laps = g_queue_peek_tail_link(ud->laps);
         if (laps) {
           GpxLapType* lap = (GpxLapType*)laps->data;
           lap->distance = distance;
@@ -599,11 +615,10 @@ static void lap_end_element ( GMarkupParseContext *context,
     break;
   case ext_gpx_lap_start_time:
     // Add to current list
-    if (user_data) {
+    if (ud->laps) {
       GTimeVal gtv;
-      if ( g_time_val_from_iso8601(gs_ext->str, &gtv) ) {
-        GQueue* gq = (GQueue*)user_data;
-        GList* laps = g_queue_peek_tail_link(gq);
+      if ( g_time_val_from_iso8601(ud->gs_ext->str, &gtv) ) {
+        GList* laps = g_queue_peek_tail_link(ud->laps);
         if (laps) {
           GpxLapType* lap = (GpxLapType*)laps->data;
           gdouble d1 = gtv.tv_sec;
@@ -615,12 +630,11 @@ static void lap_end_element ( GMarkupParseContext *context,
     break;
   case ext_gpx_lap_duration:
     // Add to current list
-    if (user_data)
+    if (ud->laps)
     {
-      gdouble duration = g_ascii_strtod ( gs_ext->str, NULL ); // seconds
+      gdouble duration = g_ascii_strtod ( ud->gs_ext->str, NULL ); // seconds
       if ( !isnan(duration) ) {
-        GQueue* gq = (GQueue*)user_data;
-        GList* laps = g_queue_peek_tail_link(gq);
+        GList* laps = g_queue_peek_tail_link(ud->laps);
         if (laps) {
           GpxLapType* lap = (GpxLapType*)laps->data;
           lap->duration = duration;
@@ -631,23 +645,20 @@ static void lap_end_element ( GMarkupParseContext *context,
   default:
     break;
   }
-  g_string_erase ( gs_ext, 0, -1 );
+  g_string_erase ( ud->gs_ext, 0, -1 );
 }
 
-static GMarkupParser gparser;
-static GMarkupParseContext *gcontext;
-
-static void track_or_trackpoint_extension_process ( gchar *str )
+static void track_or_trackpoint_extension_process ( UserDataT *ud, gchar *str )
 {
   if ( !str )
     return;
 
   // Parse xml fragment to extract extension tag values
   GError *error = NULL;
-  if ( !g_markup_parse_context_parse ( gcontext, str, strlen(str), &error ) )
+  if ( !g_markup_parse_context_parse ( ud->gcontext, str, strlen(str), &error ) )
     g_warning ( "%s: parse error %s on:%s", __FUNCTION__, error ? error->message : "???", str );
 
-  if ( !g_markup_parse_context_end_parse ( gcontext, &error) )
+  if ( !g_markup_parse_context_end_parse ( ud->gcontext, &error) )
     g_warning ( "%s: error %s occurred on end of:%s", __FUNCTION__, error ? error->message : "???", str );
 }
 
@@ -668,25 +679,25 @@ static void extension_append_attributions ( GString *gs, const char *el, const c
 
 static void gpx_start(UserDataT *ud, const char *el, const char **attr)
 {
-  static const gchar *tmp;
+  const gchar *tmp;
   VikTrwLayer *vtl = ud->vtl;
 
-  g_string_append_c ( xpath, '/' );
-  g_string_append ( xpath, el );
-  current_tag = get_tag ( xpath->str );
-  if ( current_tag == tt_unknown )
-    current_tag = get_tag_extension ( xpath->str );
+  g_string_append_c ( ud->xpath, '/' );
+  g_string_append ( ud->xpath, el );
+  ud->current_tag = get_tag ( ud->xpath->str );
+  if ( ud->current_tag == tt_unknown )
+    ud->current_tag = get_tag_extension ( ud->xpath->str );
 
-  switch ( current_tag ) {
+  switch ( ud->current_tag ) {
 
      case tt_gpx:
        {
-         c_md = vik_trw_metadata_new();
+         ud->c_md = vik_trw_metadata_new();
          // Store creator information if possible
          const gchar *crt = get_attr ( attr, "creator" );
          if ( crt ) {
            // If there is an actual description field it will overwrite this value
-           c_md->description = g_strdup_printf ( _("Created by: %s"), crt );
+           ud->c_md->description = g_strdup_printf ( _("Created by: %s"), crt );
          }
 
          const gchar *version = get_attr ( attr, "version" );
@@ -710,49 +721,49 @@ static void gpx_start(UserDataT *ud, const char *el, const char **attr)
        }
        break;
      case tt_wpt:
-       if ( set_c_ll( attr ) ) {
-         c_wp = vik_waypoint_new ();
+       if ( set_c_ll( ud, attr ) ) {
+         ud->c_wp = vik_waypoint_new ();
          if ( get_attr ( attr, "hidden" ) )
-           c_wp->visible = FALSE;
+           ud->c_wp->visible = FALSE;
 
-         vik_coord_load_from_latlon ( &(c_wp->coord), vik_trw_layer_get_coord_mode ( vtl ), &c_ll );
+         vik_coord_load_from_latlon ( &(ud->c_wp->coord), vik_trw_layer_get_coord_mode ( vtl ), &ud->c_ll );
        }
        break;
 
      case tt_trk:
      case tt_rte:
-       c_tr = vik_track_new ();
-       c_tr->is_route = (current_tag == tt_rte) ? TRUE : FALSE;
+       ud->c_tr = vik_track_new ();
+       ud->c_tr->is_route = (ud->current_tag == tt_rte) ? TRUE : FALSE;
        if ( get_attr ( attr, "hidden" ) )
-         c_tr->visible = FALSE;
+         ud->c_tr->visible = FALSE;
        // Apply default colouring if applicable,
        //  which will then get overridden by any specific colour later
-       if ( c_have_color ) {
-           c_tr->has_color = TRUE;
-           c_tr->color = c_color;
+       if ( ud->c_have_color ) {
+           ud->c_tr->has_color = TRUE;
+           ud->c_tr->color = ud->c_color;
        }
        break;
 
      case tt_trk_trkseg:
-       f_tr_newseg = TRUE;
+       ud->f_tr_newseg = TRUE;
        break;
 
      case tt_trk_trkseg_trkpt:
-       if ( set_c_ll( attr ) ) {
-         c_tp = vik_trackpoint_new ();
-         vik_coord_load_from_latlon ( &(c_tp->coord), vik_trw_layer_get_coord_mode ( vtl ), &c_ll );
-         if ( f_tr_newseg ) {
-           c_tp->newsegment = TRUE;
-           f_tr_newseg = FALSE;
+       if ( set_c_ll( ud, attr ) ) {
+         ud->c_tp = vik_trackpoint_new ();
+         vik_coord_load_from_latlon ( &(ud->c_tp->coord), vik_trw_layer_get_coord_mode ( vtl ), &ud->c_ll );
+         if ( ud->f_tr_newseg ) {
+           ud->c_tp->newsegment = TRUE;
+           ud->f_tr_newseg = FALSE;
          }
-         c_tr->trackpoints = g_list_prepend ( c_tr->trackpoints, c_tp );
+         ud->c_tr->trackpoints = g_list_prepend ( ud->c_tr->trackpoints, ud->c_tp );
        }
        break;
 
      case tt_gpx_url:
      case tt_wpt_link:
      case tt_trk_link:
-       c_link = get_attr ( attr, "href" );
+       ud->c_link = get_attr ( attr, "href" );
        break;
      case tt_gpx_url_name:
      case tt_gpx_name:
@@ -792,42 +803,42 @@ static void gpx_start(UserDataT *ud, const char *el, const char **attr)
      case tt_trk_url:
      case tt_trk_url_name:
      case tt_trk_name:
-       g_string_erase ( c_cdata, 0, -1 ); /* clear the cdata buffer */
+       g_string_erase ( ud->c_cdata, 0, -1 ); /* clear the cdata buffer */
        break;
 
      case tt_waypoint:
-       c_wp = vik_waypoint_new ();
+       ud->c_wp = vik_waypoint_new ();
        break;
 
      case tt_waypoint_coord:
-       if ( set_c_ll( attr ) )
-         vik_coord_load_from_latlon ( &(c_wp->coord), vik_trw_layer_get_coord_mode ( vtl ), &c_ll );
+       if ( set_c_ll( ud, attr ) )
+         vik_coord_load_from_latlon ( &(ud->c_wp->coord), vik_trw_layer_get_coord_mode ( vtl ), &ud->c_ll );
        break;
 
      case tt_waypoint_name:
        if ( ( tmp = get_attr(attr, "id") ) ) {
-         if ( c_wp_name )
-           g_free ( c_wp_name );
-         c_wp_name = g_strdup ( tmp );
+         if ( ud->c_wp_name )
+           g_free ( ud->c_wp_name );
+         ud->c_wp_name = g_strdup ( tmp );
        }
-       g_string_erase ( c_cdata, 0, -1 ); /* clear the cdata buffer for description */
+       g_string_erase ( ud->c_cdata, 0, -1 ); /* clear the cdata buffer for description */
        break;
 
      case tt_gpx_extensions:
      case tt_wpt_extensions:
      case tt_trk_extensions:
-       g_string_erase ( c_ext, 0, -1 ); // clear the buffer
+       g_string_erase ( ud->c_ext, 0, -1 ); // clear the buffer
        break;
      case tt_trk_trkseg_trkpt_extensions:
-       g_string_erase ( c_trkpt_ext, 0, -1 ); // clear the buffer
+       g_string_erase ( ud->c_trkpt_ext, 0, -1 ); // clear the buffer
        break;
      case tt_gpx_an_extension:
      case tt_wpt_an_extension:
      case tt_trk_an_extension:
-       extension_append_attributions ( c_ext, el, attr );
+       extension_append_attributions ( ud->c_ext, el, attr );
        break;
      case tt_trk_trkseg_trkpt_an_extension:
-       extension_append_attributions ( c_trkpt_ext, el, attr );
+       extension_append_attributions ( ud->c_trkpt_ext, el, attr );
        break;
 
      default: break;
@@ -839,9 +850,9 @@ static void gpx_start(UserDataT *ud, const char *el, const char **attr)
 #define VIK_SETTINGS_GPX_TIDY_SPEED "gpx_tidy_points_max_speed"
 
 /**
- *
+ * Returns whether tidying should be performed and if so at what speed
  */
-static void track_tidy_processing ( VikTrwLayer *vtl )
+static gboolean track_tidy_settings ( guint *speed )
 {
   // Default to automatically attempt tiding
   gboolean do_tidy = TRUE;
@@ -849,14 +860,23 @@ static void track_tidy_processing ( VikTrwLayer *vtl )
   if ( a_settings_get_boolean ( VIK_SETTINGS_GPX_TIDY, &btmp ) )
      do_tidy = btmp;
 
-  if ( do_tidy ) {
-    // highly unlikely to be going faster than this, especially for the first point
-    guint speed = 340; // Speed of Sound
+  // highly unlikely to be going faster than this, especially for the first point
+  *speed = 340; // Speed of Sound
 
-    gint itmp = 0;
-    if ( a_settings_get_integer ( VIK_SETTINGS_GPX_TIDY_SPEED, &itmp ) )
-      speed = (guint)itmp;
+  gint itmp = 0;
+  if ( a_settings_get_integer ( VIK_SETTINGS_GPX_TIDY_SPEED, &itmp ) )
+    *speed = (guint)itmp;
 
+  return do_tidy;
+}
+
+/**
+ *
+ */
+static void track_tidy_processing ( VikTrwLayer *vtl )
+{
+  guint speed;
+  if ( track_tidy_settings(&speed) ) {
     // NB bounds calculated in subsequent layer post read,
     //  so no need to do it now
     vik_trw_layer_tidy_tracks ( vtl, speed, FALSE );
@@ -865,405 +885,410 @@ static void track_tidy_processing ( VikTrwLayer *vtl )
 
 static void gpx_end(UserDataT *ud, const char *el)
 {
-  static GTimeVal tp_time;
-  static GTimeVal wp_time;
+  GTimeVal tp_time;
+  GTimeVal wp_time;
   VikTrwLayer *vtl = ud->vtl;
 
-  g_string_truncate ( xpath, xpath->len - strlen(el) - 1 );
+  g_string_truncate ( ud->xpath, ud->xpath->len - strlen(el) - 1 );
 
-  switch ( current_tag ) {
+  switch ( ud->current_tag ) {
 
      case tt_gpx:
-       vik_trw_layer_set_metadata ( vtl, c_md );
-       c_md = NULL;
+       vik_trw_layer_set_metadata ( vtl, ud->c_md );
+       ud->c_md = NULL;
 
        // Essentially the end for a TrackWaypoint layer,
        //  so any specific GPX post processing can occur here
-       track_tidy_processing ( vtl );
+       if ( !ud->progress_func )
+         track_tidy_processing ( vtl );
 
        break;
 
      case tt_gpx_name:
-       vik_layer_rename ( VIK_LAYER(vtl), c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_layer_rename ( VIK_LAYER(vtl), ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_author:
-       if ( c_md->author )
-         g_free ( c_md->author );
-       c_md->author = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( ud->c_md->author )
+         g_free ( ud->c_md->author );
+       ud->c_md->author = g_strdup ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_desc:
-       if ( c_md->description )
-         g_free ( c_md->description );
-       c_md->description = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( ud->c_md->description )
+         g_free ( ud->c_md->description );
+       ud->c_md->description = g_strdup ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_keywords:
-       if ( c_md->keywords )
-         g_free ( c_md->keywords );
-       c_md->keywords = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( ud->c_md->keywords )
+         g_free ( ud->c_md->keywords );
+       ud->c_md->keywords = g_strdup ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_time:
-       if ( c_md->timestamp )
-         g_free ( c_md->timestamp );
-       c_md->timestamp = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( ud->c_md->timestamp )
+         g_free ( ud->c_md->timestamp );
+       ud->c_md->timestamp = g_strdup ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_url:
-       if ( c_md->url )
-         g_free ( c_md->url );
-       if ( c_link ) {
-         c_md->url = g_strdup ( c_link );
-         c_link = NULL;
-       } else if ( c_cdata->len > 0 ) {
-         c_md->url = g_strdup ( c_cdata->str );
-         g_string_erase ( c_cdata, 0, -1 );
+       if ( ud->c_md->url )
+         g_free ( ud->c_md->url );
+       if ( ud->c_link ) {
+         ud->c_md->url = g_strdup ( ud->c_link );
+         ud->c_link = NULL;
+       } else if ( ud->c_cdata->len > 0 ) {
+         ud->c_md->url = g_strdup ( ud->c_cdata->str );
+         g_string_erase ( ud->c_cdata, 0, -1 );
        }
        break;
 
      case tt_gpx_url_name:
-       if ( c_md->url_name )
-         g_free ( c_md->url_name );
-       c_md->url_name = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( ud->c_md->url_name )
+         g_free ( ud->c_md->url_name );
+       ud->c_md->url_name = g_strdup ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_color:
-       c_have_color = global_set_color ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_have_color = global_set_color ( ud, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_waypoint:
      case tt_wpt:
-       if ( ! c_wp_name )
-         c_wp_name = g_strdup_printf("VIKING_WP%04d", unnamed_waypoints++);
-       vik_trw_layer_filein_add_waypoint ( vtl, c_wp_name, c_wp );
-       g_free ( c_wp_name );
-       c_wp = NULL;
-       c_wp_name = NULL;
+       if ( ! ud->c_wp_name )
+         ud->c_wp_name = g_strdup_printf("VIKING_WP%04d", ud->unnamed_waypoints++);
+       vik_trw_layer_filein_add_waypoint ( vtl, ud->c_wp_name, ud->c_wp );
+       g_free ( ud->c_wp_name );
+       ud->c_wp = NULL;
+       ud->c_wp_name = NULL;
        break;
 
      case tt_trk:
-       if ( ! c_tr_name )
-         c_tr_name = g_strdup_printf("VIKING_TR%03d", unnamed_tracks++);
+       if ( ! ud->c_tr_name )
+         ud->c_tr_name = g_strdup_printf("VIKING_TR%03d", ud->unnamed_tracks++);
        // Delibrate fall through
      case tt_rte:
-       if ( ! c_tr_name )
-         c_tr_name = g_strdup_printf("VIKING_RT%03d", unnamed_routes++);
-       c_tr->trackpoints = g_list_reverse ( c_tr->trackpoints );
-       vik_trw_layer_filein_add_track ( vtl, c_tr_name, c_tr );
-       g_free ( c_tr_name );
-       c_tr = NULL;
-       c_tr_name = NULL;
+       if ( ! ud->c_tr_name )
+         ud->c_tr_name = g_strdup_printf("VIKING_RT%03d", ud->unnamed_routes++);
+       ud->c_tr->trackpoints = g_list_reverse ( ud->c_tr->trackpoints );
+       if ( ud->tidy && !ud->c_tr->is_route )
+         if ( vik_track_remove_dodgy_first_point ( ud->c_tr, ud->tidy_speed, FALSE ) )
+           g_message ( "%s: Removed dodgy first point from track: %s", __FUNCTION__, ud->c_tr_name );
+       vik_trw_layer_filein_add_track ( vtl, ud->c_tr_name, ud->c_tr );
+       g_free ( ud->c_tr_name );
+       ud->c_tr = NULL;
+       ud->c_tr_name = NULL;
        break;
 
      case tt_wpt_name:
-       if ( c_wp_name )
-         g_free ( c_wp_name );
-       c_wp_name = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( ud->c_wp_name )
+         g_free ( ud->c_wp_name );
+       ud->c_wp_name = g_strdup ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_name:
-       if ( c_tr_name )
-         g_free ( c_tr_name );
-       c_tr_name = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( ud->c_tr_name )
+         g_free ( ud->c_tr_name );
+       ud->c_tr_name = g_strdup ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_ele:
-       c_wp->altitude = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->altitude = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_ele:
-       c_tp->altitude = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_tp->altitude = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_waypoint_name: /* .loc name is really description. */
      case tt_wpt_desc:
-       vik_waypoint_set_description ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_description ( ud->c_wp, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_cmt:
-       vik_waypoint_set_comment ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_comment ( ud->c_wp, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_src:
-       vik_waypoint_set_source ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_source ( ud->c_wp, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_type:
-       vik_waypoint_set_type ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_type ( ud->c_wp, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_url:
-       vik_waypoint_set_url ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_url ( ud->c_wp, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_url_name:
-       vik_waypoint_set_url_name ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_url_name ( ud->c_wp, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_link:
-       if ( c_link ) {
+       if ( ud->c_link ) {
          // Correct <link href="uri"></link> format
          // NB although Viking itself may write <type> information,
          //  ATM we don't use it and rely on the value of the URI to determine if URL vs Image
-         if ( util_is_url(c_link) ) {
-           vik_waypoint_set_url ( c_wp, c_link );
+         if ( util_is_url(ud->c_link) ) {
+           vik_waypoint_set_url ( ud->c_wp, ud->c_link );
          }
          else {
-           vu_waypoint_set_image_uri ( c_wp, c_link, ud->dirpath );
+           vu_waypoint_set_image_uri ( ud->c_wp, ud->c_link, ud->dirpath );
          }
        }
        else {
          // Fallback for incorrect GPX <link> format (probably from previous versions of Viking!)
          //  of the form <link>file</link>
-         gchar *fn = util_make_absolute_filename ( c_cdata->str, ud->dirpath );
-         vik_waypoint_set_image ( c_wp, fn ? fn : c_cdata->str );
+         gchar *fn = util_make_absolute_filename ( ud->c_cdata->str, ud->dirpath );
+         vik_waypoint_set_image ( ud->c_wp, fn ? fn : ud->c_cdata->str );
          g_free ( fn );
        }
-       c_link = NULL;
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_link = NULL;
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_sym:
-       vik_waypoint_set_symbol ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_symbol ( ud->c_wp, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_course:
-       c_wp->course = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->course = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_speed:
-       c_wp->speed = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->speed = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_magvar:
-       c_wp->magvar = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->magvar = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_geoidheight:
-       c_wp->geoidheight = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->geoidheight = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_fix:
-       if (!strcmp("2d", c_cdata->str))
-         c_wp->fix_mode = VIK_GPS_MODE_2D;
-       else if (!strcmp("3d", c_cdata->str))
-         c_wp->fix_mode = VIK_GPS_MODE_3D;
-       else if (!strcmp("dgps", c_cdata->str))
-         c_wp->fix_mode = VIK_GPS_MODE_DGPS;
-       else if (!strcmp("pps", c_cdata->str))
-         c_wp->fix_mode = VIK_GPS_MODE_PPS;
+       if (!strcmp("2d", ud->c_cdata->str))
+         ud->c_wp->fix_mode = VIK_GPS_MODE_2D;
+       else if (!strcmp("3d", ud->c_cdata->str))
+         ud->c_wp->fix_mode = VIK_GPS_MODE_3D;
+       else if (!strcmp("dgps", ud->c_cdata->str))
+         ud->c_wp->fix_mode = VIK_GPS_MODE_DGPS;
+       else if (!strcmp("pps", ud->c_cdata->str))
+         ud->c_wp->fix_mode = VIK_GPS_MODE_PPS;
        else
-         c_wp->fix_mode = VIK_GPS_MODE_NOT_SEEN;
-       g_string_erase ( c_cdata, 0, -1 );
+         ud->c_wp->fix_mode = VIK_GPS_MODE_NOT_SEEN;
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_sat:
-       c_wp->nsats = atoi ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->nsats = atoi ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_hdop:
-       c_wp->hdop = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->hdop = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_vdop:
-       c_wp->vdop = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->vdop = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_pdop:
-       c_wp->pdop = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->pdop = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_ageofdgpsdata:
-       c_wp->ageofdgpsdata = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->ageofdgpsdata = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_dgpsid:
-       c_wp->dgpsid = atoi ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->dgpsid = atoi ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_desc:
-       vik_track_set_description ( c_tr, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_track_set_description ( ud->c_tr, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_src:
-       vik_track_set_source ( c_tr, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_track_set_source ( ud->c_tr, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_number:
-       c_tr->number = atoi ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_tr->number = atoi ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_type:
-       vik_track_set_type ( c_tr, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_track_set_type ( ud->c_tr, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_url:
-       vik_track_set_url ( c_tr, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_track_set_url ( ud->c_tr, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_url_name:
-       vik_track_set_url_name ( c_tr, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_track_set_url_name ( ud->c_tr, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_link:
-       if ( c_link )
-         if ( util_is_url(c_link) )
-           vik_track_set_url ( c_tr, c_link );
-       c_link = NULL;
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( ud->c_link )
+         if ( util_is_url(ud->c_link) )
+           vik_track_set_url ( ud->c_tr, ud->c_link );
+       ud->c_link = NULL;
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_cmt:
-       vik_track_set_comment ( c_tr, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_track_set_comment ( ud->c_tr, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_time:
-       if ( g_time_val_from_iso8601(c_cdata->str, &wp_time) ) {
+       if ( g_time_val_from_iso8601(ud->c_cdata->str, &wp_time) ) {
 	 gdouble d1 = wp_time.tv_sec;
 	 gdouble d2 = (gdouble)wp_time.tv_usec/G_USEC_PER_SEC;
-         c_wp->timestamp = (d1 < 0) ? d1 - d2 : d1 + d2;
+         ud->c_wp->timestamp = (d1 < 0) ? d1 - d2 : d1 + d2;
        }
-       g_string_erase ( c_cdata, 0, -1 );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_name:
-       vik_trackpoint_set_name ( c_tp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_trackpoint_set_name ( ud->c_tp, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_time:
-       if ( g_time_val_from_iso8601(c_cdata->str, &tp_time) ) {
+       if ( g_time_val_from_iso8601(ud->c_cdata->str, &tp_time) ) {
 	 gdouble d1 = tp_time.tv_sec;
 	 gdouble d2 = (gdouble)tp_time.tv_usec/G_USEC_PER_SEC;
-         c_tp->timestamp = (d1 < 0) ? d1 - d2 : d1 + d2;
+         ud->c_tp->timestamp = (d1 < 0) ? d1 - d2 : d1 + d2;
        }
-       g_string_erase ( c_cdata, 0, -1 );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_course:
-       c_tp->course = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_tp->course = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_speed:
-       c_tp->speed = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_tp->speed = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_fix:
-       if (!strcmp("2d", c_cdata->str))
-         c_tp->fix_mode = VIK_GPS_MODE_2D;
-       else if (!strcmp("3d", c_cdata->str))
-         c_tp->fix_mode = VIK_GPS_MODE_3D;
-       else if (!strcmp("dgps", c_cdata->str))
-         c_tp->fix_mode = VIK_GPS_MODE_DGPS;
-       else if (!strcmp("pps", c_cdata->str))
-         c_tp->fix_mode = VIK_GPS_MODE_PPS;
+       if (!strcmp("2d", ud->c_cdata->str))
+         ud->c_tp->fix_mode = VIK_GPS_MODE_2D;
+       else if (!strcmp("3d", ud->c_cdata->str))
+         ud->c_tp->fix_mode = VIK_GPS_MODE_3D;
+       else if (!strcmp("dgps", ud->c_cdata->str))
+         ud->c_tp->fix_mode = VIK_GPS_MODE_DGPS;
+       else if (!strcmp("pps", ud->c_cdata->str))
+         ud->c_tp->fix_mode = VIK_GPS_MODE_PPS;
        else
-         c_tp->fix_mode = VIK_GPS_MODE_NOT_SEEN;
-       g_string_erase ( c_cdata, 0, -1 );
+         ud->c_tp->fix_mode = VIK_GPS_MODE_NOT_SEEN;
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_sat:
-       c_tp->nsats = atoi ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_tp->nsats = atoi ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_hdop:
-       c_tp->hdop = g_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_tp->hdop = g_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_vdop:
-       c_tp->vdop = g_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_tp->vdop = g_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_pdop:
-       c_tp->pdop = g_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_tp->pdop = g_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_an_extension:
      case tt_wpt_an_extension:
      case tt_trk_an_extension:
-       g_string_append_printf ( c_ext, "</%s>", el );
+       g_string_append_printf ( ud->c_ext, "</%s>", el );
        break;
      case tt_trk_trkseg_trkpt_an_extension:
-       g_string_append_printf ( c_trkpt_ext, "</%s>", el );
+       g_string_append_printf ( ud->c_trkpt_ext, "</%s>", el );
        break;
 
      case tt_trk_extensions:
-       if ( current_tag == tt_trk_extensions )
-         track_or_trackpoint_extension_process ( c_ext->str );
-       vik_track_set_extensions ( c_tr, c_ext->str );
-       g_string_erase ( c_ext, 0, -1 );
+       if ( ud->current_tag == tt_trk_extensions )
+         track_or_trackpoint_extension_process ( ud, ud->c_ext->str );
+       vik_track_set_extensions ( ud->c_tr, ud->c_ext->str );
+       g_string_erase ( ud->c_ext, 0, -1 );
        break;
 
      case tt_gpx_extensions:
-       vik_trw_layer_set_gpx_extensions ( vtl, c_ext->str );
-       g_string_erase ( c_ext, 0, -1 );
+       vik_trw_layer_set_gpx_extensions ( vtl, ud->c_ext->str );
+       g_string_erase ( ud->c_ext, 0, -1 );
        break;
 
      case tt_wpt_extensions:
-       vik_waypoint_set_extensions ( c_wp, c_ext->str );
-       g_string_erase ( c_ext, 0, -1 );
+       vik_waypoint_set_extensions ( ud->c_wp, ud->c_ext->str );
+       g_string_erase ( ud->c_ext, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_extensions:
-       vik_trackpoint_set_extensions ( c_tp, c_trkpt_ext->str );
-       track_or_trackpoint_extension_process ( c_trkpt_ext->str );
-       g_string_erase ( c_trkpt_ext, 0, -1 );
+       vik_trackpoint_set_extensions ( ud->c_tp, ud->c_trkpt_ext->str );
+       track_or_trackpoint_extension_process ( ud, ud->c_trkpt_ext->str );
+       g_string_erase ( ud->c_trkpt_ext, 0, -1 );
        break;
 
      default: break;
   }
 
-  current_tag = get_tag ( xpath->str );
-  if ( current_tag == tt_unknown )
-    current_tag = get_tag_extension ( xpath->str );
+  ud->current_tag = get_tag ( ud->xpath->str );
+  if ( ud->current_tag == tt_unknown )
+    ud->current_tag = get_tag_extension ( ud->xpath->str );
 }
 
 static void gpx_cdata(void *dta, const XML_Char *s, int len)
 {
-  switch ( current_tag ) {
+  UserDataT *ud = (UserDataT*)dta;
+  switch ( ud->current_tag ) {
     case tt_gpx_name:
     case tt_gpx_author:
     case tt_gpx_desc:
@@ -1314,18 +1339,18 @@ static void gpx_cdata(void *dta, const XML_Char *s, int len)
     case tt_trk_trkseg_trkpt_vdop:
     case tt_trk_trkseg_trkpt_pdop:
     case tt_waypoint_name: /* .loc name is really description. */
-      g_string_append_len ( c_cdata, s, len );
+      g_string_append_len ( ud->c_cdata, s, len );
       break;
 
     case tt_trk_trkseg_trkpt_an_extension:
     case tt_trk_trkseg_trkpt_extensions:
-      g_string_append_len ( c_trkpt_ext, s, len );
+      g_string_append_len ( ud->c_trkpt_ext, s, len );
       break;
     case tt_trk_extensions:
     case tt_gpx_extensions:
     // No longer store the <extensions> tag itself for waypoints
     //case tt_wpt_extensions:
-      g_string_append_len ( c_ext, s, len );
+      g_string_append_len ( ud->c_ext, s, len );
       break;
     case tt_trk_an_extension:
     case tt_wpt_an_extension:
@@ -1335,7 +1360,7 @@ static void gpx_cdata(void *dta, const XML_Char *s, int len)
       gchar *txt = g_memdup ( s, len+1 );
       txt[len] = '\0';
       gchar *tmp = a_gpx_entitize ( txt );
-      g_string_append ( c_ext, tmp );
+      g_string_append ( ud->c_ext, tmp );
       g_free ( txt );
       g_free ( tmp );
     }
@@ -1345,6 +1370,9 @@ static void gpx_cdata(void *dta, const XML_Char *s, int len)
   }
 }
 
+// Expat parses directly from its own buffer of this size
+#define GPX_READ_CHUNK_SIZE (1024*1024)
+
 // make like a "stack" of tag names
 // like gpspoint's separated like /gpx/wpt/whatever
 // @append: Whether the read is to append to the vtl (or otherwise a new layer)
@@ -1353,14 +1381,34 @@ static void gpx_cdata(void *dta, const XML_Char *s, int len)
 //  The #GpxReadStatus_t of how successful the read attempt is
 //
 GpxReadStatus_t a_gpx_read_file( VikTrwLayer *vtl, FILE *f, const gchar* dirpath, gboolean append ) {
+  return a_gpx_read_file_progress ( vtl, f, dirpath, append, NULL, NULL );
+}
+
+/**
+ * a_gpx_read_file_progress:
+ * @progress_func: Optional function called after each chunk of the file has been parsed
+ * @user_data:     Passed to @progress_func
+ *
+ * As a_gpx_read_file(), but allowing the read to report how far it has got and to be stopped.
+ * Since items may be taken from the layer by @progress_func,
+ *  GPX tidying is then applied to each track as it is read.
+ *
+ * Returns: The #GpxReadStatus_t of how successful the read attempt is
+ */
+GpxReadStatus_t a_gpx_read_file_progress ( VikTrwLayer *vtl, FILE *f, const gchar* dirpath, gboolean append, VikFileReadProgressFunc progress_func, gpointer user_data )
+{
   XML_Parser parser = XML_ParserCreate(NULL);
   int done=0, len;
   enum XML_Status status = XML_STATUS_ERROR;
 
-  UserDataT *ud = g_malloc (sizeof(UserDataT));
+  UserDataT *ud = g_malloc0 (sizeof(UserDataT));
   ud->vtl     = vtl;
   ud->dirpath = dirpath;
   ud->append  = append;
+  ud->current_tag = tt_unknown;
+  ud->progress_func = progress_func;
+  if ( progress_func )
+    ud->tidy = track_tidy_settings ( &ud->tidy_speed );
 
   XML_SetElementHandler(parser, (XML_StartElementHandler) gpx_start, (XML_EndElementHandler) gpx_end);
   XML_SetUserData(parser, ud);
@@ -1370,66 +1418,86 @@ GpxReadStatus_t a_gpx_read_file( VikTrwLayer *vtl, FILE *f, const gchar* dirpath
   //  seems to work better on xml fragments compared to expat,
   //  and also we can reuse a single parser,
   //  rather than having to create an expat parser each time on each <extension> tag group
+  // NB one per read, as the context refers back to this read's state
+  GMarkupParser gparser;
   gparser.start_element = &ext_start_element;
   gparser.end_element = &ext_end_element;
   gparser.text = &ext_text;
   gparser.passthrough = NULL;
   gparser.error = NULL;
-  gcontext = g_markup_parse_context_new ( &gparser, 0, NULL, NULL );
-
-  gchar buf[4096];
+  ud->gcontext = g_markup_parse_context_new ( &gparser, 0, ud, NULL );
 
   g_assert ( f != NULL && vtl != NULL );
 
-  xpath = g_string_new ( "" );
-  c_cdata = g_string_new ( "" );
-  c_ext = g_string_new ( NULL );
-  c_trkpt_ext = g_string_new ( NULL );
-  gs_ext = g_string_new ( NULL );
+  ud->xpath = g_string_new ( "" );
+  ud->c_cdata = g_string_new ( "" );
+  ud->c_ext = g_string_new ( NULL );
+  ud->c_trkpt_ext = g_string_new ( NULL );
+  ud->gs_ext = g_string_new ( NULL );
 
-  unnamed_waypoints = 1;
-  unnamed_tracks = 1;
-  unnamed_routes = 1;
+  ud->unnamed_waypoints = 1;
+  ud->unnamed_tracks = 1;
+  ud->unnamed_routes = 1;
 
+  gint64 bytes_read = 0;
+  gboolean cancelled = FALSE;
   while (!done) {
-    len = fread(buf, 1, sizeof(buf)-7, f);
+    // Read straight into expat's buffer to avoid copying
+    void *buf = XML_GetBuffer ( parser, GPX_READ_CHUNK_SIZE );
+    if ( !buf ) {
+      status = XML_STATUS_ERROR;
+      break;
+    }
+    len = fread(buf, 1, GPX_READ_CHUNK_SIZE, f);
     done = feof(f) || !len;
-    status = XML_Parse(parser, buf, len, done);
+    status = XML_ParseBuffer(parser, len, done);
+    if ( status == XML_STATUS_ERROR )
+      break;
+    bytes_read += len;
+    if ( progress_func && !done && !progress_func(user_data, bytes_read) ) {
+      cancelled = TRUE;
+      break;
+    }
   }
 
   GpxReadStatus_t result;
-  gboolean ans = (status != XML_STATUS_ERROR);
+  gboolean ans = (status != XML_STATUS_ERROR) && !cancelled;
   if ( !ans ) {
-    g_warning ( "%s: XML error %s at line %ld with tag %s", __FUNCTION__, XML_ErrorString(XML_GetErrorCode(parser)), XML_GetCurrentLineNumber(parser), get_tag_name(current_tag)  );
+    if ( cancelled )
+      g_debug ( "%s: Stopped at %" G_GINT64_FORMAT " bytes", __FUNCTION__, bytes_read );
+    else
+      g_warning ( "%s: XML error %s at line %ld with tag %s", __FUNCTION__, XML_ErrorString(XML_GetErrorCode(parser)), XML_GetCurrentLineNumber(parser), get_tag_name(ud->current_tag)  );
     gboolean have_closed_tag = FALSE;
     // Possibly should try to close the latest tag - e.g. for various trackpoint elements
     //  but generally missing out only the last partial trackpoint isn't too bad
     //  vs at least having some kind of track at all
-    if ( current_tag >= tt_trk && current_tag <= tt_trk_trkseg_trkpt_an_extension ) {
+    if ( ud->current_tag >= tt_trk && ud->current_tag <= tt_trk_trkseg_trkpt_an_extension ) {
       g_debug ( "%s: Force closure of track", __FUNCTION__ );
-      current_tag = tt_trk;
+      ud->current_tag = tt_trk;
       gpx_end ( ud, "" );
       have_closed_tag = TRUE;
-    } else if ( current_tag >= tt_wpt && current_tag <= tt_wpt_an_extension ) {
+    } else if ( ud->current_tag >= tt_wpt && ud->current_tag <= tt_wpt_an_extension ) {
       g_debug ( "%s: Force closure of waypoint", __FUNCTION__ );
-      current_tag = tt_wpt;
+      ud->current_tag = tt_wpt;
       gpx_end ( ud, "" );
       have_closed_tag = TRUE;
     }
-    if ( have_closed_tag ) {
-      current_tag = tt_gpx;
+    if ( have_closed_tag || (cancelled && ud->c_md) ) {
+      ud->current_tag = tt_gpx;
       gpx_end ( ud, "" );
       result = GPX_READ_WARNING;
     } else {
       // Give up - maybe a corrupt header or other problem
       result = GPX_READ_FAILURE;
     }
+    if ( cancelled )
+      result = GPX_READ_CANCELLED;
   }
   else {
     result = GPX_READ_SUCCESS;
     // First pass was OK, so attempt secondary parse
     // Re-parse raw extension text into a more understandable structure for gpxdata laps
-    GQueue *laps = g_queue_new();
+    ud->laps = g_queue_new();
     GMarkupParser gparserLap;
     GMarkupParseContext *gcontextLap;
     gparserLap.start_element = &lap_start_element;
@@ -1437,7 +1505,7 @@ GpxReadStatus_t a_gpx_read_file( VikTrwLayer *vtl, FILE *f, const gchar* dirpath
     gparserLap.text = &ext_text;
     gparserLap.passthrough = NULL;
     gparserLap.error = NULL;
-    gcontextLap = g_markup_parse_context_new ( &gparserLap, 0, laps, NULL );
+    gcontextLap = g_markup_parse_context_new ( &gparserLap, 0, ud, NULL );
     gchar* vtlExtensions = vik_trw_layer_get_gpx_extensions ( vtl );
     if ( vtlExtensions ) {
       GError *error = NULL;
@@ -1447,19 +1515,24 @@ GpxReadStatus_t a_gpx_read_file( VikTrwLayer *vtl, FILE *f, const gchar* dirpath
       if ( !g_markup_parse_context_end_parse ( gcontextLap, &error) )
         g_warning ( "%s: error %s occurred on end of:%s", __FUNCTION__, error ? error->message : "???", vtlExtensions );
 
-      if ( !g_queue_is_empty(laps) )
-        vik_trw_layer_set_laps ( vtl, laps );
+      if ( !g_queue_is_empty(ud->laps) ) {
+        vik_trw_layer_set_laps ( vtl, ud->laps );
+        ud->laps = NULL;
+      }
     }
+    g_markup_parse_context_free ( gcontextLap );
+    if ( ud->laps )
+      g_queue_free_full ( ud->laps, g_free );
   }
 
   XML_ParserFree (parser);
+  g_string_free ( ud->xpath, TRUE );
+  g_string_free ( ud->c_cdata, TRUE );
+  g_string_free ( ud->c_ext, TRUE );
+  g_string_free ( ud->c_trkpt_ext, TRUE );
+  g_string_free ( ud->gs_ext, TRUE );
+  g_markup_parse_context_free ( ud->gcontext );
   g_free ( ud );
-  g_string_free ( xpath, TRUE );
-  g_string_free ( c_cdata, TRUE );
-  g_string_free ( c_ext, TRUE );
-  g_string_free ( c_trkpt_ext, TRUE );
-  g_string_free ( gs_ext, TRUE );
-  g_markup_parse_context_free ( gcontext );
 
   return result;
 }
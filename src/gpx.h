@@ -53,9 +53,24 @@ typedef enum {
   GPX_READ_SUCCESS,
   GPX_READ_WARNING, // Partial read - may be some geodata is available
   GPX_READ_FAILURE, // Total failure - no geodata available
+  GPX_READ_CANCELLED, // Stopped on request - what was read so far is available
 } GpxReadStatus_t;
 
+/**
+ * VikFileReadProgressFunc:
+ * @user_data: As given to the read function
+ * @bytes_read: Position reached within the file
+ *
+ * Called between chunks of a file being read.
+ * Any items already in the layer are complete (the one part way through being read is not yet added),
+ *  so they may be taken out of the layer at this point.
+ *
+ * Returns: FALSE to stop reading
+ */
+typedef gboolean (*VikFileReadProgressFunc) ( gpointer user_data, gint64 bytes_read );
+
 GpxReadStatus_t a_gpx_read_file ( VikTrwLayer *trw, FILE *f, const gchar* dirpath, gboolean append );
+GpxReadStatus_t a_gpx_read_file_progress ( VikTrwLayer *trw, FILE *f, const gchar* dirpath, gboolean append, VikFileReadProgressFunc progress_func, gpointer user_data );
 void a_gpx_write_file ( VikTrwLayer *trw, FILE *f, GpxWritingOptions *options, const gchar *dirpath );
 void a_gpx_write_track_file ( VikTrwLayer *trw, VikTrack *trk, FILE *f, GpxWritingOptions *options );
 void a_gpx_write_waypoints_file ( VikTrwLayer *vtl, FILE *f, GpxWritingOptions *options );
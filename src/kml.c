@@ -74,12 +74,11 @@ typedef struct {
 	gboolean layer_has_been_named;
 	gboolean layer_has_description;
 	XML_Parser parser;
+	guint unnamed_waypoints;
+	guint unnamed_tracks;
+	guint unnamed_routes;
 } xml_data;
 
-static guint unnamed_waypoints = 0;
-static guint unnamed_tracks = 0;
-static guint unnamed_routes = 0;
-
 // Various helper functions
 
 static void track_set_color ( VikTrack *trk, gchar *color )
@@ -265,7 +264,7 @@ static void point_end ( xml_data *xd, const char *el )
 				vik_waypoint_set_name ( xd->waypoint, xd->name );
 			} else {
 				xd->waypoint->hide_name = TRUE;
-				gchar *name = g_strdup_printf ( "WP%04d", unnamed_waypoints++ );
+				gchar *name = g_strdup_printf ( "WP%04d", xd->unnamed_waypoints++ );
 				vik_waypoint_set_name ( xd->waypoint, name );
 				g_free ( name );
 			}
@@ -367,7 +366,7 @@ static void add_track ( xml_data *xd )
 		if ( xd->name && strlen(xd->name) > 0 ) {
 			vik_track_set_name ( xd->track, xd->name );
 		} else {
-			gchar *name = g_strdup_printf ( "TRK%04d", unnamed_tracks++ );
+			gchar *name = g_strdup_printf ( "TRK%04d", xd->unnamed_tracks++ );
 			vik_track_set_name ( xd->track, name );
 			g_free ( name );
 		}
@@ -497,7 +496,7 @@ static void track_end ( xml_data *xd, const char *el )
 				g_free ( xd->name );
 				xd->name = NULL;
 			} else {
-				gchar *name = g_strdup_printf ( "TRK%04d", unnamed_tracks++ );
+				gchar *name = g_strdup_printf ( "TRK%04d", xd->unnamed_tracks++ );
 				vik_track_set_name ( xd->track, name );
 				g_free ( name );
 			}
@@ -926,15 +925,32 @@ static void kml_cdata ( xml_data *xd, const XML_Char *ss, int len )
  */
 gboolean a_kml_read_file ( VikTrwLayer *vtl, FILE *ff, gboolean external )
 {
-	gchar buffer[4096];
+	return a_kml_read_file_progress ( vtl, ff, external, NULL, NULL, NULL );
+}
+
+// Expat parses directly from its own buffer of this size
+#define KML_READ_CHUNK_SIZE (1024*1024)
+
+/**
+ * a_kml_read_file_progress:
+ * @progress_func: Optional function called after each chunk of the file has been parsed
+ * @user_data:     Passed to @progress_func
+ * @cancelled:     Optional, set to whether @progress_func stopped the read
+ *
+ * As a_kml_read_file(), but allowing the read to report how far it has got and to be stopped.
+ *
+ * Returns:
+ *  TRUE on success (including when stopped, as whatever was read so far is available)
+ */
+gboolean a_kml_read_file_progress ( VikTrwLayer *vtl, FILE *ff, gboolean external, VikFileReadProgressFunc progress_func, gpointer user_data, gboolean *cancelled )
+{
 	XML_Parser parser = XML_ParserCreate(NULL);
 	enum XML_Status status = XML_STATUS_ERROR;
 
-	unnamed_waypoints = 1;
-	unnamed_tracks = 1;
-	unnamed_routes = 1;
-
 	xml_data *xd = g_malloc0 ( sizeof (xml_data) );
+	xd->unnamed_waypoints = 1;
+	xd->unnamed_tracks = 1;
+	xd->unnamed_routes = 1;
 	// Set default allocations / settings:
 	xd->c_cdata = g_string_new ( "" );
 	xd->vtl = vtl;
@@ -959,11 +975,28 @@ gboolean a_kml_read_file ( VikTrwLayer *vtl, FILE *ff, gboolean external )
 	XML_SetCharacterDataHandler ( parser, (XML_CharacterDataHandler)kml_cdata);
 
 	int done=0, len;
+	gint64 bytes_read = 0;
+	gboolean stopped = FALSE;
 	while ( !done ) {
-		len = fread ( buffer, 1, sizeof(buffer)-7, ff );
+		// Read straight into expat's buffer to avoid copying
+		void *buffer = XML_GetBuffer ( parser, KML_READ_CHUNK_SIZE );
+		if ( !buffer ) {
+			status = XML_STATUS_ERROR;
+			break;
+		}
+		len = fread ( buffer, 1, KML_READ_CHUNK_SIZE, ff );
 		done = feof ( ff ) || !len;
-		status = XML_Parse ( parser, buffer, len, done );
+		status = XML_ParseBuffer ( parser, len, done );
+		if ( status != XML_STATUS_OK )
+			break;
+		bytes_read += len;
+		if ( progress_func && !done && !progress_func(user_data, bytes_read) ) {
+			stopped = TRUE;
+			break;
+		}
 	}
+	if ( cancelled )
+		*cancelled = stopped;
 
 	gboolean ans = (status != XML_STATUS_ERROR);
 	if ( !ans ) {
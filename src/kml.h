@@ -22,10 +22,12 @@
 #define _VIKING_KML_H
 
 #include "viktrwlayer.h"
+#include "gpx.h"
 
 G_BEGIN_DECLS
 
 gboolean a_kml_read_file ( VikTrwLayer *vtl, FILE *ff, gboolean external );
+gboolean a_kml_read_file_progress ( VikTrwLayer *vtl, FILE *ff, gboolean external, VikFileReadProgressFunc progress_func, gpointer user_data, gboolean *cancelled );
 
 G_END_DECLS
 
@@ -31,6 +31,7 @@
 #include "dems.h"
 #include "babel.h"
 #include "curl_download.h"
+#include "tilestore.h"
 #include "logging.h"
 #include "vikdemlayer.h"
 #include "vikmapslayer.h"
@@ -277,9 +278,26 @@ int main( int argc, char *argv[] )
       vik_window_open_file ( first_window, a_vik_get_startup_file(), TRUE, TRUE, TRUE, TRUE, FALSE );
   }
 
+  // Many GPX files are read concurrently in the background, rather than one after another below
+  GSList *gpx_files = NULL;
+  for ( int jj = 1; jj < argc; jj++ )
+    if ( a_file_check_ext(argv[jj], ".gpx") )
+      gpx_files = g_slist_append ( gpx_files, g_strdup(argv[jj]) );
+  gpx_files = vik_window_open_gpx_files ( first_window, gpx_files, external );
+  // Any returned list means the files were not taken
+  gboolean gpx_concurrent = (gpx_files == NULL);
+  g_slist_free_full ( gpx_files, g_free );
+
+  int last_file = argc - 1;
+  if ( gpx_concurrent )
+    while ( last_file > 0 && a_file_check_ext(argv[last_file], ".gpx") )
+      last_file--;
+
   while ( ++i < argc ) {
     if ( strcmp(argv[i],"--") == 0 && !dashdash_already )
       dashdash_already = TRUE; /* hack to open '-' */
+    else if ( gpx_concurrent && a_file_check_ext(argv[i], ".gpx") )
+      continue;
     else {
       VikWindow *newvw = first_window;
       gboolean change_filename = (i == 1);
@@ -293,7 +311,7 @@ int main( int argc, char *argv[] )
       // Check if the file parameter is a 'geo:' URI
       //  if so then then don't try to load this parameter as a file
       if ( !check_for_geo_uri(argv[i]) )
-        vik_window_open_file ( newvw, argv[i], change_filename, (i==1), (i+1 == argc), TRUE, external );
+        vik_window_open_file ( newvw, argv[i], change_filename, (i==1), (i == last_file), TRUE, external );
     }
   }
 
@@ -310,6 +328,10 @@ int main( int argc, char *argv[] )
   a_babel_uninit ();
   a_toolbar_uninit ();
   a_background_uninit ();
+  // Stop any downloads and complete their file writes before the map layers and caches they update go
+  curl_download_uninit();
+  a_download_uninit();
+  a_tilestore_uninit();
   maps_layer_uninit ();
   vik_dem_layer_uninit ();
   a_mapcache_uninit ();
@@ -321,9 +343,6 @@ int main( int argc, char *argv[] )
 
   modules_uninit();
 
-  curl_download_uninit();
-  a_download_uninit();
-
   vu_finalize_lat_lon_tz_lookup ();
 
   vik_icons_unregister_resource ();
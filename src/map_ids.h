@@ -31,6 +31,9 @@
 
 #define MAP_ID_MAPNIK_RENDER 7
 
+// Tiles generated by the aggregate layer's heatmap
+#define MAP_ID_HEATMAP 8
+
 // Mostly OSM related - except the Blue Marble value
 #define MAP_ID_OSM_MAPNIK 13
 #define MAP_ID_BLUE_MARBLE 15
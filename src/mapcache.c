@@ -30,33 +30,48 @@
 #include "preferences.h"
 #include "vik_compat.h"
 
-#define MC_KEY_SIZE 64
-
-typedef struct _List {
-  struct _List *next;
-  gchar *key;
-} List;
-
-/* a circular linked list, a pointer to the tail, and the tail points to the head */
-/* this is so we can free the last */
-static List *queue_tail = NULL;
-static int queue_count = 0;
+/*
+ * The cache is split into a number of shards, each with its own lock, hash table and LRU list.
+ * All the variants of a tile (alpha & shrink factors) hash to the same shard,
+ *  so removing those only needs to look in one shard.
+ * Any function here may be called from any background thread.
+ */
+#define MC_SHARDS 16
 
-static guint32 cache_size = 0;
-static guint32 max_cache_size = VIK_CONFIG_MAPCACHE_SIZE * 1024 * 1024;
+// Not sure what this 100 represents anyway - probably a guess at an average pixbuf metadata size
+#define MC_ITEM_OVERHEAD 100
 
-static GHashTable *cache = NULL;
+typedef struct {
+  gint x;
+  gint y;
+  gint z;
+  gint zoom;
+  guint name_hash;
+  gint xshrink; // Shrink factors stored in thousandths, i.e. the precision previously used in the string keys
+  gint yshrink;
+  guint16 type;
+  guint8 alpha;
+} mc_key_t;
 
 typedef struct {
+  mc_key_t key;
   GdkPixbuf *pixbuf;
   mapcache_extra_t extra;
+  guint size;
+  GList link; // Position in the LRU queue; most recently used is the head
 } cache_item_t;
 
-static GMutex *mc_mutex = NULL;
+typedef struct {
+  GMutex *mutex;
+  GHashTable *items; // mc_key_t* -> cache_item_t*
+  GQueue lru;
+  guint64 size;
+  GHashTable *type_sizes; // map type -> bytes used in this shard
+} mc_shard_t;
+
+static mc_shard_t shards[MC_SHARDS];
 
-#define HASHKEY_FORMAT_STRING "%d-%d-%d-%d-%d-%d-%d-%.3f-%.3f"
-#define HASHKEY_FORMAT_STRING_NOSHRINK_NOR_ALPHA "%d-%d-%d-%d-%d-%d-"
-#define HASHKEY_FORMAT_STRING_TYPE "%d-"
+static guint max_cache_size = VIK_CONFIG_MAPCACHE_SIZE * 1024 * 1024;
 
 static VikLayerParamScale params_scales[] = {
   /* min, max, step, digits (decimal places) */
@@ -69,97 +84,153 @@ static VikLayerParam prefs[] = {
   { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_NAMESPACE "mapcache_size", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Map cache memory size (MB):"), VIK_LAYER_WIDGET_HSCALE, params_scales, NULL, NULL, mcs_default, NULL, NULL },
 };
 
-static void cache_item_free (cache_item_t *ci)
+static inline guint mix ( guint h, guint v )
+{
+  h ^= v + 0x9e3779b9 + (h << 6) + (h >> 2);
+  return h;
+}
+
+/**
+ * Hash of the tile identity only (i.e. excluding alpha and shrink factors)
+ */
+static guint key_tile_hash ( const mc_key_t *key )
+{
+  guint h = key->type;
+  h = mix ( h, (guint)key->x );
+  h = mix ( h, (guint)key->y );
+  h = mix ( h, (guint)key->z );
+  h = mix ( h, (guint)key->zoom );
+  h = mix ( h, key->name_hash );
+  return h;
+}
+
+static guint key_hash ( gconstpointer ptr )
+{
+  const mc_key_t *key = ptr;
+  guint h = key_tile_hash ( key );
+  h = mix ( h, key->alpha );
+  h = mix ( h, (guint)key->xshrink );
+  h = mix ( h, (guint)key->yshrink );
+  return h;
+}
+
+static gboolean key_same_tile ( const mc_key_t *k1, const mc_key_t *k2 )
+{
+  return k1->x == k2->x && k1->y == k2->y && k1->z == k2->z &&
+         k1->zoom == k2->zoom && k1->type == k2->type && k1->name_hash == k2->name_hash;
+}
+
+static gboolean key_equal ( gconstpointer a, gconstpointer b )
+{
+  const mc_key_t *k1 = a;
+  const mc_key_t *k2 = b;
+  return key_same_tile ( k1, k2 ) &&
+         k1->alpha == k2->alpha && k1->xshrink == k2->xshrink && k1->yshrink == k2->yshrink;
+}
+
+static inline void key_set ( mc_key_t *key, gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar *name )
+{
+  key->x = x;
+  key->y = y;
+  key->z = z;
+  key->zoom = zoom;
+  key->name_hash = name ? g_str_hash ( name ) : 0;
+  key->xshrink = (gint)(xshrinkfactor * 1000.0 + 0.5);
+  key->yshrink = (gint)(yshrinkfactor * 1000.0 + 0.5);
+  key->type = type;
+  key->alpha = alpha;
+}
+
+static inline mc_shard_t *shard_for_key ( const mc_key_t *key )
+{
+  return &shards[key_tile_hash(key) % MC_SHARDS];
+}
+
+static void cache_item_free ( cache_item_t *ci )
 {
   if ( ci->pixbuf )
     g_object_unref ( ci->pixbuf );
   g_free ( ci );
 }
 
-void a_mapcache_init ()
+static guint pixbuf_size ( GdkPixbuf *pixbuf )
 {
-  a_preferences_register ( prefs, (VikLayerParamData){0}, VIKING_PREFERENCES_GROUP_KEY );
-
-  mc_mutex = vik_mutex_new ();
-  cache = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify) cache_item_free );
+  guint size = MC_ITEM_OVERHEAD;
+  // ATM size of 'extra' data hardly worth trying to count (compared to pixbuf sizes)
+  if ( pixbuf )
+    size += gdk_pixbuf_get_rowstride(pixbuf) * gdk_pixbuf_get_height(pixbuf);
+  return size;
 }
 
-// Returns whether added or not (i.e. if key already exists - as per g_hash_table_insert() )
-static gboolean cache_add(gchar *key, GdkPixbuf *pixbuf, mapcache_extra_t extra)
+/**
+ * Adjust the sizes held by the shard (which must be locked)
+ */
+static void shard_account ( mc_shard_t *shard, guint16 type, gint64 delta )
 {
-  cache_item_t *ci = g_malloc ( sizeof(cache_item_t) );
-  ci->pixbuf = pixbuf;
-  ci->extra = extra;
-  gboolean added = g_hash_table_insert ( cache, key, ci );
-  if ( added )
-  {
-    // ATM size of 'extra' data hardly worth trying to count (compared to pixbuf sizes)
-    if ( pixbuf ) {
-      cache_size += gdk_pixbuf_get_rowstride(pixbuf) * gdk_pixbuf_get_height(pixbuf);
-      // Not sure what this 100 represents anyway - probably a guess at an average pixbuf metadata size
-      cache_size += 100;
-    }
-  }
-  return added;
+  shard->size += delta;
+  gpointer key = GUINT_TO_POINTER((guint)type);
+  gsize tsize = GPOINTER_TO_SIZE(g_hash_table_lookup(shard->type_sizes, key));
+  tsize += delta;
+  if ( tsize )
+    g_hash_table_insert ( shard->type_sizes, key, GSIZE_TO_POINTER(tsize) );
+  else
+    g_hash_table_remove ( shard->type_sizes, key );
 }
 
-static void cache_remove(const gchar *key)
+/**
+ * Remove the item from the shard (which must be locked)
+ */
+static void shard_remove ( mc_shard_t *shard, cache_item_t *ci )
 {
-  cache_item_t *ci = g_hash_table_lookup ( cache, key );
-  if (ci && ci->pixbuf) {
-    cache_size -= gdk_pixbuf_get_rowstride(ci->pixbuf) * gdk_pixbuf_get_height(ci->pixbuf);
-    cache_size -= 100;
-    g_hash_table_remove ( cache, key );
-  }
+  g_queue_unlink ( &shard->lru, &ci->link );
+  shard_account ( shard, ci->key.type, -(gint64)ci->size );
+  // Frees the item
+  g_hash_table_remove ( shard->items, &ci->key );
 }
 
-#ifdef MAPCACHE_DEBUG
-static void print_queue()
+/**
+ * Mark the item as the most recently used (shard must be locked)
+ */
+static inline void shard_promote ( mc_shard_t *shard, cache_item_t *ci )
 {
-  List *loop = queue_tail;
-  guint count = 0;
-  while ( loop ) {
-    g_printf ( "%s: [%d]=%s\n", __FUNCTION__, count, loop->key );
-    loop = loop->next;
-    count++;
-    if ( loop == queue_tail )
-      loop = NULL;
+  if ( shard->lru.head != &ci->link ) {
+    g_queue_unlink ( &shard->lru, &ci->link );
+    g_queue_push_head_link ( &shard->lru, &ci->link );
   }
 }
-#endif
 
-/* returns key from head, adds on newtailkey to tail. */
-static gchar *list_shift_add_entry ( gchar *newtailkey )
+/**
+ * Drop least recently used items until the shard is within its share of the total allowance
+ *  (but always keeping the most recent item)
+ */
+static void shard_evict ( mc_shard_t *shard, guint64 limit )
 {
-  gchar *oldheadkey = queue_tail->next->key;
-  queue_tail->next->key = newtailkey;
-  queue_tail = queue_tail->next;
-  return oldheadkey;
+  while ( shard->size > limit && shard->lru.length > 1 ) {
+    cache_item_t *ci = shard->lru.tail->data;
+    shard_remove ( shard, ci );
+  }
 }
 
-static gchar *list_shift ()
+static void shard_clear ( mc_shard_t *shard )
 {
-  gchar *oldheadkey = queue_tail->next->key;
-  List *oldhead = queue_tail->next;
-  queue_tail->next = queue_tail->next->next;
-  g_free ( oldhead );
-  queue_count--;
-  return oldheadkey;
+  g_hash_table_remove_all ( shard->items );
+  // Links were embedded within the items, so now simply reset the queue
+  g_queue_init ( &shard->lru );
+  g_hash_table_remove_all ( shard->type_sizes );
+  shard->size = 0;
 }
 
-/* adds key to tail */
-static void list_add_entry ( gchar *key )
+void a_mapcache_init ()
 {
-  List *newlist = g_malloc ( sizeof ( List ) );
-  newlist->key = key;
-  if ( queue_tail ) {
-    newlist->next = queue_tail->next;
-    queue_tail->next = newlist;
-  } else {
-    newlist->next = newlist;
+  a_preferences_register ( prefs, (VikLayerParamData){0}, VIKING_PREFERENCES_GROUP_KEY );
+
+  for ( guint ii = 0; ii < MC_SHARDS; ii++ ) {
+    shards[ii].mutex = vik_mutex_new ();
+    shards[ii].items = g_hash_table_new_full ( key_hash, key_equal, NULL, (GDestroyNotify) cache_item_free );
+    g_queue_init ( &shards[ii].lru );
+    shards[ii].size = 0;
+    shards[ii].type_sizes = g_hash_table_new ( g_direct_hash, g_direct_equal );
   }
-  queue_tail = newlist;
-  queue_count++;
 }
 
 /**
@@ -168,6 +239,8 @@ static void list_add_entry ( gchar *key )
  * @pixbuf: The image to add.
  *    This maybe NULL (especially when adding just #mapcache_extra_t information -
  *     such as the download request result - before the tile is read from disk)
+ *
+ * If the item already exists it is replaced and becomes the most recently used.
  */
 void a_mapcache_add ( GdkPixbuf *pixbuf, mapcache_extra_t extra, gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name )
 {
@@ -176,131 +249,89 @@ void a_mapcache_add ( GdkPixbuf *pixbuf, mapcache_extra_t extra, gint x, gint y,
       g_debug ( "Not caching corrupt pixbuf for maptype %d at %d %d %d %d", type, x, y, z, zoom );
       return;
     }
+    g_object_ref ( pixbuf );
   }
 
-  guint nn = name ? g_str_hash ( name ) : 0;
-  gchar *key = g_strdup_printf ( HASHKEY_FORMAT_STRING, type, x, y, z, zoom, nn, alpha, xshrinkfactor, yshrinkfactor );
+  // TODO: that should be done on preference change only...
+  max_cache_size = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "mapcache_size")->u * 1024 * 1024;
 
-  g_mutex_lock(mc_mutex);
+  mc_key_t key;
+  key_set ( &key, x, y, z, type, zoom, alpha, xshrinkfactor, yshrinkfactor, name );
+  mc_shard_t *shard = shard_for_key ( &key );
+  guint size = pixbuf_size ( pixbuf );
 
-  if ( pixbuf )
-    g_object_ref(pixbuf);
-  gboolean added = cache_add(key, pixbuf, extra);
-
-  // Do not add already existing keys into list
-  //  and more importantly in this circumstance 'key' should not be reused
-  //  (since it has been freed by g_hash_table_insert() defined destructors) and so no longer valid
-  if ( added ) {
-
-    // TODO: that should be done on preference change only...
-    max_cache_size = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "mapcache_size")->u * 1024 * 1024;
-
-    if ( cache_size > max_cache_size ) {
-      if ( queue_tail ) {
-        gchar *oldkey = list_shift_add_entry ( key );
-        cache_remove(oldkey);
-
-        while ( cache_size > max_cache_size &&
-                (queue_tail->next != queue_tail) ) { // make sure there's more than one thing to delete
-          oldkey = list_shift ();
-          cache_remove(oldkey);
-        }
-      }
-      // chop off 'start' etc
-    } else {
-      list_add_entry ( key );
-      // business as usual
-    }
+  g_mutex_lock ( shard->mutex );
+
+  cache_item_t *ci = g_hash_table_lookup ( shard->items, &key );
+  if ( ci ) {
+    if ( ci->pixbuf )
+      g_object_unref ( ci->pixbuf );
+    shard_account ( shard, type, (gint64)size - (gint64)ci->size );
+    shard_promote ( shard, ci );
   }
-  g_mutex_unlock(mc_mutex);
+  else {
+    ci = g_malloc0 ( sizeof(cache_item_t) );
+    ci->key = key;
+    ci->link.data = ci;
+    g_hash_table_insert ( shard->items, &ci->key, ci );
+    g_queue_push_head_link ( &shard->lru, &ci->link );
+    shard_account ( shard, type, size );
+  }
+  ci->pixbuf = pixbuf;
+  ci->extra = extra;
+  ci->size = size;
 
-  static int tmp = 0;
-  if ( (++tmp == 100 )) { g_debug("DEBUG: cache count=%d size=%u list count=%d", g_hash_table_size(cache), cache_size, queue_count ); tmp=0; }
+  shard_evict ( shard, max_cache_size / MC_SHARDS );
+
+  g_mutex_unlock ( shard->mutex );
+
+  static gint tmp = 0;
+  if ( g_atomic_int_add(&tmp, 1) % 100 == 99 )
+    g_debug ( "DEBUG: cache count=%d size=%u", a_mapcache_get_count(), a_mapcache_get_size() );
 }
 
 /**
  * Function increases reference counter of pixels buffer in behalf of caller.
  * Caller have to decrease references counter, when buffer is no longer needed.
  * Returns a #GdkPixbuf which may be NULL.
+ *
+ * A hit makes the item the most recently used.
  */
 GdkPixbuf *a_mapcache_get ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name )
 {
-  static char key[MC_KEY_SIZE];
-  guint nn = name ? g_str_hash ( name ) : 0;
-  g_snprintf ( key, sizeof(key), HASHKEY_FORMAT_STRING, type, x, y, z, zoom, nn, alpha, xshrinkfactor, yshrinkfactor );
-  g_mutex_lock(mc_mutex); /* prevent returning pixbuf when cache is being cleared */
-  cache_item_t *ci = g_hash_table_lookup ( cache, key );
+  mc_key_t key;
+  key_set ( &key, x, y, z, type, zoom, alpha, xshrinkfactor, yshrinkfactor, name );
+  mc_shard_t *shard = shard_for_key ( &key );
+  GdkPixbuf *pixbuf = NULL;
+
+  g_mutex_lock ( shard->mutex ); /* prevent returning pixbuf when cache is being cleared */
+  cache_item_t *ci = g_hash_table_lookup ( shard->items, &key );
   if ( ci ) {
-    if ( ci->pixbuf )
-      g_object_ref(ci->pixbuf);
-    g_mutex_unlock(mc_mutex);
-    return ci->pixbuf;
-  } else {
-    g_mutex_unlock(mc_mutex);
-    return NULL;
+    if ( ci->pixbuf ) {
+      pixbuf = g_object_ref ( ci->pixbuf );
+      shard_promote ( shard, ci );
+    }
   }
-}
-
-mapcache_extra_t a_mapcache_get_extra ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name )
-{
-  static char key[MC_KEY_SIZE];
-  guint nn = name ? g_str_hash ( name ) : 0;
-  g_snprintf ( key, sizeof(key), HASHKEY_FORMAT_STRING, type, x, y, z, zoom, nn, alpha, xshrinkfactor, yshrinkfactor );
-  cache_item_t *ci = g_hash_table_lookup ( cache, key );
-  if ( ci )
-    return ci->extra;
-  else
-    return (mapcache_extra_t) { 0.0, MAPCACHE_STATUS_NOT_IN_CACHE };
+  g_mutex_unlock ( shard->mutex );
+  return pixbuf;
 }
 
 /**
- * Common function to remove cache items for keys starting with the specified string
+ * Just a lookup - does not affect the order of eviction.
  */
-static void flush_matching ( gchar *str )
+mapcache_extra_t a_mapcache_get_extra ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name )
 {
-  g_mutex_lock(mc_mutex);
-
-  if ( queue_tail == NULL ) {
-    g_mutex_unlock(mc_mutex);
-    return;
-  }
+  mc_key_t key;
+  key_set ( &key, x, y, z, type, zoom, alpha, xshrinkfactor, yshrinkfactor, name );
+  mc_shard_t *shard = shard_for_key ( &key );
+  mapcache_extra_t extra = { 0.0, MAPCACHE_STATUS_NOT_IN_CACHE };
 
-#ifdef MAPCACHE_DEBUG
-  print_queue();
-#endif
-
-  // The 'loop' variable must be assigned within the mutex lock section,
-  //  otherwise where it points to might not be valid anymore when the actual processing occurs
-  List *loop = queue_tail;
-  List *tmp;
-  size_t len = strlen(str);
-
-  do {
-    tmp = loop->next;
-    if ( tmp ) {
-    if ( strncmp(tmp->key, str, len) == 0 )
-    {
-      cache_remove(tmp->key);
-      if ( tmp == loop ) /* we deleted the last thing in the queue! */
-        loop = queue_tail = NULL;
-      else {
-        loop->next = tmp->next;
-        if ( tmp == queue_tail )
-          queue_tail = tmp->next;
-      }
-      g_free ( tmp );
-      tmp = NULL;
-      queue_count--;
-    }
-    else
-      loop = tmp;
-    } else
-      loop = NULL;
-  } while ( loop && (loop != queue_tail || tmp == NULL) );
-  /* loop thru list, looking for the one, compare first whatever chars */
-
-  cache_remove(str);
-  g_mutex_unlock(mc_mutex);
+  g_mutex_lock ( shard->mutex );
+  cache_item_t *ci = g_hash_table_lookup ( shard->items, &key );
+  if ( ci )
+    extra = ci->extra;
+  g_mutex_unlock ( shard->mutex );
+  return extra;
 }
 
 /**
@@ -308,32 +339,29 @@ static void flush_matching ( gchar *str )
  */
 void a_mapcache_remove_all_shrinkfactors ( gint x, gint y, gint z, guint16 type, gint zoom, const gchar* name )
 {
-  char key[MC_KEY_SIZE];
-  guint nn = name ? g_str_hash ( name ) : 0;
-  g_snprintf ( key, sizeof(key), HASHKEY_FORMAT_STRING_NOSHRINK_NOR_ALPHA, type, x, y, z, zoom, nn );
-  flush_matching ( key );
+  mc_key_t key;
+  key_set ( &key, x, y, z, type, zoom, 0, 0.0, 0.0, name );
+  mc_shard_t *shard = shard_for_key ( &key );
+
+  g_mutex_lock ( shard->mutex );
+  GList *iter = shard->lru.head;
+  while ( iter ) {
+    GList *next = iter->next;
+    cache_item_t *ci = iter->data;
+    if ( key_same_tile(&ci->key, &key) )
+      shard_remove ( shard, ci );
+    iter = next;
+  }
+  g_mutex_unlock ( shard->mutex );
 }
 
 void a_mapcache_flush ()
 {
-  // Everything happens within the mutex lock section
-  g_mutex_lock(mc_mutex);
-
-  List *loop = queue_tail;
-  List *tmp;
-
-  while ( loop ) {
-    tmp = loop->next;
-    cache_remove(tmp->key);
-    if ( tmp == queue_tail ) /* we deleted the last thing in the queue */
-      loop = queue_tail = NULL;
-    else
-      loop->next = tmp->next;
-    g_free ( tmp );
-    tmp = NULL;
+  for ( guint ii = 0; ii < MC_SHARDS; ii++ ) {
+    g_mutex_lock ( shards[ii].mutex );
+    shard_clear ( &shards[ii] );
+    g_mutex_unlock ( shards[ii].mutex );
   }
-
-  g_mutex_unlock(mc_mutex);
 }
 
 /**
@@ -345,27 +373,80 @@ void a_mapcache_flush ()
  */
 void a_mapcache_flush_type ( guint16 type )
 {
-  char key[MC_KEY_SIZE];
-  g_snprintf ( key, sizeof(key), HASHKEY_FORMAT_STRING_TYPE, type );
-  flush_matching ( key );
+  for ( guint ii = 0; ii < MC_SHARDS; ii++ ) {
+    mc_shard_t *shard = &shards[ii];
+    g_mutex_lock ( shard->mutex );
+    // Quick check to avoid walking shards without any of this type
+    if ( g_hash_table_contains(shard->type_sizes, GUINT_TO_POINTER((guint)type)) ) {
+      GList *iter = shard->lru.head;
+      while ( iter ) {
+        GList *next = iter->next;
+        cache_item_t *ci = iter->data;
+        if ( ci->key.type == type )
+          shard_remove ( shard, ci );
+        iter = next;
+      }
+    }
+    g_mutex_unlock ( shard->mutex );
+  }
 }
 
 void a_mapcache_uninit ()
 {
-  g_hash_table_destroy ( cache );
-  /* free list */
-  cache = NULL;
-  vik_mutex_free (mc_mutex);
+  for ( guint ii = 0; ii < MC_SHARDS; ii++ ) {
+    shard_clear ( &shards[ii] );
+    g_hash_table_destroy ( shards[ii].items );
+    shards[ii].items = NULL;
+    g_hash_table_destroy ( shards[ii].type_sizes );
+    shards[ii].type_sizes = NULL;
+    vik_mutex_free ( shards[ii].mutex );
+    shards[ii].mutex = NULL;
+  }
 }
 
 // Size of mapcache in memory
 guint a_mapcache_get_size ()
 {
-  return cache_size;
+  guint64 size = 0;
+  for ( guint ii = 0; ii < MC_SHARDS; ii++ ) {
+    g_mutex_lock ( shards[ii].mutex );
+    size += shards[ii].size;
+    g_mutex_unlock ( shards[ii].mutex );
+  }
+  return (guint)size;
 }
 
 // Count of items in the mapcache
 guint a_mapcache_get_count ()
 {
-  return g_hash_table_size ( cache );
+  guint count = 0;
+  for ( guint ii = 0; ii < MC_SHARDS; ii++ ) {
+    g_mutex_lock ( shards[ii].mutex );
+    count += g_hash_table_size ( shards[ii].items );
+    g_mutex_unlock ( shards[ii].mutex );
+  }
+  return count;
+}
+
+/**
+ * a_mapcache_get_type_sizes:
+ *
+ * Returns: A new table of the memory used by each map type
+ *  (GUINT_TO_POINTER(type) -> GSIZE_TO_POINTER(bytes)), to be freed with g_hash_table_destroy()
+ */
+GHashTable *a_mapcache_get_type_sizes ()
+{
+  GHashTable *sizes = g_hash_table_new ( g_direct_hash, g_direct_equal );
+  for ( guint ii = 0; ii < MC_SHARDS; ii++ ) {
+    g_mutex_lock ( shards[ii].mutex );
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init ( &iter, shards[ii].type_sizes );
+    while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+      gsize size = GPOINTER_TO_SIZE(g_hash_table_lookup(sizes, key)) + GPOINTER_TO_SIZE(value);
+      g_hash_table_insert ( sizes, key, GSIZE_TO_POINTER(size) );
+    }
+    g_mutex_unlock ( shards[ii].mutex );
+  }
+  return sizes;
 }
@@ -47,6 +47,7 @@ void a_mapcache_uninit ();
 
 guint a_mapcache_get_size ();
 guint a_mapcache_get_count ();
+GHashTable *a_mapcache_get_type_sizes ();
 
 G_END_DECLS
 
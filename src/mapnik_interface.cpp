@@ -230,12 +230,28 @@ static void destroy_fn ( guchar *pixels, gpointer data )
  * Returns a #GdkPixbuf of the specified area. #GdkPixbuf may be NULL
  */
 GdkPixbuf* mapnik_interface_render ( MapnikInterface* mi, double lat_tl, double lon_tl, double lat_br, double lon_br )
+{
+	if ( !mi ) return NULL;
+	return mapnik_interface_render_size ( mi, lat_tl, lon_tl, lat_br, lon_br, mi->myMap->width(), mi->myMap->height() );
+}
+
+/**
+ * mapnik_interface_render_size:
+ *
+ * As mapnik_interface_render() but into an image of the given size,
+ *  e.g. for rendering a block of several tiles in one go
+ *
+ * Returns a #GdkPixbuf of the specified area. #GdkPixbuf may be NULL
+ */
+GdkPixbuf* mapnik_interface_render_size ( MapnikInterface* mi, double lat_tl, double lon_tl, double lat_br, double lon_br, guint width, guint height )
 {
 	if ( !mi ) return NULL;
 
 	// Copy main object to local map variable
 	//  This enables rendering to work when this function is called from different threads
 	mapnik::Map myMap(*mi->myMap);
+	if ( width != myMap.width() || height != myMap.height() )
+		myMap.resize(width,height);
 
 	// Note prj & bbox want stuff in lon,lat order!
 	double p0x = lon_tl;
@@ -249,8 +265,6 @@ GdkPixbuf* mapnik_interface_render ( MapnikInterface* mi, double lat_tl, double
 
 	GdkPixbuf *pixbuf = NULL;
 	try {
-		unsigned width  = myMap.width();
-		unsigned height = myMap.height();
 		mapnik::image_32 image(width,height);
 		mapnik::box2d<double> bbox(p0x, p0y, p1x, p1y);
 		myMap.zoom_to_box(bbox);
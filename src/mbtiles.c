@@ -0,0 +1,395 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, Viking Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include "sqlite3.h"
+#include "mbtiles.h"
+#include "settings.h"
+#include "vik_compat.h"
+
+#define VIK_SETTINGS_MBTILES_MMAP_SIZE "mbtiles_mmap_size"
+// In bytes - SQLite will use less if the file is smaller
+static gint MMAP_SIZE = 256 * 1024 * 1024;
+
+#define SQL_TILE "SELECT tile_data FROM tiles WHERE zoom_level=?1 AND tile_column=?2 AND tile_row=?3;"
+#define SQL_AREA "SELECT tile_column, tile_row, tile_data FROM tiles WHERE zoom_level=?1 AND tile_column BETWEEN ?2 AND ?3 AND tile_row BETWEEN ?4 AND ?5;"
+
+typedef struct {
+  sqlite3 *sql;
+  sqlite3_stmt *tile_stmt;
+  sqlite3_stmt *area_stmt;
+} MBTilesConn;
+
+struct _MBTiles {
+  gint ref_count;
+  gchar *filename;
+  GMutex *mutex;
+  GQueue idle; // MBTilesConn* not currently used by any thread
+};
+
+static void conn_free ( MBTilesConn *conn )
+{
+  (void)sqlite3_finalize ( conn->tile_stmt );
+  (void)sqlite3_finalize ( conn->area_stmt );
+  int ans = sqlite3_close ( conn->sql );
+  if ( ans != SQLITE_OK )
+    // Only to console for information purposes only
+    g_warning ( "%s: SQL Close problem: %s", __FUNCTION__, sqlite3_errstr(ans) );
+  g_free ( conn );
+}
+
+static MBTilesConn *conn_new ( const gchar *filename )
+{
+  MBTilesConn *conn = g_malloc0 ( sizeof(MBTilesConn) );
+  // Each connection is only ever used by one thread at a time, so SQLite's own locking isn't needed
+  int ans = sqlite3_open_v2 ( filename, &conn->sql, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL );
+  if ( ans != SQLITE_OK ) {
+    // That didn't work, so here's why:
+    g_warning ( "%s: %s", __FUNCTION__, sqlite3_errmsg(conn->sql) );
+    conn_free ( conn );
+    return NULL;
+  }
+
+  gchar *pragmas = g_strdup_printf ( "PRAGMA query_only=1; PRAGMA mmap_size=%d;", MMAP_SIZE );
+  (void)sqlite3_exec ( conn->sql, pragmas, NULL, NULL, NULL );
+  g_free ( pragmas );
+
+  ans = sqlite3_prepare_v2 ( conn->sql, SQL_TILE, -1, &conn->tile_stmt, NULL );
+  if ( ans == SQLITE_OK )
+    ans = sqlite3_prepare_v2 ( conn->sql, SQL_AREA, -1, &conn->area_stmt, NULL );
+  if ( ans != SQLITE_OK ) {
+    g_warning ( "%s: %s - %s", __FUNCTION__, "prepare failure", sqlite3_errmsg(conn->sql) );
+    conn_free ( conn );
+    return NULL;
+  }
+  return conn;
+}
+
+/**
+ * Get a connection for use by the current thread
+ */
+static MBTilesConn *conn_acquire ( MBTiles *mbt )
+{
+  g_mutex_lock ( mbt->mutex );
+  MBTilesConn *conn = g_queue_pop_head ( &mbt->idle );
+  g_mutex_unlock ( mbt->mutex );
+  if ( !conn )
+    conn = conn_new ( mbt->filename );
+  return conn;
+}
+
+static void conn_release ( MBTiles *mbt, MBTilesConn *conn )
+{
+  (void)sqlite3_reset ( conn->tile_stmt );
+  (void)sqlite3_reset ( conn->area_stmt );
+  g_mutex_lock ( mbt->mutex );
+  g_queue_push_head ( &mbt->idle, conn );
+  g_mutex_unlock ( mbt->mutex );
+}
+
+static gboolean check_is_mbtiles_file ( sqlite3 *sql )
+{
+  sqlite3_stmt *sql_stmt = NULL;
+  // Stackoverflow suggests something like this should work:
+  // int ans = sqlite3_prepare_v2 ( sql, "SELECT count(*) FROM sqlite_master WHERE type='table' AND name='tiles' COLLATE NOCASE;", -1, &sql_stmt, NULL );
+  // But it doesn't
+
+  // This seems more reliable instead
+  int ans = sqlite3_prepare_v2 ( sql, "SELECT count(*) FROM tiles;", -1, &sql_stmt, NULL );
+  (void)sqlite3_finalize ( sql_stmt );
+  // NB we don't care if any 'metadata' table exists or not
+
+  if ( ans != SQLITE_OK ) {
+    g_warning ( "%s: %s[%d]: %s - %s", __FUNCTION__, "failure", ans, sqlite3_errstr(ans), "no 'tiles' table found" );
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static gboolean metadata_value ( sqlite3 *sql, const gchar *name, gchar **value )
+{
+  gboolean result = FALSE;
+  sqlite3_stmt *sql_stmt = NULL;
+  int ans = sqlite3_prepare_v2 ( sql, "SELECT value FROM metadata WHERE name=?1;", -1, &sql_stmt, NULL );
+  if ( ans == SQLITE_OK ) {
+    (void)sqlite3_bind_text ( sql_stmt, 1, name, -1, SQLITE_STATIC );
+    ans = sqlite3_step ( sql_stmt );
+    switch (ans) {
+    case SQLITE_ROW: // Only care about 1st row
+    case SQLITE_DONE: {
+      int count = sqlite3_column_count ( sql_stmt );
+      if ( count == 1 )  {
+        int ctype = sqlite3_column_type ( sql_stmt, 0 );
+        if ( ctype == SQLITE_TEXT ) {
+          result = TRUE;
+          *value = g_strdup ( (gchar*)sqlite3_column_text ( sql_stmt, 0 ) );
+        }
+      }
+      break;
+    }
+    default:
+      // e.g. SQLITE_ERROR | SQLITE_MISUSE | etc...
+      g_warning ( "%s: %s - %s", __FUNCTION__, "step issue", sqlite3_errstr(ans) );
+    }
+  }
+  (void)sqlite3_finalize ( sql_stmt );
+  return result;
+}
+
+static gboolean check_mbtiles_file_for_supported_format ( sqlite3 *sql )
+{
+  gchar *format = NULL;
+  gboolean result = metadata_value ( sql, "format", &format );
+  if ( result ) {
+    g_debug ( "%s: format found is: %s", __FUNCTION__, format );
+    if ( !g_strcmp0 ( format, "pbf" ) )
+      result = FALSE;
+    g_free ( format );
+  }
+  else
+    // No metadata format information found
+    // So assume contents are compatible
+    result = TRUE;
+
+  return result;
+}
+
+/**
+ * mbtiles_open:
+ * @filename: The MBTiles file
+ * @result:   Details of any failure
+ *
+ * Returns: A new handle, or NULL if the file can not be used.
+ *  Release with mbtiles_unref()
+ */
+MBTiles *mbtiles_open ( const gchar *filename, MBTilesOpenResult *result )
+{
+  static gsize settings_read = 0;
+  if ( g_once_init_enter(&settings_read) ) {
+    gint gitmp = 0;
+    if ( a_settings_get_integer ( VIK_SETTINGS_MBTILES_MMAP_SIZE, &gitmp ) )
+      MMAP_SIZE = gitmp;
+    g_once_init_leave ( &settings_read, 1 );
+  }
+
+  sqlite3 *sql = NULL;
+  int ans = sqlite3_open_v2 ( filename, &sql, SQLITE_OPEN_READONLY, NULL );
+  if ( ans != SQLITE_OK ) {
+    g_warning ( "%s: %s", __FUNCTION__, sqlite3_errmsg(sql) );
+    (void)sqlite3_close ( sql );
+    *result = MBTILES_OPEN_FAILED;
+    return NULL;
+  }
+  if ( !check_is_mbtiles_file(sql) ) {
+    (void)sqlite3_close ( sql );
+    *result = MBTILES_OPEN_NOT_MBTILES;
+    return NULL;
+  }
+  if ( !check_mbtiles_file_for_supported_format(sql) ) {
+    (void)sqlite3_close ( sql );
+    *result = MBTILES_OPEN_UNSUPPORTED_FORMAT;
+    return NULL;
+  }
+  (void)sqlite3_close ( sql );
+
+  // Now known to be valid, create the first connection for the pool
+  MBTilesConn *conn = conn_new ( filename );
+  if ( !conn ) {
+    *result = MBTILES_OPEN_FAILED;
+    return NULL;
+  }
+
+  MBTiles *mbt = g_malloc0 ( sizeof(MBTiles) );
+  mbt->ref_count = 1;
+  mbt->filename = g_strdup ( filename );
+  mbt->mutex = vik_mutex_new ();
+  g_queue_init ( &mbt->idle );
+  g_queue_push_head ( &mbt->idle, conn );
+
+  *result = MBTILES_OPEN_OK;
+  return mbt;
+}
+
+MBTiles *mbtiles_ref ( MBTiles *mbt )
+{
+  g_atomic_int_inc ( &mbt->ref_count );
+  return mbt;
+}
+
+/**
+ * Closes all connections once the last reference is removed
+ */
+void mbtiles_unref ( MBTiles *mbt )
+{
+  if ( !mbt )
+    return;
+  if ( !g_atomic_int_dec_and_test(&mbt->ref_count) )
+    return;
+
+  // As no other references remain, all connections must be idle
+  MBTilesConn *conn;
+  while ( (conn = g_queue_pop_head(&mbt->idle)) )
+    conn_free ( conn );
+  vik_mutex_free ( mbt->mutex );
+  g_free ( mbt->filename );
+  g_free ( mbt );
+}
+
+/**
+ * mbtiles_get_metadata_value:
+ *
+ * Returns: TRUE if metadata value is present
+ *  and then @value is allocated
+ */
+gboolean mbtiles_get_metadata_value ( MBTiles *mbt, const gchar *name, gchar **value )
+{
+  MBTilesConn *conn = conn_acquire ( mbt );
+  if ( !conn )
+    return FALSE;
+  gboolean result = metadata_value ( conn->sql, name, value );
+  conn_release ( mbt, conn );
+  return result;
+}
+
+/**
+ * Decode directly from the blob memory held by SQLite
+ *  (only valid until the statement is next stepped or reset)
+ */
+static GdkPixbuf *blob_to_pixbuf ( sqlite3_stmt *sql_stmt, int col )
+{
+  const void *data = sqlite3_column_blob ( sql_stmt, col );
+  int bytes = sqlite3_column_bytes ( sql_stmt, col );
+  if ( bytes < 1 ) {
+    g_warning ( "%s: %s (%d)", __FUNCTION__, "not enough bytes", bytes );
+    return NULL;
+  }
+
+  GdkPixbuf *pixbuf = NULL;
+  GError *error = NULL;
+  GdkPixbufLoader *loader = gdk_pixbuf_loader_new ();
+  if ( gdk_pixbuf_loader_write ( loader, data, bytes, &error ) &&
+       gdk_pixbuf_loader_close ( loader, &error ) ) {
+    pixbuf = gdk_pixbuf_loader_get_pixbuf ( loader );
+    if ( pixbuf )
+      g_object_ref ( pixbuf );
+  }
+  else
+    (void)gdk_pixbuf_loader_close ( loader, NULL );
+
+  if ( error ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+  }
+  g_object_unref ( loader );
+  return pixbuf;
+}
+
+// MBTiles stored internally with the flipping y thingy (i.e. TMS scheme).
+static inline gint flip_y ( gint y, gint zoom )
+{
+  return (1 << zoom) - 1 - y;
+}
+
+/**
+ * mbtiles_get_pixbuf:
+ *
+ * Returns: The tile image (or NULL if not available)
+ *  which the caller should unref.
+ */
+GdkPixbuf *mbtiles_get_pixbuf ( MBTiles *mbt, gint x, gint y, gint zoom )
+{
+  if ( !mbt )
+    return NULL;
+  MBTilesConn *conn = conn_acquire ( mbt );
+  if ( !conn )
+    return NULL;
+
+  GdkPixbuf *pixbuf = NULL;
+  sqlite3_stmt *sql_stmt = conn->tile_stmt;
+  (void)sqlite3_bind_int ( sql_stmt, 1, zoom );
+  (void)sqlite3_bind_int ( sql_stmt, 2, x );
+  (void)sqlite3_bind_int ( sql_stmt, 3, flip_y(y, zoom) );
+
+  int ans = sqlite3_step ( sql_stmt );
+  if ( ans == SQLITE_ROW )
+    pixbuf = blob_to_pixbuf ( sql_stmt, 0 );
+  else if ( ans != SQLITE_DONE )
+    g_warning ( "%s: %s - %s", __FUNCTION__, "step issue", sqlite3_errstr(ans) );
+
+  conn_release ( mbt, conn );
+  return pixbuf;
+}
+
+/**
+ * mbtiles_get_pixbufs:
+ * @zoom: The zoom level
+ * @xmin, @xmax, @ymin, @ymax: The inclusive area of tiles (in the XYZ scheme)
+ * @func: Function called for each tile found
+ *
+ * Get all available tiles in an area using a single query.
+ *
+ * Returns: The number of tiles found
+ */
+guint mbtiles_get_pixbufs ( MBTiles *mbt, gint zoom, gint xmin, gint xmax, gint ymin, gint ymax, MBTilesPixbufFunc func, gpointer user_data )
+{
+  if ( !mbt )
+    return 0;
+  MBTilesConn *conn = conn_acquire ( mbt );
+  if ( !conn )
+    return 0;
+
+  guint count = 0;
+  sqlite3_stmt *sql_stmt = conn->area_stmt;
+  (void)sqlite3_bind_int ( sql_stmt, 1, zoom );
+  (void)sqlite3_bind_int ( sql_stmt, 2, xmin );
+  (void)sqlite3_bind_int ( sql_stmt, 3, xmax );
+  // NB flipping swaps the min & max
+  (void)sqlite3_bind_int ( sql_stmt, 4, flip_y(ymax, zoom) );
+  (void)sqlite3_bind_int ( sql_stmt, 5, flip_y(ymin, zoom) );
+
+  gboolean finished = FALSE;
+  while ( !finished ) {
+    int ans = sqlite3_step ( sql_stmt );
+    if ( ans == SQLITE_ROW ) {
+      gint x = sqlite3_column_int ( sql_stmt, 0 );
+      gint y = flip_y ( sqlite3_column_int(sql_stmt, 1), zoom );
+      GdkPixbuf *pixbuf = blob_to_pixbuf ( sql_stmt, 2 );
+      if ( pixbuf ) {
+        count++;
+        if ( !func ( x, y, pixbuf, user_data ) )
+          finished = TRUE;
+      }
+    }
+    else {
+      // Finished normally
+      //  and give up on any errors
+      if ( ans != SQLITE_DONE )
+        g_warning ( "%s: %s - %s", __FUNCTION__, "step issue", sqlite3_errstr(ans) );
+      finished = TRUE;
+    }
+  }
+
+  conn_release ( mbt, conn );
+  return count;
+}
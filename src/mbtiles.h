@@ -0,0 +1,60 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, Viking Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef __VIKING_MBTILES_H
+#define __VIKING_MBTILES_H
+
+#include <glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Read only access to MBTiles files.
+ * A handle may be used from any thread - each thread uses its own connection
+ *  (with its own prepared statements) taken from a pool held by the handle.
+ */
+typedef struct _MBTiles MBTiles;
+
+typedef enum {
+  MBTILES_OPEN_OK = 0,
+  MBTILES_OPEN_FAILED,             // Unable to open the file
+  MBTILES_OPEN_NOT_MBTILES,        // No 'tiles' table
+  MBTILES_OPEN_UNSUPPORTED_FORMAT, // e.g. vector tiles
+} MBTilesOpenResult;
+
+/**
+ * Called for each tile found in an area, the function takes ownership of the pixbuf.
+ * Return FALSE to stop processing any further tiles.
+ */
+typedef gboolean (*MBTilesPixbufFunc) ( gint x, gint y, GdkPixbuf *pixbuf, gpointer user_data );
+
+MBTiles *mbtiles_open ( const gchar *filename, MBTilesOpenResult *result );
+MBTiles *mbtiles_ref ( MBTiles *mbt );
+void mbtiles_unref ( MBTiles *mbt );
+
+gboolean mbtiles_get_metadata_value ( MBTiles *mbt, const gchar *name, gchar **value );
+
+GdkPixbuf *mbtiles_get_pixbuf ( MBTiles *mbt, gint x, gint y, gint zoom );
+guint mbtiles_get_pixbufs ( MBTiles *mbt, gint zoom, gint xmin, gint xmax, gint ymin, gint ymax, MBTilesPixbufFunc func, gpointer user_data );
+
+G_END_DECLS
+
+#endif
@@ -34,6 +34,10 @@
 #include <fcntl.h>
 
 #include "metatile.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
 /**
  * metatile.h
  */
@@ -54,10 +58,6 @@ struct meta_layout {
     // The index offsets are measured from the start of the file
 };
 
-// Use this to enable meta-tiles which will render NxN tiles at once
-// Note: This should be a power of 2 (2, 4, 8, 16 ...)
-#define METATILE (8)
-
 /**
  * xyz_to_meta:
  * Based on function from mod_tile/src/store_file_utils.c
@@ -191,3 +191,74 @@ int metatile_read(const char *dir, int x, int y, int z, char *buf, size_t sz, in
     close(fd);
     return pos;
 }
+
+/**
+ * metatile_write:
+ * Based on the metatile writing in mod_tile/src/metatile.cpp
+ *
+ * Writes the tiles of the meta-tile containing x,y
+ *  (the directory for the file must already exist)
+ *
+ * @bufs:  METATILE*METATILE tile images in meta-tile offset order
+ *         (as returned by xyz_to_meta()), any may be NULL
+ * @sizes: The size of each tile image
+ *
+ * Returns 0 on success, otherwise negative with an error message in log_msg
+ */
+int metatile_write(const char *dir, int x, int y, int z, char **bufs, size_t *sizes, char * log_msg)
+{
+    char path[PATH_MAX];
+    char tmp[PATH_MAX];
+    unsigned int header_len = sizeof(struct meta_layout) + METATILE*METATILE*sizeof(struct entry);
+    struct meta_layout *meta = (struct meta_layout *)calloc(1, header_len);
+    int mask = METATILE - 1;
+    int ii, fd, offset;
+
+    (void)xyz_to_meta(path, sizeof(path), dir, x, y, z);
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+
+    memcpy(meta->magic, META_MAGIC, strlen(META_MAGIC));
+    meta->count = METATILE * METATILE;
+    meta->x = x & ~mask;
+    meta->y = y & ~mask;
+    meta->z = z;
+
+    offset = header_len;
+    for (ii = 0; ii < METATILE * METATILE; ii++) {
+        meta->index[ii].offset = offset;
+        meta->index[ii].size = bufs[ii] ? sizes[ii] : 0;
+        offset += meta->index[ii].size;
+    }
+
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666);
+    if (fd < 0) {
+        snprintf(log_msg, PATH_MAX - 1, "Could not create metatile %s. Reason: %s\n", tmp, strerror(errno));
+        free(meta);
+        return -1;
+    }
+
+    int ok = (write(fd, meta, header_len) == (int)header_len);
+    for (ii = 0; ok && ii < METATILE * METATILE; ii++) {
+        if (meta->index[ii].size)
+            ok = (write(fd, bufs[ii], meta->index[ii].size) == meta->index[ii].size);
+    }
+    free(meta);
+
+    if (close(fd) != 0 || !ok) {
+        snprintf(log_msg, PATH_MAX - 1, "Failed to write metatile %s. Reason: %s\n", tmp, strerror(errno));
+        unlink(tmp);
+        return -2;
+    }
+
+    // Replace any existing file in one go, so readers never see a partial one
+    //  (Windows' rename() won't replace an existing file)
+    if (rename(tmp, path) != 0) {
+        unlink(path);
+        if (rename(tmp, path) != 0) {
+            snprintf(log_msg, PATH_MAX - 1, "Failed to rename metatile %s. Reason: %s\n", path, strerror(errno));
+            unlink(tmp);
+            return -3;
+        }
+    }
+    return 0;
+}
@@ -228,6 +228,56 @@ unsigned char* heatmap_render_saturated_to(const heatmap_t* h, const heatmap_col
     return colorbuf;
 }
 
+void heatmap_tile_init(heatmap_tile_t* t, heatmap_t* h, unsigned x0, unsigned y0, unsigned x1, unsigned y1)
+{
+    t->hm = h;
+    t->x0 = x0;
+    t->y0 = y0;
+    t->x1 = x1 < h->w ? x1 : h->w;
+    t->y1 = y1 < h->h ? y1 : h->h;
+    t->max = 0.0f;
+    heatmap_tile_update_max(t);
+}
+
+void heatmap_tile_add_weighted_point_with_stamp(heatmap_tile_t* t, int x, int y, float w, const heatmap_stamp_t* stamp)
+{
+    /* Signed arithmetic here, since the point may well be outside of the tile. */
+    const int sx = x - (int)(stamp->w/2);
+    const int sy = y - (int)(stamp->h/2);
+
+    /* These are [first, last) pairs in the HEATMAP's pixels. */
+    const int x0 = sx > (int)t->x0 ? sx : (int)t->x0;
+    const int y0 = sy > (int)t->y0 ? sy : (int)t->y0;
+    const int x1 = sx + (int)stamp->w < (int)t->x1 ? sx + (int)stamp->w : (int)t->x1;
+    const int y1 = sy + (int)stamp->h < (int)t->y1 ? sy + (int)stamp->h : (int)t->y1;
+
+    int iy;
+
+    for(iy = y0 ; iy < y1 ; ++iy) {
+        float* line = t->hm->buf + iy*t->hm->w + x0;
+        const float* stampline = stamp->buf + (iy - sy)*stamp->w + (x0 - sx);
+
+        int ix;
+        for(ix = x0 ; ix < x1 ; ++ix, ++line, ++stampline) {
+            *line += *stampline * w;
+            if(*line > t->max) {t->max = *line;}
+        }
+    }
+}
+
+void heatmap_tile_update_max(heatmap_tile_t* t)
+{
+    unsigned y;
+    t->max = 0.0f;
+    for(y = t->y0 ; y < t->y1 ; ++y) {
+        const float* line = t->hm->buf + y*t->hm->w;
+        unsigned x;
+        for(x = t->x0 ; x < t->x1 ; ++x) {
+            if(line[x] > t->max) {t->max = line[x];}
+        }
+    }
+}
+
 void heatmap_stamp_init(heatmap_stamp_t* stamp, unsigned w, unsigned h, float* data)
 {
     if(stamp) {
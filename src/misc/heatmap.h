@@ -118,6 +118,30 @@ unsigned char* heatmap_render_to(const heatmap_t* h, const heatmap_colorscheme_t
  */
 unsigned char* heatmap_render_saturated_to(const heatmap_t* h, const heatmap_colorscheme_t* colorscheme, float saturation, unsigned char* colorbuf);
 
+/* A rectangular part of a heatmap.
+ * The tiles of a heatmap can be filled and rendered concurrently by separate
+ * threads, as long as each tile is only used by one thread at a time.
+ */
+typedef struct {
+    heatmap_t* hm;         /* The heatmap this is part of. */
+    unsigned x0, y0;       /* The first pixel of the heatmap in this tile. */
+    unsigned x1, y1;       /* One past the last pixel of the heatmap in this tile. */
+    float max;             /* The highest heat within this tile. */
+} heatmap_tile_t;
+
+/* Sets up a tile for the [x0,x1)x[y0,y1) part of the heatmap, clipped to its size.
+ * The tile's max is determined from any heat already in that part.
+ */
+void heatmap_tile_init(heatmap_tile_t* t, heatmap_t* h, unsigned x0, unsigned y0, unsigned x1, unsigned y1);
+
+/* Adds the part of the stamp centred on x,y (which may be outside of the tile,
+ * or even the heatmap) that falls within the tile.
+ */
+void heatmap_tile_add_weighted_point_with_stamp(heatmap_tile_t* t, int x, int y, float w, const heatmap_stamp_t* stamp);
+
+/* Recalculates the highest heat within the tile. */
+void heatmap_tile_update_max(heatmap_tile_t* t);
+
 /* Creates a new stamp COPYING the given w*h floats in data.
  *
  * w, h: The width/height of the stamp, in pixels.
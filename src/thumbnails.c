@@ -38,6 +38,7 @@
 #include "thumbnails.h"
 #include "icons/icons.h"
 #include "md5_hash.h"
+#include "background.h"
 
 #ifdef __CYGWIN__
 #ifdef __CYGWIN_USE_BIG_TYPES__
@@ -70,7 +71,7 @@ static void set_thumb_dir ()
 
 #define PIXMAP_THUMB_SIZE  128
 
-static GdkPixbuf *save_thumbnail(const char *pathname, GdkPixbuf *full);
+static GdkPixbuf *save_thumbnail(const char *pathname, GdkPixbuf *full, int original_width, int original_height);
 static GdkPixbuf *child_create_thumbnail(const gchar *path);
 
 gboolean a_thumbnails_exists ( const gchar *filename )
@@ -132,18 +133,35 @@ GdkPixbuf *a_thumbnails_scale_pixbuf(GdkPixbuf *src, int max_w, int max_h)
 static GdkPixbuf *child_create_thumbnail(const gchar *path)
 {
 	GdkPixbuf *image, *tmpbuf;
+	int original_width = 0, original_height = 0;
 
-	image = gdk_pixbuf_new_from_file(path, NULL);
+	// Only decode at (about) the thumbnail size, rather than the full image which is then thrown away.
+	// For JPEGs the loader does this in the DCT domain (libjpeg's scale_denom), so it is much quicker.
+	if (!gdk_pixbuf_get_file_info(path, &original_width, &original_height))
+		return NULL;
+
+	if (original_width > PIXMAP_THUMB_SIZE || original_height > PIXMAP_THUMB_SIZE)
+		image = gdk_pixbuf_new_from_file_at_size(path, PIXMAP_THUMB_SIZE, PIXMAP_THUMB_SIZE, NULL);
+	else
+		image = gdk_pixbuf_new_from_file(path, NULL);
 	if (!image)
 		return NULL;
 
+	gboolean landscape = gdk_pixbuf_get_width(image) >= gdk_pixbuf_get_height(image);
 	tmpbuf = gdk_pixbuf_apply_embedded_orientation(image);
 	g_object_unref(G_OBJECT(image));
 	image = tmpbuf;
 
 	if (image)
 	{
-		GdkPixbuf *thumb = save_thumbnail(path, image);
+		// Report the size as displayed, i.e. after any rotation
+		if (landscape != (gdk_pixbuf_get_width(image) >= gdk_pixbuf_get_height(image)))
+		{
+			int tmp = original_width;
+			original_width = original_height;
+			original_height = tmp;
+		}
+		GdkPixbuf *thumb = save_thumbnail(path, image, original_width, original_height);
 		g_object_unref ( G_OBJECT ( image ) );
 		return thumb;
 	}
@@ -151,11 +169,10 @@ static GdkPixbuf *child_create_thumbnail(const gchar *path)
 	return NULL;
 }
 
-static GdkPixbuf *save_thumbnail(const char *pathname, GdkPixbuf *full)
+static GdkPixbuf *save_thumbnail(const char *pathname, GdkPixbuf *full, int original_width, int original_height)
 {
 	struct stat info;
 	gchar *path;
-	int original_width, original_height;
 	const gchar* orientation;
 	GString *to;
 	char *md5, *swidth, *sheight, *ssize, *smtime, *uri;
@@ -170,10 +187,6 @@ static GdkPixbuf *save_thumbnail(const char *pathname, GdkPixbuf *full)
 
 	orientation = gdk_pixbuf_get_option (full, "orientation");
 
-	original_width = gdk_pixbuf_get_width(full);
-	original_height = gdk_pixbuf_get_height(full);
-
-
 	swidth = g_strdup_printf("%d", original_width);
 	sheight = g_strdup_printf("%d", original_height);
 	ssize = g_strdup_printf(ST_SIZE_FMT, info.st_size);
@@ -304,6 +317,165 @@ out:
 	return thumb;
 }
 
+/*
+ * Thumbnail requests, serviced by background workers
+ *
+ * Requests are handled newest first, since those are most likely still wanted on screen,
+ *  and the queue is bounded so that panning around lots of images does not build up
+ *  an ever growing backlog of work for places no longer being looked at.
+ */
+
+#define REQUEST_QUEUE_MAX 256
+
+typedef struct {
+  GObject *object;
+  ThumbnailsReadyFunc func;
+} request_subscriber_t;
+
+typedef struct {
+  gchar *filename;
+  GSList *subscribers;
+  GList *link; // Position in the queue, NULL once being worked on
+  GdkPixbuf *pixbuf;
+} request_t;
+
+static GMutex request_mutex;
+static GQueue request_queue = G_QUEUE_INIT;
+static GHashTable *request_hash = NULL; // filename -> request_t, both queued and in progress
+static guint request_workers = 0;
+
+// Main thread only
+static void request_free ( request_t *req )
+{
+  for ( GSList *sl = req->subscribers; sl; sl = sl->next ) {
+    request_subscriber_t *sub = sl->data;
+    g_object_unref ( sub->object );
+    g_free ( sub );
+  }
+  g_slist_free ( req->subscribers );
+  if ( req->pixbuf )
+    g_object_unref ( G_OBJECT(req->pixbuf) );
+  g_free ( req->filename );
+  g_free ( req );
+}
+
+// In main thread
+static gboolean request_ready ( request_t *req )
+{
+  g_mutex_lock ( &request_mutex );
+  g_hash_table_remove ( request_hash, req->filename );
+  g_mutex_unlock ( &request_mutex );
+
+  // Now no more subscribers can be added
+  req->subscribers = g_slist_reverse ( req->subscribers );
+  for ( GSList *sl = req->subscribers; sl; sl = sl->next ) {
+    request_subscriber_t *sub = sl->data;
+    sub->func ( sub->object, req->filename, req->pixbuf );
+  }
+  request_free ( req );
+  return FALSE;
+}
+
+// Runs in a background thread until there are no more requests, or it is cancelled
+static void request_worker ( gpointer data, gpointer threaddata )
+{
+  while ( TRUE ) {
+    g_mutex_lock ( &request_mutex );
+    request_t *req = g_queue_pop_head ( &request_queue );
+    if ( req )
+      req->link = NULL;
+    else
+      request_workers--;
+    g_mutex_unlock ( &request_mutex );
+    if ( !req )
+      break;
+
+    req->pixbuf = a_thumbnails_get ( req->filename );
+    if ( !req->pixbuf )
+      req->pixbuf = child_create_thumbnail ( req->filename );
+    (void)gdk_threads_add_idle ( (GSourceFunc)request_ready, req );
+
+    if ( a_background_testcancel ( threaddata ) ) {
+      g_mutex_lock ( &request_mutex );
+      request_workers--;
+      g_mutex_unlock ( &request_mutex );
+      break;
+    }
+  }
+}
+
+/**
+ * a_thumbnails_request:
+ * @filename: The image file
+ * @object:   Kept alive (referenced) until @func has been called
+ * @func:     Called in the main thread with the thumbnail, or NULL if one could not be made
+ *
+ * Get the thumbnail for @filename in the background, creating it when necessary.
+ * Multiple requests for the same file are combined, and @func is called once for each @object.
+ * If the request gets too old, it may be dropped without @func being called.
+ *
+ * Must be called from the main thread.
+ */
+void a_thumbnails_request ( const gchar *filename, GObject *object, ThumbnailsReadyFunc func )
+{
+  GSList *dropped = NULL;
+  gboolean start_worker = FALSE;
+
+  g_mutex_lock ( &request_mutex );
+  request_t *req = g_hash_table_lookup ( request_hash, filename );
+  if ( req ) {
+    // Still waiting, so move it to the front
+    if ( req->link ) {
+      g_queue_unlink ( &request_queue, req->link );
+      g_queue_push_head_link ( &request_queue, req->link );
+    }
+  }
+  else {
+    req = g_malloc0 ( sizeof(request_t) );
+    req->filename = g_strdup ( filename );
+    g_queue_push_head ( &request_queue, req );
+    req->link = request_queue.head;
+    g_hash_table_insert ( request_hash, req->filename, req );
+
+    while ( g_queue_get_length(&request_queue) > REQUEST_QUEUE_MAX ) {
+      request_t *old = g_queue_pop_tail ( &request_queue );
+      g_hash_table_remove ( request_hash, old->filename );
+      dropped = g_slist_prepend ( dropped, old );
+    }
+  }
+
+  // Repeated requests (e.g. on each redraw) only need to be told once
+  gboolean subscribed = FALSE;
+  for ( GSList *iter = req->subscribers; iter && !subscribed; iter = iter->next ) {
+    request_subscriber_t *sub = iter->data;
+    subscribed = ( sub->object == object && sub->func == func );
+  }
+  if ( !subscribed ) {
+    request_subscriber_t *sub = g_malloc ( sizeof(request_subscriber_t) );
+    sub->object = g_object_ref ( object );
+    sub->func = func;
+    req->subscribers = g_slist_prepend ( req->subscribers, sub );
+  }
+
+  if ( request_workers < MIN(g_queue_get_length(&request_queue), util_get_number_of_cpus()) ) {
+    request_workers++;
+    start_worker = TRUE;
+  }
+  g_mutex_unlock ( &request_mutex );
+
+  g_slist_free_full ( dropped, (GDestroyNotify)request_free );
+
+  if ( start_worker )
+    a_background_thread ( BACKGROUND_POOL_LOCAL,
+                          NULL,
+                          _("Creating Thumbnails"),
+                          (vik_thr_func) request_worker,
+                          NULL,
+                          NULL,
+                          NULL,
+                          1 );
+}
+
 /*
  * Startup and finish routines
  */
@@ -311,9 +483,19 @@ out:
 void a_thumbnails_init ()
 {
   set_thumb_dir ();
+  request_hash = g_hash_table_new ( g_str_hash, g_str_equal );
 }
 
 void a_thumbnails_uninit ()
 {
+  // Any workers have been stopped by now, just discard outstanding requests
+  g_mutex_lock ( &request_mutex );
+  GList *pending = request_queue.head;
+  g_queue_init ( &request_queue );
+  g_mutex_unlock ( &request_mutex );
+  g_list_free_full ( pending, (GDestroyNotify)request_free );
+  g_hash_table_destroy ( request_hash );
+  request_hash = NULL;
+
   g_free ( thumb_dir );
 }
@@ -36,6 +36,9 @@ GdkPixbuf *a_thumbnails_get(const gchar *filename);
 GdkPixbuf *a_thumbnails_get_default ();
 GdkPixbuf *a_thumbnails_scale_pixbuf(GdkPixbuf *src, int max_w, int max_h);
 
+typedef void (*ThumbnailsReadyFunc) ( GObject *object, const gchar *filename, GdkPixbuf *pixbuf );
+void a_thumbnails_request ( const gchar *filename, GObject *object, ThumbnailsReadyFunc func );
+
 G_END_DECLS
 
 #endif
@@ -0,0 +1,439 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, Viking Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include "tileset.h"
+
+// All bits set - i.e. not a valid x:y as these can not be negative
+#define EMPTY_KEY G_MAXUINT64
+#define MIN_BITS 10
+
+struct _TileSet {
+  guint64 *keys;   // EMPTY_KEY for unused slots
+  guint *labels;   // Per slot, only allocated once labelled
+  guint bits;
+  guint capacity;  // Always 2^bits
+  guint size;
+};
+
+static inline guint64 tile_key ( gint x, gint y )
+{
+  return ((guint64)(guint32)x << 32) | (guint32)y;
+}
+
+static inline gint key_x ( guint64 key )
+{
+  return (gint)(key >> 32);
+}
+
+static inline gint key_y ( guint64 key )
+{
+  return (gint)(guint32)key;
+}
+
+// Fibonacci hashing, as neighbouring tiles have very similar keys
+static inline guint home_slot ( const TileSet *ts, guint64 key )
+{
+  return (guint)((key * G_GUINT64_CONSTANT(0x9E3779B97F4A7C15)) >> (64 - ts->bits));
+}
+
+/**
+ * Returns: The slot holding the key, or otherwise the empty slot where it would go
+ */
+static guint find_slot ( const TileSet *ts, guint64 key )
+{
+  const guint mask = ts->capacity - 1;
+  guint slot = home_slot ( ts, key );
+  while ( ts->keys[slot] != EMPTY_KEY && ts->keys[slot] != key )
+    slot = (slot + 1) & mask;
+  return slot;
+}
+
+static void alloc_slots ( TileSet *ts, guint bits )
+{
+  ts->bits = bits;
+  ts->capacity = 1u << bits;
+  ts->keys = g_malloc ( ts->capacity * sizeof(guint64) );
+  memset ( ts->keys, 0xff, ts->capacity * sizeof(guint64) );
+  ts->labels = NULL;
+  ts->size = 0;
+}
+
+static void grow ( TileSet *ts )
+{
+  guint64 *keys = ts->keys;
+  guint *labels = ts->labels;
+  guint capacity = ts->capacity;
+  guint size = ts->size;
+
+  alloc_slots ( ts, ts->bits + 1 );
+  if ( labels )
+    ts->labels = g_malloc0 ( ts->capacity * sizeof(guint) );
+  for ( guint ii = 0; ii < capacity; ii++ ) {
+    if ( keys[ii] == EMPTY_KEY )
+      continue;
+    guint slot = find_slot ( ts, keys[ii] );
+    ts->keys[slot] = keys[ii];
+    if ( labels )
+      ts->labels[slot] = labels[ii];
+  }
+  ts->size = size;
+
+  g_free ( keys );
+  g_free ( labels );
+}
+
+TileSet *tile_set_new ( void )
+{
+  TileSet *ts = g_malloc ( sizeof(TileSet) );
+  alloc_slots ( ts, MIN_BITS );
+  return ts;
+}
+
+TileSet *tile_set_copy ( const TileSet *ts )
+{
+  TileSet *copy = g_malloc ( sizeof(TileSet) );
+  *copy = *ts;
+  copy->keys = g_memdup ( ts->keys, ts->capacity * sizeof(guint64) );
+  if ( ts->labels )
+    copy->labels = g_memdup ( ts->labels, ts->capacity * sizeof(guint) );
+  return copy;
+}
+
+void tile_set_free ( TileSet *ts )
+{
+  if ( !ts )
+    return;
+  g_free ( ts->keys );
+  g_free ( ts->labels );
+  g_free ( ts );
+}
+
+void tile_set_clear ( TileSet *ts )
+{
+  g_free ( ts->keys );
+  g_free ( ts->labels );
+  alloc_slots ( ts, MIN_BITS );
+}
+
+guint tile_set_size ( const TileSet *ts )
+{
+  return ts->size;
+}
+
+/**
+ * Returns: TRUE if the tile was not already in the set
+ */
+gboolean tile_set_add ( TileSet *ts, gint x, gint y )
+{
+  g_return_val_if_fail ( x >= 0 && y >= 0, FALSE );
+
+  // Keep the load factor below 0.7 so probe sequences stay short
+  if ( (guint64)(ts->size + 1) * 10 > (guint64)ts->capacity * 7 )
+    grow ( ts );
+
+  guint64 key = tile_key ( x, y );
+  guint slot = find_slot ( ts, key );
+  if ( ts->keys[slot] == key )
+    return FALSE;
+  ts->keys[slot] = key;
+  ts->size++;
+  return TRUE;
+}
+
+gboolean tile_set_contains ( const TileSet *ts, gint x, gint y )
+{
+  if ( x < 0 || y < 0 )
+    return FALSE;
+  guint64 key = tile_key ( x, y );
+  return ts->keys[find_slot(ts, key)] == key;
+}
+
+/**
+ * Returns: The label of the tile as set by tile_set_label_regions(),
+ *  or 0 if the tile is not in the set or not labelled
+ */
+guint tile_set_get_label ( const TileSet *ts, gint x, gint y )
+{
+  if ( !ts->labels || x < 0 || y < 0 )
+    return 0;
+  guint64 key = tile_key ( x, y );
+  guint slot = find_slot ( ts, key );
+  return ts->keys[slot] == key ? ts->labels[slot] : 0;
+}
+
+/**
+ * Returns: FALSE if the set is empty
+ */
+gboolean tile_set_get_extents ( const TileSet *ts, gint *tlx, gint *tly, gint *brx, gint *bry )
+{
+  *tlx = *tly = G_MAXINT;
+  *brx = *bry = -G_MAXINT;
+  for ( guint ii = 0; ii < ts->capacity; ii++ ) {
+    if ( ts->keys[ii] == EMPTY_KEY )
+      continue;
+    gint x = key_x ( ts->keys[ii] );
+    gint y = key_y ( ts->keys[ii] );
+    if ( x < *tlx ) *tlx = x;
+    if ( x > *brx ) *brx = x;
+    if ( y < *tly ) *tly = y;
+    if ( y > *bry ) *bry = y;
+  }
+  return ts->size > 0;
+}
+
+void tile_set_iter_init ( TileSetIter *iter, const TileSet *ts )
+{
+  iter->ts = ts;
+  iter->pos = 0;
+}
+
+/**
+ * Tiles are returned in no particular order
+ *  and the set must not be changed whilst iterating
+ */
+gboolean tile_set_iter_next ( TileSetIter *iter, gint *x, gint *y )
+{
+  const TileSet *ts = iter->ts;
+  while ( iter->pos < ts->capacity ) {
+    guint64 key = ts->keys[iter->pos++];
+    if ( key != EMPTY_KEY ) {
+      *x = key_x ( key );
+      *y = key_y ( key );
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+/**
+ * Returns: A new set of the tiles that have all eight of their neighbours in the set too
+ */
+TileSet *tile_set_surrounded ( const TileSet *ts )
+{
+  TileSet *result = tile_set_new ();
+  for ( guint ii = 0; ii < ts->capacity; ii++ ) {
+    if ( ts->keys[ii] == EMPTY_KEY )
+      continue;
+    gint x = key_x ( ts->keys[ii] );
+    gint y = key_y ( ts->keys[ii] );
+    if ( tile_set_contains(ts, x-1, y) && tile_set_contains(ts, x+1, y) &&
+         tile_set_contains(ts, x-1, y-1) && tile_set_contains(ts, x, y-1) && tile_set_contains(ts, x+1, y-1) &&
+         tile_set_contains(ts, x-1, y+1) && tile_set_contains(ts, x, y+1) && tile_set_contains(ts, x+1, y+1) )
+      (void)tile_set_add ( result, x, y );
+  }
+  return result;
+}
+
+static inline guint uf_find ( guint *parent, guint ii )
+{
+  while ( parent[ii] != ii ) {
+    parent[ii] = parent[parent[ii]]; // Path halving
+    ii = parent[ii];
+  }
+  return ii;
+}
+
+/**
+ * Label each region of tiles connected horizontally or vertically,
+ *  using union-find over the slots of the set (rather than over the whole grid of the extents)
+ *
+ * Returns: The number of regions, with the label (from 1) and size of the biggest one
+ */
+guint tile_set_label_regions ( TileSet *ts, guint *largest_label, guint *largest_size )
+{
+  *largest_label = 0;
+  *largest_size = 0;
+
+  guint *parent = g_malloc ( ts->capacity * sizeof(guint) );
+  for ( guint ii = 0; ii < ts->capacity; ii++ )
+    parent[ii] = ii;
+
+  for ( guint ii = 0; ii < ts->capacity; ii++ ) {
+    if ( ts->keys[ii] == EMPTY_KEY )
+      continue;
+    gint x = key_x ( ts->keys[ii] );
+    gint y = key_y ( ts->keys[ii] );
+    // Joining to the left and above neighbours covers all connections
+    guint64 neighbours[2] = { tile_key(x-1, y), tile_key(x, y-1) };
+    for ( guint nn = 0; nn < 2; nn++ ) {
+      if ( (nn == 0 && x == 0) || (nn == 1 && y == 0) )
+        continue;
+      guint slot = find_slot ( ts, neighbours[nn] );
+      if ( ts->keys[slot] == EMPTY_KEY )
+        continue;
+      guint r1 = uf_find ( parent, ii );
+      guint r2 = uf_find ( parent, slot );
+      if ( r1 != r2 )
+        parent[MAX(r1, r2)] = MIN(r1, r2);
+    }
+  }
+
+  // Number the regions, by the label of the root of each one
+  g_free ( ts->labels );
+  ts->labels = g_malloc0 ( ts->capacity * sizeof(guint) );
+  GArray *sizes = g_array_new ( FALSE, TRUE, sizeof(guint) );
+  g_array_set_size ( sizes, 1 );
+  guint count = 0;
+  for ( guint ii = 0; ii < ts->capacity; ii++ ) {
+    if ( ts->keys[ii] == EMPTY_KEY )
+      continue;
+    guint root = uf_find ( parent, ii );
+    if ( !ts->labels[root] ) {
+      ts->labels[root] = ++count;
+      g_array_set_size ( sizes, count + 1 );
+    }
+    ts->labels[ii] = ts->labels[root];
+    g_array_index ( sizes, guint, ts->labels[ii] )++;
+  }
+  g_free ( parent );
+
+  for ( guint ll = 1; ll <= count; ll++ ) {
+    if ( g_array_index(sizes, guint, ll) > *largest_size ) {
+      *largest_size = g_array_index ( sizes, guint, ll );
+      *largest_label = ll;
+    }
+  }
+  g_array_free ( sizes, TRUE );
+
+  return count;
+}
+
+static gint compare_keys ( gconstpointer aa, gconstpointer bb )
+{
+  guint64 ka = *(const guint64*)aa;
+  guint64 kb = *(const guint64*)bb;
+  return (ka > kb) - (ka < kb);
+}
+
+/**
+ * Returns: The keys in order; by x then y for columns, otherwise swapped to be y:x to be in order by rows
+ */
+static guint64 *sorted_keys ( const TileSet *ts, gboolean columns )
+{
+  guint64 *keys = g_malloc ( MAX(ts->size, 1) * sizeof(guint64) );
+  guint nn = 0;
+  for ( guint ii = 0; ii < ts->capacity; ii++ ) {
+    guint64 key = ts->keys[ii];
+    if ( key == EMPTY_KEY )
+      continue;
+    keys[nn++] = columns ? key : ((key << 32) | (key >> 32));
+  }
+  qsort ( keys, nn, sizeof(guint64), compare_keys );
+  return keys;
+}
+
+/**
+ * Find the biggest square of tiles, by the usual dynamic programming method
+ *  but just over the tiles in row order, rather than a grid of the extents
+ *
+ * Returns: The size of the square, with x & y of its top left tile
+ */
+guint tile_set_max_square ( const TileSet *ts, gint *x, gint *y )
+{
+  const guint nn = ts->size;
+  if ( nn == 0 )
+    return 0;
+
+  guint64 *rows = sorted_keys ( ts, FALSE );
+  // The size of the square with its bottom right at each tile
+  guint *sq = g_malloc ( nn * sizeof(guint) );
+  guint best = 0;
+  guint row_start = 0;
+  // The row above, when it is directly above
+  guint above_start = 0, above_end = 0;
+  guint pp = 0;
+
+  for ( guint ii = 0; ii < nn; ii++ ) {
+    const guint32 yy = (guint32)(rows[ii] >> 32);
+    const guint32 xx = (guint32)rows[ii];
+    if ( ii == 0 || (guint32)(rows[ii-1] >> 32) != yy ) {
+      // The previous row always ends here, but is only used (otherwise an empty range) when directly above
+      gboolean adjacent = ( ii > 0 && (guint32)(rows[ii-1] >> 32) + 1 == yy );
+      above_start = adjacent ? row_start : ii;
+      above_end = ii;
+      row_start = ii;
+      pp = above_start;
+    }
+    guint left = ( ii > row_start && (guint32)rows[ii-1] + 1 == xx ) ? sq[ii-1] : 0;
+    guint up = 0;
+    guint diag = 0;
+    // Move along the row above to the tile above left
+    while ( pp < above_end && (guint32)rows[pp] + 1 < xx )
+      pp++;
+    if ( pp < above_end && (guint32)rows[pp] + 1 == xx ) {
+      diag = sq[pp];
+      if ( pp + 1 < above_end && (guint32)rows[pp+1] == xx )
+        up = sq[pp+1];
+    }
+    else if ( pp < above_end && (guint32)rows[pp] == xx )
+      up = sq[pp];
+
+    sq[ii] = 1 + MIN ( left, MIN(up, diag) );
+    if ( sq[ii] > best ) {
+      best = sq[ii];
+      *x = xx - best + 1;
+      *y = yy - best + 1;
+    }
+  }
+
+  g_free ( sq );
+  g_free ( rows );
+  return best;
+}
+
+// Of the keys sorted as major:minor, find the first longest run of consecutive minor values
+static void longest_run ( const guint64 *keys, guint nn, guint *size, gint *major, gint *minor )
+{
+  guint run = 0;
+  *size = 0;
+  for ( guint ii = 0; ii < nn; ii++ ) {
+    if ( ii > 0 && (keys[ii] >> 32) == (keys[ii-1] >> 32) && (guint32)keys[ii] == (guint32)keys[ii-1] + 1 )
+      run++;
+    else
+      run = 1;
+    if ( run > *size ) {
+      *size = run;
+      *major = (gint)(keys[ii] >> 32);
+      *minor = (gint)(guint32)keys[ii];
+    }
+  }
+}
+
+/**
+ * Find the longest lines of tiles, both vertically (north/south) and horizontally (east/west)
+ *  each given by the size and the last tile of the line
+ */
+void tile_set_longest_lines ( const TileSet *ts,
+                              guint *ns_size, gint *ns_x, gint *ns_y,
+                              guint *ew_size, gint *ew_x, gint *ew_y )
+{
+  guint64 *keys = sorted_keys ( ts, TRUE );
+  longest_run ( keys, ts->size, ns_size, ns_x, ns_y );
+  g_free ( keys );
+
+  keys = sorted_keys ( ts, FALSE );
+  longest_run ( keys, ts->size, ew_size, ew_y, ew_x );
+  g_free ( keys );
+}
@@ -0,0 +1,68 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, Viking Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef _VIKING_TILESET_H
+#define _VIKING_TILESET_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * A set of map tiles (of a single zoom level), with an optional label per tile.
+ *
+ * Tiles are held as packed 64 bit x:y values in a flat open addressing hash table,
+ *  which is much more compact than a #GHashTable with a key string per tile.
+ * x and y values must not be negative.
+ */
+typedef struct _TileSet TileSet;
+
+TileSet *tile_set_new ( void );
+TileSet *tile_set_copy ( const TileSet *ts );
+void tile_set_free ( TileSet *ts );
+void tile_set_clear ( TileSet *ts );
+
+guint tile_set_size ( const TileSet *ts );
+gboolean tile_set_add ( TileSet *ts, gint x, gint y );
+gboolean tile_set_contains ( const TileSet *ts, gint x, gint y );
+guint tile_set_get_label ( const TileSet *ts, gint x, gint y );
+gboolean tile_set_get_extents ( const TileSet *ts, gint *tlx, gint *tly, gint *brx, gint *bry );
+
+typedef struct {
+  const TileSet *ts;
+  guint pos;
+} TileSetIter;
+
+void tile_set_iter_init ( TileSetIter *iter, const TileSet *ts );
+gboolean tile_set_iter_next ( TileSetIter *iter, gint *x, gint *y );
+
+/*
+ * Coverage analysis
+ */
+TileSet *tile_set_surrounded ( const TileSet *ts );
+guint tile_set_label_regions ( TileSet *ts, guint *largest_label, guint *largest_size );
+guint tile_set_max_square ( const TileSet *ts, gint *x, gint *y );
+void tile_set_longest_lines ( const TileSet *ts,
+                              guint *ns_size, gint *ns_x, gint *ns_y,
+                              guint *ew_size, gint *ew_x, gint *ew_y );
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,702 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, Viking Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <glib/gstdio.h>
+
+#include "tilestore.h"
+
+/*
+ * File layout:
+ *  TILESTORE_MAGIC followed by a 32 bit version number
+ *  Then a sequence of records, each being:
+ *   A header of (all values little endian):
+ *    x, y:        32 bits each
+ *    mtime:       64 bits - seconds since the epoch
+ *    length:      32 bits - of the tile data
+ *    etag_length: 16 bits
+ *    flags:       16 bits
+ *   The ETag (not nul terminated)
+ *   The tile data
+ *
+ * Records are only ever appended, so replacing a tile or removing one (via a record with the
+ *  TILESTORE_REMOVED flag) leaves unused space in the file, which is reclaimed by compaction.
+ * The index of where each tile is in the file is built from the record headers on first use.
+ */
+#define TILESTORE_MAGIC "VIKTILES"
+#define TILESTORE_MAGIC_LEN 8
+#define TILESTORE_VERSION 1
+#define FILE_HEADER_LEN (TILESTORE_MAGIC_LEN + 4)
+#define RECORD_HEADER_LEN 24
+#define RECORD_MTIME_OFFSET 8
+
+#define TILESTORE_REMOVED 0x1
+
+// Tiles are written to the file once there are this many bytes of them,
+//  or on the next write after this time (microseconds)
+#define FLUSH_SIZE (1024 * 1024)
+#define FLUSH_INTERVAL (5 * G_TIME_SPAN_SECOND)
+// Compact once at least this much, and over half, of the file is unused
+#define COMPACT_MIN_GARBAGE (1024 * 1024)
+// The least recently used store not in use is closed when there are more than this many
+#define MAX_STORES 64
+
+typedef struct {
+  gint32 x, y;
+  gint64 mtime;
+  guint32 length;
+  guint16 etag_length;
+  guint16 flags;
+} RecordHeader;
+
+typedef struct {
+  gint64 key;
+  goffset offset; // Of the record
+  guint32 length; // Of the tile data
+  guint16 etag_length;
+  gint64 mtime;
+  gchar *etag;
+} TileEntry;
+
+typedef struct {
+  gint ref_count;  // Protected by stores_mutex
+  gint64 last_used; // Protected by stores_mutex
+  gchar *filename;
+  GMutex mutex;
+  gboolean loaded;
+  GHashTable *index;   // Of TileEntry*, by key
+  GMappedFile *mapped; // The file as written so far
+  goffset size;        // Of the file
+  GByteArray *pending; // Records yet to be written to the file
+  goffset garbage;     // Bytes of replaced or removed tiles
+  gboolean compact;    // Needs compacting regardless
+  gint64 last_write;
+} TileStore;
+
+static GHashTable *stores = NULL; // Of TileStore*, by filename
+static GMutex stores_mutex;
+
+static inline gint64 tile_key ( gint x, gint y )
+{
+  return ((gint64)x << 32) | (guint32)y;
+}
+
+static inline goffset entry_record_length ( TileEntry *te )
+{
+  return RECORD_HEADER_LEN + te->etag_length + te->length;
+}
+
+static void entry_free ( TileEntry *te )
+{
+  g_free ( te->etag );
+  g_free ( te );
+}
+
+static void header_write ( guint8 *buf, const RecordHeader *rh )
+{
+  guint32 u32;
+  guint64 u64;
+  guint16 u16;
+  u32 = GUINT32_TO_LE ( (guint32)rh->x );
+  memcpy ( buf, &u32, 4 );
+  u32 = GUINT32_TO_LE ( (guint32)rh->y );
+  memcpy ( buf+4, &u32, 4 );
+  u64 = GUINT64_TO_LE ( (guint64)rh->mtime );
+  memcpy ( buf+RECORD_MTIME_OFFSET, &u64, 8 );
+  u32 = GUINT32_TO_LE ( rh->length );
+  memcpy ( buf+16, &u32, 4 );
+  u16 = GUINT16_TO_LE ( rh->etag_length );
+  memcpy ( buf+20, &u16, 2 );
+  u16 = GUINT16_TO_LE ( rh->flags );
+  memcpy ( buf+22, &u16, 2 );
+}
+
+static void header_read ( const guint8 *buf, RecordHeader *rh )
+{
+  guint32 u32;
+  guint64 u64;
+  guint16 u16;
+  memcpy ( &u32, buf, 4 );
+  rh->x = (gint32)GUINT32_FROM_LE ( u32 );
+  memcpy ( &u32, buf+4, 4 );
+  rh->y = (gint32)GUINT32_FROM_LE ( u32 );
+  memcpy ( &u64, buf+RECORD_MTIME_OFFSET, 8 );
+  rh->mtime = (gint64)GUINT64_FROM_LE ( u64 );
+  memcpy ( &u32, buf+16, 4 );
+  rh->length = GUINT32_FROM_LE ( u32 );
+  memcpy ( &u16, buf+20, 2 );
+  rh->etag_length = GUINT16_FROM_LE ( u16 );
+  memcpy ( &u16, buf+22, 2 );
+  rh->flags = GUINT16_FROM_LE ( u16 );
+}
+
+static void file_header_write ( guint8 *buf )
+{
+  guint32 version = GUINT32_TO_LE ( TILESTORE_VERSION );
+  memcpy ( buf, TILESTORE_MAGIC, TILESTORE_MAGIC_LEN );
+  memcpy ( buf+TILESTORE_MAGIC_LEN, &version, 4 );
+}
+
+static void store_map ( TileStore *ts )
+{
+  if ( ts->mapped )
+    g_mapped_file_unref ( ts->mapped );
+  GError *error = NULL;
+  ts->mapped = g_mapped_file_new ( ts->filename, FALSE, &error );
+  if ( error ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+  }
+}
+
+/**
+ * Build the index from the file, if there is one
+ */
+static void store_load ( TileStore *ts )
+{
+  ts->loaded = TRUE;
+  if ( !g_file_test ( ts->filename, G_FILE_TEST_EXISTS ) )
+    return;
+
+  store_map ( ts );
+  if ( !ts->mapped )
+    return;
+
+  gsize len = g_mapped_file_get_length ( ts->mapped );
+  const guint8 *data = (const guint8*)g_mapped_file_get_contents ( ts->mapped );
+  guint32 version = 0;
+  if ( len >= FILE_HEADER_LEN ) {
+    memcpy ( &version, data+TILESTORE_MAGIC_LEN, 4 );
+    version = GUINT32_FROM_LE ( version );
+  }
+  if ( len < FILE_HEADER_LEN || memcmp(data, TILESTORE_MAGIC, TILESTORE_MAGIC_LEN) || version != TILESTORE_VERSION ) {
+    // Ensure it gets replaced, rather than added to
+    g_warning ( "%s: Ignoring unrecognized tile file %s", __FUNCTION__, ts->filename );
+    g_mapped_file_unref ( ts->mapped );
+    ts->mapped = NULL;
+    return;
+  }
+
+  goffset pos = FILE_HEADER_LEN;
+  while ( pos + RECORD_HEADER_LEN <= len ) {
+    RecordHeader rh;
+    header_read ( data+pos, &rh );
+    goffset rlen = RECORD_HEADER_LEN + rh.etag_length + (goffset)rh.length;
+    if ( pos + rlen > len )
+      break;
+
+    gint64 key = tile_key ( rh.x, rh.y );
+    TileEntry *old = g_hash_table_lookup ( ts->index, &key );
+    if ( old ) {
+      ts->garbage += entry_record_length ( old );
+      (void)g_hash_table_remove ( ts->index, &key );
+    }
+    if ( rh.flags & TILESTORE_REMOVED )
+      ts->garbage += rlen;
+    else {
+      TileEntry *te = g_malloc0 ( sizeof(TileEntry) );
+      te->key = key;
+      te->offset = pos;
+      te->length = rh.length;
+      te->mtime = rh.mtime;
+      te->etag_length = rh.etag_length;
+      if ( rh.etag_length )
+        te->etag = g_strndup ( (const gchar*)data+pos+RECORD_HEADER_LEN, rh.etag_length );
+      g_hash_table_insert ( ts->index, &te->key, te );
+    }
+    pos += rlen;
+  }
+
+  ts->size = pos;
+  if ( pos < len ) {
+    // Presumably from when writing was interrupted
+    //  Compact on the next write so the remnant can't be mistaken for records
+    g_warning ( "%s: Ignoring incomplete tile data at the end of %s", __FUNCTION__, ts->filename );
+    ts->compact = TRUE;
+  }
+}
+
+static void store_lock ( TileStore *ts )
+{
+  g_mutex_lock ( &ts->mutex );
+  if ( !ts->loaded )
+    store_load ( ts );
+}
+
+/**
+ * Returns: Where the record is, either in the file or the pending records
+ */
+static const guint8 *store_record ( TileStore *ts, TileEntry *te )
+{
+  if ( te->offset >= ts->size )
+    return ts->pending->data + (te->offset - ts->size);
+  if ( ts->mapped && te->offset + entry_record_length(te) <= (goffset)g_mapped_file_get_length(ts->mapped) )
+    return (const guint8*)g_mapped_file_get_contents ( ts->mapped ) + te->offset;
+  return NULL;
+}
+
+/**
+ * Add a record, returning the index entry for it (unless it is a removal)
+ */
+static TileEntry *store_append ( TileStore *ts, gint x, gint y, gint64 mtime, const gchar *etag, guint16 etag_length,
+                                 const guint8 *data, guint32 length, guint16 flags )
+{
+  if ( ts->size + ts->pending->len == 0 ) {
+    guint8 header[FILE_HEADER_LEN];
+    file_header_write ( header );
+    g_byte_array_append ( ts->pending, header, FILE_HEADER_LEN );
+  }
+
+  gint64 key = tile_key ( x, y );
+  TileEntry *old = g_hash_table_lookup ( ts->index, &key );
+  if ( old ) {
+    ts->garbage += entry_record_length ( old );
+    (void)g_hash_table_remove ( ts->index, &key );
+  }
+
+  RecordHeader rh = { x, y, mtime, length, etag_length, flags };
+  guint8 buf[RECORD_HEADER_LEN];
+  header_write ( buf, &rh );
+  goffset offset = ts->size + ts->pending->len;
+  g_byte_array_append ( ts->pending, buf, RECORD_HEADER_LEN );
+  if ( etag_length )
+    g_byte_array_append ( ts->pending, (const guint8*)etag, etag_length );
+  if ( length )
+    g_byte_array_append ( ts->pending, data, length );
+
+  if ( flags & TILESTORE_REMOVED ) {
+    ts->garbage += RECORD_HEADER_LEN + etag_length + length;
+    return NULL;
+  }
+
+  TileEntry *te = g_malloc0 ( sizeof(TileEntry) );
+  te->key = key;
+  te->offset = offset;
+  te->length = length;
+  te->mtime = mtime;
+  te->etag_length = etag_length;
+  te->etag = etag_length ? g_strndup ( etag, etag_length ) : NULL;
+  g_hash_table_insert ( ts->index, &te->key, te );
+  return te;
+}
+
+static gboolean entry_is_pending ( gpointer key, gpointer value, gpointer user_data )
+{
+  return ((TileEntry*)value)->offset >= *(goffset*)user_data;
+}
+
+/**
+ * Rewrite the file with only the current tiles
+ * Call with the store locked and nothing pending
+ */
+static void store_compact ( TileStore *ts )
+{
+  gchar *tmpname = g_strdup_printf ( "%s.tmp", ts->filename );
+  guint size = g_hash_table_size ( ts->index );
+  goffset *offsets = g_new ( goffset, size ? size : 1 );
+  goffset pos = FILE_HEADER_LEN;
+  guint ii = 0;
+  gboolean ok = FALSE;
+
+  FILE *f = g_fopen ( tmpname, "wb" );
+  if ( f ) {
+    guint8 header[FILE_HEADER_LEN];
+    file_header_write ( header );
+    ok = ( fwrite(header, 1, FILE_HEADER_LEN, f) == FILE_HEADER_LEN );
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init ( &iter, ts->index );
+    while ( ok && g_hash_table_iter_next(&iter, NULL, &value) ) {
+      TileEntry *te = value;
+      const guint8 *rec = store_record ( ts, te );
+      goffset rlen = entry_record_length ( te );
+      ok = rec && ( fwrite(rec, 1, rlen, f) == rlen );
+      offsets[ii++] = pos;
+      pos += rlen;
+    }
+    if ( fclose(f) != 0 )
+      ok = FALSE;
+  }
+
+  if ( ok ) {
+    // The file can't be replaced whilst mapped on Windows
+    if ( ts->mapped ) {
+      g_mapped_file_unref ( ts->mapped );
+      ts->mapped = NULL;
+    }
+    if ( g_rename(tmpname, ts->filename) != 0 ) {
+      (void)g_remove ( ts->filename );
+      if ( g_rename(tmpname, ts->filename) != 0 ) {
+        // Nothing left
+        g_warning ( "%s: file rename failed [%s] to [%s]", __FUNCTION__, tmpname, ts->filename );
+        g_hash_table_remove_all ( ts->index );
+        ts->size = 0;
+        ts->garbage = 0;
+        ts->compact = FALSE;
+        g_free ( offsets );
+        g_free ( tmpname );
+        return;
+      }
+    }
+
+    // Same order as written, since the table hasn't changed
+    GHashTableIter iter;
+    gpointer value;
+    ii = 0;
+    g_hash_table_iter_init ( &iter, ts->index );
+    while ( g_hash_table_iter_next(&iter, NULL, &value) )
+      ((TileEntry*)value)->offset = offsets[ii++];
+    ts->size = pos;
+    ts->garbage = 0;
+    ts->compact = FALSE;
+    g_debug ( "%s: %s now %" G_GOFFSET_FORMAT " bytes", __FUNCTION__, ts->filename, pos );
+  }
+  else {
+    g_warning ( "%s: Failed to write %s", __FUNCTION__, tmpname );
+    (void)g_remove ( tmpname );
+  }
+
+  store_map ( ts );
+  g_free ( offsets );
+  g_free ( tmpname );
+}
+
+/**
+ * Write the pending records to the file, compacting it if worthwhile
+ * Call with the store locked
+ */
+static gboolean store_flush ( TileStore *ts )
+{
+  gboolean ok = TRUE;
+  if ( ts->pending->len ) {
+    gchar *dir = g_path_get_dirname ( ts->filename );
+    if ( g_mkdir_with_parents ( dir, 0777 ) != 0 )
+      g_warning ( "%s: Failed to mkdir %s", __FUNCTION__, dir );
+    g_free ( dir );
+
+    // Write from the end of the last complete record
+    ok = FALSE;
+    FILE *f = g_fopen ( ts->filename, ts->size ? "r+b" : "wb" );
+    if ( f ) {
+      ok = ( fseek(f, (long)ts->size, SEEK_SET) == 0 ) &&
+           ( fwrite(ts->pending->data, 1, ts->pending->len, f) == ts->pending->len );
+      if ( fclose(f) != 0 )
+        ok = FALSE;
+    }
+
+    if ( ok )
+      ts->size += ts->pending->len;
+    else {
+      g_warning ( "%s: Failed to write %s: %s", __FUNCTION__, ts->filename, g_strerror(errno) );
+      // Forget about the tiles that couldn't be written
+      (void)g_hash_table_foreach_remove ( ts->index, entry_is_pending, &ts->size );
+    }
+    g_byte_array_set_size ( ts->pending, 0 );
+    store_map ( ts );
+  }
+  ts->last_write = g_get_monotonic_time ();
+
+  if ( ok && ts->size &&
+       ( ts->compact || (ts->garbage > COMPACT_MIN_GARBAGE && ts->garbage > ts->size / 2) ) )
+    store_compact ( ts );
+
+  return ok;
+}
+
+static gboolean store_write_if_due ( TileStore *ts )
+{
+  if ( ts->pending->len >= FLUSH_SIZE || g_get_monotonic_time() - ts->last_write > FLUSH_INTERVAL )
+    return store_flush ( ts );
+  return TRUE;
+}
+
+static void store_free ( TileStore *ts )
+{
+  g_mutex_lock ( &ts->mutex );
+  (void)store_flush ( ts );
+  g_mutex_unlock ( &ts->mutex );
+
+  if ( ts->mapped )
+    g_mapped_file_unref ( ts->mapped );
+  g_hash_table_destroy ( ts->index );
+  g_byte_array_unref ( ts->pending );
+  g_mutex_clear ( &ts->mutex );
+  g_free ( ts->filename );
+  g_free ( ts );
+}
+
+/**
+ * Close the least recently used store not being used, when there are too many
+ * Call with stores_mutex locked
+ *
+ * The store is written out before it is removed from the table,
+ *  so another store can't be opened on the file whilst it is still being written.
+ */
+static void stores_trim ( void )
+{
+  if ( g_hash_table_size(stores) < MAX_STORES )
+    return;
+
+  TileStore *oldest = NULL;
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init ( &iter, stores );
+  while ( g_hash_table_iter_next(&iter, NULL, &value) ) {
+    TileStore *ts = value;
+    if ( ts->ref_count == 1 && ( !oldest || ts->last_used < oldest->last_used ) )
+      oldest = ts;
+  }
+
+  if ( oldest ) {
+    // Nothing else can get hold of it, as that would need stores_mutex
+    oldest->ref_count--;
+    (void)g_hash_table_remove ( stores, oldest->filename );
+    store_free ( oldest );
+  }
+}
+
+/**
+ * Returns: The store for the file, to be released via store_unref()
+ */
+static TileStore *store_get ( const gchar *filename )
+{
+  g_mutex_lock ( &stores_mutex );
+  if ( !stores )
+    stores = g_hash_table_new ( g_str_hash, g_str_equal );
+
+  TileStore *ts = g_hash_table_lookup ( stores, filename );
+  if ( !ts ) {
+    stores_trim ();
+    ts = g_malloc0 ( sizeof(TileStore) );
+    ts->ref_count = 1; // For the stores table
+    ts->filename = g_strdup ( filename );
+    g_mutex_init ( &ts->mutex );
+    ts->index = g_hash_table_new_full ( g_int64_hash, g_int64_equal, NULL, (GDestroyNotify)entry_free );
+    ts->pending = g_byte_array_new ();
+    g_hash_table_insert ( stores, ts->filename, ts );
+  }
+  ts->ref_count++;
+  ts->last_used = g_get_monotonic_time ();
+  g_mutex_unlock ( &stores_mutex );
+
+  return ts;
+}
+
+static void store_unref ( TileStore *ts )
+{
+  g_mutex_lock ( &stores_mutex );
+  gboolean last = ( --ts->ref_count == 0 );
+  g_mutex_unlock ( &stores_mutex );
+  if ( last )
+    store_free ( ts );
+}
+
+static TileEntry *store_lookup ( TileStore *ts, gint x, gint y )
+{
+  gint64 key = tile_key ( x, y );
+  return g_hash_table_lookup ( ts->index, &key );
+}
+
+/**
+ * a_tilestore_get_info:
+ * @filename: The store
+ * @mtime:    Returns when the tile was last downloaded (maybe NULL)
+ * @etag:     Returns the tile's ETag to be freed after use, or NULL if it hasn't got one (maybe NULL)
+ *
+ * Returns: Whether the tile is in the store
+ */
+gboolean a_tilestore_get_info ( const gchar *filename, gint x, gint y, time_t *mtime, gchar **etag )
+{
+  TileStore *ts = store_get ( filename );
+  store_lock ( ts );
+  TileEntry *te = store_lookup ( ts, x, y );
+  if ( te ) {
+    if ( mtime )
+      *mtime = (time_t)te->mtime;
+    if ( etag )
+      *etag = g_strdup ( te->etag );
+  }
+  g_mutex_unlock ( &ts->mutex );
+  store_unref ( ts );
+  return te != NULL;
+}
+
+/**
+ * a_tilestore_read:
+ *
+ * Returns: The tile data, or NULL if the tile is not in the store
+ */
+GBytes *a_tilestore_read ( const gchar *filename, gint x, gint y )
+{
+  GBytes *content = NULL;
+  TileStore *ts = store_get ( filename );
+  store_lock ( ts );
+  TileEntry *te = store_lookup ( ts, x, y );
+  if ( te ) {
+    const guint8 *rec = store_record ( ts, te );
+    if ( rec )
+      content = g_bytes_new ( rec + RECORD_HEADER_LEN + te->etag_length, te->length );
+  }
+  g_mutex_unlock ( &ts->mutex );
+  store_unref ( ts );
+  return content;
+}
+
+/**
+ * a_tilestore_write:
+ * @etag: The ETag from the server for this tile (maybe NULL)
+ *
+ * Add or replace the tile, as downloaded now.
+ * Tiles may not be written to the file straight away, see a_tilestore_flush()
+ *
+ * Returns: FALSE if writing failed
+ */
+gboolean a_tilestore_write ( const gchar *filename, gint x, gint y, GBytes *content, const gchar *etag )
+{
+  gsize length;
+  const guint8 *data = g_bytes_get_data ( content, &length );
+  if ( length > G_MAXUINT32 )
+    return FALSE;
+  guint16 etag_length = etag ? MIN ( strlen(etag), G_MAXUINT16 ) : 0;
+
+  TileStore *ts = store_get ( filename );
+  store_lock ( ts );
+  (void)store_append ( ts, x, y, time(NULL), etag, etag_length, data, (guint32)length, 0 );
+  gboolean ok = store_write_if_due ( ts );
+  g_mutex_unlock ( &ts->mutex );
+  store_unref ( ts );
+  return ok;
+}
+
+/**
+ * a_tilestore_touch:
+ *
+ * Mark the tile as current, i.e. as when the server says it is unchanged
+ *
+ * Returns: FALSE if the tile isn't in the store or updating failed
+ */
+gboolean a_tilestore_touch ( const gchar *filename, gint x, gint y )
+{
+  gboolean ok = FALSE;
+  TileStore *ts = store_get ( filename );
+  store_lock ( ts );
+  TileEntry *te = store_lookup ( ts, x, y );
+  if ( te ) {
+    te->mtime = time ( NULL );
+    guint64 u64 = GUINT64_TO_LE ( (guint64)te->mtime );
+    if ( te->offset >= ts->size ) {
+      memcpy ( ts->pending->data + (te->offset - ts->size) + RECORD_MTIME_OFFSET, &u64, 8 );
+      ok = TRUE;
+    }
+    else {
+      // Update in place
+      FILE *f = g_fopen ( ts->filename, "r+b" );
+      if ( f ) {
+        ok = ( fseek(f, (long)(te->offset + RECORD_MTIME_OFFSET), SEEK_SET) == 0 ) && ( fwrite(&u64, 8, 1, f) == 1 );
+        if ( fclose(f) != 0 )
+          ok = FALSE;
+      }
+      if ( !ok )
+        g_warning ( "%s: Failed to update %s: %s", __FUNCTION__, ts->filename, g_strerror(errno) );
+    }
+  }
+  g_mutex_unlock ( &ts->mutex );
+  store_unref ( ts );
+  return ok;
+}
+
+/**
+ * a_tilestore_remove:
+ *
+ * Returns: Whether the tile was in the store
+ */
+gboolean a_tilestore_remove ( const gchar *filename, gint x, gint y )
+{
+  TileStore *ts = store_get ( filename );
+  store_lock ( ts );
+  gboolean found = ( store_lookup(ts, x, y) != NULL );
+  if ( found ) {
+    (void)store_append ( ts, x, y, time(NULL), NULL, 0, NULL, 0, TILESTORE_REMOVED );
+    (void)store_write_if_due ( ts );
+  }
+  g_mutex_unlock ( &ts->mutex );
+  store_unref ( ts );
+  return found;
+}
+
+/**
+ * a_tilestore_flush:
+ *
+ * Ensure all tiles are written to the files
+ */
+void a_tilestore_flush ( void )
+{
+  GSList *list = NULL;
+  g_mutex_lock ( &stores_mutex );
+  if ( stores ) {
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init ( &iter, stores );
+    while ( g_hash_table_iter_next(&iter, NULL, &value) ) {
+      TileStore *ts = value;
+      ts->ref_count++;
+      list = g_slist_prepend ( list, ts );
+    }
+  }
+  g_mutex_unlock ( &stores_mutex );
+
+  for ( GSList *iter = list; iter; iter = iter->next ) {
+    TileStore *ts = iter->data;
+    g_mutex_lock ( &ts->mutex );
+    if ( ts->pending->len )
+      (void)store_flush ( ts );
+    g_mutex_unlock ( &ts->mutex );
+    store_unref ( ts );
+  }
+  g_slist_free ( list );
+}
+
+void a_tilestore_uninit ( void )
+{
+  // Write out under the lock, for the same reason as in stores_trim()
+  g_mutex_lock ( &stores_mutex );
+  if ( stores ) {
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init ( &iter, stores );
+    while ( g_hash_table_iter_next(&iter, NULL, &value) ) {
+      TileStore *ts = value;
+      g_hash_table_iter_remove ( &iter );
+      // Any still in use get freed when released
+      if ( --ts->ref_count == 0 )
+        store_free ( ts );
+    }
+    g_hash_table_destroy ( stores );
+    stores = NULL;
+  }
+  g_mutex_unlock ( &stores_mutex );
+}
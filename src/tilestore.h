@@ -0,0 +1,49 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, Viking Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef _VIKING_TILESTORE_H
+#define _VIKING_TILESTORE_H
+
+#include <time.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Many tiles packed into a single file, rather than a file per tile.
+ * Each file holds the tiles of a square block (bucket) of a zoom level,
+ *  TILESTORE_BUCKET_SIZE tiles across (which also keeps each file well under 2GB).
+ *
+ * Tiles are identified by their x & y values within the file.
+ * Files are only expected to be written by a single Viking instance at a time.
+ */
+#define TILESTORE_BUCKET_SIZE 64
+
+gboolean a_tilestore_get_info ( const gchar *filename, gint x, gint y, time_t *mtime, gchar **etag );
+GBytes *a_tilestore_read ( const gchar *filename, gint x, gint y );
+gboolean a_tilestore_write ( const gchar *filename, gint x, gint y, GBytes *content, const gchar *etag );
+gboolean a_tilestore_touch ( const gchar *filename, gint x, gint y );
+gboolean a_tilestore_remove ( const gchar *filename, gint x, gint y );
+void a_tilestore_flush ( void );
+void a_tilestore_uninit ( void );
+
+G_END_DECLS
+
+#endif
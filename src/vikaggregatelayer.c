@@ -27,7 +27,10 @@
 #include "viktrwlayer_waypointlist.h"
 #include "viktrwlayer_export.h"
 #include "maputils.h"
+#include "mapcache.h"
+#include "map_ids.h"
 #include "background.h"
+#include "tileset.h"
 #include "gpx.h"
 #include "dir.h"
 #include "babel.h"
@@ -51,9 +54,15 @@ static void aggregate_layer_post_read ( VikAggregateLayer *val, VikViewport *vvp
 static gboolean aggregate_layer_selected_viewport_menu ( VikAggregateLayer *val, GdkEventButton *event, VikViewport *vvp );
 
 static void tac_calculate ( VikAggregateLayer *val );
+static TileSet *tac_tiles ( VikAggregateLayer *val );
+typedef struct _HeatmapIndex HeatmapIndex;
 static void hm_calculate ( VikAggregateLayer *val );
+static void hm_free_index ( VikAggregateLayer *val );
+static void hm_tiles_reset ( VikAggregateLayer *val );
+static void hm_draw ( VikAggregateLayer *val, VikViewport *vp );
 
 static gchar *params_tile_area_levels[] = { "18", "17", "16", "15", "14", "13", "12", "11", "10", "9", "8", "7", "6", "5", "4", NULL };
+#define TAC_NUM_LEVELS (G_N_ELEMENTS(params_tile_area_levels)-1)
 static gchar *params_tac_time_ranges[] = { N_("All Time"), "1", "2", "3", "5", "7", "10", "15", "20", "25", NULL };
 
 static VikLayerParamData tac_time_to_internal ( VikLayerParamData value )
@@ -337,42 +346,32 @@ struct _VikAggregateLayer {
   gint west_y;
 
   guint8 tac_time_range; // Years
-  // Maybe a sparse table would be more efficient
-  //  but this seems to work OK at least if all tracks are confined within a not too diverse area
-  GHashTable *tiles; // The current working set for calculating coverage
-  GHashTable *tiles_clust;
-
-  // Enable to determine changed tiles (mainly for those added rather than removed)
-  GHashTable *prev;
-  GHashTable *tiles_new;
-
-  // Cached results from previous calculations
-  //  keep a copy per area level to enable quick redraw of coverage
+  // Results from calculations per area level, to enable quick redraw of coverage
   //  especially useful for the calculations with the smallest (and hence more) tiles can take some time.
-  // ATM only just for basic area coverage.
+  // The one for the current area level is the working set for calculating coverage
+  // ATM only just for basic area coverage (and the contiguous labels)
   //  for other types cluster, square, etc... just have to wait for the recalculation to complete.
-  GHashTable *tiles_cached[G_N_ELEMENTS(params_tile_area_levels)];
+  TileSet *tiles_cached[TAC_NUM_LEVELS];
+  TileSet *tiles_clust;
+  // Enable to determine changed tiles (mainly for those added rather than removed)
+  TileSet *tiles_new;
+  // The tracks in the working set, so when the only change is more tracks
+  //  then just these need to be added rather than processing all of them again
+  GHashTable *tac_tracks; // Key: VikTrack* (a reference is held), Value: generation of the track
+  gboolean tac_valid; // Whether the working set is made from the tac_tracks
 
   // Heatmap
   gboolean hm_calculating;
-  // Values as at original request
-  guint hm_scale;
-  gint hm_zoom;
-  gint hm_width;
-  gint hm_height;
-  LatLonBBox hm_bbox;
-  const VikCoord *hm_center;
-  VikCoord hm_tl;
-  // Drawing values (zoom level may have changed)
-  gint hm_scaled_zoom;
-  gint hm_zoom_max;
   guint8 hm_alpha;
-  GdkPixbuf *hm_pixbuf;
-  GdkPixbuf *hm_pbf_scaled;
-  gboolean hm_scaled;
   guint8 hm_stamp_factor;
   guint8 hm_style;
   GdkColor hm_color;
+  // Index of all the trackpoints, from which the heatmap tiles are rendered on demand
+  HeatmapIndex *hm_index;
+  gchar *hm_name; // Identifies the tiles of the current index & settings in the mapcache
+  // The contribution of each track to the index,
+  //  so only changed tracks need to be processed on the next calculation
+  GHashTable *hm_tracks; // Key: VikTrack*, Value: HeatmapTrack*
 
   // General
   gboolean auto_load_external;
@@ -383,6 +382,10 @@ struct _VikAggregateLayer {
 // Single global
 static GHashTable *tiles_unreachable = NULL;
 
+// Outstanding heatmap tile renders, so each tile is only requested once
+static GHashTable *hm_requests = NULL;
+static GMutex hm_requests_mutex;
+
 static GdkColor black_color;
 
 static void aggregate_layer_class_init ( VikAggregateLayerClass *klass )
@@ -421,6 +424,8 @@ static void aggregate_layer_class_init ( VikAggregateLayerClass *klass )
   g_free ( fn );
 
   gdk_color_parse ( "#000000", &black_color );
+
+  hm_requests = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
 }
 
 void vik_aggregate_layer_uninit ()
@@ -503,12 +508,12 @@ const heatmap_colorscheme_t* hm_colorschemes[] =
     &d2, // Yellow/Orange/Red
   };
 
-// Ensure when 'apply' button heatmap regenerated to use new values
+// Ensure when 'apply' button heatmap tiles are regenerated to use new values
 static void hm_apply ( VikAggregateLayer *val )
 {
   if ( VIK_LAYER(val)->realized )
-    if ( !val->hm_calculating && val->hm_pixbuf )
-      hm_calculate ( val );
+    if ( val->hm_index )
+      hm_tiles_reset ( val );
 }
 
 static void tac_apply ( VikAggregateLayer *val, VikLayerSetParam *vlsp )
@@ -780,12 +785,12 @@ VikAggregateLayer *vik_aggregate_layer_new (VikViewport *vvp)
   vik_layer_set_type ( VIK_LAYER(val), VIK_LAYER_AGGREGATE );
   vik_layer_set_defaults ( VIK_LAYER(val), vvp );
   val->children = NULL;
-  val->tiles = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
-  val->tiles_clust = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
-  val->tiles_new = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
-  val->prev = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
-  for ( guint xx = 0; xx <= G_N_ELEMENTS(params_tile_area_levels); xx++ )
-    val->tiles_cached[xx] = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+  val->tiles_clust = tile_set_new ();
+  val->tiles_new = tile_set_new ();
+  for ( guint xx = 0; xx < TAC_NUM_LEVELS; xx++ )
+    val->tiles_cached[xx] = tile_set_new ();
+  val->tac_tracks = g_hash_table_new_full ( g_direct_hash, g_direct_equal, (GDestroyNotify)vik_track_free, NULL );
+  val->hm_tracks = g_hash_table_new ( g_direct_hash, g_direct_equal );
 
   return val;
 }
@@ -967,45 +972,6 @@ void vik_aggregate_layer_move_layer ( VikAggregateLayer *val, GtkTreeIter *child
     val->children = second;
 }
 
-static gboolean is_tile_occupied ( GHashTable *ght, gint x, gint y )
-{
-  gchar *key = g_strdup_printf ( "%d:%d", x, y );
-  gboolean ans = g_hash_table_contains ( ght, key );
-  g_free ( key );
-  return ans;
-}
-
-static guint tile_label ( GHashTable *ght, gint x, gint y )
-{
-  gchar *key = g_strdup_printf ( "%d:%d", x, y );
-  gpointer gp = g_hash_table_lookup ( ght, key );
-  g_free ( key );
-  if ( gp )
-    return GPOINTER_TO_UINT(gp);
-  else
-    return 0;
-}
-
-/**
- * is_cluster: returns whether a tile is surrounded by occupied tiles
- */
-static gboolean is_cluster ( GHashTable *val, gint x, gint y )
-{
-  //if ( !is_tile_occupied(val, x, y) ) return FALSE;
-  if ( !is_tile_occupied(val, x-1, y) ) return FALSE;
-  if ( !is_tile_occupied(val, x+1, y) ) return FALSE;
-
-  if ( !is_tile_occupied(val, x-1, y-1) ) return FALSE;
-  if ( !is_tile_occupied(val, x+1, y-1) ) return FALSE;
-  if ( !is_tile_occupied(val, x, y-1) ) return FALSE;
-
-  if ( !is_tile_occupied(val, x-1, y+1) ) return FALSE;
-  if ( !is_tile_occupied(val, x+1, y+1) ) return FALSE;
-  if ( !is_tile_occupied(val, x, y+1) ) return FALSE;
-
-  return TRUE;
-}
-
 static GdkPixbuf *setup_pixbuf ( GdkPixbuf *pixbuf, guint width, guint height )
 {
   if ( pixbuf )
@@ -1068,11 +1034,9 @@ static void tac_draw_section ( VikAggregateLayer *val, VikViewport *vvp, VikCoor
     map_utils_iTMS_to_center_vikcoord ( &ulm, &coord );
     vik_viewport_coord_to_screen ( vvp, &coord, &xx_tmp, &yy_tmp );
 
-    const guint zoom_index = 18 - map_utils_mpp_to_zoom_level ( val->zoom_level );
-    if ( zoom_index > G_N_ELEMENTS(params_tile_area_levels) ) {
-      g_warning ( "%s: zoom_index out of bounds (%d)", __FUNCTION__, zoom_index );
+    const TileSet *cached = tac_tiles ( val );
+    if ( !cached )
       return;
-    }
 
     // ceiled so tiles will be maximum size in the case of funky shrinkfactor
     const gint tilesize_ceil = ceil ( tilesize );
@@ -1119,7 +1083,7 @@ static void tac_draw_section ( VikAggregateLayer *val, VikViewport *vvp, VikCoor
         ulm.x = x;
         ulm.y = y;
 
-        if ( is_tile_occupied(val->tiles_cached[zoom_index], x, y) ) {
+        if ( tile_set_contains(cached, x, y) ) {
           //g_printf ( "%s1: %d, %d, %d, %d, %d, %d %0.2f\n", __FUNCTION__, xx, yy, tilesize_ceil, tilesize_ceil, width, height, shrinkfactor );
           if ( !is_big ) {
 
@@ -1133,12 +1097,13 @@ static void tac_draw_section ( VikAggregateLayer *val, VikViewport *vvp, VikCoor
 
             gdk_pixbuf_copy_area ( val->pixbuf[BASIC], 0, 0, sizex, sizey, val->full_pixbuf[BASIC], destx, desty );
 
-            if ( val->cont_label && (tile_label(val->tiles_cached[zoom_index], x, y) == val->cont_label) )
-              gdk_pixbuf_copy_area ( val->pixbuf[CONTIG], 0, 0, sizex, sizey, val->full_pixbuf[CONTIG], destx, desty );
+            if ( val->on[CONTIG] )
+              if ( val->cont_label && (tile_set_get_label(cached, x, y) == val->cont_label) )
+                gdk_pixbuf_copy_area ( val->pixbuf[CONTIG], 0, 0, sizex, sizey, val->full_pixbuf[CONTIG], destx, desty );
 
             // Cluster drawing
             if ( val->on[CLUSTER] )
-              if ( val->clust_label && (tile_label(val->tiles_clust, x, y) == val->clust_label) )
+              if ( val->clust_label && (tile_set_get_label(val->tiles_clust, x, y) == val->clust_label) )
                 gdk_pixbuf_copy_area ( val->pixbuf[CLUSTER], 0, 0, sizex, sizey, val->full_pixbuf[CLUSTER], destx, desty );
 
             // Max Square drawing
@@ -1151,17 +1116,17 @@ static void tac_draw_section ( VikAggregateLayer *val, VikViewport *vvp, VikCoor
             // Line of tiles drawing
             if ( val->on[LINES] && val->ns_size && val->ew_size ) {
               if ( x == val->ns_x ) {
-                if ( y <= val->ns_y && y >= val->ns_y-val->ns_size )
+                if ( y <= val->ns_y && y > val->ns_y-(gint)val->ns_size )
                   gdk_pixbuf_copy_area ( val->pixbuf[LINES], 0, 0, sizex, sizey, val->full_pixbuf[LINES], destx, desty );
               }
               if ( y == val->ew_y ) {
-                if ( x <= val->ew_x && x >= val->ew_x-val->ew_size )
+                if ( x <= val->ew_x && x > val->ew_x-(gint)val->ew_size )
                   gdk_pixbuf_copy_area ( val->pixbuf[LINES], 0, 0, sizex, sizey, val->full_pixbuf[LINES], destx, desty );
               }
             }
 
             if ( val->on[TNEW] )
-              if ( is_tile_occupied(val->tiles_new, x, y) ) {
+              if ( tile_set_contains(val->tiles_new, x, y) ) {
                 gdk_pixbuf_copy_area ( val->pixbuf[TNEW], 0, 0, sizex, sizey, val->full_pixbuf[TNEW], destx, desty );
               }
           } else {
@@ -1276,90 +1241,6 @@ static void tac_draw ( VikAggregateLayer *val, VikViewport *vp )
   tac_draw_section ( val, vp, &ul, &br );
 }
 
-/**
- * c.f. vik_viewport_coord_to_screen() but for a separately configurable zoom level & Mercator only
- */
-static void coord_to_screen ( gint width, gint height, gdouble mf, struct LatLon *center, VikCoord *coord, gint *xx, gint *yy )
-{
-  struct LatLon *ll = (struct LatLon *)coord;
-  *xx = (int)(width/2 + ( mf * (ll->lon - center->lon) ));
-  *yy = (int)(height/2 + ( mf * ( MERCLAT(center->lat) - MERCLAT(ll->lat) ) ));
-}
-
-/**
- *
- */
-static void hm_clear ( VikAggregateLayer *val )
-{
-  if ( val->hm_pixbuf )
-    g_object_unref ( val->hm_pixbuf );
-  if ( val->hm_pbf_scaled )
-    g_object_unref ( val->hm_pbf_scaled );
-  val->hm_pixbuf = NULL;
-  val->hm_pbf_scaled = NULL;
-}
-
-/**
- * Draw heatmap
- */
-static void hm_draw ( VikAggregateLayer *val, VikViewport *vp )
-{
-  LatLonBBox bbox = vik_viewport_get_bbox ( vp );
-
-  if ( BBOX_INTERSECT ( bbox, val->hm_bbox ) ) {
-
-    clock_t begin, end;
-
-    gint zz = (gint)vik_viewport_get_zoom ( vp );
-    // Avoid excessive image scaling as it will be too slow
-    //  (and memory intensive) so simply avoid trying.
-    if ( zz < val->hm_zoom_max ) {
-      return;
-    }
-
-    if ( val->hm_width != vik_viewport_get_width(vp) ||
-         val->hm_height != vik_viewport_get_height(vp) ) {
-      hm_clear ( val );
-      return;
-    }
-
-    // Calculate width & height (even if no scaling as not excessive computation)
-    gint ww = round (val->hm_width * (gdouble)val->hm_zoom/(gdouble)zz );
-    gint hh = round (val->hm_height * (gdouble)val->hm_zoom/(gdouble)zz );
-    // Scale only once as necessary when zoom level has changed
-    if ( val->hm_scaled_zoom != zz ) {
-      val->hm_scaled_zoom = zz;
-      // Different zoom level so generate new image from the original image
-      if ( val->hm_scaled_zoom != val->hm_zoom ) {
-        if ( val->hm_pbf_scaled )
-          g_object_unref ( val->hm_pbf_scaled );
-
-        val->hm_scaled = TRUE;
-        GdkInterpType interp_type = GDK_INTERP_BILINEAR;
-        // When scaling up: use the fastest method (as scaling up is much slower than scaling down)
-        //  especially since this is being performed in the main thread
-        if ( val->hm_scaled_zoom < val->hm_zoom )
-          interp_type = GDK_INTERP_NEAREST;
-        begin = clock();
-        val->hm_pbf_scaled = gdk_pixbuf_scale_simple ( val->hm_pixbuf, ww, hh, interp_type );
-        end = clock();
-        double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
-        // Last usable zoom-level as the next one is going to be an order of magnitude worse or more
-        if ( interp_type == GDK_INTERP_NEAREST && time_spent > 0.05 )
-          val->hm_zoom_max = zz;
-        g_debug ( "%s: time %f scaling to %d, %d", __FUNCTION__, time_spent, ww, hh );
-      } else {
-        // Use original image
-        val->hm_scaled = FALSE;
-      }
-    }
-    gint xx, yy;
-    gdouble mf = mercator_factor ( val->hm_scaled_zoom, val->hm_scale );
-    coord_to_screen ( val->hm_width, val->hm_height, mf, (struct LatLon*)val->hm_center, &val->hm_tl, &xx, &yy);
-    vik_viewport_draw_pixbuf ( vp, val->hm_scaled ? val->hm_pbf_scaled : val->hm_pixbuf, 0, 0, xx, yy, ww, hh );
-  }
-}
-
 /* Draw the aggregate layer.
  *  (And all layers within it)
  * Previously there was a concept of 'half drawn', an attempt to only draw layers necessary.
@@ -1380,7 +1261,8 @@ void vik_aggregate_layer_draw ( VikAggregateLayer *val, VikViewport *vp )
     tac_draw ( val, vp );
   }
 
-  if ( !val->hm_calculating && val->hm_pixbuf ) {
+  // Any previous heatmap remains whilst a new one is calculated
+  if ( val->hm_index ) {
     hm_draw ( val, vp );
   }
 }
@@ -1863,941 +1745,1343 @@ static void aggregate_layer_export_gpsbabel ( menu_array_values values )
 }
 
 /**
- *
+ * Current working set of tiles (for the current Tile Area Level)
  */
-static void add_tile_label ( GHashTable *ght, gint x, gint y, guint id )
+static TileSet *tac_tiles ( VikAggregateLayer *val )
 {
-  gchar *key = g_strdup_printf ( "%d:%d", x, y );
-  (void)g_hash_table_insert ( ght, key, GUINT_TO_POINTER(id) );
+  const guint zoom_index = 18 - map_utils_mpp_to_zoom_level ( val->zoom_level );
+  if ( zoom_index >= TAC_NUM_LEVELS ) {
+    g_warning ( "%s: zoom_index out of bounds (%d)", __FUNCTION__, zoom_index );
+    return NULL;
+  }
+  return val->tiles_cached[zoom_index];
 }
 
 /**
+ * Position of a coordinate in tiles of the zoom level, including the fraction within the tile
  *
+ * Returns: FALSE if not a usable position
  */
-static void add_tile ( GHashTable *ght, gint x, gint y )
+static gboolean tac_coord_to_tile ( const VikCoord *coord, gdouble zoom, gdouble *x, gdouble *y )
 {
-  add_tile_label ( ght, x, y, 0 );
+  struct LatLon ll;
+  vik_coord_to_latlon ( coord, &ll );
+  *x = (ll.lon + 180) / 360 * VIK_GZ(17) / zoom;
+  *y = (180 - MERCLAT(ll.lat)) / 360 * VIK_GZ(17) / zoom;
+  return isfinite(*x) && isfinite(*y) && *x >= 0 && *y >= 0;
 }
 
-/**
- *
- */
-static void check_point ( VikAggregateLayer *val, VikCoord *coord )
+static inline guint tac_add_tile ( TileSet *ts, TileSet *added, gint x, gint y )
 {
-  MapCoord mc;
-  gdouble zoom = val->zoom_level;
-  // Give up if can't convert - shouldn't happen
-  if ( !map_utils_vikcoord_to_iTMS(coord, zoom, zoom, &mc) ) {
-    g_warning ( "%s: %s", __FUNCTION__, "Failed to convert positions" );
-    return;
-  }
+  if ( x < 0 || y < 0 || !tile_set_add(ts, x, y) )
+    return 0;
+  if ( added )
+    (void)tile_set_add ( added, x, y );
+  return 1;
+}
 
-  if ( ! is_tile_occupied ( val->tiles, mc.x, mc.y ) ) {
-    add_tile ( val->tiles, mc.x, mc.y );
-    val->num_tiles[BASIC]++;
+// Beyond this many tiles apart, points are more likely to be a break in recording
+//  (e.g. a tunnel or the GPS turned off) rather than the path travelled
+#define TAC_MAX_GAP_TILES 32
 
-    // Monitor north/east/south/west extent here
-    if ( mc.y < val->north_y ) {
-      val->north_x = mc.x;
-      val->north_y = mc.y;
-    }
-    if ( mc.x > val->east_x ) {
-      val->east_x = mc.x;
-      val->east_y = mc.y;
-    }
-    if ( mc.y > val->south_y ) {
-      val->south_x = mc.x;
-      val->south_y = mc.y;
+/**
+ * Add all the tiles that the line between two points passes through,
+ *  by stepping across the tile boundaries in the order the line crosses them
+ *  (a Bresenham like grid traversal), so fast movement or sparse recording doesn't leave gaps
+ */
+static guint tac_add_line ( TileSet *ts, TileSet *added, gdouble x0, gdouble y0, gdouble x1, gdouble y1 )
+{
+  gint x = (gint)x0;
+  gint y = (gint)y0;
+  const gint xend = (gint)x1;
+  const gint yend = (gint)y1;
+  guint steps = abs(xend - x) + abs(yend - y);
+  if ( steps > TAC_MAX_GAP_TILES )
+    return tac_add_tile ( ts, added, xend, yend );
+
+  const gint xstep = (x1 > x0) ? 1 : -1;
+  const gint ystep = (y1 > y0) ? 1 : -1;
+  const gdouble dx = fabs ( x1 - x0 );
+  const gdouble dy = fabs ( y1 - y0 );
+  // Distance along the line (as a fraction of it) to the next tile boundary in each direction,
+  //  and then the distance between tile boundaries
+  gdouble xnext = (dx > 0) ? ((xstep > 0) ? (x + 1 - x0) : (x0 - x)) / dx : G_MAXDOUBLE;
+  gdouble ynext = (dy > 0) ? ((ystep > 0) ? (y + 1 - y0) : (y0 - y)) / dy : G_MAXDOUBLE;
+  const gdouble xdelta = (dx > 0) ? 1.0 / dx : G_MAXDOUBLE;
+  const gdouble ydelta = (dy > 0) ? 1.0 / dy : G_MAXDOUBLE;
+
+  guint count = tac_add_tile ( ts, added, x, y );
+  for ( guint ss = 0; ss < steps; ss++ ) {
+    if ( xnext < ynext ) {
+      x += xstep;
+      xnext += xdelta;
     }
-    if ( mc.x < val->west_x ) {
-      val->west_x = mc.x;
-      val->west_y = mc.y;
+    else {
+      y += ystep;
+      ynext += ydelta;
     }
+    count += tac_add_tile ( ts, added, x, y );
   }
+  return count;
 }
 
 /**
+ * Add the tiles a track covers - those of its trackpoints and the tiles in between them
+ *  Any newly added tiles are also put into @added when it is given
  *
+ * Returns: The number of newly added tiles
  */
-static void check_track ( VikAggregateLayer *val, vik_trw_and_track_t *vtlist )
-{
-  VikTrack *trk = vtlist->trk;
-  //g_debug ( "%s: %s", __FUNCTION__, trk->name );
-  guint no_times = 0;
-  GList *iter = trk->trackpoints;
-  while ( iter ) {
+static guint tac_track_tiles ( const VikTrack *trk, gdouble zoom, TileSet *ts, TileSet *added )
+{
+  guint count = 0;
+  gboolean joined = FALSE;
+  gdouble px = 0.0, py = 0.0;
+  for ( GList *iter = trk->trackpoints; iter; iter = iter->next ) {
+    const VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    gdouble x, y;
     // Only do trackpoints with timestamps
     // - i.e. hopefully to avoid artificial tracks
-    if ( !isnan(VIK_TRACKPOINT(iter->data)->timestamp) ) {
-      check_point ( val, &VIK_TRACKPOINT(iter->data)->coord );
+    if ( isnan(tp->timestamp) || !tac_coord_to_tile(&tp->coord, zoom, &x, &y) ) {
+      joined = FALSE;
+      continue;
     }
+    if ( joined && !tp->newsegment )
+      count += tac_add_line ( ts, added, px, py, x, y );
     else
-      no_times++;
-    iter = iter->next;
+      count += tac_add_tile ( ts, added, (gint)x, (gint)y );
+    px = x;
+    py = y;
+    joined = TRUE;
   }
-  // Handy to find out if your not expecting any of these
-  if ( no_times )
-    g_debug ( "%s: %d points encountered with no times", __FUNCTION__, no_times );
+  return count;
 }
 
+/*
+ * The coverage values worked out in the background,
+ *  only put into the layer once the calculation has completed
+ */
+typedef struct {
+  guint num_tiles[CP_NUM];
+  guint cont_label;
+  guint clust_label;
+  guint max_square;
+  gint xx,yy;
+  gint ns_x;
+  gint ns_y;
+  guint ns_size;
+  gint ew_x;
+  gint ew_y;
+  guint ew_size;
+  gint north_x;
+  gint north_y;
+  gint east_x;
+  gint east_y;
+  gint south_x;
+  gint south_y;
+  gint west_x;
+  gint west_y;
+} TACResultsT;
+
 typedef struct {
-  GList *tracks_and_layers;
   VikAggregateLayer *val;
-  guint num_of_tracks;
+  GPtrArray *tracks;     // #VikTrack to add - references are held
+  gdouble zoom_level;
+  guint zoom_index;
+  gboolean on[CP_NUM];   // Which coverage types to work out
+  gboolean adding;       // To the previous tiles
+  gboolean detect_new;
+  gboolean success;
+  TileSet *tiles;        // The working set - either the previous one to add to, or starting afresh
+  TileSet *prev;         // To determine new tiles when starting afresh
+  TileSet *tiles_clust;
+  TileSet *tiles_new;
+  TACResultsT res;       // Starts with the previous values, as not all are recalculated
 } CalculateThreadT;
 
-static void ct_free ( CalculateThreadT *ct )
+static void tac_results_get ( TACResultsT *res, const VikAggregateLayer *val )
+{
+  memcpy ( res->num_tiles, val->num_tiles, sizeof(res->num_tiles) );
+  res->cont_label = val->cont_label;
+  res->clust_label = val->clust_label;
+  res->max_square = val->max_square;
+  res->xx = val->xx;
+  res->yy = val->yy;
+  res->ns_x = val->ns_x;
+  res->ns_y = val->ns_y;
+  res->ns_size = val->ns_size;
+  res->ew_x = val->ew_x;
+  res->ew_y = val->ew_y;
+  res->ew_size = val->ew_size;
+  res->north_x = val->north_x;
+  res->north_y = val->north_y;
+  res->east_x = val->east_x;
+  res->east_y = val->east_y;
+  res->south_x = val->south_x;
+  res->south_y = val->south_y;
+  res->west_x = val->west_x;
+  res->west_y = val->west_y;
+}
+
+static void tac_results_set ( VikAggregateLayer *val, const TACResultsT *res )
+{
+  memcpy ( val->num_tiles, res->num_tiles, sizeof(val->num_tiles) );
+  val->cont_label = res->cont_label;
+  val->clust_label = res->clust_label;
+  val->max_square = res->max_square;
+  val->xx = res->xx;
+  val->yy = res->yy;
+  val->ns_x = res->ns_x;
+  val->ns_y = res->ns_y;
+  val->ns_size = res->ns_size;
+  val->ew_x = res->ew_x;
+  val->ew_y = res->ew_y;
+  val->ew_size = res->ew_size;
+  val->north_x = res->north_x;
+  val->north_y = res->north_y;
+  val->east_x = res->east_x;
+  val->east_y = res->east_y;
+  val->south_x = res->south_x;
+  val->south_y = res->south_y;
+  val->west_x = res->west_x;
+  val->west_y = res->west_y;
+}
+
+// Back in the main thread
+static gboolean tac_calc_done_idle ( CalculateThreadT *ct )
 {
-  ct->val->calculating = FALSE;
-  g_list_free_full ( ct->tracks_and_layers, g_free );
+  VikAggregateLayer *val = ct->val;
+  if ( ct->success ) {
+    tac_results_set ( val, &ct->res );
+    tile_set_free ( val->tiles_cached[ct->zoom_index] );
+    val->tiles_cached[ct->zoom_index] = ct->tiles;
+    tile_set_free ( val->tiles_clust );
+    val->tiles_clust = ct->tiles_clust;
+    tile_set_free ( val->tiles_new );
+    val->tiles_new = ct->tiles_new;
+    val->tac_valid = TRUE;
+  }
+  else {
+    tile_set_free ( ct->tiles );
+    tile_set_free ( ct->tiles_clust );
+    tile_set_free ( ct->tiles_new );
+    // The included tracks no longer match the tiles, so start again next time
+    g_hash_table_remove_all ( val->tac_tracks );
+    val->tac_valid = FALSE;
+  }
+  tile_set_free ( ct->prev );
+  g_ptr_array_free ( ct->tracks, TRUE );
+  val->calculating = FALSE;
   g_free ( ct );
-}
 
-static void ct_cancel ( CalculateThreadT *ct )
-{
-  // Draw as much as we have processed so far
-  vik_layer_emit_update ( VIK_LAYER(ct->val), FALSE ); // NB update display from background
+  vik_layer_emit_update ( VIK_LAYER(val), FALSE );
+  return FALSE;
 }
 
-// Since previous square should have been checked, only need to consider the next outer row+column
-//  rather than rechecking the contents of the whole square again
-//  this is obviously gets more efficient as the square that needs checking gets bigger
-static gboolean is_square_next ( VikAggregateLayer *val, gint x, gint y, guint n )
+static void ct_free ( CalculateThreadT *ct )
 {
-  gint tmpx = x;
-  gint tmpy = y + n - 1;
-  for ( tmpx = x; tmpx < (x + n); tmpx++ ) {
-    if ( ! is_tile_occupied(val->tiles, tmpx, tmpy) ) {
-      return FALSE;
-    }
-  }
-  tmpx = x + n - 1;
-  for ( gint tmpy = y; tmpy < (y + n); tmpy++ ) {
-    if ( ! is_tile_occupied(val->tiles, tmpx, tmpy) ) {
-      return FALSE;
-    }
-  }
-  // NB tile (tmpx+n-1, tmpy+n-1) gets checked twice, but this isn't too much of a waste
-  return TRUE;
+  // Tracks are released and the tiles are swapped over in the main thread
+  g_idle_add ( (GSourceFunc)tac_calc_done_idle, ct );
 }
 
-static gboolean is_square ( VikAggregateLayer *val, gint x, gint y, guint n )
+static void ct_cancel ( CalculateThreadT *ct )
 {
-  for ( gint tmpx = x; tmpx < (x + n); tmpx++ ) {
-     for ( gint tmpy = y; tmpy < (y + n); tmpy++ ) {
-       if ( ! is_tile_occupied(val->tiles, tmpx, tmpy) ) {
-         return FALSE;
-      }
-    }
-  }
-  return TRUE;
+  // Nothing to do - the previous coverage remains displayed
 }
 
-/*
- * Union Find stuff for labelling
- */
-
-/* The 'labels' array has the meaning that labels[x] is an alias for the label x; by
-   following this chain until x == labels[x], you can find the canonical name of an
-   equivalence class.  The labels start at one; labels[0] is a special value indicating
-   the highest label already used. */
-
-guint *labels;
-guint n_labels = 0; /* length of the labels array */
-
 /**
- * uf_find:
- *  returns the canonical label for the equivalence class containing x
+ * Insert unreachable tiles to pretend they have been visited
+ *  thus contributing to max squares, clusters and contiguous calculations
+ * NB: ATM this doesn't effect the numbers reported too much as it uses the
+ *  separate count 'num_tiles' rather than the number in the tile set
  */
-static guint uf_find ( guint x ) {
-  guint y = x;
-  while (labels[y] != y)
-    y = labels[y];
+static void tac_unreachable ( TileSet *ts, gdouble zoom_level )
+{
+  if ( !tiles_unreachable ) return;
 
-  while (labels[x] != x) {
-    guint z = labels[x];
-    labels[x] = y;
-    x = z;
-  }
-  return y;
-}
+  GHashTableIter iter;
+  gpointer key, value;
+  gint z,x,y;
 
-/**
- * uf_union:
- *   joins two equivalence classes and returns the canonical label of the resulting class.
- */
-static guint uf_union ( guint x, guint y ) {
-  return labels[uf_find(x)] = uf_find(y);
-}
+  guint zoom = (guint)map_utils_mpp_to_zoom_level(zoom_level);
 
-/**
- * uf_make_set:
- *  creates a new equivalence class and returns its label
- */
-static guint uf_make_set(void) {
-  labels[0]++;
-  labels[labels[0]] = labels[0];
-  return labels[0];
+  g_hash_table_iter_init ( &iter, tiles_unreachable );
+  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
+    (void)sscanf ( key, "%d %d %d", &z, &x, &y );
+    if ( z == zoom && x >= 0 && y >= 0 )
+      (void)tile_set_add ( ts, x, y );
+  }
 }
 
 /**
- * uf_init:
- *   Allocate array for potential labels
+ * Simple extents North/East/South/West
  */
-static void uf_init ( guint max_labels ) {
-  n_labels = max_labels;
-  labels = g_malloc0_n ( sizeof(guint), n_labels );
-  labels[0] = 0;
+static void tac_extents_calc ( TACResultsT *res, const TileSet *ts )
+{
+  gint x, y;
+  gboolean first = TRUE;
+  TileSetIter iter;
+  tile_set_iter_init ( &iter, ts );
+  while ( tile_set_iter_next ( &iter, &x, &y ) ) {
+    if ( first || y < res->north_y ) {
+      res->north_x = x;
+      res->north_y = y;
+    }
+    if ( first || x > res->east_x ) {
+      res->east_x = x;
+      res->east_y = y;
+    }
+    if ( first || y > res->south_y ) {
+      res->south_x = x;
+      res->south_y = y;
+    }
+    if ( first || x < res->west_x ) {
+      res->west_x = x;
+      res->west_y = y;
+    }
+    first = FALSE;
+  }
 }
 
 /**
- * uf_finish: clean up
+ * Add the tracks to the working set of tiles and then work out the coverage types
  */
-static void uf_finish ( void ) {
-  n_labels = 0;
-  g_free ( labels );
-  labels = NULL;
-}
-
-// NB ATM This only tracks one such area
-//  (there might be multiple such areas)
-static void tac_contiguous_calc ( VikAggregateLayer *val )
+static gint tac_calculate_thread ( CalculateThreadT *ct, gpointer threaddata )
 {
-  clock_t begin = clock();
-
-  GHashTableIter iter;
-  gpointer key, value;
-  gint x,y;
-  gint tlx=G_MAXINT,tly=G_MAXINT,brx=-G_MAXINT,bry=-G_MAXINT;
+  const gint64 begin = g_get_monotonic_time ();
+  TACResultsT *res = &ct->res;
 
-  // Get grid extents
-  g_hash_table_iter_init ( &iter, val->tiles );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-    (void)sscanf ( key, "%d:%d", &x, &y );
-    if ( x < tlx ) tlx = x;
-    if ( x > brx ) brx = x;
-    if ( y < tly ) tly = y;
-    if ( y > bry ) bry = y;
-  }
+  // Only collect new tiles as they are added when adding to the previous tiles
+  TileSet *added = ( ct->detect_new && ct->adding ) ? ct->tiles_new : NULL;
+  guint count = 0;
 
-  // Process the grid according to 'labelling clusters on a grid'
-  // https://en.wikipedia.org/wiki/Hoshen%E2%80%93Kopelman_algorithm
-  guint size = (abs(tlx-brx) * abs(tly-bry)) / 2;
-  if ( size == 0 )
-    return;
+  guint tracks_processed = 0;
+  // This is used to prevent the progress going negative or otherwise over 100%
+  // It's difficult to get an estimate for the total and track progress of each of these parts
+  //  and then combine it in a coherent single thread progress meter.
+  // So for simplicity they are considered the same as processing one extra track each
+  const guint extras = ct->on[MAX_SQR] + ct->on[CONTIG] + ct->on[CLUSTER] + ct->on[LINES];
+  const guint total = ct->tracks->len + extras;
 
-  uf_init ( size );
+  for ( guint ii = 0; ii < ct->tracks->len; ii++ ) {
+    gdouble percent = (gdouble)tracks_processed/(gdouble)total;
+    gint res = a_background_thread_progress ( threaddata, percent );
+    if ( res != 0 ) return -1;
 
-  for ( gint xx = tlx; xx <= brx; xx++ ) {
-    for ( gint yy = tly; yy <= bry; yy++ ) {
-      if ( is_tile_occupied(val->tiles, xx, yy) ) {
-        guint label_up = tile_label (val->tiles, xx-1, yy ); // NB don't have to worry about -1 going out of bounds
-        guint label_left = tile_label (val->tiles, xx, yy-1 );
-        switch ( !!label_up + !!label_left ) {
-        case 0: // New
-          add_tile_label ( val->tiles, xx, yy, uf_make_set() );
-          break;
-        case 1: // Existing
-          add_tile_label ( val->tiles, xx, yy, MAX(label_up, label_left) );
-          break;
-        case 2: // Bind existing
-          add_tile_label ( val->tiles, xx, yy, uf_union(label_up, label_left) );
-          break;
-        default: // Should not happen
-          g_critical ("%s: labelling algorithm broken", __FUNCTION__);
-          break;
-        }
-      }
-    }
+    count += tac_track_tiles ( g_ptr_array_index(ct->tracks, ii), ct->zoom_level, ct->tiles, added );
+    tracks_processed++;
   }
+  // Continuing from the previous count when only adding tracks
+  if ( ct->adding )
+    res->num_tiles[BASIC] += count;
+  else
+    res->num_tiles[BASIC] = count;
 
-  // Reprocess the grid to compare the size of the labels
-  int *new_labels = g_malloc0_n ( sizeof(int), n_labels ); // allocate array, initialized to zero
-  int *sizes = g_malloc0_n ( sizeof(int), n_labels ); // allocate array, initialized to zero
-
-  for ( gint xx = tlx; xx <= brx; xx++ ) {
-    for ( gint yy = tly; yy <= bry; yy++ ) {
-      if ( is_tile_occupied(val->tiles, xx, yy) ) {
-        gint ll = uf_find(tile_label (val->tiles, xx, yy));
-        if (new_labels[ll] == 0) {
-          new_labels[0]++;
-          new_labels[ll] = new_labels[0];
-        }
-        sizes[new_labels[ll]]++;
-        add_tile_label ( val->tiles, xx, yy, new_labels[ll] );
-      }
-    }
-  }
-  gint total_clusters = new_labels[0];
+  tac_extents_calc ( res, ct->tiles );
 
-  guint largist = 0;
-  for ( guint ss = 1; ss < n_labels; ss++ ) {
-    if ( sizes[ss] > largist ) {
-      largist = sizes[ss];
-      val->cont_label = ss;
-      val->num_tiles[CONTIG] = largist;
-    }
+  if ( ct->prev ) {
+    // Determine difference in latest tiles vs prev
+    gint x, y;
+    TileSetIter iter;
+    tile_set_iter_init ( &iter, ct->tiles );
+    while ( tile_set_iter_next ( &iter, &x, &y ) )
+      if ( !tile_set_contains ( ct->prev, x, y ) )
+        (void)tile_set_add ( ct->tiles_new, x, y );
   }
-  g_free ( new_labels );
-  g_free ( sizes );
-  uf_finish();
+  res->num_tiles[TNEW] = tile_set_size ( ct->tiles_new );
 
-  clock_t end = clock();
-  double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
-  g_debug ( "%s: %f %d %d %d", __FUNCTION__, time_spent, total_clusters, largist, val->cont_label );
-}
+  if ( ct->on[MAX_SQR] ) {
+    gdouble percent = (gdouble)tracks_processed++/(gdouble)total;
+    if ( a_background_thread_progress ( threaddata, percent ) ) return -1;
 
-// NB ATM This only tracks one such area
-//  (there might be multiple such areas)
-static void tac_cluster_calc ( VikAggregateLayer *val )
-{
-  clock_t begin = clock();
+    res->max_square = tile_set_max_square ( ct->tiles, &res->xx, &res->yy );
+    g_debug ( "%s: max square %d at %d:%d", __FUNCTION__, res->max_square, res->xx, res->yy );
+  }
+  else
+    res->max_square = 0;
 
-  GHashTableIter iter;
-  gpointer key, value;
-  gint x,y;
+  if ( ct->on[CONTIG] ) {
+    gdouble percent = (gdouble)tracks_processed++/(gdouble)total;
+    if ( a_background_thread_progress ( threaddata, percent ) ) return -1;
 
-  g_hash_table_iter_init ( &iter, val->tiles );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-    (void)sscanf ( key, "%d:%d", &x, &y );
-    if ( is_cluster(val->tiles, x, y) ) {
-      // Make new hashtable from just the tiles that are in a cluster
-      add_tile ( val->tiles_clust, x, y );
-      val->num_tiles[CLUSTER]++;
-    }
+    guint regions = tile_set_label_regions ( ct->tiles, &res->cont_label, &res->num_tiles[CONTIG] );
+    g_debug ( "%s: contiguous %d %d %d", __FUNCTION__, regions, res->num_tiles[CONTIG], res->cont_label );
   }
+  else
+    res->cont_label = 0;
 
-  gint tlx=G_MAXINT,tly=G_MAXINT,brx=-G_MAXINT,bry=-G_MAXINT;
+  if ( ct->on[CLUSTER] ) {
+    gdouble percent = (gdouble)tracks_processed++/(gdouble)total;
+    if ( a_background_thread_progress ( threaddata, percent ) ) return -1;
 
-  // Get grid extents
-  g_hash_table_iter_init ( &iter, val->tiles_clust );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-    (void)sscanf ( key, "%d:%d", &x, &y );
-    if ( x < tlx ) tlx = x;
-    if ( x > brx ) brx = x;
-    if ( y < tly ) tly = y;
-    if ( y > bry ) bry = y;
+    // The tiles that are surrounded by occupied tiles, and then the biggest group of these
+    ct->tiles_clust = tile_set_surrounded ( ct->tiles );
+    guint regions = tile_set_label_regions ( ct->tiles_clust, &res->clust_label, &res->num_tiles[CLUSTER] );
+    g_debug ( "%s: clusters %d %d %d", __FUNCTION__, regions, res->num_tiles[CLUSTER], res->clust_label );
   }
+  else
+    res->clust_label = 0;
 
-  guint size = (abs(tlx-brx) * abs(tly-bry)) / 2;
-  if ( size == 0 )
-    return;
-
-  uf_init ( size );
+  if ( ct->on[LINES] ) {
+    gdouble percent = (gdouble)tracks_processed++/(gdouble)total;
+    if ( a_background_thread_progress ( threaddata, percent ) ) return -1;
 
-  for ( gint xx = tlx; xx <= brx; xx++ ) {
-    for ( gint yy = tly; yy <= bry; yy++ ) {
-      if ( is_tile_occupied(val->tiles_clust, xx, yy) ) {
-        guint label_up = tile_label (val->tiles_clust, xx-1, yy ); // NB don't have to worry about -1 going out of bounds
-        guint label_left = tile_label (val->tiles_clust, xx, yy-1 );
-        switch ( !!label_up + !!label_left ) {
-        case 0: // New
-          add_tile_label ( val->tiles_clust, xx, yy, uf_make_set() );
-          break;
-        case 1: // Existing
-          add_tile_label ( val->tiles_clust, xx, yy, MAX(label_up, label_left) );
-          break;
-        case 2: // Bind existing
-          add_tile_label ( val->tiles_clust, xx, yy, uf_union(label_up, label_left) );
-          break;
-        default: // Should not happen
-          g_critical ("%s: labelling algorithm broken", __FUNCTION__);
-          break;
-        }
-      }
-    }
+    tile_set_longest_lines ( ct->tiles, &res->ns_size, &res->ns_x, &res->ns_y, &res->ew_size, &res->ew_x, &res->ew_y );
+    g_debug ( "%s: ns_x %d, ns_y %d, ns_size %d | ew_x %d, ew_y %d, ew_size %d:",
+              __FUNCTION__, res->ns_x, res->ns_y, res->ns_size, res->ew_x, res->ew_y, res->ew_size );
   }
+  else
+    res->ns_size = res->ew_size = 0;
 
-  // Reprocess the grid to compare the size of the labels
-  int *new_labels = g_malloc0_n ( sizeof(int), n_labels ); // allocate array, initialized to zero
-  int *sizes = g_malloc0_n ( sizeof(int), n_labels ); // allocate array, initialized to zero
+  if ( !ct->tiles_clust )
+    ct->tiles_clust = tile_set_new ();
+  ct->success = TRUE;
 
-  for ( gint xx = tlx; xx <= brx; xx++ ) {
-    for ( gint yy = tly; yy <= bry; yy++ ) {
-      if ( is_tile_occupied(val->tiles_clust, xx, yy) ) {
-        gint ll = uf_find(tile_label (val->tiles_clust, xx, yy));
-        if (new_labels[ll] == 0) {
-          new_labels[0]++;
-          new_labels[ll] = new_labels[0];
-        }
-        sizes[new_labels[ll]]++;
-        add_tile_label ( val->tiles_clust, xx, yy, new_labels[ll] );
-      }
-    }
-  }
-  gint total_clusters = new_labels[0];
+  // Timing for all tile calcs
+  g_debug ( "%s: %d tracks, %d tiles in %.3f seconds", __FUNCTION__, ct->tracks->len,
+            tile_set_size(ct->tiles), (gdouble)(g_get_monotonic_time()-begin)/G_USEC_PER_SEC );
 
-  guint largist = 0;
-  for ( guint ss = 1; ss < n_labels; ss++ ) {
-    if ( sizes[ss] > largist ) {
-      largist = sizes[ss];
-      val->clust_label = ss;
-      val->num_tiles[CLUSTER] = largist;
-    }
+  return 0;
+}
+
+/**
+ *
+ */
+static void tac_clear ( VikAggregateLayer *val )
+{
+  val->max_square = 0;
+  for (gint x = 0; x<CP_NUM; x++ ) {
+    val->num_tiles[x] = 0;
   }
-  g_free ( new_labels );
-  g_free ( sizes );
-  uf_finish();
+  val->cont_label = 0;
+  val->clust_label = 0;
+  tile_set_clear ( val->tiles_clust );
+  tile_set_clear ( val->tiles_new );
+  val->ns_size = 0;
+  val->ew_size = 0;
+  // NB North/East/South/West extents only done on calculation with a position
+  // as setting to map x/y tile of 0s not useful
 
-  clock_t end = clock();
-  double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
-  g_debug ( "%s: %f %d %d %d", __FUNCTION__, time_spent, total_clusters, largist, val->clust_label );
+  for ( guint xx = 0; xx < TAC_NUM_LEVELS; xx++ )
+    tile_set_clear ( val->tiles_cached[xx] );
+  g_hash_table_remove_all ( val->tac_tracks );
+  val->tac_valid = FALSE;
 }
 
-
-// NB ATM This only tracks one square
-//  (there might be multiple such squares)
-static void tac_square_calc ( VikAggregateLayer *val )
+/**
+ * Whether the track is included for the time range
+ */
+static gboolean tac_track_in_range ( VikAggregateLayer *val, VikTrack *trk, GDate *now )
 {
-  val->max_square = 1;
-  clock_t begin = clock();
-
-  GHashTableIter iter;
-  gpointer key, value;
-  gint x,y;
+  if ( !val->tac_time_range )
+    // All
+    return TRUE;
 
-  g_hash_table_iter_init ( &iter, val->tiles );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-    (void)sscanf ( key, "%d:%d", &x, &y );
-    if ( is_square(val, x, y, val->max_square) ) {
-      g_debug ( "%s: is_square %d at %d:%d", __FUNCTION__, val->max_square, x, y );
-      val->xx = x;
-      val->yy = y;
-      val->max_square++;
-      gboolean do_again = FALSE;
-      do {
-        do_again = FALSE;
-        if ( is_square_next(val, x, y, val->max_square) ) {
-          g_debug ( "%s: is_square_next %d at %d:%d", __FUNCTION__, val->max_square, x, y );
-          do_again = TRUE;
-          val->max_square++;
-        }
-      } while ( do_again );
-    }
-  }
-  val->max_square--;
+  // Only those within specified time period
+  VikTrackpoint *tpt = vik_track_get_tp_first ( trk );
+  if ( !tpt || isnan(tpt->timestamp) )
+    return FALSE;
 
-  clock_t end = clock();
-  double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
-  g_debug ( "%s: %f", __FUNCTION__, time_spent );
+  GDate* gdate = g_date_new ();
+  g_date_set_time_t ( gdate, (time_t)tpt->timestamp );
+  gint diff = g_date_days_between ( gdate, now );
+  g_date_free ( gdate );
+  // NB this doesn't get the year date range exact
+  //  however this generally should be good/close enough for practical purposes
+  return ( diff > 0 && diff < (365.25*val->tac_time_range) );
 }
 
 /**
- * Finds biggest line of tiles, both vertically and horizontally
+ * Start (re)calculating the coverage.
+ * When the only change since the previous calculation is additional tracks,
+ *  then just these tracks are added to the previous tiles.
+ * Otherwise all the tracks are processed again.
  */
-static void tac_lines_calc ( VikAggregateLayer *val )
+static void tac_calculate ( VikAggregateLayer *val )
 {
-  clock_t begin = clock();
-
-  GHashTableIter iter;
-  gpointer key, value;
-  gint x,y;
-  gint tlx=G_MAXINT,tly=G_MAXINT,brx=-G_MAXINT,bry=-G_MAXINT;
+  val->calculating = TRUE;
+  val->num_calcs++;
 
-  // Get extents of tile coverage
-  g_hash_table_iter_init ( &iter, val->tiles );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-    (void)sscanf ( key, "%d:%d", &x, &y );
-    if ( x < tlx ) tlx = x;
-    if ( x > brx ) brx = x;
-    if ( y < tly ) tly = y;
-    if ( y > bry ) bry = y;
-  }
-
-  // Simple brute force method
-  // Detects the first instance of the biggest consective run of tiles
-  //  in both vertical and horizontal directions
-  guint crt_sz = 0;
-
-  // North/South passage...
-  for ( gint xx = tlx; xx <= brx; xx++ ) {
-    gint yy;
-    for ( yy = tly ; yy <= bry; yy++ ) {
-      if ( is_tile_occupied(val->tiles, xx, yy) )
-        crt_sz++;
-      else {
-        if ( crt_sz > val->ns_size ) {
-          val->ns_size = crt_sz;
-          val->ns_x = xx;
-          val->ns_y = yy-1;
-        }
-        crt_sz = 0;
+  CalculateThreadT *ct = g_malloc0 ( sizeof(CalculateThreadT) );
+  ct->val = val;
+  ct->tracks = g_ptr_array_new_with_free_func ( (GDestroyNotify)vik_track_free );
+  ct->zoom_level = val->zoom_level;
+  ct->zoom_index = 18 - map_utils_mpp_to_zoom_level ( val->zoom_level );
+  memcpy ( ct->on, val->on, sizeof(ct->on) );
+  tac_results_get ( &ct->res, val );
+  if ( ct->zoom_index >= TAC_NUM_LEVELS ) {
+    g_warning ( "%s: zoom_index out of bounds (%d)", __FUNCTION__, ct->zoom_index );
+    (void)tac_calc_done_idle ( ct );
+    return;
+  }
+
+  // Don't try to find new ones when the zoom level has changed
+  val->zoom_level_chgd = (val->zoom_level_prev != val->zoom_level);
+  if ( val->zoom_level_chgd )
+    val->zoom_level_prev = val->zoom_level;
+
+  GDate *now = g_date_new ();
+  g_date_set_time_t ( now, time(NULL) );
+
+  // Work out which tracks are new, or otherwise whether any have changed or been removed
+  gboolean only_added = val->tac_valid && !val->zoom_level_chgd;
+  GHashTable *current = g_hash_table_new ( g_direct_hash, g_direct_equal );
+  GList *layers = NULL;
+  layers = vik_aggregate_layer_get_all_layers_of_type ( val, layers, VIK_LAYER_TRW, TRUE );
+  for ( GList *layer = layers; layer != NULL; layer = layer->next ) {
+    GList *tracks = g_hash_table_get_values ( vik_trw_layer_get_tracks( VIK_TRW_LAYER(layer->data) ) );
+    for ( GList *iter = tracks; iter != NULL; iter = iter->next ) {
+      VikTrack *trk = VIK_TRACK(iter->data);
+      if ( !tac_track_in_range ( val, trk, now ) )
+        continue;
+      g_hash_table_add ( current, trk );
+      gpointer generation;
+      if ( g_hash_table_lookup_extended ( val->tac_tracks, trk, NULL, &generation ) ) {
+        if ( GPOINTER_TO_UINT(generation) == vik_track_get_generation(trk) )
+          continue;
+        only_added = FALSE;
       }
+      vik_track_ref ( trk );
+      g_hash_table_insert ( val->tac_tracks, trk, GUINT_TO_POINTER(vik_track_get_generation(trk)) );
+      vik_track_ref ( trk );
+      g_ptr_array_add ( ct->tracks, trk );
     }
-    // Detect finish at edge of extents
-    if ( crt_sz > val->ns_size ) {
-      val->ns_size = crt_sz;
-      val->ns_x = xx;
-      val->ns_y = yy;
-    }
-    // Reset for next line
-    crt_sz = 0;
-  }
-
-  crt_sz = 0;
-  // East/West passage...
-  for ( gint yy = tly; yy <= bry; yy++ ) {
-    gint xx;
-    for ( xx = tlx; xx <= brx; xx++ ) {
-      if ( is_tile_occupied(val->tiles, xx, yy) )
-        crt_sz++;
-      else {
-        if ( crt_sz > val->ew_size ) {
-          val->ew_size = crt_sz;
-          val->ew_x = xx-1;
-          val->ew_y = yy;
-        }
-        crt_sz = 0;
-      }
+    g_list_free ( tracks );
+  }
+  g_list_free ( layers );
+  g_date_free ( now );
+
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, val->tac_tracks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    if ( !g_hash_table_contains ( current, key ) ) {
+      g_hash_table_iter_remove ( &iter );
+      only_added = FALSE;
     }
-    // Detect finish at edge of extents
-    if ( crt_sz > val->ew_size ) {
-      val->ew_size = crt_sz;
-      val->ew_x = xx;
-      val->ew_y = yy;
+  }
+  g_hash_table_destroy ( current );
+
+  // Otherwise all the tracks need processing
+  if ( !only_added ) {
+    g_ptr_array_set_size ( ct->tracks, 0 );
+    g_hash_table_iter_init ( &iter, val->tac_tracks );
+    while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+      vik_track_ref ( VIK_TRACK(key) );
+      g_ptr_array_add ( ct->tracks, key );
     }
-    // Reset for next line
-    crt_sz = 0;
+  }
+  ct->adding = only_added;
+
+  // Only if there's something before then 'turn on' detection of new tiles...
+  //  (too otherwise avoid marking everything new on first time calculation
+  //   on particularly initial file loads)
+  //  and discount the number of unreachable tiles
+  guint sz = 0;
+  if ( tiles_unreachable )
+    sz = g_hash_table_size ( tiles_unreachable );
+  ct->detect_new = val->on[TNEW] && (val->num_tiles[BASIC] > sz) && !val->zoom_level_chgd;
+  if ( ct->detect_new )
+    for ( gint x = 0; x<CP_NUM; x++ )
+      val->num_prev[x] = val->num_tiles[x];
+
+  val->max_square_prev = val->max_square;
+  val->ns_size_prev = val->ns_size;
+  val->ew_size_prev = val->ew_size;
+
+  ct->tiles_new = tile_set_new ();
+  if ( ct->adding )
+    ct->tiles = tile_set_copy ( val->tiles_cached[ct->zoom_index] );
+  else {
+    if ( ct->detect_new )
+      ct->prev = tile_set_copy ( val->tiles_cached[ct->zoom_index] );
+    ct->tiles = tile_set_new ();
+    tac_unreachable ( ct->tiles, ct->zoom_level );
   }
 
-  g_debug ( "%s: ns_x %d, ns_y %d, ns_size %d | ew_x %d, ew_y %d, ew_size %d:",
-            __FUNCTION__, val->ns_x, val->ns_y, val->ns_size, val->ew_x, val->ew_y, val->ew_size );
+  guint extras = val->on[MAX_SQR] + val->on[CONTIG] + val->on[CLUSTER] + val->on[LINES];
 
-  clock_t end = clock();
-  double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
-  g_debug ( "%s: %f", __FUNCTION__, time_spent );
+  a_background_thread ( BACKGROUND_POOL_LOCAL,
+                        VIK_GTK_WINDOW_FROM_LAYER(val),
+                        _("Track Area Coverage"),
+                        (vik_thr_func)tac_calculate_thread,
+                        ct,
+                        (vik_thr_free_func)ct_free,
+                        (vik_thr_free_func)ct_cancel,
+                        ct->tracks->len + extras );
 }
 
-/**
- * Insert unreachable tiles to pretend they have been visited
- *  thus contributing to max squares, clusters and contiguous calculations
- * NB: ATM this doesn't effect the numbers reported too much as it uses the
- *  separate count 'num_tiles' rather than the number in the hash table
+static void rhomboidal (float *values, unsigned d, unsigned r)
+{
+  for (guint y = 0 ; y < d ; ++y) {
+    for (guint x = 0 ; x < d ; ++x) {
+      values[y*d+x] = 1.0 - fmin(1.0, (float)(labs(x-(long)r)+labs(y-(long)r))/(r+1));
+    }
+  }
+}
+
+/*
+ * The heatmap is a pyramid of Web Mercator tiles, rendered on demand in the background into the mapcache.
+ *
+ * To render any tile at any zoom level quickly, all the trackpoints are indexed by their position in the world
+ *  as 64 bit Morton (Z-order) keys of the interleaved x & y bits.
+ * Once sorted the trackpoints of any tile are then a contiguous range of the keys.
  */
-static void tac_unreachable ( VikAggregateLayer *val )
+#define HM_KEY_BITS 31  // Per axis
+#define HM_TILE_BITS 8  // 256 pixel tiles
+#define HM_TILE_SIZE (1<<HM_TILE_BITS)
+// Deepest zoom level that the map utils can convert (and thus is within HM_KEY_BITS-HM_TILE_BITS)
+#define HM_MAX_ZOOM 22
+
+// Spread the lower 32 bits into the even bits
+static guint64 hm_spread_bits ( guint64 vv )
 {
-  if ( !tiles_unreachable ) return;
+  vv &= G_GUINT64_CONSTANT(0x00000000ffffffff);
+  vv = (vv | (vv << 16)) & G_GUINT64_CONSTANT(0x0000ffff0000ffff);
+  vv = (vv | (vv << 8))  & G_GUINT64_CONSTANT(0x00ff00ff00ff00ff);
+  vv = (vv | (vv << 4))  & G_GUINT64_CONSTANT(0x0f0f0f0f0f0f0f0f);
+  vv = (vv | (vv << 2))  & G_GUINT64_CONSTANT(0x3333333333333333);
+  vv = (vv | (vv << 1))  & G_GUINT64_CONSTANT(0x5555555555555555);
+  return vv;
+}
 
-  GHashTableIter iter;
-  gpointer key, value;
-  gint z,x,y;
+// Gather the even bits, i.e. the reverse of hm_spread_bits()
+static guint32 hm_compact_bits ( guint64 vv )
+{
+  vv &= G_GUINT64_CONSTANT(0x5555555555555555);
+  vv = (vv | (vv >> 1))  & G_GUINT64_CONSTANT(0x3333333333333333);
+  vv = (vv | (vv >> 2))  & G_GUINT64_CONSTANT(0x0f0f0f0f0f0f0f0f);
+  vv = (vv | (vv >> 4))  & G_GUINT64_CONSTANT(0x00ff00ff00ff00ff);
+  vv = (vv | (vv >> 8))  & G_GUINT64_CONSTANT(0x0000ffff0000ffff);
+  vv = (vv | (vv >> 16)) & G_GUINT64_CONSTANT(0x00000000ffffffff);
+  return (guint32)vv;
+}
 
-  guint zoom = (guint)map_utils_mpp_to_zoom_level(val->zoom_level);
+static inline guint64 hm_key ( guint32 xx, guint32 yy )
+{
+  return hm_spread_bits ( xx ) | (hm_spread_bits ( yy ) << 1);
+}
 
-  g_hash_table_iter_init ( &iter, tiles_unreachable );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-    (void)sscanf ( key, "%d %d %d", &z, &x, &y );
-    if ( z == zoom )
-      add_tile ( val->tiles, x, y );
-  }
+static gint hm_key_compare ( gconstpointer aa, gconstpointer bb )
+{
+  guint64 ka = *(const guint64*)aa;
+  guint64 kb = *(const guint64*)bb;
+  return (ka > kb) - (ka < kb);
 }
 
-// Fwd declaration
-static void tac_clear ( VikAggregateLayer *val, gboolean full );
+/**
+ * Position in the Web Mercator world, in units of HM_KEY_BITS
+ *  (i.e. the pixel position at zoom level HM_KEY_BITS-HM_TILE_BITS)
+ */
+static void hm_coord_to_world ( const VikCoord *coord, guint32 *xx, guint32 *yy )
+{
+  struct LatLon ll;
+  vik_coord_to_latlon ( coord, &ll );
+  const gdouble size = (gdouble)(1u << HM_KEY_BITS);
+  gdouble wx = (ll.lon + 180.0) / 360.0 * size;
+  gdouble wy = (180.0 - MERCLAT(ll.lat)) / 360.0 * size;
+  *xx = (guint32)CLAMP ( wx, 0.0, size-1.0 );
+  *yy = (guint32)CLAMP ( wy, 0.0, size-1.0 );
+}
 
 /**
- *
+ * Nearest zoom level of tiles for the viewport's 'mpp'
  */
-static gint tac_calculate_thread ( CalculateThreadT *ct, gpointer threaddata )
+static guint hm_zoom_for_mpp ( gdouble mpp )
 {
-  clock_t begin = clock();
+  gint zoom = (gint)round ( 17.0 - log2(mpp) );
+  return CLAMP ( zoom, 0, HM_MAX_ZOOM );
+}
 
-  g_hash_table_remove_all ( ct->val->prev );
-  g_hash_table_remove_all ( ct->val->tiles_new );
-  ct->val->num_tiles[TNEW] = 0;
+static guint hm_stamp_radius ( guint8 factor, guint zoom )
+{
+  // Stamp size is relative to the zoom level, but only reaches into the neighbouring tiles
+  guint radius = zoom * (gdouble)factor / (gdouble)width_default().u;
+  return CLAMP ( radius, 1, HM_TILE_SIZE-1 );
+}
 
-  // Only if there's something before then 'turn on' detection of new tiles...
-  //  (too otherwise avoid marking everything new on first time calculation
-  //   on particularly initial file loads)
-  // Also don't try to find new ones when the zoom level has changed
-  //  and discount the number of unreachable tiles
-  ct->val->zoom_level_chgd = (ct->val->zoom_level_prev != ct->val->zoom_level);
-  if ( ct->val->zoom_level_chgd )
-    ct->val->zoom_level_prev = ct->val->zoom_level;
-  guint sz = 0;
-  if ( tiles_unreachable )
-    sz = g_hash_table_size ( tiles_unreachable );
-  if ( (ct->val->num_tiles[BASIC] > sz) && ct->val->on[TNEW]) {
-    // Copy current tiles into prev
-    GHashTableIter iter;
-    gpointer key, value;
-    g_hash_table_iter_init ( &iter, ct->val->tiles );
-    while ( g_hash_table_iter_next(&iter, &key, &value) )
-      (void)g_hash_table_insert ( ct->val->prev, g_strdup(key), NULL );
+static const heatmap_colorscheme_t *hm_get_colorscheme ( guint8 style )
+{
+  if ( style > 0 && style < 4 )
+    return hm_colorschemes[style-1];
+  return heatmap_cs_default;
+}
+
+/*
+ * The sorted keys of all the trackpoints
+ * Shared with the tile rendering, hence reference counted
+ */
+struct _HeatmapIndex {
+  gint ref_count;
+  guint64 *keys;
+  guint nkeys;
+  guint32 x0, y0, x1, y1; // Bounds of the points
+  // Worked out when first needed
+  GMutex mutex;
+  gfloat saturation[HM_MAX_ZOOM+1];
+  guint saturation_radius[HM_MAX_ZOOM+1];
+};
+
+static HeatmapIndex *hm_index_new ( guint nkeys )
+{
+  HeatmapIndex *hi = g_malloc0 ( sizeof(HeatmapIndex) );
+  hi->ref_count = 1;
+  hi->keys = g_malloc ( MAX(nkeys, 1) * sizeof(guint64) );
+  hi->nkeys = nkeys;
+  g_mutex_init ( &hi->mutex );
+  return hi;
+}
+
+static HeatmapIndex *hm_index_ref ( HeatmapIndex *hi )
+{
+  g_atomic_int_inc ( &hi->ref_count );
+  return hi;
+}
 
-    for (gint x = 0; x<CP_NUM; x++ )
-      ct->val->num_prev[x] = ct->val->num_tiles[x];
+static void hm_index_unref ( HeatmapIndex *hi )
+{
+  if ( !hi )
+    return;
+  if ( g_atomic_int_dec_and_test ( &hi->ref_count ) ) {
+    g_mutex_clear ( &hi->mutex );
+    g_free ( hi->keys );
+    g_free ( hi );
   }
+}
 
-  ct->val->max_square_prev = ct->val->max_square;
-  ct->val->ns_size_prev = ct->val->ns_size;
-  ct->val->ew_size_prev = ct->val->ew_size;
+// First key that is not less than the given key
+static guint hm_index_lower_bound ( const HeatmapIndex *hi, guint64 key )
+{
+  guint lo = 0;
+  guint hi_n = hi->nkeys;
+  while ( lo < hi_n ) {
+    guint mid = lo + (hi_n - lo) / 2;
+    if ( hi->keys[mid] < key )
+      lo = mid + 1;
+    else
+      hi_n = mid;
+  }
+  return lo;
+}
 
-  tac_clear ( ct->val, FALSE );
+/**
+ * The keys of the trackpoints within a tile are [first, last)
+ */
+static void hm_index_tile_range ( const HeatmapIndex *hi, guint xx, guint yy, guint zoom, guint *first, guint *last )
+{
+  const guint shift = 2 * (HM_KEY_BITS - zoom);
+  const guint64 prefix = hm_key ( xx, yy );
+  *first = hm_index_lower_bound ( hi, prefix << shift );
+  *last = hm_index_lower_bound ( hi, (prefix + 1) << shift );
+}
 
-  tac_unreachable ( ct->val );
+/**
+ * Whether there are any trackpoints within the tile or its neighbours
+ *  (and so might have some heat)
+ */
+static gboolean hm_index_tile_has_points ( const HeatmapIndex *hi, guint xx, guint yy, guint zoom )
+{
+  const gint ntiles = 1 << zoom;
+  for ( gint ty = (gint)yy - 1; ty <= (gint)yy + 1; ty++ ) {
+    for ( gint tx = (gint)xx - 1; tx <= (gint)xx + 1; tx++ ) {
+      if ( tx < 0 || ty < 0 || tx >= ntiles || ty >= ntiles )
+        continue;
+      guint first, last;
+      hm_index_tile_range ( hi, tx, ty, zoom, &first, &last );
+      if ( last > first )
+        return TRUE;
+    }
+  }
+  return FALSE;
+}
 
-  // Set up sensible initial extents to first location
-  if ( ct->tracks_and_layers ) {
-    vik_trw_and_track_t *vtlist = ct->tracks_and_layers->data;
-    VikTrack *trk = vtlist->trk;
-    VikTrackpoint *tpt = vik_track_get_tp_first ( trk );
-    if ( tpt ) {
-      MapCoord mc;
-      if ( map_utils_vikcoord_to_iTMS ( &tpt->coord, ct->val->zoom_level, ct->val->zoom_level, &mc ) ) {
-        ct->val->north_x = mc.x;
-        ct->val->north_y = mc.y;
-        ct->val->east_x = mc.x;
-        ct->val->east_y = mc.y;
-        ct->val->south_x = mc.x;
-        ct->val->south_y = mc.y;
-        ct->val->west_x = mc.x;
-        ct->val->west_y = mc.y;
+/**
+ * The tiles of the zoom level with trackpoints within them or a neighbouring tile
+ *  (and so might have some heat), found from the prefixes of the sorted keys
+ *  rather than checking every tile of the area.
+ * Returns: An array of the hm_key() of each tile position, in ascending order
+ */
+static GArray *hm_index_occupied_tiles ( const HeatmapIndex *hi, guint zoom )
+{
+  const guint shift = 2 * (HM_KEY_BITS - zoom);
+  const gint ntiles = 1 << zoom;
+  GArray *tiles = g_array_new ( FALSE, FALSE, sizeof(guint64) );
+  guint ii = 0;
+  while ( ii < hi->nkeys ) {
+    const guint64 prefix = hi->keys[ii] >> shift;
+    const gint xx = (gint)hm_compact_bits ( prefix );
+    const gint yy = (gint)hm_compact_bits ( prefix >> 1 );
+    for ( gint ty = yy - 1; ty <= yy + 1; ty++ ) {
+      for ( gint tx = xx - 1; tx <= xx + 1; tx++ ) {
+        if ( tx < 0 || ty < 0 || tx >= ntiles || ty >= ntiles )
+          continue;
+        guint64 key = hm_key ( tx, ty );
+        g_array_append_val ( tiles, key );
       }
     }
+    // Skip the other trackpoints of this tile
+    ii = hm_index_lower_bound ( hi, (prefix + 1) << shift );
   }
 
-  guint tracks_processed = 0;
-  // This is used to prevent the progress going negative or otherwise over 100%
-  // It's difficult to get an estimate for the total and track progress of each of these parts
-  //  and then combine it in a coherent single thread progress meter.
-  // So for simplicity they are considered the same as processing extra set of tracks
-  guint extras = (ct->val->on[MAX_SQR] * ct->num_of_tracks) +
-    (ct->val->on[CONTIG] * ct->num_of_tracks) +
-    (ct->val->on[CLUSTER] * ct->num_of_tracks) +
-    (ct->val->on[LINES] * ct->num_of_tracks);
-
-  for ( GList *tl = ct->tracks_and_layers; tl != NULL; tl = tl->next ) {
-    gdouble percent = (gdouble)tracks_processed/(gdouble)(ct->num_of_tracks+extras);
-    gint res = a_background_thread_progress ( threaddata, percent );
-    if ( res != 0 ) return -1;
+  // Neighbours are shared, so remove the duplicates
+  g_array_sort ( tiles, hm_key_compare );
+  guint nn = 0;
+  for ( guint jj = 0; jj < tiles->len; jj++ )
+    if ( nn == 0 || g_array_index(tiles, guint64, jj) != g_array_index(tiles, guint64, nn-1) )
+      g_array_index(tiles, guint64, nn++) = g_array_index(tiles, guint64, jj);
+  g_array_set_size ( tiles, nn );
+  return tiles;
+}
 
-    check_track ( ct->val, tl->data );
-    tracks_processed++;
+/**
+ * The heat at which the colour scale saturates for a zoom level, so all the tiles of that level match up.
+ * Summing every tile of the level to find the actual maximum would defeat rendering on demand,
+ *  so this is estimated from the most trackpoints within a cell about the size of the stamp.
+ */
+static gfloat hm_index_saturation ( HeatmapIndex *hi, guint zoom, guint radius )
+{
+  g_mutex_lock ( &hi->mutex );
+  if ( hi->saturation_radius[zoom] != radius ) {
+    gint level = (gint)(zoom + HM_TILE_BITS) - (gint)g_bit_storage ( 2*radius + 1 );
+    const guint shift = 2 * (HM_KEY_BITS - MAX(level, 0));
+    guint most = 0;
+    guint run = 0;
+    for ( guint ii = 0; ii < hi->nkeys; ii++ ) {
+      if ( ii > 0 && (hi->keys[ii] >> shift) == (hi->keys[ii-1] >> shift) )
+        run++;
+      else
+        run = 1;
+      most = MAX ( most, run );
+    }
+    // Points in a cell are spread over the stamp, so rarely all coincide
+    hi->saturation[zoom] = MAX ( 1.0, most * 0.5 );
+    hi->saturation_radius[zoom] = radius;
   }
+  gfloat saturation = hi->saturation[zoom];
+  g_mutex_unlock ( &hi->mutex );
+  return saturation;
+}
 
-  if ( ct->val->on[MAX_SQR] ) {
-    gdouble percent = (gdouble)tracks_processed/(gdouble)(ct->num_of_tracks+extras);
-    gint res = a_background_thread_progress ( threaddata, percent );
-    if ( res != 0 ) return -1;
+static void hm_img_free ( guchar *pixels, gpointer data )
+{
+  g_free ( pixels );
+}
 
-    tac_square_calc ( ct->val );
-    tracks_processed = tracks_processed + ct->num_of_tracks;
+/**
+ * Render a tile of the heatmap, from the trackpoints within the stamp's reach of it
+ */
+static GdkPixbuf *hm_render_tile ( HeatmapIndex *hi, guint xx, guint yy, guint zoom, guint radius, const heatmap_colorscheme_t *colorscheme )
+{
+  const unsigned d = 2*radius + 1;
+  float *pts = g_malloc ( d * d * sizeof(float) );
+  rhomboidal ( pts, d, radius );
+  heatmap_stamp_t *stamp = heatmap_stamp_load ( d, d, pts );
+  g_free ( pts );
+
+  heatmap_t *hm = heatmap_new ( HM_TILE_SIZE, HM_TILE_SIZE );
+  heatmap_tile_t tile;
+  heatmap_tile_init ( &tile, hm, 0, 0, HM_TILE_SIZE, HM_TILE_SIZE );
+
+  // Pixel position of the keys at this zoom level, relative to this tile
+  const guint shift = HM_KEY_BITS - HM_TILE_BITS - zoom;
+  const gint64 ox = (gint64)xx << HM_TILE_BITS;
+  const gint64 oy = (gint64)yy << HM_TILE_BITS;
+  const gint reach = (gint)radius;
+  const gint ntiles = 1 << zoom;
+
+  for ( gint ty = (gint)yy - 1; ty <= (gint)yy + 1; ty++ ) {
+    for ( gint tx = (gint)xx - 1; tx <= (gint)xx + 1; tx++ ) {
+      if ( tx < 0 || ty < 0 || tx >= ntiles || ty >= ntiles )
+        continue;
+      guint first, last;
+      hm_index_tile_range ( hi, tx, ty, zoom, &first, &last );
+      for ( guint ii = first; ii < last; ii++ ) {
+        gint px = (gint)((gint64)(hm_compact_bits(hi->keys[ii]) >> shift) - ox);
+        gint py = (gint)((gint64)(hm_compact_bits(hi->keys[ii] >> 1) >> shift) - oy);
+        if ( px < -reach || py < -reach || px >= HM_TILE_SIZE + reach || py >= HM_TILE_SIZE + reach )
+          continue;
+        heatmap_tile_add_weighted_point_with_stamp ( &tile, px, py, 1.0f, stamp );
+      }
+    }
   }
 
-  if ( ct->val->on[CONTIG] ) {
-    gdouble percent = (gdouble)tracks_processed/(gdouble)(ct->num_of_tracks+extras);
-    gint res = a_background_thread_progress ( threaddata, percent );
-    if ( res != 0 ) return -1;
-
-    tac_contiguous_calc ( ct->val );
-    tracks_processed = tracks_processed + ct->num_of_tracks;
-  }
+  guchar *image = g_malloc ( HM_TILE_SIZE * HM_TILE_SIZE * 4 );
+  (void)heatmap_render_saturated_to ( hm, colorscheme, hm_index_saturation(hi, zoom, radius), image );
+  heatmap_free ( hm );
+  heatmap_stamp_free ( stamp );
 
-  if ( ct->val->on[CLUSTER] ) {
-    gdouble percent = (gdouble)tracks_processed/(gdouble)(ct->num_of_tracks+extras);
-    gint res = a_background_thread_progress ( threaddata, percent );
-    if ( res != 0 ) return -1;
+  return gdk_pixbuf_new_from_data ( image, GDK_COLORSPACE_RGB, TRUE, 8, HM_TILE_SIZE, HM_TILE_SIZE, 4*HM_TILE_SIZE, hm_img_free, NULL );
+}
 
-    tac_cluster_calc ( ct->val );
-    tracks_processed = tracks_processed + ct->num_of_tracks;
-  }
+typedef struct {
+  VikAggregateLayer *val;
+  HeatmapIndex *index;  // A reference is held
+  gchar *name;
+  guint xx;
+  guint yy;
+  guint zoom;
+  guint radius;
+  guint8 alpha;
+  const heatmap_colorscheme_t *colorscheme;
+  gchar *request;       // Freed by the hash table
+} HeatmapRenderT;
 
-  if ( ct->val->on[LINES] ) {
-    gdouble percent = (gdouble)tracks_processed/(gdouble)(ct->num_of_tracks+extras);
-    gint res = a_background_thread_progress ( threaddata, percent );
-    if ( res != 0 ) return -1;
+static void hm_render_free ( HeatmapRenderT *hr )
+{
+  hm_index_unref ( hr->index );
+  g_free ( hr->name );
+  g_free ( hr );
+}
 
-    tac_lines_calc ( ct->val );
-    tracks_processed = tracks_processed + ct->num_of_tracks;
-  }
+static void hm_render_cancel ( HeatmapRenderT *hr )
+{
+  // Nothing to do
+}
 
-  if ( (ct->val->num_prev[BASIC] > sz) && ct->val->on[TNEW] && !ct->val->zoom_level_chgd ) {
-    // Determine difference in latest tiles vs prev
-    // Could be slow, but seems not too bad
-    GHashTableIter iter;
-    gpointer key, value;
-    g_hash_table_iter_init ( &iter, ct->val->tiles );
-    while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-      gboolean contained = g_hash_table_contains ( ct->val->prev, key );
-      if ( !contained ) {
-        (void)g_hash_table_insert ( ct->val->tiles_new, g_strdup(key), NULL );
-        ct->val->num_tiles[TNEW]++;
-      }
-    }
-    // Also doing it here means the detection is only done for the 'first' calculation update
-    // (this calculation alsootherwise gets done for any config change - even if just colour changed).
-    //  so ATM the new tiles get reset for such subsequent recalculations
-    g_hash_table_remove_all ( ct->val->prev );
+static void hm_render_thread ( HeatmapRenderT *hr, gpointer threaddata )
+{
+  int res = a_background_thread_progress ( threaddata, 0 );
+  if ( res == 0 ) {
+    const gint64 begin = g_get_monotonic_time ();
+    GdkPixbuf *pixbuf = hm_render_tile ( hr->index, hr->xx, hr->yy, hr->zoom, hr->radius, hr->colorscheme );
+    if ( hr->alpha < 255 )
+      pixbuf = ui_pixbuf_set_alpha ( pixbuf, hr->alpha );
+    gdouble duration = (gdouble)(g_get_monotonic_time() - begin) / G_USEC_PER_SEC;
+    a_mapcache_add ( pixbuf, (mapcache_extra_t){ duration, 0 }, hr->xx, hr->yy, 0, MAP_ID_HEATMAP, hr->zoom, hr->alpha, 0.0, 0.0, hr->name );
+    g_object_unref ( pixbuf );
   }
 
-  // Copy result into cache per zoom level
-  const guint zoom_index = 18 - map_utils_mpp_to_zoom_level ( ct->val->zoom_level );
-  if ( zoom_index <= G_N_ELEMENTS(params_tile_area_levels) ) {
-    // Reset
-    g_hash_table_remove_all ( ct->val->tiles_cached[zoom_index] );
-    // Copy
-    GHashTableIter iter;
-    gpointer key, value;
-    g_hash_table_iter_init ( &iter, ct->val->tiles );
-    while ( g_hash_table_iter_next(&iter, &key, &value) )
-      (void)g_hash_table_insert ( ct->val->tiles_cached[zoom_index], g_strdup(key), NULL );
-  }
+  g_mutex_lock ( &hm_requests_mutex );
+  g_hash_table_remove ( hm_requests, hr->request );
+  g_mutex_unlock ( &hm_requests_mutex );
 
-  // Timing for all tile calcs
-  clock_t end = clock();
-  double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
-  g_debug ( "%s: %f", __FUNCTION__, time_spent );
+  if ( res == 0 )
+    vik_layer_emit_update ( VIK_LAYER(hr->val), FALSE ); // NB update display from background
+}
 
-  ct->val->calculating = FALSE;
-  vik_layer_emit_update ( VIK_LAYER(ct->val), FALSE ); // NB update display from background
+/**
+ * Render a tile of the current heatmap in the background
+ */
+static void hm_render_add ( VikAggregateLayer *val, guint xx, guint yy, guint zoom )
+{
+  gchar *request = g_strdup_printf ( "%s-%d-%d-%d-%d", val->hm_name, xx, yy, zoom, val->hm_alpha );
 
-  return 0;
+  g_mutex_lock ( &hm_requests_mutex );
+  if ( g_hash_table_contains ( hm_requests, request ) ) {
+    g_mutex_unlock ( &hm_requests_mutex );
+    g_free ( request );
+    return;
+  }
+  g_hash_table_add ( hm_requests, request );
+  g_mutex_unlock ( &hm_requests_mutex );
+
+  HeatmapRenderT *hr = g_malloc ( sizeof(HeatmapRenderT) );
+  hr->val = val;
+  hr->index = hm_index_ref ( val->hm_index );
+  hr->name = g_strdup ( val->hm_name );
+  hr->xx = xx;
+  hr->yy = yy;
+  hr->zoom = zoom;
+  hr->radius = hm_stamp_radius ( val->hm_stamp_factor, zoom );
+  hr->alpha = val->hm_alpha;
+  hr->colorscheme = hm_get_colorscheme ( val->hm_style );
+  hr->request = request;
+
+  gchar *description = g_strdup_printf ( _("Heatmap Render %d:%d:%d"), zoom, xx, yy );
+  a_background_thread ( BACKGROUND_POOL_LOCAL,
+                        VIK_GTK_WINDOW_FROM_LAYER(val),
+                        description,
+                        (vik_thr_func)hm_render_thread,
+                        hr,
+                        (vik_thr_free_func)hm_render_free,
+                        (vik_thr_free_func)hm_render_cancel,
+                        1 );
+  g_free ( description );
 }
 
 /**
+ * Get a tile of the heatmap at the size it is to be drawn,
+ *  requesting it to be rendered if not available yet.
  *
+ * Caller has to decrease reference counter of returned
+ *  GdkPixbuf, when buffer is no longer needed.
  */
-static void tac_clear ( VikAggregateLayer *val, gboolean full )
+static GdkPixbuf *hm_get_pixbuf ( VikAggregateLayer *val, guint xx, guint yy, guint zoom, gint tilesize )
 {
-  val->max_square = 0;
-  for (gint x = 0; x<CP_NUM; x++ ) {
-    val->num_tiles[x] = 0;
+  const gdouble shrink = (tilesize == HM_TILE_SIZE) ? 0.0 : (gdouble)tilesize / HM_TILE_SIZE;
+  GdkPixbuf *pixbuf = a_mapcache_get ( xx, yy, 0, MAP_ID_HEATMAP, zoom, val->hm_alpha, shrink, shrink, val->hm_name );
+  if ( pixbuf )
+    return pixbuf;
+
+  if ( shrink != 0.0 ) {
+    // Scale the rendered tile once and keep that too
+    GdkPixbuf *tile = a_mapcache_get ( xx, yy, 0, MAP_ID_HEATMAP, zoom, val->hm_alpha, 0.0, 0.0, val->hm_name );
+    if ( tile ) {
+      pixbuf = gdk_pixbuf_scale_simple ( tile, tilesize, tilesize, GDK_INTERP_BILINEAR );
+      g_object_unref ( tile );
+      if ( pixbuf )
+        a_mapcache_add ( pixbuf, (mapcache_extra_t){ -42.0, 0 }, xx, yy, 0, MAP_ID_HEATMAP, zoom, val->hm_alpha, shrink, shrink, val->hm_name );
+      return pixbuf;
+    }
   }
-  val->cont_label = 0;
-  val->clust_label = 0;
-  g_hash_table_remove_all ( val->tiles ); // No memory to remove ATM
-  g_hash_table_remove_all ( val->tiles_clust ); // No memory to remove ATM
-  g_hash_table_remove_all ( val->tiles_new ); // No memory to remove ATM
-  // NB val->prev is not cleared at this point as needed for the later comparison
-  val->ns_size = 0;
-  val->ew_size = 0;
-  // NB North/East/South/West extents only done on calculation with a position
-  // as setting to map x/y tile of 0s not useful
 
-  if ( full )
-    for ( guint xx = 0; xx <= G_N_ELEMENTS(params_tile_area_levels); xx++ )
-      g_hash_table_remove_all ( val->tiles_cached[xx] ); // No memory to remove ATM
+  hm_render_add ( val, xx, yy, zoom );
+  return NULL;
 }
 
 /**
+ * Draw heatmap
  *
+ * Using the tiles of the nearest zoom level, which are only scaled when the viewport is between zoom levels
  */
-static void tac_calculate ( VikAggregateLayer *val )
+static void hm_draw ( VikAggregateLayer *val, VikViewport *vp )
 {
-  val->calculating = TRUE;
-  val->num_calcs++;
+  if ( vik_viewport_get_drawmode(vp) != VIK_VIEWPORT_DRAWMODE_MERCATOR )
+    return;
 
-  GDate *now = g_date_new ();
-  g_date_set_time_t ( now, time(NULL) );
+  const gdouble mpp = vik_viewport_get_xmpp ( vp );
+  if ( mpp != vik_viewport_get_ympp(vp) )
+    return;
 
-  GList *layers = NULL;
-  layers = vik_aggregate_layer_get_all_layers_of_type ( val, layers, VIK_LAYER_TRW, TRUE );
+  const guint zoom = hm_zoom_for_mpp ( mpp );
+  const gint tilesize = (gint)round ( HM_TILE_SIZE * ldexp(1.0, 17 - (gint)zoom) / mpp );
+  if ( tilesize < 1 )
+    return;
 
-  // For each TRW layers keep adding the tracks to build a list of all of them
-  GList *tracks_and_layers = NULL; // A list of #vik_trw_track_list_t
-  for ( GList *layer = layers; layer != NULL; layer = layer->next ) {
-    GList *tracks = g_hash_table_get_values ( vik_trw_layer_get_tracks( VIK_TRW_LAYER(layer->data) ) );
-    if ( !val->tac_time_range )
-      // All
-      tracks_and_layers = g_list_concat ( tracks_and_layers, vik_trw_layer_build_track_list_t ( VIK_TRW_LAYER(layer->data), tracks ) );
-    else {
-      // Only those within specified time period
-      for ( GList *track = tracks; track != NULL; track = track->next ) {
-        VikTrack *trk = VIK_TRACK(track->data);
-        gdouble ts = VIK_TRACKPOINT(trk->trackpoints->data)->timestamp;
-        if ( trk->trackpoints && !isnan(ts) ) {
-          GDate* gdate = g_date_new ();
-          g_date_set_time_t ( gdate, (time_t)ts );
-          gint diff = g_date_days_between ( gdate, now );
-          g_date_free ( gdate );
-          // NB this doesn't get the year date range exact
-          //  however this generally should be good/close enough for practical purposes
-          if ( diff > 0 && diff < (365.25*val->tac_time_range) ) {
-            vik_trw_and_track_t *vtdl = g_malloc (sizeof(vik_trw_and_track_t));
-            vtdl->trk = trk;
-            vtdl->vtl = VIK_TRW_LAYER(layer->data);
-            tracks_and_layers = g_list_prepend ( tracks_and_layers, vtdl );
-          }
-        }
+  VikCoord ul, br;
+  vik_viewport_screen_to_coord ( vp, 0, 0, &ul );
+  vik_viewport_screen_to_coord ( vp, vik_viewport_get_width(vp), vik_viewport_get_height(vp), &br );
+  guint32 wx0, wy0, wx1, wy1;
+  hm_coord_to_world ( &ul, &wx0, &wy0 );
+  hm_coord_to_world ( &br, &wx1, &wy1 );
+
+  // Only where there are points
+  HeatmapIndex *hi = val->hm_index;
+  if ( hi->nkeys == 0 )
+    return;
+  // Visible tiles that may have heat from the points
+  const guint shift = HM_KEY_BITS - zoom;
+  const guint last = (1u << zoom) - 1;
+  const guint xmin = MAX ( MIN(wx0, wx1) >> shift, (hi->x0 >> shift) > 0 ? (hi->x0 >> shift) - 1 : 0 );
+  const guint xmax = MIN ( MAX(wx0, wx1) >> shift, MIN((hi->x1 >> shift) + 1, last) );
+  const guint ymin = MAX ( MIN(wy0, wy1) >> shift, (hi->y0 >> shift) > 0 ? (hi->y0 >> shift) - 1 : 0 );
+  const guint ymax = MIN ( MAX(wy0, wy1) >> shift, MIN((hi->y1 >> shift) + 1, last) );
+
+  MapCoord mc;
+  mc.z = 0;
+  mc.scale = 17 - (gint)zoom;
+  VikCoord coord;
+  gint xx, yy;
+  for ( guint tx = xmin; tx <= xmax; tx++ ) {
+    for ( guint ty = ymin; ty <= ymax; ty++ ) {
+      if ( !hm_index_tile_has_points ( hi, tx, ty, zoom ) )
+        continue;
+      GdkPixbuf *pixbuf = hm_get_pixbuf ( val, tx, ty, zoom, tilesize );
+      if ( pixbuf ) {
+        mc.x = tx;
+        mc.y = ty;
+        map_utils_iTMS_to_vikcoord ( &mc, &coord );
+        vik_viewport_coord_to_screen ( vp, &coord, &xx, &yy );
+        vik_viewport_draw_pixbuf ( vp, pixbuf, 0, 0, xx, yy, tilesize, tilesize );
+        g_object_unref ( pixbuf );
       }
     }
-    g_list_free ( tracks );
   }
-  g_list_free ( layers );
-  g_date_free ( now );
+}
 
-  CalculateThreadT *ct = g_malloc ( sizeof(CalculateThreadT) );
-  ct->tracks_and_layers = tracks_and_layers;
-  ct->val = val;
-  ct->num_of_tracks = g_list_length (tracks_and_layers);
-  guint extras = ct->val->on[MAX_SQR] + ct->val->on[CONTIG] + ct->val->on[CLUSTER];
+/**
+ * Any previously rendered tiles are no longer applicable
+ */
+static void hm_tiles_reset ( VikAggregateLayer *val )
+{
+  static guint count = 0;
+  g_free ( val->hm_name );
+  val->hm_name = g_strdup_printf ( "heatmap-%p-%u", (gpointer)val, ++count );
+  // NB Tiles of any other heatmaps will simply get rendered again
+  a_mapcache_flush_type ( MAP_ID_HEATMAP );
+}
 
-  a_background_thread ( BACKGROUND_POOL_LOCAL,
-                        VIK_GTK_WINDOW_FROM_LAYER(val),
-                        _("Track Area Coverage"),
-                        (vik_thr_func)tac_calculate_thread,
-                        ct,
-                        (vik_thr_free_func)ct_free,
-                        (vik_thr_free_func)ct_cancel,
-                        ct->num_of_tracks + extras );
+/*
+ * The contribution of a track to the heatmap
+ */
+typedef struct {
+  VikTrack *trk;        // A reference is held
+  guint generation;     // Of the track when the keys were determined
+  GArray *keys;         // Of guint64 - the trackpoint keys
+} HeatmapTrack;
+
+static HeatmapTrack *hm_track_new ( VikTrack *trk )
+{
+  HeatmapTrack *ht = g_malloc0 ( sizeof(HeatmapTrack) );
+  vik_track_ref ( trk );
+  ht->trk = trk;
+  ht->generation = vik_track_get_generation ( trk );
+  ht->keys = g_array_new ( FALSE, FALSE, sizeof(guint64) );
+  return ht;
 }
 
-static void rhomboidal (float *values, unsigned d, unsigned r)
+// NB Tracks are only unreferenced in the main thread
+static void hm_track_free ( HeatmapTrack *ht )
 {
-  for (guint y = 0 ; y < d ; ++y) {
-    for (guint x = 0 ; x < d ; ++x) {
-      values[y*d+x] = 1.0 - fmin(1.0, (float)(labs(x-(long)r)+labs(y-(long)r))/(r+1));
-    }
+  vik_track_free ( ht->trk );
+  g_array_free ( ht->keys, TRUE );
+  g_free ( ht );
+}
+
+static void hm_free_tracks ( VikAggregateLayer *val )
+{
+  GList *hts = g_hash_table_get_values ( val->hm_tracks );
+  g_list_free_full ( hts, (GDestroyNotify)hm_track_free );
+  g_hash_table_remove_all ( val->hm_tracks );
+}
+
+/**
+ * Drop the heatmap and the track contributions to it
+ *  (not to be called whilst calculating)
+ */
+static void hm_free_index ( VikAggregateLayer *val )
+{
+  if ( val->hm_index ) {
+    hm_index_unref ( val->hm_index );
+    val->hm_index = NULL;
+    a_mapcache_flush_type ( MAP_ID_HEATMAP );
+  }
+  hm_free_tracks ( val );
+}
+
+typedef struct {
+  VikAggregateLayer *val;
+  GPtrArray *added;      // #HeatmapTrack to work out
+  GPtrArray *removed;    // #HeatmapTrack no longer used
+  GPtrArray *all;        // All the current #HeatmapTrack
+  HeatmapIndex *index;   // The new index when successful
+  // Progress of the parallel work
+  GMutex mutex;
+  GCond cond;
+  guint done;
+  gint cancelled;
+} HeatmapCalcT;
+
+// Back in the main thread
+static gboolean hm_calc_done_idle ( HeatmapCalcT *hc )
+{
+  VikAggregateLayer *val = hc->val;
+  if ( hc->index && hc->index == val->hm_index )
+    // Nothing changed, so any rendered tiles are still valid
+    hm_index_unref ( hc->index );
+  else if ( hc->index ) {
+    hm_index_unref ( val->hm_index );
+    val->hm_index = hc->index;
+    hm_tiles_reset ( val );
   }
+  else
+    // The track contributions no longer match the index, so start again next time
+    hm_free_tracks ( val );
+  val->hm_calculating = FALSE;
+
+  g_ptr_array_free ( hc->removed, TRUE );
+  g_ptr_array_free ( hc->added, FALSE );
+  g_ptr_array_free ( hc->all, FALSE );
+  g_mutex_clear ( &hc->mutex );
+  g_cond_clear ( &hc->cond );
+  g_free ( hc );
+
+  vik_layer_emit_update ( VIK_LAYER(val), FALSE );
+  return FALSE;
+}
+
+static void hm_calc_free ( HeatmapCalcT *hc )
+{
+  // Tracks are released and the index is swapped over in the main thread
+  g_idle_add ( (GSourceFunc)hm_calc_done_idle, hc );
+}
+
+static void hm_calc_cancel ( HeatmapCalcT *hc )
+{
+  // Nothing to do
 }
 
 /**
- *
+ * Work out the keys of the trackpoints of a track
  */
-static void hm_track ( VikAggregateLayer *val, vik_trw_and_track_t *vtlist, gdouble mf, heatmap_t* hm, heatmap_stamp_t *stamp )
+static void hm_track_keys ( HeatmapTrack *ht )
 {
-  int xx, yy;
-  VikTrack *trk = vtlist->trk;
-  GList *iter = trk->trackpoints;
-  while ( iter ) {
+  for ( GList *iter = ht->trk->trackpoints; iter; iter = iter->next ) {
+    const VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
     // Only do trackpoints with timestamps
     // - i.e. hopefully to avoid artificial tracks
-    if ( !isnan(VIK_TRACKPOINT(iter->data)->timestamp) ) {
-      coord_to_screen (val->hm_width, val->hm_height, mf, (struct LatLon*)val->hm_center, &VIK_TRACKPOINT(iter->data)->coord, &xx, &yy);
-      /*
-      struct LatLon *ll = (struct LatLon *)&VIK_TRACKPOINT(iter->data)->coord;
-      xx = (int)(val->hm_width/2 + ( mf * (ll->lon - center->lon) ));
-      yy = (int)(val->hm_height/2 + ( mf * ( MERCLAT(center->lat) - MERCLAT(ll->lat) ) ));
-      */
-      //heatmap_add_point ( hm, xx, yy );
-      heatmap_add_point_with_stamp ( hm, xx, yy, stamp );
-      //hm_point ( val, &VIK_TRACKPOINT(iter->data)->coord, hm );
-    }
-    iter = iter->next;
+    if ( isnan(tp->timestamp) )
+      continue;
+    guint32 xx, yy;
+    hm_coord_to_world ( &tp->coord, &xx, &yy );
+    guint64 key = hm_key ( xx, yy );
+    g_array_append_val ( ht->keys, key );
   }
 }
 
-static void hm_img_free ( guchar *pixels, gpointer data )
+static void hm_worker ( gpointer data, HeatmapCalcT *hc )
 {
-  g_free ( pixels );
+  guint nn = GPOINTER_TO_UINT(data) - 1;
+  if ( !g_atomic_int_get(&hc->cancelled) )
+    hm_track_keys ( g_ptr_array_index(hc->added, nn) );
+  g_mutex_lock ( &hc->mutex );
+  hc->done++;
+  g_cond_signal ( &hc->cond );
+  g_mutex_unlock ( &hc->mutex );
 }
 
 /**
+ * Work out the keys of the added tracks using all the CPUs,
+ *  whilst reporting progress up to @to
  *
+ * Returns: 0 or -1 if cancelled
  */
-static gint hm_calculate_thread ( CalculateThreadT *ct, gpointer threaddata )
+static gint hm_run_parallel ( HeatmapCalcT *hc, gpointer threaddata, gdouble to )
 {
-  VikAggregateLayer *val = ct->val;
+  const guint count = hc->added->len;
+  if ( count == 0 )
+    return 0;
 
-  const clock_t begin = clock();
+  hc->done = 0;
+  GThreadPool *pool = g_thread_pool_new ( (GFunc)hm_worker, hc, MIN(count, util_get_number_of_cpus()), FALSE, NULL );
+  for ( guint nn = 0; nn < count; nn++ )
+    g_thread_pool_push ( pool, GUINT_TO_POINTER(nn+1), NULL );
+
+  g_mutex_lock ( &hc->mutex );
+  while ( hc->done < count ) {
+    gint64 end_time = g_get_monotonic_time () + G_TIME_SPAN_SECOND / 4;
+    (void)g_cond_wait_until ( &hc->cond, &hc->mutex, end_time );
+    gdouble fraction = (gdouble)hc->done / count;
+    g_mutex_unlock ( &hc->mutex );
+    if ( a_background_thread_progress ( threaddata, fraction*to ) )
+      g_atomic_int_set ( &hc->cancelled, 1 );
+    g_mutex_lock ( &hc->mutex );
+  }
+  g_mutex_unlock ( &hc->mutex );
 
-  // Generate a stamp with a size relative to the zoom level
-  const unsigned radius = map_utils_mpp_to_zoom_level ( val->hm_zoom ) *
-    (gdouble)val->hm_stamp_factor/(gdouble)width_default().u;
-  const unsigned d = 2*radius + 1;
-  float pts[d * d];
-  rhomboidal ( pts, d, radius );
-  heatmap_stamp_t *stamp = heatmap_stamp_load ( d, d, pts );
-  heatmap_t* hm = heatmap_new ( val->hm_width, val->hm_height );
+  g_thread_pool_free ( pool, FALSE, TRUE );
+  return g_atomic_int_get(&hc->cancelled) ? -1 : 0;
+}
 
-  const int ww = val->hm_width;
-  const int hh = val->hm_height;
+/**
+ * The keys of the added tracks are worked out in parallel,
+ *  then merged with those of the unchanged tracks into the new index
+ */
+static gint hm_calculate_thread ( HeatmapCalcT *hc, gpointer threaddata )
+{
+  const gint64 begin = g_get_monotonic_time ();
 
-  // Only needs calculating once
-  const gdouble mf = mercator_factor ( val->hm_zoom, val->hm_scale );
+  if ( hm_run_parallel ( hc, threaddata, 0.8 ) != 0 )
+    return -1;
 
-  guint tracks_processed = 0;
-  for ( GList *tl = ct->tracks_and_layers; tl != NULL; tl = tl->next ) {
-    const gdouble percent = (gdouble)tracks_processed/(gdouble)(ct->num_of_tracks);
-    const gint res = a_background_thread_progress ( threaddata, percent );
-    if ( res != 0 ) return -1;
-
-    vik_trw_and_track_t *vtlist = tl->data;
-    if ( BBOX_INTERSECT ( vtlist->trk->bbox, val->hm_bbox ) )
-      hm_track ( ct->val, vtlist, mf, hm, stamp );
+  guint nkeys = 0;
+  for ( guint ii = 0; ii < hc->all->len; ii++ )
+    nkeys += ((HeatmapTrack*)g_ptr_array_index(hc->all, ii))->keys->len;
 
-    tracks_processed++;
+  HeatmapIndex *hi = hm_index_new ( nkeys );
+  guint64 *kk = hi->keys;
+  for ( guint ii = 0; ii < hc->all->len; ii++ ) {
+    GArray *keys = ((HeatmapTrack*)g_ptr_array_index(hc->all, ii))->keys;
+    if ( keys->len ) {
+      memcpy ( kk, keys->data, keys->len * sizeof(guint64) );
+      kk += keys->len;
+    }
   }
-
-  // Would be better if testing for any tracks actually used
-  if ( tracks_processed > 0 ) {
-    unsigned char *image = g_malloc ( ww*hh*4 );
-
-    if ( val->hm_style > 0 && val->hm_style < 4 )
-      heatmap_render_to ( hm, hm_colorschemes[val->hm_style-1], image );
-    else
-      heatmap_render_default_to ( hm, image );
-
-    val->hm_pixbuf = gdk_pixbuf_new_from_data ( image, GDK_COLORSPACE_RGB, TRUE, 8, ww, hh, 4*ww, hm_img_free, NULL );
-    val->hm_pixbuf = ui_pixbuf_set_alpha ( val->hm_pixbuf, val->hm_alpha );
+  if ( a_background_thread_progress ( threaddata, 0.85 ) ) {
+    hm_index_unref ( hi );
+    return -1;
   }
 
-  heatmap_free ( hm );
-  heatmap_stamp_free ( stamp );
+  qsort ( hi->keys, hi->nkeys, sizeof(guint64), hm_key_compare );
+
+  hi->x0 = hi->y0 = G_MAXUINT32;
+  hi->x1 = hi->y1 = 0;
+  for ( guint ii = 0; ii < hi->nkeys; ii++ ) {
+    guint32 xx = hm_compact_bits ( hi->keys[ii] );
+    guint32 yy = hm_compact_bits ( hi->keys[ii] >> 1 );
+    hi->x0 = MIN ( hi->x0, xx );
+    hi->y0 = MIN ( hi->y0, yy );
+    hi->x1 = MAX ( hi->x1, xx );
+    hi->y1 = MAX ( hi->y1, yy );
+  }
+  hc->index = hi;
 
   // Timing
-  const clock_t end = clock();
-  const double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
-  g_debug ( "%s: %f", __FUNCTION__, time_spent );
-
-  ct->val->hm_calculating = FALSE;
-  vik_layer_emit_update ( VIK_LAYER(ct->val), FALSE ); // NB update display from background
+  g_debug ( "%s: %d tracks added, %d removed, %d points in %.3f seconds", __FUNCTION__,
+            hc->added->len, hc->removed->len, hi->nkeys, (gdouble)(g_get_monotonic_time()-begin)/G_USEC_PER_SEC );
 
+  (void)a_background_thread_progress ( threaddata, 1.0 );
   return 0;
 }
 
 /**
- *
+ * Start (re)generating the heatmap index of all the tracks.
+ * Only the tracks that have been added, changed or removed since the previous calculation are processed.
+ * Tiles are then rendered when drawn, for any zoom level.
  */
 static void hm_calculate ( VikAggregateLayer *val )
 {
-  VikWindow *vw = VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(val));
-  VikViewport *vvp = vik_window_viewport ( vw );
-
-  val->hm_width = vik_viewport_get_width ( vvp );
-  val->hm_height = vik_viewport_get_height ( vvp );
-  val->hm_bbox = vik_viewport_get_bbox ( vvp );
-  val->hm_zoom = (gint)vik_viewport_get_zoom ( vvp );
-  val->hm_scaled_zoom = val->hm_zoom;
-  val->hm_center = vik_viewport_get_center ( vvp );
-  vik_viewport_screen_to_coord ( vvp, 0, 0, &val->hm_tl );
-  val->hm_scale = vik_viewport_get_scale ( vvp );
-  val->hm_scaled = FALSE;
-  val->hm_zoom_max = 0;
-  if ( val->hm_zoom == 0 ) {
-    g_warning ( "%s: Zoom invalid", __FUNCTION__ );
-    return;
-  }
-
-  hm_clear ( val );
-  val->hm_calculating = TRUE;
+  HeatmapCalcT *hc = g_malloc0 ( sizeof(HeatmapCalcT) );
+  hc->val = val;
+  hc->added = g_ptr_array_new ();
+  hc->removed = g_ptr_array_new_with_free_func ( (GDestroyNotify)hm_track_free );
+  hc->all = g_ptr_array_new ();
+  g_mutex_init ( &hc->mutex );
+  g_cond_init ( &hc->cond );
 
+  // Work out which track contributions have changed
+  GHashTable *current = g_hash_table_new ( g_direct_hash, g_direct_equal );
   GList *layers = NULL;
   layers = vik_aggregate_layer_get_all_layers_of_type ( val, layers, VIK_LAYER_TRW, TRUE );
-
-  // For each TRW layers keep adding the tracks to build a list of all of them
-  GList *tracks_and_layers = NULL; // A list of #vik_trw_track_list_t
   for ( GList *layer = layers; layer != NULL; layer = layer->next ) {
     GList *tracks = g_hash_table_get_values ( vik_trw_layer_get_tracks( VIK_TRW_LAYER(layer->data) ) );
-    tracks_and_layers = g_list_concat ( tracks_and_layers, vik_trw_layer_build_track_list_t ( VIK_TRW_LAYER(layer->data), tracks ) );
+    for ( GList *iter = tracks; iter != NULL; iter = iter->next ) {
+      VikTrack *trk = VIK_TRACK(iter->data);
+      g_hash_table_add ( current, trk );
+      HeatmapTrack *ht = g_hash_table_lookup ( val->hm_tracks, trk );
+      if ( ht && ht->generation == vik_track_get_generation(trk) )
+        continue;
+      if ( ht ) {
+        g_hash_table_remove ( val->hm_tracks, trk );
+        g_ptr_array_add ( hc->removed, ht );
+      }
+      ht = hm_track_new ( trk );
+      g_hash_table_insert ( val->hm_tracks, trk, ht );
+      g_ptr_array_add ( hc->added, ht );
+    }
     g_list_free ( tracks );
   }
   g_list_free ( layers );
 
-  CalculateThreadT *ct = g_malloc ( sizeof(CalculateThreadT) );
-  ct->tracks_and_layers = tracks_and_layers;
-  ct->val = val;
-  ct->num_of_tracks = g_list_length ( tracks_and_layers );
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, val->hm_tracks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    if ( !g_hash_table_contains ( current, key ) ) {
+      g_ptr_array_add ( hc->removed, value );
+      g_hash_table_iter_remove ( &iter );
+    }
+    else
+      g_ptr_array_add ( hc->all, value );
+  }
+  g_hash_table_destroy ( current );
+
+  val->hm_calculating = TRUE;
+
+  // Nothing changed
+  if ( val->hm_index && hc->added->len == 0 && hc->removed->len == 0 ) {
+    hc->index = hm_index_ref ( val->hm_index );
+    (void)hm_calc_done_idle ( hc );
+    return;
+  }
 
   a_background_thread ( BACKGROUND_POOL_LOCAL,
                         VIK_GTK_WINDOW_FROM_LAYER(val),
                         _("Heatmap generation"),
                         (vik_thr_func)hm_calculate_thread,
-                        ct,
-                        (vik_thr_free_func)ct_free,
-                        (vik_thr_free_func)ct_cancel,
-                        ct->num_of_tracks );
+                        hc,
+                        (vik_thr_free_func)hm_calc_free,
+                        (vik_thr_free_func)hm_calc_cancel,
+                        hc->added->len + 2 );
 }
 
 /**
@@ -2821,7 +3105,7 @@ void vik_aggregate_layer_file_load_complete ( VikAggregateLayer *val )
 static void tac_clear_cb ( menu_array_values values )
 {
   VikAggregateLayer *val = VIK_AGGREGATE_LAYER(values[MA_VAL]);
-  tac_clear ( val, TRUE );
+  tac_clear ( val );
   vik_layer_emit_update ( VIK_LAYER(val), FALSE ); // NB update display from background
 }
 
@@ -2833,11 +3117,13 @@ static void tac_clear_cb ( menu_array_values values )
 typedef struct {
   VikAggregateLayer *val;
   gchar *fn;
+  TileSet *tiles; // A copy of the tiles at the time of the request
 } MBT_T;
 
 static void mbt_free ( MBT_T *mbt )
 {
   g_free ( mbt->fn );
+  tile_set_free ( mbt->tiles );
   g_free ( mbt );
 }
 
@@ -2859,19 +3145,19 @@ static void tac_mbtiles_insert_metadata_pair ( sqlite3 *sql, const gchar *name,
   (void)sqlite3_finalize ( sql_stmt );
 }
 
-static gint tac_mbtiles_thread ( MBT_T *mbt, gpointer threaddata  )
+/**
+ * Create the MBTiles file, replacing any existing content
+ *
+ * Returns: The open database or NULL on failure, when @msg is set
+ */
+static sqlite3 *mbtiles_create ( const gchar *fn, const gchar *name, gchar **msg )
 {
-  VikAggregateLayer *val = mbt->val;
-  clock_t begin = clock();
-  guint num_tiles = 0;
-  gint result = 0;
-
-  gchar *msg = NULL;
   sqlite3 *mbtiles;
-  int ans = sqlite3_open ( mbt->fn, &mbtiles );
+  int ans = sqlite3_open ( fn, &mbtiles );
   if ( ans != SQLITE_OK ) {
-    msg = g_strdup ( sqlite3_errmsg(mbtiles) );
-    goto cleanup;
+    *msg = g_strdup ( sqlite3_errmsg(mbtiles) );
+    (void)sqlite3_close ( mbtiles );
+    return NULL;
   }
 
   char *err_msg = 0;
@@ -2889,28 +3175,100 @@ static gint tac_mbtiles_thread ( MBT_T *mbt, gpointer threaddata  )
 
   ans = sqlite3_exec ( mbtiles, cmd, 0, 0, &err_msg );
   if ( ans != SQLITE_OK ) {
-    msg = g_strdup ( err_msg );
+    *msg = g_strdup ( err_msg );
     sqlite3_free ( err_msg );
-    goto cleanup;
+    (void)sqlite3_close ( mbtiles );
+    return NULL;
   }
 
   // v1.1 Metadata
-  tac_mbtiles_insert_metadata_pair ( mbtiles, "name", vik_layer_get_name(VIK_LAYER(val)) );
+  tac_mbtiles_insert_metadata_pair ( mbtiles, "name", name );
   tac_mbtiles_insert_metadata_pair ( mbtiles, "type", "overlay" );
   tac_mbtiles_insert_metadata_pair ( mbtiles, "version", "1" );
   tac_mbtiles_insert_metadata_pair ( mbtiles, "description", "Created by Viking - " PACKAGE_URL );
   tac_mbtiles_insert_metadata_pair ( mbtiles, "format", "png" );
 
+  return mbtiles;
+}
+
+/**
+ * Store the pixbuf of the (Inverse TMS) tile
+ *
+ * Returns: FALSE on failure, when @msg is set
+ */
+static gboolean mbtiles_insert_tile ( sqlite3 *mbtiles, guint zoom, gint x, gint y, GdkPixbuf *pixbuf, gchar **msg )
+{
+  gint flip_y = (gint) pow(2, zoom)-1 - y;
+
+  gchar *ins = g_strdup_printf
+    ("INSERT INTO tiles VALUES (%d, %d, %d, ?);", zoom, x, flip_y);
+
+  sqlite3_stmt *sql_stmt;
+  int ans = sqlite3_prepare_v2 ( mbtiles, ins, -1, &sql_stmt, NULL );
+  g_free ( ins );
+  if ( ans != SQLITE_OK ) {
+    *msg = g_strdup ( sqlite3_errmsg(mbtiles) );
+    return FALSE;
+  }
+
+  gboolean result = FALSE;
+  gchar *buffer;
+  gsize size;
+  GError *error = NULL;
+  (void)gdk_pixbuf_save_to_buffer ( pixbuf, &buffer, &size, "png", &error, NULL );
+  if ( error ) {
+    *msg = g_strdup ( error->message );
+    g_error_free ( error );
+    goto finalize;
+  }
+
+  ans = sqlite3_bind_blob ( sql_stmt, 1, buffer, size, g_free );
+  if ( ans != SQLITE_OK ) {
+    *msg = g_strdup ( sqlite3_errmsg(mbtiles) );
+    goto finalize;
+  }
+
+  int step = sqlite3_step ( sql_stmt );
+  // This should always complete
+  if ( step != SQLITE_DONE ) {
+    *msg = g_strdup_printf ( "sqlite3_step result was %d", step );
+    goto finalize;
+  }
+  result = TRUE;
+
+ finalize:
+  (void)sqlite3_finalize ( sql_stmt );
+  return result;
+}
+
+static void mbtiles_report_problem ( VikAggregateLayer *val, const gchar *msg )
+{
+  gchar *fullmsg = g_strdup_printf ( _("MBTiles file write problem: %s"), msg );
+  vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(val), fullmsg, VIK_STATUSBAR_INFO );
+  g_free ( fullmsg );
+}
+
+static gint tac_mbtiles_thread ( MBT_T *mbt, gpointer threaddata  )
+{
+  VikAggregateLayer *val = mbt->val;
+  clock_t begin = clock();
+  guint num_tiles = 0;
+  gint result = 0;
+
+  gchar *msg = NULL;
+  sqlite3 *mbtiles = mbtiles_create ( mbt->fn, vik_layer_get_name(VIK_LAYER(val)), &msg );
+  if ( !mbtiles )
+    goto cleanup;
+
   guint zoom = (guint)map_utils_mpp_to_zoom_level(val->zoom_level);
 
-  GHashTableIter iter;
-  gpointer key, value;
+  TileSetIter iter;
   gint x,y;
   GdkPixbuf *pixbuf = NULL;
-  guint sz = g_hash_table_size ( val->tiles );
+  guint sz = tile_set_size ( mbt->tiles );
 
-  g_hash_table_iter_init ( &iter, val->tiles );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
+  tile_set_iter_init ( &iter, mbt->tiles );
+  while ( tile_set_iter_next(&iter, &x, &y) ) {
 
     num_tiles++;
     gdouble percent = (gdouble)num_tiles/(gdouble)sz;
@@ -2920,73 +3278,37 @@ static gint tac_mbtiles_thread ( MBT_T *mbt, gpointer threaddata  )
       goto cleanup;
     }
 
-    (void)sscanf ( key, "%d:%d", &x, &y );
-
     pixbuf = layer_pixbuf_update ( pixbuf, val->color[BASIC], 256, 256, val->alpha[BASIC] );
 
-    gint flip_y = (gint) pow(2, zoom)-1 - y;
-
-    gchar *ins = g_strdup_printf
-      ("INSERT INTO tiles VALUES (%d, %d, %d, ?);", zoom, x, flip_y);
-
-    sqlite3_stmt *sql_stmt;
-    ans = sqlite3_prepare_v2 ( mbtiles, ins, -1, &sql_stmt, NULL );
-    g_free ( ins );
-    if ( ans != SQLITE_OK ) {
-      msg = g_strdup ( sqlite3_errmsg(mbtiles) );
-      goto cleanup;
-    }
-
-    gchar *buffer;
-    gsize size;
-    GError *error = NULL;
-    ans = gdk_pixbuf_save_to_buffer ( pixbuf, &buffer, &size, "png", &error, NULL );
-    if ( error ) {
-      msg = g_strdup ( error->message );
-      g_error_free ( error );
-      goto cleanup;
-    }
-
-    ans = sqlite3_bind_blob ( sql_stmt, 1, buffer, size, g_free );
-    if ( ans != SQLITE_OK ) {
-      msg = g_strdup ( err_msg );
-      sqlite3_free ( err_msg );
-      goto cleanup;
-    }
-
-    int step = sqlite3_step ( sql_stmt );
-    // This should always complete
-    if ( step != SQLITE_DONE ) {
-      msg = g_strdup_printf ( "sqlite3_step result was %d", step );
+    if ( !mbtiles_insert_tile ( mbtiles, zoom, x, y, pixbuf, &msg ) )
       goto cleanup;
-    }
-
-    (void)sqlite3_finalize ( sql_stmt );
 
     // Minimize filesize
     (void)sqlite3_exec ( mbtiles, "ANALYZE; VACUUM;", 0, 0, NULL );
   }
 
  cleanup:
-  (void)sqlite3_close ( mbtiles );
+  if ( mbtiles )
+    (void)sqlite3_close ( mbtiles );
   clock_t end = clock();
   double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
   g_message ( "%s: %f %d", __FUNCTION__, time_spent, num_tiles );
 
   if ( msg ) {
-    gchar *fullmsg = g_strdup_printf ( _("MBTiles file write problem: %s"), msg );
-    vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(val), fullmsg, VIK_STATUSBAR_INFO );
-    g_free ( fullmsg );
+    mbtiles_report_problem ( val, msg );
     g_free ( msg );
   }
 
   return result;
 }
 
-static void tac_generate_mbtiles_cb ( menu_array_values values )
+/**
+ * Ask for the MBTiles file to create
+ *
+ * Returns: The filename or NULL if cancelled
+ */
+static gchar *mbtiles_choose_file ( VikAggregateLayer *val )
 {
-  VikAggregateLayer *val = VIK_AGGREGATE_LAYER(values[MA_VAL]);
-
   gchar *fn = NULL;
   GtkWidget *dialog = gtk_file_chooser_dialog_new ( _("Export"),
 						    NULL,
@@ -3007,12 +3329,25 @@ static void tac_generate_mbtiles_cb ( menu_array_values values )
   }
   gtk_widget_destroy ( dialog );
 
+  return fn;
+}
+
+static void tac_generate_mbtiles_cb ( menu_array_values values )
+{
+  VikAggregateLayer *val = VIK_AGGREGATE_LAYER(values[MA_VAL]);
+
+  const TileSet *tiles = tac_tiles ( val );
+  if ( !tiles )
+    return;
+
+  gchar *fn = mbtiles_choose_file ( val );
   if ( !fn )
     return;
 
   MBT_T *mbt = g_malloc ( sizeof(MBT_T) );
   mbt->val = val;
   mbt->fn = fn;
+  mbt->tiles = tile_set_copy ( tiles );
   a_background_thread ( BACKGROUND_POOL_LOCAL,
                         VIK_GTK_WINDOW_FROM_LAYER(val),
                         _("Creating MBTiles File"),
@@ -3020,7 +3355,117 @@ static void tac_generate_mbtiles_cb ( menu_array_values values )
                         mbt,
                         (vik_thr_free_func)mbt_free,
                         NULL, // cancel() nothing to do, could delete file but ATM leave as progressed
-                        g_hash_table_size(val->tiles) );
+                        tile_set_size(mbt->tiles) );
+}
+
+/**
+ * Generate MBTiles file of the heatmap tiles,
+ *  from the world level down to the zoom level at the time of the request
+ */
+typedef struct {
+  VikAggregateLayer *val;
+  gchar *fn;
+  HeatmapIndex *index;  // A reference is held
+  guint zoom_max;
+  guint8 factor;
+  guint8 alpha;
+  const heatmap_colorscheme_t *colorscheme;
+} HeatmapMBT_T;
+
+static void hm_mbt_free ( HeatmapMBT_T *hmt )
+{
+  hm_index_unref ( hmt->index );
+  g_free ( hmt->fn );
+  g_free ( hmt );
+}
+
+static gint hm_mbtiles_thread ( HeatmapMBT_T *hmt, gpointer threaddata )
+{
+  const gint64 begin = g_get_monotonic_time ();
+  HeatmapIndex *hi = hmt->index;
+  guint num_tiles = 0;
+  gint result = 0;
+
+  gchar *msg = NULL;
+  sqlite3 *mbtiles = mbtiles_create ( hmt->fn, vik_layer_get_name(VIK_LAYER(hmt->val)), &msg );
+  if ( !mbtiles )
+    goto cleanup;
+
+  for ( guint zoom = 0; zoom <= hmt->zoom_max && hi->nkeys; zoom++ ) {
+    if ( a_background_thread_progress ( threaddata, (gdouble)zoom/(hmt->zoom_max+1) ) ) {
+      result = -1;
+      goto cleanup;
+    }
+    const guint radius = hm_stamp_radius ( hmt->factor, zoom );
+    // Tiles of the points and their neighbours
+    GArray *tiles = hm_index_occupied_tiles ( hi, zoom );
+    for ( guint ii = 0; ii < tiles->len; ii++ ) {
+      if ( a_background_testcancel ( threaddata ) ) {
+        result = -1;
+        g_array_free ( tiles, TRUE );
+        goto cleanup;
+      }
+      const guint64 key = g_array_index ( tiles, guint64, ii );
+      const guint tx = hm_compact_bits ( key );
+      const guint ty = hm_compact_bits ( key >> 1 );
+      GdkPixbuf *pixbuf = hm_render_tile ( hi, tx, ty, zoom, radius, hmt->colorscheme );
+      if ( hmt->alpha < 255 )
+        pixbuf = ui_pixbuf_set_alpha ( pixbuf, hmt->alpha );
+      gboolean ok = mbtiles_insert_tile ( mbtiles, zoom, tx, ty, pixbuf, &msg );
+      g_object_unref ( pixbuf );
+      if ( !ok ) {
+        g_array_free ( tiles, TRUE );
+        goto cleanup;
+      }
+      num_tiles++;
+    }
+    g_array_free ( tiles, TRUE );
+  }
+
+  // Minimize filesize
+  (void)sqlite3_exec ( mbtiles, "ANALYZE; VACUUM;", 0, 0, NULL );
+
+ cleanup:
+  if ( mbtiles )
+    (void)sqlite3_close ( mbtiles );
+  g_debug ( "%s: %d tiles in %.3f seconds", __FUNCTION__, num_tiles, (gdouble)(g_get_monotonic_time()-begin)/G_USEC_PER_SEC );
+
+  if ( msg ) {
+    mbtiles_report_problem ( hmt->val, msg );
+    g_free ( msg );
+  }
+
+  return result;
+}
+
+static void hm_generate_mbtiles_cb ( menu_array_values values )
+{
+  VikAggregateLayer *val = VIK_AGGREGATE_LAYER(values[MA_VAL]);
+  if ( !val->hm_index || val->hm_calculating )
+    return;
+
+  VikViewport *vvp = vik_window_viewport ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(val)) );
+
+  gchar *fn = mbtiles_choose_file ( val );
+  if ( !fn )
+    return;
+
+  HeatmapMBT_T *hmt = g_malloc ( sizeof(HeatmapMBT_T) );
+  hmt->val = val;
+  hmt->fn = fn;
+  hmt->index = hm_index_ref ( val->hm_index );
+  hmt->zoom_max = hm_zoom_for_mpp ( vik_viewport_get_zoom(vvp) );
+  hmt->factor = val->hm_stamp_factor;
+  hmt->alpha = val->hm_alpha;
+  hmt->colorscheme = hm_get_colorscheme ( val->hm_style );
+  a_background_thread ( BACKGROUND_POOL_LOCAL,
+                        VIK_GTK_WINDOW_FROM_LAYER(val),
+                        _("Creating MBTiles File"),
+                        (vik_thr_func)hm_mbtiles_thread,
+                        hmt,
+                        (vik_thr_free_func)hm_mbt_free,
+                        NULL,
+                        hmt->zoom_max + 1 );
 }
 #endif
 
@@ -3231,7 +3676,8 @@ static void hm_calculate_cb ( menu_array_values values )
 static void hm_clear_cb ( menu_array_values values )
 {
   VikAggregateLayer *val = VIK_AGGREGATE_LAYER(values[MA_VAL]);
-  hm_clear ( val );
+  if ( !val->hm_calculating )
+    hm_free_index ( val );
   vik_layer_emit_update ( VIK_LAYER(val), FALSE );
 }
 
@@ -3301,8 +3747,13 @@ static void aggregate_build_submenu_hm ( VikAggregateLayer *val, GtkMenu *menu,
     GtkWidget *itemhmc = vu_menu_add_item ( hm_submenu, _("_Calculate"), GTK_STOCK_REFRESH, G_CALLBACK(hm_calculate_cb), values );
     gtk_widget_set_sensitive ( itemhmc, hm_available );
 
+#ifdef HAVE_SQLITE3_H
+    GtkWidget *itemhme = vu_menu_add_item ( hm_submenu, _("_Export as MBTiles"), GTK_STOCK_CONVERT, G_CALLBACK(hm_generate_mbtiles_cb), values );
+    gtk_widget_set_sensitive ( itemhme, hm_available && val->hm_index );
+#endif
+
     GtkWidget *itemhmlr = vu_menu_add_item ( hm_submenu, _("_Remove"), GTK_STOCK_DELETE, G_CALLBACK(hm_clear_cb), values );
-    gtk_widget_set_sensitive ( itemhmlr, (val->hm_pixbuf != NULL) );
+    gtk_widget_set_sensitive ( itemhmlr, hm_available && val->hm_index );
   }
 }
 
@@ -3312,6 +3763,7 @@ static void aggregate_build_submenu_hm ( VikAggregateLayer *val, GtkMenu *menu,
 GList *build_tac_track_list ( VikTrwLayer *vtl, GList *tracks, MapCoord *mc )
 {
   GList *tracks_and_layers = NULL;
+  const gdouble zoom = (mc->scale >= 0) ? VIK_GZ(mc->scale) : 1.0/VIK_GZ(-mc->scale);
   // build tracks_and_layers list
   while ( tracks ) {
     VikTrack *trk = VIK_TRACK(tracks->data);
@@ -3327,20 +3779,16 @@ GList *build_tac_track_list ( VikTrwLayer *vtl, GList *tracks, MapCoord *mc )
 
     // First a quick check to see if the track bounds covers this tile
     if ( BBOX_INTERSECT ( bbox, trk->bbox ) ) {
-      // Now check each point to see if actually in the tile bounds
-      GList *iter = trk->trackpoints;
-      while ( iter ) {
-        if ( !isnan(VIK_TRACKPOINT(iter->data)->timestamp) ) {
-          if ( vik_coord_inside ( &(VIK_TRACKPOINT(iter->data)->coord), &tl, &br ) ) {
-            vik_trw_and_track_t *vtdl = g_malloc(sizeof(vik_trw_and_track_t));
-            vtdl->trk = trk;
-            vtdl->vtl = vtl;
-            tracks_and_layers = g_list_prepend ( tracks_and_layers, vtdl );
-            break;
-          }
-        }
-        iter = iter->next;
+      // Now check the tiles of the track, in the same way as the coverage is calculated
+      TileSet *ts = tile_set_new ();
+      (void)tac_track_tiles ( trk, zoom, ts, NULL );
+      if ( tile_set_contains ( ts, mc->x, mc->y ) ) {
+        vik_trw_and_track_t *vtdl = g_malloc(sizeof(vik_trw_and_track_t));
+        vtdl->trk = trk;
+        vtdl->vtl = vtl;
+        tracks_and_layers = g_list_prepend ( tracks_and_layers, vtdl );
       }
+      tile_set_free ( ts );
     }
     tracks = g_list_next ( tracks );
   }
@@ -3414,7 +3862,8 @@ static gboolean aggregate_layer_selected_viewport_menu ( VikAggregateLayer *val,
 
     if ( map_utils_vikcoord_to_iTMS(&coord, val->zoom_level, val->zoom_level, &val->rc_menu_mc) ) {
       GtkWidget *itemtt = vu_menu_add_item ( sm, _("_Tracks in this Tile"), GTK_STOCK_INFO, G_CALLBACK(tac_track_list_cb), values );
-      available = available && is_tile_occupied ( val->tiles, val->rc_menu_mc.x, val->rc_menu_mc.y );
+      const TileSet *tiles = tac_tiles ( val );
+      available = available && tiles && tile_set_contains ( tiles, val->rc_menu_mc.x, val->rc_menu_mc.y );
       gtk_widget_set_sensitive ( itemtt, available );
     }
 
@@ -3511,7 +3960,6 @@ void vik_aggregate_layer_free ( VikAggregateLayer *val )
   if ( val->tracks_analysis_dialog != NULL )
     gtk_widget_destroy ( val->tracks_analysis_dialog );
 
-  g_hash_table_destroy ( val->tiles );
   for ( guint ii=0; ii<CP_NUM; ii++ ) {
     if ( val->pixbuf[ii] )
       g_object_unref ( val->pixbuf[ii] );
@@ -3520,16 +3968,15 @@ void vik_aggregate_layer_free ( VikAggregateLayer *val )
   }
   if ( val->unreachable_pixbuf )
     g_object_unref ( val->unreachable_pixbuf );
-  g_hash_table_destroy ( val->tiles_clust );
-  g_hash_table_destroy ( val->tiles_new );
-  g_hash_table_destroy ( val->prev );
-  for ( guint xx = 0; xx <= G_N_ELEMENTS(params_tile_area_levels); xx++ )
-    g_hash_table_destroy ( val->tiles_cached[xx] );
-
-  if ( val->hm_pixbuf )
-    g_object_unref ( val->hm_pixbuf );
-  if ( val->hm_pbf_scaled )
-    g_object_unref ( val->hm_pbf_scaled );
+  tile_set_free ( val->tiles_clust );
+  tile_set_free ( val->tiles_new );
+  for ( guint xx = 0; xx < TAC_NUM_LEVELS; xx++ )
+    tile_set_free ( val->tiles_cached[xx] );
+  g_hash_table_destroy ( val->tac_tracks );
+
+  hm_free_index ( val );
+  g_hash_table_destroy ( val->hm_tracks );
+  g_free ( val->hm_name );
 }
 
 static void delete_layer_iter ( VikLayer *vl )
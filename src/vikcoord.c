@@ -26,6 +26,9 @@
 
 /* all coord operations MUST BE ABSTRACTED!!! */
 
+// Work through arrays of coordinates in blocks of this many
+#define VIK_COORD_BLOCK_SIZE 256
+
 void vik_coord_convert(VikCoord *coord, VikCoordMode dest_mode)
 {
   VikCoord tmp;
@@ -65,6 +68,9 @@ static gdouble vik_coord_diff_safe(const VikCoord *c1, const VikCoord *c2)
 
 gdouble vik_coord_diff(const VikCoord *c1, const VikCoord *c2)
 {
+  // Within the same UTM zone there's no need to go via lat/lon
+  if ( c1->mode == VIK_COORD_UTM && c2->mode == VIK_COORD_UTM && c1->utm_zone == c2->utm_zone )
+    return a_coords_utm_diff ( (const struct UTM *) c1, (const struct UTM *) c2 );
   if ( c1->mode == c2->mode )
     return vik_coord_diff_safe ( c1, c2 );
   if ( c1->mode == VIK_COORD_UTM )
@@ -73,6 +79,139 @@ gdouble vik_coord_diff(const VikCoord *c1, const VikCoord *c2)
     return a_coords_latlon_diff ( (const struct LatLon *) c1, (const struct LatLon *) c2 );
 }
 
+/**
+ * vik_coord_diff_n:
+ * @coords: Array of @n coordinates
+ * @n:      Number of coordinates
+ * @diffs:  Receives for each coordinate the distance from the previous one (0 for the first one)
+ *
+ * Gives the same values as vik_coord_diff() on each consecutive pair,
+ *  but is much faster for long runs of coordinates in the same mode.
+ * UTM coordinates are converted to lat/lon in bulk when not all in one zone,
+ *  whereas the odd pair in different modes just uses vik_coord_diff().
+ *
+ * Returns: The total distance
+ */
+gdouble vik_coord_diff_n ( const VikCoord *coords, guint n, gdouble *diffs )
+{
+  gdouble lat[VIK_COORD_BLOCK_SIZE];
+  gdouble lon[VIK_COORD_BLOCK_SIZE];
+  gdouble out[VIK_COORD_BLOCK_SIZE];
+  gdouble ns[VIK_COORD_BLOCK_SIZE];
+  gdouble ew[VIK_COORD_BLOCK_SIZE];
+  gdouble utm_lat[VIK_COORD_BLOCK_SIZE];
+  gdouble utm_lon[VIK_COORD_BLOCK_SIZE];
+  gchar zone[VIK_COORD_BLOCK_SIZE];
+  gchar letter[VIK_COORD_BLOCK_SIZE];
+  guint index[VIK_COORD_BLOCK_SIZE];
+  gdouble total = 0.0;
+
+  if ( n == 0 )
+    return total;
+  diffs[0] = 0.0;
+
+  // Consecutive blocks overlap by one coordinate, so the difference across the join is included
+  for ( guint first = 0; first+1 < n; first += VIK_COORD_BLOCK_SIZE-1 ) {
+    guint len = MIN ( VIK_COORD_BLOCK_SIZE, n - first );
+    const VikCoord *block = coords + first;
+
+    // All in one UTM zone - then every difference is taken directly from the UTM values
+    gboolean one_zone = TRUE;
+    for ( guint ii = 0; ii < len && one_zone; ii++ )
+      one_zone = ( block[ii].mode == VIK_COORD_UTM && block[ii].utm_zone == block[0].utm_zone );
+
+    if ( !one_zone ) {
+      guint count = 0;
+      for ( guint ii = 0; ii < len; ii++ ) {
+        if ( block[ii].mode == VIK_COORD_LATLON ) {
+          lat[ii] = block[ii].north_south;
+          lon[ii] = block[ii].east_west;
+        }
+        else {
+          ns[count] = block[ii].north_south;
+          ew[count] = block[ii].east_west;
+          zone[count] = block[ii].utm_zone;
+          letter[count] = block[ii].utm_letter;
+          index[count] = ii;
+          count++;
+        }
+      }
+      if ( count ) {
+        a_coords_utm_to_latlon_n ( ns, ew, zone, letter, count, utm_lat, utm_lon );
+        for ( guint ii = 0; ii < count; ii++ ) {
+          lat[index[ii]] = utm_lat[ii];
+          lon[index[ii]] = utm_lon[ii];
+        }
+      }
+      (void)a_coords_latlon_diff_n ( lat, lon, len, out );
+    }
+
+    for ( guint ii = 1; ii < len; ii++ ) {
+      if ( block[ii].mode != block[ii-1].mode )
+        out[ii] = vik_coord_diff ( &block[ii], &block[ii-1] );
+      else if ( block[ii].mode == VIK_COORD_UTM && block[ii].utm_zone == block[ii-1].utm_zone )
+        out[ii] = a_coords_utm_diff ( (const struct UTM *)&block[ii], (const struct UTM *)&block[ii-1] );
+      diffs[first+ii] = out[ii];
+      total += out[ii];
+    }
+  }
+  return total;
+}
+
+/**
+ * vik_coord_convert_n:
+ * @coords:    Array of @n coordinates
+ * @n:         Number of coordinates
+ * @dest_mode: The mode to convert the coordinates into
+ *
+ * The same as vik_coord_convert() on each coordinate, but using the bulk coordinate functions
+ */
+void vik_coord_convert_n ( VikCoord *coords, guint n, VikCoordMode dest_mode )
+{
+  gdouble ns[VIK_COORD_BLOCK_SIZE];
+  gdouble ew[VIK_COORD_BLOCK_SIZE];
+  gdouble ns2[VIK_COORD_BLOCK_SIZE];
+  gdouble ew2[VIK_COORD_BLOCK_SIZE];
+  gchar zone[VIK_COORD_BLOCK_SIZE];
+  gchar letter[VIK_COORD_BLOCK_SIZE];
+  guint index[VIK_COORD_BLOCK_SIZE];
+
+  for ( guint first = 0; first < n; first += VIK_COORD_BLOCK_SIZE ) {
+    guint len = MIN ( VIK_COORD_BLOCK_SIZE, n - first );
+    VikCoord *block = coords + first;
+    // Gather those that need converting
+    guint count = 0;
+    for ( guint ii = 0; ii < len; ii++ ) {
+      if ( block[ii].mode != dest_mode ) {
+        ns[count] = block[ii].north_south;
+        ew[count] = block[ii].east_west;
+        zone[count] = block[ii].utm_zone;
+        letter[count] = block[ii].utm_letter;
+        index[count] = ii;
+        count++;
+      }
+    }
+    if ( !count )
+      continue;
+
+    if ( dest_mode == VIK_COORD_LATLON )
+      a_coords_utm_to_latlon_n ( ns, ew, zone, letter, count, ns2, ew2 );
+    else
+      a_coords_latlon_to_utm_n ( ns, ew, count, ns2, ew2, zone, letter );
+
+    for ( guint ii = 0; ii < count; ii++ ) {
+      VikCoord *coord = &block[index[ii]];
+      coord->north_south = ns2[ii];
+      coord->east_west = ew2[ii];
+      if ( dest_mode == VIK_COORD_UTM ) {
+        coord->utm_zone = zone[ii];
+        coord->utm_letter = letter[ii];
+      }
+      coord->mode = dest_mode;
+    }
+  }
+}
+
 void vik_coord_load_from_latlon ( VikCoord *coord, VikCoordMode mode, const struct LatLon *ll )
 {
   if ( mode == VIK_COORD_LATLON )
@@ -123,7 +262,7 @@ gboolean vik_coord_equals ( const VikCoord *coord1, const VikCoord *coord2 )
  */
 gboolean vik_coord_equalish ( const VikCoord *coord1, const VikCoord *coord2 )
 {
-  static const gdouble TOLERANCE = 0.000005; // ATM use for both coordinate modes
+  static const gdouble TOLERANCE = VIK_COORD_EQUALISH_TOLERANCE;
   if ( coord1->mode != coord2->mode )
     return FALSE;
   if ( coord1->mode == VIK_COORD_LATLON )
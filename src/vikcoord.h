@@ -48,6 +48,10 @@ void vik_coord_convert(VikCoord *coord, VikCoordMode dest_mode);
 void vik_coord_copy_convert(const VikCoord *coord, VikCoordMode dest_mode, VikCoord *dest);
 gdouble vik_coord_diff(const VikCoord *c1, const VikCoord *c2);
 
+// For arrays of coordinates
+gdouble vik_coord_diff_n ( const VikCoord *coords, guint n, gdouble *diffs );
+void vik_coord_convert_n ( VikCoord *coords, guint n, VikCoordMode dest_mode );
+
 void vik_coord_load_from_latlon ( VikCoord *coord, VikCoordMode mode, const struct LatLon *ll );
 void vik_coord_load_from_utm ( VikCoord *coord, VikCoordMode mode, const struct UTM *utm );
 
@@ -55,6 +59,9 @@ void vik_coord_to_latlon ( const VikCoord *coord, struct LatLon *dest );
 void vik_coord_to_utm ( const VikCoord *coord, struct UTM *dest );
 
 gboolean vik_coord_equals ( const VikCoord *coord1, const VikCoord *coord2 );
+// Maximum difference in either axis for coordinates to be considered equalish
+// ATM used for both coordinate modes
+#define VIK_COORD_EQUALISH_TOLERANCE 0.000005
 gboolean vik_coord_equalish ( const VikCoord *coord1, const VikCoord *coord2 );
 
 void vik_coord_set_area(const VikCoord *coord, const struct LatLon *wh, VikCoord *tl, VikCoord *br);
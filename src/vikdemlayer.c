@@ -855,7 +855,7 @@ static inline void pixels_set_area ( guchar* pixels, GdkColor gcolor, guint alph
 
 static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *dem )
 {
-  VikDEMColumn *column, *prevcolumn, *nextcolumn;
+  VikDEMColumn *column;
 
   LatLonBBox vp_bbox = vik_viewport_get_bbox ( vp );
   LatLonBBox dem_bbox = vik_dem_get_bbox ( dem );
@@ -942,26 +942,19 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
       // NOTE: ( counter.lon <= end_lon + ESCALE_DEG*SKIP_FACTOR ) is neccessary so in high zoom modes,
       // the leftmost column does also get drawn, if the center point is out of viewport.
       if ( x < dem->n_columns ) {
-        column = g_ptr_array_index ( dem->columns, x );
         // get previous and next column. catch out-of-bound.
 	gint32 new_x = x;
 	new_x -= gradient_skip_factor;
-        if(new_x < 0)
-          prevcolumn = g_ptr_array_index ( dem->columns, 0);
-        else
-          prevcolumn = g_ptr_array_index ( dem->columns, new_x);
+        guint prev_x = (new_x < 0) ? 0 : new_x;
 	new_x = x;
 	new_x += gradient_skip_factor;
-        if(new_x >= dem->n_columns)
-          nextcolumn = g_ptr_array_index ( dem->columns, dem->n_columns-1);
-        else
-          nextcolumn = g_ptr_array_index ( dem->columns, new_x);
+        guint next_x = (new_x >= dem->n_columns) ? dem->n_columns-1 : new_x;
 
         for ( y=start_y, counter.lat = start_lat; counter.lat <= end_lat; counter.lat += nscale_deg * skip_factor, y += skip_factor ) {
-          if ( y > column->n_points )
-            break;
-
-          elev = column->points[y];
+          // Values come from a reduced resolution version of the DEM when available,
+          //  rather than sampling every skip_factor'th value of the full resolution
+          //  (and positions beyond the end of the column are invalid)
+          elev = vik_dem_get_xy_scaled ( dem, x, y, skip_factor );
 
 	  // calculate bounding box for drawing
 	  gint box_x, box_y, box_width, box_height;
@@ -1021,19 +1014,18 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
 		new_y = y - gradient_skip_factor;
 		if(new_y < 0)
                   new_y = 0;
-		change += get_height_difference(elev, prevcolumn->points[new_y]);
-		change += get_height_difference(elev, column->points[new_y]);
-		change += get_height_difference(elev, nextcolumn->points[new_y]);
+		change += get_height_difference(elev, vik_dem_get_xy_scaled(dem, prev_x, new_y, skip_factor));
+		change += get_height_difference(elev, vik_dem_get_xy_scaled(dem, x, new_y, skip_factor));
+		change += get_height_difference(elev, vik_dem_get_xy_scaled(dem, next_x, new_y, skip_factor));
 
-		change += get_height_difference(elev, prevcolumn->points[y]);
-		change += get_height_difference(elev, nextcolumn->points[y]);
+		change += get_height_difference(elev, vik_dem_get_xy_scaled(dem, prev_x, y, skip_factor));
+		change += get_height_difference(elev, vik_dem_get_xy_scaled(dem, next_x, y, skip_factor));
 
+		// NB Beyond the end of a column gives an invalid elevation, so is ignored
 		new_y = y + gradient_skip_factor;
-		if(new_y >= column->n_points)
-			new_y = y;
-		change += get_height_difference(elev, prevcolumn->points[new_y]);
-		change += get_height_difference(elev, column->points[new_y]);
-		change += get_height_difference(elev, nextcolumn->points[new_y]);
+		change += get_height_difference(elev, vik_dem_get_xy_scaled(dem, prev_x, new_y, skip_factor));
+		change += get_height_difference(elev, vik_dem_get_xy_scaled(dem, x, new_y, skip_factor));
+		change += get_height_difference(elev, vik_dem_get_xy_scaled(dem, next_x, new_y, skip_factor));
 
 		change = change / ((skip_factor > 1) ? log(skip_factor) : 0.55); // FIXME: better calc.
 
@@ -61,6 +61,7 @@ static void gps_empty_all_cb( gpointer layer_and_vlp[2] );
 static void gps_empty_realtime_cb( gpointer layer_and_vlp[2] );
 static void gps_start_stop_tracking_cb( gpointer layer_and_vlp[2] );
 static void realtime_tracking_draw(VikGpsLayer *vgl, VikViewport *vp);
+static void realtime_drawn_save ( VikGpsLayer *vgl, VikViewport *vp );
 static void rt_gpsd_disconnect(VikGpsLayer *vgl);
 static gboolean rt_gpsd_connect(VikGpsLayer *vgl, gboolean ask_if_failed);
 static VikLayerParamData color_default_tri ( void ) {
@@ -199,6 +200,10 @@ static VikLayerParamData gpsd_retry_interval_default ( void )
   return data;
 }
 
+static VikLayerParamScale params_redraw_rate[] = { {1, 25, 1, 0} };
+
+static VikLayerParamData redraw_rate_default ( void ) { return VIK_LPD_UINT ( 5 ); }
+
 static gchar *modes_string[] = {
   N_("Not Seen"),
   N_("No Fix"),
@@ -251,6 +256,8 @@ static VikLayerParam gps_layer_params[] = {
   { VIK_LAYER_GPS, "moving_map_method", VIK_LAYER_PARAM_UINT, GROUP_REALTIME_MODE, N_("Moving Map Method:"), VIK_LAYER_WIDGET_RADIOGROUP_STATIC, params_vehicle_position, NULL, NULL, moving_map_method_default, NULL, NULL },
   { VIK_LAYER_GPS, "indicator_color", VIK_LAYER_PARAM_COLOR, GROUP_REALTIME_MODE, N_("Indicator Color:"), VIK_LAYER_WIDGET_COLOR, NULL, NULL, NULL, color_default_tri, NULL, NULL },
   { VIK_LAYER_GPS, "realtime_update_statusbar", VIK_LAYER_PARAM_BOOLEAN, GROUP_REALTIME_MODE, N_("Update Statusbar:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, N_("Display information in the statusbar on GPS updates"), vik_lpd_true_default, NULL, NULL },
+  { VIK_LAYER_GPS, "realtime_redraw_rate", VIK_LAYER_PARAM_UINT, GROUP_REALTIME_MODE, N_("Maximum Redraws per Second:"), VIK_LAYER_WIDGET_SPINBUTTON, params_redraw_rate, NULL,
+    N_("Limit how often the display is updated, however often GPS updates are received"), redraw_rate_default, NULL, NULL },
   { VIK_LAYER_GPS, "auto_connect", VIK_LAYER_PARAM_BOOLEAN, GROUP_REALTIME_MODE, N_("Auto Connect"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, N_("Automatically connect to GPSD"), vik_lpd_false_default, NULL, NULL },
   { VIK_LAYER_GPS, "gpsd_host", VIK_LAYER_PARAM_STRING, GROUP_REALTIME_MODE, N_("Gpsd Host:"), VIK_LAYER_WIDGET_ENTRY, NULL, NULL, NULL, gpsd_host_default, NULL, NULL },
   { VIK_LAYER_GPS, "gpsd_port", VIK_LAYER_PARAM_STRING, GROUP_REALTIME_MODE, N_("Gpsd Port:"), VIK_LAYER_WIDGET_ENTRY, NULL, NULL, NULL, gpsd_port_default, NULL, NULL },
@@ -270,6 +277,7 @@ enum {
   PARAM_VEHICLE_POSITION,
   PARAM_INDICATOR_COLOR,
   PARAM_REALTIME_UPDATE_STATUSBAR,
+  PARAM_REALTIME_REDRAW_RATE,
   PARAM_GPSD_CONNECT,
   PARAM_GPSD_HOST,
   PARAM_GPSD_PORT,
@@ -410,8 +418,25 @@ struct _VikGpsLayer {
   guint vehicle_position;
   GdkColor indicator_color;
   gboolean realtime_update_statusbar;
+  guint realtime_redraw_rate;
   VikTrackpoint *trkpt;
   VikTrackpoint *trkpt_prev;
+  // Redrawing is limited to the rate above, independently of how often fixes are received
+  guint realtime_redraw_id;
+  gboolean realtime_redraw_all;  // Whether the pending redraw must include everything
+  gint64 realtime_redraw_time;   // Of the last redraw
+  gint64 realtime_full_draw_time;
+  // What was last drawn, so only the changes can be drawn on top of it
+  gboolean realtime_drawn;
+  VikCoord realtime_drawn_center;
+  gdouble realtime_drawn_zoom;
+  gint realtime_drawn_width;
+  gint realtime_drawn_height;
+  GList *realtime_drawn_tpl;       // The last trackpoint drawn
+  guint realtime_track_generation; // Whilst matching the track, it has only been added to since being drawn
+  GdkPixbuf *realtime_under;       // What is under the position indicator
+  gint realtime_under_x;
+  gint realtime_under_y;
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
   gchar *protocol;
   gchar *serial_port;
@@ -680,6 +705,10 @@ static gboolean gps_layer_set_param ( VikGpsLayer *vgl, VikLayerSetParam *vlsp )
     case PARAM_REALTIME_UPDATE_STATUSBAR:
       changed = vik_layer_param_change_boolean ( vlsp->data, &vgl->realtime_update_statusbar );
       break;
+    case PARAM_REALTIME_REDRAW_RATE:
+      if ( vlsp->data.u >= params_redraw_rate[0].min && vlsp->data.u <= params_redraw_rate[0].max )
+        changed = vik_layer_param_change_uint ( vlsp->data, &vgl->realtime_redraw_rate );
+      break;
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
     default: break;
   }
@@ -747,6 +776,9 @@ static VikLayerParamData gps_layer_get_param ( VikGpsLayer *vgl, guint16 id, gbo
     case PARAM_REALTIME_UPDATE_STATUSBAR:
       rv.b = vgl->realtime_update_statusbar;
       break;
+    case PARAM_REALTIME_REDRAW_RATE:
+      rv.u = vgl->realtime_redraw_rate;
+      break;
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
     case PARAM_RESET: rv.ptr = reset_cb; break;
     default: break;
@@ -827,6 +859,8 @@ static void gps_layer_draw ( VikGpsLayer *vgl, VikViewport *vp )
   }
 #if defined (VIK_CONFIG_REALTIME_GPS_TRACKING) && defined (GPSD_API_MAJOR_VERSION)
   if (vgl->realtime_tracking) {
+    vgl->realtime_full_draw_time = g_get_monotonic_time ();
+    realtime_drawn_save ( vgl, vp );
     realtime_tracking_draw(vgl, vp);
   }
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
@@ -910,6 +944,10 @@ static void gps_layer_free ( VikGpsLayer *vgl )
   }
 #if defined (VIK_CONFIG_REALTIME_GPS_TRACKING) && defined (GPSD_API_MAJOR_VERSION)
   rt_gpsd_disconnect(vgl);
+  if ( vgl->realtime_redraw_id )
+    g_source_remove ( vgl->realtime_redraw_id );
+  if ( vgl->realtime_under )
+    g_object_unref ( vgl->realtime_under );
   gcs_free(vgl);
   g_free ( vgl->gpsd_host );
   g_free ( vgl->gpsd_port );
@@ -1793,12 +1831,13 @@ static VikTrackpoint* create_realtime_trackpoint(VikGpsLayer *vgl, gboolean forc
       int alt = isnan(vgl->realtime_fix.fix.altitude) ? 0 : (int)floor(vgl->realtime_fix.fix.altitude);
       int last_alt = isnan(vgl->last_fix.fix.altitude) ? 0 : (int)floor(vgl->last_fix.fix.altitude);
 #endif
-      if (((last_tp = g_list_last(vgl->realtime_track->trackpoints)) != NULL) &&
-          (vgl->realtime_fix.fix.mode > MODE_2D) &&
+      if ((vgl->realtime_fix.fix.mode > MODE_2D) &&
           (vgl->last_fix.fix.mode <= MODE_2D) &&
-          ((cur_timestamp - last_timestamp) < 2)) {
+          ((cur_timestamp - last_timestamp) < 2) &&
+          ((last_tp = vik_track_get_tpl_last(vgl->realtime_track)) != NULL)) {
         g_free(last_tp->data);
         vgl->realtime_track->trackpoints = g_list_delete_link(vgl->realtime_track->trackpoints, last_tp);
+        vik_track_calculate_bounds ( vgl->realtime_track );
         replace = TRUE;
       }
       if (replace ||
@@ -1828,7 +1867,11 @@ static VikTrackpoint* create_realtime_trackpoint(VikGpsLayer *vgl, gboolean forc
         vik_coord_load_from_latlon(&tp->coord,
              vik_trw_layer_get_coord_mode(vgl->trw_children[TRW_REALTIME]), &ll);
 
+        // Track whether the only changes to the track since it was drawn are these additions
+        guint generation = vik_track_get_generation ( vgl->realtime_track );
         vik_track_add_trackpoint ( vgl->realtime_track, tp, TRUE ); // Ensure bounds is recalculated
+        if ( generation == vgl->realtime_track_generation )
+          vgl->realtime_track_generation = vik_track_get_generation ( vgl->realtime_track );
         vgl->realtime_fix.dirty = FALSE;
         vgl->realtime_fix.satellites_used = 0;
         vgl->last_fix = vgl->realtime_fix;
@@ -1839,6 +1882,127 @@ static VikTrackpoint* create_realtime_trackpoint(VikGpsLayer *vgl, gboolean forc
     return NULL;
 }
 
+// Pixels around the position, covering the drawn position indicator
+#define REALTIME_INDICATOR_EXTENT 36
+// Drawing just the changes can't take into account other layers (e.g. those drawn on top)
+//  so everything is still redrawn occasionally
+#define REALTIME_FULL_DRAW_SECONDS 10
+
+/**
+ * Keep what is needed to draw just the changes on top of what has been drawn:
+ *  the viewport position, the last trackpoint and the area that the position indicator is about to cover
+ */
+static void realtime_drawn_save ( VikGpsLayer *vgl, VikViewport *vp )
+{
+  vgl->realtime_drawn = FALSE;
+  if ( vgl->realtime_under ) {
+    g_object_unref ( vgl->realtime_under );
+    vgl->realtime_under = NULL;
+  }
+
+  // Only applicable to the main display (e.g. not when generating an image)
+  VikWindow *vw = VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vgl));
+  if ( !vw || vp != vik_window_viewport(vw) )
+    return;
+
+  if ( vgl->realtime_track ) {
+    vgl->realtime_drawn_tpl = vik_track_get_tpl_last ( vgl->realtime_track );
+    vgl->realtime_track_generation = vik_track_get_generation ( vgl->realtime_track );
+  }
+  vgl->realtime_drawn_center = *vik_viewport_get_center ( vp );
+  vgl->realtime_drawn_zoom = vik_viewport_get_zoom ( vp );
+  vgl->realtime_drawn_width = vik_viewport_get_width ( vp );
+  vgl->realtime_drawn_height = vik_viewport_get_height ( vp );
+
+  struct LatLon ll;
+  VikCoord gps;
+  gint x, y;
+  ll.lat = vgl->realtime_fix.fix.latitude;
+  ll.lon = vgl->realtime_fix.fix.longitude;
+  if ( !isnan(ll.lat) && !isnan(ll.lon) ) {
+    vik_coord_load_from_latlon ( &gps, vik_viewport_get_coord_mode(vp), &ll );
+    vik_viewport_coord_to_screen ( vp, &gps, &x, &y );
+    gint x1 = MAX ( 0, x - REALTIME_INDICATOR_EXTENT );
+    gint y1 = MAX ( 0, y - REALTIME_INDICATOR_EXTENT );
+    gint x2 = MIN ( vgl->realtime_drawn_width, x + REALTIME_INDICATOR_EXTENT );
+    gint y2 = MIN ( vgl->realtime_drawn_height, y + REALTIME_INDICATOR_EXTENT );
+    if ( x2 > x1 && y2 > y1 ) {
+      vgl->realtime_under = vik_viewport_get_pixbuf_area ( vp, x1, y1, x2-x1, y2-y1 );
+      vgl->realtime_under_x = x1;
+      vgl->realtime_under_y = y1;
+    }
+  }
+  vgl->realtime_drawn = TRUE;
+}
+
+/**
+ * Draw just the changes since the last draw directly on the display:
+ *  the part of the track that has been added and the moved position indicator
+ *
+ * Returns: FALSE when this is not possible, so everything needs to be redrawn
+ */
+static gboolean realtime_draw_changes ( VikGpsLayer *vgl )
+{
+  if ( !vgl->realtime_drawn )
+    return FALSE;
+  if ( g_get_monotonic_time() - vgl->realtime_full_draw_time > REALTIME_FULL_DRAW_SECONDS * G_USEC_PER_SEC )
+    return FALSE;
+
+  VikViewport *vvp = vik_window_viewport ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vgl)) );
+  if ( vik_viewport_get_zoom(vvp) != vgl->realtime_drawn_zoom ||
+       !vik_coord_equals(vik_viewport_get_center(vvp), &vgl->realtime_drawn_center) ||
+       vik_viewport_get_width(vvp) != vgl->realtime_drawn_width ||
+       vik_viewport_get_height(vvp) != vgl->realtime_drawn_height )
+    return FALSE;
+  // Check the layer for visibility (including all the parents visibilities)
+  if ( !vik_treeview_item_get_visible_tree(VIK_LAYER(vgl)->vt, &(VIK_LAYER(vgl)->iter)) )
+    return FALSE;
+
+  VikTrack *trk = vgl->realtime_track;
+  if ( trk && (!vgl->realtime_drawn_tpl || vik_track_get_generation(trk) != vgl->realtime_track_generation) )
+    return FALSE;
+
+  if ( vgl->realtime_under )
+    vik_viewport_draw_pixbuf ( vvp, vgl->realtime_under, 0, 0, vgl->realtime_under_x, vgl->realtime_under_y,
+                               gdk_pixbuf_get_width(vgl->realtime_under), gdk_pixbuf_get_height(vgl->realtime_under) );
+
+  VikTrwLayer *vtl = vgl->trw_children[TRW_REALTIME];
+  if ( trk && VIK_LAYER(vtl)->visible )
+    vik_trw_layer_draw_track_tail ( vtl, vvp, trk, vgl->realtime_drawn_tpl );
+
+  realtime_drawn_save ( vgl, vvp );
+  realtime_tracking_draw ( vgl, vvp );
+  vik_viewport_sync ( vvp, NULL );
+  return TRUE;
+}
+
+static gboolean realtime_redraw_cb ( VikGpsLayer *vgl )
+{
+  vgl->realtime_redraw_id = 0;
+  vgl->realtime_redraw_time = g_get_monotonic_time ();
+
+  gboolean all = vgl->realtime_redraw_all;
+  vgl->realtime_redraw_all = FALSE;
+  if ( all || !realtime_draw_changes(vgl) )
+    vik_layer_emit_update ( all ? VIK_LAYER(vgl) : VIK_LAYER(vgl->trw_children[TRW_REALTIME]), FALSE );
+  return FALSE;
+}
+
+/**
+ * Redraw as soon as allowed by the maximum redraw rate,
+ *  with any further requests until then handled by the same redraw
+ */
+static void realtime_request_redraw ( VikGpsLayer *vgl, gboolean all )
+{
+  vgl->realtime_redraw_all = vgl->realtime_redraw_all || all;
+  if ( vgl->realtime_redraw_id )
+    return;
+
+  gint64 interval = G_USEC_PER_SEC / MAX(1, vgl->realtime_redraw_rate);
+  gint64 wait = vgl->realtime_redraw_time + interval - g_get_monotonic_time();
+  vgl->realtime_redraw_id = g_timeout_add ( (guint)(CLAMP(wait, 0, interval) / 1000), (GSourceFunc)realtime_redraw_cb, vgl );
+}
+
 #define VIK_SETTINGS_GPS_STATUSBAR_FORMAT "gps_statusbar_format"
 
 static void update_statusbar ( VikGpsLayer *vgl, VikWindow *vw )
@@ -1927,7 +2091,9 @@ static void gpsd_raw_hook(VglGpsd *vgpsd, gchar *data)
       vgl->trkpt_prev = vgl->trkpt;
     }
 
-    vik_layer_emit_update ( update_all ? VIK_LAYER(vgl) : VIK_LAYER(vgl->trw_children[TRW_REALTIME]), vgl->trkpt ? TRUE : FALSE ); // NB update from background thread
+    if ( vgl->trkpt )
+      vik_window_set_modified ( vw );
+    realtime_request_redraw ( vgl, update_all );
   }
 }
 
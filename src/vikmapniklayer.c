@@ -29,6 +29,7 @@
 #include "dir.h"
 #include "mapnik_interface.h"
 #include "background.h"
+#include "metatile.h"
 
 #include "vikmapslayer.h"
 
@@ -48,6 +49,7 @@ static VikLayerParamData file_default ( void )
 
 static VikLayerParamData size_default ( void ) { return VIK_LPD_UINT ( 256 ); }
 static VikLayerParamData alpha_default ( void ) { return VIK_LPD_UINT ( 255 ); }
+static VikLayerParamData render_block_default ( void ) { return VIK_LPD_UINT ( METATILE ); }
 
 static VikLayerParamData cache_dir_default ( void )
 {
@@ -62,6 +64,10 @@ static VikLayerParamScale scales[] = {
 	{ 0, 1024, 12, 0 }, // Rerender timeout hours
 };
 
+// Render blocks are powers of two, so they always line up with the edges of the world
+static gchar *params_render_blocks[] = { "1x1", "2x2", "4x4", "8x8", "16x16", NULL };
+static guint params_render_block_values[] = { 1, 2, 4, 8, 16 };
+
 static void reset_cb ( GtkWidget *widget, gpointer ptr )
 {
 	a_layer_defaults_reset_show ( MAPNIK_FIXED_NAME, ptr, VIK_LAYER_GROUP_NONE );
@@ -80,6 +86,10 @@ VikLayerParam mapnik_layer_params[] = {
     NULL, vik_lpd_true_default, NULL, NULL },
   { VIK_LAYER_MAPNIK, "file-cache-dir", VIK_LAYER_PARAM_STRING, VIK_LAYER_GROUP_NONE, N_("File Cache Directory:"), VIK_LAYER_WIDGET_FOLDERENTRY, NULL, NULL,
     NULL, cache_dir_default, NULL, NULL },
+  { VIK_LAYER_MAPNIK, "file-cache-metatiles", VIK_LAYER_PARAM_BOOLEAN, VIK_LAYER_GROUP_NONE, N_("File Cache As Metatiles:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL,
+    N_("Store tiles in the file cache as mod_tile compatible .meta files, each of 8x8 tiles"), vik_lpd_false_default, NULL, NULL },
+  { VIK_LAYER_MAPNIK, "render-block", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Render Block Size:"), VIK_LAYER_WIDGET_COMBOBOX, params_render_blocks, params_render_block_values,
+    N_("The number of tiles across to render in one go. Larger blocks are much quicker overall and avoid labels being cut off at tile edges. Metatiles always use 8."), render_block_default, NULL, NULL },
   { VIK_LAYER_MAPNIK, "reset", VIK_LAYER_PARAM_PTR_DEFAULT, VIK_LAYER_GROUP_NONE, NULL,
     VIK_LAYER_WIDGET_BUTTON, N_("Reset to Defaults"), NULL, NULL, reset_default, NULL, NULL },
 };
@@ -90,6 +100,8 @@ enum {
   PARAM_ALPHA,
   PARAM_USE_FILE_CACHE,
   PARAM_FILE_CACHE_DIR,
+  PARAM_FILE_CACHE_METATILES,
+  PARAM_RENDER_BLOCK,
   PARAM_RESET,
   NUM_PARAMS };
 
@@ -215,9 +227,10 @@ struct _VikMapnikLayer {
 
 	gboolean use_file_cache;
 	gchar *file_cache_dir;
+	gboolean file_cache_metatiles;
+	guint render_block;
 
 	VikCoord rerender_ul;
-	VikCoord rerender_br;
 	gdouble rerender_zoom;
 	GtkWidget *right_click_menu;
 };
@@ -426,6 +439,13 @@ static gboolean mapnik_layer_set_param ( VikMapnikLayer *vml, VikLayerSetParam *
 		case PARAM_FILE_CACHE_DIR:
 			changed = vik_layer_param_change_string ( vlsp->data, &vml->file_cache_dir );
 			break;
+		case PARAM_FILE_CACHE_METATILES:
+			changed = vik_layer_param_change_boolean ( vlsp->data, &vml->file_cache_metatiles );
+			break;
+		case PARAM_RENDER_BLOCK:
+			if ( vlsp->data.u >= 1 && vlsp->data.u <= 16 && !(vlsp->data.u & (vlsp->data.u - 1)) )
+				changed = vik_layer_param_change_uint ( vlsp->data, &vml->render_block );
+			break;
 		default: break;
 	}
 	if ( vik_debug && changed )
@@ -474,6 +494,8 @@ static VikLayerParamData mapnik_layer_get_param ( VikMapnikLayer *vml, guint16 i
 		case PARAM_ALPHA: data.u = vml->alpha; break;
 		case PARAM_USE_FILE_CACHE: data.b = vml->use_file_cache; break;
 		case PARAM_FILE_CACHE_DIR: data.s = vml->file_cache_dir; break;
+		case PARAM_FILE_CACHE_METATILES: data.b = vml->file_cache_metatiles; break;
+		case PARAM_RENDER_BLOCK: data.u = vml->render_block; break;
 		case PARAM_RESET: data.ptr = reset_cb; break;
 		default: break;
 	}
@@ -636,6 +658,25 @@ static gchar *get_filename ( gchar *dir, guint x, guint y, guint z)
 	return g_strdup_printf ( MAPNIK_LAYER_FILE_CACHE_LAYOUT, dir, (17-z), x, y );
 }
 
+/**
+ * Whether the file cache holds mod_tile .meta files, rather than a file per tile
+ */
+static gboolean use_metatiles ( VikMapnikLayer *vml )
+{
+	return vml->use_file_cache && vml->file_cache_dir && vml->file_cache_metatiles;
+}
+
+// Free returned string after use
+static gchar *get_cache_filename ( VikMapnikLayer *vml, MapCoord *ulm )
+{
+	if ( use_metatiles(vml) ) {
+		char path[PATH_MAX];
+		(void)xyz_to_meta ( path, sizeof(path), vml->file_cache_dir, ulm->x, ulm->y, (17 - ulm->scale) );
+		return g_strdup ( path );
+	}
+	return get_filename ( vml->file_cache_dir, ulm->x, ulm->y, ulm->scale );
+}
+
 static void possibly_save_pixbuf ( VikMapnikLayer *vml, GdkPixbuf *pixbuf, MapCoord *ulm )
 {
 	if ( vml->use_file_cache ) {
@@ -658,44 +699,164 @@ static void possibly_save_pixbuf ( VikMapnikLayer *vml, GdkPixbuf *pixbuf, MapCo
 	}
 }
 
+/**
+ * Save the PNG encoded tiles of a metatile, indexed by their metatile offset
+ */
+static void save_metatile ( VikMapnikLayer *vml, MapCoord *ulm, gchar **bufs, gsize *sizes )
+{
+	char path[PATH_MAX];
+	gint zoom = 17 - ulm->scale;
+	(void)xyz_to_meta ( path, sizeof(path), vml->file_cache_dir, ulm->x, ulm->y, zoom );
+
+	gchar *dir = g_path_get_dirname ( path );
+	if ( g_mkdir_with_parents ( dir , 0777 ) != 0 )
+		g_warning ("%s: Failed to mkdir %s", __FUNCTION__, dir );
+	g_free ( dir );
+
+	size_t lens[METATILE*METATILE];
+	for ( guint ii = 0; ii < METATILE*METATILE; ii++ )
+		lens[ii] = sizes[ii];
+
+	char err_msg[PATH_MAX];
+	err_msg[0] = 0;
+	if ( metatile_write ( vml->file_cache_dir, ulm->x, ulm->y, zoom, bufs, lens, err_msg ) )
+		g_warning ("%s: %s", __FUNCTION__, err_msg );
+}
+
+// Largest image (in pixels across) to ask Mapnik for in one go
+#define RENDER_MAX_SIZE 4096
+
+/**
+ * get_render_block:
+ * @origin: Returns the top left tile of the block
+ *
+ * Tiles are rendered in square blocks aligned to multiples of the block size,
+ *  which thus coincide with mod_tile metatiles when of that size.
+ * The block size is a power of two no bigger than the world at the zoom level,
+ *  so the block never extends beyond the edges of the world.
+ *
+ * Returns: The number of tiles across the block containing this tile
+ */
+static guint get_render_block ( VikMapnikLayer *vml, MapCoord *ulm, MapCoord *origin )
+{
+	*origin = *ulm;
+
+	guint block = METATILE;
+	if ( !use_metatiles(vml) ) {
+		block = MAX ( vml->render_block, 1 );
+		// Round down to a power of two
+		while ( block & (block - 1) )
+			block &= block - 1;
+		// Keep the image size reasonable for large tiles
+		while ( block > 1 && block * vml->tile_size_x > RENDER_MAX_SIZE )
+			block /= 2;
+	}
+
+	// No bigger than the whole world at this zoom level
+	gint zoom = 17 - ulm->scale;
+	if ( zoom <= 0 )
+		return 1;
+	if ( zoom < 16 )
+		block = MIN ( block, (guint)1 << zoom );
+
+	// Tiles beyond the edges of the world (if ever requested) are just rendered on their own
+	if ( zoom < 31 ) {
+		gint world = 1 << zoom;
+		if ( ulm->x < 0 || ulm->x >= world || ulm->y < 0 || ulm->y >= world )
+			return 1;
+	}
+
+	origin->x = ulm->x & ~(gint)(block - 1);
+	origin->y = ulm->y & ~(gint)(block - 1);
+	return block;
+}
+
 typedef struct
 {
 	VikMapnikLayer *vml;
-	VikCoord *ul;
-	VikCoord *br;
 	MapCoord *ulmc;
+	guint block;
 	const gchar* request;
 } RenderInfo;
 
 /**
  * render:
+ * @ulm:   The top left tile of the block
+ * @block: The number of tiles across the block
  *
  * Common render function which can run in separate thread
+ * The whole block is rendered in one go (so labels are placed across tile edges)
+ *  and then split into the tiles for the cache
  */
-static void render ( VikMapnikLayer *vml, VikCoord *ul, VikCoord *br, MapCoord *ulm )
+static void render ( VikMapnikLayer *vml, MapCoord *ulm, guint block )
 {
+	VikCoord ul; VikCoord br;
+	MapCoord brm = *ulm;
+	brm.x += block;
+	brm.y += block;
+	map_utils_iTMS_to_vikcoord ( ulm, &ul );
+	map_utils_iTMS_to_vikcoord ( &brm, &br );
+
+	const guint size = vml->tile_size_x;
 	gint64 tt1 = g_get_real_time ();
-	GdkPixbuf *pixbuf = mapnik_interface_render ( vml->mi, ul->north_south, ul->east_west, br->north_south, br->east_west );
+	GdkPixbuf *pixbuf = mapnik_interface_render_size ( vml->mi, ul.north_south, ul.east_west, br.north_south, br.east_west, size*block, size*block );
 	gint64 tt2 = g_get_real_time ();
 	gdouble tt = (gdouble)(tt2-tt1)/1000000;
-	g_debug ( "Mapnik rendering completed in %.3f seconds", tt );
-	if ( !pixbuf ) {
-		// A pixbuf to stick into cache incase of an unrenderable area - otherwise will get continually re-requested
-		pixbuf = gdk_pixbuf_scale_simple ( ui_get_icon("vikmapniklayer", 16), vml->tile_size_x, vml->tile_size_x, GDK_INTERP_BILINEAR );
+	g_debug ( "Mapnik rendering of %dx%d tiles completed in %.3f seconds", block, block, tt );
+
+	// Tiles for a metatile are collected in encoded form to be saved together
+	gboolean as_meta = use_metatiles ( vml );
+	gchar *bufs[METATILE*METATILE] = { NULL };
+	gsize sizes[METATILE*METATILE] = { 0 };
+
+	for ( guint ii = 0; ii < block; ii++ ) {
+		for ( guint jj = 0; jj < block; jj++ ) {
+			MapCoord tile_mc = *ulm;
+			tile_mc.x += ii;
+			tile_mc.y += jj;
+
+			GdkPixbuf *tile;
+			if ( pixbuf ) {
+				// Copy out, rather than a sub pixbuf, so each tile in the cache doesn't keep the whole image
+				GdkPixbuf *sub = gdk_pixbuf_new_subpixbuf ( pixbuf, ii*size, jj*size, size, size );
+				tile = gdk_pixbuf_copy ( sub );
+				g_object_unref ( sub );
+			}
+			else {
+				// A pixbuf to stick into cache incase of an unrenderable area - otherwise will get continually re-requested
+				tile = gdk_pixbuf_scale_simple ( ui_get_icon("vikmapniklayer", 16), size, size, GDK_INTERP_BILINEAR );
+			}
+
+			if ( as_meta ) {
+				guint offset = (tile_mc.x & (METATILE-1)) * METATILE + (tile_mc.y & (METATILE-1));
+				GError *error = NULL;
+				if ( !gdk_pixbuf_save_to_buffer ( tile, &bufs[offset], &sizes[offset], "png", &error, NULL ) ) {
+					g_warning ("%s: %s", __FUNCTION__, error->message );
+					g_error_free (error);
+				}
+			}
+			else
+				possibly_save_pixbuf ( vml, tile, &tile_mc );
+
+			// NB Mapnik can apply alpha, but use our own function for now
+			if ( vml->alpha < 255 )
+				tile = ui_pixbuf_scale_alpha ( tile, vml->alpha );
+			a_mapcache_add ( tile, (mapcache_extra_t){ tt, 0 }, tile_mc.x, tile_mc.y, tile_mc.z, MAP_ID_MAPNIK_RENDER, tile_mc.scale, vml->alpha, 0.0, 0.0, vml->filename_xml );
+			g_object_unref ( tile );
+		}
 	}
-	possibly_save_pixbuf ( vml, pixbuf, ulm );
+	if ( pixbuf )
+		g_object_unref ( pixbuf );
 
-	// NB Mapnik can apply alpha, but use our own function for now
-	if ( vml->alpha < 255 )
-		pixbuf = ui_pixbuf_scale_alpha ( pixbuf, vml->alpha );
-	a_mapcache_add ( pixbuf, (mapcache_extra_t){ tt, 0 }, ulm->x, ulm->y, ulm->z, MAP_ID_MAPNIK_RENDER, ulm->scale, vml->alpha, 0.0, 0.0, vml->filename_xml );
-	g_object_unref(pixbuf);
+	if ( as_meta ) {
+		save_metatile ( vml, ulm, bufs, sizes );
+		for ( guint ii = 0; ii < METATILE*METATILE; ii++ )
+			g_free ( bufs[ii] );
+	}
 }
 
 static void render_info_free ( RenderInfo *data )
 {
-	g_free ( data->ul );
-	g_free ( data->br );
 	g_free ( data->ulmc );
 	// NB No need to free the request/key - as this is freed by the hash table destructor
 	g_free ( data );
@@ -705,7 +866,7 @@ static void background ( RenderInfo *data, gpointer threaddata )
 {
 	int res = a_background_thread_progress ( threaddata, 0 );
 	if (res == 0) {
-		render ( data->vml, data->ul, data->br, data->ulmc );
+		render ( data->vml, data->ulmc, data->block );
 	}
 
 	g_mutex_lock(tp_mutex);
@@ -721,16 +882,21 @@ static void render_cancel_cleanup (RenderInfo *data)
 	// Anything?
 }
 
-#define REQUEST_HASHKEY_FORMAT "%d-%d-%d-%d-%d"
+#define REQUEST_HASHKEY_FORMAT "%d-%d-%d-%d-%d-%d"
 
 /**
  * Thread
+ *
+ * Render the block of tiles containing the tile
  */
-static void thread_add (VikMapnikLayer *vml, MapCoord *mul, VikCoord *ul, VikCoord *br, gint x, gint y, gint z, gint zoom, const gchar* name )
+static void thread_add (VikMapnikLayer *vml, MapCoord *mul, const gchar* name )
 {
+	MapCoord origin;
+	guint block = get_render_block ( vml, mul, &origin );
+
 	// Create request
 	guint nn = name ? g_str_hash ( name ) : 0;
-	gchar *request = g_strdup_printf ( REQUEST_HASHKEY_FORMAT, x, y, z, zoom, nn );
+	gchar *request = g_strdup_printf ( REQUEST_HASHKEY_FORMAT, origin.x, origin.y, origin.z, origin.scale, block, nn );
 
 	g_mutex_lock(tp_mutex);
 
@@ -742,12 +908,9 @@ static void thread_add (VikMapnikLayer *vml, MapCoord *mul, VikCoord *ul, VikCoo
 
 	RenderInfo *ri = g_malloc ( sizeof(RenderInfo) );
 	ri->vml = vml;
-	ri->ul = g_malloc ( sizeof(VikCoord) );
-	ri->br = g_malloc ( sizeof(VikCoord) );
 	ri->ulmc = g_malloc ( sizeof(MapCoord) );
-	memcpy(ri->ul, ul, sizeof(VikCoord));
-	memcpy(ri->br, br, sizeof(VikCoord));
-	memcpy(ri->ulmc, mul, sizeof(MapCoord));
+	memcpy(ri->ulmc, &origin, sizeof(MapCoord));
+	ri->block = block;
 	ri->request = request;
 
 	g_hash_table_insert ( requests, request, NULL );
@@ -755,7 +918,7 @@ static void thread_add (VikMapnikLayer *vml, MapCoord *mul, VikCoord *ul, VikCoo
 	g_mutex_unlock (tp_mutex);
 
 	gchar *basename = g_path_get_basename (name);
-	gchar *description = g_strdup_printf ( _("Mapnik Render %d:%d:%d %s"), zoom, x, y, basename );
+	gchar *description = g_strdup_printf ( _("Mapnik Render %d:%d:%d %s"), origin.scale, origin.x, origin.y, basename );
 	g_free ( basename );
 	a_background_thread ( BACKGROUND_POOL_LOCAL_MAPNIK,
 	                      VIK_GTK_WINDOW_FROM_LAYER(vml),
@@ -774,22 +937,25 @@ static void thread_add (VikMapnikLayer *vml, MapCoord *mul, VikCoord *ul, VikCoo
  * If function returns GdkPixbuf properly, reference counter to this
  * buffer has to be decreased, when buffer is no longer needed.
  */
-static GdkPixbuf *load_pixbuf ( VikMapnikLayer *vml, MapCoord *ulm, MapCoord *brm, gboolean *rerender )
+static GdkPixbuf *load_pixbuf ( VikMapnikLayer *vml, MapCoord *ulm, gboolean *rerender )
 {
 	*rerender = FALSE;
 	GdkPixbuf *pixbuf = NULL;
-	gchar *filename = get_filename ( vml->file_cache_dir, ulm->x, ulm->y, ulm->scale );
+	gchar *filename = get_cache_filename ( vml, ulm );
 
 	GStatBuf gsb;
 	if ( g_stat ( filename, &gsb ) == 0 ) {
 		// Get from disk
 		GError *error = NULL;
-		pixbuf = gdk_pixbuf_new_from_file ( filename, &error );
+		if ( use_metatiles(vml) )
+			pixbuf = maps_layer_get_pixbuf_from_metatile ( vml->file_cache_dir, ulm->x, ulm->y, (17 - ulm->scale) );
+		else
+			pixbuf = gdk_pixbuf_new_from_file ( filename, &error );
 		if ( error ) {
 			g_warning ("%s: %s", __FUNCTION__, error->message );
 			g_error_free ( error );
 		}
-		else {
+		else if ( pixbuf ) {
 			if ( vml->alpha < 255 )
 				pixbuf = ui_pixbuf_set_alpha ( pixbuf, vml->alpha );
 			a_mapcache_add ( pixbuf, (mapcache_extra_t) { -42.0 }, ulm->x, ulm->y, ulm->z, MAP_ID_MAPNIK_RENDER, ulm->scale, vml->alpha, 0.0, 0.0, vml->filename_xml );
@@ -808,26 +974,24 @@ static GdkPixbuf *load_pixbuf ( VikMapnikLayer *vml, MapCoord *ulm, MapCoord *br
  * Caller has to decrease reference counter of returned
  * GdkPixbuf, when buffer is no longer needed.
  */
-static GdkPixbuf *get_pixbuf ( VikMapnikLayer *vml, MapCoord *ulm, MapCoord *brm )
+static GdkPixbuf *get_pixbuf ( VikMapnikLayer *vml, MapCoord *ulm )
 {
-	VikCoord ul; VikCoord br;
 	GdkPixbuf *pixbuf = NULL;
 
-	map_utils_iTMS_to_vikcoord (ulm, &ul);
-	map_utils_iTMS_to_vikcoord (brm, &br);
-
 	pixbuf = a_mapcache_get ( ulm->x, ulm->y, ulm->z, MAP_ID_MAPNIK_RENDER, ulm->scale, vml->alpha, 0.0, 0.0, vml->filename_xml );
 
 	if ( ! pixbuf ) {
 		gboolean rerender = FALSE;
 		if ( vml->use_file_cache && vml->file_cache_dir )
-			pixbuf = load_pixbuf ( vml, ulm, brm, &rerender );
+			pixbuf = load_pixbuf ( vml, ulm, &rerender );
 		if ( ! pixbuf || rerender ) {
 			if ( TRUE )
-				thread_add (vml, ulm, &ul, &br, ulm->x, ulm->y, ulm->z, ulm->scale, vml->filename_xml );
+				thread_add ( vml, ulm, vml->filename_xml );
 			else {
 				// Run in the foreground
-				render ( vml, &ul, &br, ulm );
+				MapCoord origin;
+				guint block = get_render_block ( vml, ulm, &origin );
+				render ( vml, &origin, block );
 				vik_layer_emit_update ( VIK_LAYER(vml), FALSE );
 			}
 		}
@@ -884,10 +1048,8 @@ static void mapnik_layer_draw ( VikMapnikLayer *vml, VikViewport *vvp )
 			for (gint y = ymin; y <= ymax; y++ ) {
 				ulm.x = x;
 				ulm.y = y;
-				brm.x = x+1;
-				brm.y = y+1;
 
-				pixbuf = get_pixbuf ( vml, &ulm, &brm );
+				pixbuf = get_pixbuf ( vml, &ulm );
 
 				if ( pixbuf ) {
 					map_utils_iTMS_to_vikcoord ( &ulm, &coord );
@@ -1049,21 +1211,14 @@ static void mapnik_layer_add_menu_items ( VikMapnikLayer *vml, GtkMenu *menu, gp
 }
 
 /**
- * Rerender a specific tile
+ * Rerender a specific tile (along with the rest of its render block)
  */
 static void mapnik_layer_rerender ( VikMapnikLayer *vml )
 {
 	MapCoord ulm;
 	// Requested position to map coord
 	map_utils_vikcoord_to_iTMS ( &vml->rerender_ul, vml->rerender_zoom, vml->rerender_zoom, &ulm );
-	// Reconvert back - thus getting the coordinate at the tile *ul corner*
-	map_utils_iTMS_to_vikcoord (&ulm, &vml->rerender_ul );
-	// Bottom right bound is simply +1 in TMS coords
-	MapCoord brm = ulm;
-	brm.x = brm.x+1;
-	brm.y = brm.y+1;
-	map_utils_iTMS_to_vikcoord (&brm, &vml->rerender_br );
-	thread_add (vml, &ulm, &vml->rerender_ul, &vml->rerender_br, ulm.x, ulm.y, ulm.z, ulm.scale, vml->filename_xml );
+	thread_add ( vml, &ulm, vml->filename_xml );
 }
 
 /**
@@ -1077,7 +1232,7 @@ static void mapnik_layer_tile_info ( VikMapnikLayer *vml )
 
 	mapcache_extra_t extra = a_mapcache_get_extra ( ulm.x, ulm.y, ulm.z, MAP_ID_MAPNIK_RENDER, ulm.scale, vml->alpha, 0.0, 0.0, vml->filename_xml );
 
-	gchar *filename = get_filename ( vml->file_cache_dir, ulm.x, ulm.y, ulm.scale );
+	gchar *filename = get_cache_filename ( vml, &ulm );
 	gchar *filemsg = NULL;
 	gchar *timemsg = NULL;
 
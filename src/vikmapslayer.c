@@ -38,11 +38,11 @@
 #include "background.h"
 #include "vikmapslayer.h"
 #include "metatile.h"
+#include "tilestore.h"
 #include "map_ids.h"
 
 #ifdef HAVE_SQLITE3_H
-#include "sqlite3.h"
-#include <gio/gio.h>
+#include "mbtiles.h"
 #endif
 
 #define MAP_FIXED_NAME "Map"
@@ -65,6 +65,9 @@ static guint SCALE_INC_DOWN = 4;
 #define VIK_SETTINGS_MAP_SCALE_SMALLER_ZOOM_FIRST "maps_scale_smaller_zoom_first"
 static gboolean SCALE_SMALLER_ZOOM_FIRST = TRUE;
 
+#define VIK_SETTINGS_MAP_ASYNC_DECODE "maps_async_decode"
+static gboolean ASYNC_DECODE = TRUE;
+
 #define VIK_SETTINGS_MAP_CACHE_NO_FILE_COLOR "maps_cache_status_no_file_color"
 #define VIK_SETTINGS_MAP_CACHE_EXPIRED_COLOR "maps_cache_status_expired_color"
 #define VIK_SETTINGS_MAP_CACHE_DOWNLOAD_ERROR_COLOR "maps_cache_status_download_error_color"
@@ -108,7 +111,7 @@ static VikLayerToolFuncStatus maps_layer_download_release ( VikMapsLayer *vml, G
 static VikLayerToolFuncStatus maps_layer_download_click ( VikMapsLayer *vml, GdkEventButton *event, VikViewport *vvp );
 static gpointer maps_layer_download_create ( VikWindow *vw, VikViewport *vvp );
 static void maps_layer_set_cache_dir ( VikMapsLayer *vml, const gchar *dir );
-static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const VikCoord *ul, const VikCoord *br, gint redownload );
+static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const VikCoord *ul, const VikCoord *br, gint redownload, gboolean for_view );
 static void maps_layer_add_menu_items ( VikMapsLayer *vml, GtkMenu *menu, VikLayersPanel *vlp, VikStdLayerMenuItem selection, GtkTreeIter *iter );
 static guint map_uniq_id_to_index ( guint uniq_id );
 
@@ -136,7 +139,7 @@ static VikLayerParamData file_default ( void )
 static VikLayerParamData alpha_default ( void ) { return VIK_LPD_UINT ( 255 ); }
 static VikLayerParamData mapzoom_default ( void ) { return VIK_LPD_UINT ( 0 ); }
 
-static gchar *cache_types[] = { "Viking", N_("OSM"), NULL };
+static gchar *cache_types[] = { "Viking", N_("OSM"), N_("Packed"), NULL };
 static VikMapsCacheLayout cache_layout_default_value = VIK_MAPS_CACHE_LAYOUT_OSM;
 static VikLayerParamData cache_layout_default ( void ) { return VIK_LPD_UINT ( cache_layout_default_value ); }
 
@@ -325,8 +328,9 @@ struct _VikMapsLayer {
   VikViewport *redownload_vvp;
   gchar *filename;
 #ifdef HAVE_SQLITE3_H
-  sqlite3 *mbtiles;
+  MBTiles *mbtiles;
 #endif
+  guint dl_view_group; // Downloads for the current view, that are cancelled when the view moves on
 };
 
 enum { REDOWNLOAD_NONE = 0,    /* download only missing maps */
@@ -349,6 +353,13 @@ static VikLayerParam prefs[] = {
 static GMutex *rq_mutex;
 static GHashTable *requests = NULL;
 
+// Similarly global tracking of tiles being loaded from disk in the background
+static GMutex *dc_mutex;
+static GHashTable *decodes = NULL;
+// Tiles found not to be available, so they aren't tried again on every draw until downloaded
+//  (also protected by dc_mutex)
+static GHashTable *decode_misses = NULL;
+
 static GdkColor black_color;
 
 static GdkColor cache_no_file_color;
@@ -394,11 +405,18 @@ void maps_layer_init ()
   if ( a_settings_get_boolean ( VIK_SETTINGS_MAP_SCALE_SMALLER_ZOOM_FIRST, &gbtmp ) )
     SCALE_SMALLER_ZOOM_FIRST = gbtmp;
 
+  if ( a_settings_get_boolean ( VIK_SETTINGS_MAP_ASYNC_DECODE, &gbtmp ) )
+    ASYNC_DECODE = gbtmp;
+
   rq_mutex = vik_mutex_new();
 
   // Just storing keys only
   requests = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
 
+  dc_mutex = vik_mutex_new();
+  decodes = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+  decode_misses = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+
   (void)gdk_color_parse ( "#000000", &black_color );
 
   // Defaults - sort of traffic light scheme style
@@ -419,6 +437,10 @@ void maps_layer_uninit ()
   vik_mutex_free ( rq_mutex );
   g_hash_table_destroy ( requests );
   rq_mutex = NULL;
+  vik_mutex_free ( dc_mutex );
+  g_hash_table_destroy ( decodes );
+  g_hash_table_destroy ( decode_misses );
+  dc_mutex = NULL;
   g_strfreev ( params_maptypes );
   g_free ( params_maptypes_ids );
   g_list_free_full ( __map_types, g_object_unref );
@@ -569,6 +591,8 @@ gchar *vik_maps_layer_get_map_label(VikMapsLayer *vml)
 #define DIRECTDIRACCESS "%s%d" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d%s"
 #define DIRECTDIRACCESS_WITH_NAME "%s%s" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d%s"
 #define DIRSTRUCTURE "%st%ds%dz%d" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d"
+#define PACKEDACCESS "%s%d" G_DIR_SEPARATOR_S "%d_%d.tiles"
+#define PACKEDACCESS_WITH_NAME "%s%s" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d_%d.tiles"
 #define MAPS_CACHE_DIR maps_layer_default_dir()
 
 #ifdef WINDOWS
@@ -947,6 +971,8 @@ static VikMapsLayer *maps_layer_new ( VikViewport *vvp )
 
 static void maps_layer_free ( VikMapsLayer *vml )
 {
+  if ( vml->dl_view_group )
+    a_download_cancel_group ( vml->dl_view_group, TRUE );
   g_free ( vml->cache_dir );
   vml->cache_dir = NULL;
   if ( vml->dl_right_click_menu )
@@ -959,13 +985,9 @@ static void maps_layer_free ( VikMapsLayer *vml )
 #ifdef HAVE_SQLITE3_H
   VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
   if ( vik_map_source_is_mbtiles ( map ) ) {
-    if ( vml->mbtiles ) {
-      int ans = sqlite3_close ( vml->mbtiles );
-      if ( ans != SQLITE_OK ) {
-        // Only to console for information purposes only
-        g_warning ( "%s: SQL Close problem: %s", __FUNCTION__, sqlite3_errstr(ans) );
-      }
-    }
+    // NB Any background decodes still in progress hold their own reference
+    mbtiles_unref ( vml->mbtiles );
+    vml->mbtiles = NULL;
   }
 #endif
 }
@@ -978,81 +1000,12 @@ static gchar* maps_layer_get_new_name ( VikLayer *vl )
 }
 
 #ifdef HAVE_SQLITE3_H
-static gboolean check_is_mbtiles_file ( sqlite3 *sql )
-{
-  sqlite3_stmt *sql_stmt = NULL;
-  // Stackoverflow suggests something like this should work:
-  // int ans = sqlite3_prepare_v2 ( sql, "SELECT count(*) FROM sqlite_master WHERE type='table' AND name='tiles' COLLATE NOCASE;", -1, &sql_stmt, NULL );
-  // But it doesn't
-
-  // This seems more reliable instead
-  int ans = sqlite3_prepare_v2 ( sql, "SELECT count(*) FROM tiles;", -1, &sql_stmt, NULL );
-  (void)sqlite3_finalize ( sql_stmt );
-  // NB we don't care if any 'metadata' table exists or not
-
-  if ( ans != SQLITE_OK ) {
-    g_warning ( "%s: %s[%d]: %s - %s", __FUNCTION__, "failure", ans, sqlite3_errstr(ans), "no 'tiles' table found" );
-    return FALSE;
-  }
-  return TRUE;
-}
-
-// returns: TRUE if metadata value is present
-// value: Allocated if call successful
-gboolean mbtiles_get_metadata_value ( sqlite3 *sql, gchar *name, gchar **value )
-{
-  gboolean result = FALSE;
-  sqlite3_stmt *sql_stmt = NULL;
-  gchar *cmd = g_strdup_printf ( "SELECT value FROM metadata WHERE name='%s';", name );
-  int ans = sqlite3_prepare_v2 ( sql, cmd, -1, &sql_stmt, NULL );
-  if ( ans == SQLITE_OK ) {
-    ans = sqlite3_step ( sql_stmt );
-    switch (ans) {
-    case SQLITE_ROW: // Only care about 1st row
-    case SQLITE_DONE: {
-      int count = sqlite3_column_count ( sql_stmt );
-      if ( count == 1 )  {
-        int ctype = sqlite3_column_type ( sql_stmt, 0 );
-        if ( ctype == SQLITE_TEXT ) {
-          result = TRUE;
-          *value = g_strdup ( (gchar*)sqlite3_column_text ( sql_stmt, 0 ) );
-        }
-      }
-      break;
-    }
-    default:
-      // e.g. SQLITE_ERROR | SQLITE_MISUSE | etc...
-      g_warning ( "%s: %s - %s", __FUNCTION__, "step issue", sqlite3_errstr(ans) );
-    }
-  }
-  (void)sqlite3_finalize ( sql_stmt );
-  return result;
-}
-
-static gboolean check_mbtiles_file_for_supported_format ( sqlite3 *sql )
-{
-  gchar *format = NULL;
-  gboolean result = mbtiles_get_metadata_value ( sql, "format", &format );
-  if ( result ) {
-    g_debug ( "%s: format found is: %s", __FUNCTION__, format );
-    if ( !g_strcmp0 ( format, "pbf" ) )
-      result = FALSE;
-    g_free ( format );
-  }
-  else
-    // No metadata format information found
-    // So assume contents are compatible
-    result = TRUE;
-
-  return result;
-}
-
-static void mbtiles_file_info ( VikMapsLayer *vml, sqlite3 *sql )
+static void mbtiles_file_info ( VikMapsLayer *vml, MBTiles *mbt )
 {
   gchar *name = NULL;
-  (void)mbtiles_get_metadata_value ( sql, "name", &name );
+  (void)mbtiles_get_metadata_value ( mbt, "name", &name );
   gchar *description = NULL;
-  (void)mbtiles_get_metadata_value ( sql, "description", &description );
+  (void)mbtiles_get_metadata_value ( mbt, "description", &description );
 
   // Maybe use better string builder (GString?), otherwise for two lines this is okish
   gchar *msg = NULL;
@@ -1074,40 +1027,27 @@ static void mbtiles_file_info ( VikMapsLayer *vml, sqlite3 *sql )
 
 static void maps_layer_mbtiles_open ( VikMapsLayer *vml, VikViewport *vp, VikMapSource *map )
 {
-  // Do some SQL stuff
   if ( vik_map_source_is_mbtiles ( map ) ) {
-    int ans = sqlite3_open_v2 ( vml->filename,
-                                &(vml->mbtiles),
-                                SQLITE_OPEN_READONLY,
-                                NULL );
-    if ( ans != SQLITE_OK ) {
-      // That didn't work, so here's why:
-      g_warning ( "%s: %s", __FUNCTION__, sqlite3_errmsg ( vml->mbtiles ) );
-
+    MBTilesOpenResult result;
+    vml->mbtiles = mbtiles_open ( vml->filename, &result );
+    switch ( result ) {
+    case MBTILES_OPEN_FAILED:
       a_dialog_error_msg_extra ( VIK_GTK_WINDOW_FROM_WIDGET(vp),
                                  _("Failed to open MBTiles file: %s"),
                                  vml->filename );
-      (void)sqlite3_close ( vml->mbtiles );
-      vml->mbtiles = NULL;
-    }
-    else {
-
-      if ( !check_is_mbtiles_file ( vml->mbtiles ) ) {
-        a_dialog_error_msg_extra ( VIK_GTK_WINDOW_FROM_WIDGET(vp),
-                                   _("Not a valid MBTiles file: %s"),
-                                   vml->filename );
-        (void)sqlite3_close ( vml->mbtiles );
-        vml->mbtiles = NULL;
-      }
-      else {
-        if ( !check_mbtiles_file_for_supported_format ( vml->mbtiles ) ) {
-          a_dialog_error_msg_extra ( VIK_GTK_WINDOW_FROM_WIDGET(vp),
-                                     _("MBTiles not in a supported format: %s"),
-                                     vml->filename );
-          (void)sqlite3_close ( vml->mbtiles );
-          vml->mbtiles = NULL;
-        }
-      }
+      break;
+    case MBTILES_OPEN_NOT_MBTILES:
+      a_dialog_error_msg_extra ( VIK_GTK_WINDOW_FROM_WIDGET(vp),
+                                 _("Not a valid MBTiles file: %s"),
+                                 vml->filename );
+      break;
+    case MBTILES_OPEN_UNSUPPORTED_FORMAT:
+      a_dialog_error_msg_extra ( VIK_GTK_WINDOW_FROM_WIDGET(vp),
+                                 _("MBTiles not in a supported format: %s"),
+                                 vml->filename );
+      break;
+    default:
+      break;
     }
   }
 }
@@ -1189,116 +1129,25 @@ static GdkPixbuf *pixbuf_shrink ( GdkPixbuf *pixbuf, gdouble xshrinkfactor, gdou
   return tmp;
 }
 
-#ifdef HAVE_SQLITE3_H
-/*
-static int sql_select_tile_dump_cb (void *data, int cols, char **fields, char **col_names )
-{
-  g_warning ( "Found %d columns", cols );
-  int i;
-  for ( i = 0; i < cols; i++ ) {
-    g_warning ( "SQL processing %s = %s", col_names[i], fields[i] );
-  }
-  return 0;
-}
-*/
-
-/**
- *
- */
-static GdkPixbuf *get_pixbuf_sql_exec ( sqlite3 *sql, gint xx, gint yy, gint zoom )
-{
-  GdkPixbuf *pixbuf = NULL;
-
-  // MBTiles stored internally with the flipping y thingy (i.e. TMS scheme).
-  gint flip_y = (gint) pow(2, zoom)-1 - yy;
-  gchar *statement = g_strdup_printf ( "SELECT tile_data FROM tiles WHERE zoom_level=%d AND tile_column=%d AND tile_row=%d;", zoom, xx, flip_y );
-
-  gboolean finished = FALSE;
-
-  sqlite3_stmt *sql_stmt = NULL;
-  int ans = sqlite3_prepare_v2 ( sql, statement, -1, &sql_stmt, NULL );
-  if ( ans != SQLITE_OK ) {
-    g_warning ( "%s: %s - %s: %s", __FUNCTION__, "prepare failure", sqlite3_errstr(ans), statement );
-    finished = TRUE;
-  }
-
-  while ( !finished ) {
-    ans = sqlite3_step ( sql_stmt );
-    switch (ans) {
-      case SQLITE_ROW: {
-        // Get tile_data blob
-        int count = sqlite3_column_count(sql_stmt);
-        if ( count != 1 )  {
-          g_warning ( "%s: %s - %d", __FUNCTION__, "count not one", count );
-          finished = TRUE;
-        }
-        else {
-          const void *data = sqlite3_column_blob ( sql_stmt, 0 );
-          int bytes = sqlite3_column_bytes ( sql_stmt, 0 );
-          if ( bytes < 1 )  {
-            g_warning ( "%s: %s (%d)", __FUNCTION__, "not enough bytes", bytes );
-            finished = TRUE;
-          }
-          else {
-            // Convert these blob bytes into a pixbuf via these streaming operations
-            GInputStream *stream = g_memory_input_stream_new_from_data ( data, bytes, NULL );
-            GError *error = NULL;
-            pixbuf = gdk_pixbuf_new_from_stream ( stream, NULL, &error );
-            if ( error ) {
-              g_warning ( "%s: %s", __FUNCTION__, error->message );
-              g_error_free ( error );
-            }
-            g_input_stream_close ( stream, NULL, NULL );
-          }
-        }
-        break;
-      }
-      default:
-       // e.g. SQLITE_DONE | SQLITE_ERROR | SQLITE_MISUSE | etc...
-       // Finished normally
-       //  and give up on any errors
-       if ( ans != SQLITE_DONE )
-         g_warning ( "%s: %s - %s", __FUNCTION__, "step issue", sqlite3_errstr(ans) );
-       finished = TRUE;
-       break;
-    }
-  }
-  (void)sqlite3_finalize ( sql_stmt );
-
-  g_free ( statement );
-
-  return pixbuf;
-}
-#endif
-
 static GdkPixbuf *get_mbtiles_pixbuf ( VikMapsLayer *vml, gint xx, gint yy, gint zoom )
 {
   GdkPixbuf *pixbuf = NULL;
 
 #ifdef HAVE_SQLITE3_H
-  if ( vml->mbtiles ) {
-    /*
-    gchar *statement = g_strdup_printf ( "SELECT name FROM sqlite_master WHERE type='table';" );
-    char *errMsg = NULL;
-    int ans = sqlite3_exec ( vml->mbtiles, statement, sql_select_tile_dump_cb, pixbuf, &errMsg );
-    if ( ans != SQLITE_OK ) {
-      // Only to console for information purposes only
-      g_warning ( "SQL problem: %d for %s - error: %s", ans, statement, errMsg );
-      sqlite3_free( errMsg );
-    }
-    g_free ( statement );
-    */
-
-    // Reading BLOBS is a bit more involved and so can't use the simpler sqlite3_exec ()
-    // Hence this specific function
-    pixbuf = get_pixbuf_sql_exec ( vml->mbtiles, xx, yy, zoom );
-  }
+  if ( vml->mbtiles )
+    pixbuf = mbtiles_get_pixbuf ( vml->mbtiles, xx, yy, zoom );
 #endif
 
   return pixbuf;
 }
 
-static GdkPixbuf *get_pixbuf_from_metatile ( VikMapsLayer *vml, gint xx, gint yy, gint zz )
+/**
+ * maps_layer_get_pixbuf_from_metatile:
+ *
+ * Read a tile from a mod_tile .meta file under the cache_dir
+ *  (also used by the Mapnik Rendering layer)
+ */
+GdkPixbuf *maps_layer_get_pixbuf_from_metatile ( const gchar *cache_dir, gint xx, gint yy, gint zz )
 {
   const int tile_max = METATILE_MAX_SIZE;
   char err_msg[PATH_MAX];
@@ -1312,7 +1161,7 @@ static GdkPixbuf *get_pixbuf_from_metatile ( VikMapsLayer *vml, gint xx, gint yy
   }
 
   err_msg[0] = 0;
-  len = metatile_read(vml->cache_dir, xx, yy, zz, buf, tile_max, &compressed, err_msg);
+  len = metatile_read(cache_dir, xx, yy, zz, buf, tile_max, &compressed, err_msg);
 
   if (len > 0) {
     if (compressed) {
@@ -1344,17 +1193,29 @@ static GdkPixbuf *get_pixbuf_from_metatile ( VikMapsLayer *vml, gint xx, gint yy
   }
 }
 
+/*
+ * Decode a tile image held in memory
+ */
+static GdkPixbuf *get_pixbuf_from_content ( GBytes *content, GError **error )
+{
+  GInputStream *stream = g_memory_input_stream_new_from_bytes ( content );
+  GdkPixbuf *pixbuf = gdk_pixbuf_new_from_stream ( stream, NULL, error );
+  g_object_unref ( stream );
+  return pixbuf;
+}
+
 /**
  * Caller has to decrease reference counter of returned
  * GdkPixbuf, when buffer is no longer needed.
+ *
+ * Can be called from any thread.
  */
-static GdkPixbuf *pixbuf_apply_settings ( GdkPixbuf *pixbuf, VikMapsLayer *vml, guint vp_scale,
-                                          MapCoord *mapcoord, gdouble xshrinkfactor, gdouble yshrinkfactor, guint status )
+static GdkPixbuf *pixbuf_apply_settings_full ( GdkPixbuf *pixbuf, VikMapSource *map, guint8 alpha, const gchar *name, guint vp_scale,
+                                               MapCoord *mapcoord, gdouble xshrinkfactor, gdouble yshrinkfactor, guint status )
 {
-  VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
   // Apply alpha setting
-  if ( pixbuf && vml->alpha < 255 )
-    pixbuf = ui_pixbuf_set_alpha ( pixbuf, vml->alpha );
+  if ( pixbuf && alpha < 255 )
+    pixbuf = ui_pixbuf_set_alpha ( pixbuf, alpha );
 
   if ( pixbuf && ( xshrinkfactor != 1.0 || yshrinkfactor != 1.0 ) )
      pixbuf = pixbuf_shrink ( pixbuf, xshrinkfactor, yshrinkfactor );
@@ -1373,11 +1234,22 @@ static GdkPixbuf *pixbuf_apply_settings ( GdkPixbuf *pixbuf, VikMapsLayer *vml,
   if ( pixbuf )
     a_mapcache_add ( pixbuf, (mapcache_extra_t){0.0, status}, mapcoord->x, mapcoord->y,
                      mapcoord->z, vik_map_source_get_uniq_id(map),
-                     mapcoord->scale, vml->alpha, xshrinkfactor, yshrinkfactor, vml->filename );
+                     mapcoord->scale, alpha, xshrinkfactor, yshrinkfactor, name );
 
   return pixbuf;
 }
 
+/**
+ * Caller has to decrease reference counter of returned
+ * GdkPixbuf, when buffer is no longer needed.
+ */
+static GdkPixbuf *pixbuf_apply_settings ( GdkPixbuf *pixbuf, VikMapsLayer *vml, guint vp_scale,
+                                          MapCoord *mapcoord, gdouble xshrinkfactor, gdouble yshrinkfactor, guint status )
+{
+  return pixbuf_apply_settings_full ( pixbuf, MAPS_LAYER_NTH_TYPE(vml->maptype), vml->alpha, vml->filename, vp_scale,
+                                      mapcoord, xshrinkfactor, yshrinkfactor, status );
+}
+
 static void get_filename ( const gchar *cache_dir,
                            VikMapsCacheLayout cl,
                            guint16 id,
@@ -1403,12 +1275,99 @@ static void get_filename ( const gchar *cache_dir,
       else
         g_snprintf ( filename_buf, buf_len, DIRECTDIRACCESS, cache_dir, (17 - scale), x, y, file_extension );
       break;
+    case VIK_MAPS_CACHE_LAYOUT_PACKED:
+      // As OSM, but the file holds a block of tiles
+      x = x / TILESTORE_BUCKET_SIZE;
+      y = y / TILESTORE_BUCKET_SIZE;
+      if ( name && !g_strcmp0 ( cache_dir, MAPS_CACHE_DIR ) )
+        g_snprintf ( filename_buf, buf_len, PACKEDACCESS_WITH_NAME, cache_dir, name, (17 - scale), x, y );
+      else
+        g_snprintf ( filename_buf, buf_len, PACKEDACCESS, cache_dir, (17 - scale), x, y );
+      break;
     default:
       g_snprintf ( filename_buf, buf_len, DIRSTRUCTURE, cache_dir, id, scale, z, x, y );
       break;
   }
 }
 
+/*
+ * The following access a tile in the cache, given the filename from get_filename()
+ */
+static gboolean tile_exists ( VikMapsCacheLayout cl, const gchar *filename, gint x, gint y )
+{
+  if ( cl == VIK_MAPS_CACHE_LAYOUT_PACKED )
+    return a_tilestore_get_info ( filename, x, y, NULL, NULL );
+  return g_file_test ( filename, G_FILE_TEST_EXISTS );
+}
+
+static gboolean tile_get_mtime ( VikMapsCacheLayout cl, const gchar *filename, gint x, gint y, time_t *mtime )
+{
+  if ( cl == VIK_MAPS_CACHE_LAYOUT_PACKED )
+    return a_tilestore_get_info ( filename, x, y, mtime, NULL );
+  GStatBuf buf;
+  if ( g_stat(filename, &buf) != 0 )
+    return FALSE;
+  *mtime = buf.st_mtime;
+  return TRUE;
+}
+
+static gboolean tile_remove ( VikMapsCacheLayout cl, const gchar *filename, gint x, gint y )
+{
+  if ( cl == VIK_MAPS_CACHE_LAYOUT_PACKED )
+    return a_tilestore_remove ( filename, x, y );
+  return g_remove ( filename ) == 0;
+}
+
+static GdkPixbuf *tile_get_pixbuf ( VikMapsCacheLayout cl, const gchar *filename, gint x, gint y, GError **error )
+{
+  if ( cl == VIK_MAPS_CACHE_LAYOUT_PACKED ) {
+    GBytes *content = a_tilestore_read ( filename, x, y );
+    if ( !content ) {
+      g_set_error ( error, G_FILE_ERROR, G_FILE_ERROR_NOENT, "No tile %d,%d in %s", x, y, filename );
+      return NULL;
+    }
+    GdkPixbuf *pixbuf = get_pixbuf_from_content ( content, error );
+    g_bytes_unref ( content );
+    return pixbuf;
+  }
+  return gdk_pixbuf_new_from_file ( filename, error );
+}
+
+/**
+ * Read a tile image file (which must exist)
+ *  and determine the cache status to be used for it.
+ *
+ * Can be called from any thread.
+ */
+static GdkPixbuf *get_pixbuf_from_file ( VikMapsCacheLayout cl, const gchar *filename, guint16 id, MapCoord *mapcoord, guint8 alpha,
+                                         gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar *name,
+                                         guint cache_expiry_age, guint *status, GError **error )
+{
+  GdkPixbuf *pixbuf = tile_get_pixbuf ( cl, filename, mapcoord->x, mapcoord->y, error );
+
+  /* free the pixbuf on error */
+  if ( *error ) {
+    if ( pixbuf )
+      g_object_unref ( G_OBJECT(pixbuf) );
+    return NULL;
+  }
+
+  // Maintain any download result status value that is already in the mapcache
+  mapcache_extra_t extra = a_mapcache_get_extra ( mapcoord->x, mapcoord->y, mapcoord->z, id, mapcoord->scale,
+                                                  alpha, xshrinkfactor, yshrinkfactor, name );
+  *status = extra.status;
+  if ( extra.status >= DOWNLOAD_SUCCESS ) {
+    // On read in from file, check expiry value
+    time_t file_time;
+    if ( tile_get_mtime(cl, filename, mapcoord->x, mapcoord->y, &file_time) ) {
+      *status = DOWNLOAD_SUCCESS;
+      if ( (time(NULL) - file_time) > cache_expiry_age )
+        *status = MAPCACHE_STATUS_FILE_EXPIRED;
+    }
+  }
+  return pixbuf;
+}
+
 /**
  * Caller has to decrease reference counter of returned
  * GdkPixbuf, when buffer is no longer needed.
@@ -1424,6 +1383,7 @@ static GdkPixbuf *get_pixbuf ( VikMapsLayer *vml, guint16 id, guint vp_scale, co
 
   if ( ! pixbuf ) {
     VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
+    VikMapsCacheLayout cl = vml->cache_layout;
     if ( vik_map_source_is_direct_file_access(map) ) {
       // ATM MBTiles must be 'a direct access type'
       if ( vik_map_source_is_mbtiles(map) ) {
@@ -1433,26 +1393,28 @@ static GdkPixbuf *get_pixbuf ( VikMapsLayer *vml, guint16 id, guint vp_scale, co
         return pixbuf;
       }
       else if ( vik_map_source_is_osm_meta_tiles(map) ) {
-        pixbuf = get_pixbuf_from_metatile ( vml, mapcoord->x, mapcoord->y, (17 - mapcoord->scale) );
+        pixbuf = maps_layer_get_pixbuf_from_metatile ( vml->cache_dir, mapcoord->x, mapcoord->y, (17 - mapcoord->scale) );
         pixbuf = pixbuf_apply_settings ( pixbuf, vml, vp_scale, mapcoord, xshrinkfactor, yshrinkfactor, DOWNLOAD_SUCCESS );
         return pixbuf;
       }
-      else
-        get_filename ( vml->cache_dir, VIK_MAPS_CACHE_LAYOUT_OSM, id, NULL,
+      else {
+        cl = VIK_MAPS_CACHE_LAYOUT_OSM;
+        get_filename ( vml->cache_dir, cl, id, NULL,
                        mapcoord->scale, mapcoord->z, mapcoord->x, mapcoord->y, filename_buf, buf_len,
                        vik_map_source_get_file_extension(map) );
+      }
     }
     else
-      get_filename ( vml->cache_dir, vml->cache_layout, id, mapname,
+      get_filename ( vml->cache_dir, cl, id, mapname,
                      mapcoord->scale, mapcoord->z, mapcoord->x, mapcoord->y, filename_buf, buf_len,
                      vik_map_source_get_file_extension(map) );
 
-    if ( g_file_test ( filename_buf, G_FILE_TEST_EXISTS ) == TRUE)
+    if ( tile_exists ( cl, filename_buf, mapcoord->x, mapcoord->y ) )
     {
       GError *gx = NULL;
-      pixbuf = gdk_pixbuf_new_from_file ( filename_buf, &gx );
-
-      /* free the pixbuf on error */
+      guint status = DOWNLOAD_SUCCESS;
+      pixbuf = get_pixbuf_from_file ( cl, filename_buf, id, mapcoord, vml->alpha, xshrinkfactor, yshrinkfactor, vml->filename,
+                                      vml->cache_expiry_age, &status, &gx );
       if (gx)
       {
         if ( gx->domain != GDK_PIXBUF_ERROR || gx->code != GDK_PIXBUF_ERROR_CORRUPT_IMAGE ) {
@@ -1463,26 +1425,8 @@ static GdkPixbuf *get_pixbuf ( VikMapsLayer *vml, guint16 id, guint vp_scale, co
             g_free (msg);
           }
         }
-
         g_error_free ( gx );
-        if ( pixbuf )
-          g_object_unref ( G_OBJECT(pixbuf) );
-        pixbuf = NULL;
       } else {
-        // Maintain any download result status value that is already in the mapcache
-        mapcache_extra_t extra = a_mapcache_get_extra ( mapcoord->x, mapcoord->y, mapcoord->z, id, mapcoord->scale,
-                                                        vml->alpha, xshrinkfactor, yshrinkfactor, vml->filename );
-        guint status = extra.status;
-        if ( extra.status >= DOWNLOAD_SUCCESS ) {
-          // On read in from file, check expiry value
-          GStatBuf buf;
-          if ( g_stat(filename_buf, &buf) == 0 ) {
-            status = DOWNLOAD_SUCCESS;
-            time_t file_time = buf.st_mtime;
-            if ( (time(NULL) - file_time) > vml->cache_expiry_age )
-              status = MAPCACHE_STATUS_FILE_EXPIRED;
-          }
-        }
         pixbuf = pixbuf_apply_settings ( pixbuf, vml, vp_scale, mapcoord, xshrinkfactor, yshrinkfactor, status );
       }
     }
@@ -1490,6 +1434,464 @@ static GdkPixbuf *get_pixbuf ( VikMapsLayer *vml, guint16 id, guint vp_scale, co
   return pixbuf;
 }
 
+/*****************************************/
+/****** BACKGROUND TILE DECODING *********/
+/*****************************************/
+
+/*
+ * Tiles not in the memory cache are read from disk and decoded on the local background threads,
+ *  whilst the draw uses whatever other scales of the tile are already available in the mapcache.
+ * Once a batch of tiles has been decoded a single redraw is requested.
+ */
+
+typedef struct {
+  MapCoord mapcoord;
+  gdouble xshrinkfactor;
+  gdouble yshrinkfactor;
+  gchar *request; // Key into the global 'decodes' table
+} TileDecode;
+
+/* Settings copied from the layer, so the workers don't access the layer itself */
+typedef struct {
+  VikMapsLayer *vml;
+  gboolean map_layer_alive;
+  GMutex *mutex;
+  gint jobs;    // Number of jobs still using this batch
+  gint decoded; // Number of tiles successfully decoded
+  VikMapSource *map;
+  gchar *cache_dir;
+  VikMapsCacheLayout cache_layout;
+  guint cache_expiry_age;
+  guint8 alpha;
+  gchar *filename;
+  guint vp_scale;
+#ifdef HAVE_SQLITE3_H
+  MBTiles *mbtiles;
+#endif
+} TileDecodeBatch;
+
+typedef struct {
+  TileDecodeBatch *batch;
+  GPtrArray *tiles; // Of TileDecode*
+} TileDecodeJob;
+
+/**
+ * Whether tiles of this map type can be decoded in the background
+ */
+static gboolean tile_decode_is_async ( VikMapsLayer *vml, VikMapSource *map )
+{
+  if ( vik_map_source_is_mbtiles ( map ) ) {
+#ifdef HAVE_SQLITE3_H
+    return vml->mbtiles != NULL;
+#else
+    return FALSE;
+#endif
+  }
+  return TRUE;
+}
+
+// Free after use
+static gchar *create_decode_string ( VikMapsLayer *vml, guint16 id, MapCoord *mapcoord, gdouble xshrinkfactor, gdouble yshrinkfactor )
+{
+  guint nn = vml->filename ? g_str_hash ( vml->filename ) : 0;
+  return g_strdup_printf ( "%d-%d-%d-%d-%d-%d-%u-%.3f-%.3f", id, mapcoord->x, mapcoord->y, mapcoord->z, mapcoord->scale,
+                           vml->alpha, nn, xshrinkfactor, yshrinkfactor );
+}
+
+// Free after use
+// Independent of how the tile is drawn, since the tile itself is missing
+static gchar *create_miss_string ( guint16 id, MapCoord *mapcoord, const gchar *cache_dir, const gchar *filename )
+{
+  guint nn = filename ? g_str_hash ( filename ) : 0;
+  guint cd = cache_dir ? g_str_hash ( cache_dir ) : 0;
+  return g_strdup_printf ( "%d-%d-%d-%d-%d-%u-%u", id, mapcoord->x, mapcoord->y, mapcoord->z, mapcoord->scale, nn, cd );
+}
+
+/**
+ * Remember the tile couldn't be loaded
+ */
+static void tile_decode_miss ( TileDecodeBatch *batch, TileDecode *td )
+{
+  gchar *miss = create_miss_string ( vik_map_source_get_uniq_id(batch->map), &td->mapcoord, batch->cache_dir, batch->filename );
+  if ( dc_mutex ) {
+    g_mutex_lock ( dc_mutex );
+    g_hash_table_add ( decode_misses, miss );
+    g_mutex_unlock ( dc_mutex );
+  }
+  else
+    g_free ( miss );
+}
+
+/**
+ * A new version of the tile may now be available
+ */
+static void tile_decode_miss_clear ( guint16 id, MapCoord *mapcoord, const gchar *cache_dir, const gchar *filename )
+{
+  if ( !dc_mutex )
+    return;
+  gchar *miss = create_miss_string ( id, mapcoord, cache_dir, filename );
+  g_mutex_lock ( dc_mutex );
+  (void)g_hash_table_remove ( decode_misses, miss );
+  g_mutex_unlock ( dc_mutex );
+  g_free ( miss );
+}
+
+static void tile_decode_free ( TileDecode *td )
+{
+  // NB request string is owned by the 'decodes' table
+  g_free ( td );
+}
+
+/**
+ * Add a tile to the list of ones to be decoded,
+ *  unless it is already being decoded (e.g. from a previous draw) or is known to be missing
+ */
+static void tile_decode_queue ( GPtrArray *pending, VikMapsLayer *vml, guint16 id, MapCoord *mapcoord, gdouble xshrinkfactor, gdouble yshrinkfactor )
+{
+  gchar *request = create_decode_string ( vml, id, mapcoord, xshrinkfactor, yshrinkfactor );
+  gchar *miss = create_miss_string ( id, mapcoord, vml->cache_dir, vml->filename );
+  g_mutex_lock ( dc_mutex );
+  gboolean skip = g_hash_table_lookup_extended(decodes, request, NULL, NULL) || g_hash_table_contains(decode_misses, miss);
+  g_free ( miss );
+  if ( skip ) {
+    g_mutex_unlock ( dc_mutex );
+    g_free ( request );
+    return;
+  }
+  g_hash_table_insert ( decodes, request, NULL );
+  g_mutex_unlock ( dc_mutex );
+
+  TileDecode *td = g_malloc ( sizeof(TileDecode) );
+  td->mapcoord = *mapcoord;
+  td->xshrinkfactor = xshrinkfactor;
+  td->yshrinkfactor = yshrinkfactor;
+  td->request = request;
+  g_ptr_array_add ( pending, td );
+}
+
+static void tile_decode_complete ( TileDecode *td )
+{
+  // Ensure mutex (and therefore hash) is available
+  //  as can become unavailable on program exit
+  //  yet this function may still be called from existing threads
+  if ( dc_mutex && td->request ) {
+    g_mutex_lock ( dc_mutex );
+    (void)g_hash_table_remove ( decodes, td->request );
+    g_mutex_unlock ( dc_mutex );
+  }
+  td->request = NULL;
+}
+
+/**
+ * Load & process the tile, storing the result in the mapcache
+ */
+static gboolean tile_decode ( TileDecodeBatch *batch, TileDecode *td )
+{
+  VikMapSource *map = batch->map;
+  const guint16 id = vik_map_source_get_uniq_id ( map );
+  MapCoord *mapcoord = &td->mapcoord;
+  GdkPixbuf *pixbuf = NULL;
+
+#ifdef HAVE_SQLITE3_H
+  if ( batch->mbtiles ) {
+    pixbuf = mbtiles_get_pixbuf ( batch->mbtiles, mapcoord->x, mapcoord->y, (17 - mapcoord->scale) );
+    pixbuf = pixbuf_apply_settings_full ( pixbuf, map, batch->alpha, batch->filename, batch->vp_scale,
+                                          mapcoord, td->xshrinkfactor, td->yshrinkfactor, DOWNLOAD_SUCCESS );
+  }
+  else
+#endif
+  if ( vik_map_source_is_osm_meta_tiles(map) ) {
+    pixbuf = maps_layer_get_pixbuf_from_metatile ( batch->cache_dir, mapcoord->x, mapcoord->y, (17 - mapcoord->scale) );
+    pixbuf = pixbuf_apply_settings_full ( pixbuf, map, batch->alpha, batch->filename, batch->vp_scale,
+                                          mapcoord, td->xshrinkfactor, td->yshrinkfactor, DOWNLOAD_SUCCESS );
+  }
+  else {
+    guint max_path_len = strlen(batch->cache_dir) + 40;
+    gchar *path_buf = g_malloc ( max_path_len * sizeof(char) );
+    VikMapsCacheLayout cl = batch->cache_layout;
+    if ( vik_map_source_is_direct_file_access(map) ) {
+      cl = VIK_MAPS_CACHE_LAYOUT_OSM;
+      get_filename ( batch->cache_dir, cl, id, NULL,
+                     mapcoord->scale, mapcoord->z, mapcoord->x, mapcoord->y, path_buf, max_path_len,
+                     vik_map_source_get_file_extension(map) );
+    }
+    else
+      get_filename ( batch->cache_dir, cl, id, vik_map_source_get_name(map),
+                     mapcoord->scale, mapcoord->z, mapcoord->x, mapcoord->y, path_buf, max_path_len,
+                     vik_map_source_get_file_extension(map) );
+
+    if ( tile_exists ( cl, path_buf, mapcoord->x, mapcoord->y ) ) {
+      GError *gx = NULL;
+      guint status = DOWNLOAD_SUCCESS;
+      pixbuf = get_pixbuf_from_file ( cl, path_buf, id, mapcoord, batch->alpha, td->xshrinkfactor, td->yshrinkfactor,
+                                      batch->filename, batch->cache_expiry_age, &status, &gx );
+      if ( gx ) {
+        // Can't report to the statusbar from here
+        g_debug ( "%s: %s", __FUNCTION__, gx->message );
+        g_error_free ( gx );
+      }
+      else
+        pixbuf = pixbuf_apply_settings_full ( pixbuf, map, batch->alpha, batch->filename, batch->vp_scale,
+                                              mapcoord, td->xshrinkfactor, td->yshrinkfactor, status );
+    }
+    g_free ( path_buf );
+  }
+
+  if ( pixbuf ) {
+    g_object_unref ( pixbuf );
+    return TRUE;
+  }
+  return FALSE;
+}
+
+static void tile_decode_weak_ref_cb ( gpointer ptr, GObject *dead_vml )
+{
+  TileDecodeBatch *batch = ptr;
+  g_mutex_lock ( batch->mutex );
+  batch->map_layer_alive = FALSE;
+  g_mutex_unlock ( batch->mutex );
+}
+
+static int tile_decode_tiles ( TileDecodeJob *job, gpointer threaddata )
+{
+  for ( guint ii = 0; ii < job->tiles->len; ii++ ) {
+    TileDecode *td = g_ptr_array_index ( job->tiles, ii );
+    int res = a_background_thread_progress ( threaddata, ((gdouble)ii+1) / job->tiles->len ); /* this also calls testcancel */
+    if ( res != 0 )
+      return -1; // Remaining requests are cleared when the job is freed
+    if ( tile_decode ( job->batch, td ) )
+      g_atomic_int_inc ( &job->batch->decoded );
+    else
+      tile_decode_miss ( job->batch, td );
+    tile_decode_complete ( td );
+  }
+  return 0;
+}
+
+#ifdef HAVE_SQLITE3_H
+typedef struct {
+  TileDecodeJob *job;
+  gpointer threaddata;
+  TileDecode **grid; // Tiles of the job indexed by position within the area
+  gint xmin;
+  gint ymin;
+  gint width;
+  gint height;
+  guint done;
+  gboolean cancelled;
+} MBTilesArea;
+
+static gboolean mbtiles_area_cb ( gint x, gint y, GdkPixbuf *pixbuf, gpointer user_data )
+{
+  MBTilesArea *area = user_data;
+  TileDecodeBatch *batch = area->job->batch;
+  gint xx = x - area->xmin;
+  gint yy = y - area->ymin;
+  TileDecode *td = NULL;
+  if ( xx >= 0 && xx < area->width && yy >= 0 && yy < area->height )
+    td = area->grid[yy*area->width + xx];
+  if ( !td ) {
+    // Within the bounding box but not a requested tile
+    g_object_unref ( pixbuf );
+    return TRUE;
+  }
+
+  area->grid[yy*area->width + xx] = NULL;
+  pixbuf = pixbuf_apply_settings_full ( pixbuf, batch->map, batch->alpha, batch->filename, batch->vp_scale,
+                                        &td->mapcoord, td->xshrinkfactor, td->yshrinkfactor, DOWNLOAD_SUCCESS );
+  if ( pixbuf ) {
+    g_object_unref ( pixbuf );
+    g_atomic_int_inc ( &batch->decoded );
+  }
+  tile_decode_complete ( td );
+
+  area->done++;
+  if ( a_background_thread_progress ( area->threaddata, ((gdouble)area->done) / area->job->tiles->len ) != 0 ) {
+    area->cancelled = TRUE;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/**
+ * Load all the tiles of the job (which are from the same zoom level) with a single query
+ */
+static int tile_decode_mbtiles_area ( TileDecodeJob *job, gpointer threaddata )
+{
+  TileDecode *first = g_ptr_array_index ( job->tiles, 0 );
+  gint xmin = first->mapcoord.x, xmax = first->mapcoord.x;
+  gint ymin = first->mapcoord.y, ymax = first->mapcoord.y;
+  for ( guint ii = 1; ii < job->tiles->len; ii++ ) {
+    TileDecode *td = g_ptr_array_index ( job->tiles, ii );
+    // Only expected to differ for maps without fixed size tiles
+    if ( td->mapcoord.scale != first->mapcoord.scale )
+      return tile_decode_tiles ( job, threaddata );
+    xmin = MIN ( xmin, td->mapcoord.x );
+    xmax = MAX ( xmax, td->mapcoord.x );
+    ymin = MIN ( ymin, td->mapcoord.y );
+    ymax = MAX ( ymax, td->mapcoord.y );
+  }
+
+  MBTilesArea area = { job, threaddata, NULL, xmin, ymin, xmax-xmin+1, ymax-ymin+1, 0, FALSE };
+  area.grid = g_malloc0 ( area.width * area.height * sizeof(TileDecode*) );
+  for ( guint ii = 0; ii < job->tiles->len; ii++ ) {
+    TileDecode *td = g_ptr_array_index ( job->tiles, ii );
+    TileDecode **slot = &area.grid[(td->mapcoord.y-ymin)*area.width + (td->mapcoord.x-xmin)];
+    if ( *slot ) {
+      // Same tile at different shrinkfactors
+      g_free ( area.grid );
+      return tile_decode_tiles ( job, threaddata );
+    }
+    *slot = td;
+  }
+
+  (void)mbtiles_get_pixbufs ( job->batch->mbtiles, 17 - first->mapcoord.scale, xmin, xmax, ymin, ymax, mbtiles_area_cb, &area );
+  if ( !area.cancelled ) {
+    // Whatever is left isn't in the file
+    for ( gint nn = 0; nn < area.width * area.height; nn++ )
+      if ( area.grid[nn] )
+        tile_decode_miss ( job->batch, area.grid[nn] );
+  }
+  g_free ( area.grid );
+
+  // Any tiles not in the file are cleared when the job is freed
+  return area.cancelled ? -1 : 0;
+}
+#endif
+
+static int tile_decode_thread ( TileDecodeJob *job, gpointer threaddata )
+{
+#ifdef HAVE_SQLITE3_H
+  if ( job->batch->mbtiles && job->tiles->len > 1 )
+    return tile_decode_mbtiles_area ( job, threaddata );
+#endif
+  return tile_decode_tiles ( job, threaddata );
+}
+
+/**
+ * Called after each job has finished or been cancelled
+ *  the last job of a batch triggers the redraw (if anything has been decoded)
+ */
+static void tile_decode_job_free ( TileDecodeJob *job )
+{
+  TileDecodeBatch *batch = job->batch;
+
+  g_ptr_array_foreach ( job->tiles, (GFunc)tile_decode_complete, NULL );
+  g_ptr_array_free ( job->tiles, TRUE );
+  g_free ( job );
+
+  if ( g_atomic_int_dec_and_test ( &batch->jobs ) ) {
+    g_mutex_lock ( batch->mutex );
+    if ( batch->map_layer_alive ) {
+      if ( g_atomic_int_get(&batch->decoded) )
+        vik_layer_emit_update ( VIK_LAYER(batch->vml), FALSE ); // NB update display from background
+      g_object_weak_unref ( G_OBJECT(batch->vml), tile_decode_weak_ref_cb, batch );
+    }
+    g_mutex_unlock ( batch->mutex );
+
+    vik_mutex_free ( batch->mutex );
+#ifdef HAVE_SQLITE3_H
+    mbtiles_unref ( batch->mbtiles );
+#endif
+    g_object_unref ( batch->map );
+    g_free ( batch->cache_dir );
+    g_free ( batch->filename );
+    g_free ( batch );
+  }
+}
+
+static void tile_decode_cancel_cleanup ( TileDecodeJob *job )
+{
+  // Nothing to undo - requests are cleared when freed
+}
+
+/**
+ * Split the pending tiles into a number of jobs for the local background threads
+ */
+static void tile_decode_start ( VikMapsLayer *vml, guint vp_scale, GPtrArray *pending )
+{
+  if ( pending->len == 0 ) {
+    g_ptr_array_free ( pending, TRUE );
+    return;
+  }
+
+  TileDecodeBatch *batch = g_malloc0 ( sizeof(TileDecodeBatch) );
+  batch->vml = vml;
+  batch->map_layer_alive = TRUE;
+  batch->mutex = vik_mutex_new();
+  batch->map = g_object_ref ( MAPS_LAYER_NTH_TYPE(vml->maptype) );
+  batch->cache_dir = g_strdup ( vml->cache_dir );
+  batch->cache_layout = vml->cache_layout;
+  batch->cache_expiry_age = vml->cache_expiry_age;
+  batch->alpha = vml->alpha;
+  batch->filename = g_strdup ( vml->filename );
+  batch->vp_scale = vp_scale;
+#ifdef HAVE_SQLITE3_H
+  if ( vml->mbtiles )
+    batch->mbtiles = mbtiles_ref ( vml->mbtiles );
+#endif
+
+  guint cpus = util_get_number_of_cpus ();
+  guint njobs = cpus > 1 ? cpus-1 : 1;
+  if ( njobs > pending->len )
+    njobs = pending->len;
+
+  TileDecodeJob **jobs = g_malloc ( njobs * sizeof(TileDecodeJob*) );
+  for ( guint jj = 0; jj < njobs; jj++ ) {
+    jobs[jj] = g_malloc ( sizeof(TileDecodeJob) );
+    jobs[jj]->batch = batch;
+    jobs[jj]->tiles = g_ptr_array_new_with_free_func ( (GDestroyNotify)tile_decode_free );
+  }
+#ifdef HAVE_SQLITE3_H
+  if ( batch->mbtiles ) {
+    // Contiguous runs of tiles (in draw order) so each job can fetch its tiles in one query
+    for ( guint ii = 0; ii < pending->len; ii++ )
+      g_ptr_array_add ( jobs[(guint64)ii * njobs / pending->len]->tiles, g_ptr_array_index(pending, ii) );
+  }
+  else
+#endif
+  // Interleave so each job gets tiles from across the whole view
+  for ( guint ii = 0; ii < pending->len; ii++ )
+    g_ptr_array_add ( jobs[ii % njobs]->tiles, g_ptr_array_index(pending, ii) );
+  // Tiles now owned by the jobs
+  g_ptr_array_free ( pending, FALSE );
+
+  batch->jobs = njobs;
+  g_object_weak_ref ( G_OBJECT(vml), tile_decode_weak_ref_cb, batch );
+
+  for ( guint jj = 0; jj < njobs; jj++ ) {
+    gchar *msg = g_strdup_printf ( ngettext("Loading %d %s map...", "Loading %d %s maps...", jobs[jj]->tiles->len),
+                                   jobs[jj]->tiles->len, MAPS_LAYER_NTH_LABEL(vml->maptype) );
+    a_background_thread ( BACKGROUND_POOL_LOCAL,
+                          VIK_GTK_WINDOW_FROM_LAYER(vml),
+                          msg,
+                          (vik_thr_func) tile_decode_thread,
+                          jobs[jj],
+                          (vik_thr_free_func) tile_decode_job_free,
+                          (vik_thr_free_func) tile_decode_cancel_cleanup,
+                          jobs[jj]->tiles->len );
+    g_free ( msg );
+  }
+  g_free ( jobs );
+}
+
+/**
+ * Get the pixbuf from the mapcache, otherwise either queue it to be decoded in the background
+ *  (when @pending is not NULL) or load it now.
+ */
+static GdkPixbuf *get_pixbuf_or_queue ( VikMapsLayer *vml, guint16 id, guint vp_scale, const gchar* mapname, MapCoord *mapcoord,
+                                        gchar *filename_buf, gint buf_len, gdouble xshrinkfactor, gdouble yshrinkfactor, GPtrArray *pending )
+{
+  if ( !pending )
+    return get_pixbuf ( vml, id, vp_scale, mapname, mapcoord, filename_buf, buf_len, xshrinkfactor, yshrinkfactor );
+
+  GdkPixbuf *pixbuf = a_mapcache_get ( mapcoord->x, mapcoord->y, mapcoord->z,
+                                       id, mapcoord->scale, vml->alpha, xshrinkfactor, yshrinkfactor, vml->filename );
+  if ( !pixbuf )
+    tile_decode_queue ( pending, vml, id, mapcoord, xshrinkfactor, yshrinkfactor );
+  return pixbuf;
+}
+
 static gboolean should_start_autodownload(VikMapsLayer *vml, VikViewport *vvp)
 {
   const VikCoord *center = vik_viewport_get_center ( vvp );
@@ -1530,7 +1932,8 @@ static gboolean should_start_autodownload(VikMapsLayer *vml, VikViewport *vvp)
  *
  */
 gboolean try_draw_scale_down (VikMapsLayer *vml, VikViewport *vvp, guint vp_scale, MapCoord ulm, gint xx, gint yy, gint tilesize_x_ceil, gint tilesize_y_ceil,
-                              gdouble xshrinkfactor, gdouble yshrinkfactor, guint id, const gchar *mapname, gchar *path_buf, guint max_path_len, gdouble off_x, gdouble off_y)
+                              gdouble xshrinkfactor, gdouble yshrinkfactor, guint id, const gchar *mapname, gchar *path_buf, guint max_path_len, gdouble off_x, gdouble off_y,
+                              gboolean cache_only)
 {
   GdkPixbuf *pixbuf;
   int scale_inc;
@@ -1541,7 +1944,10 @@ gboolean try_draw_scale_down (VikMapsLayer *vml, VikViewport *vvp, guint vp_scal
     ulm2.x = ulm.x / scale_factor;
     ulm2.y = ulm.y / scale_factor;
     ulm2.scale = ulm.scale + scale_inc;
-    pixbuf = get_pixbuf ( vml, id, vp_scale, mapname, &ulm2, path_buf, max_path_len, xshrinkfactor * scale_factor, yshrinkfactor * scale_factor );
+    if ( cache_only )
+      pixbuf = a_mapcache_get ( ulm2.x, ulm2.y, ulm2.z, id, ulm2.scale, vml->alpha, xshrinkfactor * scale_factor, yshrinkfactor * scale_factor, vml->filename );
+    else
+      pixbuf = get_pixbuf ( vml, id, vp_scale, mapname, &ulm2, path_buf, max_path_len, xshrinkfactor * scale_factor, yshrinkfactor * scale_factor );
     if ( pixbuf ) {
       gint src_x = (ulm.x % scale_factor) * tilesize_x_ceil;
       gint src_y = (ulm.y % scale_factor) * tilesize_y_ceil;
@@ -1568,7 +1974,8 @@ gboolean try_draw_scale_down (VikMapsLayer *vml, VikViewport *vvp, guint vp_scal
  *
  */
 gboolean try_draw_scale_up (VikMapsLayer *vml, VikViewport *vvp, guint vp_scale, MapCoord ulm, gint xx, gint yy, gint tilesize_x_ceil, gint tilesize_y_ceil,
-                            gdouble xshrinkfactor, gdouble yshrinkfactor, guint id, const gchar *mapname, gchar *path_buf, guint max_path_len, gdouble off_x, gdouble off_y)
+                            gdouble xshrinkfactor, gdouble yshrinkfactor, guint id, const gchar *mapname, gchar *path_buf, guint max_path_len, gdouble off_x, gdouble off_y,
+                            gboolean cache_only)
 {
   GdkPixbuf *pixbuf;
   gboolean ans = FALSE;
@@ -1586,7 +1993,10 @@ gboolean try_draw_scale_up (VikMapsLayer *vml, VikViewport *vvp, guint vp_scale,
         MapCoord ulm3 = ulm2;
         ulm3.x += pict_x;
         ulm3.y += pict_y;
-        pixbuf = get_pixbuf ( vml, id, vp_scale, mapname, &ulm3, path_buf, max_path_len, xshrinkfactor / scale_factor, yshrinkfactor / scale_factor );
+        if ( cache_only )
+          pixbuf = a_mapcache_get ( ulm3.x, ulm3.y, ulm3.z, id, ulm3.scale, vml->alpha, xshrinkfactor / scale_factor, yshrinkfactor / scale_factor, vml->filename );
+        else
+          pixbuf = get_pixbuf ( vml, id, vp_scale, mapname, &ulm3, path_buf, max_path_len, xshrinkfactor / scale_factor, yshrinkfactor / scale_factor );
         if ( pixbuf ) {
           gint dest_x = xx + pict_x * (tilesize_x_ceil / scale_factor);
           gint dest_y = yy + pict_y * (tilesize_y_ceil / scale_factor);
@@ -1663,14 +2073,21 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
 
     guint vp_scale = vik_viewport_get_scale ( vvp );
 
+    // Tiles not yet in the mapcache to be loaded in the background
+    //  (whilst fallbacks only use what is already in the mapcache)
+    GPtrArray *pending = NULL;
+    if ( ASYNC_DECODE && !existence_only && tile_decode_is_async(vml, map) && !vik_viewport_get_draw_synchronous(vvp) )
+      pending = g_ptr_array_new ();
+    const gboolean cache_only = (pending != NULL);
+
     if ( (!existence_only) && vml->autodownload  && should_start_autodownload(vml, vvp)) {
       g_debug("%s: Starting autodownload", __FUNCTION__);
       if ( !vml->adl_only_missing && vik_map_source_supports_download_only_new (map) )
         // Try to download newer tiles
-        start_download_thread ( vml, vvp, ul, br, REDOWNLOAD_NEW );
+        start_download_thread ( vml, vvp, ul, br, REDOWNLOAD_NEW, TRUE );
       else
         // Download only missing tiles
-        start_download_thread ( vml, vvp, ul, br, REDOWNLOAD_NONE );
+        start_download_thread ( vml, vvp, ul, br, REDOWNLOAD_NONE, TRUE );
     }
 
     // Get drawing offset (ATM a single value that applies to all zoom levels)
@@ -1683,7 +2100,7 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
         for ( y = ymin; y <= ymax; y++ ) {
           ulm.x = x;
           ulm.y = y;
-          pixbuf = get_pixbuf ( vml, id, vp_scale, mapname, &ulm, path_buf, max_path_len, xshrinkfactor, yshrinkfactor );
+          pixbuf = get_pixbuf_or_queue ( vml, id, vp_scale, mapname, &ulm, path_buf, max_path_len, xshrinkfactor, yshrinkfactor, pending );
           if ( pixbuf ) {
             width = gdk_pixbuf_get_width ( pixbuf );
             height = gdk_pixbuf_get_height ( pixbuf );
@@ -1726,21 +2143,20 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
           ulm.y = y;
 
           if ( existence_only ) {
+            VikMapsCacheLayout cl = vml->cache_layout;
             if ( vik_map_source_is_direct_file_access (MAPS_LAYER_NTH_TYPE(vml->maptype)) )
-              get_filename ( vml->cache_dir, VIK_MAPS_CACHE_LAYOUT_OSM, id, mapname,
-                             ulm.scale, ulm.z, ulm.x, ulm.y, path_buf, max_path_len, vik_map_source_get_file_extension(map) );
-            else
-              get_filename ( vml->cache_dir, vml->cache_layout, id, mapname,
-                             ulm.scale, ulm.z, ulm.x, ulm.y, path_buf, max_path_len, vik_map_source_get_file_extension(map) );
+              cl = VIK_MAPS_CACHE_LAYOUT_OSM;
+            get_filename ( vml->cache_dir, cl, id, mapname,
+                           ulm.scale, ulm.z, ulm.x, ulm.y, path_buf, max_path_len, vik_map_source_get_file_extension(map) );
 
-            if ( g_file_test ( path_buf, G_FILE_TEST_EXISTS ) == TRUE ) {
+            if ( tile_exists ( cl, path_buf, ulm.x, ulm.y ) ) {
 	      GdkGC *black_gc = vik_viewport_get_black_gc(vvp);
               vik_viewport_draw_line ( vvp, black_gc, xx+tilesize_x_ceil, yy, xx, yy+tilesize_y_ceil, &black_color, 1 );
             }
           } else {
             // Try correct scale first
             int scale_factor = 1;
-            pixbuf = get_pixbuf ( vml, id, vp_scale, mapname, &ulm, path_buf, max_path_len, xshrinkfactor * scale_factor, yshrinkfactor * scale_factor );
+            pixbuf = get_pixbuf_or_queue ( vml, id, vp_scale, mapname, &ulm, path_buf, max_path_len, xshrinkfactor * scale_factor, yshrinkfactor * scale_factor, pending );
             if ( pixbuf ) {
               gint src_x = (ulm.x % scale_factor) * tilesize_x_ceil;
               gint src_y = (ulm.y % scale_factor) * tilesize_y_ceil;
@@ -1750,13 +2166,13 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
             else {
               // Otherwise try different scales
               if ( SCALE_SMALLER_ZOOM_FIRST ) {
-                if ( !try_draw_scale_down(vml,vvp,vp_scale,ulm,xx,yy,tilesize_x_ceil,tilesize_y_ceil,xshrinkfactor,yshrinkfactor,id,mapname,path_buf,max_path_len, xa, ya) ) {
-                  try_draw_scale_up(vml,vvp,vp_scale,ulm,xx,yy,tilesize_x_ceil,tilesize_y_ceil,xshrinkfactor,yshrinkfactor,id,mapname,path_buf,max_path_len, xa, ya);
+                if ( !try_draw_scale_down(vml,vvp,vp_scale,ulm,xx,yy,tilesize_x_ceil,tilesize_y_ceil,xshrinkfactor,yshrinkfactor,id,mapname,path_buf,max_path_len, xa, ya, cache_only) ) {
+                  try_draw_scale_up(vml,vvp,vp_scale,ulm,xx,yy,tilesize_x_ceil,tilesize_y_ceil,xshrinkfactor,yshrinkfactor,id,mapname,path_buf,max_path_len, xa, ya, cache_only);
                 }
               }
               else {
-                if ( !try_draw_scale_up(vml,vvp,vp_scale,ulm,xx,yy,tilesize_x_ceil,tilesize_y_ceil,xshrinkfactor,yshrinkfactor,id,mapname,path_buf,max_path_len, xa, ya) ) {
-                  try_draw_scale_down(vml,vvp,vp_scale,ulm,xx,yy,tilesize_x_ceil,tilesize_y_ceil,xshrinkfactor,yshrinkfactor,id,mapname,path_buf,max_path_len, xa, ya);
+                if ( !try_draw_scale_up(vml,vvp,vp_scale,ulm,xx,yy,tilesize_x_ceil,tilesize_y_ceil,xshrinkfactor,yshrinkfactor,id,mapname,path_buf,max_path_len, xa, ya, cache_only) ) {
+                  try_draw_scale_down(vml,vvp,vp_scale,ulm,xx,yy,tilesize_x_ceil,tilesize_y_ceil,xshrinkfactor,yshrinkfactor,id,mapname,path_buf,max_path_len, xa, ya, cache_only);
                 }
               }
             }
@@ -1832,6 +2248,9 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
 
     }
     g_free ( path_buf );
+
+    if ( pending )
+      tile_decode_start ( vml, vp_scale, pending );
   }
 }
 
@@ -1890,10 +2309,25 @@ typedef struct {
   VikViewport *vvp;
   gboolean map_layer_alive;
   GMutex *mutex;
+  // For downloading in the background alongside other downloads
+  guint group;
+  gdouble centre_x, centre_y; // Tiles nearest to this go first
+  gdouble priority_base;      // Lower for the zoom level being viewed
+  GCond cond;                 // Signalled as each download completes
+  guint outstanding;
+  GQueue finished;            // Of MapDownloadTile* waiting to be processed
+  gboolean cancelled;
+  // Downloaded tiles wanted for the view are put straight into the mapcache
+  gboolean decode;
+  gdouble xshrinkfactor, yshrinkfactor;
+  guint vp_scale;
 } MapDownloadInfo;
 
 static void mdi_free ( MapDownloadInfo *mdi )
 {
+  // Only setup when downloading
+  if ( mdi->group )
+    g_cond_clear ( &mdi->cond );
   vik_mutex_free(mdi->mutex);
   g_free ( mdi->cache_dir );
   mdi->cache_dir = NULL;
@@ -1959,6 +2393,206 @@ static void unref_weak_ref_cb ( MapDownloadInfo *mdi )
   g_mutex_unlock ( mdi->mutex );
 }
 
+/*
+ * Handle the outcome of getting a tile
+ * @content: The downloaded tile data when available
+ */
+static void map_download_tile_result ( MapDownloadInfo *mdi, gint x, gint y, gboolean remove_mem_cache, gboolean need_download, DownloadResult_t dr, GBytes *content )
+{
+  VikMapSource *map = MAPS_LAYER_NTH_TYPE(mdi->maptype);
+  const guint16 id = vik_map_source_get_uniq_id ( map );
+
+  switch ( dr ) {
+    case DOWNLOAD_PARAMETERS_ERROR:
+    case DOWNLOAD_HTTP_ERROR:
+    case DOWNLOAD_CONTENT_ERROR: {
+      // TODO: ?? count up the number of download errors somehow...
+      gchar* msg = g_strdup_printf ( "%s: %s", vik_maps_layer_get_map_label (mdi->vml), _("Failed to download tile") );
+      vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(mdi->vml), msg, VIK_STATUSBAR_INFO );
+      g_free (msg);
+      break;
+    }
+    case DOWNLOAD_FILE_WRITE_ERROR: {
+      gchar* msg = g_strdup_printf ( "%s: %s", vik_maps_layer_get_map_label (mdi->vml), _("Unable to save tile") );
+      vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(mdi->vml), msg, VIK_STATUSBAR_INFO );
+      g_free (msg);
+      break;
+    }
+    case DOWNLOAD_SUCCESS: break;
+    case DOWNLOAD_NOT_REQUIRED:
+      need_download = FALSE;
+      break;
+    case DOWNLOAD_USER_ABORTED:
+      break;
+    default:
+      break;
+  }
+
+  // Decode now, rather than the draw having to read the file back in
+  GdkPixbuf *pixbuf = NULL;
+  if ( dr == DOWNLOAD_SUCCESS && content && mdi->decode ) {
+    GError *error = NULL;
+    pixbuf = get_pixbuf_from_content ( content, &error );
+    if ( error ) {
+      g_debug ( "%s: %s", __FUNCTION__, error->message );
+      g_error_free ( error );
+    }
+  }
+
+  mark_request_complete ( mdi, id, x, y );
+
+  // Avoid attempting to update mapcache when download aborted
+  //  1. Since no real change to track
+  //  2. more importantly, if the program is ending then the mapcache may have been removed
+  if ( dr != DOWNLOAD_USER_ABORTED ) {
+
+    g_mutex_lock(mdi->mutex);
+    // Once cancelled the layer may have gone
+    if ( !mdi->cancelled ) {
+      if (remove_mem_cache)
+        a_mapcache_remove_all_shrinkfactors ( x, y, mdi->mapcoord.z, id, mdi->mapcoord.scale, mdi->vml->filename );
+
+      MapCoord mcoord = mdi->mapcoord;
+      mcoord.x = x;
+      mcoord.y = y;
+      tile_decode_miss_clear ( id, &mcoord, mdi->cache_dir, mdi->vml->filename );
+
+      // Save download result - must be after remove_all_shrinkfactors() otherwise that would remove this result!
+      a_mapcache_add ( NULL, (mapcache_extra_t){0.0, dr}, x, y, mdi->mapcoord.z, id,
+                       mdi->mapcoord.scale, mdi->vml->alpha, 1.0, 1.0, mdi->vml->filename );
+
+      if ( pixbuf ) {
+        pixbuf = pixbuf_apply_settings_full ( pixbuf, map, mdi->vml->alpha, mdi->vml->filename, mdi->vp_scale,
+                                              &mcoord, mdi->xshrinkfactor, mdi->yshrinkfactor, dr );
+      }
+
+      if (mdi->refresh_display && mdi->map_layer_alive) {
+        /* TODO: check if it's on visible area */
+        if ( need_download ) {
+          vik_layer_emit_update ( VIK_LAYER(mdi->vml), FALSE ); // NB update display from background
+        }
+      }
+    }
+    g_mutex_unlock(mdi->mutex);
+  }
+
+  if ( pixbuf )
+    g_object_unref ( pixbuf );
+}
+
+typedef struct {
+  MapDownloadInfo *mdi;
+  gint x, y;
+  gboolean remove_mem_cache;
+  DownloadResult_t dr;
+  GBytes *content;
+} MapDownloadTile;
+
+/*
+ * Hand the outcome over to the download thread,
+ *  as this is called from the thread performing all the downloads
+ */
+static void map_download_tile_done ( DownloadResult_t dr, GBytes *content, gpointer user_data )
+{
+  MapDownloadTile *mdt = user_data;
+  MapDownloadInfo *mdi = mdt->mdi;
+  mdt->dr = dr;
+  mdt->content = content ? g_bytes_ref ( content ) : NULL;
+
+  // NB mdi may be freed as soon as this is unlocked
+  g_mutex_lock ( mdi->mutex );
+  mdi->outstanding--;
+  g_queue_push_tail ( &mdi->finished, mdt );
+  g_cond_signal ( &mdi->cond );
+  g_mutex_unlock ( mdi->mutex );
+}
+
+static void map_download_tile_finish ( MapDownloadTile *mdt )
+{
+  map_download_tile_result ( mdt->mdi, mdt->x, mdt->y, mdt->remove_mem_cache, TRUE, mdt->dr, mdt->content );
+  if ( mdt->content )
+    g_bytes_unref ( mdt->content );
+  g_free ( mdt );
+}
+
+/*
+ * Request the tile to be downloaded in the background
+ *
+ * Returns: FALSE if this isn't possible for the map source
+ */
+static gboolean map_download_tile_async ( MapDownloadInfo *mdi, VikMapSource *map, gint x, gint y, gboolean remove_mem_cache )
+{
+  MapDownloadTile *mdt = g_malloc0 ( sizeof(MapDownloadTile) );
+  mdt->mdi = mdi;
+  mdt->x = x;
+  mdt->y = y;
+  mdt->remove_mem_cache = remove_mem_cache;
+
+  MapCoord mcoord = mdi->mapcoord;
+  mcoord.x = x;
+  mcoord.y = y;
+  gdouble dx = x - mdi->centre_x;
+  gdouble dy = y - mdi->centre_y;
+
+  g_mutex_lock ( mdi->mutex );
+  mdi->outstanding++;
+  g_mutex_unlock ( mdi->mutex );
+  if ( vik_map_source_download_async ( map, &mcoord, mdi->filename_buf, mdi->cache_layout == VIK_MAPS_CACHE_LAYOUT_PACKED,
+                                       mdi->priority_base + dx*dx + dy*dy, mdi->group, map_download_tile_done, mdt ) )
+    return TRUE;
+
+  g_mutex_lock ( mdi->mutex );
+  mdi->outstanding--;
+  g_mutex_unlock ( mdi->mutex );
+  g_free ( mdt );
+  return FALSE;
+}
+
+/*
+ * Stop all the background downloads, including those in progress
+ */
+static void map_download_cancel ( MapDownloadInfo *mdi )
+{
+  g_mutex_lock ( mdi->mutex );
+  mdi->cancelled = TRUE;
+  g_mutex_unlock ( mdi->mutex );
+  a_download_cancel_group ( mdi->group, TRUE );
+}
+
+/*
+ * Wait for the background downloads to complete, processing and reporting progress as each one does
+ * @res: Whether already cancelled
+ *
+ * Returns: Non zero if cancelled
+ */
+static int map_download_wait ( MapDownloadInfo *mdi, gpointer threaddata, guint *donemaps, int res )
+{
+  g_mutex_lock ( mdi->mutex );
+  while ( mdi->outstanding || !g_queue_is_empty(&mdi->finished) ) {
+    if ( g_queue_is_empty(&mdi->finished) )
+      (void)g_cond_wait_until ( &mdi->cond, mdi->mutex, g_get_monotonic_time() + G_TIME_SPAN_SECOND/10 );
+    MapDownloadTile *mdt = g_queue_pop_head ( &mdi->finished );
+    g_mutex_unlock ( mdi->mutex );
+
+    if ( mdt )
+      map_download_tile_finish ( mdt );
+
+    if ( res == 0 ) {
+      if ( mdt ) {
+        (*donemaps)++;
+        res = a_background_thread_progress ( threaddata, ((gdouble)*donemaps) / mdi->mapstoget ); /* this also calls testcancel */
+      }
+      else
+        res = a_background_testcancel ( threaddata );
+      if ( res != 0 )
+        map_download_cancel ( mdi );
+    }
+    g_mutex_lock ( mdi->mutex );
+  }
+  g_mutex_unlock ( mdi->mutex );
+  return res;
+}
+
 static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
 {
   VikMapSource *map = MAPS_LAYER_NTH_TYPE(mdi->maptype);
@@ -1968,6 +2602,10 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
   gint x, y;
   gboolean needed[mdi->xf-mdi->x0+1][mdi->yf-mdi->y0+1];
   const guint16 id = vik_map_source_get_uniq_id ( map );
+  // Prefer downloading in the background so many tiles are fetched at once,
+  //  rather than waiting on each one in turn
+  gboolean async = TRUE;
+  int res = 0;
 
   for ( x = mdi->x0; x <= mdi->xf; x++ ) {
     mcoord.x = x;
@@ -1997,9 +2635,9 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
     }
   }
 
-  for ( x = mdi->x0; x <= mdi->xf; x++ ) {
+  for ( x = mdi->x0; x <= mdi->xf && res == 0; x++ ) {
     mcoord.x = x;
-    for ( y = mdi->y0; y <= mdi->yf; y++ ) {
+    for ( y = mdi->y0; y <= mdi->yf && res == 0; y++ ) {
       mcoord.y = y;
 
       // Only attempt to download a tile from supported areas
@@ -2007,15 +2645,11 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
 
         gboolean remove_mem_cache = FALSE;
         gboolean need_download = FALSE;
-        donemaps++;
-        int res = a_background_thread_progress ( threaddata, ((gdouble)donemaps) / mdi->mapstoget ); /* this also calls testcancel */
-        if (res != 0) {
-          requests_clear ( mdi->maptype );
-          vik_map_source_download_handle_cleanup ( map, handle );
-          return -1;
-        }
+
         // Skip as already being requested
         if ( !needed[mdi->xf-x][mdi->yf-y] ) {
+          donemaps++;
+          res = a_background_thread_progress ( threaddata, ((gdouble)donemaps) / mdi->mapstoget ); /* this also calls testcancel */
           continue;
         }
 
@@ -2024,7 +2658,7 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
                        mdi->mapcoord.scale, mdi->mapcoord.z, x, y, mdi->filename_buf, mdi->maxlen,
                        vik_map_source_get_file_extension(map) );
 
-        if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == FALSE ) {
+        if ( !tile_exists ( mdi->cache_layout, mdi->filename_buf, x, y ) ) {
           need_download = TRUE;
           remove_mem_cache = TRUE;
 
@@ -2032,15 +2666,17 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
           switch (mdi->redownload) {
             case REDOWNLOAD_NONE:
               mark_request_complete ( mdi, id, x, y );
+              donemaps++;
+              res = a_background_thread_progress ( threaddata, ((gdouble)donemaps) / mdi->mapstoget );
               continue;
 
             case REDOWNLOAD_BAD:
             {
               /* see if this one is bad or what */
               GError *gx = NULL;
-              GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file ( mdi->filename_buf, &gx );
+              GdkPixbuf *pixbuf = tile_get_pixbuf ( mdi->cache_layout, mdi->filename_buf, x, y, &gx );
               if (gx || (!pixbuf)) {
-                if ( g_remove ( mdi->filename_buf ) )
+                if ( !tile_remove ( mdi->cache_layout, mdi->filename_buf, x, y ) )
                   g_warning ( "REDOWNLOAD failed to remove: %s", mdi->filename_buf );
                 need_download = TRUE;
                 remove_mem_cache = TRUE;
@@ -2071,67 +2707,51 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
           }
         }
 
-        mdi->mapcoord.x = x; mdi->mapcoord.y = y;
-
-        DownloadResult_t dr = DOWNLOAD_NOT_REQUIRED;
-        if (need_download) {
-          dr = vik_map_source_download ( map, &(mdi->mapcoord), mdi->filename_buf, handle );
-          switch ( dr ) {
-            case DOWNLOAD_PARAMETERS_ERROR:
-            case DOWNLOAD_HTTP_ERROR:
-            case DOWNLOAD_CONTENT_ERROR: {
-              // TODO: ?? count up the number of download errors somehow...
-              gchar* msg = g_strdup_printf ( "%s: %s", vik_maps_layer_get_map_label (mdi->vml), _("Failed to download tile") );
-              vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(mdi->vml), msg, VIK_STATUSBAR_INFO );
-              g_free (msg);
-              break;
-            }
-            case DOWNLOAD_FILE_WRITE_ERROR: {
-              gchar* msg = g_strdup_printf ( "%s: %s", vik_maps_layer_get_map_label (mdi->vml), _("Unable to save tile") );
-              vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(mdi->vml), msg, VIK_STATUSBAR_INFO );
-              g_free (msg);
-              break;
-            }
-            case DOWNLOAD_SUCCESS: break;
-            case DOWNLOAD_NOT_REQUIRED:
-	      need_download = FALSE;
-	      break;
-            case DOWNLOAD_USER_ABORTED:
-              break;
-            default:
-              break;
+        // Progress is reported once the background download completes
+        if ( need_download && async ) {
+          if ( map_download_tile_async ( mdi, map, x, y, remove_mem_cache ) ) {
+            res = a_background_testcancel ( threaddata );
+            continue;
           }
+          async = FALSE;
         }
 
-        mark_request_complete ( mdi, id, x, y );
-
-        // Avoid attempting to update mapcache when download aborted
-        //  1. Since no real change to track
-        //  2. more importantly, if the program is ending then the mapcache may have been removed
-        if ( dr != DOWNLOAD_USER_ABORTED ) {
+        donemaps++;
+        res = a_background_thread_progress ( threaddata, ((gdouble)donemaps) / mdi->mapstoget ); /* this also calls testcancel */
+        if ( res != 0 )
+          break;
 
-          g_mutex_lock(mdi->mutex);
-          if (remove_mem_cache)
-            a_mapcache_remove_all_shrinkfactors ( x, y, mdi->mapcoord.z, id, mdi->mapcoord.scale, mdi->vml->filename );
+        mdi->mapcoord.x = x; mdi->mapcoord.y = y;
 
-          // Save download result - must be after remove_all_shrinkfactors() otherwise that would remove this result!
-          a_mapcache_add ( NULL, (mapcache_extra_t){0.0, dr}, mdi->mapcoord.x, mdi->mapcoord.y, mdi->mapcoord.z, id,
-                           mdi->mapcoord.scale, mdi->vml->alpha, 1.0, 1.0, mdi->vml->filename );
+        DownloadResult_t dr = DOWNLOAD_NOT_REQUIRED;
+        if ( need_download ) {
+          // The packed store can only be written via the background downloads
+          if ( mdi->cache_layout == VIK_MAPS_CACHE_LAYOUT_PACKED )
+            dr = DOWNLOAD_PARAMETERS_ERROR;
+          else
+            dr = vik_map_source_download ( map, &(mdi->mapcoord), mdi->filename_buf, handle );
+        }
 
-          if (mdi->refresh_display && mdi->map_layer_alive) {
-            /* TODO: check if it's on visible area */
-            if ( need_download ) {
-              vik_layer_emit_update ( VIK_LAYER(mdi->vml), FALSE ); // NB update display from background
-            }
-          }
+        map_download_tile_result ( mdi, x, y, remove_mem_cache, need_download, dr, NULL );
 
-          g_mutex_unlock(mdi->mutex);
+        if ( dr != DOWNLOAD_USER_ABORTED )
           mdi->mapcoord.x = mdi->mapcoord.y = 0; /* we're temporarily between downloads */
-        }
       }
     }
   }
+
+  if ( res != 0 )
+    map_download_cancel ( mdi );
+  // The background downloads refer to this request, so must always wait for them
+  res = map_download_wait ( mdi, threaddata, &donemaps, res );
+
   vik_map_source_download_handle_cleanup ( map, handle );
+  a_tilestore_flush ();
+
+  if ( res != 0 ) {
+    requests_clear ( mdi->maptype );
+    return -1;
+  }
 
   unref_weak_ref_cb ( mdi );
 
@@ -2140,7 +2760,8 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
 
 static void mdi_cancel_cleanup ( MapDownloadInfo *mdi )
 {
-  if ( mdi->mapcoord.x || mdi->mapcoord.y )
+  // Partial downloads never reach the packed store
+  if ( (mdi->mapcoord.x || mdi->mapcoord.y) && mdi->cache_layout != VIK_MAPS_CACHE_LAYOUT_PACKED )
   {
     get_filename ( mdi->cache_dir, mdi->cache_layout,
                    vik_map_source_get_uniq_id(MAPS_LAYER_NTH_TYPE(mdi->maptype)),
@@ -2159,7 +2780,44 @@ static void mdi_cancel_cleanup ( MapDownloadInfo *mdi )
   unref_weak_ref_cb ( mdi );
 }
 
-static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const VikCoord *ul, const VikCoord *br, gint redownload )
+/*
+ * Prepare for downloading in the background, such that tiles nearest the centre of the view
+ *  and those at the zoom level being viewed are downloaded first
+ * @zoom:    Of the tiles to be downloaded
+ * @viewing: Whether the tiles are for the current view
+ */
+static void mdi_init_background ( MapDownloadInfo *mdi, VikMapSource *map, VikViewport *vvp, gdouble zoom, gboolean viewing )
+{
+  g_cond_init ( &mdi->cond );
+  mdi->outstanding = 0;
+  g_queue_init ( &mdi->finished );
+  mdi->cancelled = FALSE;
+  mdi->group = a_download_new_group ();
+
+  // Use the same settings as the draw, so it finds the tiles in the mapcache
+  mdi->decode = viewing;
+  mdi->vp_scale = vik_viewport_get_scale ( vvp );
+  mdi->xshrinkfactor = 1.0;
+  mdi->yshrinkfactor = 1.0;
+  if ( mdi->vml->xmapzoom && (mdi->vml->xmapzoom != vik_viewport_get_xmpp(vvp) || mdi->vml->ymapzoom != vik_viewport_get_ympp(vvp)) ) {
+    mdi->xshrinkfactor = mdi->vml->xmapzoom / vik_viewport_get_xmpp ( vvp );
+    mdi->yshrinkfactor = mdi->vml->ymapzoom / vik_viewport_get_ympp ( vvp );
+  }
+
+  MapCoord mc;
+  if ( vik_map_source_coord_to_mapcoord ( map, vik_viewport_get_center(vvp), zoom, zoom, &mc ) ) {
+    mdi->centre_x = mc.x;
+    mdi->centre_y = mc.y;
+  }
+  else {
+    mdi->centre_x = (mdi->x0 + mdi->xf) / 2.0;
+    mdi->centre_y = (mdi->y0 + mdi->yf) / 2.0;
+  }
+  // Each zoom level away from the one viewed counts as being much further away than any tile
+  mdi->priority_base = viewing ? 0.0 : 1.0e9 * fabs ( log2(zoom / vik_viewport_get_xmpp(vvp)) );
+}
+
+static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const VikCoord *ul, const VikCoord *br, gint redownload, gboolean for_view )
 {
   gdouble xzoom = vml->xmapzoom ? vml->xmapzoom : vik_viewport_get_xmpp ( vvp );
   gdouble yzoom = vml->ymapzoom ? vml->ymapzoom : vik_viewport_get_ympp ( vvp );
@@ -2173,7 +2831,15 @@ static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const V
   if ( vik_map_source_coord_to_mapcoord ( map, ul, xzoom, yzoom, &ulm )
     && vik_map_source_coord_to_mapcoord ( map, br, xzoom, yzoom, &brm ) )
   {
-    MapDownloadInfo *mdi = g_malloc ( sizeof(MapDownloadInfo) );
+    // Downloads no longer in view are not wanted
+    //  (and any still in view are requested again, in order from the new centre)
+    //  Those in progress are kept, as they may well still be in view
+    if ( for_view && vml->dl_view_group ) {
+      a_download_cancel_group ( vml->dl_view_group, FALSE );
+      vml->dl_view_group = 0;
+    }
+
+    MapDownloadInfo *mdi = g_malloc0 ( sizeof(MapDownloadInfo) );
     gint a, b;
 
     mdi->vml = vml;
@@ -2224,7 +2890,7 @@ static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const V
                              vik_map_source_get_name(map),
                              ulm.scale, ulm.z, a, b, mdi->filename_buf, mdi->maxlen,
                              vik_map_source_get_file_extension(map) );
-              if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == FALSE ) {
+              if ( !tile_exists ( mdi->cache_layout, mdi->filename_buf, a, b ) ) {
                 mdi->mapstoget++;
               }
             }
@@ -2238,6 +2904,10 @@ static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const V
 
     if ( mdi->mapstoget )
     {
+      mdi_init_background ( mdi, map, vvp, xzoom, TRUE );
+      if ( for_view )
+        vml->dl_view_group = mdi->group;
+
       const gchar *tmp_str;
       gchar *tmp;
 
@@ -2286,7 +2956,7 @@ static void maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, V
     return;
   }
 
-  MapDownloadInfo *mdi = g_malloc(sizeof(MapDownloadInfo));
+  MapDownloadInfo *mdi = g_malloc0(sizeof(MapDownloadInfo));
   gint i, j;
 
   mdi->vml = vml;
@@ -2324,7 +2994,7 @@ static void maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, V
                        vik_map_source_get_name(map),
                        ulm.scale, ulm.z, i, j, mdi->filename_buf, mdi->maxlen,
                        vik_map_source_get_file_extension(map) );
-        if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == FALSE )
+        if ( !tile_exists ( mdi->cache_layout, mdi->filename_buf, i, j ) )
               mdi->mapstoget++;
       }
     }
@@ -2333,6 +3003,8 @@ static void maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, V
   mdi->mapcoord.x = mdi->mapcoord.y = 0; /* for cleanup -- no current map */
 
   if (mdi->mapstoget) {
+    mdi_init_background ( mdi, map, vvp, zoom, FALSE );
+
     gchar *tmp;
     const gchar *fmt;
     fmt = ngettext("Downloading %d %s map...",
@@ -2374,17 +3046,17 @@ void vik_maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, VikC
 
 static void maps_layer_redownload_bad ( VikMapsLayer *vml )
 {
-  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_BAD );
+  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_BAD, FALSE );
 }
 
 static void maps_layer_redownload_all ( VikMapsLayer *vml )
 {
-  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_ALL );
+  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_ALL, FALSE );
 }
 
 static void maps_layer_redownload_new ( VikMapsLayer *vml )
 {
-  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_NEW );
+  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_NEW, FALSE );
 }
 
 /**
@@ -2428,16 +3100,19 @@ static void maps_layer_delete_tiles ( VikMapsLayer *vml )
                        ulm.scale, ulm.z, xx, yy, filename, max_path_len,
                        vik_map_source_get_file_extension(map) );
 
-        if ( g_file_test(filename, G_FILE_TEST_EXISTS) ) {
-          if ( g_remove(filename) )
+        if ( tile_exists(vml->cache_layout, filename, xx, yy) ) {
+          if ( !tile_remove(vml->cache_layout, filename, xx, yy) )
             g_warning ( "%s failed to remove: %s", __FUNCTION__, filename );
         }
 
         // Attempt to remove etag as well if there is one
-        gchar *etagfile = g_strdup_printf ( "%s.etag", filename );
-        if ( g_file_test(etagfile, G_FILE_TEST_EXISTS) )
-          (void)g_remove(etagfile);
-        g_free ( etagfile );
+        //  (the packed store keeps it with the tile)
+        if ( vml->cache_layout != VIK_MAPS_CACHE_LAYOUT_PACKED ) {
+          gchar *etagfile = g_strdup_printf ( "%s.etag", filename );
+          if ( g_file_test(etagfile, G_FILE_TEST_EXISTS) )
+            (void)g_remove(etagfile);
+          g_free ( etagfile );
+        }
 
         a_mapcache_remove_all_shrinkfactors ( xx, yy, ulm.z,
                                               vik_map_source_get_uniq_id(map),
@@ -2466,6 +3141,7 @@ static void maps_layer_tile_info ( VikMapsLayer *vml )
 
   gchar *filename = NULL;
   gchar *source = NULL;
+  VikMapsCacheLayout cl = VIK_MAPS_CACHE_LAYOUT_OSM;
 
   if ( vik_map_source_is_direct_file_access ( map ) ) {
     if ( vik_map_source_is_mbtiles ( map ) ) {
@@ -2475,7 +3151,7 @@ static void maps_layer_tile_info ( VikMapsLayer *vml )
       gchar *exists = NULL;
       gint zoom = 17 - ulm.scale;
       if ( vml->mbtiles ) {
-        GdkPixbuf *pixbuf = get_pixbuf_sql_exec ( vml->mbtiles, ulm.x, ulm.y, zoom );
+        GdkPixbuf *pixbuf = mbtiles_get_pixbuf ( vml->mbtiles, ulm.x, ulm.y, zoom );
         if ( pixbuf ) {
           exists = g_strdup ( _("YES") );
           g_object_unref ( G_OBJECT(pixbuf) );
@@ -2514,7 +3190,8 @@ static void maps_layer_tile_info ( VikMapsLayer *vml )
   else {
     guint max_path_len = strlen(vml->cache_dir) + 40;
     filename = g_malloc ( max_path_len * sizeof(char) );
-    get_filename ( vml->cache_dir, vml->cache_layout,
+    cl = vml->cache_layout;
+    get_filename ( vml->cache_dir, cl,
                    vik_map_source_get_uniq_id(map),
                    vik_map_source_get_name(map),
                    ulm.scale, ulm.z, ulm.x, ulm.y, filename, max_path_len,
@@ -2530,13 +3207,13 @@ static void maps_layer_tile_info ( VikMapsLayer *vml )
   gchar *filemsg = NULL;
   gchar *timemsg = NULL;
 
-  if ( g_file_test ( filename, G_FILE_TEST_EXISTS ) ) {
+  if ( tile_exists ( cl, filename, ulm.x, ulm.y ) ) {
     filemsg = g_strconcat ( "Tile File: ", filename, NULL );
     // Get some timestamp information of the tile
-    GStatBuf stat_buf;
-    if ( g_stat ( filename, &stat_buf ) == 0 ) {
+    time_t mtime;
+    if ( tile_get_mtime ( cl, filename, ulm.x, ulm.y, &mtime ) ) {
       gchar time_buf[64];
-      strftime ( time_buf, sizeof(time_buf), "%c", gmtime((const time_t *)&stat_buf.st_mtime) );
+      strftime ( time_buf, sizeof(time_buf), "%c", gmtime(&mtime) );
       timemsg = g_strdup_printf ( _("Tile File Timestamp: %s"), time_buf );
     }
     else {
@@ -2570,7 +3247,7 @@ static VikLayerToolFuncStatus maps_layer_download_release ( VikMapsLayer *vml, G
       VikCoord ul, br;
       vik_viewport_screen_to_coord ( vvp, MAX(0, MIN(event->x, vml->dl_tool_x)), MAX(0, MIN(event->y, vml->dl_tool_y)), &ul );
       vik_viewport_screen_to_coord ( vvp, MIN(vik_viewport_get_width(vvp), MAX(event->x, vml->dl_tool_x)), MIN(vik_viewport_get_height(vvp), MAX ( event->y, vml->dl_tool_y ) ), &br );
-      start_download_thread ( vml, vvp, &ul, &br, DOWNLOAD_OR_REFRESH );
+      start_download_thread ( vml, vvp, &ul, &br, DOWNLOAD_OR_REFRESH, FALSE );
       vml->dl_tool_x = vml->dl_tool_y = -1;
       return VIK_LAYER_TOOL_ACK;
     }
@@ -2662,7 +3339,7 @@ static void download_onscreen_maps ( menu_array_values values, gint redownload )
   if ( vik_map_source_get_drawmode(map) == vp_drawmode &&
        vik_map_source_coord_to_mapcoord ( map, &ul, xzoom, yzoom, &ulm ) &&
        vik_map_source_coord_to_mapcoord ( map, &br, xzoom, yzoom, &brm ) )
-    start_download_thread ( vml, vvp, &ul, &br, redownload );
+    start_download_thread ( vml, vvp, &ul, &br, redownload, FALSE );
   else if (vik_map_source_get_drawmode(map) != vp_drawmode) {
     const gchar *drawmode_name = vik_viewport_get_drawmode_name (vvp, vik_map_source_get_drawmode(map));
     gchar *err = g_strdup_printf(_("Wrong drawmode for this map.\nSelect \"%s\" from View menu and try again."), _(drawmode_name));
@@ -2752,7 +3429,7 @@ static gint maps_layer_how_many_maps ( VikMapsLayer *vml, VikViewport *vvp, VikC
     return 0;
   }
 
-  MapDownloadInfo *mdi = g_malloc(sizeof(MapDownloadInfo));
+  MapDownloadInfo *mdi = g_malloc0(sizeof(MapDownloadInfo));
   gint i, j;
 
   mdi->vml = vml;
@@ -2800,14 +3477,14 @@ static gint maps_layer_how_many_maps ( VikMapsLayer *vml, VikViewport *vvp, VikC
             mdi->mapstoget++;
           }
           else {
-            if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == FALSE ) {
+            if ( !tile_exists ( mdi->cache_layout, mdi->filename_buf, i, j ) ) {
               // Missing
               mdi->mapstoget++;
             }
             else {
               if ( mdi->redownload == REDOWNLOAD_BAD ) {
                 /* see if this one is bad or what */
-                GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file ( mdi->filename_buf, NULL );
+                GdkPixbuf *pixbuf = tile_get_pixbuf ( mdi->cache_layout, mdi->filename_buf, i, j, NULL );
                 if ( !pixbuf ) {
                   mdi->mapstoget++;
                 } else {
@@ -3019,6 +3696,10 @@ static void maps_layer_flush ( menu_array_values values )
 {
   VikMapsLayer *vml = VIK_MAPS_LAYER(values[MA_VML]);
   a_mapcache_flush_type ( vik_map_source_get_uniq_id(MAPS_LAYER_NTH_TYPE(vml->maptype)) );
+  // Tiles may have been added by other means
+  g_mutex_lock ( dc_mutex );
+  g_hash_table_remove_all ( decode_misses );
+  g_mutex_unlock ( dc_mutex );
 }
 
 static void maps_layer_add_menu_items ( VikMapsLayer *vml, GtkMenu *menu, VikLayersPanel *vlp, VikStdLayerMenuItem selection, GtkTreeIter *iter )
@@ -50,6 +50,7 @@ typedef struct _VikMapsLayer VikMapsLayer;
 typedef enum {
   VIK_MAPS_CACHE_LAYOUT_VIKING=0, // CacheDir/t<MapId>s<VikingZoom>z0/X/Y (NB no file extension) - Legacy default layout
   VIK_MAPS_CACHE_LAYOUT_OSM,      // CacheDir/<OptionalMapName>/OSMZoomLevel/X/Y.ext (Default ext=png)
+  VIK_MAPS_CACHE_LAYOUT_PACKED,   // CacheDir/<OptionalMapName>/OSMZoomLevel/BucketX_BucketY.tiles - see tilestore.h
   VIK_MAPS_CACHE_LAYOUT_NUM       // Last enum
 } VikMapsCacheLayout;
 
@@ -69,6 +70,7 @@ guint vik_maps_layer_get_map_type(VikMapsLayer *vml);
 void vik_maps_layer_set_map_type(VikMapsLayer *vml, guint map_type);
 gchar *vik_maps_layer_get_map_label(VikMapsLayer *vml);
 gchar *maps_layer_default_dir ();
+GdkPixbuf *maps_layer_get_pixbuf_from_metatile ( const gchar *cache_dir, gint xx, gint yy, gint zz );
 void vik_maps_layer_download ( VikMapsLayer *vml, VikViewport *vvp, gboolean only_new );
 
 void vik_maps_layer_info_dialog ( GtkWindow *parent );
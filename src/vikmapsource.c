@@ -87,6 +87,7 @@ vik_map_source_class_init (VikMapSourceClass *klass)
 	klass->download = NULL;
 	klass->download_handle_init = NULL;
 	klass->download_handle_cleanup = NULL;
+	klass->download_async = NULL;
 
 	object_class->finalize = vik_map_source_finalize;
 }
@@ -528,3 +529,33 @@ vik_map_source_download_handle_cleanup (VikMapSource * self, void * handle)
 
 	(*klass->download_handle_cleanup)(self, handle);
 }
+
+/**
+ * vik_map_source_download_async:
+ * @self:      The VikMapSource of interest.
+ * @src:       The map location to download
+ * @dest_fn:   The filename to save the result in
+ * @in_store:  Whether @dest_fn is a tile store (see tilestore.h) holding the tile, rather than the tile itself
+ * @priority:  Downloads with lower values are started first
+ * @group:     From a_download_new_group(), so it can be cancelled (or 0)
+ * @done_func: Called with the outcome, see a_http_download_get_url_async()
+ * @user_data: Passed to @done_func
+ *
+ * Download in the background alongside other downloads.
+ *
+ * Returns: FALSE if the map source doesn't support this,
+ *  in which case use vik_map_source_download() instead and @done_func is not called
+ */
+gboolean
+vik_map_source_download_async (VikMapSource * self, MapCoord * src, const gchar * dest_fn, gboolean in_store, gdouble priority, guint group, DownloadDoneFunc done_func, gpointer user_data)
+{
+	VikMapSourceClass *klass;
+	g_return_val_if_fail (self != NULL, FALSE);
+	g_return_val_if_fail (VIK_IS_MAP_SOURCE (self), FALSE);
+	klass = VIK_MAP_SOURCE_GET_CLASS(self);
+
+	if (klass->download_async == NULL)
+		return FALSE;
+
+	return (*klass->download_async)(self, src, dest_fn, in_store, priority, group, done_func, user_data);
+}
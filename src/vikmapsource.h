@@ -75,6 +75,7 @@ struct _VikMapSourceClass
 	int (* download) (VikMapSource * self, MapCoord * src, const gchar * dest_fn, void * handle);
 	void * (* download_handle_init) (VikMapSource * self);
 	void (* download_handle_cleanup) (VikMapSource * self, void * handle);
+	gboolean (* download_async) (VikMapSource * self, MapCoord * src, const gchar * dest_fn, gboolean in_store, gdouble priority, guint group, DownloadDoneFunc done_func, gpointer user_data);
 };
 
 struct _VikMapSource
@@ -114,6 +115,7 @@ void vik_map_source_mapcoord_to_center_coord (VikMapSource * self, MapCoord *src
 DownloadResult_t vik_map_source_download (VikMapSource * self, MapCoord * src, const gchar * dest_fn, void * handle);
 void * vik_map_source_download_handle_init (VikMapSource * self);
 void vik_map_source_download_handle_cleanup (VikMapSource * self, void * handle);
+gboolean vik_map_source_download_async (VikMapSource * self, MapCoord * src, const gchar * dest_fn, gboolean in_store, gdouble priority, guint group, DownloadDoneFunc done_func, gpointer user_data);
 
 G_END_DECLS
 
@@ -50,6 +50,7 @@ static gdouble map_source_get_offset_y (VikMapSource *self);
 static DownloadResult_t _download ( VikMapSource *self, MapCoord *src, const gchar *dest_fn, void *handle );
 static void * _download_handle_init ( VikMapSource *self );
 static void _download_handle_cleanup ( VikMapSource *self, void *handle );
+static gboolean _download_async ( VikMapSource *self, MapCoord *src, const gchar *dest_fn, gboolean in_store, gdouble priority, guint group, DownloadDoneFunc done_func, gpointer user_data );
 
 typedef struct _VikMapSourceDefaultPrivate VikMapSourceDefaultPrivate;
 struct _VikMapSourceDefaultPrivate
@@ -308,6 +309,7 @@ vik_map_source_default_class_init (VikMapSourceDefaultClass *klass)
 	parent_class->download =                 _download;
 	parent_class->download_handle_init =     _download_handle_init;
 	parent_class->download_handle_cleanup =  _download_handle_cleanup;
+	parent_class->download_async =           _download_async;
 
 	/* Default implementation of methods */
 	klass->get_uri = NULL;
@@ -551,6 +553,22 @@ _download ( VikMapSource *self, MapCoord *src, const gchar *dest_fn, void *handl
    return res;
 }
 
+static gboolean
+_download_async ( VikMapSource *self, MapCoord *src, const gchar *dest_fn, gboolean in_store, gdouble priority, guint group, DownloadDoneFunc done_func, gpointer user_data )
+{
+   gchar *uri = vik_map_source_default_get_uri(VIK_MAP_SOURCE_DEFAULT(self), src);
+   gchar *host = vik_map_source_default_get_hostname(VIK_MAP_SOURCE_DEFAULT(self));
+   DownloadFileOptions *options = vik_map_source_default_get_download_options(VIK_MAP_SOURCE_DEFAULT(self), src);
+   // NB options are taken over
+   if ( in_store )
+     a_http_download_get_url_to_store_async ( host, uri, dest_fn, src->x, src->y, options, priority, group, done_func, user_data );
+   else
+     a_http_download_get_url_async ( host, uri, dest_fn, options, priority, group, done_func, user_data );
+   g_free ( uri );
+   g_free ( host );
+   return TRUE;
+}
+
 static const gchar *
 map_source_get_file_extension (VikMapSource *self)
 {
@@ -0,0 +1,144 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, Viking Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+
+#include "vikpointindex.h"
+
+// Aim for this many points per cell on average
+#define POINTS_PER_CELL 8
+// Avoid very small cells (in degrees - ~1m) when all points are in much the same place
+#define MIN_CELL_SIZE 0.00001
+
+typedef struct {
+  struct LatLon ll;
+  guint id;
+  gpointer data;
+} PointEntry;
+
+struct _VikPointIndex {
+  gdouble cell_size; // Degrees
+  GHashTable *cells; // gint64 cell key -> GArray of PointEntry
+  guint count;
+};
+
+static inline gint cell_coord ( const VikPointIndex *vpi, gdouble value )
+{
+  return (gint)floor ( value / vpi->cell_size );
+}
+
+static inline gint64 cell_key ( gint row, gint col )
+{
+  return ((gint64)row << 32) | (guint32)col;
+}
+
+/**
+ * vik_point_index_new:
+ * @bbox:            The expected extent of the points (points outside are still handled)
+ * @expected_points: The expected number of points, used to size the grid cells
+ */
+VikPointIndex *vik_point_index_new ( const LatLonBBox *bbox, guint expected_points )
+{
+  VikPointIndex *vpi = g_malloc0 ( sizeof(VikPointIndex) );
+
+  gdouble extent = MAX ( bbox->north - bbox->south, bbox->east - bbox->west );
+  gdouble cells_per_side = sqrt ( (gdouble)MAX(expected_points, 1) / POINTS_PER_CELL );
+  if ( cells_per_side < 1.0 )
+    cells_per_side = 1.0;
+  vpi->cell_size = extent / cells_per_side;
+  if ( isnan(vpi->cell_size) || vpi->cell_size < MIN_CELL_SIZE )
+    vpi->cell_size = MIN_CELL_SIZE;
+
+  vpi->cells = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, (GDestroyNotify)g_array_unref );
+  return vpi;
+}
+
+void vik_point_index_free ( VikPointIndex *vpi )
+{
+  if ( !vpi )
+    return;
+  g_hash_table_destroy ( vpi->cells );
+  g_free ( vpi );
+}
+
+void vik_point_index_add ( VikPointIndex *vpi, const struct LatLon *ll, guint id, gpointer data )
+{
+  gint64 key = cell_key ( cell_coord(vpi, ll->lat), cell_coord(vpi, ll->lon) );
+  GArray *cell = g_hash_table_lookup ( vpi->cells, &key );
+  if ( !cell ) {
+    cell = g_array_new ( FALSE, FALSE, sizeof(PointEntry) );
+    g_hash_table_insert ( vpi->cells, g_memdup(&key, sizeof(gint64)), cell );
+  }
+  PointEntry entry = { *ll, id, data };
+  g_array_append_val ( cell, entry );
+  vpi->count++;
+}
+
+guint vik_point_index_get_count ( const VikPointIndex *vpi )
+{
+  return vpi->count;
+}
+
+static void cell_foreach_in_bbox ( GArray *cell, const LatLonBBox *bbox, VikPointIndexFunc func, gpointer user_data )
+{
+  for ( guint ii = 0; ii < cell->len; ii++ ) {
+    PointEntry *entry = &g_array_index ( cell, PointEntry, ii );
+    if ( entry->ll.lat >= bbox->south && entry->ll.lat <= bbox->north &&
+         entry->ll.lon >= bbox->west && entry->ll.lon <= bbox->east )
+      func ( &entry->ll, entry->id, entry->data, user_data );
+  }
+}
+
+/**
+ * vik_point_index_foreach_in_bbox:
+ *
+ * Call the function for each point within the area (inclusive of the edges)
+ */
+void vik_point_index_foreach_in_bbox ( const VikPointIndex *vpi, const LatLonBBox *bbox, VikPointIndexFunc func, gpointer user_data )
+{
+  gint row_min = cell_coord ( vpi, bbox->south );
+  gint row_max = cell_coord ( vpi, bbox->north );
+  gint col_min = cell_coord ( vpi, bbox->west );
+  gint col_max = cell_coord ( vpi, bbox->east );
+
+  // When the area covers more cells than are in use, it's quicker to check each used cell
+  gdouble area_cells = ((gdouble)row_max - row_min + 1) * ((gdouble)col_max - col_min + 1);
+  if ( area_cells > g_hash_table_size(vpi->cells) ) {
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init ( &iter, vpi->cells );
+    while ( g_hash_table_iter_next(&iter, NULL, &value) )
+      cell_foreach_in_bbox ( (GArray*)value, bbox, func, user_data );
+    return;
+  }
+
+  for ( gint row = row_min; row <= row_max; row++ ) {
+    for ( gint col = col_min; col <= col_max; col++ ) {
+      gint64 key = cell_key ( row, col );
+      GArray *cell = g_hash_table_lookup ( vpi->cells, &key );
+      if ( cell )
+        cell_foreach_in_bbox ( cell, bbox, func, user_data );
+    }
+  }
+}
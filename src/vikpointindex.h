@@ -0,0 +1,49 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, Viking Developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef _VIKING_POINTINDEX_H
+#define _VIKING_POINTINDEX_H
+
+#include <glib.h>
+
+#include "coords.h"
+#include "bbox.h"
+
+G_BEGIN_DECLS
+
+/*
+ * A uniform grid of positions, so that the points within an area can be found
+ *  without considering every point.
+ * Each point has an identifier (e.g. position in a list or a hash table key)
+ *  and optionally a pointer to the item itself, to allow the caller to find the actual item.
+ */
+typedef struct _VikPointIndex VikPointIndex;
+
+typedef void (*VikPointIndexFunc) ( const struct LatLon *ll, guint id, gpointer data, gpointer user_data );
+
+VikPointIndex *vik_point_index_new ( const LatLonBBox *bbox, guint expected_points );
+void vik_point_index_free ( VikPointIndex *vpi );
+void vik_point_index_add ( VikPointIndex *vpi, const struct LatLon *ll, guint id, gpointer data );
+guint vik_point_index_get_count ( const VikPointIndex *vpi );
+void vik_point_index_foreach_in_bbox ( const VikPointIndex *vpi, const LatLonBBox *bbox, VikPointIndexFunc func, gpointer user_data );
+
+G_END_DECLS
+
+#endif
@@ -35,9 +35,78 @@
 #include "dems.h"
 #include "settings.h"
 
+/*
+ * Values for the whole track, all calculated in one pass over the trackpoints
+ */
+typedef struct {
+  gulong tp_count;
+  gdouble length;
+  gdouble length_including_gaps;
+  gdouble duration;          // Between the first and last trackpoints
+  gdouble duration_segments; // Total within segments
+  gdouble speed_length;      // Length and time of the timed parts within segments - for the average speed
+  gdouble speed_time;
+  gdouble max_speed;         // -1 when unavailable
+  gdouble elev_up;
+  gdouble elev_down;
+  gdouble min_alt;           // 25000 when unavailable
+  gdouble max_alt;           // -5000 when unavailable
+  // For updating the values when a trackpoint is added
+  gdouble first_timestamp;
+  VikCoord last_coord;
+  gdouble last_timestamp;
+  gdouble last_altitude;
+} TrackStatsValues;
+
+/*
+ * The values are kept until the trackpoints change
+ * Where possible, adding a trackpoint updates the values rather than invalidating them
+ */
+struct _VikTrackStats {
+  gint valid;      // Accessed atomically
+  gint generation; // Incremented whenever the trackpoints change; accessed atomically
+  // The values may be wanted by background threads whilst being calculated on another,
+  //  so they are only copied in or out (and valid set) with the lock held
+  GMutex lock;
+  TrackStatsValues values;
+  // The last entry of the trackpoint list, so adding to the end doesn't need to go through the whole list
+  //  only valid whilst the generation is unchanged (since any other change may have altered the list)
+  GList *tail;
+  gint tail_generation;
+  // Likewise the trackpoint index refers to the list entries, so is only valid whilst the generation is unchanged
+  gint tp_index_generation;
+  // Built on demand by vik_track_search_time() and kept whilst the generation is unchanged
+  // The lock allows searches of the same track from several background threads at once
+  struct _TrackTimeIndex *time_index;
+  GRWLock time_index_lock;
+};
+
+/*
+ * The trackpoints with a timestamp, in list order
+ */
+typedef struct _TrackTimeIndex {
+  gint generation;
+  gboolean ordered; // Whether the timestamps never decrease, and so can be searched
+  guint n;
+  gdouble *times;
+  GList **nodes;
+} TrackTimeIndex;
+
+static void track_time_index_free ( TrackTimeIndex *ti )
+{
+  if ( !ti )
+    return;
+  g_free ( ti->times );
+  g_free ( ti->nodes );
+  g_free ( ti );
+}
+
 VikTrack *vik_track_new()
 {
   VikTrack *tr = g_malloc0 ( sizeof ( VikTrack ) );
+  tr->stats = g_malloc0 ( sizeof ( VikTrackStats ) );
+  g_mutex_init ( &tr->stats->lock );
+  g_rw_lock_init ( &tr->stats->time_index_lock );
   tr->ref_count = 1;
   tr->visible = TRUE;
   vik_track_set_defaults ( tr );
@@ -196,6 +265,13 @@ void vik_track_free(VikTrack *tr)
     g_free ( tr->extensions );
   g_list_foreach ( tr->trackpoints, (GFunc) vik_trackpoint_free, NULL );
   g_list_free( tr->trackpoints );
+  vik_point_index_free ( tr->tp_index );
+  if ( tr->lods )
+    g_ptr_array_free ( tr->lods, TRUE );
+  track_time_index_free ( tr->stats->time_index );
+  g_mutex_clear ( &tr->stats->lock );
+  g_rw_lock_clear ( &tr->stats->time_index_lock );
+  g_free ( tr->stats );
   if (tr->property_dialog)
     if ( GTK_IS_WIDGET(tr->property_dialog) )
       gtk_widget_destroy ( GTK_WIDGET(tr->property_dialog) );
@@ -307,6 +383,17 @@ VikTrackpoint *vik_trackpoint_copy(VikTrackpoint *tp)
   return new_tp;
 }
 
+/*
+ * The last entry of the trackpoint list
+ */
+static GList *track_get_tail ( const VikTrack *tr )
+{
+  VikTrackStats *stats = tr->stats;
+  if ( stats->tail && stats->tail_generation == g_atomic_int_get(&stats->generation) && !stats->tail->next )
+    return stats->tail;
+  return g_list_last ( tr->trackpoints );
+}
+
 /**
  * track_recalculate_bounds_last_tp:
  * @trk:   The track to consider the recalculation on
@@ -315,12 +402,15 @@ VikTrackpoint *vik_trackpoint_copy(VikTrackpoint *tp)
  */
 static void track_recalculate_bounds_last_tp ( VikTrack *trk )
 {
-  GList *tpl = g_list_last ( trk->trackpoints );
+  const VikCoord *last = NULL;
+  GList *tpl = track_get_tail ( trk );
+  if ( tpl )
+    last = &(VIK_TRACKPOINT(tpl->data)->coord);
 
-  if ( tpl ) {
+  if ( last ) {
     struct LatLon ll;
     // See if this trackpoint increases the track bounds and update if so
-    vik_coord_to_latlon ( &(VIK_TRACKPOINT(tpl->data)->coord), &ll );
+    vik_coord_to_latlon ( last, &ll );
     if ( ll.lat > trk->bbox.north )
       trk->bbox.north = ll.lat;
     if ( ll.lon < trk->bbox.west )
@@ -332,6 +422,150 @@ static void track_recalculate_bounds_last_tp ( VikTrack *trk )
   }
 }
 
+/**
+ * vik_track_invalidate_stats:
+ *
+ * Discard the statistics and simplified versions (see vik_track_get_lod()) held for the track.
+ * vik_track_calculate_bounds() does this too, so this is only needed for changes
+ *  that can't affect the bounds, such as to trackpoint times, altitudes or segments.
+ */
+void vik_track_invalidate_stats ( VikTrack *tr )
+{
+  g_mutex_lock ( &tr->stats->lock );
+  g_atomic_int_set ( &tr->stats->valid, 0 );
+  g_atomic_int_inc ( &tr->stats->generation );
+  g_mutex_unlock ( &tr->stats->lock );
+}
+
+/**
+ * vik_track_get_generation:
+ *
+ * Returns: A value that changes whenever the trackpoints of the track are changed,
+ *  so anything derived from them can be checked to be up to date
+ */
+guint vik_track_get_generation ( const VikTrack *tr )
+{
+  return (guint)g_atomic_int_get ( &tr->stats->generation );
+}
+
+static gdouble *track_make_diffs ( const VikTrack *tr, gdouble *total );
+
+/*
+ * Include the next trackpoint (@tp) into the statistics
+ * @diff: Distance from the previous trackpoint (i.e. as held in @stats)
+ */
+static void track_stats_add_next ( TrackStatsValues *stats, const VikTrackpoint *tp, gdouble diff )
+{
+  if ( !tp->newsegment )
+    stats->length += diff;
+  stats->length_including_gaps += diff;
+
+  if ( !isnan(tp->timestamp) && !isnan(stats->last_timestamp) && !tp->newsegment ) {
+    gdouble time = ABS(tp->timestamp - stats->last_timestamp);
+    stats->duration_segments += time;
+    stats->speed_length += diff;
+    stats->speed_time += time;
+    gdouble speed = diff / time;
+    if ( speed > stats->max_speed )
+      stats->max_speed = speed;
+  }
+
+  if ( !isnan(tp->altitude) && !isnan(stats->last_altitude) ) {
+    gdouble alt_diff = tp->altitude - stats->last_altitude;
+    if ( alt_diff > 0 )
+      stats->elev_up += alt_diff;
+    else
+      stats->elev_down -= alt_diff;
+  }
+}
+
+static void track_stats_set_last ( TrackStatsValues *stats, const VikTrackpoint *tp )
+{
+  stats->tp_count++;
+  if ( !isnan(tp->altitude) ) {
+    if ( tp->altitude > stats->max_alt )
+      stats->max_alt = tp->altitude;
+    if ( tp->altitude < stats->min_alt )
+      stats->min_alt = tp->altitude;
+  }
+  stats->last_coord = tp->coord;
+  stats->last_timestamp = tp->timestamp;
+  stats->last_altitude = tp->altitude;
+  if ( !isnan(stats->first_timestamp) && !isnan(tp->timestamp) )
+    stats->duration = tp->timestamp - stats->first_timestamp;
+  else
+    stats->duration = 0;
+}
+
+/*
+ * Update the statistics for a trackpoint being added onto the end of the track
+ */
+static void track_stats_append ( VikTrackStats *stats, const VikTrackpoint *tp )
+{
+  g_mutex_lock ( &stats->lock );
+  track_stats_add_next ( &stats->values, tp, vik_coord_diff(&tp->coord, &stats->values.last_coord) );
+  track_stats_set_last ( &stats->values, tp );
+  g_atomic_int_inc ( &stats->generation );
+  g_mutex_unlock ( &stats->lock );
+}
+
+static void track_stats_calculate ( const VikTrack *tr, TrackStatsValues *stats )
+{
+  stats->tp_count = 0;
+  stats->length = 0.0;
+  stats->duration = 0.0;
+  stats->duration_segments = 0.0;
+  stats->speed_length = 0.0;
+  stats->speed_time = 0.0;
+  stats->max_speed = -1.0;
+  stats->elev_up = 0.0;
+  stats->elev_down = 0.0;
+  stats->min_alt = 25000;
+  stats->max_alt = -5000;
+  stats->first_timestamp = NAN;
+
+  gdouble *diffs = track_make_diffs ( tr, NULL );
+  stats->length_including_gaps = 0.0;
+
+  guint ii = 0;
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next, ii++ ) {
+    const VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    if ( ii == 0 )
+      stats->first_timestamp = tp->timestamp;
+    else
+      track_stats_add_next ( stats, tp, diffs[ii] );
+    track_stats_set_last ( stats, tp );
+  }
+  g_free ( diffs );
+}
+
+/*
+ * Get a copy of the statistics of the track, calculating them if necessary
+ */
+static void track_get_stats ( const VikTrack *tr, TrackStatsValues *values )
+{
+  VikTrackStats *stats = tr->stats;
+  g_mutex_lock ( &stats->lock );
+  gboolean valid = g_atomic_int_get ( &stats->valid );
+  gint generation = g_atomic_int_get ( &stats->generation );
+  if ( valid )
+    *values = stats->values;
+  g_mutex_unlock ( &stats->lock );
+  if ( valid )
+    return;
+
+  // Calculated without the lock, so others can still get the statistics of the track meanwhile
+  track_stats_calculate ( tr, values );
+
+  // Only kept if the track wasn't changed meanwhile
+  g_mutex_lock ( &stats->lock );
+  if ( g_atomic_int_get(&stats->generation) == generation ) {
+    stats->values = *values;
+    g_atomic_int_set ( &stats->valid, 1 );
+  }
+  g_mutex_unlock ( &stats->lock );
+}
+
 /**
  * vik_track_add_trackpoint:
  * @tr:          The track to which the trackpoint will be added
@@ -341,16 +575,52 @@ static void track_recalculate_bounds_last_tp ( VikTrack *trk )
  *               (But ensure calculate_bounds() is called after adding all points!!)
  *
  * The trackpoint is added to the end of the existing trackpoint list
+ *  (the end is remembered, so continually adding points, e.g. when recording a track, is efficient)
  */
 void vik_track_add_trackpoint ( VikTrack *tr, VikTrackpoint *tp, gboolean recalculate )
 {
   // When it's the first trackpoint need to ensure the bounding box is initialized correctly
-  gboolean adding_first_point = tr->trackpoints ? FALSE : TRUE;
-  tr->trackpoints = g_list_append ( tr->trackpoints, tp );
+  gboolean adding_first_point = ( tr->trackpoints == NULL );
+  // Any index can be kept up to date, since it's simple to add the new point on the end
+  gboolean index_current = tr->tp_index && !adding_first_point &&
+    tr->stats->tp_index_generation == g_atomic_int_get ( &tr->stats->generation );
+
+  // Whereas simplified versions have to be regenerated
+  if ( tr->lods ) {
+    g_ptr_array_free ( tr->lods, TRUE );
+    tr->lods = NULL;
+  }
+
+  // The statistics can simply be updated too
+  if ( !adding_first_point && g_atomic_int_get(&tr->stats->valid) )
+    track_stats_append ( tr->stats, tp );
+  else
+    vik_track_invalidate_stats ( tr );
+
+  GList *tail = adding_first_point ? NULL : track_get_tail ( tr );
+  if ( tail ) {
+    (void)g_list_append ( tail, tp );
+    tail = tail->next;
+  }
+  else
+    tr->trackpoints = tail = g_list_append ( NULL, tp );
+  tr->stats->tail = tail;
+
   if ( adding_first_point )
     vik_track_calculate_bounds ( tr );
   else if ( recalculate )
     track_recalculate_bounds_last_tp ( tr );
+
+  if ( index_current ) {
+    struct LatLon ll;
+    vik_coord_to_latlon ( &tp->coord, &ll );
+    vik_point_index_add ( tr->tp_index, &ll, vik_point_index_get_count(tr->tp_index), tail );
+  }
+
+  // Now all the changes are done
+  tr->stats->tail_generation = g_atomic_int_get ( &tr->stats->generation );
+  if ( index_current )
+    tr->stats->tp_index_generation = tr->stats->tail_generation;
 }
 
 /**
@@ -384,46 +654,50 @@ gdouble vik_track_get_length_to_trackpoint (const VikTrack *tr, const VikTrackpo
   return len;
 }
 
+/*
+ * Distances between consecutive trackpoints (in order of the trackpoints, with 0 for the first one)
+ *  calculated in bulk
+ * Free the returned array with g_free()
+ */
+static gdouble *track_make_diffs ( const VikTrack *tr, gdouble *total )
+{
+  guint n = vik_track_get_tp_count ( tr );
+  gdouble *diffs = g_malloc ( sizeof(gdouble) * MAX(n,1) );
+  VikCoord *coords = g_malloc ( sizeof(VikCoord) * MAX(n,1) );
+  guint ii = 0;
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next )
+    coords[ii++] = VIK_TRACKPOINT(iter->data)->coord;
+  gdouble len = vik_coord_diff_n ( coords, n, diffs );
+  g_free ( coords );
+  if ( total )
+    *total = len;
+  return diffs;
+}
+
 gdouble vik_track_get_length(const VikTrack *tr)
 {
-  gdouble len = 0.0;
-  if ( tr->trackpoints )
-  {
-    GList *iter = tr->trackpoints->next;
-    while (iter)
-    {
-      if ( iter->data ) {
-        if ( ! VIK_TRACKPOINT(iter->data)->newsegment )
-          len += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-                                  &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-      }
-      iter = iter->next;
-    }
-  }
-  return len;
+  TrackStatsValues stats;
+  track_get_stats ( tr, &stats );
+  return stats.length;
 }
 
 gdouble vik_track_get_length_including_gaps(const VikTrack *tr)
 {
-  gdouble len = 0.0;
-  if ( tr->trackpoints )
-  {
-    GList *iter = tr->trackpoints->next;
-    while (iter)
-    {
-      if ( iter->data ) {
-        len += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-                                &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-      }
-      iter = iter->next;
-    }
-  }
-  return len;
+  TrackStatsValues stats;
+  track_get_stats ( tr, &stats );
+  return stats.length_including_gaps;
 }
 
 gulong vik_track_get_tp_count(const VikTrack *tr)
 {
-  return g_list_length(tr->trackpoints);
+  // NB Don't calculate the statistics here, as that uses this
+  gulong count = 0;
+  g_mutex_lock ( &tr->stats->lock );
+  gboolean valid = g_atomic_int_get ( &tr->stats->valid );
+  if ( valid )
+    count = tr->stats->values.tp_count;
+  g_mutex_unlock ( &tr->stats->lock );
+  return valid ? count : g_list_length(tr->trackpoints);
 }
 
 gulong vik_track_get_dup_point_count ( const VikTrack *tr )
@@ -538,6 +812,52 @@ gulong vik_track_remove_same_time_points ( VikTrack *tr )
   return num;
 }
 
+/**
+ * vik_track_get_duplicate_hash:
+ *
+ * A hash of the start time and number of trackpoints,
+ *  so that possible duplicates of a track (e.g. from loading the same file twice or merging layers)
+ *  can be found without comparing against every other track.
+ * Tracks that are vik_track_equalish() always have the same hash.
+ */
+guint vik_track_get_duplicate_hash ( const VikTrack *tr )
+{
+  guint hash = (guint)vik_track_get_tp_count ( tr ) * 31 + (tr->is_route ? 1 : 0);
+  if ( tr->trackpoints && !isnan(VIK_TRACKPOINT(tr->trackpoints->data)->timestamp) ) {
+    gint64 start = (gint64)floor ( VIK_TRACKPOINT(tr->trackpoints->data)->timestamp );
+    hash ^= g_int64_hash ( &start );
+  }
+  return hash;
+}
+
+/**
+ * vik_track_equalish:
+ *
+ * Returns: TRUE if both tracks have the same trackpoints,
+ *  with the same times and (within the #vik_coord_equalish() tolerance) positions.
+ *  Other properties such as names are not considered.
+ */
+gboolean vik_track_equalish ( const VikTrack *tr1, const VikTrack *tr2 )
+{
+  if ( tr1->is_route != tr2->is_route )
+    return FALSE;
+  if ( vik_track_get_tp_count(tr1) != vik_track_get_tp_count(tr2) )
+    return FALSE;
+
+  GList *iter1 = tr1->trackpoints;
+  GList *iter2 = tr2->trackpoints;
+  for ( ; iter1 && iter2; iter1 = iter1->next, iter2 = iter2->next ) {
+    const VikTrackpoint *tp1 = VIK_TRACKPOINT(iter1->data);
+    const VikTrackpoint *tp2 = VIK_TRACKPOINT(iter2->data);
+    if ( !vik_coord_equalish ( &tp1->coord, &tp2->coord ) )
+      return FALSE;
+    if ( !isnan(tp1->timestamp) != !isnan(tp2->timestamp) ||
+         ( !isnan(tp1->timestamp) && tp1->timestamp != tp2->timestamp ) )
+      return FALSE;
+  }
+  return !iter1 && !iter2;
+}
+
 /**
  * vik_track_remove_all_points:
  **/
@@ -591,6 +911,8 @@ gboolean vik_track_remove_dodgy_first_point ( VikTrack *tr, guint speed, gboolea
             tr->trackpoints = g_list_delete_link ( tr->trackpoints, iter );
             if ( recalc_bounds )
               vik_track_calculate_bounds ( tr );
+            else
+              vik_track_invalidate_stats ( tr );
 	  }
 	}
       }
@@ -628,6 +950,7 @@ void vik_track_to_routepoints ( VikTrack *tr )
 
     iter = iter->next;
   }
+  vik_track_invalidate_stats ( tr );
 }
 
 guint vik_track_get_segment_count(const VikTrack *tr)
@@ -636,8 +959,7 @@ guint vik_track_get_segment_count(const VikTrack *tr)
   GList *iter = tr->trackpoints;
   if ( !iter )
     return 0;
-  while ( (iter = iter->next) )
-  {
+  while ( (iter = iter->next) ) {
     if ( VIK_TRACKPOINT(iter->data)->newsegment )
       num++;
   }
@@ -715,6 +1037,8 @@ guint vik_track_merge_segments(VikTrack *tr)
       num++;
     }
   }
+  if ( num )
+    vik_track_invalidate_stats ( tr );
   return num;
 }
 
@@ -740,6 +1064,7 @@ void vik_track_reverse ( VikTrack *tr )
     }
     iter = iter->prev;
   }
+  vik_track_invalidate_stats ( tr );
 }
 
 /**
@@ -752,35 +1077,12 @@ void vik_track_reverse ( VikTrack *tr )
  */
 gdouble vik_track_get_duration(const VikTrack *tr, gboolean segment_gaps)
 {
-  gdouble duration = 0;
-  if ( tr->trackpoints ) {
-    // Ensure times are available
-    if ( !isnan(vik_track_get_tp_first(tr)->timestamp) ) {
-      // Get trkpt only once - as using vik_track_get_tp_last() iterates whole track each time
-      if (segment_gaps) {
-        // Simple duration
-        VikTrackpoint *trkpt_last = vik_track_get_tp_last(tr);
-        if ( !isnan(trkpt_last->timestamp) ) {
-          gdouble t1 = vik_track_get_tp_first(tr)->timestamp;
-          gdouble t2 = trkpt_last->timestamp;
-          duration = t2 - t1;
-        }
-      }
-      else {
-        // Total within segments
-        GList *iter = tr->trackpoints->next;
-        while (iter) {
-          if ( !isnan(VIK_TRACKPOINT(iter->data)->timestamp) &&
-               !isnan(VIK_TRACKPOINT(iter->prev->data)->timestamp) &&
-              (!VIK_TRACKPOINT(iter->data)->newsegment) ) {
-            duration += ABS(VIK_TRACKPOINT(iter->data)->timestamp - VIK_TRACKPOINT(iter->prev->data)->timestamp);
-          }
-          iter = iter->next;
-        }
-      }
-    }
-  }
-  return duration;
+  TrackStatsValues stats;
+  track_get_stats ( tr, &stats );
+  // Ensure times are available
+  if ( isnan(stats.first_timestamp) )
+    return 0;
+  return segment_gaps ? stats.duration : stats.duration_segments;
 }
 
 /**
@@ -800,25 +1102,9 @@ VikCoord vik_track_get_center ( VikTrack *tr, VikCoordMode cmode )
 
 gdouble vik_track_get_average_speed(const VikTrack *tr)
 {
-  gdouble len = 0.0;
-  gdouble time = 0;
-  if ( tr->trackpoints )
-  {
-    GList *iter = tr->trackpoints->next;
-    while (iter)
-    {
-      if ( !isnan(VIK_TRACKPOINT(iter->data)->timestamp) &&
-           !isnan(VIK_TRACKPOINT(iter->prev->data)->timestamp) &&
-          (! VIK_TRACKPOINT(iter->data)->newsegment) )
-      {
-        len += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-                                &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-        time += ABS(VIK_TRACKPOINT(iter->data)->timestamp - VIK_TRACKPOINT(iter->prev->data)->timestamp);
-      }
-      iter = iter->next;
-    }
-  }
-  return (time == 0) ? 0 : ABS(len/time);
+  TrackStatsValues stats;
+  track_get_stats ( tr, &stats );
+  return (stats.speed_time == 0) ? 0 : ABS(stats.speed_length/stats.speed_time);
 }
 
 /**
@@ -835,21 +1121,18 @@ gdouble vik_track_get_average_speed_moving (const VikTrack *tr, int stop_length_
 {
   gdouble len = 0.0;
   gdouble time = 0;
-  if ( tr->trackpoints )
-  {
+  if ( tr->trackpoints ) {
     GList *iter = tr->trackpoints->next;
-    while (iter)
-    {
-      if ( !isnan(VIK_TRACKPOINT(iter->data)->timestamp) &&
-           !isnan(VIK_TRACKPOINT(iter->prev->data)->timestamp) &&
-          (! VIK_TRACKPOINT(iter->data)->newsegment) )
-      {
-	if ( ( VIK_TRACKPOINT(iter->data)->timestamp - VIK_TRACKPOINT(iter->prev->data)->timestamp ) < stop_length_seconds ) {
-	  len += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-				  &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-
-	  time += ABS(VIK_TRACKPOINT(iter->data)->timestamp - VIK_TRACKPOINT(iter->prev->data)->timestamp);
-	}
+    while ( iter ) {
+      const VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+      const VikTrackpoint *prev = VIK_TRACKPOINT(iter->prev->data);
+      if ( !isnan(tp->timestamp) &&
+           !isnan(prev->timestamp) &&
+           !tp->newsegment ) {
+        if ( ( tp->timestamp - prev->timestamp ) < stop_length_seconds ) {
+          len += vik_coord_diff ( &tp->coord, &prev->coord );
+          time += ABS(tp->timestamp - prev->timestamp);
+        }
       }
       iter = iter->next;
     }
@@ -870,24 +1153,9 @@ gdouble vik_track_get_average_speed_moving (const VikTrack *tr, int stop_length_
  */
 gdouble vik_track_get_max_speed(const VikTrack *tr)
 {
-  gdouble maxspeed = -1.0, speed = 0.0;
-  if ( tr->trackpoints )
-  {
-    GList *iter = tr->trackpoints->next;
-    while (iter)
-    {
-      if ( !isnan(VIK_TRACKPOINT(iter->data)->timestamp) &&
-           !isnan(VIK_TRACKPOINT(iter->prev->data)->timestamp) &&
-          (! VIK_TRACKPOINT(iter->data)->newsegment) )
-      {
-        speed =  vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord), &(VIK_TRACKPOINT(iter->prev->data)->coord) )
-                 / ABS(VIK_TRACKPOINT(iter->data)->timestamp - VIK_TRACKPOINT(iter->prev->data)->timestamp);
-        if ( speed > maxspeed )
-          maxspeed = speed;
-      }
-      iter = iter->next;
-    }
-  }
+  TrackStatsValues stats;
+  track_get_stats ( tr, &stats );
+  gdouble maxspeed = stats.max_speed;
   if ( maxspeed < 0.0 )
     maxspeed = NAN;
   return maxspeed;
@@ -903,16 +1171,14 @@ gdouble vik_track_get_max_speed(const VikTrack *tr)
  */
 gdouble vik_track_get_max_speed_by_gps(const VikTrack *tr)
 {
-  gdouble maxspeed = -1.0, speed;
+  gdouble maxspeed = -1.0;
   if ( tr->trackpoints ) {
     // NB skips first point (unlikely to be maximum speed / possible false reading anyway)
     GList *iter = tr->trackpoints->next;
-    while (iter) {
-      if ( !isnan(VIK_TRACKPOINT(iter->data)->speed) ) {
-        speed = VIK_TRACKPOINT(iter->data)->speed;
-        if ( speed > maxspeed )
-          maxspeed = speed;
-      }
+    while ( iter ) {
+      gdouble speed = VIK_TRACKPOINT(iter->data)->speed;
+      if ( !isnan(speed) && speed > maxspeed )
+        maxspeed = speed;
       iter = iter->next;
     }
   }
@@ -1325,12 +1591,21 @@ VikTrackpoint *vik_track_get_tp_by_max_power ( const VikTrack *tr )
 
 void vik_track_convert ( VikTrack *tr, VikCoordMode dest_mode )
 {
-  GList *iter = tr->trackpoints;
-  while (iter)
-  {
-    vik_coord_convert ( &(VIK_TRACKPOINT(iter->data)->coord), dest_mode );
-    iter = iter->next;
+  // Convert in bulk via a small buffer
+  VikCoord coords[256];
+  GList *start = tr->trackpoints;
+  while ( start ) {
+    guint n = 0;
+    GList *iter;
+    for ( iter = start; iter && n < G_N_ELEMENTS(coords); iter = iter->next )
+      coords[n++] = VIK_TRACKPOINT(iter->data)->coord;
+    vik_coord_convert_n ( coords, n, dest_mode );
+    n = 0;
+    for ( ; start != iter; start = start->next )
+      VIK_TRACKPOINT(start->data)->coord = coords[n++];
   }
+  // The held last coordinate would otherwise be in the old mode
+  vik_track_invalidate_stats ( tr );
 }
 
 /* I understood this when I wrote it ... maybe ... Basically it eats up the
@@ -1368,15 +1643,18 @@ gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks )
   }
 
   iter = tr->trackpoints;
+  guint index = 0; // Of iter
 
   pts = g_malloc ( sizeof(gdouble) * num_chunks );
 
-  total_length = vik_track_get_length_including_gaps ( tr );
+  // diffs[i] is the length of the segment ending at trackpoint i
+  gdouble *diffs = track_make_diffs ( tr, &total_length );
   chunk_length = total_length / num_chunks;
 
   /* Zero chunk_length (eg, track of 2 tp with the same loc) will cause crash */
   if (chunk_length <= 0) {
     g_free(pts);
+    g_free(diffs);
     return NULL;
   }
 
@@ -1385,8 +1663,7 @@ gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks )
   current_chunk = 0;
   current_seg_length = 0;
 
-  current_seg_length = vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-      &(VIK_TRACKPOINT(iter->next->data)->coord) );
+  current_seg_length = diffs[index+1];
   altitude1 = VIK_TRACKPOINT(iter->data)->altitude;
   altitude2 = VIK_TRACKPOINT(iter->next->data)->altitude;
   dist_along_seg = 0;
@@ -1423,9 +1700,9 @@ gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks )
 
       /* get intervening segs */
       iter = iter->next;
+      index++;
       while ( iter && iter->next ) {
-        current_seg_length = vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-            &(VIK_TRACKPOINT(iter->next->data)->coord) );
+        current_seg_length = diffs[index+1];
         altitude1 = VIK_TRACKPOINT(iter->data)->altitude;
         altitude2 = VIK_TRACKPOINT(iter->next->data)->altitude;
         ignore_it = VIK_TRACKPOINT(iter->next->data)->newsegment;
@@ -1434,6 +1711,7 @@ gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks )
           current_dist += current_seg_length;
           current_area_under_curve += current_seg_length * (altitude1+altitude2) * 0.5;
           iter = iter->next;
+          index++;
         } else {
           break;
         }
@@ -1460,6 +1738,7 @@ gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks )
     }
   }
 
+  g_free ( diffs );
   return pts;
 }
 
@@ -1471,24 +1750,14 @@ gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks )
  */
 void vik_track_get_total_elevation_gain(const VikTrack *tr, gdouble *up, gdouble *down)
 {
-  gdouble diff;
-  *up = *down = 0;
-  if ( tr->trackpoints ) {
-    GList *iter = tr->trackpoints->next;
-    while (iter) {
-      VikTrackpoint *tp1 = VIK_TRACKPOINT(iter->data);
-      VikTrackpoint *tp2 = VIK_TRACKPOINT(iter->prev->data);
-      if ( !isnan(tp1->altitude) && !isnan(tp2->altitude) ) {
-        diff = tp1->altitude - tp2->altitude;
-        if ( diff > 0 )
-          *up += diff;
-        else
-          *down -= diff;
-      }
-      iter = iter->next;
-    }
-  } else
+  TrackStatsValues stats;
+  track_get_stats ( tr, &stats );
+  if ( !stats.tp_count ) {
     *up = *down = NAN;
+    return;
+  }
+  *up = stats.elev_up;
+  *down = stats.elev_down;
 }
 
 gdouble *vik_track_make_gradient_map ( const VikTrack *tr, guint16 num_chunks )
@@ -1534,7 +1803,7 @@ gdouble *vik_track_make_gradient_map ( const VikTrack *tr, guint16 num_chunks )
 /* by Alex Foobarian */
 gdouble *vik_track_make_speed_map ( const VikTrack *tr, guint16 num_chunks )
 {
-  gdouble *v, *s, *t;
+  gdouble *v, *s, *t, *diffs;
   gdouble duration, chunk_dur;
   int i, pt_count, numpts, index;
   GList *iter;
@@ -1568,12 +1837,14 @@ gdouble *vik_track_make_speed_map ( const VikTrack *tr, guint16 num_chunks )
   s[0] = 0;
   t[0] = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
   numpts++;
+  diffs = track_make_diffs ( tr, NULL );
   while (iter) {
-    s[numpts] = s[numpts-1] + vik_coord_diff ( &(VIK_TRACKPOINT(iter->prev->data)->coord), &(VIK_TRACKPOINT(iter->data)->coord) );
+    s[numpts] = s[numpts-1] + diffs[numpts];
     t[numpts] = VIK_TRACKPOINT(iter->data)->timestamp;
     numpts++;
     iter = iter->next;
   }
+  g_free ( diffs );
 
   /* In the following computation, we iterate through periods of time of duration chunk_dur.
    * The first period begins at the beginning of the track.  The last period ends at the end of the track.
@@ -1609,7 +1880,7 @@ gdouble *vik_track_make_speed_map ( const VikTrack *tr, guint16 num_chunks )
  */
 gdouble *vik_track_make_distance_map ( const VikTrack *tr, guint16 num_chunks )
 {
-  gdouble *v, *s, *t;
+  gdouble *v, *s, *t, *diffs;
   gdouble duration, chunk_dur;
   int i, pt_count, numpts, index;
   GList *iter;
@@ -1642,12 +1913,14 @@ gdouble *vik_track_make_distance_map ( const VikTrack *tr, guint16 num_chunks )
   s[0] = 0;
   t[0] = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
   numpts++;
+  diffs = track_make_diffs ( tr, NULL );
   while (iter) {
-    s[numpts] = s[numpts-1] + vik_coord_diff ( &(VIK_TRACKPOINT(iter->prev->data)->coord), &(VIK_TRACKPOINT(iter->data)->coord) );
+    s[numpts] = s[numpts-1] + diffs[numpts];
     t[numpts] = VIK_TRACKPOINT(iter->data)->timestamp;
     numpts++;
     iter = iter->next;
   }
+  g_free ( diffs );
 
   /* In the following computation, we iterate through periods of time of duration chunk_dur.
    * The first period begins at the beginning of the track.  The last period ends at the end of the track.
@@ -1683,7 +1956,7 @@ gdouble *vik_track_make_distance_map ( const VikTrack *tr, guint16 num_chunks )
  */
 gdouble *vik_track_make_speed_dist_map ( const VikTrack *tr, guint16 num_chunks )
 {
-  gdouble *v, *s, *t;
+  gdouble *v, *s, *t, *diffs;
   gint i, pt_count, numpts, index;
   GList *iter;
   gdouble duration, total_length, chunk_length;
@@ -1704,11 +1977,12 @@ gdouble *vik_track_make_speed_dist_map ( const VikTrack *tr, guint16 num_chunks
     return NULL;
   }
 
-  total_length = vik_track_get_length_including_gaps ( tr );
+  diffs = track_make_diffs ( tr, &total_length );
   chunk_length = total_length / num_chunks;
   pt_count = vik_track_get_tp_count(tr);
 
   if (chunk_length <= 0) {
+    g_free ( diffs );
     return NULL;
   }
 
@@ -1723,11 +1997,12 @@ gdouble *vik_track_make_speed_dist_map ( const VikTrack *tr, guint16 num_chunks
   t[0] = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
   numpts++;
   while (iter) {
-    s[numpts] = s[numpts-1] + vik_coord_diff ( &(VIK_TRACKPOINT(iter->prev->data)->coord), &(VIK_TRACKPOINT(iter->data)->coord) );
+    s[numpts] = s[numpts-1] + diffs[numpts];
     t[numpts] = VIK_TRACKPOINT(iter->data)->timestamp;
     numpts++;
     iter = iter->next;
   }
+  g_free ( diffs );
 
   // Iterate through a portion of the track to get an average speed for that part
   // This will essentially interpolate between segments, which I think is right given the usage of 'get_length_including_gaps'
@@ -1998,7 +2273,93 @@ VikTrackpoint *vik_track_get_tp_last ( const VikTrack *tr )
   if ( !tr->trackpoints )
     return NULL;
 
-  return (VikTrackpoint*)g_list_last(tr->trackpoints)->data;
+  return (VikTrackpoint*)track_get_tail(tr)->data;
+}
+
+/**
+ * vik_track_get_tpl_last:
+ *
+ * Returns: The last entry of the trackpoint list,
+ *  which unlike g_list_last() doesn't need to go through the whole list.
+ *  NULL if there are no trackpoints.
+ */
+GList *vik_track_get_tpl_last ( const VikTrack *tr )
+{
+  if ( !tr->trackpoints )
+    return NULL;
+
+  return track_get_tail ( tr );
+}
+
+static TrackTimeIndex *track_time_index_new ( const VikTrack *tr, gint generation )
+{
+  TrackTimeIndex *ti = g_new0 ( TrackTimeIndex, 1 );
+  guint size = g_list_length ( tr->trackpoints );
+  ti->generation = generation;
+  ti->ordered = TRUE;
+  ti->times = g_new ( gdouble, size );
+  ti->nodes = g_new ( GList*, size );
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next ) {
+    gdouble timestamp = VIK_TRACKPOINT(iter->data)->timestamp;
+    if ( isnan(timestamp) )
+      continue;
+    if ( ti->n && timestamp < ti->times[ti->n-1] )
+      ti->ordered = FALSE;
+    ti->times[ti->n] = timestamp;
+    ti->nodes[ti->n] = iter;
+    ti->n++;
+  }
+  return ti;
+}
+
+/**
+ * vik_track_search_time:
+ * @tpl: Returns the first entry of the trackpoint list with a timestamp at or after the time,
+ *       or NULL if there is none
+ *
+ * Uses an index of the trackpoint timestamps, which is kept until the trackpoints change,
+ *  so repeated searches (e.g. when geotagging many images) only take logarithmic time.
+ *
+ * Returns: FALSE if the track can not be searched,
+ *  as its timestamps are not in order
+ */
+gboolean vik_track_search_time ( const VikTrack *tr, gdouble time, GList **tpl )
+{
+  *tpl = NULL;
+
+  VikTrackStats *stats = tr->stats;
+  gint generation = g_atomic_int_get ( &stats->generation );
+  g_rw_lock_reader_lock ( &stats->time_index_lock );
+  TrackTimeIndex *ti = stats->time_index;
+  if ( !ti || ti->generation != generation ) {
+    // Only one thread needs to (re)build it
+    g_rw_lock_reader_unlock ( &stats->time_index_lock );
+    g_rw_lock_writer_lock ( &stats->time_index_lock );
+    ti = stats->time_index;
+    if ( !ti || ti->generation != generation ) {
+      track_time_index_free ( ti );
+      stats->time_index = track_time_index_new ( tr, generation );
+    }
+    g_rw_lock_writer_unlock ( &stats->time_index_lock );
+    g_rw_lock_reader_lock ( &stats->time_index_lock );
+    ti = stats->time_index;
+  }
+
+  gboolean ordered = ti->ordered;
+  if ( ordered && ti->n && time <= ti->times[ti->n-1] ) {
+    // Binary search for the first one not before the time
+    guint lo = 0, hi = ti->n - 1;
+    while ( lo < hi ) {
+      guint mid = lo + (hi - lo) / 2;
+      if ( ti->times[mid] < time )
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    *tpl = ti->nodes[lo];
+  }
+  g_rw_lock_reader_unlock ( &stats->time_index_lock );
+  return ordered;
 }
 
 VikTrackpoint *vik_track_get_tp_prev ( const VikTrack *tr, VikTrackpoint *tp )
@@ -2033,28 +2394,17 @@ gboolean vik_track_get_minmax_alt ( const VikTrack *tr, gdouble *min_alt, gdoubl
 {
   *min_alt = 25000;
   *max_alt = -5000;
-  if ( tr && tr->trackpoints ) {
-    GList *iter = tr->trackpoints;
-    gdouble tmp_alt;
-    while (iter) {
-      VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
-      if ( !isnan(tp->altitude) ) {
-	tmp_alt = tp->altitude;
-	if ( tmp_alt > *max_alt )
-	  *max_alt = tmp_alt;
-	if ( tmp_alt < *min_alt )
-	  *min_alt = tmp_alt;
-      }
-      iter = iter->next;
-    }
-    return (*min_alt != 25000);
-  }
-  return FALSE;
+  if ( !tr )
+    return FALSE;
+  TrackStatsValues stats;
+  track_get_stats ( tr, &stats );
+  *min_alt = stats.min_alt;
+  *max_alt = stats.max_alt;
+  return (*min_alt != 25000);
 }
 
 void vik_track_marshall ( VikTrack *tr, guint8 **data, guint *datalen)
 {
-  GList *tps;
   GByteArray *b = g_byte_array_new();
   guint len;
   guint intp, ntp;
@@ -2072,13 +2422,12 @@ void vik_track_marshall ( VikTrack *tr, guint8 **data, guint *datalen)
   g_byte_array_append(b, (guint8 *)&len, sizeof(len)); \
   if (s) g_byte_array_append(b, (guint8 *)s, len);
 
-  tps = tr->trackpoints;
   ntp = 0;
-  while (tps) {
-    g_byte_array_append(b, (guint8 *)tps->data, sizeof(VikTrackpoint));
-    vtm_append(VIK_TRACKPOINT(tps->data)->name);
-    vtm_append(VIK_TRACKPOINT(tps->data)->extensions);
-    tps = tps->next;
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next ) {
+    const VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    g_byte_array_append(b, (guint8 *)tp, sizeof(VikTrackpoint));
+    vtm_append(tp->name);
+    vtm_append(tp->extensions);
     ntp++;
   }
   *(guint *)(b->data + intp) = ntp;
@@ -2164,35 +2513,40 @@ VikTrack *vik_track_unmarshall (const guint8 *data_in, guint datalen)
  */
 void vik_track_calculate_bounds ( VikTrack *tr )
 {
-  GList *tp_iter;
-  tp_iter = tr->trackpoints;
+  // Any change to the trackpoints makes the index, simplified versions and statistics invalid
+  vik_track_invalidate_stats ( tr );
+  vik_point_index_free ( tr->tp_index );
+  tr->tp_index = NULL;
+  if ( tr->lods ) {
+    g_ptr_array_free ( tr->lods, TRUE );
+    tr->lods = NULL;
+  }
 
   struct LatLon topleft, bottomright, ll;
 
-  // Set bounds to first point
-  if ( tp_iter ) {
-    vik_coord_to_latlon ( &(VIK_TRACKPOINT(tp_iter->data)->coord), &topleft );
-    vik_coord_to_latlon ( &(VIK_TRACKPOINT(tp_iter->data)->coord), &bottomright );
-  } else {
-    // Defaults when no trackpoints
-    //  values aren't actively used, but avoids potential use of uninitialised variables
-    // (they are reset when first trkpt set or entire track is set)
-    topleft.lat = NAN;
-    topleft.lon = NAN;
-    bottomright.lat = NAN;
-    bottomright.lon = NAN;
-  }
-  while ( tp_iter ) {
+  // Defaults when no trackpoints
+  //  values aren't actively used, but avoids potential use of uninitialised variables
+  // (they are reset when first trkpt set or entire track is set)
+  topleft.lat = NAN;
+  topleft.lon = NAN;
+  bottomright.lat = NAN;
+  bottomright.lon = NAN;
 
-    // See if this trackpoint increases the track bounds.
-    vik_coord_to_latlon ( &(VIK_TRACKPOINT(tp_iter->data)->coord), &ll );
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next ) {
+    vik_coord_to_latlon ( &VIK_TRACKPOINT(iter->data)->coord, &ll );
+
+    // Set bounds to first point
+    if ( iter == tr->trackpoints ) {
+      topleft = ll;
+      bottomright = ll;
+      continue;
+    }
 
+    // See if this trackpoint increases the track bounds.
     if ( ll.lat > topleft.lat) topleft.lat = ll.lat;
     if ( ll.lon < topleft.lon) topleft.lon = ll.lon;
     if ( ll.lat < bottomright.lat) bottomright.lat = ll.lat;
     if ( ll.lon > bottomright.lon) bottomright.lon = ll.lon;
-
-    tp_iter = tp_iter->next;
   }
 
   g_debug ( "Bounds of track: '%s' is: %f,%f to: %f,%f", tr->name, topleft.lat, topleft.lon, bottomright.lat, bottomright.lon );
@@ -2203,6 +2557,243 @@ void vik_track_calculate_bounds ( VikTrack *tr )
   tr->bbox.west = topleft.lon;
 }
 
+/**
+ * vik_track_get_tp_index:
+ *
+ * Get the spatial index of the trackpoints, creating it if necessary.
+ * The identifier of each point in the index is its position in the track,
+ *  and the data is its entry in the trackpoint list.
+ *
+ * NB The index is only valid whilst the trackpoints are unchanged,
+ *  hence any modification must be followed by vik_track_calculate_bounds()
+ *  (or use vik_track_add_trackpoint() to add points)
+ */
+VikPointIndex *vik_track_get_tp_index ( VikTrack *tr )
+{
+  if ( tr->tp_index ) {
+    if ( tr->stats->tp_index_generation == g_atomic_int_get(&tr->stats->generation) )
+      return tr->tp_index;
+    vik_point_index_free ( tr->tp_index );
+  }
+
+  tr->stats->tp_index_generation = g_atomic_int_get ( &tr->stats->generation );
+  tr->tp_index = vik_point_index_new ( &tr->bbox, vik_track_get_tp_count(tr) );
+  guint pos = 0;
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next ) {
+    struct LatLon ll;
+    vik_coord_to_latlon ( &(VIK_TRACKPOINT(iter->data)->coord), &ll );
+    vik_point_index_add ( tr->tp_index, &ll, pos++, iter );
+  }
+  return tr->tp_index;
+}
+
+static void track_lod_free ( VikTrackLOD *lod )
+{
+  g_free ( lod->coords );
+  g_free ( lod->timestamps );
+  g_free ( lod->newsegments );
+  g_free ( lod );
+}
+
+/**
+ * Squared distance of a point from the line between two other points
+ *  (treating the coordinates as planar, which is fine at the small tolerances in use)
+ */
+static gdouble track_lod_distance_sqrd ( const VikCoord *pt, const VikCoord *start, const VikCoord *end )
+{
+  gdouble dx = end->east_west - start->east_west;
+  gdouble dy = end->north_south - start->north_south;
+  gdouble px = pt->east_west - start->east_west;
+  gdouble py = pt->north_south - start->north_south;
+  gdouble len_sqrd = dx*dx + dy*dy;
+  if ( len_sqrd > 0.0 ) {
+    gdouble frac = CLAMP ( (px*dx + py*dy) / len_sqrd, 0.0, 1.0 );
+    px -= frac * dx;
+    py -= frac * dy;
+  }
+  return px*px + py*py;
+}
+
+// Not worth simplifying tracks with few points
+#define TRACK_LOD_MIN_POINTS 64
+
+static VikTrackLOD *track_lod_new ( VikTrack *tr, gint level )
+{
+  VikTrackLOD *lod = g_malloc0 ( sizeof(VikTrackLOD) );
+  lod->level = level;
+
+  guint n = vik_track_get_tp_count ( tr );
+  if ( n < TRACK_LOD_MIN_POINTS )
+    return lod;
+
+  const gdouble tolerance = ldexp ( 1.0, level );
+  const gdouble tol_sqrd = tolerance * tolerance;
+  VikCoord *coords = g_new ( VikCoord, n );
+  gdouble *timestamps = g_new ( gdouble, n );
+  guint8 *newsegments = g_new ( guint8, n );
+  guint mm = 0;
+
+  // First pass: remove points within the tolerance of the previously kept point
+  //  (but always keeping the ends of each segment)
+  gboolean pending = FALSE;
+  VikCoord pending_coord;
+  gdouble pending_timestamp = NAN;
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next ) {
+    const VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    gboolean keep = ( iter == tr->trackpoints || tp->newsegment );
+    if ( keep && pending ) {
+      coords[mm] = pending_coord;
+      timestamps[mm] = pending_timestamp;
+      newsegments[mm] = FALSE;
+      mm++;
+    }
+    if ( !keep ) {
+      gdouble dx = tp->coord.east_west - coords[mm-1].east_west;
+      gdouble dy = tp->coord.north_south - coords[mm-1].north_south;
+      keep = ( dx*dx + dy*dy > tol_sqrd );
+    }
+    if ( keep ) {
+      coords[mm] = tp->coord;
+      timestamps[mm] = tp->timestamp;
+      newsegments[mm] = tp->newsegment;
+      mm++;
+      pending = FALSE;
+    }
+    else {
+      pending = TRUE;
+      pending_coord = tp->coord;
+      pending_timestamp = tp->timestamp;
+    }
+  }
+  if ( pending ) {
+    coords[mm] = pending_coord;
+    timestamps[mm] = pending_timestamp;
+    newsegments[mm] = FALSE;
+    mm++;
+  }
+
+  // Second pass: Douglas-Peucker on each segment
+  //  (iteratively via a stack of ranges, as tracks can be very long)
+  gboolean *keep = g_new0 ( gboolean, mm );
+  GArray *stack = g_array_new ( FALSE, FALSE, sizeof(guint) );
+  guint start = 0;
+  for ( guint ii = 1; ii <= mm; ii++ ) {
+    if ( ii < mm && !newsegments[ii] )
+      continue;
+    // Segment is [start, ii-1]
+    guint end = ii - 1;
+    keep[start] = keep[end] = TRUE;
+    if ( end > start + 1 ) {
+      g_array_append_val ( stack, start );
+      g_array_append_val ( stack, end );
+    }
+    while ( stack->len ) {
+      guint last = g_array_index ( stack, guint, stack->len-1 );
+      guint first = g_array_index ( stack, guint, stack->len-2 );
+      g_array_set_size ( stack, stack->len-2 );
+      gdouble max_dist = 0.0;
+      guint index = first;
+      for ( guint jj = first+1; jj < last; jj++ ) {
+        gdouble dist = track_lod_distance_sqrd ( &coords[jj], &coords[first], &coords[last] );
+        if ( dist > max_dist ) {
+          max_dist = dist;
+          index = jj;
+        }
+      }
+      if ( max_dist > tol_sqrd ) {
+        keep[index] = TRUE;
+        if ( index > first + 1 ) {
+          g_array_append_val ( stack, first );
+          g_array_append_val ( stack, index );
+        }
+        if ( last > index + 1 ) {
+          g_array_append_val ( stack, index );
+          g_array_append_val ( stack, last );
+        }
+      }
+    }
+    start = ii;
+  }
+  g_array_free ( stack, TRUE );
+
+  guint kept = 0;
+  for ( guint ii = 0; ii < mm; ii++ )
+    if ( keep[ii] )
+      kept++;
+
+  // Only worth holding on to when it significantly reduces the amount to draw
+  if ( kept <= n / 2 ) {
+    lod->n_points = kept;
+    lod->coords = g_new ( VikCoord, kept );
+    lod->timestamps = g_new ( gdouble, kept );
+    lod->newsegments = g_new ( guint8, kept );
+    guint jj = 0;
+    for ( guint ii = 0; ii < mm; ii++ ) {
+      if ( keep[ii] ) {
+        lod->coords[jj] = coords[ii];
+        lod->timestamps[jj] = timestamps[ii];
+        lod->newsegments[jj] = newsegments[ii];
+        jj++;
+      }
+    }
+  }
+
+  g_free ( keep );
+  g_free ( coords );
+  g_free ( timestamps );
+  g_free ( newsegments );
+  return lod;
+}
+
+/**
+ * vik_track_get_lod:
+ * @tolerance: The acceptable deviation from the track
+ *             (in the units of the coordinate mode, e.g. the size of a pixel)
+ *
+ * Get a simplified version of the track suitable for drawing at the given tolerance.
+ * These are generated on demand and kept for each power of two of tolerance,
+ *  so panning and returning to a zoom level reuses the same version.
+ *
+ * Returns: The simplified version or NULL if it would not be any simpler
+ *
+ * NB Like vik_track_get_tp_index(), this relies on vik_track_calculate_bounds()
+ *  or vik_track_invalidate_stats() being called whenever the trackpoints are modified.
+ */
+const VikTrackLOD *vik_track_get_lod ( VikTrack *tr, gdouble tolerance )
+{
+  if ( !(tolerance > 0.0) || !isfinite(tolerance) )
+    return NULL;
+
+  // Round down to a power of two, so it's never coarser than requested
+  gint level;
+  (void)frexp ( tolerance, &level );
+  level--;
+
+  if ( !tr->lods )
+    tr->lods = g_ptr_array_new_with_free_func ( (GDestroyNotify)track_lod_free );
+
+  // All versions are made at the same generation, so if one is out of date they all are
+  guint generation = vik_track_get_generation ( tr );
+  if ( tr->lods->len && ((VikTrackLOD*)g_ptr_array_index(tr->lods, 0))->generation != generation )
+    g_ptr_array_set_size ( tr->lods, 0 );
+
+  VikTrackLOD *lod = NULL;
+  for ( guint ii = 0; ii < tr->lods->len; ii++ ) {
+    VikTrackLOD *ll = g_ptr_array_index ( tr->lods, ii );
+    if ( ll->level == level ) {
+      lod = ll;
+      break;
+    }
+  }
+  if ( !lod ) {
+    lod = track_lod_new ( tr, level );
+    lod->generation = generation;
+    g_ptr_array_add ( tr->lods, lod );
+  }
+
+  return lod->n_points ? lod : NULL;
+}
+
 /**
  * vik_track_anonymize_times:
  *
@@ -2235,6 +2826,7 @@ void vik_track_anonymize_times ( VikTrack *tr )
     }
     tp_iter = tp_iter->next;
   }
+  vik_track_invalidate_stats ( tr );
 }
 
 /**
@@ -2286,6 +2878,62 @@ void vik_track_interpolate_times ( VikTrack *tr )
   }
 }
 
+/**
+ * vik_track_get_dem_positions:
+ * @skip_existing: When TRUE, skip trackpoints that already have an elevation
+ * @coords:        Array of #VikCoord to append the positions to
+ * @indices:       Array of guint to append the trackpoint indices to
+ *
+ * Collect the positions needing a DEM value, so the DEM lookups can be done in one batch
+ *  (possibly together with those of other tracks)
+ *
+ * Returns: The number of positions added
+ */
+guint vik_track_get_dem_positions ( VikTrack *tr, gboolean skip_existing, GArray *coords, GArray *indices )
+{
+  guint count = 0;
+  guint index = 0;
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next, index++ ) {
+    const VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    // Don't apply if the point already has a value and the overwrite is off
+    if ( !(skip_existing && !isnan(tp->altitude)) ) {
+      g_array_append_vals ( coords, &tp->coord, 1 );
+      g_array_append_vals ( indices, &index, 1 );
+      count++;
+    }
+  }
+  return count;
+}
+
+/**
+ * vik_track_set_dem_elevations:
+ * @indices: The trackpoint indices, in increasing order
+ * @elevs:   The corresponding elevations, VIK_DEM_INVALID_ELEVATION values are ignored
+ * @count:   The number of values
+ *
+ * Set the elevations previously looked up for the positions from vik_track_get_dem_positions()
+ *
+ * Returns: The number of trackpoints changed
+ */
+gulong vik_track_set_dem_elevations ( VikTrack *tr, const guint *indices, const gint16 *elevs, guint count )
+{
+  gulong num = 0;
+  GList *tp_iter = tr->trackpoints;
+  guint index = 0;
+  for ( guint ii = 0; ii < count; ii++ ) {
+    if ( elevs[ii] == VIK_DEM_INVALID_ELEVATION )
+      continue;
+    // Indices are in increasing order, so just move along the list
+    for ( ; index < indices[ii]; index++ )
+      tp_iter = tp_iter->next;
+    VIK_TRACKPOINT(tp_iter->data)->altitude = elevs[ii];
+    num++;
+  }
+  if ( num )
+    vik_track_invalidate_stats ( tr );
+  return num;
+}
+
 /**
  * vik_track_apply_dem_data:
  * @skip_existing: When TRUE, don't change the elevation if the trackpoint already has a value
@@ -2295,24 +2943,24 @@ void vik_track_interpolate_times ( VikTrack *tr )
 gulong vik_track_apply_dem_data ( VikTrack *tr, gboolean skip_existing )
 {
   gulong num = 0;
-  GList *tp_iter;
-  gint16 elev;
-  tp_iter = tr->trackpoints;
-  while ( tp_iter ) {
-    // Don't apply if the point already has a value and the overwrite is off
-    if ( !(skip_existing && !isnan(VIK_TRACKPOINT(tp_iter->data)->altitude)) ) {
-      /* TODO: of the 4 possible choices we have for choosing an elevation
-       * (trackpoint in between samples), choose the one with the least elevation change
-       * as the last */
-      elev = a_dems_get_elev_by_coord ( &(VIK_TRACKPOINT(tp_iter->data)->coord), VIK_DEM_INTERPOL_BEST );
-
-      if ( elev != VIK_DEM_INVALID_ELEVATION ) {
-        VIK_TRACKPOINT(tp_iter->data)->altitude = elev;
-	num++;
-      }
-    }
-    tp_iter = tp_iter->next;
-  }
+  guint n_points = vik_track_get_tp_count ( tr );
+  if ( n_points == 0 )
+    return num;
+
+  GArray *coords = g_array_sized_new ( FALSE, FALSE, sizeof(VikCoord), n_points );
+  GArray *indices = g_array_sized_new ( FALSE, FALSE, sizeof(guint), n_points );
+  guint count = vik_track_get_dem_positions ( tr, skip_existing, coords, indices );
+
+  /* TODO: of the 4 possible choices we have for choosing an elevation
+   * (trackpoint in between samples), choose the one with the least elevation change
+   * as the last */
+  gint16 *elevs = g_new ( gint16, count );
+  if ( a_dems_get_elevs_by_coords ( (VikCoord*)coords->data, count, VIK_DEM_INTERPOL_BEST, elevs ) )
+    num = vik_track_set_dem_elevations ( tr, (guint*)indices->data, elevs, count );
+
+  g_free ( elevs );
+  g_array_free ( indices, TRUE );
+  g_array_free ( coords, TRUE );
   return num;
 }
 
@@ -2488,6 +3136,8 @@ gulong vik_track_smooth_missing_elevation_data ( VikTrack *tr, gboolean flat )
     tp_iter = tp_iter->next;
   }
 
+  if ( num )
+    vik_track_invalidate_stats ( tr );
   return num;
 }
 
@@ -2543,6 +3193,7 @@ VikCoord *vik_track_cut_back_to_double_point ( VikTrack *tr )
 
       prev->next = NULL;
 
+      vik_track_invalidate_stats ( tr );
       return rv;
     }
     iter = iter->prev;
@@ -2554,6 +3205,7 @@ VikCoord *vik_track_cut_back_to_double_point ( VikTrack *tr )
   g_list_foreach ( tr->trackpoints, (GFunc) g_free, NULL );
   g_list_free( tr->trackpoints );
   tr->trackpoints = NULL;
+  vik_track_invalidate_stats ( tr );
   return rv;
 }
 
@@ -28,6 +28,7 @@
 #include "vikcoord.h"
 #include "bbox.h"
 #include "globals.h"
+#include "vikpointindex.h"
 
 G_BEGIN_DECLS
 
@@ -76,6 +77,8 @@ typedef enum {
 //  This is simpler than having to rewrite particularly every track function for route version
 //   given that they do the same things
 //  Mostly this matters in the display in deciding where and how they are shown
+typedef struct _VikTrackStats VikTrackStats;
+
 typedef struct _VikTrack VikTrack;
 struct _VikTrack {
   GList *trackpoints;
@@ -97,8 +100,25 @@ struct _VikTrack {
   gboolean has_color;
   GdkColor color;
   LatLonBBox bbox;
+  VikPointIndex *tp_index; // Created on demand (see vik_track_get_tp_index()), rebuilt once the trackpoints change
+  GPtrArray *lods; // Of VikTrackLOD, created on demand (see vik_track_get_lod()), regenerated once the trackpoints change
+  VikTrackStats *stats; // Whole track values (length, duration etc...) kept once calculated, until the trackpoints change
 };
 
+/*
+ * A simplified version of a track for drawing at a particular scale
+ * Each point is within the tolerance (2^level in the units of the coordinate mode)
+ *  of the line drawn through the full track.
+ */
+typedef struct {
+  gint level;
+  guint generation; // Of the track when created (see vik_track_get_generation())
+  guint n_points; // 0 when simplification is not worthwhile at this level
+  VikCoord *coords;
+  gdouble *timestamps;
+  guint8 *newsegments;
+} VikTrackLOD;
+
 typedef struct {
   gdouble length; // Metres
   guint time;     // Seconds
@@ -148,6 +168,8 @@ gulong vik_track_remove_dup_points ( VikTrack *tr );
 gulong vik_track_get_same_time_point_count ( const VikTrack *tr );
 gulong vik_track_remove_same_time_points ( VikTrack *tr );
 void vik_track_remove_all_points ( VikTrack *tr );
+guint vik_track_get_duplicate_hash ( const VikTrack *tr );
+gboolean vik_track_equalish ( const VikTrack *tr1, const VikTrack *tr2 );
 
 gboolean vik_track_remove_dodgy_first_point ( VikTrack *vt, guint speed, gboolean recalc_bounds );
 
@@ -187,6 +209,8 @@ VikTrackpoint *vik_track_get_tp_by_max_alt ( const VikTrack *tr );
 VikTrackpoint *vik_track_get_tp_by_min_alt ( const VikTrack *tr );
 VikTrackpoint *vik_track_get_tp_first ( const VikTrack *tr );
 VikTrackpoint *vik_track_get_tp_last ( const VikTrack *tr );
+GList *vik_track_get_tpl_last ( const VikTrack *tr );
+gboolean vik_track_search_time ( const VikTrack *tr, gdouble time, GList **tpl );
 VikTrackpoint *vik_track_get_tp_prev ( const VikTrack *tr, VikTrackpoint *tp );
 gdouble *vik_track_make_gradient_map ( const VikTrack *tr, guint16 num_chunks );
 gdouble *vik_track_make_speed_map ( const VikTrack *tr, guint16 num_chunks );
@@ -207,10 +231,16 @@ void vik_track_marshall ( VikTrack *tr, guint8 **data, guint *len);
 VikTrack *vik_track_unmarshall (const guint8 *data_in, guint datalen);
 
 void vik_track_calculate_bounds ( VikTrack *tr );
+void vik_track_invalidate_stats ( VikTrack *tr );
+guint vik_track_get_generation ( const VikTrack *tr );
+VikPointIndex *vik_track_get_tp_index ( VikTrack *tr );
+const VikTrackLOD *vik_track_get_lod ( VikTrack *tr, gdouble tolerance );
 
 void vik_track_anonymize_times ( VikTrack *tr );
 void vik_track_interpolate_times ( VikTrack *tr );
 gulong vik_track_apply_dem_data ( VikTrack *tr, gboolean skip_existing );
+guint vik_track_get_dem_positions ( VikTrack *tr, gboolean skip_existing, GArray *coords, GArray *indices );
+gulong vik_track_set_dem_elevations ( VikTrack *tr, const guint *indices, const gint16 *elevs, guint count );
 //void vik_track_apply_dem_data_last_trackpoint ( VikTrack *tr );
 gulong vik_track_smooth_missing_elevation_data ( VikTrack *tr, gboolean flat );
 
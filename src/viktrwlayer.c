@@ -60,6 +60,7 @@
 #include "vikexttools.h"
 #include "vikexttool_datasources.h"
 #include "vikrouting.h"
+#include "coordgrid.h"
 
 #include <ctype.h>
 #include <gdk/gdkkeysyms.h>
@@ -126,6 +127,7 @@ struct _VikTrwLayer {
   GtkTreeIter tracks_iter, routes_iter, waypoints_iter;
   gboolean tracks_visible, routes_visible, waypoints_visible;
   LatLonBBox waypoints_bbox;
+  VikPointIndex *wp_index; // Created on demand, cleared when the waypoint bounds are recalculated
 
   gboolean track_draw_labels;
   guint8 drawmode;
@@ -232,9 +234,12 @@ struct _VikTrwLayer {
   GHashTable *image_cache;
   guint8 image_size;
   guint image_cache_size;
+  guint wp_draw_pass;          // Incremented for each draw of the waypoints
+  guint thumbnail_redraw_id;   // Pending redraw for newly available thumbnails
 
   /* for waypoint text */
   PangoLayout *wplabellayout;
+  GHashTable *wp_labels;       // Waypoint -> wp_label_t, so labels aren't remade on every draw
 
   gboolean has_verified_thumbnails;
 
@@ -277,6 +282,7 @@ struct DrawingParams {
   gdouble ce1, ce2, cn1, cn2;
   LatLonBBox bbox;
   gboolean highlight;
+  GArray *labels; // Waypoint labels to be placed once all the waypoints are drawn, or NULL to draw them directly
 };
 
 static gboolean trw_layer_delete_waypoint ( VikTrwLayer *vtl, VikWaypoint *wp );
@@ -351,6 +357,8 @@ static void trw_layer_delete_tracks_from_selection ( menu_array_layer values );
 static void trw_layer_delete_all_waypoints ( menu_array_layer values );
 static void trw_layer_delete_waypoints_from_selection ( menu_array_layer values );
 static void trw_layer_delete_duplicate_waypoints ( menu_array_layer values );
+static void trw_layer_delete_duplicate_tracks ( menu_array_layer values );
+static void trw_layer_delete_duplicate_routes ( menu_array_layer values );
 #ifdef VIK_CONFIG_GEONAMES
 static void trw_layer_new_wikipedia_wp_viewport ( menu_array_layer values );
 static void trw_layer_new_wikipedia_wp_layer ( menu_array_layer values );
@@ -740,7 +748,8 @@ VikLayerParam trw_layer_params[] = {
   { VIK_LAYER_TRW, "preferGPSspeed", VIK_LAYER_PARAM_BOOLEAN, GROUP_TRACKS_ADV, N_("Use GPS Speed"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL,
     N_("Use reported GPS speed values - particularly for maximum speed"), vik_lpd_true_default, NULL, NULL },
 
-  { VIK_LAYER_TRW, "drawlabels", VIK_LAYER_PARAM_BOOLEAN, GROUP_WAYPOINTS, N_("Draw Labels"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, NULL, vik_lpd_true_default, NULL, NULL },
+  { VIK_LAYER_TRW, "drawlabels", VIK_LAYER_PARAM_BOOLEAN, GROUP_WAYPOINTS, N_("Draw Labels"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL,
+    N_("Labels that would overlap others are not drawn"), vik_lpd_true_default, NULL, NULL },
   { VIK_LAYER_TRW, "wpfontsize", VIK_LAYER_PARAM_UINT, GROUP_WAYPOINTS, N_("Waypoint Font Size:"), VIK_LAYER_WIDGET_COMBOBOX, params_font_sizes, NULL, NULL, wpfontsize_default, NULL, NULL },
   { VIK_LAYER_TRW, "wptextcolor", VIK_LAYER_PARAM_COLOR, GROUP_WAYPOINTS, N_("Waypoint Text:"), VIK_LAYER_WIDGET_COLOR, NULL, NULL, NULL, wptextcolor_default, NULL, NULL },
   { VIK_LAYER_TRW, "wpbgcolor", VIK_LAYER_PARAM_COLOR, GROUP_WAYPOINTS, N_("Background:"), VIK_LAYER_WIDGET_COLOR, NULL, NULL, NULL, wpbgcolor_default, NULL, NULL },
@@ -1077,6 +1086,8 @@ void vik_trw_layer_set_laps ( VikTrwLayer *vtl, GQueue *value )
 typedef struct {
   gboolean found;
   const gchar *date_str;
+  gboolean have_day;
+  gdouble day_start;
   const VikTrack *trk;
   const VikWaypoint *wpt;
   gpointer trk_id;
@@ -1100,36 +1111,26 @@ static gboolean trw_layer_find_date_track ( const gpointer id, const VikTrack *t
       df->trk = trk;
       df->trk_id = id;
     }
-    // Extended test - slower as analyses whole track
-    if ( TRUE ) {
-      GTimeVal tv;
-      // See also g_date_time_new_from_iso8601() but glib 2.56 needed
-      // NB the time val is for the beginning of day
-      // Force date_str into value considered to be ISO8601 by this function
-      gchar *ds = g_strdup_printf ( "%sT00:00:00", df->date_str );
-      if ( g_time_val_from_iso8601(ds, &tv) ) {
-        // Step through track to find parts that may be on this date
-        // Process in chunks for every 100th point in order to speed up search
-        GList *tp_iter;
-        tp_iter = trk->trackpoints;
-        guint count = 0;
-        while ( tp_iter ) {
-          count++;
-          if ( count % 100 == 0 || tp_iter->next == NULL ) {
-            VikTrackpoint *tpt = VIK_TRACKPOINT(tp_iter->data);
-            if ( !isnan(tpt->timestamp) &&
-                 tpt->timestamp < tv.tv_sec+86400 &&
-                 tpt->timestamp > tv.tv_sec ) {
-              df->found = TRUE;
-              df->trk = trk;
-              df->trk_id = id;
-              break;
-            }
-          }
-          tp_iter = tp_iter->next;
+    // Extended test - any trackpoint on this date
+    if ( !df->found && df->have_day ) {
+      GList *tp_iter;
+      if ( vik_track_search_time ( trk, df->day_start, &tp_iter ) ) {
+        // Simply the first trackpoint from the start of the day
+        df->found = tp_iter && VIK_TRACKPOINT(tp_iter->data)->timestamp < df->day_start + SECS_IN_DAY;
+      }
+      else {
+        // Timestamps not in order, so step through the whole track
+        for ( tp_iter = trk->trackpoints; tp_iter && !df->found; tp_iter = tp_iter->next ) {
+          VikTrackpoint *tpt = VIK_TRACKPOINT(tp_iter->data);
+          df->found = !isnan(tpt->timestamp) &&
+                      tpt->timestamp < df->day_start + SECS_IN_DAY &&
+                      tpt->timestamp >= df->day_start;
         }
       }
-      g_free ( ds );
+      if ( df->found ) {
+        df->trk = trk;
+        df->trk_id = id;
+      }
     }
   }
   return df->found;
@@ -1164,8 +1165,17 @@ gboolean vik_trw_layer_find_date ( VikTrwLayer *vtl, const gchar *date_str, VikC
   df.trk = NULL;
   df.wpt = NULL;
   // Only tracks ATM
-  if ( do_tracks )
+  if ( do_tracks ) {
+    GTimeVal tv;
+    // See also g_date_time_new_from_iso8601() but glib 2.56 needed
+    // NB the time val is for the beginning of day
+    // Force date_str into value considered to be ISO8601 by this function
+    gchar *ds = g_strdup_printf ( "%sT00:00:00", date_str );
+    df.have_day = g_time_val_from_iso8601 ( ds, &tv );
+    df.day_start = df.have_day ? tv.tv_sec : 0;
+    g_free ( ds );
     g_hash_table_find ( vtl->tracks, (GHRFunc) trw_layer_find_date_track, &df );
+  }
   else
     g_hash_table_find ( vtl->waypoints, (GHRFunc) trw_layer_find_date_waypoint, &df );
 
@@ -1572,6 +1582,8 @@ static gboolean trw_layer_set_param ( VikTrwLayer *vtl, VikLayerSetParam *vlsp )
           case FS_XX_LARGE: vtl->wp_fsize_str = g_strdup ( "xx-large" ); break;
           default: vtl->wp_fsize_str = g_strdup ( "medium" ); break;
         }
+        if ( changed )
+          g_hash_table_remove_all ( vtl->wp_labels );
       }
       break;
     case PARAM_WPSO:
@@ -1962,9 +1974,118 @@ static guint strcase_hash(gconstpointer v)
 }
 */
 
-static void pixbuf_free ( GdkPixbuf *pixbuf )
+typedef struct {
+  GdkPixbuf *pixbuf;
+  guint drawn; // The draw pass it was last used in
+} cached_image_t;
+
+static void cached_image_free ( cached_image_t *ci )
+{
+  g_object_unref ( G_OBJECT(ci->pixbuf) );
+  g_free ( ci );
+}
+
+typedef struct {
+  gchar *name; // What the layout was made from, as the waypoint may be renamed
+  PangoLayout *layout;
+  gint width, height;
+  guint drawn; // The draw pass it was last used in
+} wp_label_t;
+
+static void wp_label_free ( wp_label_t *label )
+{
+  g_free ( label->name );
+  g_object_unref ( G_OBJECT(label->layout) );
+  g_free ( label );
+}
+
+#define IMAGE_CACHE_DEFAULT "\x12\x00" /* this shouldn't occur naturally. */
+
+/**
+ * Store a scaled copy of a thumbnail in the image cache, with the alpha setting applied
+ *
+ * When the cache is full, an image not used in the latest draw is replaced.
+ * If everything in the cache is currently on display, the cache grows beyond its size
+ *  (see trw_layer_image_cache_trim()) so that all the images on display can be drawn.
+ * Returns: The cached image, or NULL if it couldn't be scaled
+ */
+static cached_image_t *trw_layer_image_cache_add ( VikTrwLayer *vtl, const gchar *key, GdkPixbuf *thumb )
+{
+  if ( g_hash_table_size(vtl->image_cache) >= vtl->image_cache_size ) {
+    GHashTableIter iter;
+    cached_image_t *old;
+    gboolean evicted = FALSE;
+    g_hash_table_iter_init ( &iter, vtl->image_cache );
+    while ( !evicted && g_hash_table_iter_next ( &iter, NULL, (gpointer*)&old ) ) {
+      if ( old->drawn != vtl->wp_draw_pass ) {
+        g_hash_table_iter_remove ( &iter );
+        evicted = TRUE;
+      }
+    }
+  }
+
+  GdkPixbuf *pixbuf = a_thumbnails_scale_pixbuf ( thumb, vtl->image_size, vtl->image_size );
+  if ( vtl->image_alpha != 255 ) {
+    // The thumbnail may be shared, so don't modify it
+    if ( pixbuf == thumb ) {
+      g_object_unref ( G_OBJECT(pixbuf) );
+      pixbuf = gdk_pixbuf_copy ( thumb );
+    }
+    if ( pixbuf )
+      pixbuf = ui_pixbuf_set_alpha ( pixbuf, vtl->image_alpha );
+  }
+  if ( !pixbuf )
+    return NULL;
+
+  cached_image_t *ci = g_malloc ( sizeof(cached_image_t) );
+  ci->pixbuf = pixbuf;
+  ci->drawn = vtl->wp_draw_pass;
+  g_hash_table_insert ( vtl->image_cache, g_strdup(key), ci );
+  return ci;
+}
+
+/**
+ * Return the image cache to its size, once the images no longer on display allow it
+ */
+static void trw_layer_image_cache_trim ( VikTrwLayer *vtl )
+{
+  if ( g_hash_table_size(vtl->image_cache) <= vtl->image_cache_size )
+    return;
+  GHashTableIter iter;
+  cached_image_t *ci;
+  g_hash_table_iter_init ( &iter, vtl->image_cache );
+  while ( g_hash_table_size(vtl->image_cache) > vtl->image_cache_size &&
+          g_hash_table_iter_next ( &iter, NULL, (gpointer*)&ci ) )
+    if ( ci->drawn != vtl->wp_draw_pass )
+      g_hash_table_iter_remove ( &iter );
+}
+
+static gboolean trw_layer_thumbnail_redraw ( VikTrwLayer *vtl )
+{
+  vtl->thumbnail_redraw_id = 0;
+  vik_layer_emit_update ( VIK_LAYER(vtl), FALSE );
+  return FALSE;
+}
+
+/**
+ * A requested thumbnail is now available (or NULL if it couldn't be made)
+ */
+static void trw_layer_thumbnail_ready ( GObject *object, const gchar *filename, GdkPixbuf *thumb )
 {
-  g_object_unref ( G_OBJECT(pixbuf) );
+  VikTrwLayer *vtl = VIK_TRW_LAYER(object);
+  if ( g_hash_table_lookup ( vtl->image_cache, filename ) )
+    return;
+
+  // Remember failures too, so they aren't tried again on every draw
+  GdkPixbuf *regularthumb = thumb ? g_object_ref ( thumb ) : a_thumbnails_get_default ();
+  if ( !regularthumb )
+    return;
+  cached_image_t *ci = trw_layer_image_cache_add ( vtl, filename, regularthumb );
+  g_object_unref ( G_OBJECT(regularthumb) );
+
+  // Combine redraws as thumbnails are often ready in quick succession
+  if ( ci && !vtl->thumbnail_redraw_id )
+    vtl->thumbnail_redraw_id = g_timeout_add ( 250, (GSourceFunc)trw_layer_thumbnail_redraw, vtl );
 }
 
 // Stick a 1 at the end of the function name to make it more unique
@@ -1993,7 +2114,8 @@ static VikTrwLayer* trw_layer_new1 ( VikViewport *vvp )
   rv->routes = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) vik_track_free );
   rv->routes_iters = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, g_free );
 
-  rv->image_cache = g_hash_table_new_full ( g_str_hash, g_str_equal, NULL, (GDestroyNotify) pixbuf_free ); // Must be performed before set_params via set_defaults
+  rv->image_cache = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify) cached_image_free );
+  rv->wp_labels = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) wp_label_free ); // Must be performed before set_params via set_defaults
 
   vik_layer_set_defaults ( VIK_LAYER(rv), vvp );
 
@@ -2013,6 +2135,7 @@ static VikTrwLayer* trw_layer_new1 ( VikViewport *vvp )
 
 static void trw_layer_free ( VikTrwLayer *trwlayer )
 {
+  vik_point_index_free ( trwlayer->wp_index );
   g_hash_table_destroy(trwlayer->waypoints);
   g_hash_table_destroy(trwlayer->waypoints_iters);
   g_hash_table_destroy(trwlayer->tracks);
@@ -2059,6 +2182,9 @@ static void trw_layer_free ( VikTrwLayer *trwlayer )
     gtk_widget_destroy ( GTK_WIDGET(trwlayer->tracks_analysis_dialog) );
 
   g_hash_table_destroy ( trwlayer->image_cache );
+  if ( trwlayer->thumbnail_redraw_id )
+    g_source_remove ( trwlayer->thumbnail_redraw_id );
+  g_hash_table_destroy ( trwlayer->wp_labels );
 
   g_free ( trwlayer->external_file );
   g_free ( trwlayer->external_dirpath );
@@ -2089,6 +2215,7 @@ static void init_drawing_params ( struct DrawingParams *dp, VikTrwLayer *vtl, Vi
   dp->vtl = vtl;
   dp->vp = vp;
   dp->highlight = highlight;
+  dp->labels = NULL;
   dp->vw = (VikWindow *)VIK_GTK_WINDOW_FROM_LAYER(dp->vtl);
   dp->xmpp = vik_viewport_get_xmpp ( vp );
   dp->ympp = vik_viewport_get_ympp ( vp );
@@ -2133,12 +2260,12 @@ static void init_drawing_params ( struct DrawingParams *dp, VikTrwLayer *vtl, Vi
  *  . average is yellow
  *  . fast points are green
  */
-static gint track_section_colour_by_speed ( VikTrwLayer *vtl, VikTrackpoint *tp1, VikTrackpoint *tp2, gdouble average_speed, gdouble low_speed, gdouble high_speed )
+static gint section_colour_by_speed ( const VikCoord *coord1, gdouble ts1, const VikCoord *coord2, gdouble ts2, gdouble average_speed, gdouble low_speed, gdouble high_speed )
 {
   gdouble rv = 0;
-  if ( !isnan(tp1->timestamp) && !isnan(tp2->timestamp) ) {
+  if ( !isnan(ts1) && !isnan(ts2) ) {
     if ( average_speed > 0 ) {
-      rv = ( vik_coord_diff ( &(tp1->coord), &(tp2->coord) ) / (tp1->timestamp - tp2->timestamp) );
+      rv = ( vik_coord_diff ( coord1, coord2 ) / (ts1 - ts2) );
       if ( rv < low_speed )
         return VIK_TRW_LAYER_TRACK_GC_SLOW;
       else if ( rv > high_speed )
@@ -2150,6 +2277,21 @@ static gint track_section_colour_by_speed ( VikTrwLayer *vtl, VikTrackpoint *tp1
   return VIK_TRW_LAYER_TRACK_GC_BLACK;
 }
 
+static gint track_section_colour_by_speed ( VikTrwLayer *vtl, VikTrackpoint *tp1, VikTrackpoint *tp2, gdouble average_speed, gdouble low_speed, gdouble high_speed )
+{
+  return section_colour_by_speed ( &(tp1->coord), tp1->timestamp, &(tp2->coord), tp2->timestamp, average_speed, low_speed, high_speed );
+}
+
+static GdkColor track_gc_colour ( VikTrwLayer *vtl, gint gc_index )
+{
+  switch ( gc_index ) {
+  case VIK_TRW_LAYER_TRACK_GC_SLOW: return vtl->slow_color;
+  case VIK_TRW_LAYER_TRACK_GC_AVER: return vtl->aver_color;
+  case VIK_TRW_LAYER_TRACK_GC_FAST: return vtl->fast_color;
+  default: return vtl->black_color;
+  }
+}
+
 
 #if GTK_CHECK_VERSION (3,0,0)
 static GdkColor track_section_gdkcolour_by_speed ( VikTrwLayer *vtl, VikTrackpoint *tp1, VikTrackpoint *tp2, gdouble average_speed, gdouble low_speed, gdouble high_speed )
@@ -2481,6 +2623,116 @@ static void trw_layer_draw_point_names ( struct DrawingParams *dp, VikTrack *trk
   g_free ( bgcolour );
 }
 
+/**
+ * Lines to be drawn in one go
+ */
+typedef struct {
+  GArray *points;  // Of GdkPoint
+  GArray *lengths; // Of gint - the number of points in each line
+} TrackLineBatch;
+
+/**
+ * Add the line between two screen positions to the batch,
+ *  extending the last line in the batch when @join is set
+ *
+ * Returns: Whether the next line may be joined on to this one
+ */
+static gboolean track_line_batch_add ( TrackLineBatch *tlb, struct DrawingParams *dp, gint x1, gint y1, gint x2, gint y2, gboolean join )
+{
+  // Ignore lines wholly off screen, as vik_viewport_draw_line() does
+  if ( ( x1 < 0 && x2 < 0 ) || ( y1 < 0 && y2 < 0 ) ||
+       ( x1 > dp->width && x2 > dp->width ) || ( y1 > dp->height && y2 > dp->height ) )
+    return FALSE;
+
+  gboolean clip = ( x1 > G_MAXINT16 || x1 < G_MININT16 || y1 > G_MAXINT16 || y1 < G_MININT16 ||
+                    x2 > G_MAXINT16 || x2 < G_MININT16 || y2 > G_MAXINT16 || y2 < G_MININT16 );
+  if ( clip )
+    a_viewport_clip_line ( &x1, &y1, &x2, &y2 );
+
+  if ( join && !clip ) {
+    GdkPoint pt = { x2, y2 };
+    g_array_append_val ( tlb->points, pt );
+    g_array_index ( tlb->lengths, gint, tlb->lengths->len-1 )++;
+  }
+  else {
+    GdkPoint pts[2] = { { x1, y1 }, { x2, y2 } };
+    g_array_append_vals ( tlb->points, pts, 2 );
+    gint len = 2;
+    g_array_append_val ( tlb->lengths, len );
+  }
+  return !clip;
+}
+
+/**
+ * trw_layer_draw_track_lod:
+ *
+ * Draw only the lines of a track, using a simplified version of it.
+ * Lines of the same colour are collected and drawn together.
+ */
+static void trw_layer_draw_track_lod ( struct DrawingParams *dp, VikTrack *track, const VikTrackLOD *lod, GdkGC *main_gc, GdkColor *main_gcolor, guint lt, gboolean draw_track_outline, gboolean by_speed )
+{
+  // When colouring by speed, a batch for each of the speed GCs
+  TrackLineBatch batches[VIK_TRW_LAYER_TRACK_GC_FAST+1];
+  const guint num_batches = by_speed ? G_N_ELEMENTS(batches) : 1;
+  for ( guint bb = 0; bb < num_batches; bb++ ) {
+    batches[bb].points = g_array_sized_new ( FALSE, FALSE, sizeof(GdkPoint), lod->n_points );
+    batches[bb].lengths = g_array_new ( FALSE, FALSE, sizeof(gint) );
+  }
+
+  gdouble average_speed = 0.0;
+  gdouble low_speed = 0.0;
+  gdouble high_speed = 0.0;
+  if ( by_speed ) {
+    average_speed = vik_track_get_average_speed_moving(track, dp->vtl->stop_length);
+    low_speed = average_speed - (average_speed*(dp->vtl->track_draw_speed_factor/100.0));
+    high_speed = average_speed + (average_speed*(dp->vtl->track_draw_speed_factor/100.0));
+  }
+
+  gint x, y, oldx, oldy;
+  gint joinable = -1; // The batch whose last line finishes at the old position
+  vik_viewport_coord_to_screen ( dp->vp, &lod->coords[0], &oldx, &oldy );
+
+  for ( guint ii = 1; ii < lod->n_points; ii++ ) {
+    const VikCoord *prev = &lod->coords[ii-1];
+    const VikCoord *coord = &lod->coords[ii];
+    vik_viewport_coord_to_screen ( dp->vp, coord, &x, &y );
+
+    // Same reasoning as trw_layer_draw_track() for not drawing lines across the 180 degrees longitude boundary
+    if ( lod->newsegments[ii] ||
+         ( prev->east_west < -90.0 && coord->east_west > 90.0 ) ||
+         ( prev->east_west > 90.0 && coord->east_west < -90.0 ) )
+      joinable = -1;
+    else if ( x != oldx || y != oldy ) {
+      gint bb = 0;
+      if ( by_speed )
+        bb = section_colour_by_speed ( coord, lod->timestamps[ii], prev, lod->timestamps[ii-1], average_speed, low_speed, high_speed );
+      if ( track_line_batch_add ( &batches[bb], dp, oldx, oldy, x, y, joinable == bb ) )
+        joinable = bb;
+      else
+        joinable = -1;
+    }
+    oldx = x;
+    oldy = y;
+  }
+
+  for ( guint bb = 0; bb < num_batches; bb++ ) {
+    if ( batches[bb].lengths->len ) {
+      GdkPoint *points = (GdkPoint*)batches[bb].points->data;
+      gint *lengths = (gint*)batches[bb].lengths->data;
+      if ( draw_track_outline )
+        vik_viewport_draw_polylines ( dp->vp, dp->vtl->track_bg_gc, points, lengths, batches[bb].lengths->len, &dp->vtl->track_bg_color, dp->vtl->line_thickness + dp->vtl->bg_line_thickness );
+      else if ( by_speed ) {
+        GdkColor gcolor = track_gc_colour ( dp->vtl, bb );
+        vik_viewport_draw_polylines ( dp->vp, g_array_index(dp->vtl->track_gc, GdkGC *, bb), points, lengths, batches[bb].lengths->len, &gcolor, lt );
+      }
+      else
+        vik_viewport_draw_polylines ( dp->vp, main_gc, points, lengths, batches[bb].lengths->len, main_gcolor, lt );
+    }
+    g_array_free ( batches[bb].points, TRUE );
+    g_array_free ( batches[bb].lengths, TRUE );
+  }
+}
+
 static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct DrawingParams *dp, gboolean draw_track_outline )
 {
   if ( ! track->visible )
@@ -2554,7 +2806,20 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
     }
   }
 
-  if (list) {
+  // When only the lines are drawn, a simplified version of the track is sufficient
+  //  (greatly reducing the work for long tracks when zoomed out)
+  const VikTrackLOD *lod = NULL;
+  if ( list && dp->lat_lon && dp->vtl->drawlines && !dp->vtl->drawpoints &&
+       !dp->vtl->drawelevation && !dp->vtl->drawdirections && track != dp->vtl->current_track ) {
+    gdouble max_lat = MAX ( fabs(track->bbox.north), fabs(track->bbox.south) );
+    lod = vik_track_get_lod ( track, vik_viewport_get_coord_units_per_pixel ( dp->vp, max_lat ) );
+  }
+
+  if ( lod ) {
+    gboolean by_speed = !drawing_highlight && (dp->vtl->drawmode == DRAWMODE_BY_SPEED);
+    trw_layer_draw_track_lod ( dp, track, lod, main_gc, &main_gcolor, lt, draw_track_outline, by_speed );
+  }
+  else if (list) {
     int x, y, oldx, oldy;
     VikTrackpoint *tp = VIK_TRACKPOINT(list->data);
 
@@ -2765,17 +3030,17 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
         useoldvals = FALSE;
       }
     }
+  }
 
-    // Labels drawn after the trackpoints, so the labels are on top
-    if ( dp->vtl->track_draw_labels ) {
-      if ( track->max_number_dist_labels > 0 ) {
-        trw_layer_draw_dist_labels ( dp, track, drawing_highlight );
-      }
-      trw_layer_draw_point_names (dp, track, drawing_highlight );
+  // Labels drawn after the trackpoints, so the labels are on top
+  if ( track->trackpoints && dp->vtl->track_draw_labels ) {
+    if ( track->max_number_dist_labels > 0 ) {
+      trw_layer_draw_dist_labels ( dp, track, drawing_highlight );
+    }
+    trw_layer_draw_point_names (dp, track, drawing_highlight );
 
-      if ( track->draw_name_mode != TRACK_DRAWNAME_NO ) {
-        trw_layer_draw_track_name_labels ( dp, track, drawing_highlight );
-      }
+    if ( track->draw_name_mode != TRACK_DRAWNAME_NO ) {
+      trw_layer_draw_track_name_labels ( dp, track, drawing_highlight );
     }
   }
 
@@ -2792,6 +3057,88 @@ static void trw_layer_draw_track_cb ( const gpointer id, VikTrack *track, struct
   }
 }
 
+typedef struct {
+  VikWaypoint *wp;
+  gint x, y; // Where the bottom middle of the label should be
+} label_place_t;
+
+/**
+ * Get the label for the waypoint, reusing the previous one when possible
+ */
+static wp_label_t *trw_layer_get_waypoint_label ( VikTrwLayer *vtl, VikWaypoint *wp )
+{
+  if ( !vtl->wplabellayout || !wp->name )
+    return NULL;
+
+  wp_label_t *label = g_hash_table_lookup ( vtl->wp_labels, wp );
+  if ( !label || g_strcmp0 ( label->name, wp->name ) ) {
+    label = g_malloc ( sizeof(wp_label_t) );
+    label->name = g_strdup ( wp->name );
+    label->layout = pango_layout_new ( pango_layout_get_context(vtl->wplabellayout) );
+    pango_layout_set_font_description ( label->layout, pango_layout_get_font_description(vtl->wplabellayout) );
+
+    // Hopefully name won't break the markup (may need to sanitize - g_markup_escape_text())
+    gchar *wp_label_markup = g_strdup_printf ( "<span size=\"%s\">%s</span>", vtl->wp_fsize_str, wp->name );
+
+    if ( pango_parse_markup ( wp_label_markup, -1, 0, NULL, NULL, NULL, NULL ) )
+      pango_layout_set_markup ( label->layout, wp_label_markup, -1 );
+    else
+      // Fallback if parse failure
+      pango_layout_set_text ( label->layout, wp->name, -1 );
+
+    g_free ( wp_label_markup );
+
+    pango_layout_get_pixel_size ( label->layout, &label->width, &label->height );
+    g_hash_table_insert ( vtl->wp_labels, wp, label );
+  }
+  label->drawn = vtl->wp_draw_pass;
+  return label;
+}
+
+static void trw_layer_draw_waypoint_label ( struct DrawingParams *dp, wp_label_t *label, gint label_x, gint label_y )
+{
+  gint width = label->width;
+  gint height = label->height;
+
+  // Cater for 'longer' waypoint names, to ensure background is always shown correctly
+  //  as otherwise vik_viewport_draw_rectangle() will not draw it if too big -ve offset
+  //  hence perform adjustment here, including reducing the width as necessary
+  gint lx_bkgr = (label_x > 0) ? label_x - 1 : 0;
+  gint width_bkgr = (label_x > 0) ? width + 2 : width + 1 - abs(label_x);
+
+  // Ensure background drawing is congruent with text layout limits
+  if (label_x > -VIK_VIEWPORT_LAYOUT_MAX ) {
+    // if highlight mode on, then draw background text in highlight colour
+    if ( dp->highlight ) {
+      GdkColor hcolor = vik_viewport_get_highlight_gdkcolor(dp->vp);
+#if GTK_CHECK_VERSION (3,0,0)
+      if ( dp->vtl->wpbgand ) {
+        GdkRGBA bg = { hcolor.red / 65535.0, hcolor.blue / 65535.0, hcolor.green / 65535.0, 0.5 };
+        gdk_cairo_set_source_rgba ( dp->vtl->waypoint_bg_gc, &bg );
+        vik_viewport_draw_rectangle ( dp->vp, vik_viewport_get_gc_highlight (dp->vp), TRUE, lx_bkgr, label_y-1, width_bkgr, height+2, NULL );
+      }
+      else
+#endif
+      vik_viewport_draw_rectangle ( dp->vp, vik_viewport_get_gc_highlight (dp->vp), TRUE, lx_bkgr, label_y-1, width_bkgr, height+2, &hcolor );
+    }
+    else {
+#if GTK_CHECK_VERSION (3,0,0)
+      if ( dp->vtl->wpbgand ) {
+        GdkRGBA bg = { dp->vtl->waypoint_bg_color.red / 65535.0,
+                       dp->vtl->waypoint_bg_color.blue / 65535.0,
+                       dp->vtl->waypoint_bg_color.green / 65535.0,
+                       0.5 };
+        gdk_cairo_set_source_rgba ( dp->vtl->waypoint_bg_gc, &bg );
+        vik_viewport_draw_rectangle ( dp->vp, dp->vtl->waypoint_bg_gc, TRUE, lx_bkgr, label_y-1, width_bkgr, height+2, NULL );
+      }
+      else
+#endif
+      vik_viewport_draw_rectangle ( dp->vp, dp->vtl->waypoint_bg_gc, TRUE, lx_bkgr, label_y-1, width_bkgr, height+2, &dp->vtl->waypoint_bg_color );
+    }
+  }
+  vik_viewport_draw_layout ( dp->vp, dp->vtl->waypoint_text_gc, label_x, label_y, label->layout, &dp->vtl->waypoint_text_color );
+}
+
 static void trw_layer_draw_waypoint ( const gpointer id, VikWaypoint *wp, struct DrawingParams *dp )
 {
   if ( wp->visible )
@@ -2802,56 +3149,44 @@ static void trw_layer_draw_waypoint ( const gpointer id, VikWaypoint *wp, struct
     gint x, y;
     vik_viewport_coord_to_screen ( dp->vp, &(wp->coord), &x, &y );
 
-    /* if in shrunken_cache, get that. If not, get and add to shrunken_cache */
+    /* if in shrunken_cache, get that. If not, request it and show the default until it is ready */
 
     if ( wp->image && dp->vtl->drawimages )
     {
       if ( dp->vtl->image_alpha == 0)
         return;
 
-      GdkPixbuf *pixbuf = g_hash_table_lookup ( dp->vtl->image_cache, wp->image );
-      if ( !pixbuf )
+      cached_image_t *ci = g_hash_table_lookup ( dp->vtl->image_cache, wp->image );
+      if ( !ci )
       {
-        gchar *image = wp->image;
-        GdkPixbuf *regularthumb = a_thumbnails_get ( wp->image );
-        if ( ! regularthumb )
-        {
-          regularthumb = a_thumbnails_get_default (); /* cache one 'not yet loaded' for all thumbs not loaded */
-          image = "\x12\x00"; /* this shouldn't occur naturally. */
-        }
-        if ( regularthumb )
+        // Decoding images is far too slow to do here, so it is done in the background
+        a_thumbnails_request ( wp->image, G_OBJECT(dp->vtl), trw_layer_thumbnail_ready );
+
+        ci = g_hash_table_lookup ( dp->vtl->image_cache, IMAGE_CACHE_DEFAULT );
+        if ( !ci )
         {
-          if ( dp->vtl->image_size == 128 )
-            pixbuf = regularthumb;
-          else
+          GdkPixbuf *regularthumb = a_thumbnails_get_default (); /* cache one 'not yet loaded' for all thumbs not loaded */
+          if ( regularthumb )
           {
-            pixbuf = a_thumbnails_scale_pixbuf(regularthumb, dp->vtl->image_size, dp->vtl->image_size);
+            ci = trw_layer_image_cache_add ( dp->vtl, IMAGE_CACHE_DEFAULT, regularthumb );
             g_object_unref ( G_OBJECT(regularthumb) );
           }
-
-          // Apply alpha setting to the image before the pixbuf gets stored in the cache
-          if ( dp->vtl->image_alpha != 255 )
-            pixbuf = ui_pixbuf_set_alpha ( pixbuf, dp->vtl->image_alpha );
-
-          /* needed so 'click picture' tool knows how big the pic is; we don't
-           * store it in the cache because they may have been freed already. */
-          wp->image_width = gdk_pixbuf_get_width ( pixbuf );
-          wp->image_height = gdk_pixbuf_get_height ( pixbuf );
-
-          if ( g_hash_table_size(dp->vtl->image_cache) < dp->vtl->image_cache_size )
-            g_hash_table_insert ( dp->vtl->image_cache, image, pixbuf );
-        }
-        else
-        {
-          pixbuf = a_thumbnails_get_default (); /* thumbnail not yet loaded */
         }
       }
-      if ( pixbuf )
+
+      if ( ci )
       {
+        GdkPixbuf *pixbuf = ci->pixbuf;
+        ci->drawn = dp->vtl->wp_draw_pass;
         gint w, h;
         w = gdk_pixbuf_get_width ( pixbuf );
         h = gdk_pixbuf_get_height ( pixbuf );
 
+        /* needed so 'click picture' tool knows how big the pic is; we don't
+         * store it in the cache because they may have been freed already. */
+        wp->image_width = w;
+        wp->image_height = h;
+
         if ( x+(w/2) > 0 && y+(h/2) > 0 && x-(w/2) < dp->width && y-(h/2) < dp->height ) /* always draw within boundaries */
         {
           if ( dp->highlight ) {
@@ -2924,69 +3259,92 @@ static void trw_layer_draw_waypoint ( const gpointer id, VikWaypoint *wp, struct
     if ( dp->vtl->drawlabels && !wp->hide_name )
     {
       /* thanks to the GPSDrive people (Fritz Ganter et al.) for hints on this part ... yah, I'm too lazy to study documentation */
-      gint label_x, label_y;
-      gint width, height;
-      // Hopefully name won't break the markup (may need to sanitize - g_markup_escape_text())
-
-      // Could this stored in the waypoint rather than recreating each pass?
-      gchar *wp_label_markup = g_strdup_printf ( "<span size=\"%s\">%s</span>", dp->vtl->wp_fsize_str, wp->name );
-
-      if ( pango_parse_markup ( wp_label_markup, -1, 0, NULL, NULL, NULL, NULL ) )
-        pango_layout_set_markup ( dp->vtl->wplabellayout, wp_label_markup, -1 );
-      else
-        // Fallback if parse failure
-        pango_layout_set_text ( dp->vtl->wplabellayout, wp->name, -1 );
-
-      g_free ( wp_label_markup );
-
-      pango_layout_get_pixel_size ( dp->vtl->wplabellayout, &width, &height );
-      label_x = x - width/2;
+      label_place_t place;
+      place.wp = wp;
+      place.x = x;
       if ( wp->symbol_pixbuf )
-        label_y = y - height - 2 - gdk_pixbuf_get_height(wp->symbol_pixbuf)/2;
+        place.y = y - 2 - gdk_pixbuf_get_height(wp->symbol_pixbuf)/2;
       else
-        label_y = y - dp->vtl->wp_size - height - 2;
-
-      // Cater for 'longer' waypoint names, to ensure background is always shown correctly
-      //  as otherwise vik_viewport_draw_rectangle() will not draw it if too big -ve offset
-      //  hence perform adjustment here, including reducing the width as necessary
-      gint lx_bkgr = (label_x > 0) ? label_x - 1 : 0;
-      gint width_bkgr = (label_x > 0) ? width + 2 : width + 1 - abs(label_x);
-
-      // Ensure background drawing is congruent with text layout limits
-      if (label_x > -VIK_VIEWPORT_LAYOUT_MAX ) {
-        // if highlight mode on, then draw background text in highlight colour
-        if ( dp->highlight ) {
-          GdkColor hcolor = vik_viewport_get_highlight_gdkcolor(dp->vp);
-#if GTK_CHECK_VERSION (3,0,0)
-          if ( dp->vtl->wpbgand ) {
-            GdkRGBA bg = { hcolor.red / 65535.0, hcolor.blue / 65535.0, hcolor.green / 65535.0, 0.5 };
-            gdk_cairo_set_source_rgba ( dp->vtl->waypoint_bg_gc, &bg );
-            vik_viewport_draw_rectangle ( dp->vp, vik_viewport_get_gc_highlight (dp->vp), TRUE, lx_bkgr, label_y-1, width_bkgr, height+2, NULL );
-          }
-          else
-#endif
-          vik_viewport_draw_rectangle ( dp->vp, vik_viewport_get_gc_highlight (dp->vp), TRUE, lx_bkgr, label_y-1, width_bkgr, height+2, &hcolor );
-        }
-        else {
-#if GTK_CHECK_VERSION (3,0,0)
-          if ( dp->vtl->wpbgand ) {
-            GdkRGBA bg = { dp->vtl->waypoint_bg_color.red / 65535.0,
-                           dp->vtl->waypoint_bg_color.blue / 65535.0,
-                           dp->vtl->waypoint_bg_color.green / 65535.0,
-                           0.5 };
-            gdk_cairo_set_source_rgba ( dp->vtl->waypoint_bg_gc, &bg );
-            vik_viewport_draw_rectangle ( dp->vp, dp->vtl->waypoint_bg_gc, TRUE, lx_bkgr, label_y-1, width_bkgr, height+2, NULL );
-          }
-          else
-#endif
-          vik_viewport_draw_rectangle ( dp->vp, dp->vtl->waypoint_bg_gc, TRUE, lx_bkgr, label_y-1, width_bkgr, height+2, &dp->vtl->waypoint_bg_color );
+        place.y = y - dp->vtl->wp_size - 2;
+
+      if ( dp->labels ) {
+        // Prefer the selected waypoint's label over all others
+        g_array_append_val ( dp->labels, place );
+        if ( wp == dp->vtl->current_wp && dp->labels->len > 1 ) {
+          g_array_index ( dp->labels, label_place_t, dp->labels->len-1 ) = g_array_index ( dp->labels, label_place_t, 0 );
+          g_array_index ( dp->labels, label_place_t, 0 ) = place;
         }
       }
-      vik_viewport_draw_layout ( dp->vp, dp->vtl->waypoint_text_gc, label_x, label_y, dp->vtl->wplabellayout, &dp->vtl->waypoint_text_color );
+      else {
+        wp_label_t *label = trw_layer_get_waypoint_label ( dp->vtl, wp );
+        if ( label )
+          trw_layer_draw_waypoint_label ( dp, label, place.x - label->width/2, place.y - label->height );
+      }
     }
   }
 }
 
+/**
+ * Draw the collected waypoint labels, greedily skipping any that would overlap one already drawn
+ * Labels are only made (i.e. laid out by Pango) for waypoints that are actually on screen
+ */
+static void trw_layer_place_waypoint_labels ( struct DrawingParams *dp )
+{
+  if ( !dp->labels->len )
+    return;
+
+  // Each placed label is recorded in the grid cells it covers, so only nearby labels need to be compared
+  const gint cell = 64;
+  gint cols = dp->width / cell + 1;
+  gint rows = dp->height / cell + 1;
+  GSList **grid = g_new0 ( GSList*, cols * rows );
+  GdkRectangle *rects = g_new ( GdkRectangle, dp->labels->len );
+  guint placed = 0;
+
+  for ( guint ii = 0; ii < dp->labels->len; ii++ ) {
+    label_place_t *place = &g_array_index ( dp->labels, label_place_t, ii );
+    // Quick check for labels that can't be on screen, before doing any work on them
+    if ( place->y < 0 || place->y > dp->height + VIK_VIEWPORT_LAYOUT_MAX || place->x < -dp->width || place->x > 2*dp->width )
+      continue;
+
+    wp_label_t *label = trw_layer_get_waypoint_label ( dp->vtl, place->wp );
+    if ( !label )
+      continue;
+
+    // Include the background border
+    GdkRectangle rect = { place->x - label->width/2 - 1, place->y - label->height - 1, label->width + 2, label->height + 2 };
+    if ( rect.x + rect.width < 0 || rect.x >= dp->width || rect.y + rect.height < 0 || rect.y >= dp->height )
+      continue;
+
+    gint c1 = CLAMP ( rect.x / cell, 0, cols-1 );
+    gint c2 = CLAMP ( (rect.x + rect.width) / cell, 0, cols-1 );
+    gint r1 = CLAMP ( rect.y / cell, 0, rows-1 );
+    gint r2 = CLAMP ( (rect.y + rect.height) / cell, 0, rows-1 );
+
+    GdkRectangle common;
+    gboolean overlaps = FALSE;
+    for ( gint rr = r1; rr <= r2 && !overlaps; rr++ )
+      for ( gint cc = c1; cc <= c2 && !overlaps; cc++ )
+        for ( GSList *sl = grid[rr*cols+cc]; sl && !overlaps; sl = sl->next )
+          overlaps = gdk_rectangle_intersect ( &rect, sl->data, &common );
+    if ( overlaps )
+      continue;
+
+    rects[placed] = rect;
+    for ( gint rr = r1; rr <= r2; rr++ )
+      for ( gint cc = c1; cc <= c2; cc++ )
+        grid[rr*cols+cc] = g_slist_prepend ( grid[rr*cols+cc], &rects[placed] );
+    placed++;
+
+    trw_layer_draw_waypoint_label ( dp, label, rect.x + 1, rect.y + 1 );
+  }
+
+  for ( gint nn = 0; nn < cols * rows; nn++ )
+    g_slist_free ( grid[nn] );
+  g_free ( grid );
+  g_free ( rects );
+}
+
 static void trw_layer_draw_waypoint_cb ( gpointer id, VikWaypoint *wp, struct DrawingParams *dp )
 {
   if ( BBOX_INTERSECT ( dp->vtl->waypoints_bbox, dp->bbox ) ) {
@@ -2994,6 +3352,18 @@ static void trw_layer_draw_waypoint_cb ( gpointer id, VikWaypoint *wp, struct Dr
   }
 }
 
+/**
+ * Draw the waypoints, with their labels afterwards so overlapping ones can be left out
+ */
+static void trw_layer_draw_waypoints ( GHashTable *wpts, struct DrawingParams *dp )
+{
+  dp->labels = g_array_new ( FALSE, FALSE, sizeof(label_place_t) );
+  g_hash_table_foreach ( wpts, (GHFunc) trw_layer_draw_waypoint_cb, dp );
+  trw_layer_place_waypoint_labels ( dp );
+  g_array_free ( dp->labels, TRUE );
+  dp->labels = NULL;
+}
+
 static void trw_layer_draw_with_highlight ( VikTrwLayer *l, VikViewport *vvp, gboolean highlight )
 {
   static struct DrawingParams dp;
@@ -3007,8 +3377,21 @@ static void trw_layer_draw_with_highlight ( VikTrwLayer *l, VikViewport *vvp, gb
   if ( l->routes_visible )
     g_hash_table_foreach ( l->routes, (GHFunc) trw_layer_draw_track_cb, &dp );
 
-  if (l->waypoints_visible)
-    g_hash_table_foreach ( l->waypoints, (GHFunc) trw_layer_draw_waypoint_cb, &dp );
+  if (l->waypoints_visible) {
+    l->wp_draw_pass++;
+    trw_layer_draw_waypoints ( l->waypoints, &dp );
+    trw_layer_image_cache_trim ( l );
+
+    // Forget labels of waypoints that have gone (or at least weren't visible just now)
+    if ( g_hash_table_size(l->wp_labels) > g_hash_table_size(l->waypoints) ) {
+      GHashTableIter iter;
+      wp_label_t *label;
+      g_hash_table_iter_init ( &iter, l->wp_labels );
+      while ( g_hash_table_iter_next ( &iter, NULL, (gpointer*)&label ) )
+        if ( label->drawn != l->wp_draw_pass )
+          g_hash_table_iter_remove ( &iter );
+    }
+  }
 }
 
 static void trw_layer_draw ( VikTrwLayer *l, VikViewport *vvp )
@@ -3132,7 +3515,40 @@ void vik_trw_layer_draw_highlight_items ( VikTrwLayer *vtl, GHashTable *trks, GH
   }
 
   if ( vtl->waypoints_visible && wpts )
-    g_hash_table_foreach ( wpts, (GHFunc) trw_layer_draw_waypoint_cb, &dp );
+    trw_layer_draw_waypoints ( wpts, &dp );
+}
+
+
+/**
+ * vik_trw_layer_draw_track_tail:
+ * @tpl: The trackpoint (list entry) to draw the track from
+ *
+ * Draw the lines of a track from the given trackpoint onwards,
+ *  e.g. to extend the drawing of a track being recorded without having to redraw everything.
+ * Only the basic track colour is used (i.e. not the 'by speed' colours), nor are any points drawn,
+ *  so the next full draw may differ slightly.
+ */
+void vik_trw_layer_draw_track_tail ( VikTrwLayer *vtl, VikViewport *vvp, VikTrack *trk, GList *tpl )
+{
+  if ( !vtl->drawlines || !trk->visible || !tpl )
+    return;
+  if ( !(trk->is_route ? vtl->routes_visible : vtl->tracks_visible) )
+    return;
+
+  GdkColor color = (vtl->drawmode == DRAWMODE_BY_TRACK) ? trk->color : vtl->track_color;
+  GdkGC *gc = vik_viewport_new_gc_from_color ( vvp, &color, vtl->line_thickness );
+
+  gint x1, y1, x2, y2;
+  vik_viewport_coord_to_screen ( vvp, &(VIK_TRACKPOINT(tpl->data)->coord), &x1, &y1 );
+  for ( GList *iter = tpl->next; iter; iter = iter->next ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    vik_viewport_coord_to_screen ( vvp, &(tp->coord), &x2, &y2 );
+    if ( !tp->newsegment )
+      vik_viewport_draw_line ( vvp, gc, x1, y1, x2, y2, &color, vtl->line_thickness );
+    x1 = x2;
+    y1 = y2;
+  }
+  ui_gc_unref ( gc );
 }
 
 
@@ -5423,12 +5839,18 @@ static void trw_layer_add_menu_items ( VikTrwLayer *vtl, GtkMenu *menu, gpointer
   GtkWidget *itemdts = vu_menu_add_item ( delete_submenu, _("Delete Tracks _From Selection..."), GTK_STOCK_INDEX,
                                           G_CALLBACK(trw_layer_delete_tracks_from_selection), data );
   gtk_widget_set_sensitive ( itemdts, (gboolean)(g_hash_table_size (vtl->tracks)) );
+  GtkWidget *itemddt = vu_menu_add_item ( delete_submenu, _("Delete Duplicate Tracks"), GTK_STOCK_DELETE,
+                                          G_CALLBACK(trw_layer_delete_duplicate_tracks), data );
+  gtk_widget_set_sensitive ( itemddt, (gboolean)(g_hash_table_size (vtl->tracks)) );
   GtkWidget *itemdar = vu_menu_add_item ( delete_submenu, _("Delete _All Routes"), GTK_STOCK_REMOVE,
                                           G_CALLBACK(trw_layer_delete_all_routes), data );
   gtk_widget_set_sensitive ( itemdar, (gboolean)(g_hash_table_size (vtl->routes)) );
   GtkWidget *itemdrs = vu_menu_add_item ( delete_submenu, _("_Delete Routes From Selection..."), GTK_STOCK_INDEX,
                                           G_CALLBACK(trw_layer_delete_routes_from_selection), data );
   gtk_widget_set_sensitive ( itemdrs, (gboolean)(g_hash_table_size (vtl->routes)) );
+  GtkWidget *itemddr = vu_menu_add_item ( delete_submenu, _("Delete Duplicate Routes"), GTK_STOCK_DELETE,
+                                          G_CALLBACK(trw_layer_delete_duplicate_routes), data );
+  gtk_widget_set_sensitive ( itemddr, (gboolean)(g_hash_table_size (vtl->routes)) );
   GtkWidget *itemdaw = vu_menu_add_item ( delete_submenu, _("Delete All _Waypoints"), GTK_STOCK_REMOVE,
                                           G_CALLBACK(trw_layer_delete_all_waypoints), data );
   gtk_widget_set_sensitive ( itemdaw, (gboolean)(g_hash_table_size (vtl->waypoints)) );
@@ -5479,16 +5901,18 @@ static void trw_layer_add_menu_items ( VikTrwLayer *vtl, GtkMenu *menu, gpointer
 }
 
 // Fake Waypoint UUIDs vi simple increasing integer
-static guint wp_uuid = 0;
+//  (atomic, as layers may be filled concurrently from file import threads)
+static gint wp_uuid = 0;
 
 /**
- * vik_trw_layer_add_waypoint:
+ * trw_layer_add_waypoint_low_level:
  * @name: New name for the waypoint, maybe NULL.
  *        If NULL then the wp must already have a name
+ * @sort: Whether to sort the treeview now, otherwise the caller must sort it after adding
  */
-void vik_trw_layer_add_waypoint ( VikTrwLayer *vtl, gchar *name, VikWaypoint *wp )
+static void trw_layer_add_waypoint_low_level ( VikTrwLayer *vtl, gchar *name, VikWaypoint *wp, gboolean sort )
 {
-  wp_uuid++;
+  guint uuid = (guint)g_atomic_int_add ( &wp_uuid, 1 ) + 1;
 
   if ( name )
     vik_waypoint_set_name (wp, name);
@@ -5507,27 +5931,34 @@ void vik_trw_layer_add_waypoint ( VikTrwLayer *vtl, gchar *name, VikWaypoint *wp
       timestamp = wp->timestamp;
 
     // Visibility column always needed for waypoints
-    vik_treeview_add_sublayer ( VIK_LAYER(vtl)->vt, &(vtl->waypoints_iter), iter, wp->name, vtl, GUINT_TO_POINTER(wp_uuid), VIK_TRW_LAYER_SUBLAYER_WAYPOINT, get_wp_sym_small (wp->symbol), TRUE, timestamp, 0 );
+    vik_treeview_add_sublayer ( VIK_LAYER(vtl)->vt, &(vtl->waypoints_iter), iter, wp->name, vtl, GUINT_TO_POINTER(uuid), VIK_TRW_LAYER_SUBLAYER_WAYPOINT, get_wp_sym_small (wp->symbol), TRUE, timestamp, 0 );
 
     // Actual setting of visibility dependent on the waypoint
     vik_treeview_item_set_visible ( VIK_LAYER(vtl)->vt, iter, wp->visible );
 
-    g_hash_table_insert ( vtl->waypoints_iters, GUINT_TO_POINTER(wp_uuid), iter );
+    g_hash_table_insert ( vtl->waypoints_iters, GUINT_TO_POINTER(uuid), iter );
 
     // Sort now as post_read is not called on a realized waypoint
-    vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->waypoints_iter), vtl->wp_sort_order );
+    if ( sort )
+      vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->waypoints_iter), vtl->wp_sort_order );
   }
 
   highest_wp_number_add_wp(vtl, wp->name);
-  g_hash_table_insert ( vtl->waypoints, GUINT_TO_POINTER(wp_uuid), wp );
+  g_hash_table_insert ( vtl->waypoints, GUINT_TO_POINTER(uuid), wp );
+
+  if ( vtl->wp_index ) {
+    struct LatLon ll;
+    vik_coord_to_latlon ( &wp->coord, &ll );
+    vik_point_index_add ( vtl->wp_index, &ll, uuid, NULL );
+  }
 }
 
 // Fake Track UUIDs vi simple increasing integer
-static guint tr_uuid = 0;
+static gint tr_uuid = 0;
 
-void vik_trw_layer_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
+static void trw_layer_add_track_low_level ( VikTrwLayer *vtl, gchar *name, VikTrack *t, gboolean sort )
 {
-  tr_uuid++;
+  guint uuid = (guint)g_atomic_int_add ( &tr_uuid, 1 ) + 1;
 
   if ( name )
     vik_track_set_name ( t, name );
@@ -5547,28 +5978,31 @@ void vik_trw_layer_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
       timestamp = tpt->timestamp;
 
     // Visibility column always needed for tracks
-    vik_treeview_add_sublayer ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter), iter, t->name, vtl, GUINT_TO_POINTER(tr_uuid), VIK_TRW_LAYER_SUBLAYER_TRACK, NULL, TRUE, timestamp, t->number );
+    vik_treeview_add_sublayer ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter), iter, t->name, vtl, GUINT_TO_POINTER(uuid), VIK_TRW_LAYER_SUBLAYER_TRACK, NULL, TRUE, timestamp, t->number );
 
     // Actual setting of visibility dependent on the track
     vik_treeview_item_set_visible ( VIK_LAYER(vtl)->vt, iter, t->visible );
 
-    g_hash_table_insert ( vtl->tracks_iters, GUINT_TO_POINTER(tr_uuid), iter );
+    GdkPixbuf *pixbuf = ui_pixbuf_new ( &t->color, SMALL_ICON_SIZE, SMALL_ICON_SIZE );
+    vik_treeview_item_set_icon ( VIK_LAYER(vtl)->vt, iter, pixbuf );
+    g_object_unref ( pixbuf );
+
+    g_hash_table_insert ( vtl->tracks_iters, GUINT_TO_POINTER(uuid), iter );
 
     // Sort now as post_read is not called on a realized track
-    vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter), vtl->track_sort_order );
+    if ( sort )
+      vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter), vtl->track_sort_order );
   }
 
-  g_hash_table_insert ( vtl->tracks, GUINT_TO_POINTER(tr_uuid), t );
-
-  trw_layer_update_treeview ( vtl, t, FALSE );
+  g_hash_table_insert ( vtl->tracks, GUINT_TO_POINTER(uuid), t );
 }
 
 // Fake Route UUIDs vi simple increasing integer
-static guint rt_uuid = 0;
+static gint rt_uuid = 0;
 
-void vik_trw_layer_add_route ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
+static void trw_layer_add_route_low_level ( VikTrwLayer *vtl, gchar *name, VikTrack *t, gboolean sort )
 {
-  rt_uuid++;
+  guint uuid = (guint)g_atomic_int_add ( &rt_uuid, 1 ) + 1;
 
   if ( name )
     vik_track_set_name ( t, name );
@@ -5582,19 +6016,63 @@ void vik_trw_layer_add_route ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
 
     GtkTreeIter *iter = g_malloc(sizeof(GtkTreeIter));
     // Visibility column always needed for routes
-    vik_treeview_add_sublayer ( VIK_LAYER(vtl)->vt, &(vtl->routes_iter), iter, t->name, vtl, GUINT_TO_POINTER(rt_uuid), VIK_TRW_LAYER_SUBLAYER_ROUTE, NULL, TRUE, 0, t->number ); // Routes don't have times
+    vik_treeview_add_sublayer ( VIK_LAYER(vtl)->vt, &(vtl->routes_iter), iter, t->name, vtl, GUINT_TO_POINTER(uuid), VIK_TRW_LAYER_SUBLAYER_ROUTE, NULL, TRUE, 0, t->number ); // Routes don't have times
     // Actual setting of visibility dependent on the route
     vik_treeview_item_set_visible ( VIK_LAYER(vtl)->vt, iter, t->visible );
 
-    g_hash_table_insert ( vtl->routes_iters, GUINT_TO_POINTER(rt_uuid), iter );
+    GdkPixbuf *pixbuf = ui_pixbuf_new ( &t->color, SMALL_ICON_SIZE, SMALL_ICON_SIZE );
+    vik_treeview_item_set_icon ( VIK_LAYER(vtl)->vt, iter, pixbuf );
+    g_object_unref ( pixbuf );
+
+    g_hash_table_insert ( vtl->routes_iters, GUINT_TO_POINTER(uuid), iter );
 
     // Sort now as post_read is not called on a realized route
-    vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->routes_iter), vtl->track_sort_order );
+    if ( sort )
+      vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->routes_iter), vtl->track_sort_order );
   }
 
-  g_hash_table_insert ( vtl->routes, GUINT_TO_POINTER(rt_uuid), t );
+  g_hash_table_insert ( vtl->routes, GUINT_TO_POINTER(uuid), t );
+}
 
-  trw_layer_update_treeview ( vtl, t, FALSE );
+void vik_trw_layer_add_waypoint ( VikTrwLayer *vtl, gchar *name, VikWaypoint *wp )
+{
+  trw_layer_add_waypoint_low_level ( vtl, name, wp, TRUE );
+}
+
+void vik_trw_layer_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
+{
+  trw_layer_add_track_low_level ( vtl, name, t, TRUE );
+}
+
+void vik_trw_layer_add_route ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
+{
+  trw_layer_add_route_low_level ( vtl, name, t, TRUE );
+}
+
+/**
+ * vik_trw_layer_add_items:
+ *
+ * Add many waypoints, tracks and routes in one go (e.g. as a file is read),
+ *  only sorting the treeview once for each type rather than after every item.
+ * The items are owned by the layer afterwards, but not the lists.
+ */
+void vik_trw_layer_add_items ( VikTrwLayer *vtl, GList *waypoints, GList *tracks, GList *routes )
+{
+  for ( GList *iter = waypoints; iter; iter = iter->next )
+    trw_layer_add_waypoint_low_level ( vtl, NULL, VIK_WAYPOINT(iter->data), FALSE );
+  for ( GList *iter = tracks; iter; iter = iter->next )
+    trw_layer_add_track_low_level ( vtl, NULL, VIK_TRACK(iter->data), FALSE );
+  for ( GList *iter = routes; iter; iter = iter->next )
+    trw_layer_add_route_low_level ( vtl, NULL, VIK_TRACK(iter->data), FALSE );
+
+  if ( VIK_LAYER(vtl)->realized ) {
+    if ( waypoints )
+      vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->waypoints_iter), vtl->wp_sort_order );
+    if ( tracks )
+      vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter), vtl->track_sort_order );
+    if ( routes )
+      vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->routes_iter), vtl->track_sort_order );
+  }
 }
 
 /* to be called whenever a track has been deleted or may have been changed. */
@@ -5714,6 +6192,67 @@ void vik_trw_layer_filein_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t
   }
 }
 
+/**
+ * vik_trw_layer_steal_items:
+ * @vtl: An unrealized layer
+ *
+ * Take all the waypoints, tracks and routes out of the layer (without copying them),
+ *  prepending them to the given lists. The layer is left empty.
+ */
+void vik_trw_layer_steal_items ( VikTrwLayer *vtl, GList **waypoints, GList **tracks, GList **routes )
+{
+  g_return_if_fail ( !VIK_LAYER(vtl)->realized );
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_hash_table_iter_init ( &iter, vtl->waypoints );
+  while ( g_hash_table_iter_next (&iter, &key, &value) ) {
+    *waypoints = g_list_prepend ( *waypoints, value );
+    g_hash_table_iter_steal ( &iter );
+  }
+  g_hash_table_iter_init ( &iter, vtl->tracks );
+  while ( g_hash_table_iter_next (&iter, &key, &value) ) {
+    *tracks = g_list_prepend ( *tracks, value );
+    g_hash_table_iter_steal ( &iter );
+  }
+  g_hash_table_iter_init ( &iter, vtl->routes );
+  while ( g_hash_table_iter_next (&iter, &key, &value) ) {
+    *routes = g_list_prepend ( *routes, value );
+    g_hash_table_iter_steal ( &iter );
+  }
+
+  vtl->highest_wp_number = 0;
+  vik_point_index_free ( vtl->wp_index );
+  vtl->wp_index = NULL;
+}
+
+/**
+ * vik_trw_layer_take_file_info:
+ *
+ * Move the file level information (name, metadata, GPX properties and laps) from @src into @vtl
+ */
+void vik_trw_layer_take_file_info ( VikTrwLayer *vtl, VikTrwLayer *src )
+{
+  if ( src->metadata ) {
+    vik_trw_layer_set_metadata ( vtl, src->metadata );
+    src->metadata = NULL;
+  }
+  vtl->gpx_version = src->gpx_version;
+  if ( src->gpx_header )
+    vik_trw_layer_set_gpx_header ( vtl, src->gpx_header );
+  if ( src->gpx_extensions )
+    vik_trw_layer_set_gpx_extensions ( vtl, src->gpx_extensions );
+  if ( src->laps ) {
+    vik_trw_layer_set_laps ( vtl, src->laps );
+    src->laps = NULL;
+  }
+  if ( g_strcmp0(VIK_LAYER(vtl)->name, VIK_LAYER(src)->name) ) {
+    vik_layer_rename ( VIK_LAYER(vtl), VIK_LAYER(src)->name );
+    if ( VIK_LAYER(vtl)->realized )
+      vik_treeview_item_set_name ( VIK_LAYER(vtl)->vt, &(VIK_LAYER(vtl)->iter), VIK_LAYER(vtl)->name );
+  }
+}
+
 /**
  * ATM Only for removing bad first points
  */
@@ -5839,22 +6378,48 @@ gboolean trw_layer_track_find_uuid ( const gpointer id, const VikTrack *trk, gpo
   return FALSE;
 }
 
+/**
+ * Remove the track or route identified by uuid (without searching for it)
+ */
+static void delete_track_low_level ( VikTrwLayer *vtl, VikTrack *trk, gpointer uuid )
+{
+  GHashTable *ht = trk->is_route ? vtl->routes : vtl->tracks;
+  GHashTable *ht_iters = trk->is_route ? vtl->routes_iters : vtl->tracks_iters;
+  GtkTreeIter *parent = trk->is_route ? &(vtl->routes_iter) : &(vtl->tracks_iter);
+
+  if ( trk == vtl->current_track ) {
+    vtl->current_track = NULL;
+    vtl->current_tp_track = NULL;
+    vtl->moving_tp = FALSE;
+  }
+
+  if ( trk == vtl->route_finder_added_track )
+    vtl->route_finder_added_track = NULL;
+
+  /* could be current_tp, so we have to check */
+  trw_layer_cancel_tps_of_track ( vtl, trk );
+
+  GtkTreeIter *it = g_hash_table_lookup ( ht_iters, uuid );
+
+  if ( it ) {
+    vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, it );
+    g_hash_table_remove ( ht_iters, uuid );
+    g_hash_table_remove ( ht, uuid ); // NB this may free the track
+
+    // If last sublayer, then remove sublayer container
+    if ( g_hash_table_size (ht) == 0 ) {
+      vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, parent );
+    }
+  }
+}
+
 gboolean vik_trw_layer_delete_track ( VikTrwLayer *vtl, VikTrack *trk )
 {
   gboolean was_visible = FALSE;
   if ( trk && trk->name ) {
 
-    if ( trk == vtl->current_track ) {
-      vtl->current_track = NULL;
-      vtl->current_tp_track = NULL;
-      vtl->moving_tp = FALSE;
-    }
-
     was_visible = trk->visible;
 
-    if ( trk == vtl->route_finder_added_track )
-      vtl->route_finder_added_track = NULL;
-
     trku_udata udata;
     udata.trk  = trk;
     udata.uuid = NULL;
@@ -5863,21 +6428,7 @@ gboolean vik_trw_layer_delete_track ( VikTrwLayer *vtl, VikTrack *trk )
     gpointer trkf = g_hash_table_find ( vtl->tracks, (GHRFunc) trw_layer_track_find_uuid, &udata );
 
     if ( trkf && udata.uuid ) {
-      /* could be current_tp, so we have to check */
-      trw_layer_cancel_tps_of_track ( vtl, trk );
-
-      GtkTreeIter *it = g_hash_table_lookup ( vtl->tracks_iters, udata.uuid );
-
-      if ( it ) {
-        vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, it );
-        g_hash_table_remove ( vtl->tracks_iters, udata.uuid );
-        g_hash_table_remove ( vtl->tracks, udata.uuid );
-
-	// If last sublayer, then remove sublayer container
-	if ( g_hash_table_size (vtl->tracks) == 0 ) {
-          vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter) );
-	}
-      }
+      delete_track_low_level ( vtl, trk, udata.uuid );
       // Incase it was selected (no item delete signal ATM)
       (void)vik_window_clear_selected ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vtl)) );
     }
@@ -5891,17 +6442,8 @@ gboolean vik_trw_layer_delete_route ( VikTrwLayer *vtl, VikTrack *trk )
 
   if ( trk && trk->name ) {
 
-    if ( trk == vtl->current_track ) {
-      vtl->current_track = NULL;
-      vtl->current_tp_track = NULL;
-      vtl->moving_tp = FALSE;
-    }
-
     was_visible = trk->visible;
 
-    if ( trk == vtl->route_finder_added_track )
-      vtl->route_finder_added_track = NULL;
-
     trku_udata udata;
     udata.trk  = trk;
     udata.uuid = NULL;
@@ -5910,21 +6452,7 @@ gboolean vik_trw_layer_delete_route ( VikTrwLayer *vtl, VikTrack *trk )
     gpointer trkf = g_hash_table_find ( vtl->routes, (GHRFunc) trw_layer_track_find_uuid, &udata );
 
     if ( trkf && udata.uuid ) {
-      /* could be current_tp, so we have to check */
-      trw_layer_cancel_tps_of_track ( vtl, trk );
-
-      GtkTreeIter *it = g_hash_table_lookup ( vtl->routes_iters, udata.uuid );
-
-      if ( it ) {
-        vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, it );
-        g_hash_table_remove ( vtl->routes_iters, udata.uuid );
-        g_hash_table_remove ( vtl->routes, udata.uuid );
-
-        // If last sublayer, then remove sublayer container
-        if ( g_hash_table_size (vtl->routes) == 0 ) {
-          vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, &(vtl->routes_iter) );
-        }
-      }
+      delete_track_low_level ( vtl, trk, udata.uuid );
       // Incase it was selected (no item delete signal ATM)
       (void)vik_window_clear_selected ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vtl)) );
     }
@@ -6886,6 +7414,8 @@ static void trw_layer_rotate ( menu_array_sublayer values )
     tp = VIK_TRACKPOINT(seg->data);
     tp->newsegment = TRUE;
 
+    vik_track_calculate_bounds ( track );
+
     vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
   }
 }
@@ -6996,21 +7526,178 @@ static void trw_layer_apply_dem_data_all ( menu_array_sublayer values )
   else
     track = (VikTrack *) g_hash_table_lookup ( vtl->tracks, values[MA_SUBLAYER_ID] );
 
-  if ( track )
-    apply_dem_data_common ( vtl, values[MA_VLP], track, FALSE );
+  if ( track )
+    apply_dem_data_common ( vtl, values[MA_VLP], track, FALSE );
+}
+
+static void trw_layer_apply_dem_data_only_missing ( menu_array_sublayer values )
+{
+  VikTrwLayer *vtl = (VikTrwLayer *)values[MA_VTL];
+  VikTrack *track;
+  if ( GPOINTER_TO_INT (values[MA_SUBTYPE]) == VIK_TRW_LAYER_SUBLAYER_ROUTE )
+    track = (VikTrack *) g_hash_table_lookup ( vtl->routes, values[MA_SUBLAYER_ID] );
+  else
+    track = (VikTrack *) g_hash_table_lookup ( vtl->tracks, values[MA_SUBLAYER_ID] );
+
+  if ( track )
+    apply_dem_data_common ( vtl, values[MA_VLP], track, TRUE );
+}
+
+/*
+ * Applying DEM data to many tracks at once:
+ *  the positions of all the tracks are collected in the main thread,
+ *  the elevations are then worked out in a background thread (itself using all the CPUs)
+ *  and finally set back in the main thread.
+ */
+typedef struct {
+  VikTrwLayer *vtl;     // Reference held
+  GPtrArray *tracks;    // References held
+  GArray *generations;  // guint per track - to detect tracks changed in the meantime
+  GArray *starts;       // guint per track into the positions, plus the end
+  GArray *coords;       // VikCoord of all the positions
+  GArray *indices;      // guint trackpoint index per position
+  gint16 *elevs;
+  gulong found;
+  gboolean completed;
+} ApplyDEMT;
+
+static ApplyDEMT *apply_dem_new ( VikTrwLayer *vtl, GHashTable *tracks, gboolean skip_existing )
+{
+  ApplyDEMT *ad = g_new0 ( ApplyDEMT, 1 );
+  ad->vtl = vtl;
+  ad->tracks = g_ptr_array_new ();
+  ad->generations = g_array_new ( FALSE, FALSE, sizeof(guint) );
+  ad->starts = g_array_new ( FALSE, FALSE, sizeof(guint) );
+  ad->coords = g_array_new ( FALSE, FALSE, sizeof(VikCoord) );
+  ad->indices = g_array_new ( FALSE, FALSE, sizeof(guint) );
+
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, tracks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    VikTrack *trk = VIK_TRACK(value);
+    guint start = ad->coords->len;
+    if ( vik_track_get_dem_positions ( trk, skip_existing, ad->coords, ad->indices ) ) {
+      guint generation = vik_track_get_generation ( trk );
+      vik_track_ref ( trk );
+      g_ptr_array_add ( ad->tracks, trk );
+      g_array_append_val ( ad->generations, generation );
+      g_array_append_val ( ad->starts, start );
+    }
+  }
+  guint end = ad->coords->len;
+  g_array_append_val ( ad->starts, end );
+  ad->elevs = g_new ( gint16, ad->coords->len );
+  return ad;
+}
+
+/**
+ * Set the elevations found, other than for tracks that have since changed
+ *
+ * Returns: The number of trackpoints changed
+ */
+static gulong apply_dem_set ( ApplyDEMT *ad )
+{
+  gulong changed = 0;
+  if ( !ad->found )
+    return changed;
+  for ( guint ii = 0; ii < ad->tracks->len; ii++ ) {
+    VikTrack *trk = g_ptr_array_index ( ad->tracks, ii );
+    if ( vik_track_get_generation(trk) != g_array_index(ad->generations, guint, ii) )
+      continue;
+    guint start = g_array_index ( ad->starts, guint, ii );
+    guint count = g_array_index ( ad->starts, guint, ii+1 ) - start;
+    changed += vik_track_set_dem_elevations ( trk,
+                                              &g_array_index(ad->indices, guint, start),
+                                              &ad->elevs[start],
+                                              count );
+  }
+  return changed;
+}
+
+static void apply_dem_free ( ApplyDEMT *ad )
+{
+  for ( guint ii = 0; ii < ad->tracks->len; ii++ )
+    vik_track_free ( g_ptr_array_index(ad->tracks, ii) );
+  g_ptr_array_free ( ad->tracks, TRUE );
+  g_array_free ( ad->generations, TRUE );
+  g_array_free ( ad->starts, TRUE );
+  g_array_free ( ad->coords, TRUE );
+  g_array_free ( ad->indices, TRUE );
+  g_free ( ad->elevs );
+  g_free ( ad );
+}
+
+static gint apply_dem_thread ( ApplyDEMT *ad, gpointer threaddata )
+{
+  if ( a_dems_get_elevs_by_coords_progress ( (VikCoord*)ad->coords->data, ad->coords->len, VIK_DEM_INTERPOL_BEST,
+                                             ad->elevs, threaddata, &ad->found ) )
+    return -1;
+  ad->completed = TRUE;
+  return 0;
+}
+
+// Back in the main thread
+static gboolean apply_dem_done_idle ( ApplyDEMT *ad )
+{
+  VikTrwLayer *vtl = ad->vtl;
+  if ( ad->completed ) {
+    gulong changed = apply_dem_set ( ad );
+    if ( VIK_LAYER(vtl)->realized ) {
+      gchar str[64];
+      const gchar *tmp_str = ngettext("%ld point adjusted", "%ld points adjusted", changed);
+      g_snprintf ( str, 64, tmp_str, changed );
+      vik_window_statusbar_update ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vtl)), str, VIK_STATUSBAR_INFO );
+      if ( changed )
+        vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
+    }
+  }
+  apply_dem_free ( ad );
+  g_object_unref ( vtl );
+  return FALSE;
+}
+
+static void apply_dem_thread_free ( ApplyDEMT *ad )
+{
+  // Tracks are updated and released in the main thread, even when cancelled
+  g_idle_add ( (GSourceFunc)apply_dem_done_idle, ad );
+}
+
+/**
+ * Apply DEM data to all the tracks (or routes) of the layer in the background
+ */
+static void apply_dem_data_tracks_common ( menu_array_sublayer values, gboolean skip_existing_elevations )
+{
+  VikTrwLayer *vtl = (VikTrwLayer *)values[MA_VTL];
+  if ( !trw_layer_dem_test ( vtl, values[MA_VLP] ) )
+    return;
+
+  gboolean routes = GPOINTER_TO_INT(values[MA_SUBTYPE]) == VIK_TRW_LAYER_SUBLAYER_ROUTES;
+  ApplyDEMT *ad = apply_dem_new ( vtl, routes ? vtl->routes : vtl->tracks, skip_existing_elevations );
+  if ( ad->coords->len == 0 ) {
+    apply_dem_free ( ad );
+    return;
+  }
+  g_object_ref ( vtl );
+
+  a_background_thread ( BACKGROUND_POOL_LOCAL,
+                        VIK_GTK_WINDOW_FROM_LAYER(vtl),
+                        routes ? _("Applying DEM data to routes") : _("Applying DEM data to tracks"),
+                        (vik_thr_func)apply_dem_thread,
+                        ad,
+                        (vik_thr_free_func)apply_dem_thread_free,
+                        NULL,
+                        ad->tracks->len );
 }
 
-static void trw_layer_apply_dem_data_only_missing ( menu_array_sublayer values )
+static void trw_layer_apply_dem_data_tracks_all ( menu_array_sublayer values )
 {
-  VikTrwLayer *vtl = (VikTrwLayer *)values[MA_VTL];
-  VikTrack *track;
-  if ( GPOINTER_TO_INT (values[MA_SUBTYPE]) == VIK_TRW_LAYER_SUBLAYER_ROUTE )
-    track = (VikTrack *) g_hash_table_lookup ( vtl->routes, values[MA_SUBLAYER_ID] );
-  else
-    track = (VikTrack *) g_hash_table_lookup ( vtl->tracks, values[MA_SUBLAYER_ID] );
+  apply_dem_data_tracks_common ( values, FALSE );
+}
 
-  if ( track )
-    apply_dem_data_common ( vtl, values[MA_VLP], track, TRUE );
+static void trw_layer_apply_dem_data_tracks_only_missing ( menu_array_sublayer values )
+{
+  apply_dem_data_tracks_common ( values, TRUE );
 }
 
 /**
@@ -7613,6 +8300,7 @@ static void trw_layer_merge_with_other ( menu_array_sublayer values )
         else
           vik_trw_layer_delete_track (vtl, merge_track);
         track->trackpoints = g_list_sort(track->trackpoints, trackpoint_compare);
+        vik_track_calculate_bounds ( track );
       }
     }
     for (l = merge_list; l != NULL; l = g_list_next(l))
@@ -7908,6 +8596,7 @@ static void trw_layer_merge_by_timestamp ( menu_array_sublayer values )
     }
 
     orig_trk->trackpoints = g_list_sort(orig_trk->trackpoints, trackpoint_compare);
+    vik_track_calculate_bounds ( orig_trk );
   }
 
   g_list_free(nearby_tracks);
@@ -7928,6 +8617,7 @@ static void trw_layer_split_create_segments ( menu_array_sublayer values )
   if ( vtl->current_tpl && vtl->current_tp_track && !vtl->current_tp_track->is_route ) {
     if ( vtl->current_tpl->next && vtl->current_tpl->prev ) {
         VIK_TRACKPOINT(vtl->current_tpl->data)->newsegment = TRUE;
+        vik_track_invalidate_stats ( vtl->current_tp_track );
         vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
     }
   }
@@ -8222,6 +8912,7 @@ static void trw_layer_trackpoint_selected_delete ( VikTrwLayer *vtl, VikTrack *t
     // Delete current trackpoint
     vik_trackpoint_free ( vtl->current_tpl->data );
     trk->trackpoints = g_list_delete_link ( trk->trackpoints, vtl->current_tpl );
+    vik_track_calculate_bounds ( trk );
     trw_layer_cancel_current_tp ( vtl, FALSE );
   }
 }
@@ -9109,47 +9800,50 @@ static void trw_layer_delete_waypoints_from_selection ( menu_array_layer values
 
 }
 
+static gboolean waypoint_same_symbol ( gpointer data, gpointer user_data )
+{
+  return !g_strcmp0 ( VIK_WAYPOINT(data)->symbol, VIK_WAYPOINT(user_data)->symbol );
+}
+
 /**
- * Only deletes first copy of each duplicated waypoint
- * Thus call repeatedly to remove all duplicates
+ * Keeps the first of each set of duplicated waypoints (in hash table order)
+ * Uses a spatial hash so all duplicates are found in a single pass,
+ *  and then deletes them all in one go.
  */
 static guint trw_layer_delete_duplicate_waypoints_main ( VikTrwLayer *vtl )
 {
   GHashTableIter iter;
   gpointer key, value;
-
+  GSList *delete_keys = NULL;
   guint delete_count = 0;
-  guint sz = g_hash_table_size ( vtl->waypoints );
 
-  for ( int ii = 0; ii < (sz - delete_count); ii++ ) {
-    g_hash_table_iter_init ( &iter, vtl->waypoints );
-    g_hash_table_iter_next ( &iter, &key, &value );
-    // Progress to the nth waypoint
-    for ( int jj = 0; jj < ii; jj++ ) {
-      g_hash_table_iter_next ( &iter, &key, &value );
-    }
-    VikWaypoint *wpt1 = VIK_WAYPOINT(value);
-    if ( wpt1 ) {
-      // Compare against rest of the list
-      gboolean done = FALSE;
-      while ( !done && g_hash_table_iter_next (&iter, &key, &value) ) {
-        VikWaypoint *wpt2 = VIK_WAYPOINT(value);
-        // Just how many other fields is it sensible to compare? altitude, comment, etc ???
-        if ( vik_coord_equalish(&(wpt1->coord), &(wpt2->coord)) &&
-             !g_strcmp0(wpt1->symbol, wpt2->symbol) ) {
-
-          GtkTreeIter *it = g_hash_table_lookup ( vtl->waypoints_iters, key );
-          if ( it ) {
-              delete_waypoint_low_level ( vtl, wpt2, key, it );
-              // Have to exit now as hash table changed
-              //  (as otherwise continuing iterating over it can go badly wrong)
-              done = TRUE;
-              delete_count++;
-	  }
-        }
+  CoordGrid *cg = coord_grid_new ();
+  g_hash_table_iter_init ( &iter, vtl->waypoints );
+  while ( g_hash_table_iter_next (&iter, &key, &value) ) {
+    VikWaypoint *wpt = VIK_WAYPOINT(value);
+    // Just how many other fields is it sensible to compare? altitude, comment, etc ???
+    if ( coord_grid_find_equalish ( cg, &wpt->coord, waypoint_same_symbol, wpt ) )
+      delete_keys = g_slist_prepend ( delete_keys, key );
+    else
+      coord_grid_add ( cg, &wpt->coord, wpt );
+  }
+  coord_grid_free ( cg );
+
+  for ( GSList *sl = delete_keys; sl; sl = sl->next ) {
+    VikWaypoint *wpt = g_hash_table_lookup ( vtl->waypoints, sl->data );
+    GtkTreeIter *it = g_hash_table_lookup ( vtl->waypoints_iters, sl->data );
+    if ( wpt && it ) {
+      if ( wpt == vtl->current_wp ) {
+        vtl->current_wp = NULL;
+        vtl->current_wp_id = NULL;
+        vtl->moving_wp = FALSE;
       }
+      delete_waypoint_low_level ( vtl, wpt, sl->data, it );
+      delete_count++;
     }
   }
+  g_slist_free ( delete_keys );
+
   return delete_count;
 }
 
@@ -9160,15 +9854,15 @@ static void trw_layer_delete_duplicate_waypoints ( menu_array_layer values )
 {
   VikTrwLayer *vtl = VIK_TRW_LAYER(values[MA_VTL]);
 
-  guint delete_count = 0;
-  guint cnt = 0;
-  // Continually call until nothing more deleted
-  do {
-    cnt = trw_layer_delete_duplicate_waypoints_main ( vtl );
-    delete_count += cnt;
-  } while ( cnt );
+  guint delete_count = trw_layer_delete_duplicate_waypoints_main ( vtl );
 
   if ( delete_count ) {
+    // Incase one was selected
+    (void)vik_window_clear_selected ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vtl)) );
+    trw_layer_calculate_bounds_waypoints ( vtl );
+    // Reset layer timestamp in case it has now changed
+    vik_treeview_item_set_timestamp ( vtl->vl.vt, &vtl->vl.iter, trw_layer_get_timestamp(vtl) );
+
     // Inform user how much was changed
     gchar str[64];
     const gchar *tmp_str = ngettext("%ld waypoint deleted", "%ld waypoints deleted", delete_count);
@@ -9181,6 +9875,94 @@ static void trw_layer_delete_duplicate_waypoints ( menu_array_layer values )
   }
 }
 
+/**
+ * Keeps the first of each set of duplicated tracks (or routes)
+ * Tracks are only compared against others with the same start time and number of trackpoints
+ */
+static guint trw_layer_delete_duplicate_tracks_main ( VikTrwLayer *vtl, GHashTable *ht )
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  GSList *delete_keys = NULL;
+  guint delete_count = 0;
+
+  // Lists of the tracks kept so far for each hash value
+  GHashTable *kept = g_hash_table_new ( g_direct_hash, g_direct_equal );
+  g_hash_table_iter_init ( &iter, ht );
+  while ( g_hash_table_iter_next (&iter, &key, &value) ) {
+    VikTrack *trk = VIK_TRACK(value);
+    gpointer hash = GUINT_TO_POINTER ( vik_track_get_duplicate_hash(trk) );
+    GSList *candidates = g_hash_table_lookup ( kept, hash );
+    gboolean duplicate = FALSE;
+    for ( GSList *sl = candidates; sl && !duplicate; sl = sl->next )
+      duplicate = vik_track_equalish ( VIK_TRACK(sl->data), trk );
+    if ( duplicate )
+      delete_keys = g_slist_prepend ( delete_keys, key );
+    else
+      g_hash_table_insert ( kept, hash, g_slist_prepend ( candidates, trk ) );
+  }
+  g_hash_table_iter_init ( &iter, kept );
+  while ( g_hash_table_iter_next (&iter, &key, &value) )
+    g_slist_free ( value );
+  g_hash_table_destroy ( kept );
+
+  for ( GSList *sl = delete_keys; sl; sl = sl->next ) {
+    VikTrack *trk = g_hash_table_lookup ( ht, sl->data );
+    if ( trk ) {
+      delete_track_low_level ( vtl, trk, sl->data );
+      delete_count++;
+    }
+  }
+  g_slist_free ( delete_keys );
+
+  return delete_count;
+}
+
+static void trw_layer_delete_duplicate_tracks_common ( menu_array_layer values, gboolean is_route )
+{
+  VikTrwLayer *vtl = VIK_TRW_LAYER(values[MA_VTL]);
+
+  guint delete_count = trw_layer_delete_duplicate_tracks_main ( vtl, is_route ? vtl->routes : vtl->tracks );
+
+  if ( delete_count ) {
+    // Incase one was selected
+    (void)vik_window_clear_selected ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vtl)) );
+    trw_layer_calculate_bounds_tracks ( vtl );
+    // Reset layer timestamp in case it has now changed
+    vik_treeview_item_set_timestamp ( vtl->vl.vt, &vtl->vl.iter, trw_layer_get_timestamp(vtl) );
+    if ( !is_route && values[MA_VLP] )
+      vik_layers_panel_calendar_update ( VIK_LAYERS_PANEL(values[MA_VLP]) );
+
+    // Inform user how much was changed
+    gchar str[64];
+    const gchar *tmp_str = is_route ?
+      ngettext("%d route deleted", "%d routes deleted", delete_count) :
+      ngettext("%d track deleted", "%d tracks deleted", delete_count);
+    g_snprintf(str, 64, tmp_str, delete_count);
+    a_dialog_info_msg ( VIK_GTK_WINDOW_FROM_LAYER(vtl), str );
+    vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
+  }
+  else {
+    a_dialog_info_msg ( VIK_GTK_WINDOW_FROM_LAYER(vtl), _("No duplicates found") );
+  }
+}
+
+/**
+ *
+ */
+static void trw_layer_delete_duplicate_tracks ( menu_array_layer values )
+{
+  trw_layer_delete_duplicate_tracks_common ( values, FALSE );
+}
+
+/**
+ *
+ */
+static void trw_layer_delete_duplicate_routes ( menu_array_layer values )
+{
+  trw_layer_delete_duplicate_tracks_common ( values, TRUE );
+}
+
 /**
  *
  */
@@ -9862,6 +10644,8 @@ static gboolean trw_layer_sublayer_add_menu_items ( VikTrwLayer *l, GtkMenu *men
       (void)vu_menu_add_item ( menu, _("Delete _All Tracks"), GTK_STOCK_REMOVE, G_CALLBACK(trw_layer_delete_all_tracks), data );
     if ( selection & VIK_MENU_ITEM_DELETE )
       (void)vu_menu_add_item ( menu, _("_Delete Tracks From Selection..."), GTK_STOCK_INDEX, G_CALLBACK(trw_layer_delete_tracks_from_selection), data );
+    if ( selection & VIK_MENU_ITEM_DELETE )
+      (void)vu_menu_add_item ( menu, _("Delete Duplicate Tracks"), GTK_STOCK_DELETE, G_CALLBACK(trw_layer_delete_duplicate_tracks), data );
 
     GtkMenu *vis_submenu = GTK_MENU(gtk_menu_new());
     GtkWidget *itemvis = vu_menu_add_item ( menu, _("_Visibility"), VIK_ICON_CHECKBOX, NULL, NULL );
@@ -9893,6 +10677,7 @@ static gboolean trw_layer_sublayer_add_menu_items ( VikTrwLayer *l, GtkMenu *men
     gtk_widget_set_sensitive ( itemnew, ! (gboolean)GPOINTER_TO_INT(l->current_track) );
     (void)vu_menu_add_item ( menu, _("Delete _All Routes"), GTK_STOCK_REMOVE, G_CALLBACK(trw_layer_delete_all_routes), data );
     (void)vu_menu_add_item ( menu, _("_Delete Routes From Selection..."), GTK_STOCK_INDEX, G_CALLBACK(trw_layer_delete_routes_from_selection), data );
+    (void)vu_menu_add_item ( menu, _("Delete Duplicate Routes"), GTK_STOCK_DELETE, G_CALLBACK(trw_layer_delete_duplicate_routes), data );
 
     GtkMenu *vis_submenu = GTK_MENU(gtk_menu_new());
     GtkWidget *itemvis = vu_menu_add_item ( menu, _("_Visibility"), NULL, NULL, NULL );
@@ -9909,6 +10694,18 @@ static gboolean trw_layer_sublayer_add_menu_items ( VikTrwLayer *l, GtkMenu *men
     (void)vu_menu_add_item ( menu, _("_Statistics"), NULL, G_CALLBACK(trw_layer_routes_stats), data );
   }
 
+  if ( subtype == VIK_TRW_LAYER_SUBLAYER_TRACKS || subtype == VIK_TRW_LAYER_SUBLAYER_ROUTES ) {
+    GtkMenu *dem_submenu = GTK_MENU(gtk_menu_new());
+    GtkWidget *itemdem = vu_menu_add_item ( menu, _("_Apply DEM Data"), "vik-icon-DEM Download", NULL, NULL );
+    gtk_menu_item_set_submenu ( GTK_MENU_ITEM(itemdem), GTK_WIDGET(dem_submenu) );
+
+    GtkWidget *itemow = vu_menu_add_item ( dem_submenu, _("_Overwrite"), NULL, G_CALLBACK(trw_layer_apply_dem_data_tracks_all), data );
+    gtk_widget_set_tooltip_text ( itemow, _("Overwrite any existing elevation values with DEM values") );
+
+    GtkWidget *itemke = vu_menu_add_item ( dem_submenu, _("_Keep Existing"), NULL, G_CALLBACK(trw_layer_apply_dem_data_tracks_only_missing), data );
+    gtk_widget_set_tooltip_text ( itemke, _("Keep existing elevation values, only attempt for missing values") );
+  }
+
 
   if ( subtype == VIK_TRW_LAYER_SUBLAYER_WAYPOINTS || subtype == VIK_TRW_LAYER_SUBLAYER_TRACKS || subtype == VIK_TRW_LAYER_SUBLAYER_ROUTES ) {
     GtkMenu *submenu_sort = GTK_MENU(gtk_menu_new());
@@ -10365,8 +11162,9 @@ static void trw_layer_insert_tp_beside_current_tp ( VikTrwLayer *vtl, gboolean b
     if ( index > -1 ) {
       if ( !before )
         index = index + 1;
-      // NB no recalculation of bounds since it is inserted between points
       trk->trackpoints = g_list_insert ( trk->trackpoints, tp_new, index );
+      // Although the bounds can't change as it is inserted between points, everything else derived from them does
+      vik_track_calculate_bounds ( trk );
     }
   }
 
@@ -10468,6 +11266,8 @@ static void trw_layer_tpwin_response ( VikTrwLayer *vtl, gint response )
     }
   }
   else if ( response == VIK_TRW_LAYER_TPWIN_DATA_CHANGED ) {
+    if ( vtl->current_tp_track )
+      vik_track_calculate_bounds ( vtl->current_tp_track );
     vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
   }
 }
@@ -10673,19 +11473,17 @@ static void waypoint_search_closest_tp ( gpointer id, VikWaypoint *wp, WPSearchP
     }
 }
 
-// 'Fast' simple search, using the size parameter
-//   this only 'works' for small values of size, otherwise use track_search_closest_tp_real()
-static void track_search_closest_tp ( gpointer id, VikTrack *t, TPSearchParams *params )
+/*
+ * Trackpoint searches use the spatial index of each track (see vik_track_get_tp_index())
+ *  so only the trackpoints near to the position need converting into screen coordinates.
+ * Should the index turn out to be out of date, then every trackpoint of that track is checked.
+ */
+
+static void track_search_closest_tp_linear ( gpointer id, VikTrack *t, TPSearchParams *params )
 {
   GList *tpl = t->trackpoints;
   VikTrackpoint *tp;
 
-  if ( !t->visible )
-    return;
-
-  if ( ! BBOX_INTERSECT ( t->bbox, params->bbox ) )
-    return;
-
   while (tpl)
   {
     gint x, y;
@@ -10708,6 +11506,172 @@ static void track_search_closest_tp ( gpointer id, VikTrack *t, TPSearchParams *
   }
 }
 
+static void track_search_closest_tp_real_linear ( gpointer id, VikTrack *trk, TPSearchParams *params )
+{
+  GList *tpl = trk->trackpoints;
+  VikTrackpoint *tp;
+
+  while (tpl)
+  {
+    gint x, y;
+    tp = VIK_TRACKPOINT(tpl->data);
+
+    vik_viewport_coord_to_screen ( params->vvp, &(tp->coord), &x, &y );
+
+    gint dist_sqrd =
+      ( abs(x - params->x) * abs(x - params->x) ) +
+      ( abs(y - params->y) * abs(y - params->y) );
+
+    if ( (!params->closest_tp) || dist_sqrd < params->closest_xy_sqrd )
+    {
+      params->closest_track_id = id;
+      params->closest_track = trk;
+      params->closest_tp = tp;
+      params->closest_tpl = tpl;
+      params->closest_xy_sqrd = dist_sqrd;
+      params->closest_x = x;
+      params->closest_y = y;
+    }
+    tpl = tpl->next;
+  }
+}
+
+/**
+ * The area (as lat/lon bounds) covered by the screen area around the position
+ */
+static LatLonBBox screen_area_bbox ( VikViewport *vvp, gint x, gint y, gint slack )
+{
+  LatLonBBox bbox;
+  bbox.north = -90.0;
+  bbox.south = 90.0;
+  bbox.east = -180.0;
+  bbox.west = 180.0;
+
+  const gint xs[2] = { x - slack, x + slack };
+  const gint ys[2] = { y - slack, y + slack };
+  for ( guint ii = 0; ii < 2; ii++ ) {
+    for ( guint jj = 0; jj < 2; jj++ ) {
+      VikCoord coord;
+      struct LatLon ll;
+      vik_viewport_screen_to_coord ( vvp, xs[ii], ys[jj], &coord );
+      vik_coord_to_latlon ( &coord, &ll );
+      bbox.north = MAX ( bbox.north, ll.lat );
+      bbox.south = MIN ( bbox.south, ll.lat );
+      bbox.east = MAX ( bbox.east, ll.lon );
+      bbox.west = MIN ( bbox.west, ll.lon );
+    }
+  }
+
+  // Allow a little extra since the projection may not be linear across the area
+  gdouble dlat = (bbox.north - bbox.south) * 0.1;
+  gdouble dlon = (bbox.east - bbox.west) * 0.1;
+  bbox.north += dlat;
+  bbox.south -= dlat;
+  bbox.east += dlon;
+  bbox.west -= dlon;
+  return bbox;
+}
+
+typedef struct {
+  VikViewport *vvp;
+  gint x, y;
+  guint size;        // Only for the 'fast' search
+  gboolean real;
+  gboolean found;
+  guint pos;         // Position of the trackpoint in the track
+  GList *tpl;
+  struct LatLon ll;
+  gint closest_x, closest_y;
+  gint dist;         // Manhattan distance for the 'fast' search, otherwise squared distance
+} TPIndexSearch;
+
+static void tp_index_search_cb ( const struct LatLon *ll, guint pos, GList *tpl, TPIndexSearch *tis )
+{
+  VikCoord coord;
+  gint x, y;
+  vik_coord_load_from_latlon ( &coord, vik_viewport_get_coord_mode(tis->vvp), ll );
+  vik_viewport_coord_to_screen ( tis->vvp, &coord, &x, &y );
+
+  gint dist;
+  if ( tis->real )
+    dist = ( abs(x - tis->x) * abs(x - tis->x) ) + ( abs(y - tis->y) * abs(y - tis->y) );
+  else {
+    if ( abs(x - tis->x) > tis->size || abs(y - tis->y) > tis->size )
+      return;
+    dist = abs(x - tis->x) + abs(y - tis->y);
+  }
+
+  // Prefer the earliest trackpoint when at the same distance
+  if ( !tis->found || dist < tis->dist || (dist == tis->dist && pos < tis->pos) ) {
+    tis->found = TRUE;
+    tis->pos = pos;
+    tis->tpl = tpl;
+    tis->ll = *ll;
+    tis->closest_x = x;
+    tis->closest_y = y;
+    tis->dist = dist;
+  }
+}
+
+/**
+ * Get the actual trackpoint found via the index
+ *
+ * Returns: NULL if the index is out of date
+ */
+static GList *tp_index_search_get_tpl ( VikTrack *trk, TPIndexSearch *tis )
+{
+  GList *tpl = tis->tpl;
+  if ( !tpl )
+    return NULL;
+  struct LatLon ll;
+  vik_coord_to_latlon ( &(VIK_TRACKPOINT(tpl->data)->coord), &ll );
+  if ( ll.lat != tis->ll.lat || ll.lon != tis->ll.lon )
+    return NULL;
+  return tpl;
+}
+
+static void tp_index_out_of_date ( VikTrack *trk )
+{
+  g_debug ( "%s: Trackpoint index of track '%s' was out of date", __FUNCTION__, trk->name );
+  vik_point_index_free ( trk->tp_index );
+  trk->tp_index = NULL;
+}
+
+// 'Fast' simple search, using the size parameter
+//   this only 'works' for small values of size, otherwise use track_search_closest_tp_real()
+static void track_search_closest_tp ( gpointer id, VikTrack *t, TPSearchParams *params )
+{
+  if ( !t->visible )
+    return;
+
+  if ( ! BBOX_INTERSECT ( t->bbox, params->bbox ) )
+    return;
+
+  TPIndexSearch tis = { params->vvp, params->x, params->y, params->size, FALSE, FALSE, 0 };
+  LatLonBBox area = screen_area_bbox ( params->vvp, params->x, params->y, params->size );
+  vik_point_index_foreach_in_bbox ( vik_track_get_tp_index(t), &area, (VikPointIndexFunc)tp_index_search_cb, &tis );
+  if ( !tis.found )
+    return;
+
+  GList *tpl = tp_index_search_get_tpl ( t, &tis );
+  if ( !tpl ) {
+    tp_index_out_of_date ( t );
+    track_search_closest_tp_linear ( id, t, params );
+    return;
+  }
+
+  if ( (!params->closest_tp) ||        /* was the old trackpoint we already found closer than this one? */
+       tis.dist < abs(params->closest_x - params->x)+abs(params->closest_y - params->y) )
+  {
+    params->closest_track_id = id;
+    params->closest_track = t;
+    params->closest_tp = VIK_TRACKPOINT(tpl->data);
+    params->closest_tpl = tpl;
+    params->closest_x = tis.closest_x;
+    params->closest_y = tis.closest_y;
+  }
+}
+
 // ATM: Leave this as 'Track' only.
 //  Not overly bothered about having a snap to route trackpoint capability
 static VikTrackpoint *closest_tp_in_interval ( VikTrwLayer *vtl, VikViewport *vvp, gint x, gint y )
@@ -10728,40 +11692,92 @@ static VikTrackpoint *closest_tp_in_interval ( VikTrwLayer *vtl, VikViewport *vv
 // True (flat geometrical) search
 static void track_search_closest_tp_real ( gpointer id, VikTrack *trk, TPSearchParams *params )
 {
-  GList *tpl = trk->trackpoints;
-  VikTrackpoint *tp;
-
   if ( !trk->visible )
     return;
 
   if ( ! BBOX_INTERSECT ( trk->bbox, params->bbox ) )
     return;
 
-  while (tpl)
+  VikPointIndex *index = vik_track_get_tp_index ( trk );
+  TPIndexSearch tis = { params->vvp, params->x, params->y, 0, TRUE, FALSE, 0 };
+
+  // Search increasingly larger areas until a trackpoint is found that is nearer than any outside of the area
+  //  (and no need to look further away than a trackpoint already found in another track)
+  const gint max_slack = 4 * MAX ( vik_viewport_get_width(params->vvp), vik_viewport_get_height(params->vvp) );
+  const gint limit = params->closest_tp ? (gint)ceil(sqrt(params->closest_xy_sqrd)) : G_MAXINT;
+  gint slack = MIN ( 32, limit );
+  while ( TRUE ) {
+    LatLonBBox area = screen_area_bbox ( params->vvp, params->x, params->y, slack );
+    vik_point_index_foreach_in_bbox ( index, &area, (VikPointIndexFunc)tp_index_search_cb, &tis );
+    if ( tis.found && tis.dist <= (gint64)slack * slack )
+      break;
+    if ( slack >= limit )
+      break;
+    if ( area.north >= trk->bbox.north && area.south <= trk->bbox.south &&
+         area.east >= trk->bbox.east && area.west <= trk->bbox.west )
+      break;
+    if ( slack >= max_slack ) {
+      // Far off screen, so just check everything
+      track_search_closest_tp_real_linear ( id, trk, params );
+      return;
+    }
+    slack = MIN ( slack * 4, limit );
+  }
+  if ( !tis.found )
+    return;
+
+  GList *tpl = tp_index_search_get_tpl ( trk, &tis );
+  if ( !tpl ) {
+    tp_index_out_of_date ( trk );
+    track_search_closest_tp_real_linear ( id, trk, params );
+    return;
+  }
+
+  if ( (!params->closest_tp) || tis.dist < params->closest_xy_sqrd )
   {
-    gint x, y;
-    tp = VIK_TRACKPOINT(tpl->data);
+    params->closest_track_id = id;
+    params->closest_track = trk;
+    params->closest_tp = VIK_TRACKPOINT(tpl->data);
+    params->closest_tpl = tpl;
+    params->closest_xy_sqrd = tis.dist;
+    params->closest_x = tis.closest_x;
+    params->closest_y = tis.closest_y;
+  }
+}
 
-    vik_viewport_coord_to_screen ( params->vvp, &(tp->coord), &x, &y );
+typedef struct {
+  GHashTable *waypoints;
+  WPSearchParams *params;
+} WPIndexSearch;
 
-    gint dist_sqrd =
-      ( abs(x - params->x) * abs(x - params->x) ) +
-      ( abs(y - params->y) * abs(y - params->y) );
+static void wp_index_search_cb ( const struct LatLon *ll, guint id, gpointer data, WPIndexSearch *wis )
+{
+  // NB Use the waypoint itself (rather than the indexed position), as any deleted ones are simply not found
+  VikWaypoint *wp = g_hash_table_lookup ( wis->waypoints, GUINT_TO_POINTER(id) );
+  if ( wp )
+    waypoint_search_closest_tp ( GUINT_TO_POINTER(id), wp, wis->params );
+}
 
-    if ( (!params->closest_tp) || dist_sqrd < params->closest_xy_sqrd )
-    {
-      params->closest_track_id = id;
-      params->closest_track = trk;
-      params->closest_tp = tp;
-      params->closest_tpl = tpl;
-      params->closest_xy_sqrd = dist_sqrd;
-      params->closest_x = x;
-      params->closest_y = y;
-    }
-    tpl = tpl->next;
+static VikPointIndex *trw_layer_get_wp_index ( VikTrwLayer *vtl )
+{
+  if ( vtl->wp_index )
+    return vtl->wp_index;
+
+  vtl->wp_index = vik_point_index_new ( &vtl->waypoints_bbox, g_hash_table_size(vtl->waypoints) );
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, vtl->waypoints );
+  while ( g_hash_table_iter_next (&iter, &key, &value) ) {
+    struct LatLon ll;
+    vik_coord_to_latlon ( &(VIK_WAYPOINT(value)->coord), &ll );
+    vik_point_index_add ( vtl->wp_index, &ll, GPOINTER_TO_UINT(key), NULL );
   }
+  return vtl->wp_index;
 }
 
+// Symbols are at most 30 pixels (when using the large icons)
+#define WP_SYMBOL_MAX_SIZE 32
+
 static VikWaypoint *closest_wp_in_interval ( VikTrwLayer *vtl, VikViewport *vvp, gint x, gint y )
 {
   WPSearchParams params;
@@ -10773,7 +11789,16 @@ static VikWaypoint *closest_wp_in_interval ( VikTrwLayer *vtl, VikViewport *vvp,
   params.draw_symbols = vtl->wp_draw_symbols;
   params.closest_wp = NULL;
   params.closest_wp_id = NULL;
-  g_hash_table_foreach ( vtl->waypoints, (GHFunc) waypoint_search_closest_tp, &params);
+
+  // Only consider waypoints that could be drawn near the position
+  gint slack = params.size;
+  if ( params.draw_images )
+    slack = MAX ( slack, vtl->image_size );
+  if ( params.draw_symbols )
+    slack = MAX ( slack, WP_SYMBOL_MAX_SIZE );
+  LatLonBBox area = screen_area_bbox ( vvp, x, y, slack );
+  WPIndexSearch wis = { vtl->waypoints, &params };
+  vik_point_index_foreach_in_bbox ( trw_layer_get_wp_index(vtl), &area, (VikPointIndexFunc)wp_index_search_cb, &wis );
   return params.closest_wp;
 }
 
@@ -12062,9 +13087,10 @@ static VikLayerToolFuncStatus tool_edit_track_or_route_click ( VikTrwLayer *vtl,
   tp->newsegment = newsegment;
 
   if ( vtl->current_track ) {
-    vik_track_add_trackpoint ( vtl->current_track, tp, TRUE ); // Ensure bounds is updated
     /* Auto attempt to get elevation from DEM data (if it's available) */
+    /* NB before adding, so the track's statistics include it */
     (void)vik_trackpoint_apply_dem_data ( tp );
+    vik_track_add_trackpoint ( vtl->current_track, tp, TRUE ); // Ensure bounds is updated
     if ( trw_layer_modified(vtl) )
       vik_window_set_modified ( (VikWindow *)(VIK_GTK_WINDOW_FROM_LAYER(vtl)) );
   }
@@ -12168,6 +13194,7 @@ static VikLayerToolFuncStatus tool_edit_track_or_route_join ( VikTrwLayer *vtl,
     trw_layer_split_at_selected_trackpoint ( vtl, is_route ? VIK_TRW_LAYER_SUBLAYER_ROUTE : VIK_TRW_LAYER_SUBLAYER_TRACK );
     vik_track_steal_and_append_trackpoints ( origin_track, vtl->current_tp_track );
     VIK_TRACKPOINT(vtl->current_tpl->data)->newsegment = FALSE;
+    vik_track_invalidate_stats ( origin_track );
 
     if ( is_route )
       vik_trw_layer_delete_route ( vtl, vtl->current_tp_track );
@@ -12823,6 +13850,10 @@ static void trw_layer_track_alloc_colors ( VikTrwLayer *vtl )
  */
 void trw_layer_calculate_bounds_waypoints ( VikTrwLayer *vtl )
 {
+  // Waypoints have changed, so the index will need to be regenerated
+  vik_point_index_free ( vtl->wp_index );
+  vtl->wp_index = NULL;
+
   struct LatLon topleft = { 0.0, 0.0 };
   struct LatLon bottomright = { 0.0, 0.0 };
   struct LatLon ll;
@@ -12965,11 +13996,13 @@ static void trw_layer_post_read ( VikTrwLayer *vtl, VikViewport *vvp, gboolean f
   gpointer key, value;
 
   if ( vtl->auto_dem ) {
-    g_hash_table_iter_init ( &iter, vtl->tracks );
-    while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
-      VikTrack *trk = VIK_TRACK(value);
-      (void)vik_track_apply_dem_data ( trk, FALSE );
-    }
+    // All tracks in one batch, using all the CPUs
+    // NB This deliberately waits for the result (without progress), as the file load expects the elevations to be set
+    ApplyDEMT *ad = apply_dem_new ( vtl, vtl->tracks, FALSE );
+    (void)a_dems_get_elevs_by_coords_progress ( (VikCoord*)ad->coords->data, ad->coords->len, VIK_DEM_INTERPOL_BEST,
+                                                ad->elevs, NULL, &ad->found );
+    (void)apply_dem_set ( ad );
+    apply_dem_free ( ad );
   }
 
   if ( vtl->auto_dedupl ) {
@@ -100,11 +100,16 @@ void vik_trw_layer_filein_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t
 
 void vik_trw_layer_tidy_tracks ( VikTrwLayer *vtl, guint speed, gboolean recalc_bounds );
 
+// For handing over what has been read into a separate layer
+void vik_trw_layer_steal_items ( VikTrwLayer *vtl, GList **waypoints, GList **tracks, GList **routes );
+void vik_trw_layer_take_file_info ( VikTrwLayer *vtl, VikTrwLayer *src );
+
 gint vik_trw_layer_get_property_tracks_line_thickness ( VikTrwLayer *vtl );
 
 void vik_trw_layer_add_waypoint ( VikTrwLayer *vtl, gchar *name, VikWaypoint *wp );
 void vik_trw_layer_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t );
 void vik_trw_layer_add_route ( VikTrwLayer *vtl, gchar *name, VikTrack *t );
+void vik_trw_layer_add_items ( VikTrwLayer *vtl, GList *waypoints, GList *tracks, GList *routes );
 
 // Waypoint returned is the first one
 VikWaypoint *vik_trw_layer_get_waypoint ( VikTrwLayer *vtl, const gchar *name );
@@ -149,6 +154,7 @@ void vik_trw_layer_reset_waypoints ( VikTrwLayer *vtl );
 void vik_trw_layer_draw_highlight ( VikTrwLayer *vtl, VikViewport *vvp );
 void vik_trw_layer_draw_highlight_item ( VikTrwLayer *vtl, VikTrack *trk, VikWaypoint *wpt, VikViewport *vvp );
 void vik_trw_layer_draw_highlight_items ( VikTrwLayer *vtl, GHashTable *trks, GHashTable *wpts, VikViewport *vvp );
+void vik_trw_layer_draw_track_tail ( VikTrwLayer *vtl, VikViewport *vvp, VikTrack *trk, GList *tpl );
 
 // E.g for creating a list of tracks with the corresponding layer it is in
 //  (thus a selection of tracks may be from differing layers)
@@ -147,6 +147,13 @@ typedef struct {
 	gdouble image_direction;
 	// If anything has changed
 	gboolean redraw;
+	// Created from the waypoints when first needed
+	VikTrack *waypoints_track;
+	// Image dates read in advance, for the image at index
+	guint index;
+	guint n_images;
+	gchar **datetimes;
+	gboolean *has_gps_exifs;
 } geotag_options_t;
 
 #define VIK_SETTINGS_GEOTAG_CREATE_WAYPOINT      "geotag_create_waypoints"
@@ -224,6 +231,55 @@ static gdouble get_heading_from_trackpoint ( GList *mytrkpt )
 	return NAN;
 }
 
+/**
+ * The image is at the time of this trackpoint
+ */
+static void trw_layer_geotag_trackpoint ( GList *mytrkpt, geotag_options_t *options )
+{
+	VikTrackpoint *trkpt = VIK_TRACKPOINT(mytrkpt->data);
+	options->coord = trkpt->coord;
+	options->altitude = trkpt->altitude;
+	options->found_match = TRUE;
+	if ( options->ov.auto_image_direction )
+		options->image_direction = get_heading_from_trackpoint ( mytrkpt );
+}
+
+/**
+ * The image is between the times of these two trackpoints
+ */
+static void trw_layer_geotag_interpolate ( VikTrackpoint *trkpt, VikTrackpoint *trkpt_next, geotag_options_t *options )
+{
+	options->found_match = TRUE;
+	// Interpolate
+	/* Calculate the "scale": a decimal giving the relative distance
+	 * in time between the two points. Ie, a number between 0 and 1 -
+	 * 0 is the first point, 1 is the next point, and 0.5 would be
+	 * half way. */
+	gdouble tdiff = (gdouble)trkpt_next->timestamp - (gdouble)trkpt->timestamp;
+	gdouble scale = ((gdouble)options->PhotoTime - (gdouble)trkpt->timestamp) / tdiff;
+
+	options->PhotoTime = options->PhotoTime + (time_t)(tdiff * scale);
+
+	struct LatLon ll_result, ll1, ll2;
+
+	vik_coord_to_latlon ( &(trkpt->coord), &ll1 );
+	vik_coord_to_latlon ( &(trkpt_next->coord), &ll2 );
+
+	ll_result.lat = ll1.lat + ((ll2.lat - ll1.lat) * scale);
+
+	// NB This won't cope with going over the 180 degrees longitude boundary
+	ll_result.lon = ll1.lon + ((ll2.lon - ll1.lon) * scale);
+
+	// set coord
+	vik_coord_load_from_latlon ( &(options->coord), VIK_COORD_LATLON, &ll_result );
+
+	// Interpolate elevation
+	options->altitude = trkpt->altitude + ((trkpt_next->altitude - trkpt->altitude) * scale);
+
+	if ( options->ov.auto_image_direction )
+		options->image_direction = vik_coord_angle ( &trkpt->coord, &trkpt_next->coord );
+}
+
 /**
  * Correlate the image against the specified track
  */
@@ -237,6 +293,29 @@ static void trw_layer_geotag_track ( const gpointer id, VikTrack *track, geotag_
 	VikTrackpoint *trkpt_next;
 
 	GList *mytrkpt;
+	if ( vik_track_search_time ( track, (gdouble)options->PhotoTime, &mytrkpt ) ) {
+		// As the times are in order, only need to consider the first trackpoint at or after the image time
+		//  and the one before it
+		if ( !mytrkpt )
+			return;
+		trkpt_next = VIK_TRACKPOINT(mytrkpt->data);
+		if ( options->PhotoTime == trkpt_next->timestamp ) {
+			trw_layer_geotag_trackpoint ( mytrkpt, options );
+			return;
+		}
+		if ( !mytrkpt->prev )
+			return;
+		trkpt = VIK_TRACKPOINT(mytrkpt->prev->data);
+		if ( isnan(trkpt->timestamp) )
+			return;
+		// Don't check between segments, unless interpolating between them
+		if ( !options->ov.interpolate_segments && trkpt_next->newsegment )
+			return;
+		trw_layer_geotag_interpolate ( trkpt, trkpt_next, options );
+		return;
+	}
+
+	// Otherwise have to go through every trackpoint
 	for ( mytrkpt = track->trackpoints; mytrkpt; mytrkpt = mytrkpt->next ) {
 
 		// Do something for this trackpoint...
@@ -249,11 +328,7 @@ static void trw_layer_geotag_track ( const gpointer id, VikTrack *track, geotag_
 
 		// is it exactly this point?
 		if ( options->PhotoTime == trkpt->timestamp ) {
-			options->coord = trkpt->coord;
-			options->altitude = trkpt->altitude;
-			options->found_match = TRUE;
-			if ( options->ov.auto_image_direction )
-				options->image_direction = get_heading_from_trackpoint ( mytrkpt );
+			trw_layer_geotag_trackpoint ( mytrkpt, options );
 			break;
 		}
 
@@ -277,36 +352,7 @@ static void trw_layer_geotag_track ( const gpointer id, VikTrack *track, geotag_
 
 		// Is is between this and the next point?
 		if ( (options->PhotoTime > trkpt->timestamp) && (options->PhotoTime < trkpt_next->timestamp) ) {
-			options->found_match = TRUE;
-			// Interpolate
-			/* Calculate the "scale": a decimal giving the relative distance
-			 * in time between the two points. Ie, a number between 0 and 1 -
-			 * 0 is the first point, 1 is the next point, and 0.5 would be
-			 * half way. */
-			gdouble tdiff = (gdouble)trkpt_next->timestamp - (gdouble)trkpt->timestamp;
-			gdouble scale = ((gdouble)options->PhotoTime - (gdouble)trkpt->timestamp) / tdiff;
-
-			options->PhotoTime = options->PhotoTime + (time_t)(tdiff * scale);
-
-			struct LatLon ll_result, ll1, ll2;
-
-			vik_coord_to_latlon ( &(trkpt->coord), &ll1 );
-			vik_coord_to_latlon ( &(trkpt_next->coord), &ll2 );
-
-			ll_result.lat = ll1.lat + ((ll2.lat - ll1.lat) * scale);
-
-			// NB This won't cope with going over the 180 degrees longitude boundary
-			ll_result.lon = ll1.lon + ((ll2.lon - ll1.lon) * scale);
-
-			// set coord
-			vik_coord_load_from_latlon ( &(options->coord), VIK_COORD_LATLON, &ll_result );
-
-			// Interpolate elevation
-			options->altitude = trkpt->altitude + ((trkpt_next->altitude - trkpt->altitude) * scale);
-
-			if ( options->ov.auto_image_direction )
-				options->image_direction = vik_coord_angle ( &trkpt->coord, &trkpt_next->coord );
-
+			trw_layer_geotag_interpolate ( trkpt, trkpt_next, options );
 			break;
 		}
 	}
@@ -342,6 +388,12 @@ static void trw_layer_geotag_waypoint ( geotag_options_t *options )
  */
 static void trw_layer_geotag_waypoints ( geotag_options_t *options )
 {
+	// Reuse the track for all the images
+	if ( options->waypoints_track ) {
+		trw_layer_geotag_track ( NULL, options->waypoints_track, options );
+		return;
+	}
+
 	// Create a temporary track from the waypoints to perform the lookup
 	// c.f. trw_layer_convert_to_track()
 	VikTrack *trk = vik_track_new();
@@ -368,10 +420,9 @@ static void trw_layer_geotag_waypoints ( geotag_options_t *options )
 
 	g_list_free_full ( gl, g_free );
 	trk->trackpoints = g_list_reverse ( trk->trackpoints );
+	options->waypoints_track = trk;
 
 	trw_layer_geotag_track ( NULL, trk, options );
-
-	vik_track_free ( trk );
 }
 
 /**
@@ -391,7 +442,15 @@ static void trw_layer_geotag_process ( geotag_options_t *options )
 	}
 
 	gboolean has_gps_exif = FALSE;
-	gchar* datetime = a_geotag_get_exif_date_from_file ( options->image, &has_gps_exif );
+	gchar* datetime = NULL;
+	if ( options->datetimes ) {
+		// Take the value already read
+		datetime = options->datetimes[options->index];
+		options->datetimes[options->index] = NULL;
+		has_gps_exif = options->has_gps_exifs[options->index];
+	}
+	else
+		datetime = a_geotag_get_exif_date_from_file ( options->image, &has_gps_exif );
 
 	if ( datetime ) {
 
@@ -523,26 +582,61 @@ static void trw_layer_geotag_thread_free ( geotag_options_t *gtd )
 {
 	if ( gtd->files )
 		g_list_free ( gtd->files );
+	if ( gtd->waypoints_track )
+		vik_track_free ( gtd->waypoints_track );
+	if ( gtd->datetimes ) {
+		for ( guint ii = 0; ii < gtd->n_images; ii++ )
+			g_free ( gtd->datetimes[ii] );
+		g_free ( gtd->datetimes );
+	}
+	g_free ( gtd->has_gps_exifs );
 	g_free ( gtd );
 }
 
+/**
+ * Reading the dates from the images is the slow part, so do them all at once in parallel
+ *  (unless simply using the waypoint position, when the date isn't needed)
+ * NB Then each image counts twice as a background item
+ */
+static gboolean geotag_read_dates_first ( geotag_options_t *options, guint total )
+{
+	return !options->wpt && total > 1;
+}
+
 /**
  * Run geotagging process in a separate thread
  */
 static int trw_layer_geotag_thread ( geotag_options_t *options, gpointer threaddata )
 {
 	guint total = g_list_length(options->files), done = 0;
+	gdouble progress_start = 0.0;
 
 	// TODO decide how to report any issues to the user ...
 
+	if ( geotag_read_dates_first ( options, total ) ) {
+		const gchar **filenames = g_new ( const gchar*, total );
+		guint nn = 0;
+		for ( GList *gl = options->files; gl; gl = gl->next )
+			filenames[nn++] = gl->data;
+		options->n_images = total;
+		options->datetimes = g_new ( gchar*, total );
+		options->has_gps_exifs = g_new ( gboolean, total );
+		gint ans = a_geotag_get_exif_dates_from_files ( filenames, total, options->datetimes, options->has_gps_exifs, threaddata );
+		g_free ( filenames );
+		if ( ans != 0 )
+			return -1; /* Abort thread */
+		progress_start = 0.5;
+	}
+
 	// Foreach file attempt to geotag it
 	while ( options->files ) {
 		options->image = (gchar *) ( options->files->data );
 		trw_layer_geotag_process ( options );
 		options->files = options->files->next;
+		options->index++;
 
 		// Update thread progress and detect stop requests
-		int result = a_background_thread_progress ( threaddata, ((gdouble) ++done) / total );
+		int result = a_background_thread_progress ( threaddata, progress_start + (1.0 - progress_start) * ++done / total );
 		if ( result != 0 )
 			return -1; /* Abort thread */
 	}
@@ -603,6 +697,11 @@ static void trw_layer_geotag_response_cb ( GtkDialog *dialog, gint resp, GeoTagW
 		options->ov.time_offset = atoi ( gtk_entry_get_text ( GTK_ENTRY(widgets->time_offset_b) ) );
 
 		options->redraw = FALSE;
+		options->waypoints_track = NULL;
+		options->index = 0;
+		options->n_images = 0;
+		options->datetimes = NULL;
+		options->has_gps_exifs = NULL;
 
 		// Save settings for reuse
 		save_default_values ( options->ov );
@@ -620,7 +719,7 @@ static void trw_layer_geotag_response_cb ( GtkDialog *dialog, gint resp, GeoTagW
 		                      options,
 		                      (vik_thr_free_func) trw_layer_geotag_thread_free,
 		                      NULL,
-		                      len );
+		                      geotag_read_dates_first ( options, len ) ? 2*len : len );
 
 		g_free ( tmp );
 
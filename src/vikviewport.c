@@ -117,6 +117,10 @@ struct _VikViewport {
   gboolean draw_centermark;
   gboolean draw_highlight;
 
+  // Layers must complete all drawing immediately (e.g. when generating an image)
+  //  rather than deferring any work to background threads
+  gboolean draw_synchronous;
+
   /* subset of coord types. lat lon can be plotted in 2 ways, google or exp. */
   VikViewportDrawMode drawmode;
 
@@ -286,6 +290,7 @@ vik_viewport_init ( VikViewport *vvp )
   vvp->draw_scale = a_vik_get_startup_show_scale();
   vvp->draw_centermark = a_vik_get_startup_show_centermark();
   vvp->draw_highlight = a_vik_get_startup_show_highlight();
+  vvp->draw_synchronous = FALSE;
 
   vvp->highlight_color = a_vik_get_startup_highlight_color();
 #if GTK_CHECK_VERSION (3,0,0)
@@ -510,6 +515,22 @@ GdkPixbuf *vik_viewport_get_pixbuf ( VikViewport *vvp, gint ww, gint hh )
   return pixbuf;
 }
 
+/**
+ * vik_viewport_get_pixbuf_area:
+ *
+ * Get a copy of part of what has been drawn (which must be within the viewport),
+ *  so it can be restored with vik_viewport_draw_pixbuf() after temporarily drawing over it
+ */
+GdkPixbuf *vik_viewport_get_pixbuf_area ( VikViewport *vvp, gint x, gint y, gint ww, gint hh )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  cairo_surface_flush ( vvp->surface_main );
+  return gdk_pixbuf_get_from_surface ( vvp->surface_main, x, y, ww, hh );
+#else
+  return gdk_pixbuf_get_from_drawable ( NULL, GDK_DRAWABLE(vvp->scr_buffer), NULL, x, y, 0, 0, ww, hh );
+#endif
+}
+
 /**
  * The returned cairo_t* should be destroyed after use,
  * inconjunction with vik_viewport_surface_tool_destroy() below.
@@ -972,6 +993,16 @@ gboolean vik_viewport_get_draw_highlight ( VikViewport *vvp )
   return vvp->draw_highlight;
 }
 
+void vik_viewport_set_draw_synchronous ( VikViewport *vvp, gboolean draw_synchronous )
+{
+  vvp->draw_synchronous = draw_synchronous;
+}
+
+gboolean vik_viewport_get_draw_synchronous ( VikViewport *vvp )
+{
+  return vvp->draw_synchronous;
+}
+
 static gboolean remove_popup_cb ( VikViewport *vvp )
 {
   // Strangely using ui_cr_clear () is worse than destroying/recreating
@@ -1593,6 +1624,31 @@ void vik_viewport_coord_to_screen ( VikViewport *vvp, const VikCoord *coord, int
   }
 }
 
+/**
+ * vik_viewport_get_coord_units_per_pixel:
+ * @lat: The highest absolute latitude of the area of interest
+ *
+ * Returns: A distance in the units of the coordinate mode (metres or degrees),
+ *  that covers no more than one pixel (in any direction) within the area of interest.
+ *  0.0 is returned when this can not be determined for the current drawmode.
+ */
+gdouble vik_viewport_get_coord_units_per_pixel ( VikViewport *vvp, gdouble lat )
+{
+  if ( vvp->coord_mode == VIK_COORD_UTM )
+    return MIN ( vvp->xmpp, vvp->ympp );
+
+  if ( vvp->drawmode == VIK_VIEWPORT_DRAWMODE_LATLON )
+    return 1.0 / MAX ( vvp->xmfactor, vvp->ymfactor );
+
+  if ( vvp->drawmode == VIK_VIEWPORT_DRAWMODE_MERCATOR ) {
+    // Latitudes are stretched by 1/cos(lat) in this projection
+    lat = MIN ( fabs(lat), 85.0 );
+    return cos ( DEG2RAD(lat) ) / MAX ( vvp->xmfactor, vvp->ymfactor );
+  }
+
+  return 0.0;
+}
+
 /**
  * a_viewport_clip_line:
  * @x1: screen coord
@@ -1789,6 +1845,41 @@ void vik_viewport_draw_polygon ( VikViewport *vvp, GdkGC *gc, gboolean filled, G
 #endif
 }
 
+/**
+ * vik_viewport_draw_polylines:
+ * @points:  The points of all the lines, one line after another
+ * @lengths: The number of points in each line
+ * @nlines:  The number of lines
+ *
+ * Draw a series of (unfilled) lines in one go,
+ *  which is much faster than drawing each segment individually via vik_viewport_draw_line()
+ *
+ * NB No clipping is performed here, so the caller should ensure the values are
+ *  in the range accepted by a_viewport_clip_line()
+ */
+void vik_viewport_draw_polylines ( VikViewport *vvp, GdkGC *gc, const GdkPoint *points, const gint *lengths, guint nlines, GdkColor *gcolor, guint thickness )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  g_return_if_fail ( gc != NULL );
+  cairo_set_line_width ( gc, thickness );
+  if ( gcolor )
+    gdk_cairo_set_source_color ( gc, gcolor );
+  // All lines make up one path, so only one stroke is required
+  for ( guint ll = 0; ll < nlines; ll++ ) {
+    cairo_move_to ( gc, points[0].x-0.5, points[0].y-0.5 );
+    for ( gint nn = 1; nn < lengths[ll]; nn++ )
+      cairo_line_to ( gc, points[nn].x-0.5, points[nn].y-0.5 );
+    points += lengths[ll];
+  }
+  cairo_stroke ( gc );
+#else
+  for ( guint ll = 0; ll < nlines; ll++ ) {
+    gdk_draw_lines ( vvp->scr_buffer, gc, (GdkPoint*)points, lengths[ll] );
+    points += lengths[ll];
+  }
+#endif
+}
+
 VikCoordMode vik_viewport_get_coord_mode ( const VikViewport *vvp )
 {
   g_assert ( vvp );
@@ -68,6 +68,7 @@ gboolean vik_viewport_configure ( VikViewport *vp );
 /* coordinate transformations */
 void vik_viewport_screen_to_coord ( VikViewport *vvp, int x, int y, VikCoord *coord );
 void vik_viewport_coord_to_screen ( VikViewport *vvp, const VikCoord *coord, int *x, int *y );
+gdouble vik_viewport_get_coord_units_per_pixel ( VikViewport *vvp, gdouble lat );
 
 
 /* viewport scale */
@@ -122,6 +123,7 @@ VikViewportDrawMode vik_viewport_get_drawmode ( VikViewport *vvp );
  ***************************************************************************************************/
 
 GdkPixbuf *vik_viewport_get_pixbuf ( VikViewport *vvp, gint ww, gint hh );
+GdkPixbuf *vik_viewport_get_pixbuf_area ( VikViewport *vvp, gint x, gint y, gint ww, gint hh );
 
 /* Viewport buffer management/drawing to screen */
 cairo_t *vik_viewport_surface_tool_create ( VikViewport *vvp );
@@ -155,6 +157,8 @@ gboolean vik_viewport_get_draw_centermark ( VikViewport *vvp );
 void vik_viewport_draw_logo ( VikViewport *vvp );
 void vik_viewport_set_draw_highlight ( VikViewport *vvp, gboolean draw_highlight );
 gboolean vik_viewport_get_draw_highlight ( VikViewport *vvp );
+void vik_viewport_set_draw_synchronous ( VikViewport *vvp, gboolean draw_synchronous );
+gboolean vik_viewport_get_draw_synchronous ( VikViewport *vvp );
 
 /* Color/graphics context management */
 void vik_viewport_set_background_color ( VikViewport *vvp, const gchar *color );
@@ -181,6 +185,7 @@ void vik_viewport_draw_line ( VikViewport *vvp, GdkGC *gc, gint x1, gint y1, gin
 void vik_viewport_draw_rectangle ( VikViewport *vvp, GdkGC *gc, gboolean filled, gint x1, gint y1, gint x2, gint y2, GdkColor *gcolor );
 void vik_viewport_draw_arc ( VikViewport *vvp, GdkGC *gc, gboolean filled, gint x, gint y, gint width, gint height, gint angle1, gint angle2, GdkColor *gcolor );
 void vik_viewport_draw_polygon ( VikViewport *vvp, GdkGC *gc, gboolean filled, GdkPoint *points, gint npoints, GdkColor *gcolor );
+void vik_viewport_draw_polylines ( VikViewport *vvp, GdkGC *gc, const GdkPoint *points, const gint *lengths, guint nlines, GdkColor *gcolor, guint thickness );
 void vik_viewport_draw_layout ( VikViewport *vvp, GdkGC *gc, gint x, gint y, PangoLayout *layout, GdkColor *gcolor );
 
 void vik_viewport_draw_popup ( VikViewport *vvp, gchar *msg, gint x, gint y );
@@ -183,10 +183,14 @@ void vik_waypoint_set_symbol(VikWaypoint *wp, const gchar *symname)
 // Everything in gpxx space we want to put into it's GHashTable
 // Everything in wptx1 space we want to put into it's GHashTable
 // The rest of the extensions is stored 'as is' in the GString
-static GString *gs_ext;
-static gboolean is_gpxx = FALSE;
-static gboolean is_wptx1 = FALSE;
-static const gchar *tag_name;
+// State of one extensions parse (so waypoints can be read in several threads at once)
+typedef struct {
+  VikWaypoint *wp;
+  GString *gs_ext;
+  gboolean is_gpxx;
+  gboolean is_wptx1;
+  const gchar *tag_name;
+} xt_parse_t;
 
 typedef enum {
   ext_unknown = 0,
@@ -226,31 +230,32 @@ static void xt_start_element ( GMarkupParseContext *context,
                                gpointer             user_data,
                                GError             **error )
 {
-  tag_name = element_name;
-  tag_type_ext tag = get_tag_ext_specific ( tag_name );
+  xt_parse_t *xtp = (xt_parse_t*)user_data;
+  xtp->tag_name = element_name;
+  tag_type_ext tag = get_tag_ext_specific ( xtp->tag_name );
   switch ( tag ) {
   case ext_wp_gpxx: {
-    VikWaypoint *wp = (VikWaypoint*)user_data;
+    VikWaypoint *wp = xtp->wp;
     wp->gpxx = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, g_free );
-    is_gpxx = TRUE;
+    xtp->is_gpxx = TRUE;
     break;
   }
   case ext_wp_wptx1: {
-    VikWaypoint *wp = (VikWaypoint*)user_data;
+    VikWaypoint *wp = xtp->wp;
     wp->wptx1 = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, g_free );
-    is_wptx1 = TRUE;
+    xtp->is_wptx1 = TRUE;
     break;
   }
   default:
     break;
   }
-  if ( !is_gpxx && !is_wptx1 ) {
+  if ( !xtp->is_gpxx && !xtp->is_wptx1 ) {
     // Store any other tag
-    g_string_append ( gs_ext, "      <" );
-    g_string_append ( gs_ext, element_name );
+    g_string_append ( xtp->gs_ext, "      <" );
+    g_string_append ( xtp->gs_ext, element_name );
     for ( guint nn = 0; nn < g_strv_length((gchar**)attribute_names); nn++ )
-      g_string_append_printf ( gs_ext, " %s=\"%s\"", attribute_names[nn], attribute_values[nn] );
-    g_string_append ( gs_ext, ">" );
+      g_string_append_printf ( xtp->gs_ext, " %s=\"%s\"", attribute_names[nn], attribute_values[nn] );
+    g_string_append ( xtp->gs_ext, ">" );
   }
 }
 
@@ -261,8 +266,9 @@ static void xt_text ( GMarkupParseContext *context,
                       gpointer             user_data,
                       GError             **error )
 {
-  if ( is_gpxx || is_wptx1 ) {
-    if ( tag_name ) {
+  xt_parse_t *xtp = (xt_parse_t*)user_data;
+  if ( xtp->is_gpxx || xtp->is_wptx1 ) {
+    if ( xtp->tag_name ) {
       // NB need to avoid white-space
       gboolean add = FALSE;
       for ( guint nn = 0; nn < text_len; nn++ ) {
@@ -272,18 +278,18 @@ static void xt_text ( GMarkupParseContext *context,
         }
       }
       if ( add ) {
-        VikWaypoint *wp = (VikWaypoint*)user_data;
+        VikWaypoint *wp = xtp->wp;
         gchar *txt = g_memdup ( text, text_len+1 );
         txt[text_len] = '\0';
 
         // Select which table is to be updated
         GHashTable *ght = wp->wptx1;
-        if ( is_gpxx )
+        if ( xtp->is_gpxx )
           ght = wp->gpxx;
-        (void)g_hash_table_insert ( ght, g_strdup(tag_name), txt );
+        (void)g_hash_table_insert ( ght, g_strdup(xtp->tag_name), txt );
 
         // Apply (latest detected) XML value to the single proximity variable
-        tag_type_ext tag = get_tag_ext_specific ( tag_name );
+        tag_type_ext tag = get_tag_ext_specific ( xtp->tag_name );
         switch ( tag ) {
         case ext_wp_wptx1_proximity:
         case ext_wp_gpxx_proximity:
@@ -300,7 +306,7 @@ static void xt_text ( GMarkupParseContext *context,
     gchar *txt = g_memdup ( text, text_len+1 );
     txt[text_len] = '\0';
     gchar *tmp = a_gpx_entitize ( txt );
-    g_string_append ( gs_ext, tmp );
+    g_string_append ( xtp->gs_ext, tmp );
     g_free ( txt );
     g_free ( tmp );
   }
@@ -311,22 +317,23 @@ static void xt_end_element ( GMarkupParseContext *context,
                              gpointer             user_data,
                              GError             **error )
 {
+  xt_parse_t *xtp = (xt_parse_t*)user_data;
   // Store any other tag info
-  if ( !is_gpxx && !is_wptx1 )
-    g_string_append_printf ( gs_ext, "%s%s%s", "</", element_name, ">\n" );
+  if ( !xtp->is_gpxx && !xtp->is_wptx1 )
+    g_string_append_printf ( xtp->gs_ext, "%s%s%s", "</", element_name, ">\n" );
 
   tag_type_ext tag = get_tag_ext_specific ( element_name );
   switch ( tag ) {
   case ext_wp_gpxx:
-    is_gpxx = FALSE;
+    xtp->is_gpxx = FALSE;
     break;
   case ext_wp_wptx1:
-    is_wptx1 = FALSE;
+    xtp->is_wptx1 = FALSE;
     break;
   default:
     break;
   }
-  tag_name = NULL;
+  xtp->tag_name = NULL;
 }
 
 /**
@@ -424,7 +431,7 @@ void vik_waypoint_set_extensions(VikWaypoint *wp, const gchar *value)
     return;
   }
 
-  gs_ext = g_string_new ( NULL );
+  xt_parse_t xtp = { wp, g_string_new(NULL), FALSE, FALSE, NULL };
 
   GMarkupParser gparser;
   GMarkupParseContext *gcontext;
@@ -433,7 +440,7 @@ void vik_waypoint_set_extensions(VikWaypoint *wp, const gchar *value)
   gparser.text = &xt_text;
   gparser.passthrough = NULL;
   gparser.error = NULL;
-  gcontext = g_markup_parse_context_new ( &gparser, 0, wp, NULL );
+  gcontext = g_markup_parse_context_new ( &gparser, 0, &xtp, NULL );
 
   // Parse xml fragment to extract extension tag values
   GError *error = NULL;
@@ -443,10 +450,10 @@ void vik_waypoint_set_extensions(VikWaypoint *wp, const gchar *value)
   if ( !g_markup_parse_context_end_parse ( gcontext, &error) )
     g_warning ( "%s: error %s occurred on end of:%s", __FUNCTION__, error ? error->message : "???", value );
 
-  if ( gs_ext->len )
-    wp->extensions = g_strdup ( gs_ext->str );
+  if ( xtp.gs_ext->len )
+    wp->extensions = g_strdup ( xtp.gs_ext->str );
 
-  g_string_free ( gs_ext, TRUE );
+  g_string_free ( xtp.gs_ext, TRUE );
   g_markup_parse_context_free ( gcontext );
 }
 
@@ -703,6 +703,8 @@ static void open_window ( VikWindow *vw, GSList *files, gboolean external )
 {
   if ( !vw  )
     return;
+  if ( !vw->filename )
+    files = vik_window_open_gpx_files ( vw, files, external );
   guint file_num = 0;
   guint num_files = g_slist_length(files);
   gboolean change_fn = (num_files == 1); // only change fn if one file
@@ -4326,15 +4328,33 @@ static void help_maps_info_cb ( GtkAction *a, VikWindow *vw )
   vik_maps_layer_info_dialog(GTK_WINDOW(vw));
 }
 
+static gint cache_info_type_compare ( gconstpointer a, gconstpointer b )
+{
+  return (gint)GPOINTER_TO_UINT(a) - (gint)GPOINTER_TO_UINT(b);
+}
+
 static void help_cache_info_cb ( GtkAction *a, VikWindow *vw )
 {
   // NB: No i18n as this is just for debug
   guint byte_size = a_mapcache_get_size();
   gchar *msg_sz = g_format_size_full ( byte_size, G_FORMAT_SIZE_LONG_FORMAT );
-  gchar *msg = g_strdup_printf ( "Map Cache size is %s with %d items", msg_sz, a_mapcache_get_count());
-  a_dialog_info_msg_extra ( GTK_WINDOW(vw), "%s", msg );
+  GString *msg = g_string_new ( NULL );
+  g_string_printf ( msg, "Map Cache size is %s with %d items", msg_sz, a_mapcache_get_count());
   g_free ( msg_sz );
-  g_free ( msg );
+
+  // Breakdown by map type
+  GHashTable *sizes = a_mapcache_get_type_sizes ();
+  GList *types = g_list_sort ( g_hash_table_get_keys(sizes), cache_info_type_compare );
+  for ( GList *iter = types; iter; iter = iter->next ) {
+    gchar *type_sz = g_format_size ( GPOINTER_TO_SIZE(g_hash_table_lookup(sizes, iter->data)) );
+    g_string_append_printf ( msg, "\nMap type %u: %s", GPOINTER_TO_UINT(iter->data), type_sz );
+    g_free ( type_sz );
+  }
+  g_list_free ( types );
+  g_hash_table_destroy ( sizes );
+
+  a_dialog_info_msg_extra ( GTK_WINDOW(vw), "%s", msg->str );
+  g_string_free ( msg, TRUE );
 }
 
 static void back_forward_info_cb ( GtkAction *a, VikWindow *vw )
@@ -5159,6 +5179,72 @@ void vik_window_open_file ( VikWindow *vw, const gchar *filename, gboolean chang
   vik_window_clear_busy_cursor ( vw );
 }
 
+typedef struct {
+  VikWindow *vw;
+  VikAggregateLayer *agg;
+  gboolean had_filename;
+} OpenGpxFilesT;
+
+static void open_gpx_files_cb ( OpenGpxFilesT *ogf, guint added, GSList *failures, gboolean complete )
+{
+  VikWindow *vw = ogf->vw;
+  if ( vw ) {
+    if ( failures ) {
+      for ( GSList *iter = failures; iter; iter = g_slist_next(iter) )
+        g_warning ( "%s: could not open %s", __FUNCTION__, (gchar*)iter->data );
+      guint nn = g_slist_length ( failures );
+      gchar *msg = g_strdup_printf ( ngettext("Unable to load %d GPX file", "Unable to load %d GPX files", nn), nn );
+      vik_statusbar_set_message ( vw->viking_vs, VIK_STATUSBAR_INFO, msg );
+      g_free ( msg );
+    }
+    if ( added ) {
+      vw->number_loaded += added;
+      if ( ogf->had_filename )
+        // Load was into existing project
+        vik_window_set_modified ( vw );
+      draw_update ( vw );
+    }
+    if ( complete ) {
+      vik_aggregate_layer_file_load_complete ( ogf->agg );
+      draw_update ( vw );
+      vik_layers_panel_calendar_update ( vw->viking_vlp );
+      if ( !vw->filename && vw->modified )
+        set_modified_title ( vw );
+    }
+  }
+  if ( complete ) {
+    if ( ogf->vw )
+      g_object_remove_weak_pointer ( G_OBJECT(ogf->vw), (gpointer*)&ogf->vw );
+    g_free ( ogf );
+  }
+}
+
+/**
+ * vik_window_open_gpx_files:
+ * @files: List of filenames, which is consumed
+ * @external: Whether the new layers should refer to the files externally
+ *
+ * Start loading the GPX files in @files into new layers, reading them concurrently in the background.
+ * Only worthwhile when there are several files, so with fewer the list is returned untouched.
+ *
+ * Returns: The list of the other files, which should be opened via vik_window_open_file()
+ */
+GSList *vik_window_open_gpx_files ( VikWindow *vw, GSList *files, gboolean external )
+{
+  if ( g_slist_length(files) < 2 || a_vik_get_open_files_in_selected_layer() )
+    return files;
+
+  OpenGpxFilesT *ogf = g_malloc0 ( sizeof(OpenGpxFilesT) );
+  ogf->vw = vw;
+  ogf->agg = vik_layers_panel_get_top_layer ( vw->viking_vlp );
+  ogf->had_filename = (vw->filename != NULL);
+  g_object_add_weak_pointer ( G_OBJECT(vw), (gpointer*)&ogf->vw );
+  // Data will be there, even though not yet
+  vw->loaded_type = LOAD_TYPE_OTHER_SUCCESS;
+
+  return a_file_load_gpx_files ( ogf->agg, vw->viking_vvp, files, external, (VikFileLoadFunc)open_gpx_files_cb, ogf );
+}
+
 static void load_file ( GtkAction *a, VikWindow *vw )
 {
   GSList *files = NULL;
@@ -5189,6 +5275,8 @@ static void load_file ( GtkAction *a, VikWindow *vw )
       // NB: GSList & contents of 'files' are freed by open_window()
     }
     else {
+      if ( !append )
+        files = vik_window_open_gpx_files ( vw, files, external );
       guint file_num = 0;
       guint num_files = g_slist_length(files);
       gboolean change_fn = !append && (num_files==1); // only change fn if one file
@@ -5827,7 +5915,9 @@ static void save_image_file ( VikWindow *vw, const gchar *fn, guint w, guint h,
   vik_viewport_configure_manually ( vw->viking_vvp, w, h );
 
   /* draw all layers */
+  vik_viewport_set_draw_synchronous ( vw->viking_vvp, TRUE );
   draw_redraw ( vw );
+  vik_viewport_set_draw_synchronous ( vw->viking_vvp, FALSE );
 
   /* save buffer as file. */
   GdkPixbuf *pixbuf_to_save = vik_viewport_get_pixbuf ( vw->viking_vvp, w, h );
@@ -5917,7 +6007,9 @@ static void save_image_dir ( VikWindow *vw, const gchar *fn, guint w, guint h, g
       /* move to correct place. */
       vik_viewport_set_center_utm ( vw->viking_vvp, &utm, FALSE );
 
+      vik_viewport_set_draw_synchronous ( vw->viking_vvp, TRUE );
       draw_redraw ( vw );
+      vik_viewport_set_draw_synchronous ( vw->viking_vvp, FALSE );
 
       /* save buffer as file. */
       GdkPixbuf *pixbuf_to_save = vik_viewport_get_pixbuf ( vw->viking_vvp, w, h );
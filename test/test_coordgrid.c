@@ -0,0 +1,84 @@
+// Copyright: CC0
+// Check finding equalish positions via the coordinate grid against comparing every pair
+#include <stdio.h>
+#include "coordgrid.h"
+
+#define POINTS 4000
+#define RUNS 20
+
+static int failures = 0;
+static VikCoord coords[POINTS];
+static guint symbols[POINTS];
+
+static void check_uint ( const gchar *what, guint run, guint v1, guint v2 )
+{
+  if ( v1 == v2 )
+    return;
+  printf ( "%s[%u]: %u != %u\n", what, run, v1, v2 );
+  failures++;
+}
+
+static gboolean same_symbol ( gpointer data, gpointer user_data )
+{
+  return symbols[GPOINTER_TO_UINT(data)-1] == GPOINTER_TO_UINT(user_data);
+}
+
+int main ( int argc, char *argv[] )
+{
+  GRand *rand = g_rand_new_with_seed ( 42 );
+
+  for ( guint run = 0; run < RUNS; run++ ) {
+    // Keep the points close together (within a few tolerances) so there are plenty of near misses,
+    //  with every other run in UTM, including negative values
+    VikCoordMode mode = run % 2 ? VIK_COORD_UTM : VIK_COORD_LATLON;
+    gdouble spread = VIK_COORD_EQUALISH_TOLERANCE * g_rand_double_range ( rand, 5, 100 );
+    gdouble base_ns = g_rand_double_range ( rand, -80, 80 );
+    gdouble base_ew = g_rand_double_range ( rand, -170, 170 );
+    CoordGrid *cg = coord_grid_new ();
+    guint kept = 0;
+
+    for ( guint ii = 0; ii < POINTS; ii++ ) {
+      coords[ii].mode = mode;
+      coords[ii].utm_zone = mode == VIK_COORD_UTM ? g_rand_int_range ( rand, 30, 32 ) : 0;
+      coords[ii].utm_letter = 'N';
+      coords[ii].north_south = base_ns + g_rand_double_range ( rand, 0, spread );
+      coords[ii].east_west = base_ew + g_rand_double_range ( rand, 0, spread );
+      // Sometimes exactly the same place
+      if ( ii && g_rand_int_range ( rand, 0, 10 ) == 0 )
+        coords[ii] = coords[g_rand_int_range ( rand, 0, ii )];
+      symbols[ii] = g_rand_int_range ( rand, 0, 3 );
+
+      // Brute force for a previously kept point
+      gboolean expected = FALSE;
+      for ( guint jj = 0; jj < ii && !expected; jj++ )
+        expected = symbols[jj] < G_MAXUINT &&
+                   vik_coord_equalish ( &coords[jj], &coords[ii] ) &&
+                   ( run % 4 < 2 || symbols[jj] == symbols[ii] );
+
+      gpointer found;
+      if ( run % 4 < 2 )
+        found = coord_grid_find_equalish ( cg, &coords[ii], NULL, NULL );
+      else
+        found = coord_grid_find_equalish ( cg, &coords[ii], same_symbol, GUINT_TO_POINTER(symbols[ii]) );
+      check_uint ( "found", run, found != NULL, expected );
+      if ( found ) {
+        guint jj = GPOINTER_TO_UINT(found) - 1;
+        check_uint ( "equalish", run, vik_coord_equalish ( &coords[jj], &coords[ii] ), TRUE );
+        // Mark as not kept
+        symbols[ii] = G_MAXUINT;
+      }
+      else {
+        coord_grid_add ( cg, &coords[ii], GUINT_TO_POINTER(ii+1) );
+        kept++;
+      }
+    }
+    check_uint ( "size", run, coord_grid_size(cg), kept );
+    coord_grid_free ( cg );
+  }
+
+  g_rand_free ( rand );
+
+  if ( failures )
+    printf ( "%d failures\n", failures );
+  return failures ? 1 : 0;
+}
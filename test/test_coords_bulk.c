@@ -0,0 +1,77 @@
+// Copyright: CC0
+// Check that the bulk coordinate functions give the same values as the single point ones
+#include <stdio.h>
+#include <math.h>
+#include "vikcoord.h"
+
+#define NUM_POINTS 5000
+
+static int failures = 0;
+
+static void check_double ( const gchar *what, guint ii, gdouble v1, gdouble v2 )
+{
+  if ( v1 == v2 )
+    return;
+  printf ( "%s[%u]: %.9f != %.9f\n", what, ii, v1, v2 );
+  failures++;
+}
+
+static void check_diffs ( const VikCoord *coords, gdouble *diffs )
+{
+  gdouble total = vik_coord_diff_n ( coords, NUM_POINTS, diffs );
+  gdouble expected_total = 0.0;
+  check_double ( "diff", 0, diffs[0], 0.0 );
+  for ( guint ii = 1; ii < NUM_POINTS; ii++ ) {
+    gdouble diff = vik_coord_diff ( &coords[ii], &coords[ii-1] );
+    check_double ( "diff", ii, diffs[ii], diff );
+    expected_total += diff;
+  }
+  check_double ( "total", 0, total, expected_total );
+}
+
+int main ( int argc, char *argv[] )
+{
+  VikCoord *coords = g_malloc ( sizeof(VikCoord) * NUM_POINTS );
+  gdouble *diffs = g_malloc ( sizeof(gdouble) * NUM_POINTS );
+
+  // A wiggly line, with some jumps across the world (and so through different UTM zones)
+  for ( guint ii = 0; ii < NUM_POINTS; ii++ ) {
+    struct LatLon ll = { 51.0 + ii * 0.0001, -1.8 + sin(ii * 0.01) * 0.01 };
+    if ( ii % 1000 == 999 ) {
+      ll.lat = -70.0 + (ii / 1000) * 31.0;
+      ll.lon = -170.0 + (ii / 1000) * 67.0;
+    }
+    vik_coord_load_from_latlon ( &coords[ii], VIK_COORD_LATLON, &ll );
+  }
+
+  for ( gint mode = VIK_COORD_UTM; mode <= VIK_COORD_LATLON; mode++ ) {
+    VikCoord *expected = g_memdup ( coords, sizeof(VikCoord) * NUM_POINTS );
+    for ( guint ii = 0; ii < NUM_POINTS; ii++ )
+      vik_coord_convert ( &expected[ii], mode );
+    vik_coord_convert_n ( coords, NUM_POINTS, mode );
+
+    for ( guint ii = 0; ii < NUM_POINTS; ii++ ) {
+      check_double ( "north_south", ii, coords[ii].north_south, expected[ii].north_south );
+      check_double ( "east_west", ii, coords[ii].east_west, expected[ii].east_west );
+      if ( mode == VIK_COORD_UTM && (coords[ii].utm_zone != expected[ii].utm_zone || coords[ii].utm_letter != expected[ii].utm_letter) ) {
+        printf ( "utm zone[%u]: %d%c != %d%c\n", ii, coords[ii].utm_zone, coords[ii].utm_letter, expected[ii].utm_zone, expected[ii].utm_letter );
+        failures++;
+      }
+    }
+    g_free ( expected );
+
+    check_diffs ( coords, diffs );
+  }
+
+  // Some points in each mode
+  for ( guint ii = 0; ii < NUM_POINTS; ii += 3 )
+    vik_coord_convert ( &coords[ii], VIK_COORD_UTM );
+  check_diffs ( coords, diffs );
+
+  g_free ( coords );
+  g_free ( diffs );
+
+  if ( failures )
+    printf ( "%d failures\n", failures );
+  return failures ? 1 : 0;
+}
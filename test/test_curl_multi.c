@@ -0,0 +1,396 @@
+// Copyright: CC0
+// Check the queued downloads against a minimal HTTP server on the loopback interface:
+//  that they start in order of priority, keep to the per server limit
+//  and that cancelling a group stops both those queued and those in progress
+#include <stdio.h>
+#include <string.h>
+#include <gio/gio.h>
+#include "curl_download.h"
+#include "settings.h"
+
+// Seconds
+#define TIMEOUT 10
+
+static int failures = 0;
+
+static void check_bool ( const gchar *what, gboolean value )
+{
+  if ( value )
+    return;
+  printf ( "%s: failed\n", what );
+  failures++;
+}
+
+/*
+ * The server, listening on two ports - so appearing as two servers to the downloads
+ *  Paths starting "/slow" are answered after a short delay
+ *  Paths starting "/hold" get part of the response, then the rest once released
+ *  Anything else is answered straight away
+ */
+static struct {
+  GMutex mutex;
+  GCond cond;
+  GSocket *sockets[2];
+  guint16 ports[2];
+  GCancellable *cancel;
+  GThread *threads[2];
+  GPtrArray *paths;         // In order of arrival
+  GHashTable *host_active;  // Requests in progress by Host header
+  guint active;
+  guint max_active;
+  guint max_host_active;
+  gboolean released;
+} server;
+
+static gboolean send_all ( GSocket *socket, const gchar *data, gsize len )
+{
+  while ( len ) {
+    gssize sent = g_socket_send ( socket, data, len, NULL, NULL );
+    if ( sent <= 0 )
+      return FALSE;
+    data += sent;
+    len -= sent;
+  }
+  return TRUE;
+}
+
+static gpointer connection_thread ( gpointer data )
+{
+  GSocket *socket = data;
+  GString *request = g_string_new ( NULL );
+  gchar buf[1024];
+
+  g_socket_set_timeout ( socket, TIMEOUT );
+  while ( !strstr(request->str, "\r\n\r\n") ) {
+    gssize got = g_socket_receive ( socket, buf, sizeof(buf), NULL, NULL );
+    if ( got <= 0 )
+      break;
+    g_string_append_len ( request, buf, got );
+  }
+
+  gchar **lines = g_strsplit ( request->str, "\r\n", -1 );
+  gchar **words = g_strsplit ( lines[0] ? lines[0] : "", " ", 3 );
+  gchar *path = g_strdup ( words[0] && words[1] ? words[1] : "" );
+  gchar *host = NULL;
+  for ( guint ii = 1; lines[ii] && !host; ii++ )
+    if ( !g_ascii_strncasecmp(lines[ii], "Host: ", 6) )
+      host = g_strdup ( lines[ii] + 6 );
+  if ( !host )
+    host = g_strdup ( "" );
+  g_strfreev ( words );
+  g_strfreev ( lines );
+  g_string_free ( request, TRUE );
+
+  g_mutex_lock ( &server.mutex );
+  g_ptr_array_add ( server.paths, g_strdup(path) );
+  guint host_active = GPOINTER_TO_UINT ( g_hash_table_lookup(server.host_active, host) ) + 1;
+  g_hash_table_insert ( server.host_active, g_strdup(host), GUINT_TO_POINTER(host_active) );
+  server.max_host_active = MAX ( server.max_host_active, host_active );
+  server.active++;
+  server.max_active = MAX ( server.max_active, server.active );
+  g_cond_broadcast ( &server.cond );
+  g_mutex_unlock ( &server.mutex );
+
+  const gchar body[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+  gchar *header = g_strdup_printf ( "HTTP/1.1 200 OK\r\nContent-Length: %d\r\nConnection: close\r\n\r\n", (gint)strlen(body) );
+  if ( g_str_has_prefix(path, "/slow") )
+    g_usleep ( G_USEC_PER_SEC / 5 );
+  if ( g_str_has_prefix(path, "/hold") ) {
+    if ( send_all(socket, header, strlen(header)) && send_all(socket, body, 10) ) {
+      gint64 end_time = g_get_monotonic_time () + TIMEOUT * G_TIME_SPAN_SECOND;
+      g_mutex_lock ( &server.mutex );
+      while ( !server.released && g_get_monotonic_time() < end_time )
+        (void)g_cond_wait_until ( &server.cond, &server.mutex, end_time );
+      g_mutex_unlock ( &server.mutex );
+      (void)send_all ( socket, body + 10, strlen(body) - 10 );
+    }
+  }
+  else if ( send_all(socket, header, strlen(header)) )
+    (void)send_all ( socket, body, strlen(body) );
+  g_free ( header );
+
+  g_mutex_lock ( &server.mutex );
+  server.active--;
+  host_active = GPOINTER_TO_UINT ( g_hash_table_lookup(server.host_active, host) ) - 1;
+  g_hash_table_insert ( server.host_active, g_strdup(host), GUINT_TO_POINTER(host_active) );
+  g_cond_broadcast ( &server.cond );
+  g_mutex_unlock ( &server.mutex );
+
+  g_socket_close ( socket, NULL );
+  g_object_unref ( socket );
+  g_free ( path );
+  g_free ( host );
+  return NULL;
+}
+
+static gpointer server_thread ( gpointer data )
+{
+  GSocket *socket = data;
+  GSocket *client;
+  while ( (client = g_socket_accept(socket, server.cancel, NULL)) )
+    g_thread_unref ( g_thread_new("connection", connection_thread, client) );
+  return NULL;
+}
+
+static gboolean server_start ( void )
+{
+  server.paths = g_ptr_array_new_with_free_func ( g_free );
+  server.host_active = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+  server.cancel = g_cancellable_new ();
+
+  for ( guint ss = 0; ss < G_N_ELEMENTS(server.sockets); ss++ ) {
+    server.sockets[ss] = g_socket_new ( G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, NULL );
+    if ( !server.sockets[ss] )
+      return FALSE;
+    GInetAddress *loopback = g_inet_address_new_loopback ( G_SOCKET_FAMILY_IPV4 );
+    GSocketAddress *address = g_inet_socket_address_new ( loopback, 0 );
+    gboolean ok = g_socket_bind ( server.sockets[ss], address, TRUE, NULL ) && g_socket_listen ( server.sockets[ss], NULL );
+    g_object_unref ( address );
+    g_object_unref ( loopback );
+    if ( !ok )
+      return FALSE;
+
+    address = g_socket_get_local_address ( server.sockets[ss], NULL );
+    server.ports[ss] = g_inet_socket_address_get_port ( G_INET_SOCKET_ADDRESS(address) );
+    g_object_unref ( address );
+    server.threads[ss] = g_thread_new ( "server", server_thread, server.sockets[ss] );
+  }
+  return TRUE;
+}
+
+static void server_stop ( void )
+{
+  g_mutex_lock ( &server.mutex );
+  server.released = TRUE;
+  g_cond_broadcast ( &server.cond );
+  // Let the connections finish
+  gint64 end_time = g_get_monotonic_time () + TIMEOUT * G_TIME_SPAN_SECOND;
+  while ( server.active && g_cond_wait_until(&server.cond, &server.mutex, end_time) );
+  g_mutex_unlock ( &server.mutex );
+
+  g_cancellable_cancel ( server.cancel );
+  for ( guint ss = 0; ss < G_N_ELEMENTS(server.sockets); ss++ ) {
+    if ( server.threads[ss] )
+      g_thread_join ( server.threads[ss] );
+    if ( server.sockets[ss] ) {
+      g_socket_close ( server.sockets[ss], NULL );
+      g_object_unref ( server.sockets[ss] );
+    }
+  }
+  g_object_unref ( server.cancel );
+  g_hash_table_destroy ( server.host_active );
+  g_ptr_array_free ( server.paths, TRUE );
+}
+
+/*
+ * The downloads
+ */
+typedef struct {
+  CurlDownloadOptions cdo;
+  gboolean done;
+  CURL_download_t result;
+} Download;
+
+static GMutex done_mutex;
+static GCond done_cond;
+
+static void download_done ( CURL_download_t result, gpointer user_data )
+{
+  Download *dl = user_data;
+  g_mutex_lock ( &done_mutex );
+  dl->result = result;
+  dl->done = TRUE;
+  g_cond_broadcast ( &done_cond );
+  g_mutex_unlock ( &done_mutex );
+}
+
+// @ss: Which server
+static Download *download_add ( guint ss, const gchar *path, gdouble priority, guint group )
+{
+  Download *dl = g_malloc0 ( sizeof(Download) );
+  dl->cdo.content = g_byte_array_new ();
+  gchar *host = g_strdup_printf ( "http://127.0.0.1:%d", server.ports[ss] );
+  if ( !curl_download_multi_add(host, path, NULL, NULL, FALSE, &dl->cdo, priority, group, download_done, dl) ) {
+    dl->done = TRUE;
+    dl->result = CURL_DOWNLOAD_ERROR;
+  }
+  g_free ( host );
+  return dl;
+}
+
+static void download_free ( Download *dl )
+{
+  g_byte_array_unref ( dl->cdo.content );
+  g_free ( dl );
+}
+
+// Returns: Whether all the downloads completed in time
+static gboolean downloads_wait ( Download **dls, guint count )
+{
+  gint64 end_time = g_get_monotonic_time () + TIMEOUT * G_TIME_SPAN_SECOND;
+  gboolean all = FALSE;
+  g_mutex_lock ( &done_mutex );
+  while ( !all ) {
+    all = TRUE;
+    for ( guint ii = 0; ii < count; ii++ )
+      all = all && dls[ii]->done;
+    if ( !all && !g_cond_wait_until(&done_cond, &done_mutex, end_time) )
+      break;
+  }
+  g_mutex_unlock ( &done_mutex );
+  return all;
+}
+
+// Returns: Whether the server got the request in time
+static gboolean server_wait_for ( const gchar *path )
+{
+  gint64 end_time = g_get_monotonic_time () + TIMEOUT * G_TIME_SPAN_SECOND;
+  gboolean found = FALSE;
+  g_mutex_lock ( &server.mutex );
+  while ( !found ) {
+    for ( guint ii = 0; ii < server.paths->len && !found; ii++ )
+      found = !g_strcmp0 ( g_ptr_array_index(server.paths, ii), path );
+    if ( !found && !g_cond_wait_until(&server.cond, &server.mutex, end_time) )
+      break;
+  }
+  g_mutex_unlock ( &server.mutex );
+  return found;
+}
+
+static void server_reset ( void )
+{
+  g_mutex_lock ( &server.mutex );
+  g_ptr_array_set_size ( server.paths, 0 );
+  server.max_active = 0;
+  server.max_host_active = 0;
+  server.released = FALSE;
+  g_mutex_unlock ( &server.mutex );
+}
+
+static void server_release ( void )
+{
+  g_mutex_lock ( &server.mutex );
+  server.released = TRUE;
+  g_cond_broadcast ( &server.cond );
+  g_mutex_unlock ( &server.mutex );
+}
+
+static void test_priority ( void )
+{
+  const gdouble priorities[] = { 3, 1, 2, 1, 0, 5, 2 };
+  const guint count = G_N_ELEMENTS(priorities);
+  Download *dls[G_N_ELEMENTS(priorities) + 1];
+
+  server_reset ();
+  // Occupy the only connection allowed to the server, so the rest get queued
+  dls[count] = download_add ( 0, "/hold", 0, 0 );
+  check_bool ( "priority hold started", server_wait_for("/hold") );
+  for ( guint ii = 0; ii < count; ii++ ) {
+    gchar *path = g_strdup_printf ( "/prio/%u", ii );
+    dls[ii] = download_add ( 0, path, priorities[ii], 0 );
+    g_free ( path );
+  }
+  server_release ();
+  check_bool ( "priority completed", downloads_wait(dls, count + 1) );
+
+  // Lowest value first, otherwise in the order added
+  const guint expected[] = { 4, 1, 3, 2, 6, 0, 5 };
+  g_mutex_lock ( &server.mutex );
+  gboolean ordered = ( server.paths->len == count + 1 );
+  for ( guint ii = 0; ordered && ii < count; ii++ ) {
+    gchar *path = g_strdup_printf ( "/prio/%u", expected[ii] );
+    ordered = !g_strcmp0 ( g_ptr_array_index(server.paths, ii + 1), path );
+    g_free ( path );
+  }
+  if ( !ordered )
+    for ( guint ii = 0; ii < server.paths->len; ii++ )
+      printf ( "priority request %u: %s\n", ii, (gchar*)g_ptr_array_index(server.paths, ii) );
+  g_mutex_unlock ( &server.mutex );
+  check_bool ( "priority order", ordered );
+
+  for ( guint ii = 0; ii <= count; ii++ ) {
+    check_bool ( "priority result", dls[ii]->result == CURL_DOWNLOAD_NO_ERROR && dls[ii]->cdo.content->len == 36 );
+    download_free ( dls[ii] );
+  }
+}
+
+// Each server is limited to one transfer at a time
+static void test_host_limit ( void )
+{
+  Download *dls[8];
+  server_reset ();
+  for ( guint ii = 0; ii < G_N_ELEMENTS(dls); ii++ ) {
+    gchar *path = g_strdup_printf ( "/slow/%u", ii );
+    dls[ii] = download_add ( ii % 2, path, ii, 0 );
+    g_free ( path );
+  }
+  check_bool ( "host limit completed", downloads_wait(dls, G_N_ELEMENTS(dls)) );
+
+  g_mutex_lock ( &server.mutex );
+  check_bool ( "host limit requests", server.paths->len == G_N_ELEMENTS(dls) );
+  check_bool ( "host limit kept", server.max_host_active == 1 );
+  // Rather than a limit on the total
+  check_bool ( "host limit per host", server.max_active == 2 );
+  g_mutex_unlock ( &server.mutex );
+
+  for ( guint ii = 0; ii < G_N_ELEMENTS(dls); ii++ ) {
+    check_bool ( "host limit result", dls[ii]->result == CURL_DOWNLOAD_NO_ERROR );
+    download_free ( dls[ii] );
+  }
+}
+
+static void test_cancel ( void )
+{
+  Download *dls[5];
+  Download *other;
+  server_reset ();
+  guint group = curl_download_multi_new_group ();
+  dls[0] = download_add ( 0, "/hold/cancel", 0, group );
+  check_bool ( "cancel hold started", server_wait_for("/hold/cancel") );
+  for ( guint ii = 1; ii < G_N_ELEMENTS(dls); ii++ ) {
+    gchar *path = g_strdup_printf ( "/cancel/%u", ii );
+    dls[ii] = download_add ( 0, path, ii, group );
+    g_free ( path );
+  }
+  // Not in the group, so should be unaffected
+  other = download_add ( 0, "/other", 10, 0 );
+
+  // Without waiting for the server to release the download in progress
+  gint64 start = g_get_monotonic_time ();
+  curl_download_multi_cancel_group ( group, TRUE );
+  check_bool ( "cancel completed", downloads_wait(dls, G_N_ELEMENTS(dls)) );
+  check_bool ( "cancel in time", g_get_monotonic_time() - start < (TIMEOUT / 2) * G_TIME_SPAN_SECOND );
+  for ( guint ii = 0; ii < G_N_ELEMENTS(dls); ii++ )
+    check_bool ( "cancel result", dls[ii]->result == CURL_DOWNLOAD_ABORTED );
+
+  check_bool ( "cancel other completed", downloads_wait(&other, 1) && other->result == CURL_DOWNLOAD_NO_ERROR );
+  g_mutex_lock ( &server.mutex );
+  check_bool ( "cancel queued not requested", server.paths->len == 2 );
+  g_mutex_unlock ( &server.mutex );
+
+  for ( guint ii = 0; ii < G_N_ELEMENTS(dls); ii++ )
+    download_free ( dls[ii] );
+  download_free ( other );
+}
+
+int main ( int argc, char *argv[] )
+{
+  if ( !server_start() ) {
+    printf ( "Failed to start the server\n" );
+    return 1;
+  }
+
+  // Limits applied on first use, without saving them
+  a_settings_init ();
+  a_settings_set_integer ( "curl_multi_transfers", 8 );
+  a_settings_set_integer ( "curl_multi_host_transfers", 1 );
+  curl_download_init ();
+
+  test_priority ();
+  test_host_limit ();
+  test_cancel ();
+
+  curl_download_uninit ();
+  server_stop ();
+  return failures ? 1 : 0;
+}
@@ -31,7 +31,7 @@
 
 #include "metatile.h"
 
-int main ( int argc, char *argv[] )
+static int read_example ( int argc, char *argv[] )
 {
     const int tile_max = METATILE_MAX_SIZE;
     char err_msg[PATH_MAX];
@@ -86,3 +86,136 @@ int main ( int argc, char *argv[] )
     free(buf);
     return 3;
 }
+
+// Like 'mkdir -p' for the directory containing the file
+static int make_parent_dirs ( const char *path )
+{
+    char dir[PATH_MAX];
+    char *pos;
+    snprintf(dir, sizeof(dir), "%s", path);
+    for (pos = strchr(dir + 1, '/'); pos; pos = strchr(pos + 1, '/')) {
+        *pos = 0;
+        if (mkdir(dir, 0777) != 0 && errno != EEXIST)
+            return -1;
+        *pos = '/';
+    }
+    return 0;
+}
+
+// Remove the file and the now empty directories above it, up to and including top
+static void remove_file_and_dirs ( const char *path, const char *top )
+{
+    char dir[PATH_MAX];
+    char *pos;
+    unlink(path);
+    snprintf(dir, sizeof(dir), "%s", path);
+    while ((pos = strrchr(dir, '/')) && strlen(dir) > strlen(top)) {
+        *pos = 0;
+        rmdir(dir);
+    }
+}
+
+/**
+ * Write a meta-tile with a mix of empty and differently sized tiles (twice, so the second replaces the first),
+ *  then check the index offsets in the file and that each tile reads back the same via metatile_read()
+ */
+static int write_read_roundtrip ( void )
+{
+    char top[] = "metatile_roundtrip_XXXXXX";
+    char path[PATH_MAX];
+    char tmp[PATH_MAX];
+    char err_msg[PATH_MAX];
+    char *bufs[METATILE * METATILE];
+    size_t sizes[METATILE * METATILE];
+    char *buf = malloc(METATILE_MAX_SIZE);
+    int x = 4051, y = 2753, z = 13;
+    int mask = METATILE - 1;
+    int failures = 0;
+    int ii, jj, pass;
+
+    if (!buf || !mkdtemp(top)) {
+        fprintf(stderr, "FAILED: roundtrip setup: %s\n", strerror(errno));
+        free(buf);
+        return 4;
+    }
+    (void)xyz_to_meta(path, sizeof(path), top, x, y, z);
+    if (make_parent_dirs(path) != 0) {
+        fprintf(stderr, "FAILED: mkdir for %s: %s\n", path, strerror(errno));
+        free(buf);
+        return 4;
+    }
+
+    for (pass = 0; pass < 2; pass++) {
+        for (ii = 0; ii < METATILE * METATILE; ii++) {
+            // Every fifth tile missing
+            sizes[ii] = (ii % 5 == pass) ? 0 : (size_t)(ii * 37 + pass * 11 + 1);
+            bufs[ii] = sizes[ii] ? malloc(sizes[ii]) : NULL;
+            for (jj = 0; jj < (int)sizes[ii]; jj++)
+                bufs[ii][jj] = (char)(ii + jj * 3 + pass);
+        }
+
+        err_msg[0] = 0;
+        if (metatile_write(top, x, y, z, bufs, sizes, err_msg) != 0) {
+            fprintf(stderr, "FAILED: write pass %d: %s", pass, err_msg);
+            failures++;
+        }
+
+        snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+        if (access(tmp, F_OK) == 0) {
+            fprintf(stderr, "FAILED: temporary file %s left behind\n", tmp);
+            failures++;
+        }
+
+        // Header is magic, count, x, y, z then an offset & size per tile
+        FILE *fp = fopen(path, "rb");
+        int header[5 + 2 * METATILE * METATILE];
+        if (!fp || fread(header, sizeof(header), 1, fp) != 1) {
+            fprintf(stderr, "FAILED: reading header of %s\n", path);
+            failures++;
+        }
+        else {
+            int expected = sizeof(header);
+            if (memcmp(header, "META", 4) || header[1] != METATILE * METATILE ||
+                header[2] != (x & ~mask) || header[3] != (y & ~mask) || header[4] != z) {
+                fprintf(stderr, "FAILED: header values pass %d\n", pass);
+                failures++;
+            }
+            for (ii = 0; ii < METATILE * METATILE; ii++) {
+                if (header[5 + 2*ii] != expected || header[6 + 2*ii] != (int)sizes[ii]) {
+                    fprintf(stderr, "FAILED: index %d pass %d: %d,%d != %d,%d\n",
+                            ii, pass, header[5 + 2*ii], header[6 + 2*ii], expected, (int)sizes[ii]);
+                    failures++;
+                }
+                expected += sizes[ii];
+            }
+        }
+        if (fp)
+            fclose(fp);
+
+        // Tile offset is (x & mask) * METATILE + (y & mask)
+        for (ii = 0; ii < METATILE * METATILE; ii++) {
+            int compressed = -1;
+            int len = metatile_read(top, (x & ~mask) + ii / METATILE, (y & ~mask) + ii % METATILE, z,
+                                    buf, METATILE_MAX_SIZE, &compressed, err_msg);
+            if (len != (int)sizes[ii] || compressed != 0 || (len > 0 && memcmp(buf, bufs[ii], len))) {
+                fprintf(stderr, "FAILED: tile %d pass %d read back %d bytes, expected %d\n", ii, pass, len, (int)sizes[ii]);
+                failures++;
+            }
+        }
+
+        for (ii = 0; ii < METATILE * METATILE; ii++)
+            free(bufs[ii]);
+    }
+
+    remove_file_and_dirs(path, top);
+    free(buf);
+    return failures ? 5 : 0;
+}
+
+int main ( int argc, char *argv[] )
+{
+    int result = read_example(argc, argv);
+    if (result == 0)
+        result = write_read_roundtrip();
+    return result;
+}
@@ -0,0 +1,174 @@
+// Copyright: CC0
+// Check the tile set coverage analysis against simple brute force methods on a grid
+#include <stdio.h>
+#include <string.h>
+#include "tileset.h"
+
+#define GRID 48
+#define RUNS 100
+
+static int failures = 0;
+static gboolean grid[GRID][GRID];
+
+static void check_uint ( const gchar *what, guint run, guint v1, guint v2 )
+{
+  if ( v1 == v2 )
+    return;
+  printf ( "%s[%u]: %u != %u\n", what, run, v1, v2 );
+  failures++;
+}
+
+static gboolean occupied ( gint x, gint y )
+{
+  return x >= 0 && y >= 0 && x < GRID && y < GRID && grid[y][x];
+}
+
+static guint brute_max_square ( void )
+{
+  guint best = 0;
+  for ( gint y = 0; y < GRID; y++ )
+    for ( gint x = 0; x < GRID; x++ )
+      for ( gint sz = best+1; x+sz <= GRID && y+sz <= GRID; sz++ ) {
+        gboolean full = TRUE;
+        for ( gint yy = y; yy < y+sz && full; yy++ )
+          for ( gint xx = x; xx < x+sz && full; xx++ )
+            full = grid[yy][xx];
+        if ( !full )
+          break;
+        best = sz;
+      }
+  return best;
+}
+
+static guint brute_longest_line ( gboolean vertical )
+{
+  guint best = 0;
+  for ( gint aa = 0; aa < GRID; aa++ ) {
+    guint run = 0;
+    for ( gint bb = 0; bb < GRID; bb++ ) {
+      run = ( vertical ? grid[bb][aa] : grid[aa][bb] ) ? run + 1 : 0;
+      best = MAX ( best, run );
+    }
+  }
+  return best;
+}
+
+// Flood fill each region, giving the number of them and the size of the largest
+static guint brute_regions ( guint *largest )
+{
+  static guint8 seen[GRID][GRID];
+  static gint stack[GRID*GRID][2];
+  memset ( seen, 0, sizeof(seen) );
+  guint count = 0;
+  *largest = 0;
+  for ( gint y = 0; y < GRID; y++ )
+    for ( gint x = 0; x < GRID; x++ ) {
+      if ( !grid[y][x] || seen[y][x] )
+        continue;
+      count++;
+      guint size = 0;
+      gint sp = 0;
+      stack[sp][0] = x; stack[sp][1] = y; sp++;
+      seen[y][x] = 1;
+      while ( sp ) {
+        sp--;
+        gint cx = stack[sp][0], cy = stack[sp][1];
+        size++;
+        const gint dirs[4][2] = { {1,0}, {-1,0}, {0,1}, {0,-1} };
+        for ( guint dd = 0; dd < 4; dd++ ) {
+          gint nx = cx + dirs[dd][0], ny = cy + dirs[dd][1];
+          if ( occupied(nx, ny) && !seen[ny][nx] ) {
+            seen[ny][nx] = 1;
+            stack[sp][0] = nx; stack[sp][1] = ny; sp++;
+          }
+        }
+      }
+      *largest = MAX ( *largest, size );
+    }
+  return count;
+}
+
+int main ( int argc, char *argv[] )
+{
+  GRand *rand = g_rand_new_with_seed ( 42 );
+
+  for ( guint run = 0; run < RUNS; run++ ) {
+    TileSet *ts = tile_set_new ();
+    guint count = 0;
+    gint density = g_rand_int_range ( rand, 0, 100 );
+    for ( gint y = 0; y < GRID; y++ )
+      for ( gint x = 0; x < GRID; x++ ) {
+        grid[y][x] = g_rand_int_range ( rand, 0, 100 ) < density;
+        if ( grid[y][x] ) {
+          count++;
+          if ( !tile_set_add ( ts, x, y ) )
+            check_uint ( "add", run, 0, 1 );
+        }
+      }
+    check_uint ( "size", run, tile_set_size(ts), count );
+    // Only added when not already there
+    check_uint ( "add again", run, tile_set_add(ts, 0, 0), !grid[0][0] );
+    grid[0][0] = TRUE;
+
+    gint sx = 0, sy = 0;
+    guint sq = tile_set_max_square ( ts, &sx, &sy );
+    check_uint ( "max square", run, sq, brute_max_square() );
+    for ( guint ii = 0; ii < sq*sq; ii++ )
+      check_uint ( "max square tile", run, occupied(sx + ii % sq, sy + ii / sq), TRUE );
+
+    guint ns, ew;
+    gint nsx, nsy, ewx, ewy;
+    tile_set_longest_lines ( ts, &ns, &nsx, &nsy, &ew, &ewx, &ewy );
+    check_uint ( "north/south", run, ns, brute_longest_line(TRUE) );
+    check_uint ( "east/west", run, ew, brute_longest_line(FALSE) );
+    for ( guint ii = 0; ii < ns; ii++ )
+      check_uint ( "north/south tile", run, occupied(nsx, nsy - ii), TRUE );
+    for ( guint ii = 0; ii < ew; ii++ )
+      check_uint ( "east/west tile", run, occupied(ewx - ii, ewy), TRUE );
+
+    guint label, largest, expected_largest;
+    guint regions = tile_set_label_regions ( ts, &label, &largest );
+    check_uint ( "regions", run, regions, brute_regions(&expected_largest) );
+    check_uint ( "largest region", run, largest, expected_largest );
+    for ( gint y = 0; y < GRID; y++ )
+      for ( gint x = 1; x < GRID; x++ )
+        if ( grid[y][x] && grid[y][x-1] )
+          check_uint ( "label", run, tile_set_get_label(ts, x, y), tile_set_get_label(ts, x-1, y) );
+
+    TileSet *surrounded = tile_set_surrounded ( ts );
+    guint expected = 0;
+    for ( gint y = 0; y < GRID; y++ )
+      for ( gint x = 0; x < GRID; x++ ) {
+        gboolean all = grid[y][x];
+        for ( gint dy = -1; dy <= 1; dy++ )
+          for ( gint dx = -1; dx <= 1; dx++ )
+            all = all && occupied ( x+dx, y+dy );
+        if ( all )
+          expected++;
+        check_uint ( "surrounded tile", run, tile_set_contains(surrounded, x, y), all );
+      }
+    check_uint ( "surrounded", run, tile_set_size(surrounded), expected );
+    tile_set_free ( surrounded );
+
+    TileSet *copy = tile_set_copy ( ts );
+    TileSetIter iter;
+    gint x, y;
+    guint iterated = 0;
+    tile_set_iter_init ( &iter, copy );
+    while ( tile_set_iter_next ( &iter, &x, &y ) ) {
+      iterated++;
+      check_uint ( "iterate", run, occupied(x, y), TRUE );
+    }
+    check_uint ( "copy", run, iterated, tile_set_size(ts) );
+    tile_set_free ( copy );
+
+    check_uint ( "negative", run, tile_set_contains(ts, -1, -1), FALSE );
+    tile_set_free ( ts );
+  }
+
+  g_rand_free ( rand );
+
+  if ( failures )
+    printf ( "%d failures\n", failures );
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,222 @@
+// Copyright: CC0
+// Check tiles written to the tile store files are read back the same, including after
+//  reopening the files, compaction, recovery from a truncated file and many files in use at once
+#include <stdio.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include "tilestore.h"
+
+// More than the number of stores kept open, so some get closed and reopened
+#define FILES 80
+#define THREADS 4
+#define TILES_PER_THREAD 400
+
+static int failures = 0;
+static gchar *dir = NULL;
+
+static void check_bool ( const gchar *what, gboolean value )
+{
+  if ( value )
+    return;
+  printf ( "%s: failed\n", what );
+  failures++;
+}
+
+static gchar *store_name ( guint nn )
+{
+  gchar *name = g_strdup_printf ( "store%u.tiles", nn );
+  gchar *path = g_build_filename ( dir, name, NULL );
+  g_free ( name );
+  return path;
+}
+
+// Content that differs for each tile and version of it
+static GBytes *tile_content ( gint x, gint y, guint version, gsize length )
+{
+  guint8 *data = g_malloc ( length );
+  for ( gsize ii = 0; ii < length; ii++ )
+    data[ii] = (guint8)( x * 7 + y * 13 + version * 31 + ii );
+  return g_bytes_new_take ( data, length );
+}
+
+static gboolean tile_matches ( const gchar *filename, gint x, gint y, guint version, gsize length )
+{
+  GBytes *expected = tile_content ( x, y, version, length );
+  GBytes *content = a_tilestore_read ( filename, x, y );
+  gboolean ok = content && g_bytes_equal ( content, expected );
+  if ( content )
+    g_bytes_unref ( content );
+  g_bytes_unref ( expected );
+  return ok;
+}
+
+static gboolean tile_write ( const gchar *filename, gint x, gint y, guint version, gsize length, const gchar *etag )
+{
+  GBytes *content = tile_content ( x, y, version, length );
+  gboolean ok = a_tilestore_write ( filename, x, y, content, etag );
+  g_bytes_unref ( content );
+  return ok;
+}
+
+static goffset file_size ( const gchar *filename )
+{
+  GStatBuf st;
+  if ( g_stat(filename, &st) != 0 )
+    return -1;
+  return st.st_size;
+}
+
+static void test_put_get_remove ( void )
+{
+  gchar *fn = store_name ( 0 );
+  time_t mtime = 0;
+  gchar *etag = NULL;
+
+  check_bool ( "missing tile", !a_tilestore_get_info(fn, 1, 2, NULL, NULL) && !a_tilestore_read(fn, 1, 2) );
+
+  check_bool ( "write", tile_write(fn, 1, 2, 0, 1000, "\"abc\"") );
+  check_bool ( "write no etag", tile_write(fn, 3, 4, 0, 10, NULL) );
+  check_bool ( "read", tile_matches(fn, 1, 2, 0, 1000) && tile_matches(fn, 3, 4, 0, 10) );
+  check_bool ( "info", a_tilestore_get_info(fn, 1, 2, &mtime, &etag) && mtime > 0 && !g_strcmp0(etag, "\"abc\"") );
+  g_free ( etag );
+  etag = NULL;
+  check_bool ( "info no etag", a_tilestore_get_info(fn, 3, 4, NULL, &etag) && !etag );
+
+  check_bool ( "replace", tile_write(fn, 1, 2, 1, 500, NULL) && tile_matches(fn, 1, 2, 1, 500) );
+  check_bool ( "touch", a_tilestore_touch(fn, 1, 2) && !a_tilestore_touch(fn, 5, 6) );
+
+  check_bool ( "remove", a_tilestore_remove(fn, 3, 4) && !a_tilestore_read(fn, 3, 4) );
+  check_bool ( "remove missing", !a_tilestore_remove(fn, 3, 4) );
+
+  // Now from the file, rather than what was pending
+  a_tilestore_flush ();
+  check_bool ( "read after flush", tile_matches(fn, 1, 2, 1, 500) && !a_tilestore_read(fn, 3, 4) );
+  check_bool ( "touch after flush", a_tilestore_touch(fn, 1, 2) );
+
+  // And with the index rebuilt from the file
+  a_tilestore_uninit ();
+  check_bool ( "read after reopen", tile_matches(fn, 1, 2, 1, 500) && !a_tilestore_read(fn, 3, 4) );
+  check_bool ( "info after reopen", a_tilestore_get_info(fn, 1, 2, &mtime, NULL) && mtime > 0 );
+
+  a_tilestore_uninit ();
+  g_free ( fn );
+}
+
+static void test_compaction ( void )
+{
+  gchar *fn = store_name ( 1 );
+  const gsize length = 64 * 1024;
+
+  // Replacing the same tile leaves well over half the file unused
+  for ( guint version = 0; version < 40; version++ )
+    (void)tile_write ( fn, 7, 8, version, length, NULL );
+  (void)tile_write ( fn, 9, 9, 0, 100, "\"x\"" );
+  a_tilestore_flush ();
+
+  goffset size = file_size ( fn );
+  // Not necessarily down to just the current tiles, depending on when it was last flushed
+  check_bool ( "compacted", size > 0 && size < 40 * length / 2 );
+  check_bool ( "read after compaction", tile_matches(fn, 7, 8, 39, length) && tile_matches(fn, 9, 9, 0, 100) );
+
+  a_tilestore_uninit ();
+  check_bool ( "read compacted after reopen", tile_matches(fn, 7, 8, 39, length) && tile_matches(fn, 9, 9, 0, 100) );
+  a_tilestore_uninit ();
+  g_free ( fn );
+}
+
+static void test_truncated ( void )
+{
+  gchar *fn = store_name ( 2 );
+  (void)tile_write ( fn, 1, 1, 0, 300, NULL );
+  (void)tile_write ( fn, 2, 2, 0, 300, NULL );
+  a_tilestore_uninit ();
+
+  // As if writing the last record was interrupted
+  gchar *contents = NULL;
+  gsize length = 0;
+  check_bool ( "truncate", g_file_get_contents(fn, &contents, &length, NULL) &&
+                           g_file_set_contents(fn, contents, length - 10, NULL) );
+  g_free ( contents );
+
+  check_bool ( "read before truncation", tile_matches(fn, 1, 1, 0, 300) );
+  check_bool ( "truncated tile missing", !a_tilestore_read(fn, 2, 2) );
+
+  // The remnant must not be read back as part of a record
+  (void)tile_write ( fn, 3, 3, 0, 200, NULL );
+  a_tilestore_uninit ();
+  check_bool ( "read after truncation", tile_matches(fn, 1, 1, 0, 300) && tile_matches(fn, 3, 3, 0, 200) );
+  check_bool ( "truncated tile still missing", !a_tilestore_read(fn, 2, 2) );
+  a_tilestore_uninit ();
+  g_free ( fn );
+}
+
+static gchar *files[FILES];
+
+static gpointer writer_thread ( gpointer data )
+{
+  gint tt = GPOINTER_TO_INT ( data );
+  for ( gint nn = 0; nn < TILES_PER_THREAD; nn++ )
+    (void)tile_write ( files[(nn * THREADS + tt) % FILES], tt, nn, 0, 100 + nn, NULL );
+  return NULL;
+}
+
+// Stores get closed and reopened by one thread whilst others are using them
+static void test_many_stores ( void )
+{
+  GThread *threads[THREADS];
+  for ( guint ff = 0; ff < FILES; ff++ )
+    files[ff] = store_name ( 100 + ff );
+
+  for ( gint tt = 0; tt < THREADS; tt++ )
+    threads[tt] = g_thread_new ( "tilestore", writer_thread, GINT_TO_POINTER(tt) );
+  for ( gint tt = 0; tt < THREADS; tt++ )
+    g_thread_join ( threads[tt] );
+
+  for ( gint pass = 0; pass < 2; pass++ ) {
+    guint missing = 0;
+    for ( gint tt = 0; tt < THREADS; tt++ )
+      for ( gint nn = 0; nn < TILES_PER_THREAD; nn++ )
+        if ( !tile_matches(files[(nn * THREADS + tt) % FILES], tt, nn, 0, 100 + nn) )
+          missing++;
+    if ( missing )
+      printf ( "many stores pass %d: %u tiles wrong\n", pass, missing );
+    check_bool ( "many stores", missing == 0 );
+    a_tilestore_uninit ();
+  }
+
+  for ( guint ff = 0; ff < FILES; ff++ )
+    g_free ( files[ff] );
+}
+
+static void remove_dir ( void )
+{
+  GDir *gdir = g_dir_open ( dir, 0, NULL );
+  if ( gdir ) {
+    const gchar *name;
+    while ( (name = g_dir_read_name(gdir)) ) {
+      gchar *path = g_build_filename ( dir, name, NULL );
+      (void)g_remove ( path );
+      g_free ( path );
+    }
+    g_dir_close ( gdir );
+  }
+  (void)g_rmdir ( dir );
+}
+
+int main ( int argc, char *argv[] )
+{
+  dir = g_dir_make_tmp ( "viking-tilestore-XXXXXX", NULL );
+  if ( !dir ) {
+    printf ( "Failed to make a temporary directory\n" );
+    return 1;
+  }
+
+  test_put_get_remove ();
+  test_compaction ();
+  test_truncated ();
+  test_many_stores ();
+
+  remove_dir ();
+  g_free ( dir );
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,132 @@
+// Copyright: CC0
+// Check that statistics kept up to date when adding a trackpoint are correct
+//  and that searching by time finds the same trackpoint as going through the list
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "viktrack.h"
+#include "settings.h"
+
+#define NUM_POINTS 2000
+
+static int failures = 0;
+
+static void check_double ( const gchar *what, gdouble v1, gdouble v2 )
+{
+  if ( (isnan(v1) && isnan(v2)) || v1 == v2 )
+    return;
+  printf ( "%s: %.9f != %.9f\n", what, v1, v2 );
+  failures++;
+}
+
+static void check_bool ( const gchar *what, gboolean v1, gboolean v2 )
+{
+  if ( !v1 == !v2 )
+    return;
+  printf ( "%s: %d != %d\n", what, v1, v2 );
+  failures++;
+}
+
+static void check_close ( const gchar *what, gdouble v1, gdouble v2 )
+{
+  if ( fabs(v1 - v2) <= 1e-9 * MAX(fabs(v1), 1.0) )
+    return;
+  printf ( "%s: %.9f != %.9f\n", what, v1, v2 );
+  failures++;
+}
+
+// The first trackpoint at or after the time
+static GList *linear_search_time ( const VikTrack *trk, gdouble time )
+{
+  for ( GList *iter = trk->trackpoints; iter; iter = iter->next )
+    if ( !isnan(VIK_TRACKPOINT(iter->data)->timestamp) && VIK_TRACKPOINT(iter->data)->timestamp >= time )
+      return iter;
+  return NULL;
+}
+
+static void check_search_time ( const gchar *what, const VikTrack *trk )
+{
+  const gdouble offsets[] = { -10.0, 0.0, 0.5, 5.0, 5.5, 96.0, 1000.0, NUM_POINTS-1, NUM_POINTS, NUM_POINTS+59.5, NUM_POINTS+60, NUM_POINTS+100 };
+  for ( guint ii = 0; ii < G_N_ELEMENTS(offsets); ii++ ) {
+    GList *tpl = NULL;
+    if ( !vik_track_search_time ( trk, 1500000000 + offsets[ii], &tpl ) ) {
+      printf ( "%s: not searchable\n", what );
+      failures++;
+    }
+    else if ( tpl != linear_search_time ( trk, 1500000000 + offsets[ii] ) ) {
+      printf ( "%s: search %.1f differs\n", what, offsets[ii] );
+      failures++;
+    }
+  }
+}
+
+static VikTrack *make_track ( void )
+{
+  VikTrack *trk = vik_track_new ();
+  for ( guint ii = 0; ii < NUM_POINTS; ii++ ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    struct LatLon ll = { 51.0 + ii * 0.0001, -1.8 + sin(ii * 0.01) * 0.01 };
+    vik_coord_load_from_latlon ( &tp->coord, VIK_COORD_LATLON, &ll );
+    tp->newsegment = (ii % 500 == 0 && ii);
+    // Some points without time or altitude
+    if ( ii % 97 != 5 )
+      tp->timestamp = 1500000000 + ii;
+    if ( ii % 89 != 5 )
+      tp->altitude = 100 + 20 * cos(ii * 0.05);
+    if ( ii % 3 == 0 )
+      tp->speed = ii * 0.01;
+    if ( ii % 10 == 0 )
+      tp->heart_rate = 100 + ii % 50;
+    if ( ii % 7 == 0 )
+      tp->cadence = ii % 90;
+    if ( ii % 250 == 0 )
+      vik_trackpoint_set_name ( tp, "name" );
+    if ( ii == 42 )
+      vik_trackpoint_set_extensions ( tp, "<ext/>" );
+    vik_track_add_trackpoint ( trk, tp, FALSE );
+  }
+  vik_track_calculate_bounds ( trk );
+  return trk;
+}
+
+int main ( int argc, char *argv[] )
+{
+  a_settings_init ();
+
+  VikTrack *trk = make_track ();
+  GList *tpl;
+  check_search_time ( "search", trk );
+
+  // Statistics updated when adding a trackpoint should match those calculated afresh
+  gdouble min1, max1, min2, max2;
+  (void)vik_track_get_length ( trk );
+  VikTrackpoint *tp = vik_trackpoint_new ();
+  struct LatLon ll = { 51.3, -1.81 };
+  vik_coord_load_from_latlon ( &tp->coord, VIK_COORD_LATLON, &ll );
+  tp->timestamp = 1500000000 + NUM_POINTS + 60;
+  tp->altitude = 150;
+  vik_track_add_trackpoint ( trk, tp, TRUE );
+  VikTrack *fresh = vik_track_copy ( trk, TRUE );
+  check_double ( "added count", vik_track_get_tp_count(trk), vik_track_get_tp_count(fresh) );
+  check_close ( "added length", vik_track_get_length(trk), vik_track_get_length(fresh) );
+  check_double ( "added duration", vik_track_get_duration(trk, TRUE), vik_track_get_duration(fresh, TRUE) );
+  check_close ( "added average speed", vik_track_get_average_speed(trk), vik_track_get_average_speed(fresh) );
+  check_close ( "added max speed", vik_track_get_max_speed(trk), vik_track_get_max_speed(fresh) );
+  vik_track_get_total_elevation_gain ( trk, &min1, &max1 );
+  vik_track_get_total_elevation_gain ( fresh, &min2, &max2 );
+  check_close ( "added elevation up", min1, min2 );
+  check_close ( "added elevation down", max1, max2 );
+  vik_track_free ( fresh );
+
+  // The time index must be updated for the new trackpoint
+  check_search_time ( "added search", trk );
+  // Times out of order can't be searched
+  VIK_TRACKPOINT(trk->trackpoints->data)->timestamp = 1600000000;
+  vik_track_invalidate_stats ( trk );
+  check_bool ( "unordered search", vik_track_search_time(trk, 1500000000, &tpl), FALSE );
+
+  vik_track_free ( trk );
+  a_settings_uninit ();
+
+  return failures ? 1 : 0;
+}